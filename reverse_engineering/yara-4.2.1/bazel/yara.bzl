@@ -105,6 +105,7 @@ def yara_library(
             "libyara/base64.c",
             "libyara/bitmask.c",
             "libyara/compiler.c",
+            "libyara/compiler_cache.c",
             "libyara/crypto.h",
             "libyara/endian.c",
             "libyara/exception.h",
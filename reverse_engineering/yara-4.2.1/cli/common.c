@@ -71,15 +71,69 @@ char* unicode_to_ansi(const char_t* str)
 }
 #endif
 
-bool compile_files(YR_COMPILER* compiler, int argc, const char_t** argv)
+// Maximum number of files passed at once to yr_compiler_add_files, which are
+// open at the same time.
+#define MAX_FILES_PER_BATCH 256
+
+typedef struct FILES_BATCH
+{
+  int num_files;
+  FILE* rules_files[MAX_FILES_PER_BATCH];
+  const char* namespaces[MAX_FILES_PER_BATCH];
+  const char* file_names[MAX_FILES_PER_BATCH];
+
+} FILES_BATCH;
+
+// Compiles the files in the batch, if any, and closes them. Returns false if
+// some of them has errors.
+static bool compile_batch(YR_COMPILER* compiler, FILES_BATCH* batch, int jobs)
+{
+  int errors = 0;
+
+  if (batch->num_files > 0)
+    errors = yr_compiler_add_files(
+        compiler,
+        batch->num_files,
+        batch->rules_files,
+        batch->namespaces,
+        batch->file_names,
+        jobs);
+
+  for (int i = 0; i < batch->num_files; i++)
+  {
+    fclose(batch->rules_files[i]);
+
+#if defined(_UNICODE)
+    free((char*) batch->namespaces[i]);
+    free((char*) batch->file_names[i]);
+#endif
+  }
+
+  batch->num_files = 0;
+
+  return errors == 0;
+}
+
+// Compiles the files specified in the command-line, except the last argument.
+// With more than one job, several files are parsed in parallel.
+bool compile_files(
+    YR_COMPILER* compiler,
+    int argc,
+    const char_t** argv,
+    int jobs)
 {
+  FILES_BATCH batch;
+
+  int batch_size = jobs > 1 ? MAX_FILES_PER_BATCH : 1;
+
+  batch.num_files = 0;
+
   for (int i = 0; i < argc - 1; i++)
   {
     FILE* rule_file;
     const char_t* ns;
     const char_t* file_name;
     char_t* colon = NULL;
-    int errors;
 
     if (access(argv[i], 0) != 0)
     {
@@ -111,29 +165,31 @@ bool compile_files(YR_COMPILER* compiler, int argc, const char_t** argv)
 
     if (rule_file == NULL)
     {
-      _ftprintf(stderr, _T("error: could not open file: %s\n"), file_name);
+      // The files before this one are compiled first, as they would be if
+      // they were compiled one by one.
+      if (compile_batch(compiler, &batch, jobs))
+        _ftprintf(stderr, _T("error: could not open file: %s\n"), file_name);
+
       return false;
     }
 
-#if defined(_UNICODE)
-    char* file_name_mb = unicode_to_ansi(file_name);
-    char* ns_mb = unicode_to_ansi(ns);
-
-    errors = yr_compiler_add_file(compiler, rule_file, ns_mb, file_name_mb);
+    batch.rules_files[batch.num_files] = rule_file;
 
-    free(file_name_mb);
-    free(ns_mb);
+#if defined(_UNICODE)
+    batch.namespaces[batch.num_files] = unicode_to_ansi(ns);
+    batch.file_names[batch.num_files] = unicode_to_ansi(file_name);
 #else
-    errors = yr_compiler_add_file(compiler, rule_file, ns, file_name);
+    batch.namespaces[batch.num_files] = ns;
+    batch.file_names[batch.num_files] = file_name;
 #endif
 
-    fclose(rule_file);
+    batch.num_files++;
 
-    if (errors > 0)
+    if (batch.num_files == batch_size && !compile_batch(compiler, &batch, jobs))
       return false;
   }
 
-  return true;
+  return compile_batch(compiler, &batch, jobs);
 }
 
 int define_external_variables(
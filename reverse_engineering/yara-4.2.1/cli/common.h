@@ -43,7 +43,8 @@ char* unicode_to_ansi(const char_t* str);
 bool compile_files(
 	YR_COMPILER* compiler,
 	int argc,
-	const char_t** argv);
+	const char_t** argv,
+	int jobs);
 
 int define_external_variables(
 	char** ext_vars,
@@ -0,0 +1,648 @@
+/*
+Copyright (c) 2021. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+
+// In Visual C++ use _taccess_s, in MinGW use _access_s.
+#if defined(_MSC_VER)
+#define access _taccess_s
+#else
+#define access _access_s
+#endif
+
+#define getpid _getpid
+
+#else  // not _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yara.h>
+
+#include "common.h"
+#include "rules_cache.h"
+#include "unicode.h"
+
+// The hash used for identifying the inputs of a compilation and the contents
+// of the files is 64-bit FNV-1a. Files are also compared by size, so a change
+// goes unnoticed only if the changed file has the same size and hash.
+#define HASH_INIT  0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+typedef struct _TEXT
+{
+  char* data;
+  size_t length;
+  size_t capacity;
+  bool failed;
+
+} TEXT;
+
+static uint64_t hash_update(uint64_t hash, const void* data, size_t size)
+{
+  const uint8_t* bytes = (const uint8_t*) data;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= HASH_PRIME;
+  }
+
+  return hash;
+}
+
+static bool hash_file(FILE* fh, uint64_t* size, uint64_t* hash)
+{
+  uint8_t buffer[65536];
+  size_t read;
+
+  *size = 0;
+  *hash = HASH_INIT;
+
+  while ((read = fread(buffer, 1, sizeof(buffer), fh)) > 0)
+  {
+    *size += read;
+    *hash = hash_update(*hash, buffer, read);
+  }
+
+  return !ferror(fh);
+}
+
+static bool hash_file_name(const char* file_name, uint64_t* size, uint64_t* hash)
+{
+  FILE* fh = fopen(file_name, "rb");
+
+  if (fh == NULL)
+    return false;
+
+  bool result = hash_file(fh, size, hash);
+
+  fclose(fh);
+
+  return result;
+}
+
+static void text_append(TEXT* text, const char* fmt, ...)
+{
+  va_list args;
+
+  if (text->failed)
+    return;
+
+  va_start(args, fmt);
+  int length = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+
+  if (length < 0)
+  {
+    text->failed = true;
+    return;
+  }
+
+  if (text->length + length + 1 > text->capacity)
+  {
+    size_t capacity = (text->length + length + 1) * 2;
+    char* data = (char*) realloc(text->data, capacity);
+
+    if (data == NULL)
+    {
+      text->failed = true;
+      return;
+    }
+
+    text->data = data;
+    text->capacity = capacity;
+  }
+
+  va_start(args, fmt);
+  vsnprintf(text->data + text->length, length + 1, fmt, args);
+  va_end(args);
+
+  text->length += length;
+}
+
+static bool read_whole_file(const char* file_name, TEXT* text)
+{
+  char buffer[65536];
+  size_t read;
+
+  FILE* fh = fopen(file_name, "rb");
+
+  if (fh == NULL)
+    return false;
+
+  while ((read = fread(buffer, 1, sizeof(buffer), fh)) > 0)
+    text_append(text, "%.*s", (int) read, buffer);
+
+  bool result = !ferror(fh) && !text->failed;
+
+  fclose(fh);
+
+  return result;
+}
+
+// Writes a file atomically, by writing a temporary file first and renaming it
+// to its final name. This way processes reading the cache never see partially
+// written files.
+static bool write_file(
+    const char* dir,
+    const char* name,
+    YR_RULES* rules,
+    const TEXT* text)
+{
+  char file_name[MAX_PATH];
+  char temp_file_name[MAX_PATH];
+
+  snprintf(file_name, sizeof(file_name), "%s/%s", dir, name);
+
+  snprintf(
+      temp_file_name,
+      sizeof(temp_file_name),
+      "%s/%s.%d.tmp",
+      dir,
+      name,
+      (int) getpid());
+
+  bool result;
+
+  if (rules != NULL)
+  {
+    result = yr_rules_save(rules, temp_file_name) == ERROR_SUCCESS;
+  }
+  else
+  {
+    FILE* fh = fopen(temp_file_name, "wb");
+
+    if (fh == NULL)
+      return false;
+
+    result = fwrite(text->data, 1, text->length, fh) == text->length;
+    result = (fclose(fh) == 0) && result;
+  }
+
+#if defined(_WIN32)
+  result = result && MoveFileExA(
+                         temp_file_name,
+                         file_name,
+                         MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  result = result && rename(temp_file_name, file_name) == 0;
+#endif
+
+  if (!result)
+    remove(temp_file_name);
+
+  return result;
+}
+
+// Returns the file name in a command-line argument specifying a rules file,
+// which can be prefixed with a namespace, as in "namespace:file". See
+// compile_files.
+static const char_t* rules_file_name(const char_t* arg)
+{
+  if (access(arg, 0) == 0)
+    return arg;
+
+  const char_t* colon = _tcschr(arg, ':');
+
+  if (colon && *(colon + 1) != '\\')
+    return colon + 1;
+
+  return arg;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Initializes a cache entry for the rules files in argv, which contains the
+// same arguments received by compile_files. Returns false if the rules can't
+// be cached, for example if they are read from the standard input or if some
+// of the files can't be read.
+//
+bool rules_cache_init(
+    RULES_CACHE* cache,
+    const char* dir,
+    int argc,
+    const char_t** argv,
+    char** ext_vars,
+    const char* atom_quality_table)
+{
+  TEXT inputs = {0};
+  uint32_t max_strings_per_rule;
+  uint64_t size, hash;
+
+  memset(cache, 0, sizeof(RULES_CACHE));
+
+  yr_get_configuration_uint32(
+      YR_CONFIG_MAX_STRINGS_PER_RULE, &max_strings_per_rule);
+
+  text_append(
+      &inputs,
+      "yara %s %d\nmax-strings-per-rule %" PRIu32 "\n",
+      YR_VERSION,
+      YR_ARENA_FILE_VERSION,
+      max_strings_per_rule);
+
+  if (atom_quality_table != NULL)
+  {
+    if (!hash_file_name(atom_quality_table, &size, &hash))
+      goto _fail;
+
+    text_append(
+        &inputs,
+        "atom-quality-table %" PRIu64 " %016" PRIx64 " %s\n",
+        size,
+        hash,
+        atom_quality_table);
+  }
+
+  for (int i = 0; ext_vars[i] != NULL; i++)
+  {
+    if (strchr(ext_vars[i], '\n') != NULL)
+      goto _fail;
+
+    text_append(&inputs, "external %s\n", ext_vars[i]);
+  }
+
+  for (int i = 0; i < argc - 1; i++)
+  {
+    const char_t* file_name = rules_file_name(argv[i]);
+
+    if (_tcscmp(file_name, _T("-")) == 0)
+      goto _fail;
+
+    FILE* fh = _tfopen(file_name, _T("rb"));
+
+    if (fh == NULL)
+      goto _fail;
+
+    bool hashed = hash_file(fh, &size, &hash);
+
+    fclose(fh);
+
+    if (!hashed)
+      goto _fail;
+
+#if defined(_UNICODE)
+    char* arg = unicode_to_ansi(argv[i]);
+#else
+    const char* arg = argv[i];
+#endif
+
+    if (strchr(arg, '\n') == NULL)
+      text_append(
+          &inputs, "rules %" PRIu64 " %016" PRIx64 " %s\n", size, hash, arg);
+    else
+      inputs.failed = true;
+
+#if defined(_UNICODE)
+    free(arg);
+#endif
+  }
+
+  if (inputs.failed)
+    goto _fail;
+
+  snprintf(
+      cache->key,
+      sizeof(cache->key),
+      "%016" PRIx64,
+      hash_update(HASH_INIT, inputs.data, inputs.length));
+
+  cache->dir = dir;
+  cache->inputs = inputs.data;
+  cache->inputs_length = inputs.length;
+
+  return true;
+
+_fail:
+
+  free(inputs.data);
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Checks a description of some rules, as produced by rules_cache_describe,
+// against the inputs of the cache entry and the current contents of the files
+// included by the rules. The description can be followed by a line with the
+// name of the compiled rules file, in which case compiled_offset receives the
+// offset of that line, otherwise it receives the length of the description.
+//
+static bool check_deps(
+    RULES_CACHE* cache,
+    const char* deps,
+    size_t deps_length,
+    bool fail_on_warnings,
+    size_t* compiled_offset)
+{
+  char line[MAX_PATH + 64];
+  bool valid = true;
+
+  *compiled_offset = deps_length;
+
+  if (deps_length < cache->inputs_length ||
+      memcmp(deps, cache->inputs, cache->inputs_length) != 0)
+    return false;
+
+  // What follows the inputs is one line for each included file, the number of
+  // warnings, and optionally the name of the compiled rules file, in that
+  // order.
+  const char* next = deps + cache->inputs_length;
+  const char* end = deps + deps_length;
+
+  // Lines are parsed even after finding that the description is not valid
+  // because the caller may need the name of the compiled rules file for
+  // deleting it. Included files are not hashed in that case.
+  while (next < end)
+  {
+    const char* eol = memchr(next, '\n', end - next);
+    uint64_t size, hash, current_size, current_hash;
+    int warnings, offset;
+
+    if (eol == NULL || eol - next >= (ptrdiff_t) sizeof(line))
+      return false;
+
+    memcpy(line, next, eol - next);
+    line[eol - next] = '\0';
+
+    if (sscanf(line, "include %" SCNu64 " %" SCNx64 " %n", &size, &hash, &offset) ==
+        2)
+    {
+      if (valid &&
+          (!hash_file_name(line + offset, &current_size, &current_hash) ||
+           current_size != size || current_hash != hash))
+        valid = false;
+    }
+    else if (sscanf(line, "warnings %d", &warnings) == 1)
+    {
+      if (fail_on_warnings && warnings > 0)
+        valid = false;
+    }
+    else if (strncmp(line, "compiled ", 9) == 0 && eol + 1 == end)
+    {
+      *compiled_offset = next - deps;
+    }
+    else
+    {
+      valid = false;
+    }
+
+    next = eol + 1;
+  }
+
+  return valid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Builds the description of the rules produced by the compiler, which includes
+// the inputs, the files included by the rules and the number of warnings. The
+// compiler can be NULL if the rules were loaded from a compiled rules file, as
+// they don't include other files. The description is stored in cache->deps.
+// Must be called before destroying the compiler.
+//
+bool rules_cache_describe(
+    RULES_CACHE* cache,
+    YR_COMPILER* compiler,
+    int warnings)
+{
+  TEXT deps = {0};
+  uint64_t size, hash;
+
+  text_append(&deps, "%.*s", (int) cache->inputs_length, cache->inputs);
+
+  const char* included_file = compiler != NULL
+                                  ? yr_compiler_get_included_files(compiler)
+                                  : "";
+
+  while (*included_file != '\0')
+  {
+    if (strchr(included_file, '\n') != NULL ||
+        !hash_file_name(included_file, &size, &hash))
+    {
+      free(deps.data);
+      return false;
+    }
+
+    text_append(
+        &deps,
+        "include %" PRIu64 " %016" PRIx64 " %s\n",
+        size,
+        hash,
+        included_file);
+
+    included_file += strlen(included_file) + 1;
+  }
+
+  text_append(&deps, "warnings %d\n", warnings);
+
+  if (deps.failed)
+  {
+    free(deps.data);
+    return false;
+  }
+
+  free(cache->deps);
+
+  cache->deps = deps.data;
+  cache->deps_length = deps.length;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if the description of some rules produced by
+// rules_cache_describe, possibly in another process, corresponds to the same
+// inputs as the cache entry, and none of the files included by the rules has
+// changed since then. If fail_on_warnings is true rules that produced warnings
+// while being compiled are not accepted.
+//
+bool rules_cache_check(
+    RULES_CACHE* cache,
+    const char* deps,
+    bool fail_on_warnings)
+{
+  size_t compiled_offset;
+  size_t deps_length = strlen(deps);
+
+  return check_deps(
+             cache, deps, deps_length, fail_on_warnings, &compiled_offset) &&
+         compiled_offset == deps_length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Loads the rules from the cache if they were compiled from the same inputs,
+// and none of the files included by them has changed since then. If
+// fail_on_warnings is true rules that produced warnings while being compiled
+// are not loaded, so that the caller compiles them again and fails. When the
+// rules are loaded their description is stored in cache->deps.
+//
+bool rules_cache_load(
+    RULES_CACHE* cache,
+    bool fail_on_warnings,
+    YR_RULES** rules)
+{
+  TEXT deps = {0};
+  char file_name[MAX_PATH];
+  size_t compiled_offset;
+  bool valid;
+
+  snprintf(file_name, sizeof(file_name), "%s/%s.deps", cache->dir, cache->key);
+
+  if (!read_whole_file(file_name, &deps))
+  {
+    free(deps.data);
+    return false;
+  }
+
+  valid = check_deps(
+      cache, deps.data, deps.length, fail_on_warnings, &compiled_offset);
+
+  // The line with the name of the compiled rules file ends with a newline,
+  // which is replaced by the null terminator.
+  char* rules_file = NULL;
+
+  if (compiled_offset < deps.length)
+  {
+    rules_file = deps.data + compiled_offset + 9;
+    deps.data[deps.length - 1] = '\0';
+  }
+
+  if (valid && rules_file != NULL)
+  {
+    snprintf(file_name, sizeof(file_name), "%s/%s", cache->dir, rules_file);
+    valid = yr_rules_load(file_name, rules) == ERROR_SUCCESS;
+  }
+  else
+  {
+    valid = false;
+  }
+
+  if (valid)
+  {
+    deps.data[compiled_offset] = '\0';
+
+    free(cache->deps);
+
+    cache->deps = deps.data;
+    cache->deps_length = compiled_offset;
+  }
+  else
+  {
+    if (rules_file != NULL)
+      cache->stale_rules_file = strdup(rules_file);
+
+    free(deps.data);
+  }
+
+  return valid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stores the rules in the cache. Must be called after rules_cache_describe.
+//
+bool rules_cache_save(RULES_CACHE* cache, YR_RULES* rules)
+{
+  TEXT deps = {0};
+  char rules_file[64];
+  bool result = false;
+
+  if (cache->deps == NULL)
+    return false;
+
+  text_append(&deps, "%.*s", (int) cache->deps_length, cache->deps);
+
+  if (deps.failed)
+    goto _exit;
+
+  // The compiled rules file is named after the contents of the entry, so that
+  // a process loading the rules of an older entry never gets the ones of the
+  // new entry, or vice versa.
+  snprintf(
+      rules_file,
+      sizeof(rules_file),
+      "%s-%016" PRIx64 ".yarc",
+      cache->key,
+      hash_update(HASH_INIT, deps.data, deps.length));
+
+  text_append(&deps, "compiled %s\n", rules_file);
+
+  if (deps.failed)
+    goto _exit;
+
+#if defined(_WIN32)
+  _mkdir(cache->dir);
+#else
+  mkdir(cache->dir, 0700);
+#endif
+
+  char deps_file[32];
+
+  snprintf(deps_file, sizeof(deps_file), "%s.deps", cache->key);
+
+  result = write_file(cache->dir, rules_file, rules, NULL) &&
+           write_file(cache->dir, deps_file, NULL, &deps);
+
+  if (result && cache->stale_rules_file != NULL &&
+      strcmp(cache->stale_rules_file, rules_file) != 0)
+  {
+    char file_name[MAX_PATH];
+
+    snprintf(
+        file_name,
+        sizeof(file_name),
+        "%s/%s",
+        cache->dir,
+        cache->stale_rules_file);
+
+    remove(file_name);
+  }
+
+_exit:
+
+  free(deps.data);
+  return result;
+}
+
+void rules_cache_destroy(RULES_CACHE* cache)
+{
+  free(cache->inputs);
+  free(cache->deps);
+  free(cache->stale_rules_file);
+
+  cache->inputs = NULL;
+  cache->deps = NULL;
+  cache->stale_rules_file = NULL;
+}
@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2021. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RULES_CACHE_H
+#define RULES_CACHE_H
+
+#include <stdbool.h>
+#include <yara.h>
+
+#include "unicode.h"
+
+// Cache of rules compiled by the command-line tool, stored in a directory. Each
+// entry corresponds to a set of rules files compiled with the same external
+// variables and atom quality table, and consists of two files: <key>.deps,
+// which describes everything the compiled rules depend on, and the compiled
+// rules themselves, saved with yr_rules_save. The compiled rules are used only
+// while none of the files they were compiled from, including the ones included
+// by them, has changed.
+typedef struct _RULES_CACHE
+{
+  // Directory where the cache is stored. It's NULL for entries used only for
+  // describing the rules, see rules_cache_describe and rules_cache_check.
+  const char* dir;
+
+  // Hash of the inputs, used for naming the entry's files.
+  char key[17];
+
+  // Description of the inputs that are known before compiling the rules: YARA
+  // version, rules files, external variables and atom quality table. Included
+  // files are known only after compiling.
+  char* inputs;
+  size_t inputs_length;
+
+  // Description of everything the rules depend on: the inputs, the files
+  // included by the rules and the number of warnings. It's known once the rules
+  // are compiled or loaded from the cache, and is also used for checking that
+  // rules published in shared memory with --shared-rules were compiled from the
+  // same inputs.
+  char* deps;
+  size_t deps_length;
+
+  // Name of the compiled rules file referenced by an existing entry that is no
+  // longer valid, it's deleted when the entry is replaced.
+  char* stale_rules_file;
+
+} RULES_CACHE;
+
+bool rules_cache_init(
+    RULES_CACHE* cache,
+    const char* dir,
+    int argc,
+    const char_t** argv,
+    char** ext_vars,
+    const char* atom_quality_table);
+
+bool rules_cache_describe(
+    RULES_CACHE* cache,
+    YR_COMPILER* compiler,
+    int warnings);
+
+bool rules_cache_check(
+    RULES_CACHE* cache,
+    const char* deps,
+    bool fail_on_warnings);
+
+bool rules_cache_load(
+    RULES_CACHE* cache,
+    bool fail_on_warnings,
+    YR_RULES** rules);
+
+bool rules_cache_save(RULES_CACHE* cache, YR_RULES* rules);
+
+void rules_cache_destroy(RULES_CACHE* cache);
+
+#endif
@@ -185,3 +185,76 @@ void cli_thread_join(THREAD* thread)
   pthread_join(*thread, NULL);
 #endif
 }
+
+void cli_thread_sleep(unsigned int microseconds)
+{
+#if defined(_WIN32) || defined(__CYGWIN__)
+  Sleep(microseconds < 1000 ? 1 : microseconds / 1000);
+#else
+  struct timespec ts;
+  ts.tv_sec = microseconds / 1000000;
+  ts.tv_nsec = (microseconds % 1000000) * 1000;
+  nanosleep(&ts, NULL);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Atomically adds "addend" to "value" and returns the resulting value.
+//
+long cli_atomic_add(volatile long* value, long addend)
+{
+#if defined(_WIN32) || defined(__CYGWIN__)
+  return InterlockedExchangeAdd(value, addend) + addend;
+#else
+  return __sync_add_and_fetch(value, addend);
+#endif
+}
+
+int cli_get_cpu_count(void)
+{
+#if defined(_WIN32) || defined(__CYGWIN__)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int) info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int) count : 1;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the CPU time consumed by the calling thread in nanoseconds, or zero
+// if the platform doesn't provide this information.
+//
+uint64_t cli_thread_cpu_time_ns(void)
+{
+#if defined(_WIN32) || defined(__CYGWIN__)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  ULARGE_INTEGER kernel, user;
+
+  if (!GetThreadTimes(
+          GetCurrentThread(),
+          &creation_time,
+          &exit_time,
+          &kernel_time,
+          &user_time))
+    return 0;
+
+  kernel.LowPart = kernel_time.dwLowDateTime;
+  kernel.HighPart = kernel_time.dwHighDateTime;
+  user.LowPart = user_time.dwLowDateTime;
+  user.HighPart = user_time.dwHighDateTime;
+
+  // FILETIME values are expressed in 100-nanosecond intervals.
+  return (kernel.QuadPart + user.QuadPart) * 100;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+  return 0;
+#endif
+}
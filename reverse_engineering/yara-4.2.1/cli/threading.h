@@ -30,6 +30,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef THREADING_H
 #define THREADING_H
 
+#include <stdint.h>
+
 #if defined(_WIN32) || defined(__CYGWIN__)
 #include <windows.h>
 #else
@@ -87,4 +89,12 @@ int cli_create_thread(
 
 void cli_thread_join(THREAD* thread);
 
+void cli_thread_sleep(unsigned int microseconds);
+
+long cli_atomic_add(volatile long* value, long addend);
+
+int cli_get_cpu_count(void);
+
+uint64_t cli_thread_cpu_time_ns(void);
+
 #endif
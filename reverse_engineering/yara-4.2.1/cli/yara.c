@@ -32,12 +32,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // for getline(3)
 #define _POSIX_C_SOURCE 200809L
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for getdents64(2), fstatat(2) and the DT_xxx constants
+#define _GNU_SOURCE
+#endif
+
 #include <dirent.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
 #else
 
 #include <fcntl.h>
@@ -58,6 +67,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "args.h"
 #include "common.h"
+#include "rules_cache.h"
 #include "threading.h"
 #include "unicode.h"
 
@@ -76,6 +86,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_ARGS_EXT_VAR     32
 #define MAX_ARGS_MODULE_DATA 32
 #define MAX_QUEUED_FILES     64
+#define STEAL_BATCH_SIZE     32
+#define IDLE_MIN_SLEEP_US    50
+#define IDLE_MAX_SLEEP_US    1000
+
+// When --adaptive-threads is used the number of active threads is revised
+// every ADAPTIVE_INTERVAL_US, provided that the scanning threads were busy for
+// at least ADAPTIVE_MIN_BUSY_US during that interval.
+#define ADAPTIVE_INTERVAL_US 250000
+#define ADAPTIVE_MIN_BUSY_US 50000
 
 #define exit_with_code(code) \
   {                          \
@@ -98,21 +117,45 @@ typedef struct _CALLBACK_ARGS
 
 } CALLBACK_ARGS;
 
-typedef struct _THREAD_ARGS
+typedef struct _THREAD_STATS
 {
-  YR_SCANNER* scanner;
-  CALLBACK_ARGS callback_args;
-  time_t deadline;
-  int current_count;
+  uint64_t files;
+  uint64_t dirs;
+  uint64_t steals;
+  uint64_t busy_ns;
+  uint64_t cpu_ns;
+  uint64_t idle_ns;
 
-} THREAD_ARGS;
+} THREAD_STATS;
 
 typedef struct _QUEUED_FILE
 {
   char_t* path;
+  bool is_dir;
 
 } QUEUED_FILE;
 
+typedef struct _FILE_LIST
+{
+  QUEUED_FILE* items;
+  int count;
+  int capacity;
+
+} FILE_LIST;
+
+typedef struct _FILE_DEQUE
+{
+  MUTEX mutex;
+
+  // Circular array with room for "capacity" items, "count" of them are
+  // currently in use starting at the "head" position.
+  QUEUED_FILE* items;
+  int capacity;
+  int head;
+  int count;
+
+} FILE_DEQUE;
+
 typedef struct COMPILER_RESULTS
 {
   int errors;
@@ -128,12 +171,25 @@ typedef struct SCAN_OPTIONS
 
 } SCAN_OPTIONS;
 
+typedef struct _THREAD_ARGS
+{
+  YR_SCANNER* scanner;
+  CALLBACK_ARGS callback_args;
+  SCAN_OPTIONS* scan_opts;
+  THREAD_STATS stats;
+  int current_count;
+  int index;
+
+} THREAD_ARGS;
+
 #define MAX_ARGS_TAG         32
 #define MAX_ARGS_IDENTIFIER  32
 #define MAX_ARGS_EXT_VAR     32
 #define MAX_ARGS_MODULE_DATA 32
 
 static char* atom_quality_table;
+static char* rules_cache_dir;
+static char* shared_rules;
 static char* tags[MAX_ARGS_TAG + 1];
 static char* identifiers[MAX_ARGS_IDENTIFIER + 1];
 static char* ext_vars[MAX_ARGS_EXT_VAR + 1];
@@ -144,6 +200,8 @@ static bool recursive_search = false;
 static bool scan_list_search = false;
 static bool show_module_data = false;
 static bool show_tags = false;
+static bool show_scan_stats = false;
+static bool adaptive_threads = false;
 static bool show_stats = false;
 static bool show_strings = false;
 static bool show_string_length = false;
@@ -161,7 +219,8 @@ static long total_count = 0;
 static long limit = 0;
 static long timeout = 1000000;
 static long stack_size = DEFAULT_STACK_SIZE;
-static long threads = YR_MAX_THREADS;
+static long threads = 0;
+static long segment_threads = 1;
 static long max_strings_per_rule = DEFAULT_MAX_STRINGS_PER_RULE;
 static long max_process_memory_chunk = DEFAULT_MAX_PROCESS_MEMORY_CHUNK;
 static long long skip_larger = 0;
@@ -170,6 +229,14 @@ static long long skip_larger = 0;
   "Usage: yara [OPTION]... [NAMESPACE:]RULES_FILE... FILE | DIR | PID"
 
 args_option_t options[] = {
+    OPT_BOOLEAN(
+        0,
+        _T("adaptive-threads"),
+        &adaptive_threads,
+        _T("adjust the number of threads scanning a directory according to")
+        _T(" the time spent waiting for I/O, using up to the NUMBER given")
+        _T(" with --threads")),
+
     OPT_STRING(
         0,
         _T("atom-quality-table"),
@@ -278,6 +345,13 @@ args_option_t options[] = {
         &show_namespace,
         _T("print rules' namespace")),
 
+    OPT_BOOLEAN(
+        0,
+        _T("print-scan-stats"),
+        &show_scan_stats,
+        _T("print files per second and per-thread idle time when scanning a")
+        _T(" directory or a scan list")),
+
     OPT_BOOLEAN(
         'S',
         _T("print-stats"),
@@ -304,12 +378,36 @@ args_option_t options[] = {
         &recursive_search,
         _T("recursively search directories")),
 
+    OPT_STRING(
+        0,
+        _T("rules-cache"),
+        &rules_cache_dir,
+        _T("keep compiled rules in DIRECTORY and reuse them while the rules")
+        _T(" files don't change"),
+        _T("DIRECTORY")),
+
     OPT_BOOLEAN(
         0,
         _T("scan-list"),
         &scan_list_search,
         _T("scan files listed in FILE, one per line")),
 
+    OPT_LONG(
+        0,
+        _T("segment-threads"),
+        &segment_threads,
+        _T("split each file in segments scanned by NUMBER threads")
+        _T(" (default=1)"),
+        _T("NUMBER")),
+
+    OPT_STRING(
+        0,
+        _T("shared-rules"),
+        &shared_rules,
+        _T("use the rules published in the shared memory object NAME, or")
+        _T(" publish them there if it doesn't exist"),
+        _T("NAME")),
+
     OPT_LONG_LONG(
         'z',
         _T("skip-larger"),
@@ -336,7 +434,9 @@ args_option_t options[] = {
         'p',
         _T("threads"),
         &threads,
-        _T("use the specified NUMBER of threads to scan a directory"),
+        _T("use the specified NUMBER of threads to scan a directory")
+        _T(" (default=32, or 4 per CPU with --adaptive-threads; 0 means")
+        _T(" the default)"),
         _T("NUMBER")),
 
     OPT_LONG(
@@ -355,98 +455,382 @@ args_option_t options[] = {
     OPT_END(),
 };
 
-// file_queue is size-limited queue stored as a circular array, files are
-// removed from queue_head position and new files are added at queue_tail
-// position. The array has room for one extra element to avoid queue_head
-// being equal to queue_tail in a full queue. The only situation where
-// queue_head == queue_tail is when queue is empty.
+// Files and directories waiting to be scanned are distributed among the
+// scanning threads, each of them having its own deque. A thread takes items
+// from the front of its deque, and when the item is a directory it reads the
+// directory and puts the entries found at the front of the same deque, in
+// the order they were read. This way a single thread scans the files in the
+// same order as a recursive traversal of the directory would do. When a
+// thread runs out of items it steals up to STEAL_BATCH_SIZE items from the
+// back of some other thread's deque. Directories are also stolen, so the
+// traversal of a directory tree is shared by all threads, and the lock of
+// each deque is rarely contended because most of the time it's used by the
+// thread owning it only.
+
+FILE_DEQUE* file_deques;
+
+int num_file_deques;
+int next_file_deque;
+
+// Only threads with an index lower than this number take items from the
+// queue. It's equal to the number of threads unless --adaptive-threads is
+// used, in which case it's adjusted by adaptive_thread.
+volatile long active_threads;
+
+// Time spent by the scanning threads processing files and CPU time consumed
+// while doing so, in microseconds, since the last time these counters were
+// checked by adaptive_thread.
+volatile long window_busy_us;
+volatile long window_cpu_us;
+
+// Number of items that were put in the deques and haven't been completely
+// processed yet. The main thread holds one extra item while adding files and
+// directories from the command line or the scan list, so the scanning threads
+// don't finish before it's done.
+volatile long pending_files;
 
-QUEUED_FILE file_queue[MAX_QUEUED_FILES + 1];
-
-int queue_head;
-int queue_tail;
-
-SEMAPHORE used_slots;
-SEMAPHORE unused_slots;
-
-MUTEX queue_mutex;
 MUTEX output_mutex;
 
 MODULE_DATA* modules_data_list = NULL;
 
-static int file_queue_init()
+static int file_queue_init(int num_threads)
 {
-  int result;
+  file_deques = (FILE_DEQUE*) calloc(num_threads, sizeof(FILE_DEQUE));
+
+  if (file_deques == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
 
-  queue_tail = 0;
-  queue_head = 0;
+  for (int i = 0; i < num_threads; i++)
+  {
+    file_deques[i].items = NULL;
+    file_deques[i].capacity = 0;
+    file_deques[i].head = 0;
+    file_deques[i].count = 0;
 
-  result = cli_mutex_init(&queue_mutex);
+    int result = cli_mutex_init(&file_deques[i].mutex);
 
-  if (result != 0)
-    return result;
+    if (result != 0)
+      return result;
 
-  result = cli_semaphore_init(&used_slots, 0);
+    // Set num_file_deques as deques are initialized, so file_queue_destroy
+    // doesn't destroy uninitialized mutexes.
+    num_file_deques = i + 1;
+  }
 
-  if (result != 0)
-    return result;
+  next_file_deque = 0;
+  pending_files = 1;
+  active_threads = num_threads;
+  window_busy_us = 0;
+  window_cpu_us = 0;
 
-  return cli_semaphore_init(&unused_slots, MAX_QUEUED_FILES);
+  return 0;
 }
 
 static void file_queue_destroy()
 {
-  cli_mutex_destroy(&queue_mutex);
-  cli_semaphore_destroy(&unused_slots);
-  cli_semaphore_destroy(&used_slots);
+  for (int i = 0; i < num_file_deques; i++)
+  {
+    FILE_DEQUE* deque = &file_deques[i];
+
+    for (int j = 0; j < deque->count; j++)
+      free(deque->items[(deque->head + j) % deque->capacity].path);
+
+    free(deque->items);
+    cli_mutex_destroy(&deque->mutex);
+  }
+
+  free(file_deques);
+
+  file_deques = NULL;
+  num_file_deques = 0;
 }
 
 static void file_queue_finish()
 {
-  for (int i = 0; i < YR_MAX_THREADS; i++) cli_semaphore_release(&used_slots);
+  cli_atomic_add(&pending_files, -1);
+}
+
+static void file_list_free(FILE_LIST* list)
+{
+  for (int i = 0; i < list->count; i++) free(list->items[i].path);
+
+  free(list->items);
+
+  list->items = NULL;
+  list->count = 0;
+  list->capacity = 0;
 }
 
-static int file_queue_put(const char_t* file_path, time_t deadline)
+static int file_list_add(FILE_LIST* list, const char_t* path, bool is_dir)
 {
-  if (cli_semaphore_wait(&unused_slots, deadline) == ERROR_SCAN_TIMEOUT)
-    return ERROR_SCAN_TIMEOUT;
+  if (list->count == list->capacity)
+  {
+    int capacity = list->capacity > 0 ? list->capacity * 2 : MAX_QUEUED_FILES;
+
+    QUEUED_FILE* items = (QUEUED_FILE*) realloc(
+        list->items, capacity * sizeof(QUEUED_FILE));
+
+    if (items == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
 
-  cli_mutex_lock(&queue_mutex);
+    list->items = items;
+    list->capacity = capacity;
+  }
+
+  list->items[list->count].path = _tcsdup(path);
+  list->items[list->count].is_dir = is_dir;
 
-  file_queue[queue_tail].path = _tcsdup(file_path);
-  queue_tail = (queue_tail + 1) % (MAX_QUEUED_FILES + 1);
+  if (list->items[list->count].path == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
 
-  cli_mutex_unlock(&queue_mutex);
-  cli_semaphore_release(&used_slots);
+  list->count++;
 
   return ERROR_SUCCESS;
 }
 
-static char_t* file_queue_get(time_t deadline)
+////////////////////////////////////////////////////////////////////////////////
+// Makes sure that the deque has room for "n" additional items. Must be called
+// with the deque's mutex held.
+//
+static bool file_deque_reserve(FILE_DEQUE* deque, int n)
 {
-  char_t* result;
+  if (deque->count + n <= deque->capacity)
+    return true;
+
+  int capacity = deque->capacity > 0 ? deque->capacity : MAX_QUEUED_FILES;
 
-  if (cli_semaphore_wait(&used_slots, deadline) == ERROR_SCAN_TIMEOUT)
-    return NULL;
+  while (capacity < deque->count + n) capacity *= 2;
 
-  cli_mutex_lock(&queue_mutex);
+  QUEUED_FILE* items = (QUEUED_FILE*) malloc(capacity * sizeof(QUEUED_FILE));
 
-  if (queue_head == queue_tail)  // queue is empty
+  if (items == NULL)
+    return false;
+
+  for (int i = 0; i < deque->count; i++)
+    items[i] = deque->items[(deque->head + i) % deque->capacity];
+
+  free(deque->items);
+
+  deque->items = items;
+  deque->capacity = capacity;
+  deque->head = 0;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Puts "n" items at the front or at the back of the deque, preserving their
+// order. The items must be already accounted in "pending_files". If there's
+// not enough memory the items are discarded.
+//
+static void file_deque_put(
+    FILE_DEQUE* deque,
+    QUEUED_FILE* items,
+    int n,
+    bool front)
+{
+  cli_mutex_lock(&deque->mutex);
+
+  if (!file_deque_reserve(deque, n))
   {
-    result = NULL;
+    cli_mutex_unlock(&deque->mutex);
+
+    for (int i = 0; i < n; i++) free(items[i].path);
+
+    cli_atomic_add(&pending_files, -n);
+
+    cli_mutex_lock(&output_mutex);
+    fprintf(stderr, "error: not enough memory for queueing %d files\n", n);
+    cli_mutex_unlock(&output_mutex);
+    return;
+  }
+
+  int first;
+
+  if (front)
+  {
+    deque->head = (deque->head + deque->capacity - n) % deque->capacity;
+    first = deque->head;
   }
   else
   {
-    result = file_queue[queue_head].path;
-    queue_head = (queue_head + 1) % (MAX_QUEUED_FILES + 1);
+    first = (deque->head + deque->count) % deque->capacity;
+  }
+
+  for (int i = 0; i < n; i++)
+    deque->items[(first + i) % deque->capacity] = items[i];
+
+  deque->count += n;
+
+  cli_mutex_unlock(&deque->mutex);
+}
+
+static bool file_deque_pop_front(FILE_DEQUE* deque, QUEUED_FILE* item)
+{
+  bool result = false;
+
+  cli_mutex_lock(&deque->mutex);
+
+  if (deque->count > 0)
+  {
+    *item = deque->items[deque->head];
+    deque->head = (deque->head + 1) % deque->capacity;
+    deque->count--;
+    result = true;
   }
 
-  cli_mutex_unlock(&queue_mutex);
-  cli_semaphore_release(&unused_slots);
+  cli_mutex_unlock(&deque->mutex);
 
   return result;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Takes up to half of the items in the deque, but no more than "max_items",
+// from the back of it. Returns the number of items copied to "items", which
+// keep the order they had in the deque.
+//
+static int file_deque_steal(
+    FILE_DEQUE* deque,
+    QUEUED_FILE* items,
+    int max_items)
+{
+  cli_mutex_lock(&deque->mutex);
+
+  int n = min((deque->count + 1) / 2, max_items);
+
+  if (n > 0)
+  {
+    int first = (deque->head + deque->count - n) % deque->capacity;
+
+    for (int i = 0; i < n; i++)
+      items[i] = deque->items[(first + i) % deque->capacity];
+
+    deque->count -= n;
+  }
+
+  cli_mutex_unlock(&deque->mutex);
+
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Puts a file or directory found in the command line or in the scan list in
+// one of the deques. Deques are filled in round-robin order and this function
+// blocks while the scanning threads have too many items pending.
+//
+static int file_queue_put(const char_t* path, bool is_dir, time_t deadline)
+{
+  unsigned int sleep_us = IDLE_MIN_SLEEP_US;
+
+  while (cli_atomic_add(&pending_files, 0) > MAX_QUEUED_FILES * num_file_deques)
+  {
+    if (time(NULL) >= deadline)
+      return ERROR_SCAN_TIMEOUT;
+
+    cli_thread_sleep(sleep_us);
+    sleep_us = min(sleep_us * 2, IDLE_MAX_SLEEP_US);
+  }
+
+  QUEUED_FILE file;
+
+  file.path = _tcsdup(path);
+  file.is_dir = is_dir;
+
+  if (file.path == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  cli_atomic_add(&pending_files, 1);
+
+  file_deque_put(&file_deques[next_file_deque], &file, 1, false);
+  next_file_deque = (next_file_deque + 1) % cli_atomic_add(&active_threads, 0);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Gets the next file or directory to be processed by a scanning thread. The
+// thread's own deque is tried first, then the deques of the other threads.
+// Returns false when all the files were processed.
+//
+static bool file_queue_get(THREAD_ARGS* args, QUEUED_FILE* file)
+{
+  QUEUED_FILE stolen[STEAL_BATCH_SIZE];
+  YR_STOPWATCH stopwatch;
+
+  unsigned int sleep_us = IDLE_MIN_SLEEP_US;
+
+  if (args->index < cli_atomic_add(&active_threads, 0) &&
+      file_deque_pop_front(&file_deques[args->index], file))
+    return true;
+
+  yr_stopwatch_start(&stopwatch);
+
+  bool found = false;
+
+  while (!found)
+  {
+    // Inactive threads don't take items, but they keep waiting because they
+    // can be activated again while there are pending files.
+    if (args->index >= cli_atomic_add(&active_threads, 0))
+    {
+      if (cli_atomic_add(&pending_files, 0) == 0)
+        break;
+
+      cli_thread_sleep(IDLE_MAX_SLEEP_US);
+      continue;
+    }
+
+    for (int i = 1; i < num_file_deques && !found; i++)
+    {
+      int victim = (args->index + i) % num_file_deques;
+      int n = file_deque_steal(&file_deques[victim], stolen, STEAL_BATCH_SIZE);
+
+      if (n > 0)
+      {
+        *file = stolen[0];
+
+        if (n > 1)
+          file_deque_put(&file_deques[args->index], &stolen[1], n - 1, false);
+
+        args->stats.steals++;
+        found = true;
+      }
+    }
+
+    // Items may have been put in this thread's deque by the main thread.
+    if (!found)
+      found = file_deque_pop_front(&file_deques[args->index], file);
+
+    if (!found)
+    {
+      if (cli_atomic_add(&pending_files, 0) == 0)
+        break;
+
+      cli_thread_sleep(sleep_us);
+      sleep_us = min(sleep_us * 2, IDLE_MAX_SLEEP_US);
+    }
+  }
+
+  args->stats.idle_ns += yr_stopwatch_elapsed_ns(&stopwatch);
+
+  return found;
+}
+
+static void print_skipped_file(const char_t* path, int64_t size)
+{
+  cli_mutex_lock(&output_mutex);
+
+  _ftprintf(
+      stderr,
+      _T("skipping %s (%" PRId64 " bytes) because it's larger than %lld")
+      _T(" bytes.\n"),
+      path,
+      size,
+      skip_larger);
+
+  cli_mutex_unlock(&output_mutex);
+}
+
 #if defined(_WIN32) || defined(__CYGWIN__)
 
 static bool is_directory(const char_t* path)
@@ -460,7 +844,12 @@ static bool is_directory(const char_t* path)
     return false;
 }
 
-static int scan_dir(const char_t* dir, SCAN_OPTIONS* scan_opts)
+////////////////////////////////////////////////////////////////////////////////
+// Adds to "list" the files in a directory, as well as its subdirectories if
+// the search is recursive. Subdirectories are not read by this function, the
+// scanning thread that takes them from the queue will do it.
+//
+static int read_dir(const char_t* dir, SCAN_OPTIONS* scan_opts, FILE_LIST* list)
 {
   int result = ERROR_SUCCESS;
   char_t path[MAX_PATH];
@@ -484,30 +873,19 @@ static int scan_dir(const char_t* dir, SCAN_OPTIONS* scan_opts)
         file_size.LowPart = FindFileData.nFileSizeLow;
 
         if (skip_larger > file_size.QuadPart || skip_larger <= 0)
-        {
-          result = file_queue_put(path, scan_opts->deadline);
-        }
+          result = file_list_add(list, path, false);
         else
-        {
-          _ftprintf(
-              stderr,
-              _T("skipping %s (%" PRIu64
-                 " bytes) because it's larger than %lld bytes.\n"),
-              path,
-              file_size.QuadPart,
-              skip_larger);
-        }
+          print_skipped_file(path, file_size.QuadPart);
       }
       else if (
           scan_opts->recursive_search &&
           _tcscmp(FindFileData.cFileName, _T(".")) != 0 &&
           _tcscmp(FindFileData.cFileName, _T("..")) != 0)
       {
-        result = scan_dir(path, scan_opts);
+        result = file_list_add(list, path, true);
       }
 
-    } while (result != ERROR_SCAN_TIMEOUT &&
-             FindNextFile(hFind, &FindFileData));
+    } while (result == ERROR_SUCCESS && FindNextFile(hFind, &FindFileData));
 
     FindClose(hFind);
   }
@@ -598,7 +976,7 @@ static int populate_scan_list(const char_t* filename, SCAN_OPTIONS* scan_opts)
 
   char_t* path = _tcstok_s(buf, _T("\n"), &context);
 
-  while (result != ERROR_SCAN_TIMEOUT && path != NULL)
+  while (result == ERROR_SUCCESS && path != NULL)
   {
     // Remove trailing carriage return, if present.
     if (*path != '\0')
@@ -609,10 +987,7 @@ static int populate_scan_list(const char_t* filename, SCAN_OPTIONS* scan_opts)
         *final = '\0';
     }
 
-    if (is_directory(path))
-      result = scan_dir(path, scan_opts);
-    else
-      result = file_queue_put(path, scan_opts->deadline);
+    result = file_queue_put(path, is_directory(path), scan_opts->deadline);
 
     path = _tcstok_s(NULL, _T("\n"), &context);
   }
@@ -634,7 +1009,120 @@ static bool is_directory(const char* path)
   return 0;
 }
 
-static int scan_dir(const char* dir, SCAN_OPTIONS* scan_opts)
+#if defined(__linux__)
+
+// Layout of the entries returned by getdents64(2), which is not declared by
+// older versions of glibc.
+struct linux_dirent64
+{
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds to "list" the files in a directory, as well as its subdirectories if
+// the search is recursive. Subdirectories are not read by this function, the
+// scanning thread that takes them from the queue will do it.
+//
+// The directory is read with getdents64, which returns the type of most
+// entries, so stat is called only for symlinks, for filesystems that don't
+// report the type, and for checking the size of files when --skip-larger
+// is used.
+//
+static int read_dir(const char* dir, SCAN_OPTIONS* scan_opts, FILE_LIST* list)
+{
+  int result = ERROR_SUCCESS;
+  char buffer[32768];
+
+  int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (fd == -1)
+    return ERROR_SUCCESS;
+
+  long nread = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+
+  while (nread > 0 && result == ERROR_SUCCESS)
+  {
+    for (long pos = 0; pos < nread && result == ERROR_SUCCESS;)
+    {
+      struct linux_dirent64* de = (struct linux_dirent64*) (buffer + pos);
+      unsigned char type = de->d_type;
+      char full_path[MAX_PATH];
+      struct stat st;
+      bool have_stat = false;
+
+      pos += de->d_reclen;
+
+      if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+        continue;
+
+      if (type == DT_UNKNOWN)
+      {
+        if (fstatat(fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+          continue;
+
+        type = IFTODT(st.st_mode);
+      }
+
+      // If this directory entry is a symlink and the user doesn't want to
+      // follow symlinks, or if it points to ., skip it. In any other case
+      // use the type of the entry pointed to by the symlink.
+      if (type == DT_LNK)
+      {
+        char buf[2];
+
+        if (!scan_opts->follow_symlinks)
+          continue;
+
+        if (readlinkat(fd, de->d_name, buf, sizeof(buf)) == 1 && buf[0] == '.')
+          continue;
+
+        if (fstatat(fd, de->d_name, &st, 0) != 0)
+          continue;
+
+        type = IFTODT(st.st_mode);
+        have_stat = true;
+      }
+
+      snprintf(full_path, sizeof(full_path), "%s/%s", dir, de->d_name);
+
+      if (type == DT_REG)
+      {
+        if (skip_larger > 0 && !have_stat &&
+            fstatat(fd, de->d_name, &st, 0) != 0)
+          continue;
+
+        if (skip_larger <= 0 || skip_larger > st.st_size)
+          result = file_list_add(list, full_path, false);
+        else
+          print_skipped_file(full_path, st.st_size);
+      }
+      else if (type == DT_DIR && scan_opts->recursive_search)
+      {
+        result = file_list_add(list, full_path, true);
+      }
+    }
+
+    if (result == ERROR_SUCCESS)
+      nread = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+  }
+
+  close(fd);
+
+  return result;
+}
+
+#else
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds to "list" the files in a directory, as well as its subdirectories if
+// the search is recursive. Subdirectories are not read by this function, the
+// scanning thread that takes them from the queue will do it.
+//
+static int read_dir(const char* dir, SCAN_OPTIONS* scan_opts, FILE_LIST* list)
 {
   int result = ERROR_SUCCESS;
   DIR* dp = opendir(dir);
@@ -643,7 +1131,7 @@ static int scan_dir(const char* dir, SCAN_OPTIONS* scan_opts)
   {
     struct dirent* de = readdir(dp);
 
-    while (de && result != ERROR_SCAN_TIMEOUT)
+    while (de && result == ERROR_SUCCESS)
     {
       char full_path[MAX_PATH];
       struct stat st;
@@ -681,25 +1169,15 @@ static int scan_dir(const char* dir, SCAN_OPTIONS* scan_opts)
         if (S_ISREG(st.st_mode))
         {
           if (skip_larger > st.st_size || skip_larger <= 0)
-          {
-            result = file_queue_put(full_path, scan_opts->deadline);
-          }
+            result = file_list_add(list, full_path, false);
           else
-          {
-            fprintf(
-                stderr,
-                "skipping %s (%" PRId64 " bytes) because it's larger than %lld"
-                " bytes.\n",
-                full_path,
-                st.st_size,
-                skip_larger);
-          }
+            print_skipped_file(full_path, st.st_size);
         }
         else if (
             scan_opts->recursive_search && S_ISDIR(st.st_mode) &&
             strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0)
         {
-          result = scan_dir(full_path, scan_opts);
+          result = file_list_add(list, full_path, true);
         }
       }
 
@@ -712,6 +1190,8 @@ static int scan_dir(const char* dir, SCAN_OPTIONS* scan_opts)
   return result;
 }
 
+#endif
+
 static int scan_file(YR_SCANNER* scanner, const char_t* filename)
 {
   YR_FILE_DESCRIPTOR fd = open(filename, O_RDONLY);
@@ -741,7 +1221,7 @@ static int populate_scan_list(const char* filename, SCAN_OPTIONS* scan_opts)
     return ERROR_COULD_NOT_OPEN_FILE;
   }
 
-  while (result != ERROR_SCAN_TIMEOUT &&
+  while (result == ERROR_SUCCESS &&
          (nread = getline(&path, &nsize, fh_scan_list)) != -1)
   {
     // remove trailing newline
@@ -751,10 +1231,7 @@ static int populate_scan_list(const char* filename, SCAN_OPTIONS* scan_opts)
       nread--;
     }
 
-    if (is_directory(path))
-      result = scan_dir(path, scan_opts);
-    else
-      result = file_queue_put(path, scan_opts->deadline);
+    result = file_queue_put(path, is_directory(path), scan_opts->deadline);
   }
 
   free(path);
@@ -1224,58 +1701,225 @@ static int callback(
   return CALLBACK_ERROR;
 }
 
+static void scan_queued_file(THREAD_ARGS* args, const char_t* file_path)
+{
+  args->callback_args.current_count = 0;
+  args->callback_args.file_path = file_path;
+
+  time_t current_time = time(NULL);
+
+  if (current_time >= args->scan_opts->deadline)
+    return;
+
+  yr_scanner_set_timeout(
+      args->scanner, (int) (args->scan_opts->deadline - current_time));
+
+  int result = scan_file(args->scanner, file_path);
+
+  if (print_count_only)
+  {
+    cli_mutex_lock(&output_mutex);
+    _tprintf(_T("%s: %d\n"), file_path, args->callback_args.current_count);
+    cli_mutex_unlock(&output_mutex);
+  }
+
+  if (result != ERROR_SUCCESS)
+  {
+    cli_mutex_lock(&output_mutex);
+    _ftprintf(stderr, _T("error scanning %s: "), file_path);
+    print_scanner_error(args->scanner, result);
+    cli_mutex_unlock(&output_mutex);
+  }
+}
+
+static void scan_queued_dir(THREAD_ARGS* args, const char_t* dir)
+{
+  FILE_LIST list = {NULL, 0, 0};
+
+  if (time(NULL) >= args->scan_opts->deadline)
+    return;
+
+  int result = read_dir(dir, args->scan_opts, &list);
+
+  if (result != ERROR_SUCCESS)
+  {
+    cli_mutex_lock(&output_mutex);
+    _ftprintf(stderr, _T("error reading %s: "), dir);
+    print_error(result);
+    cli_mutex_unlock(&output_mutex);
+
+    file_list_free(&list);
+    return;
+  }
+
+  if (list.count > 0)
+  {
+    cli_atomic_add(&pending_files, list.count);
+    file_deque_put(&file_deques[args->index], list.items, list.count, true);
+  }
+
+  free(list.items);
+}
+
 #if defined(_WIN32) || defined(__CYGWIN__)
 static DWORD WINAPI scanning_thread(LPVOID param)
 #else
 static void* scanning_thread(void* param)
 #endif
 {
-  int result = ERROR_SUCCESS;
   THREAD_ARGS* args = (THREAD_ARGS*) param;
+  QUEUED_FILE file;
 
-  char_t* file_path = file_queue_get(args->deadline);
-
-  while (file_path != NULL)
+  while (file_queue_get(args, &file))
   {
-    args->callback_args.current_count = 0;
-    args->callback_args.file_path = file_path;
+    YR_STOPWATCH stopwatch;
 
-    time_t current_time = time(NULL);
+    uint64_t cpu_time = cli_thread_cpu_time_ns();
 
-    if (current_time < args->deadline)
-    {
-      yr_scanner_set_timeout(
-          args->scanner, (int) (args->deadline - current_time));
+    yr_stopwatch_start(&stopwatch);
 
-      result = scan_file(args->scanner, file_path);
+    if (file.is_dir)
+    {
+      scan_queued_dir(args, file.path);
+      args->stats.dirs++;
+    }
+    else
+    {
+      scan_queued_file(args, file.path);
+      args->stats.files++;
+    }
 
-      if (print_count_only)
-      {
-        cli_mutex_lock(&output_mutex);
-        _tprintf(_T("%s: %d\n"), file_path, args->callback_args.current_count);
-        cli_mutex_unlock(&output_mutex);
-      }
+    uint64_t busy_ns = yr_stopwatch_elapsed_ns(&stopwatch);
+    uint64_t cpu_ns = cli_thread_cpu_time_ns() - cpu_time;
 
-      if (result != ERROR_SUCCESS)
-      {
-        cli_mutex_lock(&output_mutex);
-        _ftprintf(stderr, _T("error scanning %s: "), file_path);
-        print_scanner_error(args->scanner, result);
-        cli_mutex_unlock(&output_mutex);
-      }
+    args->stats.busy_ns += busy_ns;
+    args->stats.cpu_ns += cpu_ns;
 
-      free(file_path);
-      file_path = file_queue_get(args->deadline);
-    }
-    else
+    if (adaptive_threads)
     {
-      file_path = NULL;
+      cli_atomic_add(&window_busy_us, (long) (busy_ns / 1000));
+      cli_atomic_add(&window_cpu_us, (long) (cpu_ns / 1000));
     }
+
+    free(file.path);
+
+    // This must be done after the directory entries were put in the queue,
+    // or other threads could see no pending files and finish too early.
+    cli_atomic_add(&pending_files, -1);
   }
 
   return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Adjusts the number of active scanning threads while there are pending files.
+// Each thread processing files spends part of the time using the CPU and the
+// rest waiting for I/O. If the fraction of time using the CPU is F, around
+// N / F threads are required for keeping N CPUs busy, and the number of active
+// threads moves halfway towards that target at each step. However, threads
+// waiting for a CPU also look like waiting for I/O, so while the CPUs are
+// saturated the number of threads is reduced slowly towards one per CPU
+// instead.
+//
+#if defined(_WIN32) || defined(__CYGWIN__)
+static DWORD WINAPI adaptive_thread(LPVOID param)
+#else
+static void* adaptive_thread(void* param)
+#endif
+{
+  YR_STOPWATCH stopwatch;
+  long num_cpus = cli_get_cpu_count();
+
+  yr_stopwatch_start(&stopwatch);
+
+  while (cli_atomic_add(&pending_files, 0) > 0)
+  {
+    cli_thread_sleep(ADAPTIVE_INTERVAL_US);
+
+    long busy_us = cli_atomic_add(&window_busy_us, 0);
+    long cpu_us = cli_atomic_add(&window_cpu_us, 0);
+
+    // Not enough samples yet, or CPU time is not available in this platform.
+    if (busy_us < ADAPTIVE_MIN_BUSY_US || cpu_us == 0)
+      continue;
+
+    cli_atomic_add(&window_busy_us, -busy_us);
+    cli_atomic_add(&window_cpu_us, -cpu_us);
+
+    double elapsed_us = yr_stopwatch_elapsed_ns(&stopwatch) / 1000.0;
+    double cpu_fraction = min((double) cpu_us / busy_us, 1.0);
+    double cpu_usage = cpu_us / (elapsed_us * num_cpus);
+
+    yr_stopwatch_start(&stopwatch);
+
+    long current = cli_atomic_add(&active_threads, 0);
+    long target;
+
+    if (cpu_usage >= 0.9)
+      target = current > num_cpus ? current - 1 : current;
+    else
+      target = (current + (long) (num_cpus / cpu_fraction + 0.5) + 1) / 2;
+
+    if (target < 1)
+      target = 1;
+
+    if (target > num_file_deques)
+      target = num_file_deques;
+
+    cli_atomic_add(&active_threads, target - current);
+  }
+
+  return 0;
+}
+
+static void print_scan_stats(
+    THREAD_ARGS* thread_args,
+    int num_threads,
+    uint64_t elapsed_ns)
+{
+  uint64_t files = 0;
+  uint64_t dirs = 0;
+
+  for (int i = 0; i < num_threads; i++)
+  {
+    files += thread_args[i].stats.files;
+    dirs += thread_args[i].stats.dirs;
+  }
+
+  double seconds = elapsed_ns / 1e9;
+
+  printf(
+      "\n===== SCAN STATISTICS =====\n\n"
+      "files scanned: %" PRIu64 "\n"
+      "directories read: %" PRIu64 "\n"
+      "elapsed time: %.3f s\n"
+      "files per second: %.1f\n\n",
+      files,
+      dirs,
+      seconds,
+      seconds > 0 ? files / seconds : 0);
+
+  if (adaptive_threads)
+    printf("active threads at the end: %ld\n\n", active_threads);
+
+  printf(
+      "thread      files       dirs   steals   busy (ms)    cpu (ms)"
+      "   idle (ms)\n");
+
+  for (int i = 0; i < num_threads; i++)
+  {
+    printf(
+        "%6d %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %11.1f %11.1f %11.1f\n",
+        i,
+        thread_args[i].stats.files,
+        thread_args[i].stats.dirs,
+        thread_args[i].stats.steals,
+        thread_args[i].stats.busy_ns / 1e6,
+        thread_args[i].stats.cpu_ns / 1e6,
+        thread_args[i].stats.idle_ns / 1e6);
+  }
+}
+
 static int load_modules_data()
 {
   for (int i = 0; modules_data[i] != NULL; i++)
@@ -1332,6 +1976,32 @@ static void unload_modules_data()
   modules_data_list = NULL;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Attaches to the rules published in the shared memory object with the given
+// name, but only if they were compiled from the inputs described by the cache
+// entry. Otherwise the rules are not used and the caller publishes the right
+// ones, replacing the object.
+//
+static bool attach_shared_rules(
+    RULES_CACHE* rules_cache,
+    const char* name,
+    bool fail_on_warnings,
+    YR_RULES** rules)
+{
+  if (yr_rules_attach(name, rules) != ERROR_SUCCESS)
+    return false;
+
+  const char* tag = yr_rules_get_tag(*rules);
+
+  if (tag != NULL && rules_cache_check(rules_cache, tag, fail_on_warnings))
+    return true;
+
+  yr_rules_destroy(*rules);
+  *rules = NULL;
+
+  return false;
+}
+
 int _tmain(int argc, const char_t** argv)
 {
   COMPILER_RESULTS cr;
@@ -1340,6 +2010,7 @@ int _tmain(int argc, const char_t** argv)
   YR_RULES* rules = NULL;
   YR_SCANNER* scanner = NULL;
   SCAN_OPTIONS scan_opts;
+  RULES_CACHE rules_cache = {0};
 
   bool arg_is_dir = false;
   int flags = 0;
@@ -1373,9 +2044,18 @@ int _tmain(int argc, const char_t** argv)
     return EXIT_SUCCESS;
   }
 
-  if (threads > YR_MAX_THREADS)
+  if (threads < 0)
+  {
+    fprintf(stderr, "number of threads must not be negative\n");
+    return EXIT_FAILURE;
+  }
+
+  if (threads == 0)
+    threads = adaptive_threads ? 4 * cli_get_cpu_count() : YR_MAX_THREADS;
+
+  if (segment_threads < 1)
   {
-    fprintf(stderr, "maximum number of threads is %d\n", YR_MAX_THREADS);
+    fprintf(stderr, "number of segment threads must be at least 1\n");
     return EXIT_FAILURE;
   }
 
@@ -1419,10 +2099,40 @@ int _tmain(int argc, const char_t** argv)
   yr_set_configuration_uint64(
       YR_CONFIG_MAX_PROCESS_MEMORY_CHUNK, max_process_memory_chunk);
 
+  yr_set_configuration_uint32(YR_CONFIG_MAX_THREADS, (uint32_t) threads);
+
+  // The inputs are described for finding the rules in the cache, and for
+  // checking that rules published in shared memory were compiled from the same
+  // rules files.
+
+  bool have_inputs = (rules_cache_dir != NULL || shared_rules != NULL) &&
+                     rules_cache_init(
+                         &rules_cache,
+                         rules_cache_dir,
+                         argc,
+                         argv,
+                         ext_vars,
+                         atom_quality_table);
+
+  // If the rules were already published by another yara process from the same
+  // inputs just attach to them, they are not compiled nor loaded in that case.
+
+  bool rules_are_attached = shared_rules != NULL && have_inputs &&
+                            attach_shared_rules(
+                                &rules_cache,
+                                shared_rules,
+                                fail_on_warnings,
+                                &rules);
+
+  if (rules_are_attached)
+  {
+    result = define_external_variables(ext_vars, rules, NULL);
+  }
+
   // Try to load the rules file as a binary file containing
   // compiled rules first
 
-  if (rules_are_compiled)
+  else if (rules_are_compiled)
   {
     // When a binary file containing compiled rules is provided, yara accepts
     // only two arguments, the compiled rules file and the target to be scanned.
@@ -1455,12 +2165,26 @@ int _tmain(int argc, const char_t** argv)
 
       if (result == ERROR_SUCCESS)
         result = define_external_variables(ext_vars, rules, NULL);
+
+      // Compiled rules don't include other files.
+      if (result == ERROR_SUCCESS && have_inputs)
+        rules_cache_describe(&rules_cache, NULL, 0);
     }
     else
     {
       result = ERROR_COULD_NOT_OPEN_FILE;
     }
   }
+
+  // With --rules-cache the rules are compiled only if they are not in the
+  // cache already, or if any of the files they depend on changed.
+
+  else if (
+      rules_cache_dir != NULL && have_inputs &&
+      rules_cache_load(&rules_cache, fail_on_warnings, &rules))
+  {
+    result = define_external_variables(ext_vars, rules, NULL);
+  }
   else
   {
     // Rules file didn't contain compiled rules, let's handle it
@@ -1495,7 +2219,7 @@ int _tmain(int argc, const char_t** argv)
 
     yr_compiler_set_callback(compiler, print_compiler_error, &cr);
 
-    if (!compile_files(compiler, argc, argv))
+    if (!compile_files(compiler, argc, argv, 1))
       exit_with_code(EXIT_FAILURE);
 
     if (cr.errors > 0)
@@ -1506,6 +2230,13 @@ int _tmain(int argc, const char_t** argv)
 
     result = yr_compiler_get_rules(compiler, &rules);
 
+    // Failing to store the rules in the cache is not an error, they will be
+    // compiled again the next time.
+    if (result == ERROR_SUCCESS && have_inputs &&
+        rules_cache_describe(&rules_cache, compiler, cr.warnings) &&
+        rules_cache_dir != NULL)
+      rules_cache_save(&rules_cache, rules);
+
     yr_compiler_destroy(compiler);
 
     compiler = NULL;
@@ -1517,6 +2248,20 @@ int _tmain(int argc, const char_t** argv)
     exit_with_code(EXIT_FAILURE);
   }
 
+  if (shared_rules != NULL && !rules_are_attached)
+  {
+    // The rules are published along with their description, if it's not
+    // available they will be published again by the next process.
+    result = yr_rules_publish(rules, shared_rules, rules_cache.deps);
+
+    if (result != ERROR_SUCCESS)
+    {
+      fprintf(stderr, "error publishing rules: ");
+      print_error(result);
+      exit_with_code(EXIT_FAILURE);
+    }
+  }
+
   if (show_stats)
     print_rules_stats(rules);
 
@@ -1525,6 +2270,14 @@ int _tmain(int argc, const char_t** argv)
   if (fast_scan)
     flags |= SCAN_FLAGS_FAST_MODE;
 
+  // Non-matching rules are needed only when they are printed, or for
+  // enforcing --max-rules. Without them the scanner can skip the strings of
+  // the rules that can't match, see yr_execute_guards.
+  flags |= SCAN_FLAGS_REPORT_RULES_MATCHING;
+
+  if (negate || limit != 0)
+    flags |= SCAN_FLAGS_REPORT_RULES_NOT_MATCHING;
+
   scan_opts.deadline = time(NULL) + timeout;
 
   arg_is_dir = is_directory(argv[argc - 1]);
@@ -1536,19 +2289,38 @@ int _tmain(int argc, const char_t** argv)
   }
   else if (scan_list_search || arg_is_dir)
   {
-    if (file_queue_init() != 0)
+    if (file_queue_init(threads) != 0)
     {
       print_error(ERROR_INTERNAL_FATAL_ERROR);
       exit_with_code(EXIT_FAILURE);
     }
 
-    THREAD thread[YR_MAX_THREADS];
-    THREAD_ARGS thread_args[YR_MAX_THREADS];
+    THREAD adaptive;
+    THREAD* thread = (THREAD*) calloc(threads, sizeof(THREAD));
+    THREAD_ARGS* thread_args = (THREAD_ARGS*) calloc(
+        threads, sizeof(THREAD_ARGS));
+    YR_STOPWATCH stopwatch;
+
+    if (thread == NULL || thread_args == NULL)
+    {
+      print_error(ERROR_INSUFFICIENT_MEMORY);
+      exit_with_code(EXIT_FAILURE);
+    }
+
+    // With --adaptive-threads start with one active thread per CPU, the
+    // remaining ones are activated if the scan turns out to be I/O bound.
+    if (adaptive_threads)
+      active_threads = min(threads, cli_get_cpu_count());
+
+    yr_stopwatch_start(&stopwatch);
 
     for (int i = 0; i < threads; i++)
     {
-      thread_args[i].deadline = scan_opts.deadline;
+      memset(&thread_args[i].stats, 0, sizeof(THREAD_STATS));
+
+      thread_args[i].scan_opts = &scan_opts;
       thread_args[i].current_count = 0;
+      thread_args[i].index = i;
 
       result = yr_scanner_create(rules, &thread_args[i].scanner);
 
@@ -1562,6 +2334,7 @@ int _tmain(int argc, const char_t** argv)
           thread_args[i].scanner, callback, &thread_args[i].callback_args);
 
       yr_scanner_set_flags(thread_args[i].scanner, flags);
+      yr_scanner_set_threads(thread_args[i].scanner, (int) segment_threads);
 
       if (cli_create_thread(
               &thread[i], scanning_thread, (void*) &thread_args[i]))
@@ -1571,9 +2344,15 @@ int _tmain(int argc, const char_t** argv)
       }
     }
 
+    if (adaptive_threads && cli_create_thread(&adaptive, adaptive_thread, NULL))
+    {
+      print_error(ERROR_COULD_NOT_CREATE_THREAD);
+      exit_with_code(EXIT_FAILURE);
+    }
+
     if (arg_is_dir)
     {
-      scan_dir(argv[argc - 1], &scan_opts);
+      file_queue_put(argv[argc - 1], true, scan_opts.deadline);
     }
     else
     {
@@ -1588,9 +2367,19 @@ int _tmain(int argc, const char_t** argv)
     // Wait for scan threads to finish
     for (int i = 0; i < threads; i++) cli_thread_join(&thread[i]);
 
+    if (adaptive_threads)
+      cli_thread_join(&adaptive);
+
+    if (show_scan_stats)
+      print_scan_stats(
+          thread_args, threads, yr_stopwatch_elapsed_ns(&stopwatch));
+
     for (int i = 0; i < threads; i++)
       yr_scanner_destroy(thread_args[i].scanner);
 
+    free(thread_args);
+    free(thread);
+
     file_queue_destroy();
   }
   else
@@ -1607,6 +2396,7 @@ int _tmain(int argc, const char_t** argv)
 
     yr_scanner_set_callback(scanner, callback, &user_data);
     yr_scanner_set_flags(scanner, flags);
+    yr_scanner_set_threads(scanner, (int) segment_threads);
     yr_scanner_set_timeout(scanner, timeout);
 
     // Assume the last argument is a file first. This assures we try to process
@@ -1653,6 +2443,8 @@ _exit:
   if (rules != NULL)
     yr_rules_destroy(rules);
 
+  rules_cache_destroy(&rules_cache);
+
   yr_finalize();
 
   args_free(options);
@@ -41,6 +41,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -75,6 +76,7 @@ static bool show_version = false;
 static bool show_help = false;
 static bool fail_on_warnings = false;
 static long max_strings_per_rule = DEFAULT_MAX_STRINGS_PER_RULE;
+static long jobs = 1;
 
 #define USAGE_STRING \
   "Usage: yarac [OPTION]... [NAMESPACE:]SOURCE_FILE... OUTPUT_FILE"
@@ -103,6 +105,13 @@ args_option_t options[] = {
 
     OPT_BOOLEAN('h', _T("help"), &show_help, _T("show this help and exit")),
 
+    OPT_LONG(
+        'j',
+        _T("jobs"),
+        &jobs,
+        _T("parse NUMBER source files in parallel (default=1)"),
+        _T("NUMBER")),
+
     OPT_LONG(
         0,
         _T("max-strings-per-rule"),
@@ -168,6 +177,56 @@ static void report_error(
   }
 }
 
+// Saves the rules into the output file. The file is replaced, not overwritten,
+// as yara processes that loaded it before would crash if it's modified while
+// they use it.
+static int save_rules(YR_RULES* rules, const char_t* file_name)
+{
+#ifdef _MSC_VER
+  // Not using yr_rules_save because it does not have support for unicode
+  // file names. Instead use _tfopen for creating a temporary file,
+  // yr_rules_save_stream for writing the rules to it, and then move it to its
+  // final name like yr_rules_save does.
+  char_t temp_file_name[MAX_PATH];
+  FILE* fh = NULL;
+
+  for (int i = 0; i < 100 && fh == NULL; i++)
+  {
+    _sntprintf(temp_file_name, MAX_PATH, _T("%s.%d.tmp"), file_name, i);
+
+    temp_file_name[MAX_PATH - 1] = _T('\0');
+    fh = _tfopen(temp_file_name, _T("wbx"));
+
+    if (fh == NULL && errno != EEXIST)
+      return ERROR_COULD_NOT_OPEN_FILE;
+  }
+
+  if (fh == NULL)
+    return ERROR_COULD_NOT_OPEN_FILE;
+
+  YR_STREAM stream;
+
+  stream.user_data = fh;
+  stream.write = (YR_STREAM_WRITE_FUNC) fwrite;
+
+  int result = yr_rules_save_stream(rules, &stream);
+
+  if (fclose(fh) != 0 && result == ERROR_SUCCESS)
+    result = ERROR_WRITING_FILE;
+
+  if (result == ERROR_SUCCESS &&
+      !MoveFileEx(temp_file_name, file_name, MOVEFILE_REPLACE_EXISTING))
+    result = ERROR_COULD_NOT_OPEN_FILE;
+
+  if (result != ERROR_SUCCESS)
+    _tremove(temp_file_name);
+
+  return result;
+#else
+  return yr_rules_save(rules, file_name);
+#endif
+}
+
 int _tmain(int argc, const char_t** argv)
 {
   COMPILER_RESULTS cr;
@@ -195,6 +254,12 @@ int _tmain(int argc, const char_t** argv)
     return EXIT_SUCCESS;
   }
 
+  if (jobs < 1)
+  {
+    fprintf(stderr, "number of jobs must be at least 1\n");
+    exit_with_code(EXIT_FAILURE);
+  }
+
   if (argc < 2)
   {
     fprintf(stderr, "yarac: wrong number of arguments\n");
@@ -233,7 +298,7 @@ int _tmain(int argc, const char_t** argv)
 
   yr_compiler_set_callback(compiler, report_error, &cr);
 
-  if (!compile_files(compiler, argc, argv))
+  if (!compile_files(compiler, argc, argv, (int) jobs))
     exit_with_code(EXIT_FAILURE);
 
   if (cr.errors > 0)
@@ -250,23 +315,7 @@ int _tmain(int argc, const char_t** argv)
     exit_with_code(EXIT_FAILURE);
   }
 
-  // Not using yr_rules_save because it does not have support for unicode
-  // file names. Instead use open _tfopen for openning the file and
-  // yr_rules_save_stream for writing the rules to it.
-
-  FILE* fh = _tfopen(argv[argc - 1], _T("wb"));
-
-  if (fh != NULL)
-  {
-    YR_STREAM stream;
-
-    stream.user_data = fh;
-    stream.write = (YR_STREAM_WRITE_FUNC) fwrite;
-
-    result = yr_rules_save_stream(rules, &stream);
-
-    fclose(fh);
-  }
+  result = save_rules(rules, argv[argc - 1]);
 
   if (result != ERROR_SUCCESS)
   {
@@ -37,6 +37,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/mem.h>
 #include <yara/utils.h>
 
+// States get an array of children indexed by input byte (see the children
+// field in YR_AC_STATE) when they have more than this number of children.
+#define YR_AC_STATE_CHILDREN_INDEX_THRESHOLD 16
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define YR_AC_PREFILTER_X86
+#include <immintrin.h>
+#endif
+
 typedef struct _QUEUE_NODE
 {
   YR_AC_STATE* value;
@@ -53,6 +62,70 @@ typedef struct _QUEUE
 
 } QUEUE;
 
+// Flags in YR_AC_STATE.flags, used by yr_ac_patch.
+#define YR_AC_STATE_FLAGS_NEW        0x01
+#define YR_AC_STATE_FLAGS_GROWN      0x02
+#define YR_AC_STATE_FLAGS_OPT_DIRTY  0x04
+#define YR_AC_STATE_FLAGS_HEAD_DIRTY 0x08
+
+// Offset of a transition table slot relative to the state that owns it.
+#define YR_AC_SLOT_OFFSET(t) ((t) & ((1 << YR_AC_SLOT_OFFSET_BITS) - 1))
+
+// Match added to a patchable automaton with yr_ac_add_match.
+typedef struct _YR_AC_PATCH_MATCH
+{
+  // State where the match was added, or NULL if the match identifier is free.
+  YR_AC_STATE* state;
+
+  // Identifiers plus one of the next and previous matches added to the same
+  // state, or zero. For free identifiers "next" is the next free one.
+  uint32_t next;
+  uint32_t prev;
+
+} YR_AC_PATCH_MATCH;
+
+typedef struct _YR_AC_STATE_LIST
+{
+  YR_AC_STATE** states;
+  uint32_t count;
+  uint32_t capacity;
+
+} YR_AC_STATE_LIST;
+
+struct YR_AC_PATCH
+{
+  // Matches indexed by identifier. num_matches includes the free ones, which
+  // are in a list that starts at free_matches (an identifier plus one).
+  YR_AC_PATCH_MATCH* matches;
+  uint32_t num_matches;
+  uint32_t max_matches;
+  uint32_t free_matches;
+
+  // slot_states[N] is the state whose transitions start at slot N of the
+  // transition table, or NULL. Has max_slot_states items.
+  YR_AC_STATE** slot_states;
+  uint32_t max_slot_states;
+
+  // Lists of states whose failure link is the root state, one list for each
+  // input byte, so that states ending with a given byte can be found quickly.
+  // For other states these lists start at YR_AC_STATE.failure_first.
+  YR_AC_STATE* root_failures[256];
+
+  // Number of states at each depth, not counting the new ones.
+  uint32_t num_states[YR_MAX_ATOM_LENGTH + 1];
+
+  // States created since the last call to yr_ac_patch, and the states that
+  // existed before and got new children.
+  YR_AC_STATE_LIST new_states;
+  YR_AC_STATE_LIST grown_states;
+
+  // States whose failure link in the transition table, or whose list of
+  // matches, must be computed again. There's one list per depth because
+  // they are computed in order of depth.
+  YR_AC_STATE_LIST opt_dirty[YR_MAX_ATOM_LENGTH + 1];
+  YR_AC_STATE_LIST head_dirty[YR_MAX_ATOM_LENGTH + 1];
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Pushes an automaton state into the tail of a queue.
 //
@@ -145,6 +218,9 @@ static int _yr_ac_queue_is_empty(QUEUE* queue)
 //
 static YR_AC_STATE* _yr_ac_next_state(YR_AC_STATE* state, uint8_t input)
 {
+  if (state->children != NULL)
+    return state->children[input];
+
   YR_AC_STATE* next_state = state->first_child;
 
   while (next_state != NULL)
@@ -179,12 +255,41 @@ static YR_AC_STATE* _yr_ac_state_create(YR_AC_STATE* state, uint8_t input)
 
   new_state->input = input;
   new_state->depth = state->depth + 1;
+  new_state->num_children = 0;
   new_state->matches_ref = YR_ARENA_NULL_REF;
   new_state->failure = NULL;
   new_state->t_table_slot = 0;
   new_state->first_child = NULL;
+  new_state->children = NULL;
   new_state->siblings = state->first_child;
+  new_state->parent = state;
+  new_state->failure_first = NULL;
+  new_state->failure_next = NULL;
+  new_state->failure_prev = NULL;
+  new_state->first_match = 0;
+  new_state->matches = 0;
+  new_state->flags = 0;
+
   state->first_child = new_state;
+  state->num_children++;
+
+  if (state->children != NULL)
+  {
+    state->children[input] = new_state;
+  }
+  else if (state->num_children > YR_AC_STATE_CHILDREN_INDEX_THRESHOLD)
+  {
+    // If the array can't be allocated the state keeps using the list of
+    // siblings, which is slower but gives the same results.
+    state->children = (YR_AC_STATE**) yr_calloc(256, sizeof(YR_AC_STATE*));
+
+    if (state->children != NULL)
+    {
+      for (YR_AC_STATE* child = state->first_child; child != NULL;
+           child = child->siblings)
+        state->children[child->input] = child;
+    }
+  }
 
   return new_state;
 }
@@ -203,6 +308,7 @@ static int _yr_ac_state_destroy(YR_AC_STATE* state)
     child_state = next_child_state;
   }
 
+  yr_free(state->children);
   yr_free(state);
 
   return ERROR_SUCCESS;
@@ -745,16 +851,26 @@ int yr_ac_automaton_create(YR_ARENA* arena, YR_AC_AUTOMATON** automaton)
   }
 
   root_state->depth = 0;
+  root_state->num_children = 0;
   root_state->matches_ref = YR_ARENA_NULL_REF;
   root_state->failure = NULL;
   root_state->first_child = NULL;
+  root_state->children = NULL;
   root_state->siblings = NULL;
   root_state->t_table_slot = 0;
+  root_state->parent = NULL;
+  root_state->failure_first = NULL;
+  root_state->failure_next = NULL;
+  root_state->failure_prev = NULL;
+  root_state->first_match = 0;
+  root_state->matches = 0;
+  root_state->flags = 0;
 
   new_automaton->arena = arena;
   new_automaton->root = root_state;
   new_automaton->bitmask = NULL;
   new_automaton->tables_size = 0;
+  new_automaton->patch = NULL;
 
   *automaton = new_automaton;
 
@@ -768,6 +884,27 @@ int yr_ac_automaton_destroy(YR_AC_AUTOMATON* automaton)
 {
   _yr_ac_state_destroy(automaton->root);
 
+  if (automaton->patch != NULL)
+  {
+    YR_AC_PATCH* patch = automaton->patch;
+
+    yr_free(patch->matches);
+    yr_free(patch->slot_states);
+    yr_free(patch->new_states.states);
+    yr_free(patch->grown_states.states);
+
+    for (int i = 0; i <= YR_MAX_ATOM_LENGTH; i++)
+    {
+      yr_free(patch->opt_dirty[i].states);
+      yr_free(patch->head_dirty[i].states);
+    }
+
+    yr_free(patch);
+
+    // The arena of a patchable automaton belongs to it.
+    yr_arena_release(automaton->arena);
+  }
+
   yr_free(automaton->bitmask);
   yr_free(automaton);
 
@@ -839,6 +976,149 @@ int yr_ac_add_string(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Path from the root to the state where a YR_AC_MATCH is, see
+// _yr_ac_find_match_paths.
+//
+typedef struct _MATCH_PATH
+{
+  bool found;
+  uint8_t length;
+  uint8_t bytes[YR_MAX_ATOM_LENGTH];
+
+} MATCH_PATH;
+
+////////////////////////////////////////////////////////////////////////////////
+// Traverses the states that descend from "state", and for each match in them
+// stores the path to the state in paths[i], where i is the index of the match
+// in YR_AC_STATE_MATCHES_POOL.
+//
+static int _yr_ac_find_match_paths(
+    YR_AC_AUTOMATON* automaton,
+    YR_AC_STATE* state,
+    uint8_t* path,
+    MATCH_PATH* paths,
+    uint32_t num_paths)
+{
+  YR_AC_MATCH* pool = (YR_AC_MATCH*) yr_arena_get_ptr(
+      automaton->arena, YR_AC_STATE_MATCHES_POOL, 0);
+
+  YR_AC_MATCH* match = yr_arena_ref_to_ptr(
+      automaton->arena, &state->matches_ref);
+
+  if (state->depth > YR_MAX_ATOM_LENGTH)
+    return ERROR_INTERNAL_FATAL_ERROR;
+
+  while (match != NULL)
+  {
+    uint32_t i = (uint32_t) (match - pool);
+
+    if (i >= num_paths || paths[i].found)
+      return ERROR_INTERNAL_FATAL_ERROR;
+
+    paths[i].found = true;
+    paths[i].length = state->depth;
+    memcpy(paths[i].bytes, path, state->depth);
+
+    match = match->next;
+  }
+
+  for (YR_AC_STATE* child = state->first_child; child != NULL;
+       child = child->siblings)
+  {
+    if (child->depth > YR_MAX_ATOM_LENGTH)
+      return ERROR_INTERNAL_FATAL_ERROR;
+
+    path[state->depth] = child->input;
+
+    FAIL_ON_ERROR(
+        _yr_ac_find_match_paths(automaton, child, path, paths, num_paths));
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds to the automaton the matches of another automaton that hasn't been
+// compiled yet. The YR_AC_MATCH structures in the other automaton's arena must
+// have been copied already to this automaton's arena, in the same order and
+// starting at offset matches_offset in YR_AC_STATE_MATCHES_POOL. Their "next"
+// fields are overwritten.
+//
+// Matches are added in the order in which they were created, so the states
+// and the lists of matches are the same as if the strings added to the other
+// automaton with yr_ac_add_string were added to this one.
+//
+int yr_ac_add_matches(
+    YR_AC_AUTOMATON* automaton,
+    YR_AC_AUTOMATON* other,
+    yr_arena_off_t matches_offset)
+{
+  uint8_t path[YR_MAX_ATOM_LENGTH];
+
+  uint32_t num_matches = yr_arena_get_current_offset(
+                             other->arena, YR_AC_STATE_MATCHES_POOL) /
+                         sizeof(YR_AC_MATCH);
+
+  if (num_matches == 0)
+    return ERROR_SUCCESS;
+
+  MATCH_PATH* paths = (MATCH_PATH*) yr_calloc(num_matches, sizeof(MATCH_PATH));
+
+  if (paths == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  int result = _yr_ac_find_match_paths(
+      other, other->root, path, paths, num_matches);
+
+  for (uint32_t i = 0; i < num_matches && result == ERROR_SUCCESS; i++)
+  {
+    YR_AC_STATE* state = automaton->root;
+
+    if (!paths[i].found)
+    {
+      result = ERROR_INTERNAL_FATAL_ERROR;
+      break;
+    }
+
+    for (int j = 0; j < paths[i].length; j++)
+    {
+      YR_AC_STATE* next_state = _yr_ac_next_state(state, paths[i].bytes[j]);
+
+      if (next_state == NULL)
+      {
+        next_state = _yr_ac_state_create(state, paths[i].bytes[j]);
+
+        if (next_state == NULL)
+        {
+          result = ERROR_INSUFFICIENT_MEMORY;
+          break;
+        }
+      }
+
+      state = next_state;
+    }
+
+    if (result != ERROR_SUCCESS)
+      break;
+
+    YR_ARENA_REF match_ref;
+
+    match_ref.buffer_id = YR_AC_STATE_MATCHES_POOL;
+    match_ref.offset = matches_offset + i * sizeof(YR_AC_MATCH);
+
+    YR_AC_MATCH* match = (YR_AC_MATCH*) yr_arena_ref_to_ptr(
+        automaton->arena, &match_ref);
+
+    match->next = yr_arena_ref_to_ptr(automaton->arena, &state->matches_ref);
+    state->matches_ref = match_ref;
+  }
+
+  yr_free(paths);
+
+  return result;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Compiles the Aho-Corasick automaton, the resulting data structures are
 // are written in the provided arena.
@@ -852,6 +1132,1228 @@ int yr_ac_compile(YR_AC_AUTOMATON* automaton, YR_ARENA* arena)
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Appends a state to a list of states.
+//
+static int _yr_ac_state_list_push(YR_AC_STATE_LIST* list, YR_AC_STATE* state)
+{
+  if (list->count == list->capacity)
+  {
+    uint32_t capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+
+    YR_AC_STATE** states = (YR_AC_STATE**) yr_realloc(
+        list->states, capacity * sizeof(YR_AC_STATE*));
+
+    if (states == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    list->states = states;
+    list->capacity = capacity;
+  }
+
+  list->states[list->count++] = state;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sets YR_AC_STATE_FLAGS_OPT_DIRTY or YR_AC_STATE_FLAGS_HEAD_DIRTY in a state
+// and puts the state in the corresponding list, if it wasn't there already.
+//
+static int _yr_ac_mark_dirty(YR_AC_PATCH* patch, YR_AC_STATE* state, uint8_t flag)
+{
+  if (state->flags & flag)
+    return ERROR_SUCCESS;
+
+  state->flags |= flag;
+
+  if (flag == YR_AC_STATE_FLAGS_OPT_DIRTY)
+    return _yr_ac_state_list_push(&patch->opt_dirty[state->depth], state);
+  else
+    return _yr_ac_state_list_push(&patch->head_dirty[state->depth], state);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Marks as dirty the states in a list of states that share the same failure
+// link. When the flag is YR_AC_STATE_FLAGS_HEAD_DIRTY states that have their
+// own matches are skipped, as the head of their lists of matches doesn't
+// depend on the failure link.
+//
+static int _yr_ac_mark_list_dirty(
+    YR_AC_PATCH* patch,
+    YR_AC_STATE* state,
+    uint8_t flag)
+{
+  while (state != NULL)
+  {
+    if (flag != YR_AC_STATE_FLAGS_HEAD_DIRTY || state->first_match == 0)
+      FAIL_ON_ERROR(_yr_ac_mark_dirty(patch, state, flag));
+
+    state = state->failure_next;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the address of the first item in the list of states whose failure
+// link is "failure" and whose input symbol is "input". The input symbol only
+// matters when "failure" is the root state.
+//
+static YR_AC_STATE** _yr_ac_failure_list(
+    YR_AC_AUTOMATON* automaton,
+    YR_AC_STATE* failure,
+    uint8_t input)
+{
+  if (failure == automaton->root)
+    return &automaton->patch->root_failures[input];
+
+  return &failure->failure_first;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sets the failure link of a state, moving the state to the list of states
+// that share the same failure link.
+//
+static void _yr_ac_set_failure(
+    YR_AC_AUTOMATON* automaton,
+    YR_AC_STATE* state,
+    YR_AC_STATE* failure)
+{
+  YR_AC_STATE** head;
+
+  if (state->failure != NULL)
+  {
+    if (state->failure_prev != NULL)
+      state->failure_prev->failure_next = state->failure_next;
+    else
+      *_yr_ac_failure_list(automaton, state->failure, state->input) =
+          state->failure_next;
+
+    if (state->failure_next != NULL)
+      state->failure_next->failure_prev = state->failure_prev;
+  }
+
+  head = _yr_ac_failure_list(automaton, failure, state->input);
+
+  state->failure = failure;
+  state->failure_prev = NULL;
+  state->failure_next = *head;
+
+  if (*head != NULL)
+    (*head)->failure_prev = state;
+
+  *head = state;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if the path from the root to "suffix" is a suffix of the path
+// from the root to "state". "state" must be deeper than "suffix".
+//
+static bool _yr_ac_state_has_suffix(YR_AC_STATE* state, YR_AC_STATE* suffix)
+{
+  while (suffix->depth > 0)
+  {
+    if (state->input != suffix->input)
+      return false;
+
+    state = state->parent;
+    suffix = suffix->parent;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Makes sure that the patch's slot_states array covers the whole transition
+// table.
+//
+static int _yr_ac_patch_grow_slot_states(YR_AC_AUTOMATON* automaton)
+{
+  YR_AC_PATCH* patch = automaton->patch;
+
+  if (patch->max_slot_states >= automaton->tables_size)
+    return ERROR_SUCCESS;
+
+  YR_AC_STATE** slot_states = (YR_AC_STATE**) yr_realloc(
+      patch->slot_states, automaton->tables_size * sizeof(YR_AC_STATE*));
+
+  if (slot_states == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  memset(
+      slot_states + patch->max_slot_states,
+      0,
+      (automaton->tables_size - patch->max_slot_states) *
+          sizeof(YR_AC_STATE*));
+
+  patch->slot_states = slot_states;
+  patch->max_slot_states = automaton->tables_size;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// After moving the transitions of a state from old_slot to new_slot, updates
+// the failure links in the transition table that pointed to old_slot. Those
+// links can only be in states whose failure link is "state", or in states
+// whose failure link is one of them, and so on, but only while the optimized
+// links keep pointing to old_slot. New states are skipped because their links
+// are written later, but the states below them are not.
+//
+static void _yr_ac_update_failure_slots(
+    YR_AC_TRANSITION* t_table,
+    YR_AC_STATE* state,
+    uint32_t old_slot,
+    uint32_t new_slot)
+{
+  for (YR_AC_STATE* s = state->failure_first; s != NULL; s = s->failure_next)
+  {
+    if (!(s->flags & YR_AC_STATE_FLAGS_NEW))
+    {
+      if (YR_AC_NEXT_STATE(t_table[s->t_table_slot]) != old_slot)
+        continue;
+
+      t_table[s->t_table_slot] = YR_AC_MAKE_TRANSITION(new_slot, 0);
+    }
+
+    _yr_ac_update_failure_slots(t_table, s, old_slot, new_slot);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Moves the transitions of a state that is already in the transition table to
+// some other place, including placeholders for the children that don't have
+// a transition yet. If reserved_slot is not zero that slot is kept free for
+// the caller after releasing the ones used by the state.
+//
+static int _yr_ac_relocate_state(
+    YR_AC_AUTOMATON* automaton,
+    YR_AC_STATE* state,
+    uint32_t reserved_slot)
+{
+  YR_AC_PATCH* patch = automaton->patch;
+  YR_AC_TRANSITION transitions[257];
+  YR_AC_STATE* child_state;
+
+  YR_AC_TRANSITION* t_table = (YR_AC_TRANSITION*) yr_arena_get_ptr(
+      automaton->arena, YR_AC_TRANSITION_TABLE, 0);
+
+  uint32_t* m_table = (uint32_t*) yr_arena_get_ptr(
+      automaton->arena, YR_AC_STATE_MATCHES_TABLE, 0);
+
+  uint32_t old_slot = state->t_table_slot;
+  uint32_t matches = m_table[old_slot];
+  uint32_t new_slot;
+
+  transitions[0] = t_table[old_slot];
+
+  t_table[old_slot] = 0;
+  m_table[old_slot] = 0;
+  patch->slot_states[old_slot] = NULL;
+  yr_bitmask_clear(automaton->bitmask, old_slot);
+
+  for (child_state = state->first_child; child_state != NULL;
+       child_state = child_state->siblings)
+  {
+    uint32_t offset = child_state->input + 1;
+    uint32_t slot = old_slot + offset;
+
+    // The slot belongs to this state only if its offset is the right one,
+    // otherwise it's used by another state and the child doesn't have a
+    // transition yet.
+    if (yr_bitmask_is_set(automaton->bitmask, slot) &&
+        YR_AC_SLOT_OFFSET(t_table[slot]) == offset)
+    {
+      transitions[offset] = t_table[slot];
+      t_table[slot] = 0;
+      yr_bitmask_clear(automaton->bitmask, slot);
+    }
+    else
+    {
+      transitions[offset] = YR_AC_MAKE_TRANSITION(0, offset);
+    }
+  }
+
+  if (reserved_slot != 0)
+    yr_bitmask_set(automaton->bitmask, reserved_slot);
+
+  if (old_slot < automaton->t_table_unused_candidate)
+    automaton->t_table_unused_candidate = old_slot;
+
+  FAIL_ON_ERROR(_yr_ac_find_suitable_transition_table_slot(
+      automaton, automaton->arena, state, &new_slot));
+
+  FAIL_ON_ERROR(_yr_ac_patch_grow_slot_states(automaton));
+
+  t_table = yr_arena_get_ptr(automaton->arena, YR_AC_TRANSITION_TABLE, 0);
+  m_table = yr_arena_get_ptr(automaton->arena, YR_AC_STATE_MATCHES_TABLE, 0);
+
+  t_table[new_slot] = transitions[0];
+  m_table[new_slot] = matches;
+  patch->slot_states[new_slot] = state;
+  yr_bitmask_set(automaton->bitmask, new_slot);
+
+  for (child_state = state->first_child; child_state != NULL;
+       child_state = child_state->siblings)
+  {
+    uint32_t offset = child_state->input + 1;
+
+    t_table[new_slot + offset] = transitions[offset];
+    yr_bitmask_set(automaton->bitmask, new_slot + offset);
+  }
+
+  state->t_table_slot = new_slot;
+
+  t_table[state->parent->t_table_slot + state->input + 1] =
+      YR_AC_MAKE_TRANSITION(new_slot, state->input + 1);
+
+  _yr_ac_update_failure_slots(t_table, state, old_slot, new_slot);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Makes room in the transition table for the transitions that go from a state
+// that was already in the table to its new children. If some of those slots
+// are used by other states, either the other state or this one is moved
+// somewhere else. Transitions from the root state are always at the same
+// slots, so in that case it's the other state the one that moves.
+//
+static int _yr_ac_place_new_children(
+    YR_AC_AUTOMATON* automaton,
+    YR_AC_STATE* state)
+{
+  YR_AC_TRANSITION* t_table;
+
+  for (YR_AC_STATE* child_state = state->first_child; child_state != NULL;
+       child_state = child_state->siblings)
+  {
+    uint32_t offset = child_state->input + 1;
+    uint32_t slot = state->t_table_slot + offset;
+
+    if (!(child_state->flags & YR_AC_STATE_FLAGS_NEW))
+      continue;
+
+    t_table = yr_arena_get_ptr(automaton->arena, YR_AC_TRANSITION_TABLE, 0);
+
+    // The slot is already reserved for this transition if the state was
+    // relocated while placing a previous child.
+    if (yr_bitmask_is_set(automaton->bitmask, slot) &&
+        YR_AC_SLOT_OFFSET(t_table[slot]) == offset)
+      continue;
+
+    if (yr_bitmask_is_set(automaton->bitmask, slot))
+    {
+      if (state != automaton->root)
+        // Relocating the state puts placeholders for all its new children.
+        return _yr_ac_relocate_state(automaton, state, 0);
+
+      YR_AC_STATE* owner =
+          automaton->patch->slot_states[slot - YR_AC_SLOT_OFFSET(t_table[slot])];
+
+      FAIL_ON_ERROR(_yr_ac_relocate_state(automaton, owner, slot));
+
+      t_table = yr_arena_get_ptr(automaton->arena, YR_AC_TRANSITION_TABLE, 0);
+    }
+
+    // Reserve the slot right away, so that relocations caused by the next
+    // children don't use it.
+    t_table[slot] = YR_AC_MAKE_TRANSITION(0, offset);
+    yr_bitmask_set(automaton->bitmask, slot);
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Puts the transitions of a new state in the transition table. The state's
+// parent must be in the table already, with a placeholder for the transition
+// to this state. The failure link and the matches are written later.
+//
+static int _yr_ac_place_new_state(YR_AC_AUTOMATON* automaton, YR_AC_STATE* state)
+{
+  YR_AC_TRANSITION* t_table;
+  uint32_t* m_table;
+  uint32_t slot;
+
+  FAIL_ON_ERROR(_yr_ac_find_suitable_transition_table_slot(
+      automaton, automaton->arena, state, &slot));
+
+  FAIL_ON_ERROR(_yr_ac_patch_grow_slot_states(automaton));
+
+  t_table = yr_arena_get_ptr(automaton->arena, YR_AC_TRANSITION_TABLE, 0);
+  m_table = yr_arena_get_ptr(automaton->arena, YR_AC_STATE_MATCHES_TABLE, 0);
+
+  t_table[slot] = YR_AC_MAKE_TRANSITION(0, 0);
+  m_table[slot] = 0;
+  automaton->patch->slot_states[slot] = state;
+  yr_bitmask_set(automaton->bitmask, slot);
+
+  for (YR_AC_STATE* child_state = state->first_child; child_state != NULL;
+       child_state = child_state->siblings)
+  {
+    uint32_t offset = child_state->input + 1;
+
+    t_table[slot + offset] = YR_AC_MAKE_TRANSITION(0, offset);
+    yr_bitmask_set(automaton->bitmask, slot + offset);
+  }
+
+  state->t_table_slot = slot;
+
+  t_table[state->parent->t_table_slot + state->input + 1] =
+      YR_AC_MAKE_TRANSITION(slot, state->input + 1);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Computes the failure link of a new state and moves to it the states whose
+// failure link must be the new state from now on. New states must be
+// processed in order of depth.
+//
+static int _yr_ac_link_new_state(YR_AC_AUTOMATON* automaton, YR_AC_STATE* state)
+{
+  YR_AC_PATCH* patch = automaton->patch;
+  YR_AC_STATE* root_state = automaton->root;
+  YR_AC_STATE* failure_state = root_state;
+  YR_AC_STATE* s;
+  YR_AC_STATE* next_s;
+
+  bool deeper_states = false;
+
+  if (state->parent != root_state)
+  {
+    YR_AC_STATE* temp_state = state->parent->failure;
+
+    while (1)
+    {
+      YR_AC_STATE* next_state = _yr_ac_next_state(temp_state, state->input);
+
+      if (next_state != NULL)
+      {
+        failure_state = next_state;
+        break;
+      }
+
+      if (temp_state == root_state)
+        break;
+
+      temp_state = temp_state->failure;
+    }
+  }
+
+  _yr_ac_set_failure(automaton, state, failure_state);
+
+  FAIL_ON_ERROR(_yr_ac_mark_dirty(patch, state, YR_AC_STATE_FLAGS_OPT_DIRTY));
+  FAIL_ON_ERROR(_yr_ac_mark_dirty(patch, state, YR_AC_STATE_FLAGS_HEAD_DIRTY));
+
+  for (int i = state->depth + 1; i <= YR_MAX_ATOM_LENGTH; i++)
+    deeper_states |= (patch->num_states[i] > 0);
+
+  if (!deeper_states)
+    return ERROR_SUCCESS;
+
+  // Existing states that end with the new state's path had as failure link
+  // a shorter suffix of that path, which must be the new state's failure
+  // link, so they are all in that state's list.
+  s = *_yr_ac_failure_list(automaton, failure_state, state->input);
+
+  while (s != NULL)
+  {
+    next_s = s->failure_next;
+
+    if (!(s->flags & YR_AC_STATE_FLAGS_NEW) && s->depth > state->depth &&
+        _yr_ac_state_has_suffix(s, state))
+    {
+      _yr_ac_set_failure(automaton, s, state);
+
+      FAIL_ON_ERROR(_yr_ac_mark_dirty(patch, s, YR_AC_STATE_FLAGS_OPT_DIRTY));
+      FAIL_ON_ERROR(_yr_ac_mark_dirty(patch, s, YR_AC_STATE_FLAGS_HEAD_DIRTY));
+    }
+
+    s = next_s;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates an automaton that can be modified after writing its transition and
+// match tables, see yr_ac_patch. Strings are not added with yr_ac_add_string
+// but with yr_ac_add_match, which identifies each match with a number. The
+// automaton has its own arena where it keeps the tables.
+//
+int yr_ac_automaton_create_patchable(YR_AC_AUTOMATON** automaton)
+{
+  YR_ARENA* arena;
+  YR_AC_AUTOMATON* new_automaton;
+
+  FAIL_ON_ERROR(yr_arena_create(YR_NUM_SECTIONS, 65536, &arena));
+
+  int result = yr_ac_automaton_create(arena, &new_automaton);
+
+  if (result != ERROR_SUCCESS)
+  {
+    yr_arena_release(arena);
+    return result;
+  }
+
+  // From now on yr_ac_automaton_destroy releases the arena.
+  new_automaton->patch = (YR_AC_PATCH*) yr_calloc(1, sizeof(YR_AC_PATCH));
+
+  if (new_automaton->patch == NULL)
+  {
+    yr_ac_automaton_destroy(new_automaton);
+    yr_arena_release(arena);
+    return ERROR_INSUFFICIENT_MEMORY;
+  }
+
+  new_automaton->tables_size = 512;
+  new_automaton->bitmask = yr_calloc(
+      YR_BITMASK_SIZE(new_automaton->tables_size), sizeof(YR_BITMASK));
+
+  if (new_automaton->bitmask == NULL)
+    result = ERROR_INSUFFICIENT_MEMORY;
+
+  if (result == ERROR_SUCCESS)
+    result = yr_arena_allocate_zeroed_memory(
+        arena,
+        YR_AC_TRANSITION_TABLE,
+        new_automaton->tables_size * sizeof(YR_AC_TRANSITION),
+        NULL);
+
+  if (result == ERROR_SUCCESS)
+    result = yr_arena_allocate_zeroed_memory(
+        arena,
+        YR_AC_STATE_MATCHES_TABLE,
+        new_automaton->tables_size * sizeof(uint32_t),
+        NULL);
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_ac_patch_grow_slot_states(new_automaton);
+
+  if (result != ERROR_SUCCESS)
+  {
+    yr_ac_automaton_destroy(new_automaton);
+    return result;
+  }
+
+  // The root state is at slot 0 and its failure link points to itself, as
+  // in the tables created by yr_ac_compile.
+  YR_AC_TRANSITION* t_table = (YR_AC_TRANSITION*) yr_arena_get_ptr(
+      arena, YR_AC_TRANSITION_TABLE, 0);
+
+  t_table[0] = YR_AC_MAKE_TRANSITION(0, 0);
+
+  yr_bitmask_set(new_automaton->bitmask, 0);
+
+  new_automaton->t_table_unused_candidate = 1;
+  new_automaton->root->failure = new_automaton->root;
+  new_automaton->patch->slot_states[0] = new_automaton->root;
+
+  *automaton = new_automaton;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds a match to a patchable automaton at the state reached with the given
+// bytes, which are the bytes of an atom. The automaton's tables don't change
+// until yr_ac_patch is called.
+//
+// Args:
+//   automaton: Pointer to a patchable automaton.
+//   bytes: Atom's bytes.
+//   length: Atom's length, no more than YR_MAX_ATOM_LENGTH.
+//   [out] match_id: Identifier of the new match.
+//
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_INVALID_ARGUMENT
+//   ERROR_INSUFFICIENT_MEMORY
+//
+int yr_ac_add_match(
+    YR_AC_AUTOMATON* automaton,
+    const uint8_t* bytes,
+    int length,
+    uint32_t* match_id)
+{
+  YR_AC_PATCH* patch = automaton->patch;
+  YR_AC_STATE* state = automaton->root;
+  YR_AC_PATCH_MATCH* match;
+
+  uint32_t id;
+
+  if (length > YR_MAX_ATOM_LENGTH)
+    return ERROR_INVALID_ARGUMENT;
+
+  for (int i = 0; i < length; i++)
+  {
+    YR_AC_STATE* next_state = _yr_ac_next_state(state, bytes[i]);
+
+    if (next_state == NULL)
+    {
+      if (!(state->flags & (YR_AC_STATE_FLAGS_NEW | YR_AC_STATE_FLAGS_GROWN)))
+      {
+        FAIL_ON_ERROR(_yr_ac_state_list_push(&patch->grown_states, state));
+        state->flags |= YR_AC_STATE_FLAGS_GROWN;
+      }
+
+      next_state = _yr_ac_state_create(state, bytes[i]);
+
+      if (next_state == NULL)
+        return ERROR_INSUFFICIENT_MEMORY;
+
+      next_state->flags = YR_AC_STATE_FLAGS_NEW;
+
+      FAIL_ON_ERROR(_yr_ac_state_list_push(&patch->new_states, next_state));
+    }
+
+    state = next_state;
+  }
+
+  if (patch->free_matches != 0)
+  {
+    id = patch->free_matches - 1;
+    patch->free_matches = patch->matches[id].next;
+  }
+  else
+  {
+    if (patch->num_matches == patch->max_matches)
+    {
+      uint32_t max_matches = (patch->max_matches == 0) ? 1024
+                                                       : patch->max_matches * 2;
+
+      match = (YR_AC_PATCH_MATCH*) yr_realloc(
+          patch->matches, max_matches * sizeof(YR_AC_PATCH_MATCH));
+
+      if (match == NULL)
+        return ERROR_INSUFFICIENT_MEMORY;
+
+      patch->matches = match;
+      patch->max_matches = max_matches;
+    }
+
+    id = patch->num_matches++;
+  }
+
+  // Like yr_ac_add_string, put the match at the head of the state's list.
+  match = &patch->matches[id];
+  match->state = state;
+  match->prev = 0;
+  match->next = state->first_match;
+
+  if (state->first_match != 0)
+    patch->matches[state->first_match - 1].prev = id + 1;
+
+  state->first_match = id + 1;
+
+  *match_id = id;
+
+  return _yr_ac_mark_dirty(patch, state, YR_AC_STATE_FLAGS_HEAD_DIRTY);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Removes a match added with yr_ac_add_match. The match identifier can be
+// returned again by yr_ac_add_match. States are never removed, so removing
+// a match doesn't change the transition table.
+//
+int yr_ac_remove_match(YR_AC_AUTOMATON* automaton, uint32_t match_id)
+{
+  YR_AC_PATCH* patch = automaton->patch;
+  YR_AC_PATCH_MATCH* match;
+
+  if (match_id >= patch->num_matches)
+    return ERROR_INVALID_ARGUMENT;
+
+  match = &patch->matches[match_id];
+
+  if (match->state == NULL)
+    return ERROR_INVALID_ARGUMENT;
+
+  if (match->prev != 0)
+    patch->matches[match->prev - 1].next = match->next;
+  else
+    match->state->first_match = match->next;
+
+  if (match->next != 0)
+    patch->matches[match->next - 1].prev = match->prev;
+
+  if (match->prev == 0)
+    FAIL_ON_ERROR(_yr_ac_mark_dirty(
+        patch, match->state, YR_AC_STATE_FLAGS_HEAD_DIRTY));
+
+  match->state = NULL;
+  match->prev = 0;
+  match->next = patch->free_matches;
+  patch->free_matches = match_id + 1;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Updates the transition and match tables of a patchable automaton after
+// adding or removing matches. Instead of building the tables from scratch as
+// yr_ac_compile does, only the new states and the states affected by them are
+// visited, so the time required depends on the number of changes and not on
+// the size of the automaton. The resulting tables are equivalent to the ones
+// built by yr_ac_compile, but the states may be at different slots.
+//
+// If this function fails the automaton is left in an inconsistent state and
+// must be destroyed.
+//
+int yr_ac_patch(YR_AC_AUTOMATON* automaton)
+{
+  YR_AC_PATCH* patch = automaton->patch;
+  YR_AC_STATE* root_state = automaton->root;
+  YR_AC_STATE* state;
+
+  YR_AC_TRANSITION* t_table;
+  uint32_t* m_table;
+
+  // Compute the failure links for the new states, which may be the new
+  // failure links of existing states too.
+  for (int d = 1; d <= YR_MAX_ATOM_LENGTH; d++)
+  {
+    for (uint32_t i = 0; i < patch->new_states.count; i++)
+    {
+      state = patch->new_states.states[i];
+
+      if (state->depth == d)
+        FAIL_ON_ERROR(_yr_ac_link_new_state(automaton, state));
+    }
+  }
+
+  // A state with new children may not need its failure link anymore, or the
+  // states whose failure link points to it may need theirs now. Failure links
+  // to the root state are never removed, so there's nothing to do in that
+  // case.
+  for (uint32_t i = 0; i < patch->grown_states.count; i++)
+  {
+    state = patch->grown_states.states[i];
+
+    if (state == root_state)
+      continue;
+
+    FAIL_ON_ERROR(
+        _yr_ac_mark_dirty(patch, state, YR_AC_STATE_FLAGS_OPT_DIRTY));
+
+    FAIL_ON_ERROR(_yr_ac_mark_list_dirty(
+        patch, state->failure_first, YR_AC_STATE_FLAGS_OPT_DIRTY));
+  }
+
+  // Put the new states in the transition table. Their parents must be there
+  // before them, so states are placed in order of depth.
+  for (uint32_t i = 0; i < patch->grown_states.count; i++)
+    FAIL_ON_ERROR(
+        _yr_ac_place_new_children(automaton, patch->grown_states.states[i]));
+
+  for (int d = 1; d <= YR_MAX_ATOM_LENGTH; d++)
+  {
+    for (uint32_t i = 0; i < patch->new_states.count; i++)
+    {
+      state = patch->new_states.states[i];
+
+      if (state->depth == d)
+        FAIL_ON_ERROR(_yr_ac_place_new_state(automaton, state));
+    }
+  }
+
+  t_table = yr_arena_get_ptr(automaton->arena, YR_AC_TRANSITION_TABLE, 0);
+  m_table = yr_arena_get_ptr(automaton->arena, YR_AC_STATE_MATCHES_TABLE, 0);
+
+  // Write the failure links, optimized as in _yr_ac_optimize_failure_links.
+  // When the link for a state changes, the links for states whose failure
+  // link is that state may change too.
+  for (int d = 1; d <= YR_MAX_ATOM_LENGTH; d++)
+  {
+    for (uint32_t i = 0; i < patch->opt_dirty[d].count; i++)
+    {
+      state = patch->opt_dirty[d].states[i];
+
+      YR_AC_STATE* failure_state = state->failure;
+      uint32_t slot = failure_state->t_table_slot;
+
+      if (failure_state != root_state &&
+          _yr_ac_transitions_subset(state, failure_state))
+        slot = YR_AC_NEXT_STATE(t_table[slot]);
+
+      if (state->flags & YR_AC_STATE_FLAGS_NEW)
+      {
+        t_table[state->t_table_slot] = YR_AC_MAKE_TRANSITION(slot, 0);
+      }
+      else if (YR_AC_NEXT_STATE(t_table[state->t_table_slot]) != slot)
+      {
+        t_table[state->t_table_slot] = YR_AC_MAKE_TRANSITION(slot, 0);
+
+        FAIL_ON_ERROR(_yr_ac_mark_list_dirty(
+            patch, state->failure_first, YR_AC_STATE_FLAGS_OPT_DIRTY));
+      }
+    }
+  }
+
+  // Write the heads of the lists of matches. The list for a state starts
+  // with its own matches and continues with the list of its failure state,
+  // as in _yr_ac_create_failure_links.
+  for (int d = 0; d <= YR_MAX_ATOM_LENGTH; d++)
+  {
+    for (uint32_t i = 0; i < patch->head_dirty[d].count; i++)
+    {
+      state = patch->head_dirty[d].states[i];
+
+      uint32_t matches = state->first_match;
+
+      if (matches == 0 && state != root_state)
+        matches = state->failure->matches;
+
+      if (!(state->flags & YR_AC_STATE_FLAGS_NEW) && matches == state->matches)
+        continue;
+
+      state->matches = matches;
+      m_table[state->t_table_slot] = matches;
+
+      if (state == root_state)
+      {
+        for (int j = 0; j < 256; j++)
+          FAIL_ON_ERROR(_yr_ac_mark_list_dirty(
+              patch, patch->root_failures[j], YR_AC_STATE_FLAGS_HEAD_DIRTY));
+      }
+      else
+      {
+        FAIL_ON_ERROR(_yr_ac_mark_list_dirty(
+            patch, state->failure_first, YR_AC_STATE_FLAGS_HEAD_DIRTY));
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < patch->new_states.count; i++)
+  {
+    patch->new_states.states[i]->flags = 0;
+    patch->num_states[patch->new_states.states[i]->depth]++;
+  }
+
+  for (uint32_t i = 0; i < patch->grown_states.count; i++)
+    patch->grown_states.states[i]->flags = 0;
+
+  for (int d = 0; d <= YR_MAX_ATOM_LENGTH; d++)
+  {
+    for (uint32_t i = 0; i < patch->opt_dirty[d].count; i++)
+      patch->opt_dirty[d].states[i]->flags = 0;
+
+    for (uint32_t i = 0; i < patch->head_dirty[d].count; i++)
+      patch->head_dirty[d].states[i]->flags = 0;
+
+    patch->opt_dirty[d].count = 0;
+    patch->head_dirty[d].count = 0;
+  }
+
+  patch->new_states.count = 0;
+  patch->grown_states.count = 0;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Writes the tables of a patchable automaton in an arena, in the same format
+// used by yr_ac_compile. The YR_AC_MATCH structures must be in the arena's
+// YR_AC_STATE_MATCHES_POOL already, pool_indexes[N] is the index within the
+// pool of the structure for match N. Their "next" fields are overwritten.
+//
+int yr_ac_write_tables(
+    YR_AC_AUTOMATON* automaton,
+    YR_ARENA* arena,
+    const uint32_t* pool_indexes)
+{
+  YR_AC_PATCH* patch = automaton->patch;
+  YR_AC_TRANSITION* t_table;
+  uint32_t* m_table;
+  uint32_t* patch_m_table;
+  YR_AC_MATCH* pool;
+
+  FAIL_ON_ERROR(yr_arena_allocate_memory(
+      arena,
+      YR_AC_TRANSITION_TABLE,
+      automaton->tables_size * sizeof(YR_AC_TRANSITION),
+      NULL));
+
+  FAIL_ON_ERROR(yr_arena_allocate_memory(
+      arena,
+      YR_AC_STATE_MATCHES_TABLE,
+      automaton->tables_size * sizeof(uint32_t),
+      NULL));
+
+  t_table = yr_arena_get_ptr(arena, YR_AC_TRANSITION_TABLE, 0);
+  m_table = yr_arena_get_ptr(arena, YR_AC_STATE_MATCHES_TABLE, 0);
+  pool = yr_arena_get_ptr(arena, YR_AC_STATE_MATCHES_POOL, 0);
+
+  memcpy(
+      t_table,
+      yr_arena_get_ptr(automaton->arena, YR_AC_TRANSITION_TABLE, 0),
+      automaton->tables_size * sizeof(YR_AC_TRANSITION));
+
+  patch_m_table = yr_arena_get_ptr(
+      automaton->arena, YR_AC_STATE_MATCHES_TABLE, 0);
+
+  for (uint32_t i = 0; i < automaton->tables_size; i++)
+  {
+    if (patch_m_table[i] == 0)
+      m_table[i] = 0;
+    else
+      m_table[i] = pool_indexes[patch_m_table[i] - 1] + 1;
+  }
+
+  for (uint32_t i = 0; i < patch->num_matches; i++)
+  {
+    YR_AC_PATCH_MATCH* match = &patch->matches[i];
+    uint32_t next = match->next;
+
+    if (match->state == NULL)
+      continue;
+
+    if (next == 0 && match->state != automaton->root)
+      next = match->state->failure->matches;
+
+    if (next == 0)
+      pool[pool_indexes[i]].next = NULL;
+    else
+      pool[pool_indexes[i]].next = &pool[pool_indexes[next - 1]];
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds byte b to the set represented by the nibble lookup tables lo and hi.
+// See the description of YR_AC_PREFILTER for details.
+//
+static void _yr_ac_prefilter_add_to_set(uint8_t* lo, uint8_t* hi, uint8_t b)
+{
+  if (b < 0x80)
+    lo[b & 0x0F] |= 1 << (b >> 4);
+  else
+    hi[b & 0x0F] |= 1 << ((b >> 4) - 8);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Portable implementation of YR_AC_PREFILTER_FIND_FUNC. Positions followed by
+// another byte are checked against the "pairs" bitmap, the last byte in the
+// data only against the "first" bitmap.
+//
+static size_t _yr_ac_prefilter_find(
+    const YR_AC_PREFILTER* prefilter,
+    const uint8_t* data,
+    size_t data_size,
+    size_t i,
+    size_t limit)
+{
+  size_t pairs_limit = yr_min(limit, data_size - 1);
+
+  while (i < pairs_limit)
+  {
+    if (yr_bitmask_is_set(prefilter->pairs, (data[i] << 8) | data[i + 1]))
+      return i;
+
+    i++;
+  }
+
+  if (i < limit && yr_bitmask_is_set(prefilter->first, data[i]))
+    return i;
+
+  return limit;
+}
+
+#if defined(YR_AC_PREFILTER_X86)
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns a vector where the bytes that belong to the set represented by the
+// lookup tables lo and hi are non-zero, and the remaining ones are zero.
+//
+__attribute__((target("sse4.2"))) static inline __m128i _yr_ac_set_lookup_128(
+    __m128i v,
+    __m128i lo,
+    __m128i hi)
+{
+  const __m128i bits = _mm_setr_epi8(
+      1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+
+  // _mm_shuffle_epi8 produces zero for bytes with the highest bit set, so
+  // bytes in the 0x80-0xFF range are looked up in "hi" after flipping that bit.
+  __m128i r = _mm_or_si128(
+      _mm_shuffle_epi8(lo, v),
+      _mm_shuffle_epi8(hi, _mm_xor_si128(v, _mm_set1_epi8(-128))));
+
+  __m128i n = _mm_and_si128(_mm_srli_epi64(v, 4), _mm_set1_epi8(0x0F));
+
+  return _mm_and_si128(r, _mm_shuffle_epi8(bits, n));
+}
+
+__attribute__((target("sse4.2"))) static size_t _yr_ac_prefilter_find_sse42(
+    const YR_AC_PREFILTER* prefilter,
+    const uint8_t* data,
+    size_t data_size,
+    size_t i,
+    size_t limit)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i first_lo = _mm_loadu_si128((__m128i*) prefilter->first_lo);
+  const __m128i first_hi = _mm_loadu_si128((__m128i*) prefilter->first_hi);
+  const __m128i second_lo = _mm_loadu_si128((__m128i*) prefilter->second_lo);
+  const __m128i second_hi = _mm_loadu_si128((__m128i*) prefilter->second_hi);
+
+  // Each iteration reads 17 bytes, the 16 positions being checked plus the
+  // byte that follows the last one.
+  while (i + 16 <= limit && i + 17 <= data_size)
+  {
+    __m128i v1 = _mm_loadu_si128((__m128i*) (data + i));
+    __m128i v2 = _mm_loadu_si128((__m128i*) (data + i + 1));
+
+    // The lookups for the first and second byte return different bits for
+    // the same position, they can't be combined before comparing with zero.
+    __m128i m1 = _mm_cmpeq_epi8(
+        _yr_ac_set_lookup_128(v1, first_lo, first_hi), zero);
+    __m128i m2 = _mm_cmpeq_epi8(
+        _yr_ac_set_lookup_128(v2, second_lo, second_hi), zero);
+
+    uint32_t candidates = ~_mm_movemask_epi8(_mm_or_si128(m1, m2)) & 0xFFFF;
+
+    while (candidates != 0)
+    {
+      size_t j = i + __builtin_ctz(candidates);
+
+      if (yr_bitmask_is_set(prefilter->pairs, (data[j] << 8) | data[j + 1]))
+        return j;
+
+      candidates &= candidates - 1;
+    }
+
+    i += 16;
+  }
+
+  return _yr_ac_prefilter_find(prefilter, data, data_size, i, limit);
+}
+
+__attribute__((target("avx2"))) static inline __m256i _yr_ac_set_lookup_256(
+    __m256i v,
+    __m256i lo,
+    __m256i hi)
+{
+  const __m256i bits = _mm256_setr_epi8(
+      1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+      1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+
+  __m256i r = _mm256_or_si256(
+      _mm256_shuffle_epi8(lo, v),
+      _mm256_shuffle_epi8(hi, _mm256_xor_si256(v, _mm256_set1_epi8(-128))));
+
+  __m256i n = _mm256_and_si256(
+      _mm256_srli_epi64(v, 4), _mm256_set1_epi8(0x0F));
+
+  return _mm256_and_si256(r, _mm256_shuffle_epi8(bits, n));
+}
+
+__attribute__((target("avx2"))) static size_t _yr_ac_prefilter_find_avx2(
+    const YR_AC_PREFILTER* prefilter,
+    const uint8_t* data,
+    size_t data_size,
+    size_t i,
+    size_t limit)
+{
+  const __m256i zero = _mm256_setzero_si256();
+
+  // _mm256_shuffle_epi8 works on each 128-bits lane independently, so the
+  // lookup tables are replicated in both lanes.
+  const __m256i first_lo = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((__m128i*) prefilter->first_lo));
+  const __m256i first_hi = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((__m128i*) prefilter->first_hi));
+  const __m256i second_lo = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((__m128i*) prefilter->second_lo));
+  const __m256i second_hi = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((__m128i*) prefilter->second_hi));
+
+  while (i + 32 <= limit && i + 33 <= data_size)
+  {
+    __m256i v1 = _mm256_loadu_si256((__m256i*) (data + i));
+    __m256i v2 = _mm256_loadu_si256((__m256i*) (data + i + 1));
+
+    __m256i m1 = _mm256_cmpeq_epi8(
+        _yr_ac_set_lookup_256(v1, first_lo, first_hi), zero);
+    __m256i m2 = _mm256_cmpeq_epi8(
+        _yr_ac_set_lookup_256(v2, second_lo, second_hi), zero);
+
+    uint32_t candidates = ~(uint32_t) _mm256_movemask_epi8(
+        _mm256_or_si256(m1, m2));
+
+    while (candidates != 0)
+    {
+      size_t j = i + __builtin_ctz(candidates);
+
+      if (yr_bitmask_is_set(prefilter->pairs, (data[j] << 8) | data[j + 1]))
+        return j;
+
+      candidates &= candidates - 1;
+    }
+
+    i += 32;
+  }
+
+  // Some compilers don't emit a vzeroupper before tail calls. Without it the
+  // upper halves of the YMM registers remain dirty after returning, and every
+  // SSE instruction executed later, including those in libm functions like
+  // log2, pays the penalty for mixing AVX and SSE code.
+  _mm256_zeroupper();
+
+  return _yr_ac_prefilter_find(prefilter, data, data_size, i, limit);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates the prefilter for the automaton represented by the given transition
+// and match tables.
+//
+// Args:
+//   transition_table: Pointer to the automaton's transition table.
+//   match_table: Pointer to the automaton's match table.
+//   prefilter: Address of a pointer that receives the new prefilter, or NULL
+//     if the automaton can't be prefiltered because the root state has
+//     matches, or if more than YR_AC_PREFILTER_MAX_PAIRS pairs of bytes can
+//     start an atom.
+//
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_INSUFFICIENT_MEMORY
+//
+int yr_ac_prefilter_create(
+    const YR_AC_TRANSITION* transition_table,
+    const uint32_t* match_table,
+    YR_AC_PREFILTER** prefilter)
+{
+  YR_AC_PREFILTER* new_prefilter;
+  uint32_t num_pairs = 0;
+
+  *prefilter = NULL;
+
+  // If the root state has matches they must be verified at every position in
+  // the input, nothing can be skipped.
+  if (match_table[YR_AC_ROOT_STATE] != 0)
+    return ERROR_SUCCESS;
+
+  new_prefilter = (YR_AC_PREFILTER*) yr_calloc(1, sizeof(YR_AC_PREFILTER));
+
+  if (new_prefilter == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  for (int b1 = 0; b1 < 256; b1++)
+  {
+    YR_AC_TRANSITION t = transition_table[YR_AC_ROOT_STATE + b1 + 1];
+
+    if (YR_AC_INVALID_TRANSITION(t, b1 + 1))
+      continue;
+
+    uint32_t state = YR_AC_NEXT_STATE(t);
+
+    yr_bitmask_set(new_prefilter->first, b1);
+
+    for (int b2 = 0; b2 < 256; b2++)
+    {
+      // The failure link of every state at depth 1 is the root state. When
+      // the state reached with b1 has no matches and no transition for b2 the
+      // automaton ends up in the same state it would reach by reading b2 from
+      // the root, which means that the position of b1 can be skipped.
+      if (match_table[state] == 0 &&
+          YR_AC_INVALID_TRANSITION(transition_table[state + b2 + 1], b2 + 1))
+        continue;
+
+      yr_bitmask_set(new_prefilter->pairs, (b1 << 8) | b2);
+      num_pairs++;
+
+      _yr_ac_prefilter_add_to_set(
+          new_prefilter->first_lo, new_prefilter->first_hi, b1);
+
+      _yr_ac_prefilter_add_to_set(
+          new_prefilter->second_lo, new_prefilter->second_hi, b2);
+    }
+  }
+
+  // When too many pairs can start an atom the prefilter finds candidates so
+  // often that it's slower than walking the transition table directly.
+  if (num_pairs > YR_AC_PREFILTER_MAX_PAIRS)
+  {
+    yr_free(new_prefilter);
+    return ERROR_SUCCESS;
+  }
+
+  // Use the fastest implementation supported by the CPU.
+  if (yr_ac_prefilter_set_find(new_prefilter, YR_AC_PREFILTER_AVX2) !=
+          ERROR_SUCCESS &&
+      yr_ac_prefilter_set_find(new_prefilter, YR_AC_PREFILTER_SSE42) !=
+          ERROR_SUCCESS)
+  {
+    yr_ac_prefilter_set_find(new_prefilter, YR_AC_PREFILTER_SCALAR);
+  }
+
+  *prefilter = new_prefilter;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Selects the implementation of the prefilter's find function. This is done
+// by yr_ac_prefilter_create, which picks the fastest one, but can be used for
+// comparing the different implementations.
+//
+// Args:
+//   prefilter: Pointer to the prefilter.
+//   implementation: One of YR_AC_PREFILTER_SCALAR, YR_AC_PREFILTER_SSE42 or
+//     YR_AC_PREFILTER_AVX2.
+//
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_INVALID_ARGUMENT if the implementation is not supported by the CPU
+//     or was not compiled in.
+//
+int yr_ac_prefilter_set_find(YR_AC_PREFILTER* prefilter, int implementation)
+{
+  switch (implementation)
+  {
+  case YR_AC_PREFILTER_SCALAR:
+    prefilter->find = _yr_ac_prefilter_find;
+    return ERROR_SUCCESS;
+
+#if defined(YR_AC_PREFILTER_X86)
+  case YR_AC_PREFILTER_SSE42:
+    __builtin_cpu_init();
+
+    if (!__builtin_cpu_supports("sse4.2"))
+      return ERROR_INVALID_ARGUMENT;
+
+    prefilter->find = _yr_ac_prefilter_find_sse42;
+    return ERROR_SUCCESS;
+
+  case YR_AC_PREFILTER_AVX2:
+    __builtin_cpu_init();
+
+    if (!__builtin_cpu_supports("avx2"))
+      return ERROR_INVALID_ARGUMENT;
+
+    prefilter->find = _yr_ac_prefilter_find_avx2;
+    return ERROR_SUCCESS;
+#endif
+  }
+
+  return ERROR_INVALID_ARGUMENT;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Destroys a prefilter created with yr_ac_prefilter_create.
+//
+void yr_ac_prefilter_destroy(YR_AC_PREFILTER* prefilter)
+{
+  yr_free(prefilter);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Prints automaton for debug purposes.
 //
@@ -27,14 +27,26 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stddef.h>
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <yara/arena.h>
 #include <yara/error.h>
 #include <yara/mem.h>
 
 typedef struct YR_ARENA_FILE_HEADER YR_ARENA_FILE_HEADER;
 typedef struct YR_ARENA_FILE_BUFFER YR_ARENA_FILE_BUFFER;
+typedef struct YR_ARENA_SHARED_HEADER YR_ARENA_SHARED_HEADER;
 
 #pragma pack(push)
 #pragma pack(1)
@@ -46,6 +58,18 @@ struct YR_ARENA_FILE_HEADER
   uint8_t num_buffers;
 };
 
+// Header that precedes the arena file in shared memory objects created by
+// yr_arena_publish_fd. The relocatable pointers in the arena file are already
+// adjusted for a mapping of the whole object starting at address base. The
+// header is followed by tag_length bytes with the null-terminated tag, if any,
+// and by the arena file at the next multiple of YR_ARENA_FILE_ALIGNMENT.
+struct YR_ARENA_SHARED_HEADER
+{
+  uint8_t magic[4];
+  uint32_t tag_length;
+  uint64_t base;
+};
+
 struct YR_ARENA_FILE_BUFFER
 {
   uint64_t offset;
@@ -54,6 +78,83 @@ struct YR_ARENA_FILE_BUFFER
 
 #pragma pack(pop)
 
+// Buffers are saved at file offsets that are multiples of this value, so that
+// the structures they contain are properly aligned when the file is mapped in
+// memory by yr_arena_load_file.
+#define YR_ARENA_FILE_ALIGNMENT 16
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if the given address is inside the mapping of the file from
+// which the arena was loaded with yr_arena_load_file.
+//
+static bool _yr_arena_is_mapped(YR_ARENA* arena, const void* address)
+{
+  return arena->mapped_data != NULL &&
+         (const uint8_t*) address >= arena->mapped_data &&
+         (const uint8_t*) address < arena->mapped_data + arena->mapped_size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rounds a file offset up to the next multiple of YR_ARENA_FILE_ALIGNMENT.
+//
+static uint64_t _yr_arena_file_align(uint64_t offset)
+{
+  return (offset + YR_ARENA_FILE_ALIGNMENT - 1) &
+         ~((uint64_t) YR_ARENA_FILE_ALIGNMENT - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Unmaps a file mapped by yr_arena_load_file.
+//
+static void _yr_arena_unmap(void* data, size_t size, void* mapping_handle)
+{
+#if defined(_WIN32) || defined(__CYGWIN__)
+  UnmapViewOfFile(data);
+  CloseHandle((HANDLE) mapping_handle);
+#else
+  munmap(data, size);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Builds the relocation list of an arena loaded with yr_arena_load_file from
+// the relocation entries in the mapped file. Does nothing if the list was
+// already built or the arena was not loaded from a file.
+//
+static int _yr_arena_load_relocs(YR_ARENA* arena)
+{
+  if (arena->mapped_relocs == NULL || arena->num_mapped_relocs == 0)
+    return ERROR_SUCCESS;
+
+  arena->reloc_pool = (YR_RELOC*) yr_malloc(
+      arena->num_mapped_relocs * sizeof(YR_RELOC));
+
+  if (arena->reloc_pool == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  for (size_t i = 0; i < arena->num_mapped_relocs; ++i)
+  {
+    YR_ARENA_REF ref;
+
+    memcpy(&ref, arena->mapped_relocs + i * sizeof(ref), sizeof(ref));
+
+    arena->reloc_pool[i].buffer_id = ref.buffer_id;
+    arena->reloc_pool[i].offset = ref.offset;
+    arena->reloc_pool[i].next = &arena->reloc_pool[i + 1];
+  }
+
+  // Entries added after loading the arena go after the ones in the pool.
+  arena->reloc_pool[arena->num_mapped_relocs - 1].next = arena->reloc_list_head;
+
+  if (arena->reloc_list_head == NULL)
+    arena->reloc_list_tail = &arena->reloc_pool[arena->num_mapped_relocs - 1];
+
+  arena->reloc_list_head = &arena->reloc_pool[0];
+  arena->mapped_relocs = NULL;
+
+  return ERROR_SUCCESS;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Tells the arena that certain offsets within a buffer contain relocatable
 // pointers. The offsets are passed as a vararg list where the end of the
@@ -146,6 +247,10 @@ static int _yr_arena_allocate_memory(
 
   if (b->size - b->used < size)
   {
+    // All the relocatable pointers must be in the relocation list before
+    // moving the buffer.
+    FAIL_ON_ERROR(_yr_arena_load_relocs(arena));
+
     size_t new_size = (b->size == 0) ? arena->initial_buffer_size : b->size * 2;
 
     while (new_size < b->used + size) new_size *= 2;
@@ -154,7 +259,21 @@ static int _yr_arena_allocate_memory(
     if (new_size > 1ULL << 32)
       return ERROR_INSUFFICIENT_MEMORY;
 
-    uint8_t* new_data = yr_realloc(b->data, new_size);
+    uint8_t* new_data;
+
+    // Buffers inside a mapped file can't be re-allocated, their data is
+    // copied to a new memory block instead.
+    if (_yr_arena_is_mapped(arena, b->data))
+    {
+      new_data = yr_malloc(new_size);
+
+      if (new_data != NULL)
+        memcpy(new_data, b->data, b->used);
+    }
+    else
+    {
+      new_data = yr_realloc(b->data, new_size);
+    }
 
     if (new_data == NULL)
       return ERROR_INSUFFICIENT_MEMORY;
@@ -271,7 +390,8 @@ int yr_arena_release(YR_ARENA* arena)
 
   for (uint32_t i = 0; i < arena->num_buffers; i++)
   {
-    if (arena->buffers[i].data != NULL)
+    if (arena->buffers[i].data != NULL &&
+        !_yr_arena_is_mapped(arena, arena->buffers[i].data))
       yr_free(arena->buffers[i].data);
   }
 
@@ -280,10 +400,21 @@ int yr_arena_release(YR_ARENA* arena)
   while (reloc != NULL)
   {
     YR_RELOC* next = reloc->next;
-    yr_free(reloc);
+
+    // Entries in the pool are freed all at once below.
+    if (arena->reloc_pool == NULL || reloc < arena->reloc_pool ||
+        reloc >= arena->reloc_pool + arena->num_mapped_relocs)
+      yr_free(reloc);
+
     reloc = next;
   }
 
+  yr_free(arena->reloc_pool);
+
+  if (arena->mapped_data != NULL)
+    _yr_arena_unmap(
+        arena->mapped_data, arena->mapped_size, arena->mapping_handle);
+
   yr_free(arena);
 
   return ERROR_SUCCESS;
@@ -338,6 +469,41 @@ int yr_arena_allocate_zeroed_memory(
       arena, YR_ARENA_ZERO_MEMORY, buffer_id, size, ref);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Makes sure that the next allocations in a buffer totalling "size" bytes
+// don't need to move the buffer. Moving a buffer requires walking the whole
+// relocation list, which is expensive when it's long, so it's better to
+// reserve the space in advance when the final size of a buffer is known.
+//
+// Args:
+//   arena: Pointer to the arena.
+//   buffer_id: Buffer number.
+//   size : Number of bytes to reserve.
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_INVALID_ARGUMENT
+//   ERROR_INSUFFICIENT_MEMORY
+//
+int yr_arena_reserve_memory(YR_ARENA* arena, uint32_t buffer_id, size_t size)
+{
+  if (buffer_id > arena->num_buffers)
+    return ERROR_INVALID_ARGUMENT;
+
+  YR_ARENA_BUFFER* b = &arena->buffers[buffer_id];
+
+  if (b->size - b->used >= size)
+    return ERROR_SUCCESS;
+
+  // The reserved memory is zeroed, as it would be if the buffer was moved
+  // by a later call to yr_arena_allocate_zeroed_memory.
+  FAIL_ON_ERROR(_yr_arena_allocate_memory(
+      arena, YR_ARENA_ZERO_MEMORY, buffer_id, size, NULL));
+
+  b->used -= size;
+
+  return ERROR_SUCCESS;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Allocates a structure within the arena. This function is similar to
 // yr_arena_allocate_memory but additionally receives a variable-length
@@ -556,11 +722,30 @@ int yr_arena_load_stream(YR_STREAM* stream, YR_ARENA** arena)
 
   FAIL_ON_ERROR(yr_arena_create(hdr.num_buffers, 10485, &new_arena))
 
+  uint64_t position = sizeof(hdr) + sizeof(buffers[0]) * hdr.num_buffers;
+
   for (int i = 0; i < hdr.num_buffers; ++i)
   {
     if (buffers[i].size == 0)
       continue;
 
+    // Skip the padding that precedes the buffer, which is always shorter
+    // than YR_ARENA_FILE_ALIGNMENT.
+    uint8_t padding[YR_ARENA_FILE_ALIGNMENT];
+
+    if (buffers[i].offset < position ||
+        buffers[i].offset - position >= sizeof(padding) ||
+        (buffers[i].offset > position &&
+         yr_stream_read(
+             padding, (size_t) (buffers[i].offset - position), 1, stream) !=
+             1))
+    {
+      yr_arena_release(new_arena);
+      return ERROR_CORRUPT_FILE;
+    }
+
+    position = buffers[i].offset + buffers[i].size;
+
     YR_ARENA_REF ref;
 
     FAIL_ON_ERROR_WITH_CLEANUP(
@@ -605,6 +790,310 @@ int yr_arena_load_stream(YR_STREAM* stream, YR_ARENA** arena)
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Creates an arena whose buffers are inside a mapping that starts at data and
+// contains a file saved with yr_arena_save_stream at image_offset. The mapping
+// must be writable, either private copy-on-write or shared. The arena takes
+// ownership of the mapping, which is unmapped if the function fails. The
+// relocatable pointers are left as they are in the mapping, callers must
+// either resolve them with _yr_arena_resolve_refs or rebase them with
+// _yr_arena_rebase.
+//
+static int _yr_arena_create_mapped(
+    uint8_t* data,
+    size_t size,
+    void* mapping_handle,
+    size_t image_offset,
+    YR_ARENA** arena)
+{
+  YR_ARENA_FILE_HEADER hdr;
+  YR_ARENA_FILE_BUFFER buffers[YR_MAX_ARENA_BUFFERS];
+  YR_ARENA* new_arena;
+
+  int result = yr_arena_create(YR_MAX_ARENA_BUFFERS, 10485, &new_arena);
+
+  if (result != ERROR_SUCCESS)
+  {
+    _yr_arena_unmap(data, size, mapping_handle);
+    return result;
+  }
+
+  new_arena->mapped_data = data;
+  new_arena->mapped_size = size;
+  new_arena->mapping_handle = mapping_handle;
+
+  if (size < image_offset + sizeof(hdr))
+  {
+    yr_arena_release(new_arena);
+    return ERROR_INVALID_FILE;
+  }
+
+  uint8_t* image = data + image_offset;
+  size_t image_size = size - image_offset;
+
+  memcpy(&hdr, image, sizeof(hdr));
+
+  if (hdr.magic[0] != 'Y' || hdr.magic[1] != 'A' || hdr.magic[2] != 'R' ||
+      hdr.magic[3] != 'A' || hdr.num_buffers > YR_MAX_ARENA_BUFFERS)
+  {
+    yr_arena_release(new_arena);
+    return ERROR_INVALID_FILE;
+  }
+
+  if (hdr.version != YR_ARENA_FILE_VERSION)
+  {
+    yr_arena_release(new_arena);
+    return ERROR_UNSUPPORTED_FILE_VERSION;
+  }
+
+  uint64_t position = sizeof(hdr) + sizeof(buffers[0]) * hdr.num_buffers;
+
+  if (image_size < position)
+  {
+    yr_arena_release(new_arena);
+    return ERROR_CORRUPT_FILE;
+  }
+
+  memcpy(buffers, image + sizeof(hdr), sizeof(buffers[0]) * hdr.num_buffers);
+
+  new_arena->num_buffers = hdr.num_buffers;
+
+  for (int i = 0; i < hdr.num_buffers; ++i)
+  {
+    if (buffers[i].size == 0)
+      continue;
+
+    if (buffers[i].offset < position || buffers[i].size > image_size ||
+        buffers[i].offset > image_size - buffers[i].size)
+    {
+      yr_arena_release(new_arena);
+      return ERROR_CORRUPT_FILE;
+    }
+
+    new_arena->buffers[i].data = image + buffers[i].offset;
+    new_arena->buffers[i].size = buffers[i].size;
+    new_arena->buffers[i].used = buffers[i].size;
+
+    position = buffers[i].offset + buffers[i].size;
+  }
+
+  // The relocation entries go from the end of the last buffer up to the end
+  // of the file. They stay there until the relocation list is needed, see
+  // _yr_arena_load_relocs.
+  new_arena->mapped_relocs = image + position;
+  new_arena->num_mapped_relocs = (size_t) ((image_size - position) /
+                                           sizeof(YR_ARENA_REF));
+
+  *arena = new_arena;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns a pointer to the relocatable pointer described by the i-th entry in
+// the relocation table of an arena created with _yr_arena_create_mapped, or
+// NULL if the entry is not within the arena's buffers.
+//
+static void** _yr_arena_mapped_reloc_ptr(YR_ARENA* arena, size_t i)
+{
+  YR_ARENA_REF ref;
+
+  memcpy(&ref, arena->mapped_relocs + i * sizeof(ref), sizeof(ref));
+
+  if (ref.buffer_id >= arena->num_buffers ||
+      (size_t) ref.offset + sizeof(void*) > arena->buffers[ref.buffer_id].used)
+    return NULL;
+
+  return (void**) (arena->buffers[ref.buffer_id].data + ref.offset);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Converts the references that occupy the place of relocatable pointers in an
+// arena created with _yr_arena_create_mapped into actual pointers.
+//
+static int _yr_arena_resolve_refs(YR_ARENA* arena)
+{
+  for (size_t i = 0; i < arena->num_mapped_relocs; ++i)
+  {
+    void** reloc_ptr = _yr_arena_mapped_reloc_ptr(arena, i);
+
+    if (reloc_ptr == NULL)
+      return ERROR_CORRUPT_FILE;
+
+    YR_ARENA_REF target;
+
+    memcpy(&target, reloc_ptr, sizeof(target));
+
+    if (!YR_ARENA_IS_NULL_REF(target) &&
+        (target.buffer_id >= arena->num_buffers ||
+         target.offset > arena->buffers[target.buffer_id].used))
+      return ERROR_CORRUPT_FILE;
+
+    // Let's convert the reference into a pointer.
+    *reloc_ptr = yr_arena_ref_to_ptr(arena, &target);
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adjusts the relocatable pointers in an arena created with
+// _yr_arena_create_mapped, which point into a mapping of the same data that
+// started at address base, so that they point into the arena's own mapping.
+// Non-null pointers that don't end up within the mapping are considered an
+// error. If the arena is mapped at base the pointers are only validated.
+//
+static int _yr_arena_rebase(YR_ARENA* arena, uint64_t base)
+{
+  for (size_t i = 0; i < arena->num_mapped_relocs; ++i)
+  {
+    void** reloc_ptr = _yr_arena_mapped_reloc_ptr(arena, i);
+
+    if (reloc_ptr == NULL)
+      return ERROR_CORRUPT_FILE;
+
+    if (*reloc_ptr == NULL)
+      continue;
+
+    uint8_t* ptr = arena->mapped_data +
+                   ((uint64_t) (uintptr_t) *reloc_ptr - base);
+
+    if (!_yr_arena_is_mapped(arena, ptr))
+      return ERROR_CORRUPT_FILE;
+
+    // Only write the pointer if it actually changes, otherwise the page where
+    // it resides would become a private copy for no reason.
+    if (*reloc_ptr != ptr)
+      *reloc_ptr = ptr;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates an arena whose buffers are inside the file image pointed to by data,
+// which must be a writable copy-on-write mapping of a file saved with
+// yr_arena_save_stream. Relocatable pointers are adjusted in place. The
+// arena takes ownership of the mapping, which is unmapped if the function
+// fails.
+//
+static int _yr_arena_load_mapped(
+    uint8_t* data,
+    size_t size,
+    void* mapping_handle,
+    YR_ARENA** arena)
+{
+  YR_ARENA* new_arena;
+
+  FAIL_ON_ERROR(
+      _yr_arena_create_mapped(data, size, mapping_handle, 0, &new_arena));
+
+  FAIL_ON_ERROR_WITH_CLEANUP(
+      _yr_arena_resolve_refs(new_arena), yr_arena_release(new_arena));
+
+  *arena = new_arena;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Loads an arena from a file saved with yr_arena_save_stream by mapping the
+// file in memory. The mapping is private and copy-on-write, so the pages where
+// relocatable pointers are adjusted become private to the process while the
+// rest of the file, like the Aho-Corasick transition table, is shared with the
+// page cache and with other processes that load the same file.
+//
+// The file must not be modified while the arena is in use, changes made to
+// pages that are not private yet are visible through the mapping, and
+// truncating the file makes accesses to the missing pages crash. It can be
+// replaced by renaming another file over it, as yr_rules_save does. On Windows
+// the file is opened without FILE_SHARE_WRITE so that nobody can write it.
+//
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_COULD_NOT_OPEN_FILE
+//   ERROR_COULD_NOT_MAP_FILE
+//   ERROR_INVALID_FILE
+//   ERROR_UNSUPPORTED_FILE_VERSION
+//   ERROR_CORRUPT_FILE
+//   ERROR_INSUFFICIENT_MEMORY
+//
+int yr_arena_load_file(const char* filename, YR_ARENA** arena)
+{
+  uint8_t* data;
+  size_t size;
+  int result;
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+  LARGE_INTEGER file_size;
+
+  HANDLE file = CreateFileA(
+      filename,
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+
+  if (file == INVALID_HANDLE_VALUE)
+    return ERROR_COULD_NOT_OPEN_FILE;
+
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 ||
+      (uint64_t) file_size.QuadPart > SIZE_MAX)
+  {
+    CloseHandle(file);
+    return ERROR_COULD_NOT_MAP_FILE;
+  }
+
+  size = (size_t) file_size.QuadPart;
+
+  HANDLE mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+  CloseHandle(file);
+
+  if (mapping == NULL)
+    return ERROR_COULD_NOT_MAP_FILE;
+
+  data = (uint8_t*) MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, size);
+
+  if (data == NULL)
+  {
+    CloseHandle(mapping);
+    return ERROR_COULD_NOT_MAP_FILE;
+  }
+
+  result = _yr_arena_load_mapped(data, size, (void*) mapping, arena);
+#else
+  struct stat st;
+
+  int fd = open(filename, O_RDONLY);
+
+  if (fd == -1)
+    return ERROR_COULD_NOT_OPEN_FILE;
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+  {
+    close(fd);
+    return ERROR_COULD_NOT_MAP_FILE;
+  }
+
+  size = (size_t) st.st_size;
+
+  data = (uint8_t*) mmap(
+      NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return ERROR_COULD_NOT_MAP_FILE;
+
+  result = _yr_arena_load_mapped(data, size, NULL, arena);
+#endif
+
+  return result;
+}
+
 int yr_arena_save_stream(YR_ARENA* arena, YR_STREAM* stream)
 {
   YR_ARENA_FILE_HEADER hdr;
@@ -617,6 +1106,8 @@ int yr_arena_save_stream(YR_ARENA* arena, YR_STREAM* stream)
   hdr.version = YR_ARENA_FILE_VERSION;
   hdr.num_buffers = arena->num_buffers;
 
+  FAIL_ON_ERROR(_yr_arena_load_relocs(arena));
+
   if (yr_stream_write(&hdr, sizeof(hdr), 1, stream) != 1)
     return ERROR_WRITING_FILE;
 
@@ -627,6 +1118,8 @@ int yr_arena_save_stream(YR_ARENA* arena, YR_STREAM* stream)
 
   for (uint32_t i = 0; i < arena->num_buffers; ++i)
   {
+    offset = _yr_arena_file_align(offset);
+
     YR_ARENA_FILE_BUFFER buffer = {
         .offset = offset,
         .size = (uint32_t) arena->buffers[i].used,
@@ -671,14 +1164,29 @@ int yr_arena_save_stream(YR_ARENA* arena, YR_STREAM* stream)
   }
 
   // Now that all relocatable pointers are converted to references, write the
-  // buffers.
+  // buffers, each one preceded by the padding that aligns it.
+  uint8_t padding[YR_ARENA_FILE_ALIGNMENT] = {0};
+
+  offset = sizeof(YR_ARENA_FILE_HEADER) +
+           sizeof(YR_ARENA_FILE_BUFFER) * arena->num_buffers;
+
   for (uint32_t i = 0; i < arena->num_buffers; ++i)
   {
     YR_ARENA_BUFFER* b = &arena->buffers[i];
 
     if (b->used > 0)
+    {
+      size_t padding_size = (size_t) (_yr_arena_file_align(offset) - offset);
+
+      if (padding_size > 0 &&
+          yr_stream_write(padding, padding_size, 1, stream) != 1)
+        return ERROR_WRITING_FILE;
+
       if (yr_stream_write(b->data, b->used, 1, stream) != 1)
         return ERROR_WRITING_FILE;
+
+      offset += padding_size + b->used;
+    }
   }
 
   // Write the relocation list and restore the pointers back.
@@ -708,3 +1216,216 @@ int yr_arena_save_stream(YR_ARENA* arena, YR_STREAM* stream)
 
   return ERROR_SUCCESS;
 }
+
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+
+////////////////////////////////////////////////////////////////////////////////
+// Writes an arena into fd, which must be an empty shared memory object, like
+// the ones created with memfd_create or shm_open, or a regular file in a
+// memory-backed file system. The arena file is preceded by a
+// YR_ARENA_SHARED_HEADER and the tag, if not NULL, and its relocatable pointers
+// are adjusted for the address where the object is mapped by this function.
+// Processes that attach to the object with yr_arena_attach_fd and manage to
+// map it at that same address don't need to adjust any pointer, and all their
+// pages remain shared.
+//
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_INVALID_ARGUMENT
+//   ERROR_WRITING_FILE
+//   ERROR_COULD_NOT_MAP_FILE
+//   ERROR_INSUFFICIENT_MEMORY
+//
+int yr_arena_publish_fd(YR_ARENA* arena, YR_FILE_DESCRIPTOR fd, const char* tag)
+{
+  // The magic is set once the object is completely written, until then
+  // yr_arena_attach_fd rejects it.
+  YR_ARENA_SHARED_HEADER shdr = {{0}, 0, 0};
+  YR_ARENA* shared_arena;
+  YR_STREAM stream;
+  struct stat st;
+
+  if (fstat(fd, &st) != 0 || st.st_size != 0)
+    return ERROR_INVALID_ARGUMENT;
+
+  size_t tag_length = tag != NULL ? strlen(tag) + 1 : 0;
+
+  if (tag_length > UINT32_MAX)
+    return ERROR_INVALID_ARGUMENT;
+
+  shdr.tag_length = (uint32_t) tag_length;
+
+  size_t image_offset = (size_t) _yr_arena_file_align(
+      sizeof(shdr) + tag_length);
+
+  int stream_fd = dup(fd);
+
+  if (stream_fd == -1)
+    return ERROR_WRITING_FILE;
+
+  FILE* fh = fdopen(stream_fd, "wb");
+
+  if (fh == NULL)
+  {
+    close(stream_fd);
+    return ERROR_WRITING_FILE;
+  }
+
+  stream.user_data = fh;
+  stream.write = (YR_STREAM_WRITE_FUNC) fwrite;
+
+  int result = ERROR_SUCCESS;
+
+  if (fwrite(&shdr, sizeof(shdr), 1, fh) != 1)
+    result = ERROR_WRITING_FILE;
+
+  if (result == ERROR_SUCCESS && tag_length > 0 &&
+      fwrite(tag, tag_length, 1, fh) != 1)
+    result = ERROR_WRITING_FILE;
+
+  for (size_t i = sizeof(shdr) + tag_length;
+       i < image_offset && result == ERROR_SUCCESS;
+       i++)
+  {
+    if (fputc(0, fh) == EOF)
+      result = ERROR_WRITING_FILE;
+  }
+
+  if (result == ERROR_SUCCESS)
+    result = yr_arena_save_stream(arena, &stream);
+
+  if (fclose(fh) != 0 && result == ERROR_SUCCESS)
+    result = ERROR_WRITING_FILE;
+
+  if (result != ERROR_SUCCESS)
+    return result;
+
+  if (fstat(fd, &st) != 0)
+    return ERROR_COULD_NOT_MAP_FILE;
+
+  size_t size = (size_t) st.st_size;
+
+  uint8_t* data = (uint8_t*) mmap(
+      NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (data == MAP_FAILED)
+    return ERROR_COULD_NOT_MAP_FILE;
+
+  // Resolving the references in the shared mapping writes the pointers into
+  // the object itself.
+  FAIL_ON_ERROR(
+      _yr_arena_create_mapped(data, size, NULL, image_offset, &shared_arena));
+
+  result = _yr_arena_resolve_refs(shared_arena);
+
+  if (result == ERROR_SUCCESS)
+  {
+    shdr.magic[0] = 'Y';
+    shdr.magic[1] = 'S';
+    shdr.magic[2] = 'H';
+    shdr.magic[3] = 'M';
+    shdr.base = (uint64_t) (uintptr_t) data;
+
+    memcpy(data, &shdr, sizeof(shdr));
+  }
+
+  yr_arena_release(shared_arena);
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates an arena from a shared memory object written by yr_arena_publish_fd.
+// The object is mapped as private and copy-on-write, at the same address it
+// had in the publishing process if possible. In that case no pointer needs to
+// be adjusted and the process uses the same physical pages as every other
+// process attached to the object. Otherwise only the pages containing
+// relocatable pointers become private. The object itself is never modified.
+// The tag stored in the object, if any, is left in the arena's tag field.
+//
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_COULD_NOT_MAP_FILE
+//   ERROR_COULD_NOT_READ_FILE
+//   ERROR_INVALID_FILE
+//   ERROR_UNSUPPORTED_FILE_VERSION
+//   ERROR_CORRUPT_FILE
+//   ERROR_INSUFFICIENT_MEMORY
+//
+int yr_arena_attach_fd(YR_FILE_DESCRIPTOR fd, YR_ARENA** arena)
+{
+  YR_ARENA_SHARED_HEADER shdr;
+  YR_ARENA* new_arena;
+  struct stat st;
+
+  if (fstat(fd, &st) != 0)
+    return ERROR_COULD_NOT_MAP_FILE;
+
+  if (st.st_size < (off_t) sizeof(shdr))
+    return ERROR_INVALID_FILE;
+
+  if (pread(fd, &shdr, sizeof(shdr), 0) != sizeof(shdr))
+    return ERROR_COULD_NOT_READ_FILE;
+
+  if (shdr.magic[0] != 'Y' || shdr.magic[1] != 'S' || shdr.magic[2] != 'H' ||
+      shdr.magic[3] != 'M')
+    return ERROR_INVALID_FILE;
+
+  size_t size = (size_t) st.st_size;
+
+  if (shdr.tag_length > size - sizeof(shdr))
+    return ERROR_CORRUPT_FILE;
+
+  size_t image_offset = (size_t) _yr_arena_file_align(
+      sizeof(shdr) + shdr.tag_length);
+
+  uint8_t* data = (uint8_t*) mmap(
+      (void*) (uintptr_t) shdr.base,
+      size,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE,
+      fd,
+      0);
+
+  if (data == MAP_FAILED)
+    return ERROR_COULD_NOT_MAP_FILE;
+
+  FAIL_ON_ERROR(
+      _yr_arena_create_mapped(data, size, NULL, image_offset, &new_arena));
+
+  if (shdr.tag_length > 0)
+  {
+    const char* tag = (const char*) data + sizeof(shdr);
+
+    if (tag[shdr.tag_length - 1] != '\0')
+    {
+      yr_arena_release(new_arena);
+      return ERROR_CORRUPT_FILE;
+    }
+
+    new_arena->tag = tag;
+  }
+
+  FAIL_ON_ERROR_WITH_CLEANUP(
+      _yr_arena_rebase(new_arena, shdr.base), yr_arena_release(new_arena));
+
+  *arena = new_arena;
+
+  return ERROR_SUCCESS;
+}
+
+#else
+
+// Shared memory objects are not supported in Windows.
+
+int yr_arena_publish_fd(YR_ARENA* arena, YR_FILE_DESCRIPTOR fd, const char* tag)
+{
+  return ERROR_COULD_NOT_MAP_FILE;
+}
+
+int yr_arena_attach_fd(YR_FILE_DESCRIPTOR fd, YR_ARENA** arena)
+{
+  return ERROR_COULD_NOT_MAP_FILE;
+}
+
+#endif
@@ -31,6 +31,35 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/bitmask.h>
 #include <yara/utils.h>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the position of the least significant bit set in x, which must be
+// different from zero.
+//
+static uint32_t _yr_bitmask_lowest_set_bit(YR_BITMASK x)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzl(x);
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, x);
+  return index;
+#else
+  uint32_t index = 0;
+
+  while ((x & 1) == 0)
+  {
+    x >>= 1;
+    index++;
+  }
+
+  return index;
+#endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Find the smallest offset within bitmask A where bitmask B can be accommodated
 // without bit collisions. A collision occurs when both bitmasks have a bit set
@@ -76,18 +105,24 @@ uint32_t yr_bitmask_find_non_colliding_offset(
        i++)
     ;
 
-  *off_a = i;
+  *off_a = i * YR_BITMASK_SLOT_BITS;
 
   for (; i <= len_a / YR_BITMASK_SLOT_BITS; i++)
   {
-    // The slot is filled with 1s, we can safely skip it.
-    if (a[i] == -1L)
-      continue;
+    // B can be put only at offsets where A has a 0, as the first bit in B is
+    // 1. Instead of trying every offset within the slot, try only those.
+    YR_BITMASK holes = ~a[i];
 
-    for (j = 0; j <= yr_min(len_a, YR_BITMASK_SLOT_BITS - 1); j++)
+    if (len_a < YR_BITMASK_SLOT_BITS - 1)
+      holes &= ((YR_BITMASK) 2 << len_a) - 1;
+
+    while (holes != 0)
     {
       bool found = true;
 
+      j = _yr_bitmask_lowest_set_bit(holes);
+      holes &= holes - 1;
+
       for (k = 0; k <= len_b / YR_BITMASK_SLOT_BITS; k++)
       {
         YR_BITMASK m = b[k] << j;
@@ -49,6 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/mem.h>
 #include <yara/object.h>
 #include <yara/strutils.h>
+#include <yara/threading.h>
 #include <yara/utils.h>
 
 static void _yr_compiler_default_include_free(
@@ -189,6 +190,15 @@ int _yr_compiler_store_data(
 
     FAIL_ON_ERROR(yr_hash_table_add_uint32_raw_key(
         compiler->sz_table, data, data_length, NULL, ref->offset));
+
+    if (compiler->cache != NULL)
+      FAIL_ON_ERROR(_yr_compiler_cache_add_unit(
+          compiler,
+          YR_SZ_POOL,
+          data,
+          data_length,
+          ref->offset,
+          (yr_arena_off_t) data_length));
   }
   else
   {
@@ -214,6 +224,72 @@ int _yr_compiler_store_string(
       ref);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Compiles a regular expression used in a condition and returns a reference
+// to it. If the same regexp with the same flags was already compiled by a
+// previous call to this function, a reference to the existing one is returned
+// instead.
+//
+int _yr_compiler_store_regexp(
+    YR_COMPILER* compiler,
+    const char* re_string,
+    int flags,
+    YR_ARENA_REF* ref,
+    RE_ERROR* error)
+{
+  size_t re_length = strlen(re_string);
+  size_t key_length = sizeof(flags) + re_length;
+  uint8_t* key = (uint8_t*) yr_malloc(key_length);
+
+  if (key == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  memcpy(key, &flags, sizeof(flags));
+  memcpy(key + sizeof(flags), re_string, re_length);
+
+  uint32_t offset = yr_hash_table_lookup_uint32_raw_key(
+      compiler->regexps_table, key, key_length, NULL);
+
+  int result = ERROR_SUCCESS;
+
+  if (offset == UINT32_MAX)
+  {
+    result = yr_re_compile(re_string, flags, compiler->arena, ref, error);
+
+    if (result == ERROR_SUCCESS)
+      result = yr_hash_table_add_uint32_raw_key(
+          compiler->regexps_table, key, key_length, NULL, ref->offset);
+
+    if (result == ERROR_SUCCESS)
+      result = yr_hash_table_add_uint32_raw_key(
+          compiler->regexps_lengths,
+          key,
+          key_length,
+          NULL,
+          yr_arena_get_current_offset(compiler->arena, YR_RE_CODE_SECTION) -
+              ref->offset);
+
+    if (result == ERROR_SUCCESS && compiler->cache != NULL)
+      result = _yr_compiler_cache_add_unit(
+          compiler,
+          YR_RE_CODE_SECTION,
+          key,
+          key_length,
+          ref->offset,
+          yr_arena_get_current_offset(compiler->arena, YR_RE_CODE_SECTION) -
+              ref->offset);
+  }
+  else
+  {
+    ref->buffer_id = YR_RE_CODE_SECTION;
+    ref->offset = offset;
+  }
+
+  yr_free(key);
+
+  return result;
+}
+
 YR_API int yr_compiler_create(YR_COMPILER** compiler)
 {
   int result;
@@ -243,8 +319,16 @@ YR_API int yr_compiler_create(YR_COMPILER** compiler)
   new_compiler->current_line = 0;
   new_compiler->file_name_stack_ptr = 0;
   new_compiler->fixup_stack_head = NULL;
+  new_compiler->condition_ands = NULL;
+  new_compiler->num_condition_ands = 0;
+  new_compiler->max_condition_ands = 0;
+  new_compiler->track_rule_idx = false;
+  new_compiler->rule_idx_locations = NULL;
+  new_compiler->num_rule_idx_locations = 0;
+  new_compiler->max_rule_idx_locations = 0;
   new_compiler->loop_index = -1;
   new_compiler->loop_for_of_var_index = -1;
+  new_compiler->cache = NULL;
 
   new_compiler->atoms_config.get_atom_quality = yr_atoms_heuristic_quality;
   new_compiler->atoms_config.quality_warning_threshold =
@@ -265,6 +349,15 @@ YR_API int yr_compiler_create(YR_COMPILER** compiler)
   if (result == ERROR_SUCCESS)
     result = yr_hash_table_create(10000, &new_compiler->sz_table);
 
+  if (result == ERROR_SUCCESS)
+    result = yr_hash_table_create(1000, &new_compiler->regexps_table);
+
+  if (result == ERROR_SUCCESS)
+    result = yr_hash_table_create(1000, &new_compiler->regexps_lengths);
+
+  if (result == ERROR_SUCCESS)
+    result = yr_hash_table_create(100, &new_compiler->called_functions_table);
+
   if (result == ERROR_SUCCESS)
     result = yr_arena_create(YR_NUM_SECTIONS, 1048576, &new_compiler->arena);
 
@@ -286,6 +379,9 @@ YR_API int yr_compiler_create(YR_COMPILER** compiler)
 
 YR_API void yr_compiler_destroy(YR_COMPILER* compiler)
 {
+  if (compiler->cache != NULL)
+    _yr_compiler_cache_detach(compiler);
+
   if (compiler->arena != NULL)
     yr_arena_release(compiler->arena);
 
@@ -304,6 +400,17 @@ YR_API void yr_compiler_destroy(YR_COMPILER* compiler)
   if (compiler->sz_table != NULL)
     yr_hash_table_destroy(compiler->sz_table, NULL);
 
+  if (compiler->regexps_table != NULL)
+    yr_hash_table_destroy(compiler->regexps_table, NULL);
+
+  if (compiler->regexps_lengths != NULL)
+    yr_hash_table_destroy(compiler->regexps_lengths, NULL);
+
+  if (compiler->called_functions_table != NULL)
+    yr_hash_table_destroy(compiler->called_functions_table, NULL);
+
+  yr_free(compiler->called_functions);
+
   if (compiler->objects_table != NULL)
     yr_hash_table_destroy(
         compiler->objects_table,
@@ -315,6 +422,8 @@ YR_API void yr_compiler_destroy(YR_COMPILER* compiler)
   for (int i = 0; i < compiler->file_name_stack_ptr; i++)
     yr_free(compiler->file_name_stack[i]);
 
+  yr_free(compiler->included_files);
+
   YR_FIXUP* fixup = compiler->fixup_stack_head;
 
   while (fixup != NULL)
@@ -324,6 +433,8 @@ YR_API void yr_compiler_destroy(YR_COMPILER* compiler)
     fixup = next_fixup;
   }
 
+  yr_free(compiler->condition_ands);
+  yr_free(compiler->rule_idx_locations);
   yr_free(compiler);
 }
 
@@ -487,6 +598,99 @@ void _yr_compiler_pop_file_name(YR_COMPILER* compiler)
   }
 }
 
+int _yr_compiler_add_included_file(
+    YR_COMPILER* compiler,
+    const char* file_name)
+{
+  size_t length = strlen(file_name) + 1;
+
+  // One more byte for the null character that ends the list.
+  char* included_files = (char*) yr_realloc(
+      compiler->included_files,
+      compiler->included_files_length + length + 1);
+
+  if (included_files == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  memcpy(included_files + compiler->included_files_length, file_name, length);
+
+  compiler->included_files = included_files;
+  compiler->included_files_length += length;
+  compiler->included_files[compiler->included_files_length] = '\0';
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds a function to the list of module functions called by the rules if it
+// isn't already there. See YR_SUMMARY.
+//
+int _yr_compiler_add_called_function(
+    YR_COMPILER* compiler,
+    const char* identifier)
+{
+  if (compiler->cache != NULL)
+    FAIL_ON_ERROR(_yr_compiler_cache_add_called_function(compiler, identifier));
+
+  if (yr_hash_table_lookup_uint32(
+          compiler->called_functions_table, identifier, NULL) != UINT32_MAX)
+    return ERROR_SUCCESS;
+
+  size_t length = strlen(identifier) + 1;
+
+  char* called_functions = (char*) yr_realloc(
+      compiler->called_functions, compiler->called_functions_length + length);
+
+  if (called_functions == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  memcpy(
+      called_functions + compiler->called_functions_length, identifier, length);
+
+  compiler->called_functions = called_functions;
+  compiler->called_functions_length += length;
+
+  return yr_hash_table_add_uint32(
+      compiler->called_functions_table, identifier, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records the location of a rule index emitted by the parser if the compiler
+// is tracking them. See YR_RULE_IDX_LOCATION.
+//
+int _yr_compiler_add_rule_idx_location(
+    YR_COMPILER* compiler,
+    YR_ARENA_REF* ref,
+    uint32_t size)
+{
+  if (!compiler->track_rule_idx)
+    return ERROR_SUCCESS;
+
+  if (compiler->num_rule_idx_locations == compiler->max_rule_idx_locations)
+  {
+    uint32_t max = compiler->max_rule_idx_locations == 0
+                       ? 64
+                       : compiler->max_rule_idx_locations * 2;
+
+    YR_RULE_IDX_LOCATION* locations = (YR_RULE_IDX_LOCATION*) yr_realloc(
+        compiler->rule_idx_locations, max * sizeof(YR_RULE_IDX_LOCATION));
+
+    if (locations == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    compiler->rule_idx_locations = locations;
+    compiler->max_rule_idx_locations = max;
+  }
+
+  YR_RULE_IDX_LOCATION* location =
+      &compiler->rule_idx_locations[compiler->num_rule_idx_locations++];
+
+  location->ref = *ref;
+  location->size = size;
+
+  return ERROR_SUCCESS;
+}
+
 int _yr_compiler_get_var_frame(YR_COMPILER* compiler)
 {
   int i, result = 0;
@@ -512,7 +716,24 @@ YR_API char* yr_compiler_get_current_file_name(YR_COMPILER* compiler)
   }
 }
 
-static int _yr_compiler_set_namespace(
+////////////////////////////////////////////////////////////////////////////////
+// Returns the names of the files included by the rules added to the compiler
+// so far, as a sequence of null-terminated strings that ends with an empty
+// string. The names are the ones passed to the include callback, with the
+// default callback that's the path of the included file, relative to the
+// current directory unless it's absolute. A file included more than once
+// appears more than once. The names are valid until the compiler is destroyed
+// or more rules are added to it.
+//
+YR_API const char* yr_compiler_get_included_files(YR_COMPILER* compiler)
+{
+  if (compiler->included_files == NULL)
+    return "";
+
+  return compiler->included_files;
+}
+
+int _yr_compiler_set_namespace(
     YR_COMPILER* compiler,
     const char* namespace_)
 {
@@ -557,6 +778,54 @@ static int _yr_compiler_set_namespace(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Reads the whole content of a file given its descriptor, like
+// yr_lex_parse_rules_fd does.
+//
+static int _yr_compiler_read_fd(
+    YR_FILE_DESCRIPTOR fd,
+    uint8_t** data,
+    size_t* data_size)
+{
+  size_t file_size;
+  uint8_t* buffer;
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+  DWORD bytes_read;
+
+  file_size = (size_t) GetFileSize(fd, NULL);
+#else
+  struct stat fs;
+
+  if (fstat(fd, &fs) != 0)
+    return ERROR_COULD_NOT_READ_FILE;
+
+  file_size = (size_t) fs.st_size;
+#endif
+
+  // One more byte, so that empty files don't result in a NULL buffer.
+  buffer = (uint8_t*) yr_malloc(file_size + 1);
+
+  if (buffer == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+  if (!ReadFile(fd, buffer, (DWORD) file_size, &bytes_read, NULL) ||
+      bytes_read != file_size)
+#else
+  if (read(fd, buffer, file_size) != (ssize_t) file_size)
+#endif
+  {
+    yr_free(buffer);
+    return ERROR_COULD_NOT_READ_FILE;
+  }
+
+  *data = buffer;
+  *data_size = file_size;
+
+  return ERROR_SUCCESS;
+}
+
 YR_API int yr_compiler_add_file(
     YR_COMPILER* compiler,
     FILE* rules_file,
@@ -575,6 +844,25 @@ YR_API int yr_compiler_add_file(
 
   assert(compiler->errors == 0);
 
+  if (compiler->cache != NULL)
+  {
+    uint8_t* data;
+    size_t data_size;
+
+    compiler->last_error = _yr_compiler_read_file(
+        rules_file, &data, &data_size);
+
+    if (compiler->last_error != ERROR_SUCCESS)
+      return ++compiler->errors;
+
+    result = _yr_compiler_cache_add_bytes(
+        compiler, data, data_size, namespace_, file_name);
+
+    yr_free(data);
+
+    return result;
+  }
+
   if (namespace_ != NULL)
     compiler->last_error = _yr_compiler_set_namespace(compiler, namespace_);
   else
@@ -610,6 +898,24 @@ YR_API int yr_compiler_add_fd(
   // yr_compiler_add_XXXX failed.
   assert(compiler->errors == 0);
 
+  if (compiler->cache != NULL)
+  {
+    uint8_t* data;
+    size_t data_size;
+
+    compiler->last_error = _yr_compiler_read_fd(rules_fd, &data, &data_size);
+
+    if (compiler->last_error != ERROR_SUCCESS)
+      return ++compiler->errors;
+
+    result = _yr_compiler_cache_add_bytes(
+        compiler, data, data_size, namespace_, file_name);
+
+    yr_free(data);
+
+    return result;
+  }
+
   if (namespace_ != NULL)
     compiler->last_error = _yr_compiler_set_namespace(compiler, namespace_);
   else
@@ -642,6 +948,10 @@ YR_API int yr_compiler_add_string(
   // yr_compiler_add_XXXX failed.
   assert(compiler->errors == 0);
 
+  if (compiler->cache != NULL)
+    return _yr_compiler_cache_add_bytes(
+        compiler, rules_string, strlen(rules_string), namespace_, NULL);
+
   if (namespace_ != NULL)
     compiler->last_error = _yr_compiler_set_namespace(compiler, namespace_);
   else
@@ -664,6 +974,10 @@ static int _yr_compiler_compile_rules(YR_COMPILER* compiler)
   FAIL_ON_ERROR(yr_arena_write_data(
       compiler->arena, YR_CODE_SECTION, &halt, sizeof(uint8_t), NULL));
 
+  // The code for the guards ends with a halt instruction too.
+  FAIL_ON_ERROR(yr_arena_write_data(
+      compiler->arena, YR_GUARD_CODE_SECTION, &halt, sizeof(uint8_t), NULL));
+
   // Write a null rule indicating the end.
   memset(&null_rule, 0xFA, sizeof(YR_RULE));
   null_rule.flags = RULE_FLAGS_NULL;
@@ -682,13 +996,47 @@ static int _yr_compiler_compile_rules(YR_COMPILER* compiler)
       sizeof(YR_EXTERNAL_VARIABLE),
       NULL));
 
-  // Write Aho-Corasick automaton to arena.
-  FAIL_ON_ERROR(yr_ac_compile(compiler->automaton, compiler->arena));
+  // Write Aho-Corasick automaton to arena. With a cache the automaton is the
+  // one kept by the cache, which is patched instead of built from scratch.
+  if (compiler->cache != NULL)
+  {
+    FAIL_ON_ERROR(_yr_compiler_cache_write_automaton(compiler));
+  }
+  else
+  {
+    FAIL_ON_ERROR(yr_ac_compile(compiler->automaton, compiler->arena));
+  }
 
   YR_ARENA_REF ref;
+  YR_ARENA_REF called_functions_ref;
+
+  // Write the identifiers of the called functions followed by the empty
+  // identifier that ends the list.
+  if (compiler->called_functions_length > 0)
+  {
+    FAIL_ON_ERROR(yr_arena_write_data(
+        compiler->arena,
+        YR_SZ_POOL,
+        compiler->called_functions,
+        compiler->called_functions_length,
+        &called_functions_ref));
+
+    FAIL_ON_ERROR(
+        yr_arena_write_data(compiler->arena, YR_SZ_POOL, "", 1, NULL));
+  }
+  else
+  {
+    FAIL_ON_ERROR(yr_arena_write_data(
+        compiler->arena, YR_SZ_POOL, "", 1, &called_functions_ref));
+  }
 
   FAIL_ON_ERROR(yr_arena_allocate_struct(
-      compiler->arena, YR_SUMMARY_SECTION, sizeof(YR_SUMMARY), &ref, EOL));
+      compiler->arena,
+      YR_SUMMARY_SECTION,
+      sizeof(YR_SUMMARY),
+      &ref,
+      offsetof(YR_SUMMARY, called_functions),
+      EOL));
 
   YR_SUMMARY* summary = (YR_SUMMARY*) yr_arena_ref_to_ptr(
       compiler->arena, &ref);
@@ -696,6 +1044,8 @@ static int _yr_compiler_compile_rules(YR_COMPILER* compiler)
   summary->num_namespaces = compiler->num_namespaces;
   summary->num_rules = compiler->next_rule_idx;
   summary->num_strings = compiler->current_string_idx;
+  summary->called_functions = (const char*) yr_arena_ref_to_ptr(
+      compiler->arena, &called_functions_ref);
 
   return yr_rules_from_arena(compiler->arena, &compiler->rules);
 }
@@ -843,6 +1193,1176 @@ YR_API int yr_compiler_define_string_variable(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Functions below implement yr_compiler_add_files. Files are parsed in
+// parallel by separate compilers, one per file, and then the data produced by
+// each of these compilers is merged into the calling compiler in the order of
+// the files. The result is exactly the same as if the calling compiler parsed
+// the files itself. When this can't be guaranteed for some file, for example
+// because it uses rules or modules from a previous file, the calling compiler
+// parses that file again.
+//
+
+// Maximum number of files parsed in parallel per thread before merging them.
+// This limits the memory used by the compilers of the files not merged yet.
+#define YR_MAX_FILES_PER_THREAD 4
+
+// Message passed to the callback while parsing a file with a separate
+// compiler. It's reported to the calling compiler's callback when the file
+// is merged.
+typedef struct _YR_COMPILER_MESSAGE
+{
+  int error_level;
+  int line_number;
+  uint32_t rule_idx;
+  char* file_name;
+  char* message;
+
+} YR_COMPILER_MESSAGE;
+
+typedef struct _YR_COMPILER_JOB
+{
+  FILE* rules_file;
+  const char* namespace_;
+  const char* file_name;
+
+  // Content of rules_file.
+  uint8_t* data;
+  size_t data_size;
+
+  // Compiler that parsed the file, and the messages passed to its callback.
+  YR_COMPILER* compiler;
+  YR_COMPILER_MESSAGE* messages;
+  uint32_t num_messages;
+  uint32_t max_messages;
+
+  // Error that prevented the file from being read or parsed, if any. Errors
+  // found in the rules are counted in compiler->errors instead.
+  int result;
+
+} YR_COMPILER_JOB;
+
+typedef struct _YR_COMPILER_JOBS
+{
+  YR_COMPILER* compiler;
+  YR_COMPILER_JOB* jobs;
+  int num_jobs;
+  int next_job;
+  YR_MUTEX mutex;
+
+} YR_COMPILER_JOBS;
+
+// Range of a buffer in the arena of a compiler that is being merged, and
+// the offset where the data in that range ends up in the same buffer of the
+// calling compiler, which is UINT32_MAX if the data is dropped.
+typedef struct _YR_MERGE_SEGMENT
+{
+  yr_arena_off_t offset;
+  yr_arena_off_t length;
+  yr_arena_off_t new_offset;
+
+} YR_MERGE_SEGMENT;
+
+// Segments for a buffer, sorted by offset.
+typedef struct _YR_MERGE_MAP
+{
+  YR_MERGE_SEGMENT* segments;
+  uint32_t num_segments;
+  uint32_t max_segments;
+
+} YR_MERGE_MAP;
+
+// Unit of data that is stored only once in a buffer, like the strings in
+// YR_SZ_POOL, see _yr_compiler_merge_pool.
+typedef struct _YR_MERGE_UNIT
+{
+  const void* key;
+  size_t key_length;
+  yr_arena_off_t offset;
+  yr_arena_off_t length;
+
+} YR_MERGE_UNIT;
+
+static int _yr_compiler_merge_map_add(
+    YR_MERGE_MAP* map,
+    yr_arena_off_t offset,
+    yr_arena_off_t length,
+    yr_arena_off_t new_offset)
+{
+  if (length == 0)
+    return ERROR_SUCCESS;
+
+  if (map->num_segments > 0)
+  {
+    YR_MERGE_SEGMENT* last = &map->segments[map->num_segments - 1];
+
+    // Contiguous segments that are moved together are joined.
+    if (last->offset + last->length == offset &&
+        last->new_offset != UINT32_MAX && new_offset != UINT32_MAX &&
+        last->new_offset + last->length == new_offset)
+    {
+      last->length += length;
+      return ERROR_SUCCESS;
+    }
+  }
+
+  if (map->num_segments == map->max_segments)
+  {
+    uint32_t max = map->max_segments == 0 ? 16 : map->max_segments * 2;
+
+    YR_MERGE_SEGMENT* segments = (YR_MERGE_SEGMENT*) yr_realloc(
+        map->segments, max * sizeof(YR_MERGE_SEGMENT));
+
+    if (segments == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    map->segments = segments;
+    map->max_segments = max;
+  }
+
+  YR_MERGE_SEGMENT* segment = &map->segments[map->num_segments++];
+
+  segment->offset = offset;
+  segment->length = length;
+  segment->new_offset = new_offset;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns in *new_offset the offset where the data at "offset" ends up. If
+// the data is dropped, or it's not in any segment, returns false.
+//
+static bool _yr_compiler_merge_map_find(
+    YR_MERGE_MAP* map,
+    yr_arena_off_t offset,
+    yr_arena_off_t* new_offset)
+{
+  uint32_t lo = 0;
+  uint32_t hi = map->num_segments;
+
+  // Find the last segment that starts at or before offset.
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if (map->segments[mid].offset <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    return false;
+
+  YR_MERGE_SEGMENT* segment = &map->segments[lo - 1];
+
+  if (offset - segment->offset >= segment->length ||
+      segment->new_offset == UINT32_MAX)
+    return false;
+
+  *new_offset = segment->new_offset + (offset - segment->offset);
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Appends the range [offset, offset + length) of a buffer in other's arena to
+// the same buffer in compiler's arena. The memory is allocated zeroed, like
+// yr_arena_allocate_struct does, so that the padding in structures allocated
+// later in the same buffer is zero as in a serial compilation.
+//
+static int _yr_compiler_merge_copy(
+    YR_COMPILER* compiler,
+    YR_COMPILER* other,
+    uint32_t buffer_id,
+    yr_arena_off_t offset,
+    yr_arena_off_t length,
+    YR_MERGE_MAP* map)
+{
+  YR_ARENA_REF ref;
+
+  if (length == 0)
+    return ERROR_SUCCESS;
+
+  FAIL_ON_ERROR(
+      yr_arena_allocate_zeroed_memory(compiler->arena, buffer_id, length, &ref));
+
+  memcpy(
+      yr_arena_ref_to_ptr(compiler->arena, &ref),
+      yr_arena_get_ptr(other->arena, buffer_id, offset),
+      length);
+
+  return _yr_compiler_merge_map_add(map, offset, length, ref.offset);
+}
+
+static int _yr_compiler_merge_unit_cmp(const void* a, const void* b)
+{
+  yr_arena_off_t offset_a = ((const YR_MERGE_UNIT*) a)->offset;
+  yr_arena_off_t offset_b = ((const YR_MERGE_UNIT*) b)->offset;
+
+  if (offset_a < offset_b)
+    return -1;
+
+  if (offset_a > offset_b)
+    return 1;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Merges a buffer where some of the data is stored only once, like YR_SZ_POOL
+// and YR_RE_CODE_SECTION. "table" maps each unit of such data to its offset,
+// and "lengths" maps it to its length, or is NULL if the length is the key's
+// length. Units found in compiler's tables are not copied again, the rest of
+// the data is appended in the same order.
+//
+static int _yr_compiler_merge_pool(
+    YR_COMPILER* compiler,
+    YR_COMPILER* other,
+    uint32_t buffer_id,
+    YR_HASH_TABLE* table,
+    YR_HASH_TABLE* lengths,
+    YR_HASH_TABLE* other_table,
+    YR_HASH_TABLE* other_lengths,
+    YR_MERGE_MAP* map)
+{
+  YR_MERGE_UNIT* units = NULL;
+  int num_units = 0;
+
+  yr_arena_off_t offset = 0;
+  yr_arena_off_t used = yr_arena_get_current_offset(other->arena, buffer_id);
+
+  int result = ERROR_SUCCESS;
+
+  if (other_table->num_entries > 0)
+  {
+    units = (YR_MERGE_UNIT*) yr_malloc(
+        other_table->num_entries * sizeof(YR_MERGE_UNIT));
+
+    if (units == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+  }
+
+  for (int i = 0; i < other_table->size && num_units < other_table->num_entries;
+       i++)
+  {
+    for (YR_HASH_TABLE_ENTRY* entry = other_table->buckets[i]; entry != NULL;
+         entry = entry->next)
+    {
+      YR_MERGE_UNIT* unit = &units[num_units++];
+
+      unit->key = entry->key;
+      unit->key_length = entry->key_length;
+      unit->offset = yr_hash_table_lookup_uint32_raw_key(
+          other_table, entry->key, entry->key_length, NULL);
+
+      if (other_lengths != NULL)
+        unit->length = yr_hash_table_lookup_uint32_raw_key(
+            other_lengths, entry->key, entry->key_length, NULL);
+      else
+        unit->length = (yr_arena_off_t) entry->key_length;
+
+      if (unit->length == UINT32_MAX)
+        GOTO_EXIT_ON_ERROR(ERROR_INTERNAL_FATAL_ERROR);
+    }
+  }
+
+  if (num_units > 0)
+    qsort(units, num_units, sizeof(YR_MERGE_UNIT), _yr_compiler_merge_unit_cmp);
+
+  for (int i = 0; i < num_units; i++)
+  {
+    YR_MERGE_UNIT* unit = &units[i];
+    YR_ARENA_REF ref;
+
+    if (unit->offset < offset)
+      GOTO_EXIT_ON_ERROR(ERROR_INTERNAL_FATAL_ERROR);
+
+    // Data between units is written as is.
+    GOTO_EXIT_ON_ERROR(_yr_compiler_merge_copy(
+        compiler, other, buffer_id, offset, unit->offset - offset, map));
+
+    ref.offset = yr_hash_table_lookup_uint32_raw_key(
+        table, unit->key, unit->key_length, NULL);
+
+    if (ref.offset == UINT32_MAX)
+    {
+      GOTO_EXIT_ON_ERROR(yr_arena_write_data(
+          compiler->arena,
+          buffer_id,
+          yr_arena_get_ptr(other->arena, buffer_id, unit->offset),
+          unit->length,
+          &ref));
+
+      GOTO_EXIT_ON_ERROR(yr_hash_table_add_uint32_raw_key(
+          table, unit->key, unit->key_length, NULL, ref.offset));
+
+      if (lengths != NULL)
+        GOTO_EXIT_ON_ERROR(yr_hash_table_add_uint32_raw_key(
+            lengths, unit->key, unit->key_length, NULL, unit->length));
+    }
+
+    GOTO_EXIT_ON_ERROR(_yr_compiler_merge_map_add(
+        map, unit->offset, unit->length, ref.offset));
+
+    offset = unit->offset + unit->length;
+  }
+
+  result = _yr_compiler_merge_copy(
+      compiler, other, buffer_id, offset, used - offset, map);
+
+_exit:
+
+  yr_free(units);
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Merges YR_CODE_SECTION. The code is appended as is, except the OP_IMPORT
+// instructions for modules that compiler has already imported in the same
+// namespace, which compiler wouldn't have emitted.
+//
+static int _yr_compiler_merge_code(
+    YR_COMPILER* compiler,
+    YR_COMPILER* other,
+    const char* ns_name,
+    YR_MERGE_MAP* map)
+{
+  const uint8_t* code = (const uint8_t*) yr_arena_get_ptr(
+      other->arena, YR_CODE_SECTION, 0);
+
+  yr_arena_off_t offset = 0;
+  yr_arena_off_t used = yr_arena_get_current_offset(
+      other->arena, YR_CODE_SECTION);
+
+  // The argument of OP_IMPORT is a relocatable pointer to the module's name,
+  // so OP_IMPORT instructions can be found by looking at the relocations.
+  for (YR_RELOC* reloc = other->arena->reloc_list_head; reloc != NULL;
+       reloc = reloc->next)
+  {
+    const char* module_name;
+
+    if (reloc->buffer_id != YR_CODE_SECTION || reloc->offset == 0 ||
+        code[reloc->offset - 1] != OP_IMPORT)
+      continue;
+
+    memcpy(&module_name, code + reloc->offset, sizeof(module_name));
+
+    if (yr_hash_table_lookup(compiler->objects_table, module_name, ns_name) ==
+        NULL)
+      continue;
+
+    FAIL_ON_ERROR(_yr_compiler_merge_copy(
+        compiler,
+        other,
+        YR_CODE_SECTION,
+        offset,
+        reloc->offset - 1 - offset,
+        map));
+
+    FAIL_ON_ERROR(_yr_compiler_merge_map_add(
+        map, reloc->offset - 1, 1 + sizeof(YR_ARENA_REF), UINT32_MAX));
+
+    offset = reloc->offset + sizeof(YR_ARENA_REF);
+  }
+
+  return _yr_compiler_merge_copy(
+      compiler, other, YR_CODE_SECTION, offset, used - offset, map);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Registers in compiler's arena the relocatable pointers in the data copied
+// from other's arena, in the same order, and makes them point to the data
+// they pointed to in other's arena.
+//
+static int _yr_compiler_merge_relocs(
+    YR_COMPILER* compiler,
+    YR_COMPILER* other,
+    YR_MERGE_MAP* maps)
+{
+  for (YR_RELOC* reloc = other->arena->reloc_list_head; reloc != NULL;
+       reloc = reloc->next)
+  {
+    yr_arena_off_t offset;
+    YR_ARENA_REF ref;
+    void* ptr;
+
+    // Namespaces and external variables are not copied.
+    if (reloc->buffer_id == YR_NAMESPACES_TABLE ||
+        reloc->buffer_id == YR_EXTERNAL_VARIABLES_TABLE)
+      continue;
+
+    if (!_yr_compiler_merge_map_find(
+            &maps[reloc->buffer_id], reloc->offset, &offset))
+    {
+      // Pointers in removed OP_IMPORT instructions.
+      if (reloc->buffer_id == YR_CODE_SECTION)
+        continue;
+
+      return ERROR_INTERNAL_FATAL_ERROR;
+    }
+
+    memcpy(
+        &ptr,
+        yr_arena_get_ptr(other->arena, reloc->buffer_id, reloc->offset),
+        sizeof(ptr));
+
+    if (ptr != NULL)
+    {
+      if (!yr_arena_ptr_to_ref(other->arena, ptr, &ref) ||
+          !_yr_compiler_merge_map_find(
+              &maps[ref.buffer_id], ref.offset, &ref.offset))
+        return ERROR_INTERNAL_FATAL_ERROR;
+
+      ptr = yr_arena_ref_to_ptr(compiler->arena, &ref);
+    }
+
+    FAIL_ON_ERROR(yr_arena_make_ptr_relocatable(
+        compiler->arena, reloc->buffer_id, (size_t) offset, EOL));
+
+    memcpy(
+        yr_arena_get_ptr(compiler->arena, reloc->buffer_id, offset),
+        &ptr,
+        sizeof(ptr));
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds rule_base to the rule indexes emitted by other, once they have been
+// copied to compiler's arena.
+//
+static int _yr_compiler_merge_rule_idx(
+    YR_COMPILER* compiler,
+    YR_COMPILER* other,
+    YR_MERGE_MAP* maps,
+    uint32_t rule_base)
+{
+  for (uint32_t i = 0; i < other->num_rule_idx_locations; i++)
+  {
+    YR_RULE_IDX_LOCATION* location = &other->rule_idx_locations[i];
+    yr_arena_off_t offset;
+
+    if (!_yr_compiler_merge_map_find(
+            &maps[location->ref.buffer_id], location->ref.offset, &offset))
+      return ERROR_INTERNAL_FATAL_ERROR;
+
+    uint8_t* ptr = (uint8_t*) yr_arena_get_ptr(
+        compiler->arena, location->ref.buffer_id, offset);
+
+    if (location->size == sizeof(uint32_t))
+    {
+      uint32_t rule_idx;
+      memcpy(&rule_idx, ptr, sizeof(rule_idx));
+      rule_idx += rule_base;
+      memcpy(ptr, &rule_idx, sizeof(rule_idx));
+    }
+    else
+    {
+      uint64_t rule_idx;
+      memcpy(&rule_idx, ptr, sizeof(rule_idx));
+      rule_idx += rule_base;
+      memcpy(ptr, &rule_idx, sizeof(rule_idx));
+    }
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if some prefix in the wildcard_identifiers_table of "compiler"
+// for the given namespace is a prefix of "identifier".
+//
+static bool _yr_compiler_matches_wildcard(
+    YR_COMPILER* compiler,
+    const char* ns_name,
+    const char* identifier)
+{
+  YR_HASH_TABLE* table = compiler->wildcard_identifiers_table;
+  int visited = 0;
+
+  for (int i = 0; i < table->size && visited < table->num_entries; i++)
+  {
+    for (YR_HASH_TABLE_ENTRY* entry = table->buckets[i]; entry != NULL;
+         entry = entry->next)
+    {
+      visited++;
+
+      if (strcmp(entry->ns, ns_name) == 0 &&
+          strncmp(entry->key, identifier, entry->key_length) == 0)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if merging the rules parsed by "other" in the given namespace
+// into "compiler" gives the same result as parsing them with "compiler". This
+// is not the case if their identifiers collide with the rules or modules in
+// "compiler", or if they use wildcards that match its rules.
+//
+static bool _yr_compiler_can_merge(
+    YR_COMPILER* compiler,
+    YR_COMPILER* other,
+    const char* ns_name)
+{
+  YR_HASH_TABLE* table = other->wildcard_identifiers_table;
+  int visited = 0;
+
+  YR_RULE* rule = (YR_RULE*) yr_arena_get_ptr(
+      other->arena, YR_RULES_TABLE, 0);
+
+  for (uint32_t i = 0; i < other->next_rule_idx; i++, rule++)
+  {
+    if (yr_hash_table_lookup_uint32(
+            compiler->rules_table, rule->identifier, ns_name) != UINT32_MAX ||
+        yr_hash_table_lookup(
+            compiler->objects_table, rule->identifier, ns_name) != NULL ||
+        _yr_compiler_matches_wildcard(compiler, ns_name, rule->identifier))
+      return false;
+  }
+
+  // Wildcards are expanded with the rules in every namespace, as in
+  // yr_parser_emit_pushes_for_rules.
+  for (int i = 0; i < table->size && visited < table->num_entries; i++)
+  {
+    for (YR_HASH_TABLE_ENTRY* entry = table->buckets[i]; entry != NULL;
+         entry = entry->next)
+    {
+      visited++;
+
+      rule = (YR_RULE*) yr_arena_get_ptr(compiler->arena, YR_RULES_TABLE, 0);
+
+      for (uint32_t j = 0; j < compiler->next_rule_idx; j++, rule++)
+      {
+        if (strncmp(entry->key, rule->identifier, entry->key_length) == 0)
+          return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Updates compiler's hash tables and lists with the rules, wildcards, modules,
+// called functions and included files from other.
+//
+static int _yr_compiler_merge_tables(
+    YR_COMPILER* compiler,
+    YR_COMPILER* other,
+    const char* ns_name,
+    uint32_t rule_base)
+{
+  YR_HASH_TABLE* table = other->wildcard_identifiers_table;
+  int visited = 0;
+
+  YR_RULE* rule = (YR_RULE*) yr_arena_get_ptr(
+      other->arena, YR_RULES_TABLE, 0);
+
+  for (uint32_t i = 0; i < other->next_rule_idx; i++, rule++)
+  {
+    FAIL_ON_ERROR(yr_hash_table_add_uint32(
+        compiler->rules_table, rule->identifier, ns_name, rule_base + i));
+  }
+
+  for (int i = 0; i < table->size && visited < table->num_entries; i++)
+  {
+    for (YR_HASH_TABLE_ENTRY* entry = table->buckets[i]; entry != NULL;
+         entry = entry->next)
+    {
+      visited++;
+
+      if (yr_hash_table_lookup_raw_key(
+              compiler->wildcard_identifiers_table,
+              entry->key,
+              entry->key_length,
+              entry->ns) == NULL)
+        FAIL_ON_ERROR(yr_hash_table_add_uint32_raw_key(
+            compiler->wildcard_identifiers_table,
+            entry->key,
+            entry->key_length,
+            entry->ns,
+            1));
+    }
+  }
+
+  // Modules imported by other but not by compiler are moved to compiler's
+  // objects_table. External variables have a NULL namespace, they are
+  // already there.
+  table = other->objects_table;
+  visited = 0;
+
+  for (int i = 0; i < table->size && visited < table->num_entries; i++)
+  {
+    YR_HASH_TABLE_ENTRY* entry = table->buckets[i];
+
+    while (entry != NULL)
+    {
+      YR_HASH_TABLE_ENTRY* next_entry = entry->next;
+
+      visited++;
+
+      if (entry->ns != NULL && yr_hash_table_lookup_raw_key(
+                                   compiler->objects_table,
+                                   entry->key,
+                                   entry->key_length,
+                                   entry->ns) == NULL)
+      {
+        FAIL_ON_ERROR(yr_hash_table_add_raw_key(
+            compiler->objects_table,
+            entry->key,
+            entry->key_length,
+            entry->ns,
+            entry->value));
+
+        yr_hash_table_remove_raw_key(
+            table, entry->key, entry->key_length, entry->ns);
+
+        visited--;
+      }
+
+      entry = next_entry;
+    }
+  }
+
+  for (size_t i = 0; i < other->called_functions_length;)
+  {
+    const char* identifier = other->called_functions + i;
+
+    FAIL_ON_ERROR(_yr_compiler_add_called_function(compiler, identifier));
+
+    i += strlen(identifier) + 1;
+  }
+
+  const char* included_file = yr_compiler_get_included_files(other);
+
+  while (*included_file != '\0')
+  {
+    FAIL_ON_ERROR(_yr_compiler_add_included_file(compiler, included_file));
+
+    included_file += strlen(included_file) + 1;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Merges into "compiler" the rules parsed by "other" in the given namespace.
+// "other" must have been created by _yr_compiler_create_job_compiler, and
+// _yr_compiler_can_merge must return true for it.
+//
+static int _yr_compiler_merge(
+    YR_COMPILER* compiler,
+    YR_COMPILER* other,
+    const char* ns_name)
+{
+  YR_MERGE_MAP maps[YR_NUM_SECTIONS];
+  YR_ARENA_REF ref;
+
+  uint32_t rule_base = compiler->next_rule_idx;
+  uint32_t string_base = compiler->current_string_idx;
+  yr_arena_off_t matches_base = yr_arena_get_current_offset(
+      compiler->arena, YR_AC_STATE_MATCHES_POOL);
+
+  int result;
+
+  memset(maps, 0, sizeof(maps));
+
+  GOTO_EXIT_ON_ERROR(_yr_compiler_set_namespace(compiler, ns_name));
+
+  // The only namespace in other is the one being merged, and its external
+  // variables are the same as compiler's.
+  GOTO_EXIT_ON_ERROR(_yr_compiler_merge_map_add(
+      &maps[YR_NAMESPACES_TABLE],
+      0,
+      sizeof(YR_NAMESPACE),
+      compiler->current_namespace_idx * sizeof(YR_NAMESPACE)));
+
+  GOTO_EXIT_ON_ERROR(_yr_compiler_merge_map_add(
+      &maps[YR_EXTERNAL_VARIABLES_TABLE],
+      0,
+      yr_arena_get_current_offset(other->arena, YR_EXTERNAL_VARIABLES_TABLE),
+      0));
+
+  GOTO_EXIT_ON_ERROR(_yr_compiler_merge_pool(
+      compiler,
+      other,
+      YR_SZ_POOL,
+      compiler->sz_table,
+      NULL,
+      other->sz_table,
+      NULL,
+      &maps[YR_SZ_POOL]));
+
+  GOTO_EXIT_ON_ERROR(_yr_compiler_merge_pool(
+      compiler,
+      other,
+      YR_RE_CODE_SECTION,
+      compiler->regexps_table,
+      compiler->regexps_lengths,
+      other->regexps_table,
+      other->regexps_lengths,
+      &maps[YR_RE_CODE_SECTION]));
+
+  GOTO_EXIT_ON_ERROR(
+      _yr_compiler_merge_code(compiler, other, ns_name, &maps[YR_CODE_SECTION]));
+
+  // The remaining buffers are copied as they are, the rule and string indexes
+  // in them are adjusted below.
+  uint32_t buffers[] = {
+      YR_RULES_TABLE,
+      YR_METAS_TABLE,
+      YR_STRINGS_TABLE,
+      YR_GUARD_CODE_SECTION,
+      YR_AC_STATE_MATCHES_POOL,
+  };
+
+  for (int i = 0; i < (int) (sizeof(buffers) / sizeof(buffers[0])); i++)
+  {
+    GOTO_EXIT_ON_ERROR(_yr_compiler_merge_copy(
+        compiler,
+        other,
+        buffers[i],
+        0,
+        yr_arena_get_current_offset(other->arena, buffers[i]),
+        &maps[buffers[i]]));
+  }
+
+  // From here on nothing is written to compiler's arena, so pointers to its
+  // data remain valid.
+  GOTO_EXIT_ON_ERROR(_yr_compiler_merge_relocs(compiler, other, maps));
+
+  GOTO_EXIT_ON_ERROR(
+      _yr_compiler_merge_rule_idx(compiler, other, maps, rule_base));
+
+  ref.buffer_id = YR_STRINGS_TABLE;
+  ref.offset = string_base * sizeof(YR_STRING);
+
+  YR_STRING* string = (YR_STRING*) yr_arena_ref_to_ptr(compiler->arena, &ref);
+
+  for (uint32_t i = 0; i < other->current_string_idx; i++, string++)
+  {
+    string->idx += string_base;
+    string->rule_idx += rule_base;
+  }
+
+  GOTO_EXIT_ON_ERROR(
+      yr_ac_add_matches(compiler->automaton, other->automaton, matches_base));
+
+  GOTO_EXIT_ON_ERROR(
+      _yr_compiler_merge_tables(compiler, other, ns_name, rule_base));
+
+  compiler->next_rule_idx += other->next_rule_idx;
+  compiler->current_string_idx += other->current_string_idx;
+  compiler->current_meta_idx += other->current_meta_idx;
+
+_exit:
+
+  for (int i = 0; i < YR_NUM_SECTIONS; i++)
+    yr_free(maps[i].segments);
+
+  return result;
+}
+
+static void _yr_compiler_job_callback(
+    int error_level,
+    const char* file_name,
+    int line_number,
+    const YR_RULE* rule,
+    const char* message,
+    void* user_data)
+{
+  YR_COMPILER_JOB* job = (YR_COMPILER_JOB*) user_data;
+
+  if (job->result != ERROR_SUCCESS)
+    return;
+
+  if (job->num_messages == job->max_messages)
+  {
+    uint32_t max = job->max_messages == 0 ? 16 : job->max_messages * 2;
+
+    YR_COMPILER_MESSAGE* messages = (YR_COMPILER_MESSAGE*) yr_realloc(
+        job->messages, max * sizeof(YR_COMPILER_MESSAGE));
+
+    if (messages == NULL)
+    {
+      job->result = ERROR_INSUFFICIENT_MEMORY;
+      return;
+    }
+
+    job->messages = messages;
+    job->max_messages = max;
+  }
+
+  YR_COMPILER_MESSAGE* m = &job->messages[job->num_messages];
+
+  m->error_level = error_level;
+  m->line_number = line_number;
+  m->rule_idx = UINT32_MAX;
+  m->file_name = file_name != NULL ? yr_strdup(file_name) : NULL;
+  m->message = yr_strdup(message);
+
+  if (rule != NULL)
+    m->rule_idx = (uint32_t) (rule - (YR_RULE*) yr_arena_get_ptr(
+                                          job->compiler->arena,
+                                          YR_RULES_TABLE,
+                                          0));
+
+  if (m->message == NULL || (file_name != NULL && m->file_name == NULL))
+  {
+    yr_free(m->file_name);
+    yr_free(m->message);
+    job->result = ERROR_INSUFFICIENT_MEMORY;
+    return;
+  }
+
+  job->num_messages++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates the compiler that parses the file for a job. It has the same
+// configuration and external variables than "compiler".
+//
+static int _yr_compiler_create_job_compiler(
+    YR_COMPILER* compiler,
+    YR_COMPILER_JOB* job)
+{
+  FAIL_ON_ERROR(yr_compiler_create(&job->compiler));
+
+  job->compiler->track_rule_idx = true;
+  job->compiler->atoms_config = compiler->atoms_config;
+  job->compiler->atoms_config.free_quality_table = false;
+
+  yr_compiler_set_include_callback(
+      job->compiler,
+      compiler->include_callback,
+      compiler->include_free,
+      compiler->incl_clbk_user_data);
+
+  if (compiler->callback != NULL)
+    yr_compiler_set_callback(job->compiler, _yr_compiler_job_callback, job);
+
+  YR_EXTERNAL_VARIABLE* external = (YR_EXTERNAL_VARIABLE*) yr_arena_get_ptr(
+      compiler->arena, YR_EXTERNAL_VARIABLES_TABLE, 0);
+
+  uint32_t num_externals = yr_arena_get_current_offset(
+                               compiler->arena, YR_EXTERNAL_VARIABLES_TABLE) /
+                           sizeof(YR_EXTERNAL_VARIABLE);
+
+  for (uint32_t i = 0; i < num_externals; i++, external++)
+    FAIL_ON_ERROR(_yr_compiler_define_variable(job->compiler, external));
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reads the whole content of a file.
+//
+int _yr_compiler_read_file(FILE* fh, uint8_t** data, size_t* data_size)
+{
+  uint8_t* buffer = NULL;
+  size_t size = 0;
+  size_t buffer_size = 0;
+
+  do
+  {
+    if (size == buffer_size)
+    {
+      buffer_size = buffer_size == 0 ? 65536 : buffer_size * 2;
+
+      uint8_t* new_buffer = (uint8_t*) yr_realloc(buffer, buffer_size);
+
+      if (new_buffer == NULL)
+      {
+        yr_free(buffer);
+        return ERROR_INSUFFICIENT_MEMORY;
+      }
+
+      buffer = new_buffer;
+    }
+
+    size += fread(buffer + size, 1, buffer_size - size, fh);
+
+  } while (size == buffer_size);
+
+  if (ferror(fh))
+  {
+    yr_free(buffer);
+    return ERROR_COULD_NOT_READ_FILE;
+  }
+
+  *data = buffer;
+  *data_size = size;
+
+  return ERROR_SUCCESS;
+}
+
+static int _yr_compiler_add_bytes(
+    YR_COMPILER* compiler,
+    const void* rules_data,
+    size_t rules_size,
+    const char* namespace_,
+    const char* file_name)
+{
+  int result;
+
+  if (namespace_ != NULL)
+    compiler->last_error = _yr_compiler_set_namespace(compiler, namespace_);
+  else
+    compiler->last_error = _yr_compiler_set_namespace(compiler, "default");
+
+  if (compiler->last_error == ERROR_SUCCESS && file_name != NULL)
+    compiler->last_error = _yr_compiler_push_file_name(compiler, file_name);
+
+  if (compiler->last_error != ERROR_SUCCESS)
+    return ++compiler->errors;
+
+  result = yr_lex_parse_rules_bytes(rules_data, rules_size, 1, compiler);
+
+  if (file_name != NULL)
+    _yr_compiler_pop_file_name(compiler);
+
+  return result;
+}
+
+static void _yr_compiler_run_jobs(YR_COMPILER_JOBS* jobs)
+{
+  while (true)
+  {
+    yr_mutex_lock(&jobs->mutex);
+    int i = jobs->next_job++;
+    yr_mutex_unlock(&jobs->mutex);
+
+    if (i >= jobs->num_jobs)
+      break;
+
+    YR_COMPILER_JOB* job = &jobs->jobs[i];
+
+    job->result = _yr_compiler_read_file(
+        job->rules_file, &job->data, &job->data_size);
+
+    if (job->result == ERROR_SUCCESS)
+      job->result = _yr_compiler_create_job_compiler(jobs->compiler, job);
+
+    if (job->result == ERROR_SUCCESS)
+      _yr_compiler_add_bytes(
+          job->compiler,
+          job->data,
+          job->data_size,
+          job->namespace_,
+          job->file_name);
+  }
+}
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+static DWORD WINAPI _yr_compiler_jobs_thread(LPVOID param)
+#else
+static void* _yr_compiler_jobs_thread(void* param)
+#endif
+{
+  _yr_compiler_run_jobs((YR_COMPILER_JOBS*) param);
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds a parsed file to compiler, by merging it if possible, or by parsing it
+// again otherwise. Returns the number of errors.
+//
+static int _yr_compiler_finish_job(YR_COMPILER* compiler, YR_COMPILER_JOB* job)
+{
+  const char* ns_name = job->namespace_ != NULL ? job->namespace_ : "default";
+
+  if (job->data == NULL)
+  {
+    compiler->last_error = job->result;
+    return ++compiler->errors;
+  }
+
+  if (job->result != ERROR_SUCCESS || job->compiler->errors > 0 ||
+      !_yr_compiler_can_merge(compiler, job->compiler, ns_name))
+  {
+    return _yr_compiler_add_bytes(
+        compiler, job->data, job->data_size, job->namespace_, job->file_name);
+  }
+
+  compiler->last_error = _yr_compiler_merge(compiler, job->compiler, ns_name);
+
+  if (compiler->last_error != ERROR_SUCCESS)
+    return ++compiler->errors;
+
+  for (uint32_t i = 0; i < job->num_messages; i++)
+  {
+    YR_COMPILER_MESSAGE* m = &job->messages[i];
+    YR_RULE* rule = NULL;
+
+    if (m->rule_idx != UINT32_MAX)
+      rule = _yr_compiler_get_rule_by_idx(
+          compiler, compiler->next_rule_idx - job->compiler->next_rule_idx +
+                        m->rule_idx);
+
+    compiler->callback(
+        m->error_level,
+        m->file_name,
+        m->line_number,
+        rule,
+        m->message,
+        compiler->user_data);
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parses a group of files in parallel and adds them to the compiler in order.
+// Returns the number of errors.
+//
+static int _yr_compiler_add_files_in_parallel(
+    YR_COMPILER* compiler,
+    int num_files,
+    FILE** rules_files,
+    const char** namespaces,
+    const char** file_names,
+    int threads)
+{
+  YR_COMPILER_JOBS jobs;
+  YR_THREAD* thread_handles;
+  int num_thread_handles = 0;
+  int errors = 0;
+
+  jobs.compiler = compiler;
+  jobs.num_jobs = num_files;
+  jobs.next_job = 0;
+  jobs.jobs = (YR_COMPILER_JOB*) yr_calloc(num_files, sizeof(YR_COMPILER_JOB));
+
+  thread_handles = (YR_THREAD*) yr_calloc(threads, sizeof(YR_THREAD));
+
+  if (jobs.jobs == NULL || thread_handles == NULL ||
+      yr_mutex_create(&jobs.mutex) != ERROR_SUCCESS)
+  {
+    yr_free(jobs.jobs);
+    yr_free(thread_handles);
+
+    compiler->last_error = ERROR_INSUFFICIENT_MEMORY;
+    return ++compiler->errors;
+  }
+
+  for (int i = 0; i < num_files; i++)
+  {
+    jobs.jobs[i].rules_file = rules_files[i];
+    jobs.jobs[i].namespace_ = namespaces[i];
+    jobs.jobs[i].file_name = file_names[i];
+  }
+
+  // The current thread runs jobs too. If some thread can't be created the
+  // other ones run its jobs.
+  while (num_thread_handles < threads - 1 &&
+         yr_thread_create(
+             &thread_handles[num_thread_handles],
+             _yr_compiler_jobs_thread,
+             &jobs) == ERROR_SUCCESS)
+  {
+    num_thread_handles++;
+  }
+
+  _yr_compiler_run_jobs(&jobs);
+
+  for (int i = 0; i < num_thread_handles; i++)
+    yr_thread_join(&thread_handles[i]);
+
+  for (int i = 0; i < num_files; i++)
+  {
+    YR_COMPILER_JOB* job = &jobs.jobs[i];
+
+    if (errors == 0)
+      errors = _yr_compiler_finish_job(compiler, job);
+
+    if (job->compiler != NULL)
+      yr_compiler_destroy(job->compiler);
+
+    for (uint32_t j = 0; j < job->num_messages; j++)
+    {
+      yr_free(job->messages[j].file_name);
+      yr_free(job->messages[j].message);
+    }
+
+    yr_free(job->messages);
+    yr_free(job->data);
+  }
+
+  yr_mutex_destroy(&jobs.mutex);
+  yr_free(jobs.jobs);
+  yr_free(thread_handles);
+
+  return errors;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds several files to the compiler, using the given number of threads for
+// parsing them. The result is the same as calling yr_compiler_add_file with
+// each file in order until one of them has errors, and the callback receives
+// the same messages in the same order, but it isn't called while files are
+// being parsed, only from the calling thread. The include callback, however,
+// is called from several threads at once.
+//
+// "namespaces" and "file_names" have num_files items, which can be NULL like
+// the corresponding arguments of yr_compiler_add_file. Returns the number of
+// errors found in the first file with errors, or 0 if there are no errors.
+//
+YR_API int yr_compiler_add_files(
+    YR_COMPILER* compiler,
+    int num_files,
+    FILE** rules_files,
+    const char** namespaces,
+    const char** file_names,
+    int threads)
+{
+  int errors = 0;
+  int i = 0;
+
+  // Don't allow yr_compiler_add_files() after
+  // yr_compiler_get_rules() has been called.
+  assert(compiler->rules == NULL);
+
+  // Don't allow calls to yr_compiler_add_files() if a previous call to
+  // yr_compiler_add_XXXX failed.
+  assert(compiler->errors == 0);
+
+  // The callback for regexp ASTs receives pointers to rules while they are
+  // parsed, and rules taken from a cache are added one by one, in both cases
+  // files are parsed by the compiler itself.
+  if (threads > 1 && compiler->re_ast_callback == NULL &&
+      compiler->cache == NULL)
+  {
+    while (i < num_files && errors == 0)
+    {
+      int count = yr_min(num_files - i, threads * YR_MAX_FILES_PER_THREAD);
+
+      errors = _yr_compiler_add_files_in_parallel(
+          compiler,
+          count,
+          rules_files + i,
+          namespaces + i,
+          file_names + i,
+          yr_min(threads, count));
+
+      i += count;
+    }
+  }
+
+  for (; i < num_files && errors == 0; i++)
+    errors = yr_compiler_add_file(
+        compiler, rules_files[i], namespaces[i], file_names[i]);
+
+  return errors;
+}
+
 YR_API char* yr_compiler_get_error_message(
     YR_COMPILER* compiler,
     char* buffer,
@@ -0,0 +1,2535 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// A compiler cache keeps the result of compiling each rule, so that compilers
+// using the cache don't parse again the rules that a previous compiler using
+// the same cache has already compiled. This is useful when the same rules are
+// compiled over and over with small changes.
+//
+// The rules added to the compiler are split in items: rules, and import and
+// include statements. The source code of each rule, together with everything
+// else that affects its compilation, like the namespace, the modules imported
+// in the namespace, and the external variables, is the key of an artifact
+// that contains the data appended by the rule to each buffer of the
+// compiler's arena, and describes how to move that data to another position:
+// which pointers must be relocated and where they point to, which rule
+// indexes must be adjusted, and which data stored only once in the arena
+// (see _yr_compiler_store_data) the rule refers to. When a rule is found in
+// the cache its artifact is copied to the compiler's arena instead of parsing
+// the rule. Other items, and rules that can't be cached, are parsed as usual.
+//
+// The cache also keeps a patchable Aho-Corasick automaton, which contains the
+// atoms of the rules compiled by the last compiler. When the rules are
+// compiled, the atoms of the rules that are not used anymore are removed from
+// the automaton, and the atoms of the new rules are added to it, see
+// yr_ac_patch. The time required for building the automaton depends on the
+// number of rules that changed, not on the total number of rules.
+
+#include <assert.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yara/ahocorasick.h>
+#include <yara/compiler.h>
+#include <yara/error.h>
+#include <yara/lexer.h>
+#include <yara/libyara.h>
+#include <yara/mem.h>
+#include <yara/object.h>
+#include <yara/strutils.h>
+#include <yara/utils.h>
+
+// The automaton is built again from scratch when the number of matches
+// removed from it since it was built is larger than this number, and larger
+// than the number of matches in it, so that removed states don't accumulate.
+#define YR_CACHE_MIN_REMOVED_MATCHES 4096
+
+// Types of the items found in the rules added to the compiler.
+#define YR_CACHE_ITEM_NONE      0  // The end of the rules.
+#define YR_CACHE_ITEM_RULE      1  // A rule.
+#define YR_CACHE_ITEM_STATEMENT 2  // An import or include statement.
+#define YR_CACHE_ITEM_REST      3  // Everything up to the end of the rules.
+
+// Types of the pointers in an artifact.
+#define YR_CACHE_RELOC_NULL      0  // NULL pointer.
+#define YR_CACHE_RELOC_INTERNAL  1  // Pointer to the artifact's own data.
+#define YR_CACHE_RELOC_NAMESPACE 2  // Pointer to the rule's namespace.
+#define YR_CACHE_RELOC_UNIT      3  // Pointer to a unit, see YR_CACHE_UNIT.
+
+typedef struct _YR_CACHE_ITEM
+{
+  int type;
+  size_t start;
+  size_t end;
+  int line;
+
+} YR_CACHE_ITEM;
+
+// Bytes of an atom, which are the path from the root of the Aho-Corasick
+// automaton to the state where the corresponding YR_AC_MATCH is.
+typedef struct _YR_CACHE_PATH
+{
+  uint8_t length;
+  uint8_t bytes[YR_MAX_ATOM_LENGTH];
+
+} YR_CACHE_PATH;
+
+// Data stored only once in YR_SZ_POOL or YR_RE_CODE_SECTION, like the strings
+// stored by _yr_compiler_store_data and the regexps compiled by
+// _yr_compiler_store_regexp. The key is the unit's key in sz_table or
+// regexps_table, in YR_SZ_POOL units it's the data itself, and "key" is NULL
+// in the cache's index of units and in the units stored by an artifact, whose
+// data is in the arena or the artifact. The units referenced by an artifact
+// have a copy of their data in "data".
+typedef struct _YR_CACHE_UNIT
+{
+  uint32_t buffer_id;
+  yr_arena_off_t offset;
+  yr_arena_off_t length;
+  uint8_t* key;
+  uint32_t key_length;
+  uint8_t* data;
+
+} YR_CACHE_UNIT;
+
+// Pointer in the data of an artifact, at "offset" within the artifact's data
+// for buffer_id. For YR_CACHE_RELOC_INTERNAL pointers target_id is the buffer
+// it points to, and target_offset the offset within the artifact's data for
+// that buffer. For YR_CACHE_RELOC_UNIT pointers target_id is the index of
+// the unit in the artifact's units, and target_offset the offset within the
+// unit.
+typedef struct _YR_CACHE_RELOC
+{
+  uint32_t buffer_id;
+  yr_arena_off_t offset;
+  uint32_t type;
+  uint32_t target_id;
+  yr_arena_off_t target_offset;
+
+} YR_CACHE_RELOC;
+
+// Rule index in the data of an artifact, see YR_RULE_IDX_LOCATION. The index
+// is the one of the artifact's own rule if rule_name is UINT32_MAX, or the
+// one of the rule whose identifier is at that offset in rule_names.
+typedef struct _YR_CACHE_RULE_IDX
+{
+  uint32_t buffer_id;
+  yr_arena_off_t offset;
+  uint32_t size;
+  uint32_t rule_name;
+
+} YR_CACHE_RULE_IDX;
+
+// Message passed to the compiler's callback while parsing a rule, which is
+// passed again when the rule is taken from the cache. The line number is
+// relative to the first line of the rule.
+typedef struct _YR_CACHE_MESSAGE
+{
+  int error_level;
+  int line_number;
+  bool own_rule;
+  char* message;
+
+} YR_CACHE_MESSAGE;
+
+typedef struct _YR_CACHE_ARTIFACT
+{
+  uint8_t* key;
+  size_t key_length;
+
+  char* identifier;
+
+  // Data appended by the rule to each buffer.
+  uint8_t* data[YR_NUM_SECTIONS];
+  yr_arena_off_t length[YR_NUM_SECTIONS];
+
+  YR_CACHE_RELOC* relocs;
+  uint32_t num_relocs;
+
+  // Units referenced by the rule, and units stored by the rule. The offsets
+  // of the latter are relative to the artifact's data.
+  YR_CACHE_UNIT* units;
+  uint32_t num_units;
+  YR_CACHE_UNIT* own_units;
+  uint32_t num_own_units;
+
+  YR_CACHE_RULE_IDX* rule_idxs;
+  uint32_t num_rule_idxs;
+  char* rule_names;
+
+  // Module functions called by the rule, see YR_SUMMARY.
+  char* called_functions;
+  size_t called_functions_length;
+
+  // Paths for the YR_AC_MATCH structures in the artifact's data.
+  YR_CACHE_PATH* paths;
+  uint32_t num_paths;
+
+  YR_CACHE_MESSAGE* messages;
+  uint32_t num_messages;
+
+  // Identifiers of the artifact's matches in the cache's automaton, or NULL
+  // if they haven't been added to it.
+  uint32_t* match_ids;
+
+  // Last compilation that used the artifact.
+  uint64_t build;
+
+  struct _YR_CACHE_ARTIFACT* prev;
+  struct _YR_CACHE_ARTIFACT* next;
+
+} YR_CACHE_ARTIFACT;
+
+// Range of YR_AC_STATE_MATCHES_POOL with the matches of an artifact, or with
+// matches that are not cached, whose paths start at first_path in the
+// cache's paths.
+typedef struct _YR_CACHE_MATCHES
+{
+  YR_CACHE_ARTIFACT* artifact;
+  uint32_t pool_index;
+  uint32_t num_matches;
+  uint32_t first_path;
+
+} YR_CACHE_MATCHES;
+
+// State of the compiler before parsing a rule, see _yr_compiler_cache_extract.
+typedef struct _YR_CACHE_SNAPSHOT
+{
+  yr_arena_off_t offsets[YR_NUM_SECTIONS];
+  YR_RELOC* reloc_list_tail;
+
+  uint32_t next_rule_idx;
+  uint32_t current_string_idx;
+  uint32_t num_rule_idx_locations;
+  uint32_t num_sz_units;
+  uint32_t num_re_units;
+  uint32_t num_paths;
+
+  int num_wildcards;
+  int num_objects;
+  int num_namespaces;
+  size_t included_files_length;
+
+} YR_CACHE_SNAPSHOT;
+
+struct YR_COMPILER_CACHE
+{
+  // Artifacts indexed by key, and a list with all of them.
+  YR_HASH_TABLE* artifacts_table;
+  YR_CACHE_ARTIFACT* artifacts;
+
+  // Automaton with the matches of the last compilation. The identifiers of
+  // the matches that don't belong to any artifact are in transient_ids.
+  YR_AC_AUTOMATON* automaton;
+  uint32_t num_live_matches;
+  uint32_t num_removed_matches;
+  uint32_t* transient_ids;
+  uint32_t num_transient_ids;
+  uint32_t max_transient_ids;
+
+  // Index within YR_AC_STATE_MATCHES_POOL of each match in the automaton,
+  // indexed by match identifier.
+  uint32_t* pool_indexes;
+  uint32_t max_pool_indexes;
+
+  // Number of compilations that used the cache so far.
+  uint64_t build;
+
+  // Size of each buffer in the arena of the last compilation, which is
+  // reserved in advance in the next one, see yr_arena_reserve_memory.
+  yr_arena_off_t buffer_sizes[YR_NUM_SECTIONS];
+
+  // Number of entries in some of the compiler's hash tables in the last
+  // compilation. The next compiler uses tables with at least that number of
+  // buckets, as the default ones are too small for large sets of rules.
+  int num_rules;
+  int num_sz_entries;
+  int num_regexps;
+
+  // The fields below are used only while a compiler uses the cache.
+  YR_COMPILER* compiler;
+
+  // Units stored in the compiler's arena, sorted by offset.
+  YR_CACHE_UNIT* sz_units;
+  uint32_t num_sz_units;
+  uint32_t max_sz_units;
+  YR_CACHE_UNIT* re_units;
+  uint32_t num_re_units;
+  uint32_t max_re_units;
+
+  // Ranges of YR_AC_STATE_MATCHES_POOL in the order they were written, and
+  // the paths for the matches written by the parser.
+  YR_CACHE_MATCHES* matches;
+  uint32_t num_matches;
+  uint32_t max_matches;
+  YR_CACHE_PATH* paths;
+  uint32_t num_paths;
+  uint32_t max_paths;
+
+  // Key prefix with everything else than the rule's source that affects the
+  // result of compiling a rule. Its length is 0 if it must be computed again.
+  uint8_t* context;
+  size_t context_length;
+  size_t max_context_length;
+  uint8_t* key;
+  size_t max_key_length;
+
+  // Compiler's callback, which is replaced with _yr_compiler_cache_callback
+  // while rules are added, and the messages and called functions recorded
+  // while parsing a rule.
+  YR_COMPILER_CALLBACK_FUNC callback;
+  void* user_data;
+  bool capture;
+  int capture_line;
+  int capture_result;
+  YR_CACHE_MESSAGE* messages;
+  uint32_t num_messages;
+  uint32_t max_messages;
+  char* called_functions;
+  size_t called_functions_length;
+  size_t max_called_functions_length;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Makes room for one more item in an array that grows as needed.
+//
+static int _yr_compiler_cache_grow(
+    void** items,
+    uint32_t* max_items,
+    uint32_t num_items,
+    size_t item_size)
+{
+  if (num_items < *max_items)
+    return ERROR_SUCCESS;
+
+  uint32_t max = *max_items == 0 ? 16 : *max_items * 2;
+  void* new_items = yr_realloc(*items, max * item_size);
+
+  if (new_items == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  *items = new_items;
+  *max_items = max;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Appends some data to a buffer that grows as needed.
+//
+static int _yr_compiler_cache_append(
+    void** buffer,
+    size_t* length,
+    size_t* max_length,
+    const void* data,
+    size_t data_length)
+{
+  if (*length + data_length > *max_length)
+  {
+    size_t max = *max_length == 0 ? 256 : *max_length * 2;
+
+    while (max < *length + data_length) max *= 2;
+
+    void* new_buffer = yr_realloc(*buffer, max);
+
+    if (new_buffer == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    *buffer = new_buffer;
+    *max_length = max;
+  }
+
+  memcpy((uint8_t*) *buffer + *length, data, data_length);
+  *length += data_length;
+
+  return ERROR_SUCCESS;
+}
+
+static void _yr_compiler_cache_free_messages(
+    YR_CACHE_MESSAGE* messages,
+    uint32_t num_messages)
+{
+  for (uint32_t i = 0; i < num_messages; i++) yr_free(messages[i].message);
+}
+
+static void _yr_compiler_cache_free_units(
+    YR_CACHE_UNIT* units,
+    uint32_t num_units)
+{
+  for (uint32_t i = 0; i < num_units; i++)
+  {
+    if (units[i].data != units[i].key)
+      yr_free(units[i].data);
+
+    yr_free(units[i].key);
+  }
+
+  yr_free(units);
+}
+
+static void _yr_compiler_cache_artifact_destroy(YR_CACHE_ARTIFACT* artifact)
+{
+  for (int i = 0; i < YR_NUM_SECTIONS; i++) yr_free(artifact->data[i]);
+
+  _yr_compiler_cache_free_units(artifact->units, artifact->num_units);
+  _yr_compiler_cache_free_units(artifact->own_units, artifact->num_own_units);
+  _yr_compiler_cache_free_messages(artifact->messages, artifact->num_messages);
+
+  yr_free(artifact->key);
+  yr_free(artifact->identifier);
+  yr_free(artifact->relocs);
+  yr_free(artifact->rule_idxs);
+  yr_free(artifact->rule_names);
+  yr_free(artifact->called_functions);
+  yr_free(artifact->paths);
+  yr_free(artifact->messages);
+  yr_free(artifact->match_ids);
+  yr_free(artifact);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Removes an artifact from the cache and destroys it.
+//
+static int _yr_compiler_cache_evict(
+    YR_COMPILER_CACHE* cache,
+    YR_CACHE_ARTIFACT* artifact)
+{
+  if (artifact->match_ids != NULL)
+  {
+    for (uint32_t i = 0; i < artifact->num_paths; i++)
+      FAIL_ON_ERROR(
+          yr_ac_remove_match(cache->automaton, artifact->match_ids[i]));
+
+    cache->num_live_matches -= artifact->num_paths;
+    cache->num_removed_matches += artifact->num_paths;
+  }
+
+  yr_hash_table_remove_raw_key(
+      cache->artifacts_table, artifact->key, artifact->key_length, NULL);
+
+  if (artifact->prev != NULL)
+    artifact->prev->next = artifact->next;
+  else
+    cache->artifacts = artifact->next;
+
+  if (artifact->next != NULL)
+    artifact->next->prev = artifact->prev;
+
+  _yr_compiler_cache_artifact_destroy(artifact);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Destroys the cache's automaton. The matches of all the artifacts are added
+// again to a new automaton the next time the rules are compiled.
+//
+static void _yr_compiler_cache_reset_automaton(YR_COMPILER_CACHE* cache)
+{
+  if (cache->automaton != NULL)
+    yr_ac_automaton_destroy(cache->automaton);
+
+  for (YR_CACHE_ARTIFACT* artifact = cache->artifacts; artifact != NULL;
+       artifact = artifact->next)
+  {
+    yr_free(artifact->match_ids);
+    artifact->match_ids = NULL;
+  }
+
+  cache->automaton = NULL;
+  cache->num_live_matches = 0;
+  cache->num_removed_matches = 0;
+  cache->num_transient_ids = 0;
+}
+
+YR_API int yr_compiler_cache_create(YR_COMPILER_CACHE** cache)
+{
+  YR_COMPILER_CACHE* new_cache = (YR_COMPILER_CACHE*) yr_calloc(
+      1, sizeof(YR_COMPILER_CACHE));
+
+  if (new_cache == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  int result = yr_hash_table_create(65536, &new_cache->artifacts_table);
+
+  if (result != ERROR_SUCCESS)
+  {
+    yr_free(new_cache);
+    return result;
+  }
+
+  *cache = new_cache;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Destroys a cache. The compiler that uses the cache, if any, must be
+// destroyed first.
+//
+YR_API void yr_compiler_cache_destroy(YR_COMPILER_CACHE* cache)
+{
+  assert(cache->compiler == NULL);
+
+  YR_CACHE_ARTIFACT* artifact = cache->artifacts;
+
+  while (artifact != NULL)
+  {
+    YR_CACHE_ARTIFACT* next = artifact->next;
+    _yr_compiler_cache_artifact_destroy(artifact);
+    artifact = next;
+  }
+
+  if (cache->automaton != NULL)
+    yr_ac_automaton_destroy(cache->automaton);
+
+  yr_hash_table_destroy(cache->artifacts_table, NULL);
+
+  yr_free(cache->transient_ids);
+  yr_free(cache->pool_indexes);
+  yr_free(cache);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Discards the state kept by the cache while a compiler uses it.
+//
+void _yr_compiler_cache_detach(YR_COMPILER* compiler)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+
+  _yr_compiler_cache_free_units(cache->sz_units, cache->num_sz_units);
+  _yr_compiler_cache_free_units(cache->re_units, cache->num_re_units);
+  _yr_compiler_cache_free_messages(cache->messages, cache->num_messages);
+
+  yr_free(cache->matches);
+  yr_free(cache->paths);
+  yr_free(cache->context);
+  yr_free(cache->key);
+  yr_free(cache->messages);
+  yr_free(cache->called_functions);
+
+  cache->sz_units = NULL;
+  cache->num_sz_units = 0;
+  cache->max_sz_units = 0;
+  cache->re_units = NULL;
+  cache->num_re_units = 0;
+  cache->max_re_units = 0;
+  cache->matches = NULL;
+  cache->num_matches = 0;
+  cache->max_matches = 0;
+  cache->paths = NULL;
+  cache->num_paths = 0;
+  cache->max_paths = 0;
+  cache->context = NULL;
+  cache->context_length = 0;
+  cache->max_context_length = 0;
+  cache->key = NULL;
+  cache->max_key_length = 0;
+  cache->messages = NULL;
+  cache->num_messages = 0;
+  cache->max_messages = 0;
+  cache->called_functions = NULL;
+  cache->called_functions_length = 0;
+  cache->max_called_functions_length = 0;
+  cache->compiler = NULL;
+
+  compiler->cache = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records a unit stored in the compiler's arena. This is called by
+// _yr_compiler_store_data and _yr_compiler_store_regexp.
+//
+int _yr_compiler_cache_add_unit(
+    YR_COMPILER* compiler,
+    uint32_t buffer_id,
+    const void* key,
+    size_t key_length,
+    yr_arena_off_t offset,
+    yr_arena_off_t length)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+  YR_CACHE_UNIT* unit;
+
+  if (buffer_id == YR_SZ_POOL)
+  {
+    FAIL_ON_ERROR(_yr_compiler_cache_grow(
+        (void**) &cache->sz_units,
+        &cache->max_sz_units,
+        cache->num_sz_units,
+        sizeof(YR_CACHE_UNIT)));
+
+    unit = &cache->sz_units[cache->num_sz_units];
+    unit->key = NULL;
+  }
+  else
+  {
+    FAIL_ON_ERROR(_yr_compiler_cache_grow(
+        (void**) &cache->re_units,
+        &cache->max_re_units,
+        cache->num_re_units,
+        sizeof(YR_CACHE_UNIT)));
+
+    unit = &cache->re_units[cache->num_re_units];
+    unit->key = (uint8_t*) yr_malloc(key_length);
+
+    if (unit->key == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    memcpy(unit->key, key, key_length);
+  }
+
+  unit->buffer_id = buffer_id;
+  unit->offset = offset;
+  unit->length = length;
+  unit->key_length = (uint32_t) key_length;
+  unit->data = NULL;
+
+  if (buffer_id == YR_SZ_POOL)
+    cache->num_sz_units++;
+  else
+    cache->num_re_units++;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the unit in the compiler's arena that contains the given offset,
+// or NULL if there's no such unit.
+//
+static YR_CACHE_UNIT* _yr_compiler_cache_find_unit(
+    YR_COMPILER_CACHE* cache,
+    uint32_t buffer_id,
+    yr_arena_off_t offset)
+{
+  YR_CACHE_UNIT* units;
+  uint32_t lo = 0;
+  uint32_t hi;
+
+  if (buffer_id == YR_SZ_POOL)
+  {
+    units = cache->sz_units;
+    hi = cache->num_sz_units;
+  }
+  else
+  {
+    units = cache->re_units;
+    hi = cache->num_re_units;
+  }
+
+  // Find the last unit that starts at or before offset.
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if (units[mid].offset <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0 || offset - units[lo - 1].offset >= units[lo - 1].length)
+    return NULL;
+
+  return &units[lo - 1];
+}
+
+static int _yr_compiler_cache_unit_cmp(const void* a, const void* b)
+{
+  yr_arena_off_t offset_a = ((const YR_CACHE_UNIT*) a)->offset;
+  yr_arena_off_t offset_b = ((const YR_CACHE_UNIT*) b)->offset;
+
+  if (offset_a < offset_b)
+    return -1;
+
+  if (offset_a > offset_b)
+    return 1;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records the units already stored in the compiler's arena in one of its
+// tables.
+//
+static int _yr_compiler_cache_add_units(
+    YR_COMPILER* compiler,
+    uint32_t buffer_id,
+    YR_HASH_TABLE* table,
+    YR_HASH_TABLE* lengths)
+{
+  int visited = 0;
+
+  for (int i = 0; i < table->size && visited < table->num_entries; i++)
+  {
+    for (YR_HASH_TABLE_ENTRY* entry = table->buckets[i]; entry != NULL;
+         entry = entry->next)
+    {
+      yr_arena_off_t length = (yr_arena_off_t) entry->key_length;
+
+      visited++;
+
+      if (lengths != NULL)
+        length = yr_hash_table_lookup_uint32_raw_key(
+            lengths, entry->key, entry->key_length, NULL);
+
+      FAIL_ON_ERROR(_yr_compiler_cache_add_unit(
+          compiler,
+          buffer_id,
+          entry->key,
+          entry->key_length,
+          yr_hash_table_lookup_uint32_raw_key(
+              table, entry->key, entry->key_length, NULL),
+          length));
+    }
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Replaces a hash table with a new one with the given number of buckets and
+// the same entries, if the table has less buckets than that.
+//
+static int _yr_compiler_cache_resize_table(YR_HASH_TABLE** table, int size)
+{
+  YR_HASH_TABLE* new_table;
+
+  if ((*table)->size >= size)
+    return ERROR_SUCCESS;
+
+  FAIL_ON_ERROR(yr_hash_table_create(size, &new_table));
+
+  for (int i = 0; i < (*table)->size; i++)
+  {
+    for (YR_HASH_TABLE_ENTRY* entry = (*table)->buckets[i]; entry != NULL;
+         entry = entry->next)
+    {
+      FAIL_ON_ERROR_WITH_CLEANUP(
+          yr_hash_table_add_raw_key(
+              new_table,
+              entry->key,
+              entry->key_length,
+              entry->ns,
+              entry->value),
+          yr_hash_table_destroy(new_table, NULL));
+    }
+  }
+
+  yr_hash_table_destroy(*table, NULL);
+  *table = new_table;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Makes a compiler use a cache. The rules added to the compiler after this
+// call are taken from the cache if they were compiled before by some other
+// compiler that used the same cache, and the rules compiled by this compiler
+// are added to the cache when yr_compiler_get_rules is called. Artifacts that
+// the compiler doesn't use are removed from the cache at that point, so the
+// cache keeps the rules of the last compilation only.
+//
+// The compiler must not have any rules yet. A cache can be used by only one
+// compiler at a time, and it must not be destroyed before the compiler.
+//
+YR_API int yr_compiler_set_cache(
+    YR_COMPILER* compiler,
+    YR_COMPILER_CACHE* cache)
+{
+  assert(compiler->next_rule_idx == 0);
+  assert(compiler->cache == NULL);
+
+  if (cache->compiler != NULL)
+    return ERROR_INVALID_ARGUMENT;
+
+  cache->compiler = compiler;
+  cache->build++;
+
+  compiler->cache = cache;
+  compiler->track_rule_idx = true;
+
+  int result = ERROR_SUCCESS;
+
+  // Rules taken from the cache are copied at once, and the buffers should
+  // not be moved while copying them because it's slow when there are many
+  // relocatable pointers.
+  for (int i = 0; i < YR_NUM_SECTIONS && result == ERROR_SUCCESS; i++)
+  {
+    yr_arena_off_t offset = yr_arena_get_current_offset(compiler->arena, i);
+
+    if (cache->buffer_sizes[i] > offset)
+      result = yr_arena_reserve_memory(
+          compiler->arena, i, cache->buffer_sizes[i] - offset);
+  }
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_compiler_cache_resize_table(
+        &compiler->rules_table, cache->num_rules);
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_compiler_cache_resize_table(
+        &compiler->sz_table, cache->num_sz_entries);
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_compiler_cache_resize_table(
+        &compiler->regexps_table, cache->num_regexps);
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_compiler_cache_resize_table(
+        &compiler->regexps_lengths, cache->num_regexps);
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_compiler_cache_add_units(
+        compiler, YR_SZ_POOL, compiler->sz_table, NULL);
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_compiler_cache_add_units(
+        compiler,
+        YR_RE_CODE_SECTION,
+        compiler->regexps_table,
+        compiler->regexps_lengths);
+
+  if (result != ERROR_SUCCESS)
+  {
+    _yr_compiler_cache_detach(compiler);
+    return result;
+  }
+
+  qsort(
+      cache->sz_units,
+      cache->num_sz_units,
+      sizeof(YR_CACHE_UNIT),
+      _yr_compiler_cache_unit_cmp);
+
+  qsort(
+      cache->re_units,
+      cache->num_re_units,
+      sizeof(YR_CACHE_UNIT),
+      _yr_compiler_cache_unit_cmp);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records a module function called by the rule being parsed. This is called
+// by _yr_compiler_add_called_function.
+//
+int _yr_compiler_cache_add_called_function(
+    YR_COMPILER* compiler,
+    const char* identifier)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+
+  if (!cache->capture)
+    return ERROR_SUCCESS;
+
+  return _yr_compiler_cache_append(
+      (void**) &cache->called_functions,
+      &cache->called_functions_length,
+      &cache->max_called_functions_length,
+      identifier,
+      strlen(identifier) + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Writes the YR_AC_MATCH structures for the atoms of a string, like
+// yr_ac_add_string does, and records their paths. The matches are added to
+// the cache's automaton when the rules are compiled.
+//
+int _yr_compiler_cache_add_string(
+    YR_COMPILER* compiler,
+    uint32_t string_idx,
+    YR_ATOM_LIST_ITEM* atom)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+
+  for (; atom != NULL; atom = atom->next)
+  {
+    YR_ARENA_REF ref;
+    YR_CACHE_PATH* path;
+
+    FAIL_ON_ERROR(_yr_compiler_cache_grow(
+        (void**) &cache->paths,
+        &cache->max_paths,
+        cache->num_paths,
+        sizeof(YR_CACHE_PATH)));
+
+    FAIL_ON_ERROR(yr_arena_allocate_struct(
+        compiler->arena,
+        YR_AC_STATE_MATCHES_POOL,
+        sizeof(YR_AC_MATCH),
+        &ref,
+        offsetof(YR_AC_MATCH, string),
+        offsetof(YR_AC_MATCH, forward_code),
+        offsetof(YR_AC_MATCH, backward_code),
+        offsetof(YR_AC_MATCH, next),
+        EOL));
+
+    YR_AC_MATCH* match = (YR_AC_MATCH*) yr_arena_ref_to_ptr(
+        compiler->arena, &ref);
+
+    match->backtrack = atom->atom.length + atom->backtrack;
+    match->string = (YR_STRING*) yr_arena_get_ptr(
+        compiler->arena, YR_STRINGS_TABLE, string_idx * sizeof(YR_STRING));
+    match->forward_code = yr_arena_ref_to_ptr(
+        compiler->arena, &atom->forward_code_ref);
+    match->backward_code = yr_arena_ref_to_ptr(
+        compiler->arena, &atom->backward_code_ref);
+    match->next = NULL;
+
+    path = &cache->paths[cache->num_paths++];
+    path->length = atom->atom.length;
+    memcpy(path->bytes, atom->atom.bytes, atom->atom.length);
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records a range of YR_AC_STATE_MATCHES_POOL.
+//
+static int _yr_compiler_cache_add_matches(
+    YR_COMPILER_CACHE* cache,
+    YR_CACHE_ARTIFACT* artifact,
+    uint32_t pool_index,
+    uint32_t num_matches,
+    uint32_t first_path)
+{
+  if (num_matches == 0)
+    return ERROR_SUCCESS;
+
+  FAIL_ON_ERROR(_yr_compiler_cache_grow(
+      (void**) &cache->matches,
+      &cache->max_matches,
+      cache->num_matches,
+      sizeof(YR_CACHE_MATCHES)));
+
+  YR_CACHE_MATCHES* matches = &cache->matches[cache->num_matches++];
+
+  matches->artifact = artifact;
+  matches->pool_index = pool_index;
+  matches->num_matches = num_matches;
+  matches->first_path = first_path;
+
+  return ERROR_SUCCESS;
+}
+
+static void _yr_compiler_cache_callback(
+    int error_level,
+    const char* file_name,
+    int line_number,
+    const YR_RULE* rule,
+    const char* message,
+    void* user_data)
+{
+  YR_COMPILER* compiler = (YR_COMPILER*) user_data;
+  YR_COMPILER_CACHE* cache = compiler->cache;
+
+  if (cache->capture && cache->capture_result == ERROR_SUCCESS)
+  {
+    cache->capture_result = _yr_compiler_cache_grow(
+        (void**) &cache->messages,
+        &cache->max_messages,
+        cache->num_messages,
+        sizeof(YR_CACHE_MESSAGE));
+
+    if (cache->capture_result == ERROR_SUCCESS)
+    {
+      YR_CACHE_MESSAGE* m = &cache->messages[cache->num_messages];
+
+      m->error_level = error_level;
+      m->line_number = line_number - cache->capture_line;
+      m->own_rule = rule != NULL;
+      m->message = yr_strdup(message);
+
+      if (m->message != NULL)
+        cache->num_messages++;
+      else
+        cache->capture_result = ERROR_INSUFFICIENT_MEMORY;
+    }
+  }
+
+  if (cache->callback != NULL)
+    cache->callback(
+        error_level, file_name, line_number, rule, message, cache->user_data);
+}
+
+static int _yr_compiler_cache_object_cmp(const void* a, const void* b)
+{
+  const YR_HASH_TABLE_ENTRY* entry_a = *(const YR_HASH_TABLE_ENTRY**) a;
+  const YR_HASH_TABLE_ENTRY* entry_b = *(const YR_HASH_TABLE_ENTRY**) b;
+
+  // External variables, which have no namespace, go first.
+  if ((entry_a->ns == NULL) != (entry_b->ns == NULL))
+    return entry_a->ns == NULL ? -1 : 1;
+
+  int result = memcmp(
+      entry_a->key,
+      entry_b->key,
+      yr_min(entry_a->key_length, entry_b->key_length));
+
+  if (result != 0)
+    return result;
+
+  if (entry_a->key_length != entry_b->key_length)
+    return entry_a->key_length < entry_b->key_length ? -1 : 1;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Computes the prefix of the keys of the artifacts for the current
+// namespace. It contains the namespace's name, the modules imported in the
+// namespace, the names and types of the external variables, and the atoms
+// configuration.
+//
+static int _yr_compiler_cache_update_context(YR_COMPILER* compiler)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+  YR_HASH_TABLE* table = compiler->objects_table;
+  YR_HASH_TABLE_ENTRY** entries = NULL;
+  YR_ATOMS_CONFIG* atoms_config = &compiler->atoms_config;
+
+  uint32_t max_strings_per_rule;
+  int num_entries = 0;
+  int result = ERROR_SUCCESS;
+
+  YR_NAMESPACE* ns = (YR_NAMESPACE*) yr_arena_get_ptr(
+      compiler->arena,
+      YR_NAMESPACES_TABLE,
+      compiler->current_namespace_idx * sizeof(struct YR_NAMESPACE));
+
+  cache->context_length = 0;
+
+  if (table->num_entries > 0)
+  {
+    entries = (YR_HASH_TABLE_ENTRY**) yr_malloc(
+        table->num_entries * sizeof(YR_HASH_TABLE_ENTRY*));
+
+    if (entries == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+  }
+
+  for (int i = 0; i < table->size && num_entries < table->num_entries; i++)
+  {
+    for (YR_HASH_TABLE_ENTRY* entry = table->buckets[i]; entry != NULL;
+         entry = entry->next)
+    {
+      entries[num_entries++] = entry;
+    }
+  }
+
+  if (num_entries > 0)
+    qsort(
+        entries,
+        num_entries,
+        sizeof(YR_HASH_TABLE_ENTRY*),
+        _yr_compiler_cache_object_cmp);
+
+  GOTO_EXIT_ON_ERROR(_yr_compiler_cache_append(
+      (void**) &cache->context,
+      &cache->context_length,
+      &cache->max_context_length,
+      ns->name,
+      strlen(ns->name) + 1));
+
+  for (int i = 0; i < num_entries; i++)
+  {
+    int8_t type;
+
+    // Modules imported in other namespaces don't matter.
+    if (entries[i]->ns != NULL && strcmp(entries[i]->ns, ns->name) != 0)
+      continue;
+
+    if (entries[i]->ns == NULL)
+      type = ((YR_OBJECT*) entries[i]->value)->type;
+    else
+      type = -1;
+
+    GOTO_EXIT_ON_ERROR(_yr_compiler_cache_append(
+        (void**) &cache->context,
+        &cache->context_length,
+        &cache->max_context_length,
+        &type,
+        sizeof(type)));
+
+    // Keys in the hash table are not null-terminated.
+    GOTO_EXIT_ON_ERROR(_yr_compiler_cache_append(
+        (void**) &cache->context,
+        &cache->context_length,
+        &cache->max_context_length,
+        entries[i]->key,
+        entries[i]->key_length));
+
+    GOTO_EXIT_ON_ERROR(_yr_compiler_cache_append(
+        (void**) &cache->context,
+        &cache->context_length,
+        &cache->max_context_length,
+        "",
+        1));
+  }
+
+  uint32_t atoms[4] = {
+      atoms_config->get_atom_quality == yr_atoms_heuristic_quality,
+      (uint32_t) atoms_config->quality_warning_threshold,
+      (uint32_t) atoms_config->quality_table_entries,
+      0,
+  };
+
+  if (atoms_config->quality_table != NULL)
+    atoms[3] = yr_hash(
+        0,
+        atoms_config->quality_table,
+        atoms_config->quality_table_entries *
+            sizeof(YR_ATOM_QUALITY_TABLE_ENTRY));
+
+  GOTO_EXIT_ON_ERROR(_yr_compiler_cache_append(
+      (void**) &cache->context,
+      &cache->context_length,
+      &cache->max_context_length,
+      atoms,
+      sizeof(atoms)));
+
+  yr_get_configuration_uint32(
+      YR_CONFIG_MAX_STRINGS_PER_RULE, &max_strings_per_rule);
+
+  result = _yr_compiler_cache_append(
+      (void**) &cache->context,
+      &cache->context_length,
+      &cache->max_context_length,
+      &max_strings_per_rule,
+      sizeof(max_strings_per_rule));
+
+_exit:
+
+  // A zero length means that the context must be computed.
+  if (result != ERROR_SUCCESS)
+    cache->context_length = 0;
+
+  yr_free(entries);
+
+  return result;
+}
+
+static bool _yr_compiler_cache_is_identifier_char(uint8_t c)
+{
+  return isalnum(c) || c == '_';
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the offset where the token that starts at "offset" ends, and adds
+// to *line the number of new lines in the token. Only comments, text strings,
+// regexps and identifiers are returned as a whole, like the lexer does, any
+// other character is a token by itself.
+//
+static size_t _yr_compiler_cache_skip_token(
+    const uint8_t* data,
+    size_t size,
+    size_t offset,
+    int* line)
+{
+  size_t i = offset;
+  uint8_t c = data[i];
+
+  if (c == '/' && i + 1 < size && data[i + 1] == '*')
+  {
+    i += 2;
+
+    while (i < size && !(data[i] == '*' && i + 1 < size && data[i + 1] == '/'))
+    {
+      if (data[i] == '\n')
+        (*line)++;
+
+      i++;
+    }
+
+    return i < size ? i + 2 : size;
+  }
+
+  if (c == '/' && i + 1 < size && data[i + 1] == '/')
+  {
+    while (i < size && data[i] != '\n') i++;
+
+    return i;
+  }
+
+  // Regexps always start with a slash, as there's no division operator with
+  // that symbol. Regexps and text strings end with the same character they
+  // start with, a backslash escapes the next character, and they can't span
+  // multiple lines.
+  if (c == '/' || c == '"')
+  {
+    i++;
+
+    while (i < size && data[i] != c && data[i] != '\n')
+    {
+      if (data[i] == '\\' && i + 1 < size && data[i + 1] != '\n')
+        i++;
+
+      i++;
+    }
+
+    return i < size && data[i] == c ? i + 1 : i;
+  }
+
+  if (isalpha(c) || c == '_')
+  {
+    while (i < size && _yr_compiler_cache_is_identifier_char(data[i])) i++;
+
+    return i;
+  }
+
+  if (c == '\n')
+    (*line)++;
+
+  return i + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Skips white spaces and comments, returns the offset where they end.
+//
+static size_t _yr_compiler_cache_skip_spaces(
+    const uint8_t* data,
+    size_t size,
+    size_t offset,
+    int* line)
+{
+  while (offset < size)
+  {
+    uint8_t c = data[offset];
+
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+    {
+      if (c == '\n')
+        (*line)++;
+
+      offset++;
+    }
+    else if (c == '/' && offset + 1 < size &&
+             (data[offset + 1] == '*' || data[offset + 1] == '/'))
+    {
+      offset = _yr_compiler_cache_skip_token(data, size, offset, line);
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  return offset;
+}
+
+static bool _yr_compiler_cache_is_keyword(
+    const uint8_t* data,
+    size_t length,
+    const char* keyword)
+{
+  return length == strlen(keyword) && memcmp(data, keyword, length) == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds the next item in the rules, starting at *offset, which is updated to
+// the offset where the item ends. *line is the line number at *offset. An
+// item is either a rule, which ends with the brace that closes its body, an
+// import or include statement, or everything up to the end of the rules if
+// the text at *offset is something else.
+//
+static void _yr_compiler_cache_next_item(
+    const uint8_t* data,
+    size_t size,
+    size_t* offset,
+    int* line,
+    YR_CACHE_ITEM* item)
+{
+  size_t i = _yr_compiler_cache_skip_spaces(data, size, *offset, line);
+  size_t end = i;
+
+  item->start = i;
+  item->end = size;
+  item->line = *line;
+
+  if (i == size)
+  {
+    item->type = YR_CACHE_ITEM_NONE;
+    *offset = i;
+    return;
+  }
+
+  item->type = YR_CACHE_ITEM_REST;
+
+  while (end < size && _yr_compiler_cache_is_identifier_char(data[end])) end++;
+
+  if (_yr_compiler_cache_is_keyword(data + i, end - i, "rule") ||
+      _yr_compiler_cache_is_keyword(data + i, end - i, "private") ||
+      _yr_compiler_cache_is_keyword(data + i, end - i, "global"))
+  {
+    int depth = 0;
+
+    while (end < size)
+    {
+      if (data[end] == '}' && --depth <= 0)
+      {
+        if (depth == 0)
+        {
+          item->type = YR_CACHE_ITEM_RULE;
+          item->end = end + 1;
+        }
+
+        break;
+      }
+
+      if (data[end] == '{')
+        depth++;
+
+      end = _yr_compiler_cache_skip_token(data, size, end, line);
+    }
+  }
+  else if (_yr_compiler_cache_is_keyword(data + i, end - i, "import"))
+  {
+    end = _yr_compiler_cache_skip_spaces(data, size, end, line);
+
+    if (end < size && data[end] == '"')
+    {
+      end = _yr_compiler_cache_skip_token(data, size, end, line);
+
+      if (data[end - 1] == '"' && end - i > 1)
+      {
+        item->type = YR_CACHE_ITEM_STATEMENT;
+        item->end = end;
+      }
+    }
+  }
+  else if (_yr_compiler_cache_is_keyword(data + i, end - i, "include"))
+  {
+    // The lexer expects spaces or tabs before the file name.
+    size_t name = end;
+
+    while (name < size && (data[name] == ' ' || data[name] == '\t')) name++;
+
+    if (name > end && name < size && data[name] == '"')
+    {
+      end = _yr_compiler_cache_skip_token(data, size, name, line);
+
+      if (data[end - 1] == '"' && end - name > 1)
+      {
+        item->type = YR_CACHE_ITEM_STATEMENT;
+        item->end = end;
+      }
+    }
+  }
+
+  // Rules with a missing brace are parsed with everything that follows them,
+  // new lines in them don't need to be counted.
+  *offset = item->end;
+}
+
+static void _yr_compiler_cache_take_snapshot(
+    YR_COMPILER* compiler,
+    YR_CACHE_SNAPSHOT* snapshot)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+
+  for (int i = 0; i < YR_NUM_SECTIONS; i++)
+    snapshot->offsets[i] = yr_arena_get_current_offset(compiler->arena, i);
+
+  snapshot->reloc_list_tail = compiler->arena->reloc_list_tail;
+  snapshot->next_rule_idx = compiler->next_rule_idx;
+  snapshot->current_string_idx = compiler->current_string_idx;
+  snapshot->num_rule_idx_locations = compiler->num_rule_idx_locations;
+  snapshot->num_sz_units = cache->num_sz_units;
+  snapshot->num_re_units = cache->num_re_units;
+  snapshot->num_paths = cache->num_paths;
+  snapshot->num_wildcards = compiler->wildcard_identifiers_table->num_entries;
+  snapshot->num_objects = compiler->objects_table->num_entries;
+  snapshot->num_namespaces = compiler->num_namespaces;
+  snapshot->included_files_length = compiler->included_files_length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parses some rules without looking for them in the cache.
+//
+static int _yr_compiler_cache_parse(
+    YR_COMPILER* compiler,
+    const uint8_t* data,
+    size_t size,
+    int line)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+  YR_CACHE_SNAPSHOT snapshot;
+
+  _yr_compiler_cache_take_snapshot(compiler, &snapshot);
+
+  int errors = yr_lex_parse_rules_bytes(data, size, line, compiler);
+
+  // Import statements change the context for the rules that follow them.
+  cache->context_length = 0;
+
+  int result = _yr_compiler_cache_add_matches(
+      cache,
+      NULL,
+      snapshot.offsets[YR_AC_STATE_MATCHES_POOL] / sizeof(YR_AC_MATCH),
+      cache->num_paths - snapshot.num_paths,
+      snapshot.num_paths);
+
+  if (result != ERROR_SUCCESS && errors == 0)
+  {
+    compiler->last_error = result;
+    errors = 1;
+  }
+
+  return errors;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if the rule parsed since the snapshot was taken can be
+// cached, by checking that it didn't change anything else in the compiler
+// than what _yr_compiler_cache_apply does.
+//
+static bool _yr_compiler_cache_is_cacheable(
+    YR_COMPILER* compiler,
+    YR_CACHE_SNAPSHOT* snapshot)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+
+  uint32_t unchanged[] = {
+      YR_NAMESPACES_TABLE,
+      YR_EXTERNAL_VARIABLES_TABLE,
+      YR_AC_TRANSITION_TABLE,
+      YR_AC_STATE_MATCHES_TABLE,
+      YR_SUMMARY_SECTION,
+  };
+
+  for (int i = 0; i < (int) (sizeof(unchanged) / sizeof(unchanged[0])); i++)
+  {
+    if (yr_arena_get_current_offset(compiler->arena, unchanged[i]) !=
+        snapshot->offsets[unchanged[i]])
+      return false;
+  }
+
+  // Rules that use wildcards depend on the rules that come before them.
+  return cache->capture_result == ERROR_SUCCESS &&
+         compiler->next_rule_idx == snapshot->next_rule_idx + 1 &&
+         compiler->wildcard_identifiers_table->num_entries ==
+             snapshot->num_wildcards &&
+         compiler->objects_table->num_entries == snapshot->num_objects &&
+         compiler->num_namespaces == snapshot->num_namespaces &&
+         compiler->included_files_length == snapshot->included_files_length &&
+         cache->num_paths - snapshot->num_paths ==
+             (yr_arena_get_current_offset(
+                  compiler->arena, YR_AC_STATE_MATCHES_POOL) -
+              snapshot->offsets[YR_AC_STATE_MATCHES_POOL]) /
+                 sizeof(YR_AC_MATCH);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns in *index the index within the artifact's units of the unit that
+// contains the given offset, adding it to the artifact if necessary. Returns
+// false if there's no such unit.
+//
+static bool _yr_compiler_cache_ref_unit(
+    YR_COMPILER* compiler,
+    YR_CACHE_ARTIFACT* artifact,
+    uint32_t buffer_id,
+    yr_arena_off_t offset,
+    uint32_t* index,
+    yr_arena_off_t* delta)
+{
+  YR_CACHE_UNIT* unit = _yr_compiler_cache_find_unit(
+      compiler->cache, buffer_id, offset);
+
+  if (unit == NULL)
+    return false;
+
+  *delta = offset - unit->offset;
+
+  // While the artifact is being extracted, the offset of its units is the
+  // offset in the compiler's arena.
+  for (uint32_t i = 0; i < artifact->num_units; i++)
+  {
+    if (artifact->units[i].buffer_id == buffer_id &&
+        artifact->units[i].offset == unit->offset)
+    {
+      *index = i;
+      return true;
+    }
+  }
+
+  YR_CACHE_UNIT* new_unit = &artifact->units[artifact->num_units];
+  const uint8_t* data = (const uint8_t*) yr_arena_get_ptr(
+      compiler->arena, buffer_id, unit->offset);
+
+  new_unit->buffer_id = buffer_id;
+  new_unit->offset = unit->offset;
+  new_unit->length = unit->length;
+  new_unit->key_length = unit->key_length;
+  new_unit->data = (uint8_t*) yr_malloc(unit->length);
+  new_unit->key = new_unit->data;
+
+  if (new_unit->data == NULL)
+    return false;
+
+  memcpy(new_unit->data, data, unit->length);
+
+  if (unit->key != NULL)
+  {
+    new_unit->key = (uint8_t*) yr_malloc(unit->key_length);
+
+    if (new_unit->key == NULL)
+    {
+      yr_free(new_unit->data);
+      return false;
+    }
+
+    memcpy(new_unit->key, unit->key, unit->key_length);
+  }
+
+  *index = artifact->num_units++;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds the target of each pointer written while parsing the rule.
+//
+static bool _yr_compiler_cache_extract_relocs(
+    YR_COMPILER* compiler,
+    YR_CACHE_SNAPSHOT* snapshot,
+    YR_CACHE_ARTIFACT* artifact)
+{
+  YR_RELOC* first = snapshot->reloc_list_tail != NULL
+                        ? snapshot->reloc_list_tail->next
+                        : compiler->arena->reloc_list_head;
+
+  for (YR_RELOC* reloc = first; reloc != NULL; reloc = reloc->next)
+    artifact->num_relocs++;
+
+  if (artifact->num_relocs == 0)
+    return true;
+
+  artifact->relocs = (YR_CACHE_RELOC*) yr_malloc(
+      artifact->num_relocs * sizeof(YR_CACHE_RELOC));
+
+  // Each pointer references one unit at most.
+  artifact->units = (YR_CACHE_UNIT*) yr_malloc(
+      artifact->num_relocs * sizeof(YR_CACHE_UNIT));
+
+  if (artifact->relocs == NULL || artifact->units == NULL)
+    return false;
+
+  YR_CACHE_RELOC* r = artifact->relocs;
+
+  for (YR_RELOC* reloc = first; reloc != NULL; reloc = reloc->next, r++)
+  {
+    yr_arena_off_t base = snapshot->offsets[reloc->buffer_id];
+    YR_ARENA_REF ref;
+    void* ptr;
+
+    if (reloc->offset < base)
+      return false;
+
+    r->buffer_id = reloc->buffer_id;
+    r->offset = reloc->offset - base;
+    r->type = YR_CACHE_RELOC_NULL;
+    r->target_id = 0;
+    r->target_offset = 0;
+
+    // Lists of matches are built when the rules are compiled.
+    if (reloc->buffer_id == YR_AC_STATE_MATCHES_POOL &&
+        r->offset % sizeof(YR_AC_MATCH) == offsetof(YR_AC_MATCH, next))
+      continue;
+
+    memcpy(
+        &ptr,
+        yr_arena_get_ptr(compiler->arena, reloc->buffer_id, reloc->offset),
+        sizeof(ptr));
+
+    if (ptr == NULL)
+      continue;
+
+    if (!yr_arena_ptr_to_ref(compiler->arena, ptr, &ref))
+      return false;
+
+    if (ref.buffer_id == YR_NAMESPACES_TABLE)
+    {
+      if (ref.offset !=
+          compiler->current_namespace_idx * sizeof(struct YR_NAMESPACE))
+        return false;
+
+      r->type = YR_CACHE_RELOC_NAMESPACE;
+    }
+    else if (ref.offset >= snapshot->offsets[ref.buffer_id])
+    {
+      r->type = YR_CACHE_RELOC_INTERNAL;
+      r->target_id = ref.buffer_id;
+      r->target_offset = ref.offset - snapshot->offsets[ref.buffer_id];
+    }
+    else if (
+        ref.buffer_id == YR_SZ_POOL || ref.buffer_id == YR_RE_CODE_SECTION)
+    {
+      if (!_yr_compiler_cache_ref_unit(
+              compiler,
+              artifact,
+              ref.buffer_id,
+              ref.offset,
+              &r->target_id,
+              &r->target_offset))
+        return false;
+
+      r->type = YR_CACHE_RELOC_UNIT;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records the rule indexes written while parsing the rule, which are either
+// the index of the rule itself, or of some other rule in the same namespace.
+//
+static bool _yr_compiler_cache_extract_rule_idxs(
+    YR_COMPILER* compiler,
+    YR_CACHE_SNAPSHOT* snapshot,
+    YR_CACHE_ARTIFACT* artifact)
+{
+  size_t names_length = 0;
+  size_t max_names_length = 0;
+
+  uint32_t count = compiler->num_rule_idx_locations -
+                   snapshot->num_rule_idx_locations;
+
+  if (count == 0)
+    return true;
+
+  artifact->rule_idxs = (YR_CACHE_RULE_IDX*) yr_malloc(
+      count * sizeof(YR_CACHE_RULE_IDX));
+
+  if (artifact->rule_idxs == NULL)
+    return false;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    YR_RULE_IDX_LOCATION* location =
+        &compiler
+             ->rule_idx_locations[snapshot->num_rule_idx_locations + i];
+
+    YR_CACHE_RULE_IDX* rule_idx = &artifact->rule_idxs[i];
+    yr_arena_off_t base = snapshot->offsets[location->ref.buffer_id];
+    uint64_t value;
+
+    if (location->ref.offset < base)
+      return false;
+
+    uint8_t* ptr = (uint8_t*) yr_arena_ref_to_ptr(
+        compiler->arena, &location->ref);
+
+    if (location->size == sizeof(uint32_t))
+    {
+      uint32_t value32;
+      memcpy(&value32, ptr, sizeof(value32));
+      value = value32;
+    }
+    else
+    {
+      memcpy(&value, ptr, sizeof(value));
+    }
+
+    rule_idx->buffer_id = location->ref.buffer_id;
+    rule_idx->offset = location->ref.offset - base;
+    rule_idx->size = location->size;
+    rule_idx->rule_name = UINT32_MAX;
+
+    artifact->num_rule_idxs++;
+
+    if (value == snapshot->next_rule_idx)
+      continue;
+
+    if (value >= snapshot->next_rule_idx)
+      return false;
+
+    YR_RULE* rule = _yr_compiler_get_rule_by_idx(compiler, (uint32_t) value);
+
+    if (rule->ns->idx != compiler->current_namespace_idx)
+      return false;
+
+    rule_idx->rule_name = (uint32_t) names_length;
+
+    if (_yr_compiler_cache_append(
+            (void**) &artifact->rule_names,
+            &names_length,
+            &max_names_length,
+            rule->identifier,
+            strlen(rule->identifier) + 1) != ERROR_SUCCESS)
+      return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates an artifact for the rule parsed since the snapshot was taken, and
+// adds it to the cache. If the rule can't be cached *artifact is NULL.
+//
+static int _yr_compiler_cache_extract(
+    YR_COMPILER* compiler,
+    YR_CACHE_SNAPSHOT* snapshot,
+    const uint8_t* key,
+    size_t key_length,
+    YR_CACHE_ARTIFACT** artifact)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+  YR_CACHE_ARTIFACT* new_artifact;
+
+  *artifact = NULL;
+
+  if (!_yr_compiler_cache_is_cacheable(compiler, snapshot))
+    return ERROR_SUCCESS;
+
+  new_artifact = (YR_CACHE_ARTIFACT*) yr_calloc(1, sizeof(YR_CACHE_ARTIFACT));
+
+  if (new_artifact == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  bool ok = true;
+
+  for (int i = 0; i < YR_NUM_SECTIONS && ok; i++)
+  {
+    yr_arena_off_t length = yr_arena_get_current_offset(compiler->arena, i) -
+                            snapshot->offsets[i];
+
+    if (length == 0)
+      continue;
+
+    new_artifact->data[i] = (uint8_t*) yr_malloc(length);
+    new_artifact->length[i] = length;
+
+    if (new_artifact->data[i] != NULL)
+      memcpy(
+          new_artifact->data[i],
+          yr_arena_get_ptr(compiler->arena, i, snapshot->offsets[i]),
+          length);
+    else
+      ok = false;
+  }
+
+  ok = ok && _yr_compiler_cache_extract_relocs(
+                 compiler, snapshot, new_artifact);
+
+  ok = ok && _yr_compiler_cache_extract_rule_idxs(
+                 compiler, snapshot, new_artifact);
+
+  // Units stored while parsing the rule are at the end of the index.
+  uint32_t num_own_units = cache->num_sz_units - snapshot->num_sz_units +
+                           cache->num_re_units - snapshot->num_re_units;
+
+  if (ok && num_own_units > 0)
+  {
+    new_artifact->own_units = (YR_CACHE_UNIT*) yr_calloc(
+        num_own_units, sizeof(YR_CACHE_UNIT));
+
+    ok = new_artifact->own_units != NULL;
+  }
+
+  for (uint32_t i = 0; i < num_own_units && ok; i++)
+  {
+    YR_CACHE_UNIT* unit = i < cache->num_sz_units - snapshot->num_sz_units
+                              ? &cache->sz_units[snapshot->num_sz_units + i]
+                              : &cache->re_units
+                                     [snapshot->num_re_units + i -
+                                      (cache->num_sz_units -
+                                       snapshot->num_sz_units)];
+
+    YR_CACHE_UNIT* own_unit = &new_artifact->own_units[i];
+
+    *own_unit = *unit;
+    own_unit->offset -= snapshot->offsets[unit->buffer_id];
+    own_unit->key = NULL;
+    new_artifact->num_own_units++;
+
+    if (unit->key != NULL)
+    {
+      own_unit->key = (uint8_t*) yr_malloc(unit->key_length);
+      ok = own_unit->key != NULL;
+
+      if (ok)
+        memcpy(own_unit->key, unit->key, unit->key_length);
+    }
+  }
+
+  YR_RULE* rule = _yr_compiler_get_rule_by_idx(
+      compiler, snapshot->next_rule_idx);
+
+  new_artifact->key = (uint8_t*) yr_malloc(key_length);
+  new_artifact->key_length = key_length;
+  new_artifact->identifier = yr_strdup(rule->identifier);
+
+  ok = ok && new_artifact->key != NULL && new_artifact->identifier != NULL;
+
+  if (ok)
+    memcpy(new_artifact->key, key, key_length);
+
+  if (ok && cache->called_functions_length > 0)
+  {
+    new_artifact->called_functions = (char*) yr_malloc(
+        cache->called_functions_length);
+
+    ok = new_artifact->called_functions != NULL;
+
+    if (ok)
+    {
+      memcpy(
+          new_artifact->called_functions,
+          cache->called_functions,
+          cache->called_functions_length);
+
+      new_artifact->called_functions_length = cache->called_functions_length;
+    }
+  }
+
+  new_artifact->num_paths = cache->num_paths - snapshot->num_paths;
+
+  if (ok && new_artifact->num_paths > 0)
+  {
+    new_artifact->paths = (YR_CACHE_PATH*) yr_malloc(
+        new_artifact->num_paths * sizeof(YR_CACHE_PATH));
+
+    ok = new_artifact->paths != NULL;
+
+    if (ok)
+      memcpy(
+          new_artifact->paths,
+          &cache->paths[snapshot->num_paths],
+          new_artifact->num_paths * sizeof(YR_CACHE_PATH));
+  }
+
+  // The messages are moved to the artifact.
+  if (ok && cache->num_messages > 0)
+  {
+    new_artifact->messages = (YR_CACHE_MESSAGE*) yr_malloc(
+        cache->num_messages * sizeof(YR_CACHE_MESSAGE));
+
+    ok = new_artifact->messages != NULL;
+
+    if (ok)
+    {
+      memcpy(
+          new_artifact->messages,
+          cache->messages,
+          cache->num_messages * sizeof(YR_CACHE_MESSAGE));
+
+      new_artifact->num_messages = cache->num_messages;
+      cache->num_messages = 0;
+    }
+  }
+
+  // Units of an artifact have offsets relative to the unit itself, the
+  // offsets in the compiler's arena were needed only while extracting.
+  for (uint32_t i = 0; i < new_artifact->num_units; i++)
+    new_artifact->units[i].offset = 0;
+
+  if (ok && yr_hash_table_add_raw_key(
+                cache->artifacts_table, key, key_length, NULL, new_artifact) !=
+                ERROR_SUCCESS)
+    ok = false;
+
+  if (!ok)
+  {
+    // Running out of memory while extracting the artifact is not an error,
+    // the rule has been added to the compiler anyways.
+    _yr_compiler_cache_artifact_destroy(new_artifact);
+    return ERROR_SUCCESS;
+  }
+
+  new_artifact->next = cache->artifacts;
+
+  if (cache->artifacts != NULL)
+    cache->artifacts->prev = new_artifact;
+
+  cache->artifacts = new_artifact;
+
+  *artifact = new_artifact;
+
+  return ERROR_SUCCESS;
+}
+
+static int _yr_compiler_cache_wildcard_iterator(
+    void* key,
+    size_t key_length,
+    void* value,
+    void* data)
+{
+  if (strncmp((const char*) key, (const char*) data, key_length) == 0)
+    return ERROR_IDENTIFIER_MATCHES_WILDCARD;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stores a unit referenced by an artifact if the compiler doesn't have it
+// already, and returns its offset.
+//
+static int _yr_compiler_cache_store_unit(
+    YR_COMPILER* compiler,
+    YR_CACHE_UNIT* unit,
+    yr_arena_off_t* offset)
+{
+  YR_ARENA_REF ref;
+
+  if (unit->buffer_id == YR_SZ_POOL)
+  {
+    FAIL_ON_ERROR(
+        _yr_compiler_store_data(compiler, unit->data, unit->length, &ref));
+
+    *offset = ref.offset;
+
+    return ERROR_SUCCESS;
+  }
+
+  *offset = yr_hash_table_lookup_uint32_raw_key(
+      compiler->regexps_table, unit->key, unit->key_length, NULL);
+
+  if (*offset != UINT32_MAX)
+    return ERROR_SUCCESS;
+
+  FAIL_ON_ERROR(yr_arena_write_data(
+      compiler->arena, YR_RE_CODE_SECTION, unit->data, unit->length, &ref));
+
+  FAIL_ON_ERROR(yr_hash_table_add_uint32_raw_key(
+      compiler->regexps_table, unit->key, unit->key_length, NULL, ref.offset));
+
+  FAIL_ON_ERROR(yr_hash_table_add_uint32_raw_key(
+      compiler->regexps_lengths,
+      unit->key,
+      unit->key_length,
+      NULL,
+      unit->length));
+
+  FAIL_ON_ERROR(_yr_compiler_cache_add_unit(
+      compiler,
+      YR_RE_CODE_SECTION,
+      unit->key,
+      unit->key_length,
+      ref.offset,
+      unit->length));
+
+  *offset = ref.offset;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Registers a unit stored by an artifact that has been copied to the
+// compiler's arena, unless the compiler has the same unit somewhere else.
+//
+static int _yr_compiler_cache_register_unit(
+    YR_COMPILER* compiler,
+    YR_CACHE_UNIT* unit,
+    yr_arena_off_t offset)
+{
+  const void* key = unit->key;
+
+  if (unit->buffer_id == YR_SZ_POOL)
+  {
+    key = yr_arena_get_ptr(compiler->arena, YR_SZ_POOL, offset);
+
+    if (yr_hash_table_lookup_uint32_raw_key(
+            compiler->sz_table, key, unit->key_length, NULL) != UINT32_MAX)
+      return ERROR_SUCCESS;
+
+    FAIL_ON_ERROR(yr_hash_table_add_uint32_raw_key(
+        compiler->sz_table, key, unit->key_length, NULL, offset));
+  }
+  else
+  {
+    if (yr_hash_table_lookup_uint32_raw_key(
+            compiler->regexps_table, key, unit->key_length, NULL) !=
+        UINT32_MAX)
+      return ERROR_SUCCESS;
+
+    FAIL_ON_ERROR(yr_hash_table_add_uint32_raw_key(
+        compiler->regexps_table, key, unit->key_length, NULL, offset));
+
+    FAIL_ON_ERROR(yr_hash_table_add_uint32_raw_key(
+        compiler->regexps_lengths, key, unit->key_length, NULL, unit->length));
+  }
+
+  return _yr_compiler_cache_add_unit(
+      compiler, unit->buffer_id, key, unit->key_length, offset, unit->length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds the rule in an artifact to the compiler, with the same result as
+// parsing the rule. If the rule would be compiled differently, for instance
+// because some other rule that it references doesn't exist anymore, or it
+// would produce an error, the compiler is not modified and *applied is false.
+//
+static int _yr_compiler_cache_apply(
+    YR_COMPILER* compiler,
+    YR_CACHE_ARTIFACT* artifact,
+    int first_line,
+    bool* applied)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+  YR_ARENA* arena = compiler->arena;
+
+  yr_arena_off_t base[YR_NUM_SECTIONS];
+  yr_arena_off_t* unit_offsets = NULL;
+
+  uint32_t rule_idx = compiler->next_rule_idx;
+  int result = ERROR_SUCCESS;
+
+  YR_NAMESPACE* ns = (YR_NAMESPACE*) yr_arena_get_ptr(
+      arena,
+      YR_NAMESPACES_TABLE,
+      compiler->current_namespace_idx * sizeof(struct YR_NAMESPACE));
+
+  *applied = false;
+
+  // These are the checks made by yr_parser_reduce_rule_declaration_phase_1.
+  // An artifact can be used only once in each compilation because its
+  // matches can be in a single place of the automaton.
+  if (artifact->build == cache->build ||
+      yr_hash_table_lookup_uint32(
+          compiler->rules_table, artifact->identifier, ns->name) !=
+          UINT32_MAX ||
+      yr_hash_table_lookup(
+          compiler->objects_table, artifact->identifier, NULL) != NULL ||
+      yr_hash_table_iterate(
+          compiler->wildcard_identifiers_table,
+          ns->name,
+          _yr_compiler_cache_wildcard_iterator,
+          artifact->identifier) != ERROR_SUCCESS)
+    return ERROR_SUCCESS;
+
+  for (uint32_t i = 0; i < artifact->num_rule_idxs; i++)
+  {
+    if (artifact->rule_idxs[i].rule_name != UINT32_MAX &&
+        yr_hash_table_lookup_uint32(
+            compiler->rules_table,
+            artifact->rule_names + artifact->rule_idxs[i].rule_name,
+            ns->name) == UINT32_MAX)
+      return ERROR_SUCCESS;
+  }
+
+  *applied = true;
+
+  if (artifact->num_units > 0)
+  {
+    unit_offsets = (yr_arena_off_t*) yr_malloc(
+        artifact->num_units * sizeof(yr_arena_off_t));
+
+    if (unit_offsets == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+  }
+
+  // The units referenced by the rule that the compiler doesn't have yet are
+  // stored before the rule's data, as the parser would have done.
+  for (uint32_t i = 0; i < artifact->num_units; i++)
+    GOTO_EXIT_ON_ERROR(_yr_compiler_cache_store_unit(
+        compiler, &artifact->units[i], &unit_offsets[i]));
+
+  for (int i = 0; i < YR_NUM_SECTIONS; i++)
+  {
+    YR_ARENA_REF ref;
+
+    base[i] = yr_arena_get_current_offset(arena, i);
+
+    if (artifact->length[i] == 0)
+      continue;
+
+    // The memory is allocated zeroed, like yr_arena_allocate_struct does, so
+    // that the padding in structures allocated later is zero.
+    GOTO_EXIT_ON_ERROR(yr_arena_allocate_zeroed_memory(
+        arena, i, artifact->length[i], &ref));
+
+    memcpy(
+        yr_arena_ref_to_ptr(arena, &ref),
+        artifact->data[i],
+        artifact->length[i]);
+  }
+
+  for (uint32_t i = 0; i < artifact->num_own_units; i++)
+  {
+    YR_CACHE_UNIT* unit = &artifact->own_units[i];
+
+    GOTO_EXIT_ON_ERROR(_yr_compiler_cache_register_unit(
+        compiler, unit, base[unit->buffer_id] + unit->offset));
+  }
+
+  // From here on nothing is written to the arena, so pointers to its data
+  // remain valid.
+  for (uint32_t i = 0; i < artifact->num_relocs; i++)
+  {
+    YR_CACHE_RELOC* r = &artifact->relocs[i];
+    void* ptr = NULL;
+
+    switch (r->type)
+    {
+    case YR_CACHE_RELOC_INTERNAL:
+      ptr = yr_arena_get_ptr(
+          arena, r->target_id, base[r->target_id] + r->target_offset);
+      break;
+
+    case YR_CACHE_RELOC_NAMESPACE:
+      ptr = ns;
+      break;
+
+    case YR_CACHE_RELOC_UNIT:
+      ptr = yr_arena_get_ptr(
+          arena,
+          artifact->units[r->target_id].buffer_id,
+          unit_offsets[r->target_id] + r->target_offset);
+      break;
+    }
+
+    GOTO_EXIT_ON_ERROR(yr_arena_make_ptr_relocatable(
+        arena, r->buffer_id, (size_t) (base[r->buffer_id] + r->offset), EOL));
+
+    memcpy(
+        yr_arena_get_ptr(arena, r->buffer_id, base[r->buffer_id] + r->offset),
+        &ptr,
+        sizeof(ptr));
+  }
+
+  for (uint32_t i = 0; i < artifact->num_rule_idxs; i++)
+  {
+    YR_CACHE_RULE_IDX* r = &artifact->rule_idxs[i];
+    YR_ARENA_REF ref;
+    uint32_t value = rule_idx;
+
+    if (r->rule_name != UINT32_MAX)
+      value = yr_hash_table_lookup_uint32(
+          compiler->rules_table, artifact->rule_names + r->rule_name, ns->name);
+
+    ref.buffer_id = r->buffer_id;
+    ref.offset = base[r->buffer_id] + r->offset;
+
+    uint8_t* ptr = (uint8_t*) yr_arena_ref_to_ptr(arena, &ref);
+
+    if (r->size == sizeof(uint32_t))
+    {
+      memcpy(ptr, &value, sizeof(value));
+    }
+    else
+    {
+      uint64_t value64 = value;
+      memcpy(ptr, &value64, sizeof(value64));
+    }
+
+    GOTO_EXIT_ON_ERROR(
+        _yr_compiler_add_rule_idx_location(compiler, &ref, r->size));
+  }
+
+  uint32_t num_strings = artifact->length[YR_STRINGS_TABLE] / sizeof(YR_STRING);
+
+  YR_STRING* string = (YR_STRING*) yr_arena_get_ptr(
+      arena, YR_STRINGS_TABLE, base[YR_STRINGS_TABLE]);
+
+  for (uint32_t i = 0; i < num_strings; i++, string++)
+  {
+    string->idx = compiler->current_string_idx + i;
+    string->rule_idx = rule_idx;
+  }
+
+  GOTO_EXIT_ON_ERROR(yr_hash_table_add_uint32(
+      compiler->rules_table, artifact->identifier, ns->name, rule_idx));
+
+  compiler->next_rule_idx++;
+  compiler->current_string_idx += num_strings;
+  compiler->current_meta_idx += artifact->length[YR_METAS_TABLE] /
+                                sizeof(YR_META);
+
+  for (size_t i = 0; i < artifact->called_functions_length;)
+  {
+    const char* identifier = artifact->called_functions + i;
+
+    GOTO_EXIT_ON_ERROR(_yr_compiler_add_called_function(compiler, identifier));
+
+    i += strlen(identifier) + 1;
+  }
+
+  GOTO_EXIT_ON_ERROR(_yr_compiler_cache_add_matches(
+      cache,
+      artifact,
+      base[YR_AC_STATE_MATCHES_POOL] / sizeof(YR_AC_MATCH),
+      artifact->num_paths,
+      0));
+
+  artifact->build = cache->build;
+
+  for (uint32_t i = 0; i < artifact->num_messages && cache->callback != NULL;
+       i++)
+  {
+    YR_CACHE_MESSAGE* m = &artifact->messages[i];
+
+    cache->callback(
+        m->error_level,
+        yr_compiler_get_current_file_name(compiler),
+        first_line + m->line_number,
+        m->own_rule ? _yr_compiler_get_rule_by_idx(compiler, rule_idx) : NULL,
+        m->message,
+        cache->user_data);
+  }
+
+_exit:
+
+  yr_free(unit_offsets);
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds a rule to the compiler, taking it from the cache if possible. The rule
+// is added to the cache otherwise. Returns the number of errors.
+//
+static int _yr_compiler_cache_add_rule(
+    YR_COMPILER* compiler,
+    const uint8_t* data,
+    size_t size,
+    int line)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+  YR_CACHE_ARTIFACT* artifact;
+  YR_CACHE_SNAPSHOT snapshot;
+
+  size_t key_length = 0;
+  bool applied;
+  int result = ERROR_SUCCESS;
+
+  if (cache->context_length == 0)
+    result = _yr_compiler_cache_update_context(compiler);
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_compiler_cache_append(
+        (void**) &cache->key,
+        &key_length,
+        &cache->max_key_length,
+        cache->context,
+        cache->context_length);
+
+  if (result == ERROR_SUCCESS)
+    result = _yr_compiler_cache_append(
+        (void**) &cache->key, &key_length, &cache->max_key_length, data, size);
+
+  if (result != ERROR_SUCCESS)
+  {
+    compiler->last_error = result;
+    return 1;
+  }
+
+  artifact = (YR_CACHE_ARTIFACT*) yr_hash_table_lookup_raw_key(
+      cache->artifacts_table, cache->key, key_length, NULL);
+
+  if (artifact != NULL)
+  {
+    result = _yr_compiler_cache_apply(compiler, artifact, line, &applied);
+
+    if (result != ERROR_SUCCESS)
+    {
+      compiler->last_error = result;
+      return 1;
+    }
+
+    if (applied)
+      return 0;
+
+    // The rule is parsed as usual, most likely producing some error.
+    return _yr_compiler_cache_parse(compiler, data, size, line);
+  }
+
+  _yr_compiler_cache_take_snapshot(compiler, &snapshot);
+
+  cache->capture = true;
+  cache->capture_line = line;
+  cache->capture_result = ERROR_SUCCESS;
+  cache->called_functions_length = 0;
+
+  int errors = yr_lex_parse_rules_bytes(data, size, line, compiler);
+
+  cache->capture = false;
+
+  if (errors == 0)
+    result = _yr_compiler_cache_extract(
+        compiler, &snapshot, cache->key, key_length, &artifact);
+
+  if (result == ERROR_SUCCESS && artifact != NULL)
+  {
+    artifact->build = cache->build;
+
+    result = _yr_compiler_cache_add_matches(
+        cache,
+        artifact,
+        snapshot.offsets[YR_AC_STATE_MATCHES_POOL] / sizeof(YR_AC_MATCH),
+        artifact->num_paths,
+        0);
+  }
+  else if (result == ERROR_SUCCESS)
+  {
+    result = _yr_compiler_cache_add_matches(
+        cache,
+        NULL,
+        snapshot.offsets[YR_AC_STATE_MATCHES_POOL] / sizeof(YR_AC_MATCH),
+        cache->num_paths - snapshot.num_paths,
+        snapshot.num_paths);
+  }
+
+  _yr_compiler_cache_free_messages(cache->messages, cache->num_messages);
+  cache->num_messages = 0;
+
+  if (compiler->objects_table->num_entries != snapshot.num_objects)
+    cache->context_length = 0;
+
+  if (result != ERROR_SUCCESS && errors == 0)
+  {
+    compiler->last_error = result;
+    errors = 1;
+  }
+
+  return errors;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds rules to a compiler that uses a cache, this is what the
+// yr_compiler_add_XXXX functions do in that case. Returns the number of
+// errors.
+//
+int _yr_compiler_cache_add_bytes(
+    YR_COMPILER* compiler,
+    const void* rules_data,
+    size_t rules_size,
+    const char* namespace_,
+    const char* file_name)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+  YR_CACHE_ITEM item;
+
+  const uint8_t* data = (const uint8_t*) rules_data;
+  size_t offset = 0;
+  int line = 1;
+  int errors = 0;
+
+  if (namespace_ != NULL)
+    compiler->last_error = _yr_compiler_set_namespace(compiler, namespace_);
+  else
+    compiler->last_error = _yr_compiler_set_namespace(compiler, "default");
+
+  if (compiler->last_error == ERROR_SUCCESS && file_name != NULL)
+    compiler->last_error = _yr_compiler_push_file_name(compiler, file_name);
+
+  if (compiler->last_error != ERROR_SUCCESS)
+    return ++compiler->errors;
+
+  cache->callback = compiler->callback;
+  cache->user_data = compiler->user_data;
+  cache->context_length = 0;
+
+  compiler->callback = _yr_compiler_cache_callback;
+  compiler->user_data = compiler;
+
+  // The callback for regexp ASTs must be called for every rule, which is not
+  // possible for rules taken from the cache.
+  if (compiler->re_ast_callback != NULL)
+  {
+    errors = _yr_compiler_cache_parse(compiler, data, rules_size, line);
+    offset = rules_size;
+  }
+
+  while (offset < rules_size && errors == 0)
+  {
+    _yr_compiler_cache_next_item(data, rules_size, &offset, &line, &item);
+
+    if (item.type == YR_CACHE_ITEM_NONE)
+      break;
+
+    if (item.type == YR_CACHE_ITEM_RULE)
+      errors = _yr_compiler_cache_add_rule(
+          compiler, data + item.start, item.end - item.start, item.line);
+    else
+      errors = _yr_compiler_cache_parse(
+          compiler, data + item.start, item.end - item.start, item.line);
+
+    // After an error the parser keeps going in order to find more errors,
+    // as it does when the rules are parsed at once.
+    if (errors > 0 && offset < rules_size)
+      errors += _yr_compiler_cache_parse(
+          compiler, data + offset, rules_size - offset, line);
+  }
+
+  compiler->callback = cache->callback;
+  compiler->user_data = cache->user_data;
+  compiler->errors = errors;
+
+  if (file_name != NULL)
+    _yr_compiler_pop_file_name(compiler);
+
+  return errors;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Updates the cache's automaton with the matches of the rules added to the
+// compiler, and writes its tables to the compiler's arena. This is what
+// _yr_compiler_compile_rules does instead of calling yr_ac_compile when the
+// compiler uses a cache.
+//
+int _yr_compiler_cache_write_automaton(YR_COMPILER* compiler)
+{
+  YR_COMPILER_CACHE* cache = compiler->cache;
+  YR_CACHE_ARTIFACT* artifact = cache->artifacts;
+
+  int result = ERROR_SUCCESS;
+
+  // Artifacts that the compiler didn't use are removed from the cache, and
+  // their matches from the automaton.
+  while (artifact != NULL && result == ERROR_SUCCESS)
+  {
+    YR_CACHE_ARTIFACT* next = artifact->next;
+
+    if (artifact->build != cache->build)
+      result = _yr_compiler_cache_evict(cache, artifact);
+
+    artifact = next;
+  }
+
+  for (uint32_t i = 0; i < cache->num_transient_ids && result == ERROR_SUCCESS;
+       i++)
+    result = yr_ac_remove_match(cache->automaton, cache->transient_ids[i]);
+
+  cache->num_live_matches -= cache->num_transient_ids;
+  cache->num_removed_matches += cache->num_transient_ids;
+  cache->num_transient_ids = 0;
+
+  if (result != ERROR_SUCCESS ||
+      (cache->num_removed_matches > YR_CACHE_MIN_REMOVED_MATCHES &&
+       cache->num_removed_matches > cache->num_live_matches))
+    _yr_compiler_cache_reset_automaton(cache);
+
+  if (cache->automaton == NULL)
+    GOTO_EXIT_ON_ERROR(yr_ac_automaton_create_patchable(&cache->automaton));
+
+  for (uint32_t i = 0; i < cache->num_matches; i++)
+  {
+    YR_CACHE_MATCHES* matches = &cache->matches[i];
+    YR_CACHE_PATH* paths = &cache->paths[matches->first_path];
+    uint32_t* ids = NULL;
+
+    artifact = matches->artifact;
+
+    if (artifact != NULL)
+    {
+      paths = artifact->paths;
+      ids = artifact->match_ids;
+    }
+
+    for (uint32_t j = 0; j < matches->num_matches; j++)
+    {
+      uint32_t id;
+
+      if (ids != NULL)
+      {
+        id = ids[j];
+      }
+      else
+      {
+        GOTO_EXIT_ON_ERROR(yr_ac_add_match(
+            cache->automaton, paths[j].bytes, paths[j].length, &id));
+
+        cache->num_live_matches++;
+
+        if (artifact != NULL)
+        {
+          if (artifact->match_ids == NULL)
+          {
+            artifact->match_ids = (uint32_t*) yr_malloc(
+                artifact->num_paths * sizeof(uint32_t));
+
+            if (artifact->match_ids == NULL)
+            {
+              // The match was added, but it's not recorded anywhere.
+              _yr_compiler_cache_reset_automaton(cache);
+              GOTO_EXIT_ON_ERROR(ERROR_INSUFFICIENT_MEMORY);
+            }
+          }
+
+          artifact->match_ids[j] = id;
+        }
+        else
+        {
+          GOTO_EXIT_ON_ERROR(_yr_compiler_cache_grow(
+              (void**) &cache->transient_ids,
+              &cache->max_transient_ids,
+              cache->num_transient_ids,
+              sizeof(uint32_t)));
+
+          cache->transient_ids[cache->num_transient_ids++] = id;
+        }
+      }
+
+      if (id >= cache->max_pool_indexes)
+      {
+        uint32_t max = yr_max(id + 1, cache->max_pool_indexes * 2);
+
+        uint32_t* pool_indexes = (uint32_t*) yr_realloc(
+            cache->pool_indexes, max * sizeof(uint32_t));
+
+        if (pool_indexes == NULL)
+          GOTO_EXIT_ON_ERROR(ERROR_INSUFFICIENT_MEMORY);
+
+        cache->pool_indexes = pool_indexes;
+        cache->max_pool_indexes = max;
+      }
+
+      cache->pool_indexes[id] = matches->pool_index + j;
+    }
+  }
+
+  GOTO_EXIT_ON_ERROR(yr_ac_patch(cache->automaton));
+
+  GOTO_EXIT_ON_ERROR(yr_ac_write_tables(
+      cache->automaton, compiler->arena, cache->pool_indexes));
+
+  for (int i = 0; i < YR_NUM_SECTIONS; i++)
+    cache->buffer_sizes[i] = yr_arena_get_current_offset(compiler->arena, i);
+
+  cache->num_rules = compiler->rules_table->num_entries;
+  cache->num_sz_entries = compiler->sz_table->num_entries;
+  cache->num_regexps = compiler->regexps_table->num_entries;
+
+_exit:
+
+  // If something failed the automaton could be inconsistent.
+  if (result != ERROR_SUCCESS)
+    _yr_compiler_cache_reset_automaton(cache);
+
+  return result;
+}
@@ -42,6 +42,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/modules.h>
 #include <yara/object.h>
 #include <yara/re.h>
+#include <yara/scan.h>
 #include <yara/sizedstr.h>
 #include <yara/stopwatch.h>
 #include <yara/strutils.h>
@@ -97,6 +98,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     }                                                             \
   }
 
+#define ensure_match_index(s, x)                                  \
+  if (yr_scan_get_match_index(context, s, &x) != ERROR_SUCCESS) \
+  {                                                             \
+    stop = true;                                                \
+    result = ERROR_INSUFFICIENT_MEMORY;                         \
+    break;                                                      \
+  }
+
 #define check_object_canary(o)           \
   if (o->canary != context->canary)      \
   {                                      \
@@ -105,6 +114,48 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     break;                               \
   }
 
+// With GCC and Clang instructions are dispatched using computed gotos
+// ("labels as values"). Each instruction ends by jumping directly to the code
+// of the next one through dispatch_table, instead of going back to the top of
+// the loop and through the switch statement. That saves a couple of branches
+// per instruction and gives each instruction its own indirect jump, which is
+// easier to predict for the CPU than the single jump of the switch. With other
+// compilers, or when YR_EXEC_NO_COMPUTED_GOTO is defined, the switch is used.
+//
+// Instructions that end with "break", like the error paths in the macros
+// above, go back to the top of the loop, where "stop" and the timeout are
+// checked as usual. next_instruction also goes that way when stop is true or
+// when the timeout must be checked in this cycle.
+#if defined(__GNUC__) && !defined(YR_EXEC_NO_COMPUTED_GOTO)
+#define YR_EXEC_COMPUTED_GOTO 1
+#else
+#define YR_EXEC_COMPUTED_GOTO 0
+#endif
+
+#if YR_EXEC_COMPUTED_GOTO
+
+#define opcode_case(op) \
+  case op:              \
+  label_##op
+
+#define dispatch_entry(op) [op] = &&label_##op
+
+#define next_instruction()                              \
+  if (stop || (context->timeout > 0ULL && cycle == 99)) \
+    break;                                              \
+  if (context->timeout > 0ULL)                          \
+    cycle++;                                            \
+  opcode = *ip++;                                       \
+  goto *dispatch_table[opcode]
+
+#else
+
+#define opcode_case(op) case op
+
+#define next_instruction() break
+
+#endif
+
 #define little_endian_uint8_t(x)  (x)
 #define little_endian_int8_t(x)   (x)
 #define little_endian_uint16_t(x) yr_le16toh(x)
@@ -326,11 +377,165 @@ static int iter_int_enum_next(YR_ITERATOR* self, YR_VALUE_STACK* stack)
   return ERROR_SUCCESS;
 }
 
-int yr_execute_code(YR_SCAN_CONTEXT* context)
+////////////////////////////////////////////////////////////////////////////////
+// Returns the position of the first match in "index" with an offset greater
+// than or equal to "offset", or "count" if there's no such match. "index" is
+// an array of "count" matches sorted by offset, see yr_scan_get_match_index.
+//
+static int32_t _yr_match_lower_bound(
+    YR_MATCH** index,
+    int32_t count,
+    int64_t offset)
 {
-  YR_DEBUG_FPRINTF(2, stderr, "+ %s() {\n", __FUNCTION__);
+  int32_t lo = 0;
+  int32_t hi = count;
+
+  while (lo < hi)
+  {
+    int32_t mid = lo + (hi - lo) / 2;
+
+    if (index[mid]->base + index[mid]->offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Calls a prototype of a module function and returns in "result_obj" the
+// object holding the result. For most functions this is the function's
+// return_obj, which is overwritten by the next call to the same function.
+//
+// Results of pure functions (see FUNCTION_FLAGS_PURE) are kept in "results",
+// a hash table created on the first call to a pure function, where the key
+// is the function's address, the prototype and the values of the arguments.
+// If the same call was done before, the function is not called again and the
+// existing result is returned. Otherwise the function is called and a copy of
+// its return_obj is put in the table, which owns it. The table is limited to
+// YR_MAX_PURE_FUNCTION_RESULTS entries, "num_results" is the number of entries
+// already in it. Once the limit is reached new results are not remembered, so
+// loops calling a function with a different argument on each iteration don't
+// make lookups slower and slower.
+//
+static int _yr_execute_call(
+    YR_SCAN_CONTEXT* context,
+    YR_OBJECT_FUNCTION* function,
+    int32_t prototype_idx,
+    YR_VALUE* args,
+    int32_t num_args,
+    YR_HASH_TABLE** results,
+    int* num_results,
+    YR_OBJECT** result_obj)
+{
+  const char* args_fmt = function->prototypes[prototype_idx].arguments_fmt;
+  YR_MODULE_FUNC code = function->prototypes[prototype_idx].code;
+
+  uint8_t buffer[256];
+  uint8_t* key = buffer;
+  size_t key_length;
+  size_t offset;
+
+  YR_OBJECT* copy;
+
+  int result = ERROR_SUCCESS;
+
+  if (!(function->prototypes[prototype_idx].flags & FUNCTION_FLAGS_PURE))
+  {
+    *result_obj = function->return_obj;
+    return code(args, context, function);
+  }
+
+  // Strings are put in the key by value, preceded by their length. The other
+  // arguments (integers, floats, booleans and regexps) are put as they are in
+  // the YR_VALUE.
+  key_length = sizeof(function) + sizeof(prototype_idx);
+
+  for (int i = 0; i < num_args; i++)
+  {
+    if (args_fmt[i] == 's')
+      key_length += sizeof(args[i].ss->length) + args[i].ss->length;
+    else
+      key_length += sizeof(YR_VALUE);
+  }
+
+  if (key_length > sizeof(buffer))
+    key = (uint8_t*) yr_malloc(key_length);
+
+  if (key == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  memcpy(key, &function, sizeof(function));
+  memcpy(key + sizeof(function), &prototype_idx, sizeof(prototype_idx));
+
+  offset = sizeof(function) + sizeof(prototype_idx);
 
-  const uint8_t* ip = context->rules->code_start;
+  for (int i = 0; i < num_args; i++)
+  {
+    if (args_fmt[i] == 's')
+    {
+      memcpy(key + offset, &args[i].ss->length, sizeof(args[i].ss->length));
+      offset += sizeof(args[i].ss->length);
+      memcpy(key + offset, args[i].ss->c_string, args[i].ss->length);
+      offset += args[i].ss->length;
+    }
+    else
+    {
+      memcpy(key + offset, &args[i], sizeof(YR_VALUE));
+      offset += sizeof(YR_VALUE);
+    }
+  }
+
+  if (*results == NULL)
+    result = yr_hash_table_create(YR_MAX_PURE_FUNCTION_RESULTS / 2, results);
+
+  if (result == ERROR_SUCCESS)
+  {
+    *result_obj = (YR_OBJECT*) yr_hash_table_lookup_raw_key(
+        *results, key, key_length, NULL);
+
+    if (*result_obj == NULL && *num_results >= YR_MAX_PURE_FUNCTION_RESULTS)
+    {
+      *result_obj = function->return_obj;
+      result = code(args, context, function);
+    }
+    else if (*result_obj == NULL)
+    {
+      result = code(args, context, function);
+
+      if (result == ERROR_SUCCESS)
+        result = yr_object_copy(function->return_obj, &copy);
+
+      if (result == ERROR_SUCCESS)
+      {
+        result = yr_hash_table_add_raw_key(
+            *results, key, key_length, NULL, copy);
+
+        if (result == ERROR_SUCCESS)
+        {
+          *result_obj = copy;
+          (*num_results)++;
+        }
+        else
+          yr_object_destroy(copy);
+      }
+    }
+  }
+
+  if (key != buffer)
+    yr_free(key);
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Executes the code starting at "ip" until an OP_HALT instruction is found.
+// See yr_execute_code and yr_execute_guards.
+//
+static int _yr_execute_code(YR_SCAN_CONTEXT* context, const uint8_t* ip)
+{
+  YR_DEBUG_FPRINTF(2, stderr, "+ %s() {\n", __FUNCTION__);
 
   YR_VALUE mem[MEM_SIZE];
   YR_VALUE args[YR_MAX_FUNCTION_ARGS];
@@ -351,13 +556,21 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
   YR_RULE* current_rule = NULL;
   YR_RULE* rule;
   YR_MATCH* match;
+  YR_MATCH** match_index;
+  YR_STRING* string;
   YR_OBJECT_FUNCTION* function;
   YR_OBJECT** obj_ptr;
   YR_ARENA* obj_arena;
   YR_NOTEBOOK* it_notebook;
+  YR_HASH_TABLE* results = NULL;
+  int num_results = 0;
 
   char* identifier;
-  char* args_fmt;
+
+  int32_t num_args;
+  int32_t prototype_idx;
+  int32_t num_matches;
+  int32_t pos;
 
   int found;
   int count;
@@ -369,6 +582,131 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
   uint8_t opcode;
 
+#if YR_EXEC_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+  // Entries for opcodes that don't exist point to the "default" case, the
+  // remaining ones point to the code of the corresponding instruction.
+  static const void* dispatch_table[256] = {
+      [0 ... 255] = &&label_unknown,
+      dispatch_entry(OP_NOP),
+      dispatch_entry(OP_HALT),
+      dispatch_entry(OP_ITER_START_ARRAY),
+      dispatch_entry(OP_ITER_START_DICT),
+      dispatch_entry(OP_ITER_START_INT_RANGE),
+      dispatch_entry(OP_ITER_START_INT_ENUM),
+      dispatch_entry(OP_ITER_NEXT),
+      dispatch_entry(OP_PUSH),
+      dispatch_entry(OP_PUSH_8),
+      dispatch_entry(OP_PUSH_16),
+      dispatch_entry(OP_PUSH_32),
+      dispatch_entry(OP_PUSH_U),
+      dispatch_entry(OP_POP),
+      dispatch_entry(OP_CLEAR_M),
+      dispatch_entry(OP_ADD_M),
+      dispatch_entry(OP_INCR_M),
+      dispatch_entry(OP_PUSH_M),
+      dispatch_entry(OP_POP_M),
+      dispatch_entry(OP_SET_M),
+      dispatch_entry(OP_SWAPUNDEF),
+      dispatch_entry(OP_JNUNDEF),
+      dispatch_entry(OP_JUNDEF_P),
+      dispatch_entry(OP_JL_P),
+      dispatch_entry(OP_JLE_P),
+      dispatch_entry(OP_JTRUE),
+      dispatch_entry(OP_JTRUE_P),
+      dispatch_entry(OP_JFALSE),
+      dispatch_entry(OP_JFALSE_P),
+      dispatch_entry(OP_JZ),
+      dispatch_entry(OP_JZ_P),
+      dispatch_entry(OP_AND),
+      dispatch_entry(OP_OR),
+      dispatch_entry(OP_NOT),
+      dispatch_entry(OP_DEFINED),
+      dispatch_entry(OP_MOD),
+      dispatch_entry(OP_SHR),
+      dispatch_entry(OP_SHL),
+      dispatch_entry(OP_BITWISE_NOT),
+      dispatch_entry(OP_BITWISE_AND),
+      dispatch_entry(OP_BITWISE_OR),
+      dispatch_entry(OP_BITWISE_XOR),
+      dispatch_entry(OP_PUSH_RULE),
+      dispatch_entry(OP_INIT_RULE),
+      dispatch_entry(OP_MATCH_RULE),
+      dispatch_entry(OP_GUARD_RULE),
+      dispatch_entry(OP_OBJ_LOAD),
+      dispatch_entry(OP_OBJ_FIELD),
+      dispatch_entry(OP_OBJ_VALUE),
+      dispatch_entry(OP_INDEX_ARRAY),
+      dispatch_entry(OP_LOOKUP_DICT),
+      dispatch_entry(OP_CALL),
+      dispatch_entry(OP_FOUND),
+      dispatch_entry(OP_FOUND_AT),
+      dispatch_entry(OP_FOUND_IN),
+      dispatch_entry(OP_COUNT),
+      dispatch_entry(OP_COUNT_IN),
+      dispatch_entry(OP_OFFSET),
+      dispatch_entry(OP_LENGTH),
+      dispatch_entry(OP_OF),
+      dispatch_entry(OP_OF_PERCENT),
+      dispatch_entry(OP_OF_FOUND_IN),
+      dispatch_entry(OP_FILESIZE),
+      dispatch_entry(OP_ENTRYPOINT),
+      dispatch_entry(OP_INT8),
+      dispatch_entry(OP_INT16),
+      dispatch_entry(OP_INT32),
+      dispatch_entry(OP_UINT8),
+      dispatch_entry(OP_UINT16),
+      dispatch_entry(OP_UINT32),
+      dispatch_entry(OP_INT8BE),
+      dispatch_entry(OP_INT16BE),
+      dispatch_entry(OP_INT32BE),
+      dispatch_entry(OP_UINT8BE),
+      dispatch_entry(OP_UINT16BE),
+      dispatch_entry(OP_UINT32BE),
+      dispatch_entry(OP_IMPORT),
+      dispatch_entry(OP_MATCHES),
+      dispatch_entry(OP_INT_TO_DBL),
+      dispatch_entry(OP_STR_TO_BOOL),
+      dispatch_entry(OP_INT_EQ),
+      dispatch_entry(OP_INT_NEQ),
+      dispatch_entry(OP_INT_LT),
+      dispatch_entry(OP_INT_GT),
+      dispatch_entry(OP_INT_LE),
+      dispatch_entry(OP_INT_GE),
+      dispatch_entry(OP_INT_ADD),
+      dispatch_entry(OP_INT_SUB),
+      dispatch_entry(OP_INT_MUL),
+      dispatch_entry(OP_INT_DIV),
+      dispatch_entry(OP_INT_MINUS),
+      dispatch_entry(OP_DBL_LT),
+      dispatch_entry(OP_DBL_GT),
+      dispatch_entry(OP_DBL_LE),
+      dispatch_entry(OP_DBL_GE),
+      dispatch_entry(OP_DBL_EQ),
+      dispatch_entry(OP_DBL_NEQ),
+      dispatch_entry(OP_DBL_ADD),
+      dispatch_entry(OP_DBL_SUB),
+      dispatch_entry(OP_DBL_MUL),
+      dispatch_entry(OP_DBL_DIV),
+      dispatch_entry(OP_DBL_MINUS),
+      dispatch_entry(OP_STR_EQ),
+      dispatch_entry(OP_STR_NEQ),
+      dispatch_entry(OP_STR_LT),
+      dispatch_entry(OP_STR_LE),
+      dispatch_entry(OP_STR_GT),
+      dispatch_entry(OP_STR_GE),
+      dispatch_entry(OP_CONTAINS),
+      dispatch_entry(OP_ICONTAINS),
+      dispatch_entry(OP_STARTSWITH),
+      dispatch_entry(OP_ISTARTSWITH),
+      dispatch_entry(OP_ENDSWITH),
+      dispatch_entry(OP_IENDSWITH),
+      dispatch_entry(OP_IEQUALS),
+  };
+#pragma GCC diagnostic pop
+#endif
+
   yr_get_configuration_uint32(YR_CONFIG_STACK_SIZE, &stack.capacity);
 
   stack.sp = 0;
@@ -404,17 +742,17 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
     switch (opcode)
     {
-    case OP_NOP:
+    opcode_case(OP_NOP):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_NOP: // %s()\n", __FUNCTION__);
-      break;
+      next_instruction();
 
-    case OP_HALT:
+    opcode_case(OP_HALT):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_HALT: // %s()\n", __FUNCTION__);
       assert(stack.sp == 0);  // When HALT is reached the stack should be empty.
       stop = true;
-      break;
+      next_instruction();
 
-    case OP_ITER_START_ARRAY:
+    opcode_case(OP_ITER_START_ARRAY):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_ITER_START_ARRAY: // %s()\n", __FUNCTION__);
       r2.p = yr_notebook_alloc(it_notebook, sizeof(YR_ITERATOR));
@@ -433,9 +771,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       stop = (result != ERROR_SUCCESS);
-      break;
+      next_instruction();
 
-    case OP_ITER_START_DICT:
+    opcode_case(OP_ITER_START_DICT):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_ITER_START_DICT: // %s()\n", __FUNCTION__);
       r2.p = yr_notebook_alloc(it_notebook, sizeof(YR_ITERATOR));
@@ -454,9 +792,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       stop = (result != ERROR_SUCCESS);
-      break;
+      next_instruction();
 
-    case OP_ITER_START_INT_RANGE:
+    opcode_case(OP_ITER_START_INT_RANGE):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_ITER_START_INT_RANGE: // %s()\n", __FUNCTION__);
       // Creates an iterator for an integer range. The higher bound of the
@@ -478,9 +816,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       stop = (result != ERROR_SUCCESS);
-      break;
+      next_instruction();
 
-    case OP_ITER_START_INT_ENUM:
+    opcode_case(OP_ITER_START_INT_ENUM):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_ITER_START_INT_ENUM: // %s()\n", __FUNCTION__);
       // Creates an iterator for an integer enumeration. The number of items
@@ -511,9 +849,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       stop = (result != ERROR_SUCCESS);
-      break;
+      next_instruction();
 
-    case OP_ITER_NEXT:
+    opcode_case(OP_ITER_NEXT):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_ITER_NEXT: // %s()\n", __FUNCTION__);
       // Loads the iterator in r1, but leaves the iterator in the stack.
@@ -525,16 +863,16 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       // calling "next".
       result = r1.it->next(r1.it, &stack);
       stop = (result != ERROR_SUCCESS);
-      break;
+      next_instruction();
 
-    case OP_PUSH:
+    opcode_case(OP_PUSH):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_PUSH: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_PUSH_8:
+    opcode_case(OP_PUSH_8):
       r1.i = *ip;
       YR_DEBUG_FPRINTF(
           2,
@@ -544,9 +882,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
           __FUNCTION__);
       ip += sizeof(uint8_t);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_PUSH_16:
+    opcode_case(OP_PUSH_16):
       r1.i = *(uint16_t*) (ip);
       YR_DEBUG_FPRINTF(
           2,
@@ -556,9 +894,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
           __FUNCTION__);
       ip += sizeof(uint16_t);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_PUSH_32:
+    opcode_case(OP_PUSH_32):
       r1.i = *(uint32_t*) (ip);
       YR_DEBUG_FPRINTF(
           2,
@@ -568,20 +906,20 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
           __FUNCTION__);
       ip += sizeof(uint32_t);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_PUSH_U:
+    opcode_case(OP_PUSH_U):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_PUSH_U: // %s()\n", __FUNCTION__);
       r1.i = YR_UNDEFINED;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_POP:
+    opcode_case(OP_POP):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_POP: // %s()\n", __FUNCTION__);
       pop(r1);
-      break;
+      next_instruction();
 
-    case OP_CLEAR_M:
+    opcode_case(OP_CLEAR_M):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_CLEAR_M: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
@@ -589,9 +927,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_within_mem(r1.i);
 #endif
       mem[r1.i].i = 0;
-      break;
+      next_instruction();
 
-    case OP_ADD_M:
+    opcode_case(OP_ADD_M):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_ADD_M: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
@@ -601,9 +939,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       pop(r2);
       if (!is_undef(r2))
         mem[r1.i].i += r2.i;
-      break;
+      next_instruction();
 
-    case OP_INCR_M:
+    opcode_case(OP_INCR_M):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INCR_M: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
@@ -611,9 +949,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_within_mem(r1.i);
 #endif
       mem[r1.i].i++;
-      break;
+      next_instruction();
 
-    case OP_PUSH_M:
+    opcode_case(OP_PUSH_M):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_PUSH_M: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
@@ -622,9 +960,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 #endif
       r1 = mem[r1.i];
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_POP_M:
+    opcode_case(OP_POP_M):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_POP_M: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
@@ -633,9 +971,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 #endif
       pop(r2);
       mem[r1.i] = r2;
-      break;
+      next_instruction();
 
-    case OP_SET_M:
+    opcode_case(OP_SET_M):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_SET_M: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
@@ -646,9 +984,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       push(r2);
       if (!is_undef(r2))
         mem[r1.i] = r2;
-      break;
+      next_instruction();
 
-    case OP_SWAPUNDEF:
+    opcode_case(OP_SWAPUNDEF):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_SWAPUNDEF: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
@@ -667,95 +1005,95 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       {
         push(r2);
       }
-      break;
+      next_instruction();
 
-    case OP_JNUNDEF:
+    opcode_case(OP_JNUNDEF):
       // Jump if the top the stack is not undefined without modifying the stack.
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_JNUNDEF: // %s()\n", __FUNCTION__);
       pop(r1);
       push(r1);
       ip = jmp_if(!is_undef(r1), ip);
-      break;
+      next_instruction();
 
-    case OP_JUNDEF_P:
+    opcode_case(OP_JUNDEF_P):
       // Removes a value from the top of the stack and jump if the value is not
       // undefined.
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_JUNDEF_P: // %s()\n", __FUNCTION__);
       pop(r1);
       ip = jmp_if(is_undef(r1), ip);
-      break;
+      next_instruction();
 
-    case OP_JL_P:
+    opcode_case(OP_JL_P):
       // Pops two values A and B from the stack and jump if A < B. B is popped
       // first, and then A.
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_JL_P: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
       ip = jmp_if(r1.i < r2.i, ip);
-      break;
+      next_instruction();
 
-    case OP_JLE_P:
+    opcode_case(OP_JLE_P):
       // Pops two values A and B from the stack and jump if A <= B. B is popped
       // first, and then A.
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_JLE_P: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
       ip = jmp_if(r1.i <= r2.i, ip);
-      break;
+      next_instruction();
 
-    case OP_JTRUE:
+    opcode_case(OP_JTRUE):
       // Jump if the top of the stack is true without modifying the stack. If
       // the top of the stack is undefined the jump is not taken.
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_JTRUE: // %s()\n", __FUNCTION__);
       pop(r1);
       push(r1);
       ip = jmp_if(!is_undef(r1) && r1.i, ip);
-      break;
+      next_instruction();
 
-    case OP_JTRUE_P:
+    opcode_case(OP_JTRUE_P):
       // Removes a value from the stack and jump if it is true. If the value
       // is undefined the jump is not taken.
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_JTRUE_P: // %s()\n", __FUNCTION__);
       pop(r1);
       ip = jmp_if(!is_undef(r1) && r1.i, ip);
-      break;
+      next_instruction();
 
-    case OP_JFALSE:
+    opcode_case(OP_JFALSE):
       // Jump if the top of the stack is false without modifying the stack. If
       // the top of the stack is undefined the jump is not taken.
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_JFALSE: // %s()\n", __FUNCTION__);
       pop(r1);
       push(r1);
       ip = jmp_if(!is_undef(r1) && !r1.i, ip);
-      break;
+      next_instruction();
 
-    case OP_JFALSE_P:
+    opcode_case(OP_JFALSE_P):
       // Removes a value from the stack and jump if it is false. If the value
       // is undefined the jump is not taken.
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_JFALSE_P: // %s()\n", __FUNCTION__);
       pop(r1);
       ip = jmp_if(!is_undef(r1) && !r1.i, ip);
-      break;
+      next_instruction();
 
-    case OP_JZ:
+    opcode_case(OP_JZ):
       // Jump if the value at the top of the stack is 0 without modifying the
       // stack.
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_JZ: // %s()\n", __FUNCTION__);
       pop(r1);
       push(r1);
       ip = jmp_if(r1.i == 0, ip);
-      break;
+      next_instruction();
 
-    case OP_JZ_P:
+    opcode_case(OP_JZ_P):
       // Removes a value from the stack and jump if the value is 0.
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_JZ_P: // %s()\n", __FUNCTION__);
       pop(r1);
       ip = jmp_if(r1.i == 0, ip);
-      break;
+      next_instruction();
 
-    case OP_AND:
+    opcode_case(OP_AND):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_AND: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -768,9 +1106,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
       r1.i = r1.i && r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_OR:
+    opcode_case(OP_OR):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_OR: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -783,9 +1121,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
       r1.i = r1.i || r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_NOT:
+    opcode_case(OP_NOT):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_NOT: // %s()\n", __FUNCTION__);
       pop(r1);
 
@@ -795,15 +1133,15 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
         r1.i = !r1.i;
 
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DEFINED:
+    opcode_case(OP_DEFINED):
       pop(r1);
       r1.i = !is_undef(r1);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_MOD:
+    opcode_case(OP_MOD):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_MOD: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -814,9 +1152,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       else
         r1.i = YR_UNDEFINED;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_SHR:
+    opcode_case(OP_SHR):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_SHR: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -829,9 +1167,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       else
         r1.i = 0;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_SHL:
+    opcode_case(OP_SHL):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_SHL: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -844,18 +1182,18 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       else
         r1.i = 0;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_BITWISE_NOT:
+    opcode_case(OP_BITWISE_NOT):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_BITWISE_NOT: // %s()\n", __FUNCTION__);
       pop(r1);
       ensure_defined(r1);
       r1.i = ~r1.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_BITWISE_AND:
+    opcode_case(OP_BITWISE_AND):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_BITWISE_AND: // %s()\n", __FUNCTION__);
       pop(r2);
@@ -864,9 +1202,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i & r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_BITWISE_OR:
+    opcode_case(OP_BITWISE_OR):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_BITWISE_OR: // %s()\n", __FUNCTION__);
       pop(r2);
@@ -875,9 +1213,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i | r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_BITWISE_XOR:
+    opcode_case(OP_BITWISE_XOR):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_BITWISE_XOR: // %s()\n", __FUNCTION__);
       pop(r2);
@@ -886,9 +1224,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i ^ r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_PUSH_RULE:
+    opcode_case(OP_PUSH_RULE):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_PUSH_RULE: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
@@ -909,9 +1247,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       push(r2);
-      break;
+      next_instruction();
 
-    case OP_INIT_RULE:
+    opcode_case(OP_INIT_RULE):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_INIT_RULE: // %s()\n", __FUNCTION__);
       // After the opcode there's an int32_t corresponding to the jump's
@@ -930,9 +1268,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       if (!RULE_IS_DISABLED(current_rule))
         ip += sizeof(uint32_t);
 
-      break;
+      next_instruction();
 
-    case OP_MATCH_RULE:
+    opcode_case(OP_MATCH_RULE):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_MATCH_RULE: // %s()\n", __FUNCTION__);
       pop(r1);
@@ -958,9 +1296,36 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 #endif
 
       assert(stack.sp == 0);  // at this point the stack should be empty.
-      break;
+      next_instruction();
+
+    opcode_case(OP_GUARD_RULE):
+      YR_DEBUG_FPRINTF(
+          2, stderr, "- case OP_GUARD_RULE: // %s()\n", __FUNCTION__);
+      pop(r1);
+
+      memcpy(&r2.i, ip, sizeof(uint64_t));
+      ip += sizeof(uint64_t);
+
+      rule = &context->rules->rules_table[r2.i];
+
+#if YR_PARANOID_EXEC
+      ensure_within_rules_arena(rule);
+#endif
+
+      // If the guard is false the rule's condition is false too, and its
+      // strings don't need to be searched for.
+      if (is_undef(r1) || !r1.i)
+      {
+        yr_rule_strings_foreach(rule, string)
+        {
+          yr_scan_disable_string(context, string);
+        }
+      }
+
+      assert(stack.sp == 0);  // at this point the stack should be empty.
+      next_instruction();
 
-    case OP_OBJ_LOAD:
+    opcode_case(OP_OBJ_LOAD):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_OBJ_LOAD: // %s()\n", __FUNCTION__);
       identifier = *(char**) (ip);
@@ -975,9 +1340,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
       assert(r1.o != NULL);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_OBJ_FIELD:
+    opcode_case(OP_OBJ_FIELD):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_OBJ_FIELD: // %s()\n", __FUNCTION__);
       identifier = *(char**) (ip);
@@ -999,10 +1364,13 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
         break;
       }
 
+      if (r1.o->stage != 0)
+        yr_object_load_stage(r1.o);
+
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_OBJ_VALUE:
+    opcode_case(OP_OBJ_VALUE):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_OBJ_VALUE: // %s()\n", __FUNCTION__);
       pop(r1);
@@ -1037,9 +1405,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INDEX_ARRAY:
+    opcode_case(OP_INDEX_ARRAY):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_INDEX_ARRAY: // %s()\n", __FUNCTION__);
       pop(r1);  // index
@@ -1060,9 +1428,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
         r1.i = YR_UNDEFINED;
 
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_LOOKUP_DICT:
+    opcode_case(OP_LOOKUP_DICT):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_LOOKUP_DICT: // %s()\n", __FUNCTION__);
       pop(r1);  // key
@@ -1083,18 +1451,23 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
         r1.i = YR_UNDEFINED;
 
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_CALL:
+    opcode_case(OP_CALL):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_CALL: // %s()\n", __FUNCTION__);
-      args_fmt = *(char**) (ip);
-      ip += sizeof(uint64_t);
-
-      int i = (int) strlen(args_fmt);
+      // The number of arguments and the prototype to call were determined
+      // at compile time, see yr_parser_emit_call.
+      memcpy(&num_args, ip, sizeof(int32_t));
+      ip += sizeof(int32_t);
+      memcpy(&prototype_idx, ip, sizeof(int32_t));
+      ip += sizeof(int32_t);
+
+      int i = num_args;
       count = 0;
 
 #if YR_PARANOID_EXEC
-      if (i > YR_MAX_FUNCTION_ARGS)
+      if (i > YR_MAX_FUNCTION_ARGS || prototype_idx < 0 ||
+          prototype_idx >= YR_MAX_OVERLOADED_FUNCTIONS)
       {
         stop = true;
         result = ERROR_INTERNAL_FATAL_ERROR;
@@ -1133,44 +1506,64 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       function = object_as_function(r2.o);
-      result = ERROR_INTERNAL_FATAL_ERROR;
 
-      for (i = 0; i < YR_MAX_OVERLOADED_FUNCTIONS; i++)
+      assert(function->prototypes[prototype_idx].code != NULL);
+
+      result = _yr_execute_call(
+          context,
+          function,
+          prototype_idx,
+          args,
+          num_args,
+          &results,
+          &num_results,
+          &r1.o);
+
+      if (result == ERROR_SUCCESS)
       {
-        if (function->prototypes[i].arguments_fmt == NULL)
+        switch (r1.o->type)
+        {
+        // Integers and floats are pushed by value, the parser doesn't emit
+        // OP_OBJ_VALUE after calling a function that returns them.
+        case OBJECT_TYPE_INTEGER:
+          r1.i = r1.o->value.i;
           break;
 
-        if (strcmp(function->prototypes[i].arguments_fmt, args_fmt) == 0)
-        {
-          result = function->prototypes[i].code(args, context, function);
+        case OBJECT_TYPE_FLOAT:
+          if (yr_isnan(r1.o->value.d))
+            r1.i = YR_UNDEFINED;
+          else
+            r1.d = r1.o->value.d;
           break;
-        }
-      }
 
-      // If i == YR_MAX_OVERLOADED_FUNCTIONS at this point no matching
-      // prototype was found, but this shouldn't happen.
-      assert(i < YR_MAX_OVERLOADED_FUNCTIONS);
+        case OBJECT_TYPE_STRING:
+          // Make a copy of the returned object and push the copy into the
+          // stack, function->return_obj can't be pushed because it can change
+          // in subsequent calls to the same function. This is not necessary
+          // with results of pure functions, which don't change.
+          if (r1.o != function->return_obj)
+            break;
 
-      // Make a copy of the returned object and push the copy into the stack,
-      // function->return_obj can't be pushed because it can change in
-      // subsequent calls to the same function.
-      if (result == ERROR_SUCCESS)
-        result = yr_object_copy(function->return_obj, &r1.o);
+          result = yr_object_copy(function->return_obj, &r1.o);
 
-      // A pointer to the copied object is stored in a arena in order to
-      // free the object before exiting yr_execute_code, obj_count tracks
-      // the number of objects written.
-      if (result == ERROR_SUCCESS)
-      {
-        result = yr_arena_write_data(obj_arena, 0, &r1.o, sizeof(r1.o), NULL);
-        obj_count++;
+          // A pointer to the copied object is stored in a arena in order to
+          // free the object before exiting yr_execute_code, obj_count tracks
+          // the number of objects written.
+          if (result == ERROR_SUCCESS)
+          {
+            result = yr_arena_write_data(
+                obj_arena, 0, &r1.o, sizeof(r1.o), NULL);
+            obj_count++;
+          }
+          break;
+        }
       }
 
       stop = (result != ERROR_SUCCESS);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_FOUND:
+    opcode_case(OP_FOUND):
       pop(r1);
       r2.i = context->matches[r1.s->idx].tail != NULL ? 1 : 0;
       YR_DEBUG_FPRINTF(
@@ -1180,9 +1573,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
           r2.i,
           __FUNCTION__);
       push(r2);
-      break;
+      next_instruction();
 
-    case OP_FOUND_AT:
+    opcode_case(OP_FOUND_AT):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_FOUND_AT: // %s()\n", __FUNCTION__);
       pop(r2);
@@ -1199,27 +1592,18 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_within_rules_arena(r2.p);
 #endif
 
-      match = context->matches[r2.s->idx].head;
-      r3.i = false;
-
-      while (match != NULL)
-      {
-        if (r1.i == match->base + match->offset)
-        {
-          r3.i = true;
-          break;
-        }
+      ensure_match_index(r2.s, match_index);
 
-        if (r1.i < match->base + match->offset)
-          break;
+      num_matches = context->matches[r2.s->idx].count;
+      pos = _yr_match_lower_bound(match_index, num_matches, r1.i);
 
-        match = match->next;
-      }
+      r3.i = pos < num_matches &&
+             match_index[pos]->base + match_index[pos]->offset == r1.i;
 
       push(r3);
-      break;
+      next_instruction();
 
-    case OP_FOUND_IN:
+    opcode_case(OP_FOUND_IN):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_FOUND_IN: // %s()\n", __FUNCTION__);
       pop(r3);
@@ -1233,27 +1617,18 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_within_rules_arena(r3.p);
 #endif
 
-      match = context->matches[r3.s->idx].head;
-      r4.i = false;
-
-      while (match != NULL && !r4.i)
-      {
-        if (match->base + match->offset >= r1.i &&
-            match->base + match->offset <= r2.i)
-        {
-          r4.i = true;
-        }
+      ensure_match_index(r3.s, match_index);
 
-        if (match->base + match->offset > r2.i)
-          break;
+      num_matches = context->matches[r3.s->idx].count;
+      pos = _yr_match_lower_bound(match_index, num_matches, r1.i);
 
-        match = match->next;
-      }
+      r4.i = pos < num_matches &&
+             match_index[pos]->base + match_index[pos]->offset <= r2.i;
 
       push(r4);
-      break;
+      next_instruction();
 
-    case OP_COUNT:
+    opcode_case(OP_COUNT):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_COUNT: // %s()\n", __FUNCTION__);
       pop(r1);
 
@@ -1263,9 +1638,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
       r2.i = context->matches[r1.s->idx].count;
       push(r2);
-      break;
+      next_instruction();
 
-    case OP_COUNT_IN:
+    opcode_case(OP_COUNT_IN):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_COUNT_IN: // %s()\n", __FUNCTION__);
       pop(r3);
@@ -1276,30 +1651,30 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r2);
 
 #if YR_PARANOID_EXEC
-      ensure_within_rules_arena(r1.p);
+      ensure_within_rules_arena(r3.p);
 #endif
 
-      match = context->matches[r3.s->idx].head;
+      ensure_match_index(r3.s, match_index);
+
+      num_matches = context->matches[r3.s->idx].count;
+
+      // The matches within the range are the ones at r1.i or later, except
+      // those at r2.i + 1 or later.
       r4.i = 0;
 
-      while (match != NULL)
+      if (r2.i >= r1.i)
       {
-        if (match->base + match->offset >= r1.i &&
-            match->base + match->offset <= r2.i)
-        {
-          r4.i++;
-        }
+        pos = r2.i < INT64_MAX
+                  ? _yr_match_lower_bound(match_index, num_matches, r2.i + 1)
+                  : num_matches;
 
-        if (match->base + match->offset > r2.i)
-          break;
-
-        match = match->next;
+        r4.i = pos - _yr_match_lower_bound(match_index, num_matches, r1.i);
       }
 
       push(r4);
-      break;
+      next_instruction();
 
-    case OP_OFFSET:
+    opcode_case(OP_OFFSET):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_OFFSET: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1310,24 +1685,19 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_within_rules_arena(r2.p);
 #endif
 
-      match = context->matches[r2.s->idx].head;
-
-      i = 1;
       r3.i = YR_UNDEFINED;
 
-      while (match != NULL && r3.i == YR_UNDEFINED)
+      if (r1.i >= 1 && r1.i <= context->matches[r2.s->idx].count)
       {
-        if (r1.i == i)
-          r3.i = match->base + match->offset;
-
-        i++;
-        match = match->next;
+        ensure_match_index(r2.s, match_index);
+        match = match_index[r1.i - 1];
+        r3.i = match->base + match->offset;
       }
 
       push(r3);
-      break;
+      next_instruction();
 
-    case OP_LENGTH:
+    opcode_case(OP_LENGTH):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_LENGTH: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1338,25 +1708,19 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_within_rules_arena(r2.p);
 #endif
 
-      match = context->matches[r2.s->idx].head;
-
-      i = 1;
       r3.i = YR_UNDEFINED;
 
-      while (match != NULL && r3.i == YR_UNDEFINED)
+      if (r1.i >= 1 && r1.i <= context->matches[r2.s->idx].count)
       {
-        if (r1.i == i)
-          r3.i = match->match_length;
-
-        i++;
-        match = match->next;
+        ensure_match_index(r2.s, match_index);
+        r3.i = match_index[r1.i - 1]->match_length;
       }
 
       push(r3);
-      break;
+      next_instruction();
 
-    case OP_OF:
-    case OP_OF_PERCENT:
+    opcode_case(OP_OF):
+    opcode_case(OP_OF_PERCENT):
       memcpy(&r2.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
       assert(r2.i == OF_STRING_SET || r2.i == OF_RULE_SET);
@@ -1408,9 +1772,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_OF_FOUND_IN:
+    opcode_case(OP_OF_FOUND_IN):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_OF_FOUND_IN: // %s()\n", __FUNCTION__);
 
@@ -1428,22 +1792,14 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 #if YR_PARANOID_EXEC
         ensure_within_rules_arena(r3.p);
 #endif
-        match = context->matches[r3.s->idx].head;
-
-        while (match != NULL)
-        {
-          if (match->base + match->offset >= r1.i &&
-              match->base + match->offset <= r2.i)
-          {
-            found++;
-            break;
-          }
+        ensure_match_index(r3.s, match_index);
 
-          if (match->base + match->offset > r1.i)
-            break;
+        num_matches = context->matches[r3.s->idx].count;
+        pos = _yr_match_lower_bound(match_index, num_matches, r1.i);
 
-          match = match->next;
-        }
+        if (pos < num_matches &&
+            match_index[pos]->base + match_index[pos]->offset <= r2.i)
+          found++;
 
         count++;
         pop(r3);
@@ -1456,9 +1812,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
         r1.i = found >= r1.i ? 1 : 0;
 
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_FILESIZE:
+    opcode_case(OP_FILESIZE):
       r1.i = context->file_size;
       YR_DEBUG_FPRINTF(
           2,
@@ -1468,102 +1824,102 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
           r1.i == YR_UNDEFINED ? " AKA YR_UNDEFINED" : "",
           __FUNCTION__);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_ENTRYPOINT:
+    opcode_case(OP_ENTRYPOINT):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_ENTRYPOINT: // %s()\n", __FUNCTION__);
       r1.i = context->entry_point;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT8:
+    opcode_case(OP_INT8):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT8: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_int8_t_little_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT16:
+    opcode_case(OP_INT16):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT16: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_int16_t_little_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT32:
+    opcode_case(OP_INT32):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT32: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_int32_t_little_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_UINT8:
+    opcode_case(OP_UINT8):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_UINT8: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_uint8_t_little_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_UINT16:
+    opcode_case(OP_UINT16):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_UINT16: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_uint16_t_little_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_UINT32:
+    opcode_case(OP_UINT32):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_UINT32: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_uint32_t_little_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT8BE:
+    opcode_case(OP_INT8BE):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT8BE: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_int8_t_big_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT16BE:
+    opcode_case(OP_INT16BE):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT16BE: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_int16_t_big_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT32BE:
+    opcode_case(OP_INT32BE):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT32BE: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_int32_t_big_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_UINT8BE:
+    opcode_case(OP_UINT8BE):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_UINT8BE: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_uint8_t_big_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_UINT16BE:
+    opcode_case(OP_UINT16BE):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_UINT16BE: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_uint16_t_big_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_UINT32BE:
+    opcode_case(OP_UINT32BE):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_UINT32BE: // %s()\n", __FUNCTION__);
       pop(r1);
       r1.i = read_uint32_t_big_endian(context->iterator, (size_t) r1.i);
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_IMPORT:
+    opcode_case(OP_IMPORT):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_IMPORT: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
       ip += sizeof(uint64_t);
@@ -1577,9 +1933,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       if (result != ERROR_SUCCESS)
         stop = true;
 
-      break;
+      next_instruction();
 
-    case OP_MATCHES:
+    opcode_case(OP_MATCHES):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_MATCHES: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1610,9 +1966,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
       r1.i = found >= 0;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_TO_DBL:
+    opcode_case(OP_INT_TO_DBL):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_INT_TO_DBL: // %s()\n", __FUNCTION__);
       memcpy(&r1.i, ip, sizeof(uint64_t));
@@ -1633,18 +1989,18 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
         stack.items[stack.sp - r1.i].i = YR_UNDEFINED;
       else
         stack.items[stack.sp - r1.i].d = (double) r2.i;
-      break;
+      next_instruction();
 
-    case OP_STR_TO_BOOL:
+    opcode_case(OP_STR_TO_BOOL):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_STR_TO_BOOL: // %s()\n", __FUNCTION__);
       pop(r1);
       ensure_defined(r1);
       r1.i = r1.ss->length > 0;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_EQ:
+    opcode_case(OP_INT_EQ):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_EQ: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1652,9 +2008,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i == r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_NEQ:
+    opcode_case(OP_INT_NEQ):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_NEQ: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1662,9 +2018,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i != r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_LT:
+    opcode_case(OP_INT_LT):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_LT: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1672,9 +2028,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i < r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_GT:
+    opcode_case(OP_INT_GT):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_GT: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1682,9 +2038,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i > r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_LE:
+    opcode_case(OP_INT_LE):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_LE: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1692,9 +2048,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i <= r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_GE:
+    opcode_case(OP_INT_GE):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_GE: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1702,9 +2058,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i >= r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_ADD:
+    opcode_case(OP_INT_ADD):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_ADD: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1712,9 +2068,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i + r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_SUB:
+    opcode_case(OP_INT_SUB):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_SUB: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1722,9 +2078,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i - r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_MUL:
+    opcode_case(OP_INT_MUL):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_MUL: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1732,9 +2088,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.i * r2.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_DIV:
+    opcode_case(OP_INT_DIV):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_INT_DIV: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1745,18 +2101,18 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       else
         r1.i = YR_UNDEFINED;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_INT_MINUS:
+    opcode_case(OP_INT_MINUS):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_INT_MINUS: // %s()\n", __FUNCTION__);
       pop(r1);
       ensure_defined(r1);
       r1.i = -r1.i;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_LT:
+    opcode_case(OP_DBL_LT):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_LT: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1765,9 +2121,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       else
         r1.i = r1.d < r2.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_GT:
+    opcode_case(OP_DBL_GT):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_GT: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1775,9 +2131,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.d > r2.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_LE:
+    opcode_case(OP_DBL_LE):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_LE: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1785,9 +2141,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.d <= r2.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_GE:
+    opcode_case(OP_DBL_GE):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_GE: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1795,9 +2151,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = r1.d >= r2.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_EQ:
+    opcode_case(OP_DBL_EQ):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_EQ: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1805,9 +2161,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = fabs(r1.d - r2.d) < DBL_EPSILON;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_NEQ:
+    opcode_case(OP_DBL_NEQ):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_NEQ: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1815,9 +2171,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.i = fabs(r1.d - r2.d) >= DBL_EPSILON;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_ADD:
+    opcode_case(OP_DBL_ADD):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_ADD: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1825,9 +2181,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.d = r1.d + r2.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_SUB:
+    opcode_case(OP_DBL_SUB):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_SUB: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1835,9 +2191,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.d = r1.d - r2.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_MUL:
+    opcode_case(OP_DBL_MUL):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_MUL: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1845,9 +2201,9 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.d = r1.d * r2.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_DIV:
+    opcode_case(OP_DBL_DIV):
       YR_DEBUG_FPRINTF(2, stderr, "- case OP_DBL_DIV: // %s()\n", __FUNCTION__);
       pop(r2);
       pop(r1);
@@ -1855,23 +2211,23 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       ensure_defined(r1);
       r1.d = r1.d / r2.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_DBL_MINUS:
+    opcode_case(OP_DBL_MINUS):
       YR_DEBUG_FPRINTF(
           2, stderr, "- case OP_DBL_MINUS: // %s()\n", __FUNCTION__);
       pop(r1);
       ensure_defined(r1);
       r1.d = -r1.d;
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_STR_EQ:
-    case OP_STR_NEQ:
-    case OP_STR_LT:
-    case OP_STR_LE:
-    case OP_STR_GT:
-    case OP_STR_GE:
+    opcode_case(OP_STR_EQ):
+    opcode_case(OP_STR_NEQ):
+    opcode_case(OP_STR_LT):
+    opcode_case(OP_STR_LE):
+    opcode_case(OP_STR_GT):
+    opcode_case(OP_STR_GE):
       pop(r2);
       pop(r1);
 
@@ -1913,15 +2269,15 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       push(r1);
-      break;
+      next_instruction();
 
-    case OP_CONTAINS:
-    case OP_ICONTAINS:
-    case OP_STARTSWITH:
-    case OP_ISTARTSWITH:
-    case OP_ENDSWITH:
-    case OP_IENDSWITH:
-    case OP_IEQUALS:
+    opcode_case(OP_CONTAINS):
+    opcode_case(OP_ICONTAINS):
+    opcode_case(OP_STARTSWITH):
+    opcode_case(OP_ISTARTSWITH):
+    opcode_case(OP_ENDSWITH):
+    opcode_case(OP_IENDSWITH):
+    opcode_case(OP_IEQUALS):
       pop(r2);
       pop(r1);
 
@@ -1968,9 +2324,12 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       }
 
       push(r1);
-      break;
+      next_instruction();
 
     default:
+#if YR_EXEC_COMPUTED_GOTO
+    label_unknown:
+#endif
       YR_DEBUG_FPRINTF(
           2, stderr, "- case <unknown instruction>: // %s()\n", __FUNCTION__);
       // Unknown instruction, this shouldn't happen.
@@ -2004,6 +2363,13 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
   yr_arena_release(obj_arena);
   yr_notebook_destroy(it_notebook);
+
+  // Results of pure functions must be discarded together with the modules,
+  // they are keyed by the address of functions in the modules' objects.
+  if (results != NULL)
+    yr_hash_table_destroy(
+        results, (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_object_destroy);
+
   yr_modules_unload_all(context);
   yr_free(stack.items);
 
@@ -2017,3 +2383,22 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
 
   return result;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// Evaluates the conditions of all the rules, once the data has been scanned.
+//
+int yr_execute_code(YR_SCAN_CONTEXT* context)
+{
+  return _yr_execute_code(context, context->rules->code_start);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Evaluates the guards of the rules before scanning the data, and disables
+// the strings of the rules whose guard is not satisfied. A guard is the part
+// of a rule's condition that depends only on the data and its size, see
+// _yr_parser_emit_guard. context->iterator and context->file_size must be set.
+//
+int yr_execute_guards(YR_SCAN_CONTEXT* context)
+{
+  return _yr_execute_code(context, context->rules->guard_code_start);
+}
@@ -927,17 +927,17 @@ static const yytype_int16 yyrline[] =
      547,   561,   575,   593,   594,   600,   599,   616,   615,   636,
      635,   660,   666,   726,   727,   728,   729,   730,   731,   737,
      758,   789,   794,   811,   816,   836,   837,   851,   852,   853,
-     854,   855,   859,   860,   874,   878,   973,  1021,  1082,  1129,
-    1130,  1134,  1169,  1222,  1264,  1287,  1293,  1299,  1311,  1321,
-    1331,  1341,  1351,  1361,  1371,  1381,  1395,  1410,  1421,  1498,
-    1536,  1438,  1695,  1694,  1784,  1790,  1796,  1816,  1836,  1842,
-    1848,  1854,  1853,  1899,  1898,  1942,  1949,  1956,  1963,  1970,
-    1977,  1984,  1988,  1996,  2016,  2044,  2118,  2146,  2154,  2163,
-    2187,  2202,  2222,  2221,  2227,  2238,  2239,  2244,  2251,  2263,
-    2262,  2272,  2273,  2278,  2309,  2331,  2335,  2340,  2345,  2354,
-    2358,  2366,  2378,  2392,  2399,  2406,  2431,  2443,  2455,  2467,
-    2482,  2494,  2509,  2552,  2573,  2608,  2643,  2677,  2702,  2719,
-    2729,  2739,  2749,  2759,  2779,  2799
+     854,   855,   859,   860,   874,   878,   973,  1021,  1082,  1144,
+    1145,  1149,  1184,  1237,  1275,  1298,  1304,  1310,  1322,  1332,
+    1342,  1352,  1362,  1372,  1382,  1392,  1406,  1421,  1432,  1509,
+    1547,  1449,  1706,  1705,  1795,  1801,  1807,  1827,  1847,  1853,
+    1859,  1865,  1864,  1908,  1907,  1951,  1958,  1965,  1972,  1979,
+    1986,  1993,  1997,  2005,  2025,  2053,  2127,  2155,  2163,  2172,
+    2196,  2211,  2231,  2230,  2236,  2247,  2248,  2253,  2260,  2272,
+    2271,  2281,  2282,  2287,  2318,  2340,  2344,  2349,  2354,  2363,
+    2367,  2375,  2387,  2401,  2408,  2415,  2440,  2452,  2464,  2476,
+    2491,  2503,  2518,  2561,  2582,  2617,  2652,  2686,  2711,  2728,
+    2738,  2748,  2758,  2768,  2788,  2808
 };
 #endif
 
@@ -2766,30 +2766,45 @@ yyreduce:
       {
         YR_ARENA_REF ref;
         int result = ERROR_SUCCESS;
+        int32_t prototype_idx;
         YR_OBJECT_FUNCTION* function;
 
         if ((yyvsp[-3].expression).type == EXPRESSION_TYPE_OBJECT &&
             (yyvsp[-3].expression).value.object->type == OBJECT_TYPE_FUNCTION)
         {
           result = yr_parser_check_types(
-              compiler, object_as_function((yyvsp[-3].expression).value.object), (yyvsp[-1].c_string));
+              compiler, object_as_function((yyvsp[-3].expression).value.object), (yyvsp[-1].c_string),
+              &prototype_idx);
 
           if (result == ERROR_SUCCESS)
             result = _yr_compiler_store_string(
                 compiler, (yyvsp[-1].c_string), &ref);
 
           if (result == ERROR_SUCCESS)
-            result = yr_parser_emit_with_arg_reloc(
+            result = yr_parser_emit_call(
                 yyscanner,
-                OP_CALL,
-                yr_arena_ref_to_ptr(compiler->arena, &ref),
-                NULL,
-                NULL);
+                object_as_function((yyvsp[-3].expression).value.object),
+                (yyvsp[-1].c_string),
+                prototype_idx);
 
           function = object_as_function((yyvsp[-3].expression).value.object);
 
-          (yyval.expression).type = EXPRESSION_TYPE_OBJECT;
-          (yyval.expression).value.object = function->return_obj;
+          // Calls to functions returning integers or floats leave the value
+          // in the stack, only strings are returned as objects. See OP_CALL.
+          switch (function->return_obj->type)
+          {
+            case OBJECT_TYPE_INTEGER:
+              (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
+              (yyval.expression).value.integer = YR_UNDEFINED;
+              break;
+            case OBJECT_TYPE_FLOAT:
+              (yyval.expression).type = EXPRESSION_TYPE_FLOAT;
+              break;
+            default:
+              (yyval.expression).type = EXPRESSION_TYPE_OBJECT;
+              (yyval.expression).value.object = function->return_obj;
+          }
+
           (yyval.expression).identifier.ref = ref;
           (yyval.expression).identifier.ptr = NULL;
         }
@@ -2805,23 +2820,23 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 2809 "grammar.c"
+#line 2824 "grammar.c"
     break;
 
   case 69: /* arguments: %empty  */
-#line 1129 "grammar.y"
+#line 1144 "grammar.y"
                       { (yyval.c_string) = yr_strdup(""); }
-#line 2815 "grammar.c"
+#line 2830 "grammar.c"
     break;
 
   case 70: /* arguments: arguments_list  */
-#line 1130 "grammar.y"
+#line 1145 "grammar.y"
                       { (yyval.c_string) = (yyvsp[0].c_string); }
-#line 2821 "grammar.c"
+#line 2836 "grammar.c"
     break;
 
   case 71: /* arguments_list: expression  */
-#line 1135 "grammar.y"
+#line 1150 "grammar.y"
       {
         (yyval.c_string) = (char*) yr_malloc(YR_MAX_FUNCTION_ARGS + 1);
 
@@ -2856,11 +2871,11 @@ yyreduce:
             assert(compiler->last_error != ERROR_SUCCESS);
         }
       }
-#line 2860 "grammar.c"
+#line 2875 "grammar.c"
     break;
 
   case 72: /* arguments_list: arguments_list ',' expression  */
-#line 1170 "grammar.y"
+#line 1185 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -2909,11 +2924,11 @@ yyreduce:
 
         (yyval.c_string) = (yyvsp[-2].c_string);
       }
-#line 2913 "grammar.c"
+#line 2928 "grammar.c"
     break;
 
   case 73: /* regexp: "regular expression"  */
-#line 1223 "grammar.y"
+#line 1238 "grammar.y"
       {
         YR_ARENA_REF re_ref;
         RE_ERROR error;
@@ -2927,12 +2942,8 @@ yyreduce:
         if ((yyvsp[0].sized_string)->flags & SIZED_STRING_FLAGS_DOT_ALL)
           re_flags |= RE_FLAGS_DOT_ALL;
 
-        result = yr_re_compile(
-            (yyvsp[0].sized_string)->c_string,
-            re_flags,
-            compiler->arena,
-            &re_ref,
-            &error);
+        result = _yr_compiler_store_regexp(
+            compiler, (yyvsp[0].sized_string)->c_string, re_flags, &re_ref, &error);
 
         yr_free((yyvsp[0].sized_string));
 
@@ -2951,11 +2962,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_REGEXP;
       }
-#line 2955 "grammar.c"
+#line 2966 "grammar.c"
     break;
 
   case 74: /* boolean_expression: expression  */
-#line 1265 "grammar.y"
+#line 1276 "grammar.y"
       {
         if ((yyvsp[0].expression).type == EXPRESSION_TYPE_STRING)
         {
@@ -2975,31 +2986,31 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 2979 "grammar.c"
+#line 2990 "grammar.c"
     break;
 
   case 75: /* expression: "<true>"  */
-#line 1288 "grammar.y"
+#line 1299 "grammar.y"
       {
         fail_if_error(yr_parser_emit_push_const(yyscanner, 1));
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 2989 "grammar.c"
+#line 3000 "grammar.c"
     break;
 
   case 76: /* expression: "<false>"  */
-#line 1294 "grammar.y"
+#line 1305 "grammar.y"
       {
         fail_if_error(yr_parser_emit_push_const(yyscanner, 0));
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 2999 "grammar.c"
+#line 3010 "grammar.c"
     break;
 
   case 77: /* expression: primary_expression "<matches>" regexp  */
-#line 1300 "grammar.y"
+#line 1311 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_STRING, "matches");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_REGEXP, "matches");
@@ -3011,11 +3022,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3015 "grammar.c"
+#line 3026 "grammar.c"
     break;
 
   case 78: /* expression: primary_expression "<contains>" primary_expression  */
-#line 1312 "grammar.y"
+#line 1323 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_STRING, "contains");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_STRING, "contains");
@@ -3025,11 +3036,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3029 "grammar.c"
+#line 3040 "grammar.c"
     break;
 
   case 79: /* expression: primary_expression "<icontains>" primary_expression  */
-#line 1322 "grammar.y"
+#line 1333 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_STRING, "icontains");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_STRING, "icontains");
@@ -3039,11 +3050,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3043 "grammar.c"
+#line 3054 "grammar.c"
     break;
 
   case 80: /* expression: primary_expression "<startswith>" primary_expression  */
-#line 1332 "grammar.y"
+#line 1343 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_STRING, "startswith");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_STRING, "startswith");
@@ -3053,11 +3064,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3057 "grammar.c"
+#line 3068 "grammar.c"
     break;
 
   case 81: /* expression: primary_expression "<istartswith>" primary_expression  */
-#line 1342 "grammar.y"
+#line 1353 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_STRING, "istartswith");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_STRING, "istartswith");
@@ -3067,11 +3078,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3071 "grammar.c"
+#line 3082 "grammar.c"
     break;
 
   case 82: /* expression: primary_expression "<endswith>" primary_expression  */
-#line 1352 "grammar.y"
+#line 1363 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_STRING, "endswith");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_STRING, "endswith");
@@ -3081,11 +3092,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3085 "grammar.c"
+#line 3096 "grammar.c"
     break;
 
   case 83: /* expression: primary_expression "<iendswith>" primary_expression  */
-#line 1362 "grammar.y"
+#line 1373 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_STRING, "iendswith");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_STRING, "iendswith");
@@ -3095,11 +3106,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3099 "grammar.c"
+#line 3110 "grammar.c"
     break;
 
   case 84: /* expression: primary_expression "<iequals>" primary_expression  */
-#line 1372 "grammar.y"
+#line 1383 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_STRING, "iequals");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_STRING, "iequals");
@@ -3109,11 +3120,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3113 "grammar.c"
+#line 3124 "grammar.c"
     break;
 
   case 85: /* expression: "string identifier"  */
-#line 1382 "grammar.y"
+#line 1393 "grammar.y"
       {
         int result = yr_parser_reduce_string_identifier(
             yyscanner,
@@ -3127,11 +3138,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3131 "grammar.c"
+#line 3142 "grammar.c"
     break;
 
   case 86: /* expression: "string identifier" "<at>" primary_expression  */
-#line 1396 "grammar.y"
+#line 1407 "grammar.y"
       {
         int result;
 
@@ -3146,11 +3157,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3150 "grammar.c"
+#line 3161 "grammar.c"
     break;
 
   case 87: /* expression: "string identifier" "<in>" range  */
-#line 1411 "grammar.y"
+#line 1422 "grammar.y"
       {
         int result = yr_parser_reduce_string_identifier(
             yyscanner, (yyvsp[-2].c_string), OP_FOUND_IN, YR_UNDEFINED);
@@ -3161,11 +3172,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3165 "grammar.c"
+#line 3176 "grammar.c"
     break;
 
   case 88: /* expression: "<for>" for_expression error  */
-#line 1422 "grammar.y"
+#line 1433 "grammar.y"
       {
         // Free all the loop variable identifiers, including the variables for
         // the current loop (represented by loop_index), and set loop_index to
@@ -3182,11 +3193,11 @@ yyreduce:
         compiler->loop_index = -1;
         YYERROR;
       }
-#line 3186 "grammar.c"
+#line 3197 "grammar.c"
     break;
 
   case 89: /* $@6: %empty  */
-#line 1498 "grammar.y"
+#line 1509 "grammar.y"
       {
         // var_frame is used for accessing local variables used in this loop.
         // All local variables are accessed using var_frame as a reference,
@@ -3224,11 +3235,11 @@ yyreduce:
         fail_if_error(yr_parser_emit_with_arg(
             yyscanner, OP_POP_M, var_frame + 2, NULL, NULL));
       }
-#line 3228 "grammar.c"
+#line 3239 "grammar.c"
     break;
 
   case 90: /* $@7: %empty  */
-#line 1536 "grammar.y"
+#line 1547 "grammar.y"
       {
         YR_LOOP_CONTEXT* loop_ctx = &compiler->loop[compiler->loop_index];
         YR_FIXUP* fixup;
@@ -3277,11 +3288,11 @@ yyreduce:
 
         loop_ctx->start_ref = loop_start_ref;
       }
-#line 3281 "grammar.c"
+#line 3292 "grammar.c"
     break;
 
   case 91: /* expression: "<for>" for_expression $@6 for_variables "<in>" iterator ':' $@7 '(' boolean_expression ')'  */
-#line 1585 "grammar.y"
+#line 1596 "grammar.y"
       {
         int32_t jmp_offset;
         YR_FIXUP* fixup;
@@ -3391,11 +3402,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3395 "grammar.c"
+#line 3406 "grammar.c"
     break;
 
   case 92: /* $@8: %empty  */
-#line 1695 "grammar.y"
+#line 1706 "grammar.y"
       {
         YR_ARENA_REF ref;
 
@@ -3430,11 +3441,11 @@ yyreduce:
         compiler->loop[compiler->loop_index].vars_internal_count = \
             YR_INTERNAL_LOOP_VARS;
       }
-#line 3434 "grammar.c"
+#line 3445 "grammar.c"
     break;
 
   case 93: /* expression: "<for>" for_expression "<of>" string_set ':' $@8 '(' boolean_expression ')'  */
-#line 1730 "grammar.y"
+#line 1741 "grammar.y"
       {
         int var_frame = 0;
 
@@ -3489,31 +3500,31 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3493 "grammar.c"
+#line 3504 "grammar.c"
     break;
 
   case 94: /* expression: for_expression "<of>" string_set  */
-#line 1785 "grammar.y"
+#line 1796 "grammar.y"
       {
         yr_parser_emit_with_arg(yyscanner, OP_OF, OF_STRING_SET, NULL, NULL);
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3503 "grammar.c"
+#line 3514 "grammar.c"
     break;
 
   case 95: /* expression: for_expression "<of>" rule_set  */
-#line 1791 "grammar.y"
+#line 1802 "grammar.y"
       {
         yr_parser_emit_with_arg(yyscanner, OP_OF, OF_RULE_SET, NULL, NULL);
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3513 "grammar.c"
+#line 3524 "grammar.c"
     break;
 
   case 96: /* expression: primary_expression '%' "<of>" string_set  */
-#line 1797 "grammar.y"
+#line 1808 "grammar.y"
       {
         check_type((yyvsp[-3].expression), EXPRESSION_TYPE_INTEGER, "%");
 
@@ -3533,11 +3544,11 @@ yyreduce:
 
         yr_parser_emit_with_arg(yyscanner, OP_OF_PERCENT, OF_STRING_SET, NULL, NULL);
       }
-#line 3537 "grammar.c"
+#line 3548 "grammar.c"
     break;
 
   case 97: /* expression: primary_expression '%' "<of>" rule_set  */
-#line 1817 "grammar.y"
+#line 1828 "grammar.y"
       {
         check_type((yyvsp[-3].expression), EXPRESSION_TYPE_INTEGER, "%");
 
@@ -3557,40 +3568,40 @@ yyreduce:
 
         yr_parser_emit_with_arg(yyscanner, OP_OF_PERCENT, OF_RULE_SET, NULL, NULL);
       }
-#line 3561 "grammar.c"
+#line 3572 "grammar.c"
     break;
 
   case 98: /* expression: for_expression "<of>" string_set "<in>" range  */
-#line 1837 "grammar.y"
+#line 1848 "grammar.y"
       {
         yr_parser_emit(yyscanner, OP_OF_FOUND_IN, NULL);
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3571 "grammar.c"
+#line 3582 "grammar.c"
     break;
 
   case 99: /* expression: "<not>" boolean_expression  */
-#line 1843 "grammar.y"
+#line 1854 "grammar.y"
       {
         yr_parser_emit(yyscanner, OP_NOT, NULL);
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3581 "grammar.c"
+#line 3592 "grammar.c"
     break;
 
   case 100: /* expression: "<defined>" boolean_expression  */
-#line 1849 "grammar.y"
+#line 1860 "grammar.y"
       {
         yr_parser_emit(yyscanner, OP_DEFINED, NULL);
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3590 "grammar.c"
+#line 3601 "grammar.c"
     break;
 
   case 101: /* $@9: %empty  */
-#line 1854 "grammar.y"
+#line 1865 "grammar.y"
       {
         YR_FIXUP* fixup;
         YR_ARENA_REF jmp_offset_ref;
@@ -3612,17 +3623,15 @@ yyreduce:
         fixup->next = compiler->fixup_stack_head;
         compiler->fixup_stack_head = fixup;
       }
-#line 3616 "grammar.c"
+#line 3627 "grammar.c"
     break;
 
   case 102: /* expression: boolean_expression "<and>" $@9 boolean_expression  */
-#line 1876 "grammar.y"
+#line 1887 "grammar.y"
       {
-        YR_FIXUP* fixup;
-
-        fail_if_error(yr_parser_emit(yyscanner, OP_AND, NULL));
+        YR_FIXUP* fixup = compiler->fixup_stack_head;
 
-        fixup = compiler->fixup_stack_head;
+        fail_if_error(yr_parser_emit_and(yyscanner, &fixup->ref));
 
         int32_t* jmp_offset_addr = (int32_t*) yr_arena_ref_to_ptr(
             compiler->arena, &fixup->ref);
@@ -3639,11 +3648,11 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3643 "grammar.c"
+#line 3652 "grammar.c"
     break;
 
   case 103: /* $@10: %empty  */
-#line 1899 "grammar.y"
+#line 1908 "grammar.y"
       {
         YR_FIXUP* fixup;
         YR_ARENA_REF jmp_offset_ref;
@@ -3664,11 +3673,11 @@ yyreduce:
         fixup->next = compiler->fixup_stack_head;
         compiler->fixup_stack_head = fixup;
       }
-#line 3668 "grammar.c"
+#line 3677 "grammar.c"
     break;
 
   case 104: /* expression: boolean_expression "<or>" $@10 boolean_expression  */
-#line 1920 "grammar.y"
+#line 1929 "grammar.y"
       {
         YR_FIXUP* fixup;
 
@@ -3691,93 +3700,93 @@ yyreduce:
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3695 "grammar.c"
+#line 3704 "grammar.c"
     break;
 
   case 105: /* expression: primary_expression "<" primary_expression  */
-#line 1943 "grammar.y"
+#line 1952 "grammar.y"
       {
         fail_if_error(yr_parser_reduce_operation(
             yyscanner, "<", (yyvsp[-2].expression), (yyvsp[0].expression)));
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3706 "grammar.c"
+#line 3715 "grammar.c"
     break;
 
   case 106: /* expression: primary_expression ">" primary_expression  */
-#line 1950 "grammar.y"
+#line 1959 "grammar.y"
       {
         fail_if_error(yr_parser_reduce_operation(
             yyscanner, ">", (yyvsp[-2].expression), (yyvsp[0].expression)));
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3717 "grammar.c"
+#line 3726 "grammar.c"
     break;
 
   case 107: /* expression: primary_expression "<=" primary_expression  */
-#line 1957 "grammar.y"
+#line 1966 "grammar.y"
       {
         fail_if_error(yr_parser_reduce_operation(
             yyscanner, "<=", (yyvsp[-2].expression), (yyvsp[0].expression)));
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3728 "grammar.c"
+#line 3737 "grammar.c"
     break;
 
   case 108: /* expression: primary_expression ">=" primary_expression  */
-#line 1964 "grammar.y"
+#line 1973 "grammar.y"
       {
         fail_if_error(yr_parser_reduce_operation(
             yyscanner, ">=", (yyvsp[-2].expression), (yyvsp[0].expression)));
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3739 "grammar.c"
+#line 3748 "grammar.c"
     break;
 
   case 109: /* expression: primary_expression "==" primary_expression  */
-#line 1971 "grammar.y"
+#line 1980 "grammar.y"
       {
         fail_if_error(yr_parser_reduce_operation(
             yyscanner, "==", (yyvsp[-2].expression), (yyvsp[0].expression)));
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3750 "grammar.c"
+#line 3759 "grammar.c"
     break;
 
   case 110: /* expression: primary_expression "!=" primary_expression  */
-#line 1978 "grammar.y"
+#line 1987 "grammar.y"
       {
         fail_if_error(yr_parser_reduce_operation(
             yyscanner, "!=", (yyvsp[-2].expression), (yyvsp[0].expression)));
 
         (yyval.expression).type = EXPRESSION_TYPE_BOOLEAN;
       }
-#line 3761 "grammar.c"
+#line 3770 "grammar.c"
     break;
 
   case 111: /* expression: primary_expression  */
-#line 1985 "grammar.y"
+#line 1994 "grammar.y"
       {
         (yyval.expression) = (yyvsp[0].expression);
       }
-#line 3769 "grammar.c"
+#line 3778 "grammar.c"
     break;
 
   case 112: /* expression: '(' expression ')'  */
-#line 1989 "grammar.y"
+#line 1998 "grammar.y"
       {
         (yyval.expression) = (yyvsp[-1].expression);
       }
-#line 3777 "grammar.c"
+#line 3786 "grammar.c"
     break;
 
   case 113: /* for_variables: "identifier"  */
-#line 1997 "grammar.y"
+#line 2006 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -3797,11 +3806,11 @@ yyreduce:
 
         assert(loop_ctx->vars_count <= YR_MAX_LOOP_VARS);
       }
-#line 3801 "grammar.c"
+#line 3810 "grammar.c"
     break;
 
   case 114: /* for_variables: for_variables ',' "identifier"  */
-#line 2017 "grammar.y"
+#line 2026 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -3826,11 +3835,11 @@ yyreduce:
 
         loop_ctx->vars[loop_ctx->vars_count++].identifier.ptr = (yyvsp[0].c_string);
       }
-#line 3830 "grammar.c"
+#line 3839 "grammar.c"
     break;
 
   case 115: /* iterator: identifier  */
-#line 2045 "grammar.y"
+#line 2054 "grammar.y"
       {
         YR_LOOP_CONTEXT* loop_ctx = &compiler->loop[compiler->loop_index];
 
@@ -3904,11 +3913,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 3908 "grammar.c"
+#line 3917 "grammar.c"
     break;
 
   case 116: /* iterator: integer_set  */
-#line 2119 "grammar.y"
+#line 2128 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -3932,11 +3941,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 3936 "grammar.c"
+#line 3945 "grammar.c"
     break;
 
   case 117: /* integer_set: '(' integer_enumeration ')'  */
-#line 2147 "grammar.y"
+#line 2156 "grammar.y"
       {
         // $2 contains the number of integers in the enumeration
         fail_if_error(yr_parser_emit_push_const(yyscanner, (yyvsp[-1].integer)));
@@ -3944,20 +3953,20 @@ yyreduce:
         fail_if_error(yr_parser_emit(
             yyscanner, OP_ITER_START_INT_ENUM, NULL));
       }
-#line 3948 "grammar.c"
+#line 3957 "grammar.c"
     break;
 
   case 118: /* integer_set: range  */
-#line 2155 "grammar.y"
+#line 2164 "grammar.y"
       {
         fail_if_error(yr_parser_emit(
             yyscanner, OP_ITER_START_INT_RANGE, NULL));
       }
-#line 3957 "grammar.c"
+#line 3966 "grammar.c"
     break;
 
   case 119: /* range: '(' primary_expression ".." primary_expression ')'  */
-#line 2164 "grammar.y"
+#line 2173 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -3977,11 +3986,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 3981 "grammar.c"
+#line 3990 "grammar.c"
     break;
 
   case 120: /* integer_enumeration: primary_expression  */
-#line 2188 "grammar.y"
+#line 2197 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -3996,11 +4005,11 @@ yyreduce:
 
         (yyval.integer) = 1;
       }
-#line 4000 "grammar.c"
+#line 4009 "grammar.c"
     break;
 
   case 121: /* integer_enumeration: integer_enumeration ',' primary_expression  */
-#line 2203 "grammar.y"
+#line 2212 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -4015,62 +4024,62 @@ yyreduce:
 
         (yyval.integer) = (yyvsp[-2].integer) + 1;
       }
-#line 4019 "grammar.c"
+#line 4028 "grammar.c"
     break;
 
   case 122: /* $@11: %empty  */
-#line 2222 "grammar.y"
+#line 2231 "grammar.y"
       {
         // Push end-of-list marker
         yr_parser_emit_push_const(yyscanner, YR_UNDEFINED);
       }
-#line 4028 "grammar.c"
+#line 4037 "grammar.c"
     break;
 
   case 124: /* string_set: "<them>"  */
-#line 2228 "grammar.y"
+#line 2237 "grammar.y"
       {
         fail_if_error(yr_parser_emit_push_const(yyscanner, YR_UNDEFINED));
 
         fail_if_error(yr_parser_emit_pushes_for_strings(
             yyscanner, "$*"));
       }
-#line 4039 "grammar.c"
+#line 4048 "grammar.c"
     break;
 
   case 127: /* string_enumeration_item: "string identifier"  */
-#line 2245 "grammar.y"
+#line 2254 "grammar.y"
       {
         int result = yr_parser_emit_pushes_for_strings(yyscanner, (yyvsp[0].c_string));
         yr_free((yyvsp[0].c_string));
 
         fail_if_error(result);
       }
-#line 4050 "grammar.c"
+#line 4059 "grammar.c"
     break;
 
   case 128: /* string_enumeration_item: "string identifier with wildcard"  */
-#line 2252 "grammar.y"
+#line 2261 "grammar.y"
       {
         int result = yr_parser_emit_pushes_for_strings(yyscanner, (yyvsp[0].c_string));
         yr_free((yyvsp[0].c_string));
 
         fail_if_error(result);
       }
-#line 4061 "grammar.c"
+#line 4070 "grammar.c"
     break;
 
   case 129: /* $@12: %empty  */
-#line 2263 "grammar.y"
+#line 2272 "grammar.y"
       {
         // Push end-of-list marker
         yr_parser_emit_push_const(yyscanner, YR_UNDEFINED);
       }
-#line 4070 "grammar.c"
+#line 4079 "grammar.c"
     break;
 
   case 133: /* rule_enumeration_item: "identifier"  */
-#line 2279 "grammar.y"
+#line 2288 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -4101,11 +4110,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4105 "grammar.c"
+#line 4114 "grammar.c"
     break;
 
   case 134: /* rule_enumeration_item: "identifier" '*'  */
-#line 2310 "grammar.y"
+#line 2319 "grammar.y"
       {
         YR_NAMESPACE* ns = (YR_NAMESPACE*) yr_arena_get_ptr(
             compiler->arena,
@@ -4123,54 +4132,54 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4127 "grammar.c"
+#line 4136 "grammar.c"
     break;
 
   case 135: /* for_expression: primary_expression  */
-#line 2332 "grammar.y"
+#line 2341 "grammar.y"
       {
         (yyval.integer) = FOR_EXPRESSION_ANY;
       }
-#line 4135 "grammar.c"
+#line 4144 "grammar.c"
     break;
 
   case 136: /* for_expression: "<all>"  */
-#line 2336 "grammar.y"
+#line 2345 "grammar.y"
       {
         yr_parser_emit_push_const(yyscanner, YR_UNDEFINED);
         (yyval.integer) = FOR_EXPRESSION_ALL;
       }
-#line 4144 "grammar.c"
+#line 4153 "grammar.c"
     break;
 
   case 137: /* for_expression: "<any>"  */
-#line 2341 "grammar.y"
+#line 2350 "grammar.y"
       {
         yr_parser_emit_push_const(yyscanner, 1);
         (yyval.integer) = FOR_EXPRESSION_ANY;
       }
-#line 4153 "grammar.c"
+#line 4162 "grammar.c"
     break;
 
   case 138: /* for_expression: "<none>"  */
-#line 2346 "grammar.y"
+#line 2355 "grammar.y"
       {
         yr_parser_emit_push_const(yyscanner, 0);
         (yyval.integer) = FOR_EXPRESSION_NONE;
       }
-#line 4162 "grammar.c"
+#line 4171 "grammar.c"
     break;
 
   case 139: /* primary_expression: '(' primary_expression ')'  */
-#line 2355 "grammar.y"
+#line 2364 "grammar.y"
       {
         (yyval.expression) = (yyvsp[-1].expression);
       }
-#line 4170 "grammar.c"
+#line 4179 "grammar.c"
     break;
 
   case 140: /* primary_expression: "<filesize>"  */
-#line 2359 "grammar.y"
+#line 2368 "grammar.y"
       {
         fail_if_error(yr_parser_emit(
             yyscanner, OP_FILESIZE, NULL));
@@ -4178,11 +4187,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4182 "grammar.c"
+#line 4191 "grammar.c"
     break;
 
   case 141: /* primary_expression: "<entrypoint>"  */
-#line 2367 "grammar.y"
+#line 2376 "grammar.y"
       {
         yywarning(yyscanner,
             "Using deprecated \"entrypoint\" keyword. Use the \"entry_point\" "
@@ -4194,11 +4203,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4198 "grammar.c"
+#line 4207 "grammar.c"
     break;
 
   case 142: /* primary_expression: "integer function" '(' primary_expression ')'  */
-#line 2379 "grammar.y"
+#line 2388 "grammar.y"
       {
         check_type((yyvsp[-1].expression), EXPRESSION_TYPE_INTEGER, "intXXXX or uintXXXX");
 
@@ -4212,33 +4221,33 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4216 "grammar.c"
+#line 4225 "grammar.c"
     break;
 
   case 143: /* primary_expression: "integer number"  */
-#line 2393 "grammar.y"
+#line 2402 "grammar.y"
       {
         fail_if_error(yr_parser_emit_push_const(yyscanner, (yyvsp[0].integer)));
 
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = (yyvsp[0].integer);
       }
-#line 4227 "grammar.c"
+#line 4236 "grammar.c"
     break;
 
   case 144: /* primary_expression: "floating point number"  */
-#line 2400 "grammar.y"
+#line 2409 "grammar.y"
       {
         fail_if_error(yr_parser_emit_with_arg_double(
             yyscanner, OP_PUSH, (yyvsp[0].double_), NULL, NULL));
 
         (yyval.expression).type = EXPRESSION_TYPE_FLOAT;
       }
-#line 4238 "grammar.c"
+#line 4247 "grammar.c"
     break;
 
   case 145: /* primary_expression: "text string"  */
-#line 2407 "grammar.y"
+#line 2416 "grammar.y"
       {
         YR_ARENA_REF ref;
 
@@ -4263,11 +4272,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_STRING;
         (yyval.expression).value.sized_string_ref = ref;
       }
-#line 4267 "grammar.c"
+#line 4276 "grammar.c"
     break;
 
   case 146: /* primary_expression: "string count" "<in>" range  */
-#line 2432 "grammar.y"
+#line 2441 "grammar.y"
       {
         int result = yr_parser_reduce_string_identifier(
             yyscanner, (yyvsp[-2].c_string), OP_COUNT_IN, YR_UNDEFINED);
@@ -4279,11 +4288,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4283 "grammar.c"
+#line 4292 "grammar.c"
     break;
 
   case 147: /* primary_expression: "string count"  */
-#line 2444 "grammar.y"
+#line 2453 "grammar.y"
       {
         int result = yr_parser_reduce_string_identifier(
             yyscanner, (yyvsp[0].c_string), OP_COUNT, YR_UNDEFINED);
@@ -4295,11 +4304,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4299 "grammar.c"
+#line 4308 "grammar.c"
     break;
 
   case 148: /* primary_expression: "string offset" '[' primary_expression ']'  */
-#line 2456 "grammar.y"
+#line 2465 "grammar.y"
       {
         int result = yr_parser_reduce_string_identifier(
             yyscanner, (yyvsp[-3].c_string), OP_OFFSET, YR_UNDEFINED);
@@ -4311,11 +4320,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4315 "grammar.c"
+#line 4324 "grammar.c"
     break;
 
   case 149: /* primary_expression: "string offset"  */
-#line 2468 "grammar.y"
+#line 2477 "grammar.y"
       {
         int result = yr_parser_emit_push_const(yyscanner, 1);
 
@@ -4330,11 +4339,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4334 "grammar.c"
+#line 4343 "grammar.c"
     break;
 
   case 150: /* primary_expression: "string length" '[' primary_expression ']'  */
-#line 2483 "grammar.y"
+#line 2492 "grammar.y"
       {
         int result = yr_parser_reduce_string_identifier(
             yyscanner, (yyvsp[-3].c_string), OP_LENGTH, YR_UNDEFINED);
@@ -4346,11 +4355,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4350 "grammar.c"
+#line 4359 "grammar.c"
     break;
 
   case 151: /* primary_expression: "string length"  */
-#line 2495 "grammar.y"
+#line 2504 "grammar.y"
       {
         int result = yr_parser_emit_push_const(yyscanner, 1);
 
@@ -4365,11 +4374,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = YR_UNDEFINED;
       }
-#line 4369 "grammar.c"
+#line 4378 "grammar.c"
     break;
 
   case 152: /* primary_expression: identifier  */
-#line 2510 "grammar.y"
+#line 2519 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -4412,11 +4421,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4416 "grammar.c"
+#line 4425 "grammar.c"
     break;
 
   case 153: /* primary_expression: '-' primary_expression  */
-#line 2553 "grammar.y"
+#line 2562 "grammar.y"
       {
         int result = ERROR_SUCCESS;
 
@@ -4437,11 +4446,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4441 "grammar.c"
+#line 4450 "grammar.c"
     break;
 
   case 154: /* primary_expression: primary_expression '+' primary_expression  */
-#line 2574 "grammar.y"
+#line 2583 "grammar.y"
       {
         int result = yr_parser_reduce_operation(
             yyscanner, "+", (yyvsp[-2].expression), (yyvsp[0].expression));
@@ -4476,11 +4485,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4480 "grammar.c"
+#line 4489 "grammar.c"
     break;
 
   case 155: /* primary_expression: primary_expression '-' primary_expression  */
-#line 2609 "grammar.y"
+#line 2618 "grammar.y"
       {
         int result = yr_parser_reduce_operation(
             yyscanner, "-", (yyvsp[-2].expression), (yyvsp[0].expression));
@@ -4515,11 +4524,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4519 "grammar.c"
+#line 4528 "grammar.c"
     break;
 
   case 156: /* primary_expression: primary_expression '*' primary_expression  */
-#line 2644 "grammar.y"
+#line 2653 "grammar.y"
       {
         int result = yr_parser_reduce_operation(
             yyscanner, "*", (yyvsp[-2].expression), (yyvsp[0].expression));
@@ -4553,11 +4562,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4557 "grammar.c"
+#line 4566 "grammar.c"
     break;
 
   case 157: /* primary_expression: primary_expression '\\' primary_expression  */
-#line 2678 "grammar.y"
+#line 2687 "grammar.y"
       {
         int result = yr_parser_reduce_operation(
             yyscanner, "\\", (yyvsp[-2].expression), (yyvsp[0].expression));
@@ -4582,11 +4591,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4586 "grammar.c"
+#line 4595 "grammar.c"
     break;
 
   case 158: /* primary_expression: primary_expression '%' primary_expression  */
-#line 2703 "grammar.y"
+#line 2712 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_INTEGER, "%");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_INTEGER, "%");
@@ -4603,11 +4612,11 @@ yyreduce:
           fail_if_error(ERROR_DIVISION_BY_ZERO);
         }
       }
-#line 4607 "grammar.c"
+#line 4616 "grammar.c"
     break;
 
   case 159: /* primary_expression: primary_expression '^' primary_expression  */
-#line 2720 "grammar.y"
+#line 2729 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_INTEGER, "^");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_INTEGER, "^");
@@ -4617,11 +4626,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = OPERATION(^, (yyvsp[-2].expression).value.integer, (yyvsp[0].expression).value.integer);
       }
-#line 4621 "grammar.c"
+#line 4630 "grammar.c"
     break;
 
   case 160: /* primary_expression: primary_expression '&' primary_expression  */
-#line 2730 "grammar.y"
+#line 2739 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_INTEGER, "^");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_INTEGER, "^");
@@ -4631,11 +4640,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = OPERATION(&, (yyvsp[-2].expression).value.integer, (yyvsp[0].expression).value.integer);
       }
-#line 4635 "grammar.c"
+#line 4644 "grammar.c"
     break;
 
   case 161: /* primary_expression: primary_expression '|' primary_expression  */
-#line 2740 "grammar.y"
+#line 2749 "grammar.y"
       {
         check_type((yyvsp[-2].expression), EXPRESSION_TYPE_INTEGER, "|");
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_INTEGER, "|");
@@ -4645,11 +4654,11 @@ yyreduce:
         (yyval.expression).type = EXPRESSION_TYPE_INTEGER;
         (yyval.expression).value.integer = OPERATION(|, (yyvsp[-2].expression).value.integer, (yyvsp[0].expression).value.integer);
       }
-#line 4649 "grammar.c"
+#line 4658 "grammar.c"
     break;
 
   case 162: /* primary_expression: '~' primary_expression  */
-#line 2750 "grammar.y"
+#line 2759 "grammar.y"
       {
         check_type((yyvsp[0].expression), EXPRESSION_TYPE_INTEGER, "~");
 
@@ -4659,11 +4668,11 @@ yyreduce:
         (yyval.expression).value.integer = ((yyvsp[0].expression).value.integer == YR_UNDEFINED) ?
             YR_UNDEFINED : ~((yyvsp[0].expression).value.integer);
       }
-#line 4663 "grammar.c"
+#line 4672 "grammar.c"
     break;
 
   case 163: /* primary_expression: primary_expression "<<" primary_expression  */
-#line 2760 "grammar.y"
+#line 2769 "grammar.y"
       {
         int result;
 
@@ -4683,11 +4692,11 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4687 "grammar.c"
+#line 4696 "grammar.c"
     break;
 
   case 164: /* primary_expression: primary_expression ">>" primary_expression  */
-#line 2780 "grammar.y"
+#line 2789 "grammar.y"
       {
         int result;
 
@@ -4707,19 +4716,19 @@ yyreduce:
 
         fail_if_error(result);
       }
-#line 4711 "grammar.c"
+#line 4720 "grammar.c"
     break;
 
   case 165: /* primary_expression: regexp  */
-#line 2800 "grammar.y"
+#line 2809 "grammar.y"
       {
         (yyval.expression) = (yyvsp[0].expression);
       }
-#line 4719 "grammar.c"
+#line 4728 "grammar.c"
     break;
 
 
-#line 4723 "grammar.c"
+#line 4732 "grammar.c"
 
       default: break;
     }
@@ -4912,5 +4921,5 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 2805 "grammar.y"
+#line 2814 "grammar.y"
 
@@ -1083,30 +1083,45 @@ identifier
       {
         YR_ARENA_REF ref;
         int result = ERROR_SUCCESS;
+        int32_t prototype_idx;
         YR_OBJECT_FUNCTION* function;
 
         if ($1.type == EXPRESSION_TYPE_OBJECT &&
             $1.value.object->type == OBJECT_TYPE_FUNCTION)
         {
           result = yr_parser_check_types(
-              compiler, object_as_function($1.value.object), $3);
+              compiler, object_as_function($1.value.object), $3,
+              &prototype_idx);
 
           if (result == ERROR_SUCCESS)
             result = _yr_compiler_store_string(
                 compiler, $3, &ref);
 
           if (result == ERROR_SUCCESS)
-            result = yr_parser_emit_with_arg_reloc(
+            result = yr_parser_emit_call(
                 yyscanner,
-                OP_CALL,
-                yr_arena_ref_to_ptr(compiler->arena, &ref),
-                NULL,
-                NULL);
+                object_as_function($1.value.object),
+                $3,
+                prototype_idx);
 
           function = object_as_function($1.value.object);
 
-          $$.type = EXPRESSION_TYPE_OBJECT;
-          $$.value.object = function->return_obj;
+          // Calls to functions returning integers or floats leave the value
+          // in the stack, only strings are returned as objects. See OP_CALL.
+          switch (function->return_obj->type)
+          {
+            case OBJECT_TYPE_INTEGER:
+              $$.type = EXPRESSION_TYPE_INTEGER;
+              $$.value.integer = YR_UNDEFINED;
+              break;
+            case OBJECT_TYPE_FLOAT:
+              $$.type = EXPRESSION_TYPE_FLOAT;
+              break;
+            default:
+              $$.type = EXPRESSION_TYPE_OBJECT;
+              $$.value.object = function->return_obj;
+          }
+
           $$.identifier.ref = ref;
           $$.identifier.ptr = NULL;
         }
@@ -1233,12 +1248,8 @@ regexp
         if ($1->flags & SIZED_STRING_FLAGS_DOT_ALL)
           re_flags |= RE_FLAGS_DOT_ALL;
 
-        result = yr_re_compile(
-            $1->c_string,
-            re_flags,
-            compiler->arena,
-            &re_ref,
-            &error);
+        result = _yr_compiler_store_regexp(
+            compiler, $1->c_string, re_flags, &re_ref, &error);
 
         yr_free($1);
 
@@ -1874,11 +1885,9 @@ expression
       }
       boolean_expression
       {
-        YR_FIXUP* fixup;
+        YR_FIXUP* fixup = compiler->fixup_stack_head;
 
-        fail_if_error(yr_parser_emit(yyscanner, OP_AND, NULL));
-
-        fixup = compiler->fixup_stack_head;
+        fail_if_error(yr_parser_emit_and(yyscanner, &fixup->ref));
 
         int32_t* jmp_offset_addr = (int32_t*) yr_arena_ref_to_ptr(
             compiler->arena, &fixup->ref);
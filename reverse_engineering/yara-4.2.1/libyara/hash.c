@@ -162,6 +162,8 @@ static void* _yr_hash_table_lookup(
 
         yr_free(entry->key);
         yr_free(entry);
+
+        table->num_entries--;
       }
 
       return result;
@@ -186,6 +188,7 @@ YR_API int yr_hash_table_create(int size, YR_HASH_TABLE** table)
     return ERROR_INSUFFICIENT_MEMORY;
 
   new_table->size = size;
+  new_table->num_entries = 0;
 
   for (i = 0; i < size; i++) new_table->buckets[i] = NULL;
 
@@ -206,7 +209,7 @@ YR_API void yr_hash_table_clean(
   if (table == NULL)
     return;
 
-  for (i = 0; i < table->size; i++)
+  for (i = 0; i < table->size && table->num_entries > 0; i++)
   {
     entry = table->buckets[i];
 
@@ -223,6 +226,7 @@ YR_API void yr_hash_table_clean(
       yr_free(entry->key);
       yr_free(entry);
 
+      table->num_entries--;
       entry = next_entry;
     }
 
@@ -245,16 +249,19 @@ YR_API int yr_hash_table_iterate(
     void* data)
 {
   int result;
+  int visited = 0;
   YR_HASH_TABLE_ENTRY* entry;
 
   if (table == NULL)
     return ERROR_INTERNAL_FATAL_ERROR;
 
-  for (int i = 0; i < table->size; i++)
+  for (int i = 0; i < table->size && visited < table->num_entries; i++)
   {
     entry = table->buckets[i];
     while (entry != NULL)
     {
+      visited++;
+
       if (!strcmp(entry->ns, ns))
       {
         result = iterate_func(
@@ -341,6 +348,7 @@ YR_API int yr_hash_table_add_raw_key(
 
   entry->next = table->buckets[bucket_index];
   table->buckets[bucket_index] = entry;
+  table->num_entries++;
 
   return ERROR_SUCCESS;
 }
@@ -61,8 +61,45 @@ int yr_ac_add_string(
     YR_ATOM_LIST_ITEM* atom,
     YR_ARENA* arena);
 
+int yr_ac_add_matches(
+    YR_AC_AUTOMATON* automaton,
+    YR_AC_AUTOMATON* other,
+    yr_arena_off_t matches_offset);
+
 int yr_ac_compile(YR_AC_AUTOMATON* automaton, YR_ARENA* arena);
 
+int yr_ac_automaton_create_patchable(YR_AC_AUTOMATON** automaton);
+
+int yr_ac_add_match(
+    YR_AC_AUTOMATON* automaton,
+    const uint8_t* bytes,
+    int length,
+    uint32_t* match_id);
+
+int yr_ac_remove_match(YR_AC_AUTOMATON* automaton, uint32_t match_id);
+
+int yr_ac_patch(YR_AC_AUTOMATON* automaton);
+
+int yr_ac_write_tables(
+    YR_AC_AUTOMATON* automaton,
+    YR_ARENA* arena,
+    const uint32_t* pool_indexes);
+
 void yr_ac_print_automaton(YR_AC_AUTOMATON* automaton);
 
+int yr_ac_prefilter_create(
+    const YR_AC_TRANSITION* transition_table,
+    const uint32_t* match_table,
+    YR_AC_PREFILTER** prefilter);
+
+void yr_ac_prefilter_destroy(YR_AC_PREFILTER* prefilter);
+
+// Implementations of the prefilter's find function, see
+// yr_ac_prefilter_set_find.
+#define YR_AC_PREFILTER_SCALAR 0
+#define YR_AC_PREFILTER_SSE42  1
+#define YR_AC_PREFILTER_AVX2   2
+
+int yr_ac_prefilter_set_find(YR_AC_PREFILTER* prefilter, int implementation);
+
 #endif
@@ -31,13 +31,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define YR_ARENA_H
 
 #include <stddef.h>
+#include <yara/filemap.h>
 #include <yara/integers.h>
 #include <yara/limits.h>
 #include <yara/stream.h>
 
 #define EOL ((size_t) -1)
 
-#define YR_ARENA_FILE_VERSION 19
+#define YR_ARENA_FILE_VERSION 24
 
 #define YR_ARENA_NULL_REF \
   (YR_ARENA_REF) { UINT32_MAX, UINT32_MAX }
@@ -159,6 +160,29 @@ struct YR_ARENA
 
   // Tail of the list containing relocation entries.
   YR_RELOC* reloc_list_tail;
+
+  // Arenas loaded with yr_arena_load_file or yr_arena_attach_fd have their
+  // buffers inside a private copy-on-write mapping of the file, which starts
+  // at mapped_data. Only the pages where relocatable pointers are adjusted
+  // become private copies, the rest are shared with the page cache.
+  // mapping_handle is the handle for the file mapping on Windows, and NULL in
+  // other platforms.
+  uint8_t* mapped_data;
+  size_t mapped_size;
+  void* mapping_handle;
+
+  // Mapped arenas keep their relocation entries in the mapped file, as an
+  // array of num_mapped_relocs YR_ARENA_REF structures starting at
+  // mapped_relocs. They are converted to YR_RELOC entries, all of them
+  // allocated at once in reloc_pool, only when the relocation list is needed,
+  // for instance when the arena is saved.
+  const uint8_t* mapped_relocs;
+  size_t num_mapped_relocs;
+  YR_RELOC* reloc_pool;
+
+  // Tag stored along with the arena by yr_arena_publish_fd, for arenas created
+  // by yr_arena_attach_fd. Points into the mapping, NULL if there's no tag.
+  const char* tag;
 };
 
 // Creates an arena with the specified number of buffers and takes ownership of
@@ -215,6 +239,8 @@ int yr_arena_allocate_zeroed_memory(
     size_t size,
     YR_ARENA_REF* ref);
 
+int yr_arena_reserve_memory(YR_ARENA* arena, uint32_t buffer_id, size_t size);
+
 int yr_arena_allocate_struct(
     YR_ARENA* arena,
     uint32_t buffer_id,
@@ -245,6 +271,22 @@ int yr_arena_write_uint32(
 
 int yr_arena_load_stream(YR_STREAM* stream, YR_ARENA** arena);
 
+// Loads an arena saved with yr_arena_save_stream from a file by mapping the
+// file in memory instead of reading it. Returns ERROR_COULD_NOT_MAP_FILE if
+// the file can't be mapped, in which case yr_arena_load_stream can be used.
+int yr_arena_load_file(const char* filename, YR_ARENA** arena);
+
 int yr_arena_save_stream(YR_ARENA* arena, YR_STREAM* stream);
 
+// Writes an arena into an empty shared memory object, with its relocatable
+// pointers already adjusted, so that other processes can use it with
+// yr_arena_attach_fd without copying it. The optional tag is stored in the
+// object too. Not supported in Windows, where it returns
+// ERROR_COULD_NOT_MAP_FILE.
+int yr_arena_publish_fd(YR_ARENA* arena, YR_FILE_DESCRIPTOR fd, const char* tag);
+
+// Creates an arena from a shared memory object written by yr_arena_publish_fd.
+// The object is mapped as private and copy-on-write, and is never modified.
+int yr_arena_attach_fd(YR_FILE_DESCRIPTOR fd, YR_ARENA** arena);
+
 #endif  // YR_ARENA_H
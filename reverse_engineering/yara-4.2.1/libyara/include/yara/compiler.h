@@ -65,10 +65,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define YR_AC_STATE_MATCHES_TABLE   9
 #define YR_AC_STATE_MATCHES_POOL    10
 #define YR_SUMMARY_SECTION          11
+#define YR_GUARD_CODE_SECTION       12
 
 // This is the number of buffers used by the compiler, should match the number
 // of items in the list above.
-#define YR_NUM_SECTIONS 12
+#define YR_NUM_SECTIONS 13
 
 // Number of variables used by loops. This doesn't include user defined
 // variables.
@@ -122,6 +123,9 @@ typedef void (*YR_COMPILER_RE_AST_CALLBACK_FUNC)(
     const RE_AST* re_ast,
     void* user_data);
 
+// Compiled rules kept between compilations, see yr_compiler_set_cache.
+typedef struct YR_COMPILER_CACHE YR_COMPILER_CACHE;
+
 typedef struct _YR_FIXUP
 {
   YR_ARENA_REF ref;
@@ -129,6 +133,31 @@ typedef struct _YR_FIXUP
 
 } YR_FIXUP;
 
+// Offsets within YR_CODE_SECTION of the OP_JFALSE and OP_AND instructions
+// emitted for an "and" operator. The compiler records them for every "and"
+// in the condition of the rule being parsed, so that it can find the
+// operands of the topmost ones once the condition is complete.
+
+typedef struct _YR_CONDITION_AND
+{
+  yr_arena_off_t jfalse_offset;
+  yr_arena_off_t and_offset;
+
+} YR_CONDITION_AND;
+
+// Location of a rule index written in YR_CODE_SECTION or YR_GUARD_CODE_SECTION,
+// like the arguments of OP_INIT_RULE, OP_MATCH_RULE, OP_PUSH_RULE and
+// OP_GUARD_RULE. The size of the index is either 4 or 8 bytes. Compilers used
+// by yr_compiler_add_files record them, so that the indexes can be adjusted
+// when their rules are moved to another compiler.
+
+typedef struct _YR_RULE_IDX_LOCATION
+{
+  YR_ARENA_REF ref;
+  uint32_t size;
+
+} YR_RULE_IDX_LOCATION;
+
 // Each "for" loop in the condition has an associated context which holds
 // information about loop, like the target address for the jump instruction
 // that goes back to the beginning of the loop and the local variables used
@@ -191,6 +220,11 @@ typedef struct _YR_COMPILER
   //      the matches pool where the list of matches for that state begins.
   //   YR_AC_STATE_MATCHES_POOL:
   //      An array of YR_AC_MATCH structures.
+  //   YR_GUARD_CODE_SECTION:
+  //      Code evaluated by yr_execute_guards before scanning the data. For
+  //      each rule with strings whose condition starts with a part that
+  //      doesn't depend on them, it contains a copy of that part followed
+  //      by an OP_GUARD_RULE instruction.
   //
   YR_ARENA* arena;
 
@@ -252,8 +286,47 @@ typedef struct _YR_COMPILER
   // writting it again.
   YR_HASH_TABLE* sz_table;
 
+  // Hash table that contains the regular expressions used in conditions. Keys
+  // are the regexp's flags followed by its source, values are the offset within
+  // YR_RE_CODE_SECTION where the compiled regexp resides. Identical regexps are
+  // compiled only once, so they have the same address while scanning, which
+  // allows modules to cache results computed with them. The compiled regexps
+  // are stored contiguously, and regexps_lengths maps the same keys to their
+  // lengths in YR_RE_CODE_SECTION.
+  YR_HASH_TABLE* regexps_table;
+  YR_HASH_TABLE* regexps_lengths;
+
+  // Hash table with the module functions called in conditions, identified
+  // like "hash.md5(ii)". The same identifiers are appended to the
+  // called_functions buffer, each one followed by a null character, which is
+  // written to YR_SZ_POOL when the rules are compiled. See YR_SUMMARY.
+  YR_HASH_TABLE* called_functions_table;
+  char* called_functions;
+  size_t called_functions_length;
+
   YR_FIXUP* fixup_stack_head;
 
+  // Offset within YR_CODE_SECTION where the condition of the current rule
+  // starts, and offset of the first instruction in that condition that
+  // depends on something else than the scanned data and its size, like
+  // strings, other rules, modules or external variables. If there's no such
+  // instruction yet, scan_dependent_offset is UINT32_MAX.
+  yr_arena_off_t condition_offset;
+  yr_arena_off_t scan_dependent_offset;
+
+  // "and" operators found so far in the condition of the current rule, see
+  // YR_CONDITION_AND.
+  YR_CONDITION_AND* condition_ands;
+  uint32_t num_condition_ands;
+  uint32_t max_condition_ands;
+
+  // Locations of the rule indexes emitted so far, see YR_RULE_IDX_LOCATION.
+  // They are recorded only if track_rule_idx is true.
+  bool track_rule_idx;
+  YR_RULE_IDX_LOCATION* rule_idx_locations;
+  uint32_t num_rule_idx_locations;
+  uint32_t max_rule_idx_locations;
+
   int num_namespaces;
 
   YR_LOOP_CONTEXT loop[YR_MAX_LOOP_NESTING];
@@ -263,6 +336,12 @@ typedef struct _YR_COMPILER
   char* file_name_stack[YR_MAX_INCLUDE_DEPTH];
   int file_name_stack_ptr;
 
+  // Names of the files included so far, as passed to the include callback,
+  // each one followed by a null character. The buffer has an additional null
+  // character at the end. See yr_compiler_get_included_files.
+  char* included_files;
+  size_t included_files_length;
+
   char last_error_extra_info[YR_MAX_COMPILER_ERROR_EXTRA_INFO];
 
   // This buffer is used by the lexer for accumulating text strings. Those
@@ -284,6 +363,9 @@ typedef struct _YR_COMPILER
   YR_COMPILER_RE_AST_CALLBACK_FUNC re_ast_callback;
   YR_ATOMS_CONFIG atoms_config;
 
+  // Cache used by the compiler, or NULL. See yr_compiler_set_cache.
+  YR_COMPILER_CACHE* cache;
+
 } YR_COMPILER;
 
 #define yr_compiler_set_error_extra_info(compiler, info) \
@@ -303,6 +385,10 @@ int _yr_compiler_push_file_name(YR_COMPILER* compiler, const char* file_name);
 
 void _yr_compiler_pop_file_name(YR_COMPILER* compiler);
 
+int _yr_compiler_add_included_file(
+    YR_COMPILER* compiler,
+    const char* file_name);
+
 int _yr_compiler_get_var_frame(YR_COMPILER* compiler);
 
 const char* _yr_compiler_default_include_callback(
@@ -324,6 +410,54 @@ int _yr_compiler_store_data(
     size_t data_length,
     YR_ARENA_REF* ref);
 
+int _yr_compiler_add_rule_idx_location(
+    YR_COMPILER* compiler,
+    YR_ARENA_REF* ref,
+    uint32_t size);
+
+int _yr_compiler_add_called_function(
+    YR_COMPILER* compiler,
+    const char* identifier);
+
+int _yr_compiler_store_regexp(
+    YR_COMPILER* compiler,
+    const char* re_string,
+    int flags,
+    YR_ARENA_REF* ref,
+    RE_ERROR* error);
+
+int _yr_compiler_set_namespace(YR_COMPILER* compiler, const char* namespace_);
+
+int _yr_compiler_read_file(FILE* fh, uint8_t** data, size_t* data_size);
+
+int _yr_compiler_cache_add_bytes(
+    YR_COMPILER* compiler,
+    const void* rules_data,
+    size_t rules_size,
+    const char* namespace_,
+    const char* file_name);
+
+int _yr_compiler_cache_add_string(
+    YR_COMPILER* compiler,
+    uint32_t string_idx,
+    YR_ATOM_LIST_ITEM* atom);
+
+int _yr_compiler_cache_add_unit(
+    YR_COMPILER* compiler,
+    uint32_t buffer_id,
+    const void* key,
+    size_t key_length,
+    yr_arena_off_t offset,
+    yr_arena_off_t length);
+
+int _yr_compiler_cache_add_called_function(
+    YR_COMPILER* compiler,
+    const char* identifier);
+
+int _yr_compiler_cache_write_automaton(YR_COMPILER* compiler);
+
+void _yr_compiler_cache_detach(YR_COMPILER* compiler);
+
 YR_API int yr_compiler_create(YR_COMPILER** compiler);
 
 YR_API void yr_compiler_destroy(YR_COMPILER* compiler);
@@ -361,6 +495,14 @@ YR_API int yr_compiler_add_file(
     const char* namespace_,
     const char* file_name);
 
+YR_API int yr_compiler_add_files(
+    YR_COMPILER* compiler,
+    int num_files,
+    FILE** rules_files,
+    const char** namespaces,
+    const char** file_names,
+    int threads);
+
 YR_API int yr_compiler_add_fd(
     YR_COMPILER* compiler,
     YR_FILE_DESCRIPTOR rules_fd,
@@ -379,6 +521,8 @@ YR_API char* yr_compiler_get_error_message(
 
 YR_API char* yr_compiler_get_current_file_name(YR_COMPILER* compiler);
 
+YR_API const char* yr_compiler_get_included_files(YR_COMPILER* compiler);
+
 YR_API int yr_compiler_define_integer_variable(
     YR_COMPILER* compiler,
     const char* identifier,
@@ -401,4 +545,12 @@ YR_API int yr_compiler_define_string_variable(
 
 YR_API int yr_compiler_get_rules(YR_COMPILER* compiler, YR_RULES** rules);
 
+YR_API int yr_compiler_cache_create(YR_COMPILER_CACHE** cache);
+
+YR_API void yr_compiler_cache_destroy(YR_COMPILER_CACHE* cache);
+
+YR_API int yr_compiler_set_cache(
+    YR_COMPILER* compiler,
+    YR_COMPILER_CACHE* cache);
+
 #endif
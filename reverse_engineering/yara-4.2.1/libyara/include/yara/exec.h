@@ -120,6 +120,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define OP_OF_FOUND_IN          72
 #define OP_COUNT_IN             73
 #define OP_DEFINED              74
+#define OP_GUARD_RULE           75
 
 #define _OP_EQ    0
 #define _OP_NEQ   1
@@ -196,4 +197,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 int yr_execute_code(YR_SCAN_CONTEXT* context);
 
+int yr_execute_guards(YR_SCAN_CONTEXT* context);
+
 #endif
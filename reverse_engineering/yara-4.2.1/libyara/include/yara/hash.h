@@ -50,6 +50,10 @@ typedef struct _YR_HASH_TABLE
 {
   int size;
 
+  // Number of entries in the table. Cleaning or iterating the table stops
+  // after visiting this number of entries instead of visiting every bucket.
+  int num_entries;
+
   YR_HASH_TABLE_ENTRY* buckets[1];
 
 } YR_HASH_TABLE;
@@ -101,3 +101,9 @@ int yr_lex_parse_rules_string(const char* rules_string, YR_COMPILER* compiler);
 int yr_lex_parse_rules_file(FILE* rules_file, YR_COMPILER* compiler);
 
 int yr_lex_parse_rules_fd(YR_FILE_DESCRIPTOR rules_fd, YR_COMPILER* compiler);
+
+int yr_lex_parse_rules_bytes(
+    const void* rules_data,
+    size_t rules_size,
+    int first_line,
+    YR_COMPILER* compiler);
@@ -73,6 +73,7 @@ typedef enum _YR_CONFIG_NAME
   YR_CONFIG_MAX_STRINGS_PER_RULE,
   YR_CONFIG_MAX_MATCH_DATA,
   YR_CONFIG_MAX_PROCESS_MEMORY_CHUNK,
+  YR_CONFIG_MAX_THREADS,
 
   YR_CONFIG_LAST  // End-of-enum marker, not a configuration
 
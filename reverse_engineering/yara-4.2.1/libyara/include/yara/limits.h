@@ -42,10 +42,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_PATH 1024
 #endif
 
-// Maximum number of threads that can use a YR_RULES structure simultaneously.
-// Increasing this number also increase memory usage as each YR_STRING structure
-// has an array with YR_MAX_THREADS entries for storing pointers to YR_MATCH
-// structures.
+// Default value for YR_CONFIG_MAX_THREADS, the number of threads expected to
+// use a YR_RULES structure simultaneously. This is not a hard limit, it only
+// determines how many idle scanners are kept by the scanner pool of each
+// YR_RULES, and it can be changed at runtime with yr_set_configuration.
 #ifndef YR_MAX_THREADS
 #define YR_MAX_THREADS 32
 #endif
@@ -119,6 +119,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define YR_MAX_FUNCTION_ARGS 128
 #endif
 
+// Maximum number of identifiers in a path compiled with yr_object_path_compile,
+// for example "a.b[%i].c" has three.
+#ifndef YR_MAX_OBJECT_PATH_LENGTH
+#define YR_MAX_OBJECT_PATH_LENGTH 8
+#endif
+
+// Maximum number of results of pure module functions (see FUNCTION_FLAGS_PURE)
+// remembered during a scan. Once this limit is reached the functions are
+// called every time with arguments not seen before.
+#ifndef YR_MAX_PURE_FUNCTION_RESULTS
+#define YR_MAX_PURE_FUNCTION_RESULTS 4096
+#endif
+
 // How many overloaded functions can share the same name in a YARA module.
 #ifndef YR_MAX_OVERLOADED_FUNCTIONS
 #define YR_MAX_OVERLOADED_FUNCTIONS 10
@@ -146,6 +159,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define YR_MATCH_VERIFICATION_PROFILING_RATE 1024
 #endif
 
+// The Aho-Corasick prefilter is not used if more than this number of 2-bytes
+// sequences (out of 65536) can start an atom. With denser automata the
+// prefilter stops too often for being faster than the transition table.
+#ifndef YR_AC_PREFILTER_MAX_PAIRS
+#define YR_AC_PREFILTER_MAX_PAIRS 2048
+#endif
+
 // Maximum allowed split ID, also limiting the number of split instructions
 // allowed in a regular expression. This number can't be increased
 // over 255 without changing RE_SPLIT_ID_TYPE.
@@ -163,6 +183,37 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define YR_RE_SCAN_LIMIT 4096
 #endif
 
+// When SCAN_FLAGS_CONTIGUOUS_BLOCKS is used, matches that cross the boundary
+// between two adjacent memory blocks are verified with up to this number of
+// bytes before and after the atom. The default is large enough for regular
+// expressions and hex strings, which never scan more than YR_RE_SCAN_LIMIT
+// bytes in each direction. Hex strings and regular expressions with jumps
+// larger than YR_STRING_CHAINING_THRESHOLD can span many more bytes, but they
+// are split in chains of smaller strings (see STRING_FLAGS_CHAIN_PART), each
+// part is verified on its own and the parts are linked by their absolute
+// offsets, so the chain can span any number of blocks. The data of such
+// matches is truncated at the end of the block where the chain starts if
+// YR_CONFIG_MAX_MATCH_DATA is larger than this size.
+#ifndef YR_BLOCK_OVERLAP_SIZE
+#define YR_BLOCK_OVERLAP_SIZE (YR_RE_SCAN_LIMIT + 64)
+#endif
+
+// Number of bytes at the start of a stream scanned with yr_scanner_scan_begin,
+// yr_scanner_scan_feed and yr_scanner_scan_end that are kept by the scanner.
+// Conditions and modules can access this data, as well as the last bytes of
+// the stream, but not the remaining data.
+#ifndef YR_SCAN_STREAM_HEAD_SIZE
+#define YR_SCAN_STREAM_HEAD_SIZE 65536
+#endif
+
+// When a scanner uses more than one thread (see yr_scanner_set_threads), each
+// memory block is split in segments that are scanned in parallel. Segments are
+// never smaller than this number of bytes, blocks that can't be split in at
+// least two segments of this size are scanned by a single thread.
+#ifndef YR_MIN_SCAN_SEGMENT_SIZE
+#define YR_MIN_SCAN_SEGMENT_SIZE 1048576
+#endif
+
 // Maximum number of fibers
 #ifndef RE_MAX_FIBERS
 #define RE_MAX_FIBERS 1024
@@ -121,6 +121,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   end_struct                        \
   (name)
 
+// Members declared between begin_stage and end_stage are filled by the given
+// load function instead of module_load. The load function is called with the
+// module's root object the first time a rule reads any of them, so data that
+// rules don't use is never parsed. Stages can be declared in the module's root
+// structure or in nested structures, but not in arrays or dictionaries of
+// structures. Multiple blocks with the same load function belong to the same
+// stage.
+#define begin_stage(load) \
+  {                       \
+    int stage_first_member = object_as_structure(stack[stack_top])->num_members;
+
+#define end_stage(load)                               \
+  FAIL_ON_ERROR(yr_object_structure_add_stage(        \
+      stack[stack_top], stage_first_member, (load))); \
+  }
+
 #define declare_integer(name)                                                 \
   {                                                                           \
     FAIL_ON_ERROR(                                                            \
@@ -187,11 +203,29 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     FAIL_ON_ERROR(yr_object_create(OBJECT_TYPE_STRING, name, dict, NULL)); \
   }
 
-#define declare_function(name, args_fmt, ret_fmt, func)               \
-  {                                                                   \
-    YR_OBJECT* function;                                              \
-    FAIL_ON_ERROR(yr_object_function_create(                          \
-        name, args_fmt, ret_fmt, func, stack[stack_top], &function)); \
+#define declare_function(name, args_fmt, ret_fmt, func)                  \
+  {                                                                      \
+    YR_OBJECT* function;                                                 \
+    FAIL_ON_ERROR(yr_object_function_create(                             \
+        name, args_fmt, ret_fmt, func, 0, stack[stack_top], &function)); \
+  }
+
+// Like declare_function, but for functions whose result depends only on their
+// arguments and the scanned data, like hash.md5(offset, size). The function is
+// called once per scan for each combination of arguments, subsequent calls
+// reuse the result. Functions with side effects, like console.log, or whose
+// result can change during the scan must use declare_function.
+#define declare_pure_function(name, args_fmt, ret_fmt, func) \
+  {                                                          \
+    YR_OBJECT* function;                                     \
+    FAIL_ON_ERROR(yr_object_function_create(                 \
+        name,                                                \
+        args_fmt,                                            \
+        ret_fmt,                                             \
+        func,                                                \
+        FUNCTION_FLAGS_PURE,                                 \
+        stack[stack_top],                                    \
+        &function));                                         \
   }
 
 #define define_function(func)     \
@@ -232,6 +266,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define get_string(object, ...) yr_object_get_string(object, __VA_ARGS__)
 
+// Like get_object, get_integer, etc, but with a path compiled beforehand with
+// yr_object_path_compile, usually in module_initialize. Much faster than the
+// former in functions that read many values, like one per item in an array.
+
+#define get_object_by_path(object, ...) \
+  yr_object_path_lookup(object, __VA_ARGS__)
+
+#define get_integer_by_path(object, ...) \
+  yr_object_path_get_integer(object, __VA_ARGS__)
+
+#define get_float_by_path(object, ...) \
+  yr_object_path_get_float(object, __VA_ARGS__)
+
+#define get_string_by_path(object, ...) \
+  yr_object_path_get_string(object, __VA_ARGS__)
+
 #define set_integer(value, object, ...) \
   yr_object_set_integer(value, object, __VA_ARGS__)
 
@@ -301,6 +351,12 @@ struct YR_MODULE
   YR_EXT_UNLOAD_FUNC unload;
   YR_EXT_INITIALIZE_FUNC initialize;
   YR_EXT_FINALIZE_FUNC finalize;
+
+  // Object tree built by the module's declarations when the module is
+  // initialized. Each scan gets a copy of it with yr_object_copy_declarations.
+  // It's available in module_initialize, where it can be used for compiling
+  // paths with yr_object_path_compile.
+  YR_OBJECT* prototype;
 };
 
 struct YR_MODULE_IMPORT
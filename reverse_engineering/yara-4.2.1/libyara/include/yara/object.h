@@ -63,6 +63,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define OBJECT_TYPE_DICTIONARY 6
 #define OBJECT_TYPE_FLOAT      7
 
+// The object was allocated by yr_object_copy_declarations together with the
+// rest of the tree, in a single memory block owned by the tree's root.
+#define OBJECT_FLAG_IN_BLOCK 1
+
+// The function's result depends only on its arguments, the scanned data and
+// the module's state, none of which change during a scan. Calls to these
+// functions are evaluated once per scan for each combination of arguments,
+// see OP_CALL in exec.c.
+#define FUNCTION_FLAGS_PURE 1
+
 int yr_object_create(
     int8_t type,
     const char* identifier,
@@ -76,6 +86,7 @@ int yr_object_function_create(
     const char* arguments_fmt,
     const char* return_fmt,
     YR_MODULE_FUNC func,
+    int flags,
     YR_OBJECT* parent,
     YR_OBJECT** function);
 
@@ -87,6 +98,11 @@ void yr_object_destroy(YR_OBJECT* object);
 
 int yr_object_copy(YR_OBJECT* object, YR_OBJECT** object_copy);
 
+int yr_object_copy_declarations(
+    YR_OBJECT* object,
+    int canary,
+    YR_OBJECT** object_copy);
+
 YR_OBJECT* yr_object_lookup_field(YR_OBJECT* object, const char* field_name);
 
 YR_OBJECT* yr_object_lookup(
@@ -95,6 +111,16 @@ YR_OBJECT* yr_object_lookup(
     const char* pattern,
     ...) YR_PRINTF_LIKE(3, 4);
 
+int yr_object_path_compile(
+    YR_OBJECT* object,
+    const char* pattern,
+    YR_OBJECT_PATH* path);
+
+YR_OBJECT* yr_object_path_lookup(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    ...);
+
 bool yr_object_has_undefined_value(YR_OBJECT* object, const char* field, ...)
     YR_PRINTF_LIKE(2, 3);
 
@@ -107,6 +133,21 @@ int64_t yr_object_get_integer(YR_OBJECT* object, const char* field, ...)
 SIZED_STRING* yr_object_get_string(YR_OBJECT* object, const char* field, ...)
     YR_PRINTF_LIKE(2, 3);
 
+int64_t yr_object_path_get_integer(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    ...);
+
+double yr_object_path_get_float(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    ...);
+
+SIZED_STRING* yr_object_path_get_string(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    ...);
+
 int yr_object_set_integer(
     int64_t value,
     YR_OBJECT* object,
@@ -141,6 +182,13 @@ int yr_object_dict_set_item(
 
 int yr_object_structure_set_member(YR_OBJECT* object, YR_OBJECT* member);
 
+int yr_object_structure_add_stage(
+    YR_OBJECT* object,
+    int first_member,
+    YR_STAGE_FUNC load);
+
+void yr_object_load_stage(YR_OBJECT* object);
+
 YR_OBJECT* yr_object_get_root(YR_OBJECT* object);
 
 YR_API void yr_object_print_data(
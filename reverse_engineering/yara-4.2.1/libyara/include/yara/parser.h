@@ -67,10 +67,19 @@ int yr_parser_emit_with_arg_reloc(
 
 int yr_parser_emit_push_const(yyscan_t yyscanner, uint64_t argument);
 
+int yr_parser_emit_call(
+    yyscan_t yyscanner,
+    YR_OBJECT_FUNCTION* function,
+    const char* args_fmt,
+    int32_t prototype_idx);
+
+int yr_parser_emit_and(yyscan_t yyscanner, YR_ARENA_REF* jfalse_arg_ref);
+
 int yr_parser_check_types(
     YR_COMPILER* compiler,
     YR_OBJECT_FUNCTION* function,
-    const char* actual_args_fmt);
+    const char* actual_args_fmt,
+    int32_t* prototype_idx);
 
 int yr_parser_lookup_string(
     yyscan_t yyscanner,
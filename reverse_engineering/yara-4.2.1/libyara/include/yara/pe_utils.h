@@ -51,6 +51,7 @@ typedef struct _PE
 {
   const uint8_t* data;
   size_t data_size;
+  uint64_t base_address;
 
   union
   {
@@ -63,6 +64,12 @@ typedef struct _PE
   IMPORTED_DLL* imported_dlls;
   IMPORTED_DLL* delay_imported_dlls;
 
+  // Hash tables used by pe.imports and pe.exports, created the first time a
+  // rule calls one of these functions.
+  YR_HASH_TABLE* imports_index;
+  YR_HASH_TABLE* delay_imports_index;
+  YR_HASH_TABLE* exports_index;
+
   uint32_t resources;
   uint32_t version_infos;
 
@@ -121,6 +121,24 @@ YR_API int yr_rules_load(const char* filename, YR_RULES** rules);
 
 YR_API int yr_rules_load_stream(YR_STREAM* stream, YR_RULES** rules);
 
+YR_API int yr_rules_publish(
+    YR_RULES* rules,
+    const char* name,
+    const char* tag);
+
+YR_API int yr_rules_publish_fd(
+    YR_RULES* rules,
+    YR_FILE_DESCRIPTOR fd,
+    const char* tag);
+
+YR_API int yr_rules_attach(const char* name, YR_RULES** rules);
+
+YR_API int yr_rules_attach_fd(YR_FILE_DESCRIPTOR fd, YR_RULES** rules);
+
+YR_API const char* yr_rules_get_tag(YR_RULES* rules);
+
+YR_API int yr_rules_unpublish(const char* name);
+
 YR_API int yr_rules_destroy(YR_RULES* rules);
 
 YR_API int yr_rules_define_integer_variable(
@@ -145,6 +163,11 @@ YR_API int yr_rules_define_string_variable(
 
 YR_API int yr_rules_get_stats(YR_RULES* rules, YR_RULES_STATS* stats);
 
+YR_API bool yr_rules_calls_function(
+    YR_RULES* rules,
+    const char* identifier,
+    const char* arguments_fmt);
+
 YR_API void yr_rule_disable(YR_RULE* rule);
 
 YR_API void yr_rule_enable(YR_RULE* rule);
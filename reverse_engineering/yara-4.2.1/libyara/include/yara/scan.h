@@ -40,6 +40,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SCAN_FLAGS_NO_TRYCATCH               4
 #define SCAN_FLAGS_REPORT_RULES_MATCHING     8
 #define SCAN_FLAGS_REPORT_RULES_NOT_MATCHING 16
+#define SCAN_FLAGS_CONTIGUOUS_BLOCKS         32
 
 int yr_scan_verify_match(
     YR_SCAN_CONTEXT* context,
@@ -49,4 +50,18 @@ int yr_scan_verify_match(
     uint64_t data_base,
     size_t offset);
 
+int yr_scan_merge_segment(
+    YR_SCAN_CONTEXT* context,
+    YR_SCAN_CONTEXT* segment_context,
+    const uint8_t* data,
+    size_t data_size,
+    uint64_t data_base);
+
+void yr_scan_disable_string(YR_SCAN_CONTEXT* context, YR_STRING* string);
+
+int yr_scan_get_match_index(
+    YR_SCAN_CONTEXT* context,
+    YR_STRING* string,
+    YR_MATCH*** index);
+
 #endif
@@ -49,6 +49,8 @@ YR_API void yr_scanner_set_timeout(YR_SCANNER* scanner, int timeout);
 
 YR_API void yr_scanner_set_flags(YR_SCANNER* scanner, int flags);
 
+YR_API void yr_scanner_set_threads(YR_SCANNER* scanner, int threads);
+
 YR_API int yr_scanner_define_integer_variable(
     YR_SCANNER* scanner,
     const char* identifier,
@@ -84,6 +86,30 @@ YR_API int yr_scanner_scan_fd(YR_SCANNER* scanner, YR_FILE_DESCRIPTOR fd);
 
 YR_API int yr_scanner_scan_proc(YR_SCANNER* scanner, int pid);
 
+YR_API int yr_scanner_scan_begin(YR_SCANNER* scanner);
+
+YR_API int yr_scanner_scan_feed(
+    YR_SCANNER* scanner,
+    const uint8_t* buffer,
+    size_t buffer_size);
+
+YR_API int yr_scanner_scan_end(YR_SCANNER* scanner);
+
+YR_API int yr_scanner_pool_create(
+    YR_RULES* rules,
+    uint32_t capacity,
+    YR_SCANNER_POOL** pool);
+
+YR_API void yr_scanner_pool_destroy(YR_SCANNER_POOL* pool);
+
+YR_API int yr_scanner_pool_acquire(
+    YR_SCANNER_POOL* pool,
+    YR_SCANNER** scanner);
+
+YR_API void yr_scanner_pool_release(
+    YR_SCANNER_POOL* pool,
+    YR_SCANNER* scanner);
+
 YR_API YR_RULE* yr_scanner_last_error_rule(YR_SCANNER* scanner);
 
 YR_API YR_STRING* yr_scanner_last_error_string(YR_SCANNER* scanner);
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <time.h>
 #include <yara/integers.h>
+#include <yara/utils.h>
 
 #if defined(_WIN32)
 
@@ -72,10 +73,10 @@ typedef struct _YR_STOPWATCH
 #endif
 
 // yr_stopwatch_start starts measuring time.
-void yr_stopwatch_start(YR_STOPWATCH* stopwatch);
+YR_API void yr_stopwatch_start(YR_STOPWATCH* stopwatch);
 
 // yr_stopwatch_elapsed_ns returns the number of nanoseconds elapsed
 // since the last call to yr_stopwatch_start.
-uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* stopwatch);
+YR_API uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* stopwatch);
 
 #endif
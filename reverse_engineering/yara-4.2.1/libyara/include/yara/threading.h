@@ -37,6 +37,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 typedef DWORD YR_THREAD_ID;
 typedef DWORD YR_THREAD_STORAGE_KEY;
 typedef HANDLE YR_MUTEX;
+typedef HANDLE YR_THREAD;
+
+typedef LPTHREAD_START_ROUTINE YR_THREAD_START_ROUTINE;
 
 #define YR_TLS __declspec(thread)
 
@@ -47,6 +50,9 @@ typedef HANDLE YR_MUTEX;
 typedef pthread_t YR_THREAD_ID;
 typedef pthread_key_t YR_THREAD_STORAGE_KEY;
 typedef pthread_mutex_t YR_MUTEX;
+typedef pthread_t YR_THREAD;
+
+typedef void* (*YR_THREAD_START_ROUTINE)(void*);
 
 #define YR_TLS __thread
 
@@ -64,4 +70,7 @@ int yr_thread_storage_destroy(YR_THREAD_STORAGE_KEY*);
 int yr_thread_storage_set_value(YR_THREAD_STORAGE_KEY*, void*);
 void* yr_thread_storage_get_value(YR_THREAD_STORAGE_KEY*);
 
+int yr_thread_create(YR_THREAD*, YR_THREAD_START_ROUTINE, void*);
+int yr_thread_join(YR_THREAD*);
+
 #endif
@@ -168,10 +168,13 @@ typedef struct YR_AC_AUTOMATON YR_AC_AUTOMATON;
 typedef struct YR_AC_TABLES YR_AC_TABLES;
 typedef struct YR_AC_MATCH_LIST_ENTRY YR_AC_MATCH_LIST_ENTRY;
 typedef struct YR_AC_MATCH YR_AC_MATCH;
+typedef struct YR_AC_PREFILTER YR_AC_PREFILTER;
+typedef struct YR_AC_PATCH YR_AC_PATCH;
 
 typedef struct YR_NAMESPACE YR_NAMESPACE;
 typedef struct YR_META YR_META;
 typedef struct YR_MATCHES YR_MATCHES;
+typedef struct YR_DEFERRED_MATCH YR_DEFERRED_MATCH;
 typedef struct YR_STRING YR_STRING;
 typedef struct YR_RULE YR_RULE;
 typedef struct YR_RULES YR_RULES;
@@ -182,6 +185,7 @@ typedef struct YR_RULE_PROFILING_INFO YR_RULE_PROFILING_INFO;
 typedef struct YR_EXTERNAL_VARIABLE YR_EXTERNAL_VARIABLE;
 typedef struct YR_MATCH YR_MATCH;
 typedef struct YR_SCAN_CONTEXT YR_SCAN_CONTEXT;
+typedef struct YR_SCANNER_POOL YR_SCANNER_POOL;
 
 typedef union YR_VALUE YR_VALUE;
 typedef struct YR_VALUE_STACK YR_VALUE_STACK;
@@ -192,9 +196,10 @@ typedef struct YR_OBJECT_ARRAY YR_OBJECT_ARRAY;
 typedef struct YR_OBJECT_DICTIONARY YR_OBJECT_DICTIONARY;
 typedef struct YR_OBJECT_FUNCTION YR_OBJECT_FUNCTION;
 
-typedef struct YR_STRUCTURE_MEMBER YR_STRUCTURE_MEMBER;
+typedef struct YR_STRUCTURE_STAGE YR_STRUCTURE_STAGE;
 typedef struct YR_ARRAY_ITEMS YR_ARRAY_ITEMS;
 typedef struct YR_DICTIONARY_ITEMS YR_DICTIONARY_ITEMS;
+typedef struct YR_OBJECT_PATH YR_OBJECT_PATH;
 
 typedef struct YR_MODULE YR_MODULE;
 typedef struct YR_MODULE_IMPORT YR_MODULE_IMPORT;
@@ -305,6 +310,12 @@ struct YR_SUMMARY
   uint32_t num_rules;
   uint32_t num_strings;
   uint32_t num_namespaces;
+
+  // Full identifiers of the module functions called by the rules followed by
+  // the arguments of the called prototype, like "hash.md5(ii)", one after the
+  // other and each one followed by a null character. The list ends with an
+  // empty identifier.
+  DECLARE_REFERENCE(const char*, called_functions);
 };
 
 struct YR_EXTERNAL_VARIABLE
@@ -463,6 +474,12 @@ struct YR_MATCHES
   YR_MATCH* tail;
 
   int32_t count;
+
+  // When conditions need random access to the matches in the list, pointers
+  // to them are stored in offset order in the scan context's "match_index"
+  // array, starting at position index - 1. If index is zero the list has not
+  // been indexed yet, or it was modified after being indexed.
+  size_t index;
 };
 
 struct YR_MATCH
@@ -488,6 +505,20 @@ struct YR_MATCH
   bool is_private;
 };
 
+// A YR_DEFERRED_MATCH is a match for a part of a string chain that was found
+// while scanning a segment of a block in parallel with other segments. These
+// matches can't be confirmed or discarded until the preceding segments are
+// done, so they are recorded and replayed later in the scan order. Matches
+// found during the same call to yr_scan_verify_match have the same value in
+// "verification".
+struct YR_DEFERRED_MATCH
+{
+  YR_STRING* string;
+  uint64_t offset;
+  int32_t match_length;
+  uint32_t verification;
+};
+
 struct YR_AC_STATE
 {
   YR_AC_STATE* failure;
@@ -501,7 +532,33 @@ struct YR_AC_STATE
   uint8_t depth;
   uint8_t input;
 
+  // Number of states in the list that starts at first_child.
+  uint16_t num_children;
+
   uint32_t t_table_slot;
+
+  // States with many children have an array with 256 entries, where the N-th
+  // entry is the child reached with input N, or NULL. This array is used for
+  // finding children faster than by traversing the list of siblings, which is
+  // still used for visiting the states in a deterministic order.
+  YR_AC_STATE** children;
+
+  // The fields below are used only by patchable automatons, see
+  // yr_ac_automaton_create_patchable. States whose failure link is this
+  // state are in a doubly-linked list that starts at failure_first.
+  YR_AC_STATE* parent;
+  YR_AC_STATE* failure_first;
+  YR_AC_STATE* failure_next;
+  YR_AC_STATE* failure_prev;
+
+  // Identifiers (plus one) of the first match added to this state, and of
+  // the first match in the list of matches reported at this state, which
+  // continues with the list of the failure state. Zero means no match.
+  uint32_t first_match;
+  uint32_t matches;
+
+  // YR_AC_STATE_FLAGS_XXX, used while patching the automaton.
+  uint8_t flags;
 };
 
 struct YR_AC_MATCH_LIST_ENTRY
@@ -535,6 +592,51 @@ struct YR_AC_AUTOMATON
 
   // Pointer to the root Aho-Corasick state.
   YR_AC_STATE* root;
+
+  // Matches and pending changes of a patchable automaton, NULL otherwise.
+  YR_AC_PATCH* patch;
+};
+
+typedef size_t (*YR_AC_PREFILTER_FIND_FUNC)(
+    const YR_AC_PREFILTER* prefilter,
+    const uint8_t* data,
+    size_t data_size,
+    size_t start,
+    size_t limit);
+
+////////////////////////////////////////////////////////////////////////////////
+// YR_AC_PREFILTER is built from the transition table when the rules are
+// created or loaded. While the automaton is in the root state the scanner uses
+// it for skipping over input positions where no atom can start, instead of
+// walking the transition table one byte at a time.
+//
+struct YR_AC_PREFILTER
+{
+  // Bitmap with one bit per pair of bytes. Bit (b1 << 8 | b2) is set if the
+  // automaton, starting at the root state, doesn't return to the root state
+  // without a match after reading b1 followed by b2.
+  YR_BITMASK pairs[YR_BITMASK_SIZE(65536)];
+
+  // Bitmap with one bit per byte. Bit N is set if the root state has a valid
+  // transition for byte N. Used for the last byte in the input, which doesn't
+  // have a successor.
+  YR_BITMASK first[YR_BITMASK_SIZE(256)];
+
+  // Nibble lookup tables for the set of bytes that can appear in the first
+  // and second position of a pair in the "pairs" bitmap. Tables suffixed with
+  // _lo are for bytes in the 0x00-0x7F range, the ones suffixed with _hi are
+  // for bytes in the 0x80-0xFF range. Byte B belongs to the set if bit
+  // (B >> 4) % 8 is set in the entry B & 0x0F of the corresponding table.
+  // These are used by the vectorized implementations of "find".
+  uint8_t first_lo[16];
+  uint8_t first_hi[16];
+  uint8_t second_lo[16];
+  uint8_t second_hi[16];
+
+  // Function that returns the first position in [start, limit) where some atom
+  // could start, or limit if there's none. The implementation is chosen at
+  // runtime according to the instruction set supported by the CPU.
+  YR_AC_PREFILTER_FIND_FUNC find;
 };
 
 struct YR_RULES
@@ -594,11 +696,25 @@ struct YR_RULES
   // match resides.
   uint32_t* ac_match_table;
 
+  // Prefilter used for skipping input that can't start any atom. It's NULL if
+  // the root state has matches, as every input position must be verified in
+  // that case.
+  YR_AC_PREFILTER* ac_prefilter;
+
+  // Pool of idle scanners used by the yr_rules_scan_xxx functions, so that
+  // they don't need to create and destroy a scanner on each call.
+  YR_SCANNER_POOL* scanner_pool;
+
   // Pointer to the first instruction that is executed whan evaluating the
   // conditions for all rules. The code is executed by yr_execute_code and
   // the instructions are defined by the OP_X macros in exec.h.
   const uint8_t* code_start;
 
+  // Pointer to the code that evaluates the guards of the rules before the
+  // data is scanned. The code is executed by yr_execute_guards, and consists
+  // only of an OP_HALT instruction if no rule has a guard.
+  const uint8_t* guard_code_start;
+
   // Total number of rules.
   uint32_t num_rules;
 
@@ -607,6 +723,10 @@ struct YR_RULES
 
   // Total number of namespaces.
   uint32_t num_namespaces;
+
+  // Module functions called by the rules, see YR_SUMMARY and
+  // yr_rules_calls_function.
+  const char* called_functions;
 };
 
 struct YR_RULES_STATS
@@ -803,9 +923,102 @@ struct YR_SCAN_CONTEXT
   // until they can be confirmed or discarded.
   YR_MATCHES* unconfirmed_matches;
 
+  // A bitmap with one bit per string, bit N is set if the entries for the
+  // string with index N in "matches", "unconfirmed_matches" or
+  // "strings_temp_disabled" were modified during the current scan.
+  YR_BITMASK* strings_dirty;
+
+  // Indexes of the strings that have their bit set in "strings_dirty", only
+  // these entries are reset when the scan finishes. The array can hold up to
+  // "max_dirty_strings" indexes, if "num_dirty_strings" grows beyond that
+  // limit the whole arrays are reset instead.
+  uint32_t* dirty_strings;
+  uint32_t num_dirty_strings;
+  uint32_t max_dirty_strings;
+
+  // Array used by yr_scan_get_match_index for storing pointers to the matches
+  // of a string in offset order, so that conditions like "$a at X", "@a[i]"
+  // or "#a in (X..Y)" don't need to walk the list of matches. It's reset when
+  // the scan finishes.
+  YR_MATCH** match_index;
+  size_t match_index_length;
+  size_t match_index_capacity;
+
   // profiling_info is a pointer to an array of YR_PROFILING_INFO structures,
   // one per rule. Entry N has the profiling information for rule with index N.
   YR_PROFILING_INFO* profiling_info;
+
+  // Number of threads used for scanning each memory block, see
+  // yr_scanner_set_threads.
+  int num_threads;
+
+  // When defer_chained_matches is true the matches for parts of string chains
+  // are not verified, they are appended to "deferred_matches" instead. This is
+  // used by the scanners working on a segment of a block scanned in parallel.
+  // num_verifications counts the calls to yr_scan_verify_match for chained
+  // strings, and is used for grouping the deferred matches.
+  bool defer_chained_matches;
+  YR_DEFERRED_MATCH* deferred_matches;
+  uint32_t num_deferred_matches;
+  uint32_t max_deferred_matches;
+  uint32_t num_verifications;
+
+  // Address where the data that is being scanned without interruption starts.
+  // It's the base of the current block or, with SCAN_FLAGS_CONTIGUOUS_BLOCKS,
+  // the base of the first block in the current sequence of adjacent blocks.
+  // Parts of string chains found before this address are never linked with
+  // the parts found after it, as the data between them is unknown.
+  uint64_t contiguous_base;
+
+  // The following fields are used only with SCAN_FLAGS_CONTIGUOUS_BLOCKS, for
+  // finding matches that cross the boundary between adjacent memory blocks.
+  //
+  // overlap_buffer has room for 4 * YR_BLOCK_OVERLAP_SIZE bytes. The first
+  // overlap_length bytes are a copy of the data right before overlap_end,
+  // which is the address where the last scanned block ends. When a block
+  // starting at overlap_end is scanned, its first bytes are appended to the
+  // copy, and the resulting buffer is scanned for matches around the boundary.
+  //
+  // Atoms found within the last YR_BLOCK_OVERLAP_SIZE bytes of a block are not
+  // verified until the next block is available, or until it is known that
+  // there's no such block. overlap_verify_from is the address where the first
+  // of those pending atoms ends.
+  uint8_t* overlap_buffer;
+  size_t overlap_length;
+  uint64_t overlap_end;
+  uint64_t overlap_verify_from;
+
+  // The following fields are used by yr_scanner_scan_begin/feed/end. While a
+  // stream is being scanned, stream_head holds a copy of its first
+  // YR_SCAN_STREAM_HEAD_SIZE bytes and stream_size is the number of bytes fed
+  // so far. When the stream ends, the head and the data in overlap_buffer are
+  // exposed to conditions and modules through stream_iterator, which returns
+  // the blocks in stream_blocks.
+  bool stream_active;
+  uint8_t* stream_head;
+  size_t stream_head_length;
+  uint64_t stream_size;
+  YR_MEMORY_BLOCK stream_blocks[2];
+  int stream_num_blocks;
+  int stream_next_block;
+  YR_MEMORY_BLOCK_ITERATOR stream_iterator;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// YR_SCANNER_POOL keeps up to "capacity" idle scanners for a given YR_RULES.
+// Scanners are taken from the pool with yr_scanner_pool_acquire and returned
+// with yr_scanner_pool_release. The pool can be used from multiple threads.
+//
+struct YR_SCANNER_POOL
+{
+  YR_RULES* rules;
+  YR_MUTEX mutex;
+
+  uint32_t capacity;
+  uint32_t count;
+
+  // Array with "capacity" entries, the first "count" ones are idle scanners.
+  YR_SCAN_CONTEXT** scanners;
 };
 
 union YR_VALUE
@@ -827,9 +1040,16 @@ struct YR_VALUE_STACK
   YR_VALUE* items;
 };
 
+// The "stage" field is non-zero for structure members declared within a parse
+// stage, in that case the member belongs to the stage with index stage - 1 in
+// the "stages" array of its parent structure. See begin_stage in modules.h.
+// The "flags" field is a combination of the OBJECT_FLAG_XXX values defined in
+// object.h.
 #define OBJECT_COMMON_FIELDS \
   int canary;                \
   int8_t type;               \
+  uint8_t stage;             \
+  uint8_t flags;             \
   const char* identifier;    \
   YR_OBJECT* parent;         \
   void* data;
@@ -843,7 +1063,23 @@ struct YR_OBJECT
 struct YR_OBJECT_STRUCTURE
 {
   OBJECT_COMMON_FIELDS
-  YR_STRUCTURE_MEMBER* members;
+
+  // Array with the members of the structure, in the order they were added.
+  // The position of a member in this array doesn't change once added, and
+  // it's the same in copies of the structure, see YR_OBJECT_PATH.
+  YR_OBJECT** members;
+  int num_members;
+  int members_capacity;
+
+  // Hash table for finding members by identifier, only for structures with
+  // many members, NULL for the rest. Each slot contains the position of a
+  // member in "members" plus one, or zero if the slot is empty.
+  int* members_index;
+  int members_index_size;
+
+  // Array of parse stages declared for members of this structure, terminated
+  // by an entry with a NULL load function. NULL if there are no stages.
+  YR_STRUCTURE_STAGE* stages;
 };
 
 struct YR_OBJECT_ARRAY
@@ -874,6 +1110,8 @@ struct YR_OBJECT_FUNCTION
   {
     const char* arguments_fmt;
     YR_MODULE_FUNC code;
+    // Combination of the FUNCTION_FLAGS_* flags defined in object.h.
+    int flags;
   } prototypes[YR_MAX_OVERLOADED_FUNCTIONS];
 };
 
@@ -882,10 +1120,16 @@ struct YR_OBJECT_FUNCTION
 #define object_as_dictionary(obj) ((YR_OBJECT_DICTIONARY*) (obj))
 #define object_as_function(obj)   ((YR_OBJECT_FUNCTION*) (obj))
 
-struct YR_STRUCTURE_MEMBER
+typedef void (*YR_STAGE_FUNC)(YR_OBJECT* module_object);
+
+struct YR_STRUCTURE_STAGE
 {
-  YR_OBJECT* object;
-  YR_STRUCTURE_MEMBER* next;
+  // Function that fills the members in the stage. It receives the module's
+  // root object.
+  YR_STAGE_FUNC load;
+
+  // True once the load function has been called.
+  bool loaded;
 };
 
 struct YR_ARRAY_ITEMS
@@ -905,6 +1149,12 @@ struct YR_DICTIONARY_ITEMS
   int used;
   int free;
 
+  // Hash table for finding items by key, with twice as many slots as items
+  // fit in "objects" (used + free). Each slot contains the position of an item
+  // in "objects" plus one, or zero if the slot is empty. If multiple items
+  // have the same key, the slot points to the last one.
+  int* index;
+
   struct
   {
     SIZED_STRING* key;
@@ -912,6 +1162,24 @@ struct YR_DICTIONARY_ITEMS
   } objects[1];
 };
 
+// A path like "sections[%i].name" resolved by yr_object_path_compile into the
+// positions of the members it goes through. Looking up the path with
+// yr_object_path_lookup doesn't need to parse it or compare identifiers.
+struct YR_OBJECT_PATH
+{
+  int length;
+
+  struct
+  {
+    // Position of the member in the "members" array of its structure.
+    int member;
+
+    // OBJECT_TYPE_ARRAY or OBJECT_TYPE_DICTIONARY if the member is followed by
+    // an index ([%i]) or key ([%s]), zero otherwise.
+    int8_t subscript;
+  } steps[YR_MAX_OBJECT_PATH_LENGTH];
+};
+
 // Iterators are used in loops of the form:
 //
 // for <any|all|number> <identifier> in <iterator> : ( <expression> )
@@ -1760,6 +1760,9 @@ YY_RULE_SETUP
     {
       int error_code = _yr_compiler_push_file_name(compiler, include_path);
 
+      if (error_code == ERROR_SUCCESS)
+        error_code = _yr_compiler_add_included_file(compiler, include_path);
+
       if (error_code != ERROR_SUCCESS)
       {
         if (error_code == ERROR_INCLUDES_CIRCULAR_REFERENCE)
@@ -1826,7 +1829,7 @@ case YY_STATE_EOF(str):
 case YY_STATE_EOF(regexp):
 case YY_STATE_EOF(include):
 case YY_STATE_EOF(comment):
-#line 364 "lexer.l"
+#line 367 "lexer.l"
 {
 
   yypop_buffer_state(yyscanner);
@@ -1839,7 +1842,7 @@ case YY_STATE_EOF(comment):
 	YY_BREAK
 case 55:
 YY_RULE_SETUP
-#line 375 "lexer.l"
+#line 378 "lexer.l"
 {
 
   yylval->c_string = yr_strdup(yytext);
@@ -1852,7 +1855,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 56:
 YY_RULE_SETUP
-#line 386 "lexer.l"
+#line 389 "lexer.l"
 {
 
   yylval->c_string = yr_strdup(yytext);
@@ -1865,7 +1868,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 57:
 YY_RULE_SETUP
-#line 397 "lexer.l"
+#line 400 "lexer.l"
 {
 
   yylval->c_string = yr_strdup(yytext);
@@ -1884,7 +1887,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 58:
 YY_RULE_SETUP
-#line 414 "lexer.l"
+#line 417 "lexer.l"
 {
 
   yylval->c_string = yr_strdup(yytext);
@@ -1903,7 +1906,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 59:
 YY_RULE_SETUP
-#line 431 "lexer.l"
+#line 434 "lexer.l"
 {
 
   yylval->c_string = yr_strdup(yytext);
@@ -1922,7 +1925,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 60:
 YY_RULE_SETUP
-#line 448 "lexer.l"
+#line 451 "lexer.l"
 {
 
   char* text = yytext;
@@ -1963,7 +1966,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 61:
 YY_RULE_SETUP
-#line 487 "lexer.l"
+#line 490 "lexer.l"
 {
 
   if (strlen(yytext) > 128)
@@ -1979,7 +1982,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 62:
 YY_RULE_SETUP
-#line 501 "lexer.l"
+#line 504 "lexer.l"
 {
 
   char *endptr;
@@ -2022,7 +2025,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 63:
 YY_RULE_SETUP
-#line 541 "lexer.l"
+#line 544 "lexer.l"
 {
   yylval->double_ = atof(yytext);
   return _DOUBLE_;
@@ -2030,7 +2033,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 64:
 YY_RULE_SETUP
-#line 546 "lexer.l"
+#line 549 "lexer.l"
 {
 
   char *endptr;
@@ -2049,7 +2052,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 65:
 YY_RULE_SETUP
-#line 562 "lexer.l"
+#line 565 "lexer.l"
 {
 
   char *endptr;
@@ -2068,7 +2071,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 66:
 YY_RULE_SETUP
-#line 579 "lexer.l"
+#line 582 "lexer.l"
 {     /* saw closing quote - all done */
 
   alloc_sized_string(s, yyextra->lex_buf_len);
@@ -2085,7 +2088,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 67:
 YY_RULE_SETUP
-#line 594 "lexer.l"
+#line 597 "lexer.l"
 {
 
   lex_check_space_ok("\t", yyextra->lex_buf_len, YR_LEX_BUF_SIZE);
@@ -2095,7 +2098,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 68:
 YY_RULE_SETUP
-#line 602 "lexer.l"
+#line 605 "lexer.l"
 {
 
   lex_check_space_ok("\r", yyextra->lex_buf_len, YR_LEX_BUF_SIZE);
@@ -2105,7 +2108,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 69:
 YY_RULE_SETUP
-#line 610 "lexer.l"
+#line 613 "lexer.l"
 {
 
   lex_check_space_ok("\n", yyextra->lex_buf_len, YR_LEX_BUF_SIZE);
@@ -2115,7 +2118,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 70:
 YY_RULE_SETUP
-#line 618 "lexer.l"
+#line 621 "lexer.l"
 {
 
   lex_check_space_ok("\"", yyextra->lex_buf_len, YR_LEX_BUF_SIZE);
@@ -2125,7 +2128,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 71:
 YY_RULE_SETUP
-#line 626 "lexer.l"
+#line 629 "lexer.l"
 {
 
   lex_check_space_ok("\\", yyextra->lex_buf_len, YR_LEX_BUF_SIZE);
@@ -2135,7 +2138,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 72:
 YY_RULE_SETUP
-#line 634 "lexer.l"
+#line 637 "lexer.l"
 {
 
   int result;
@@ -2148,13 +2151,13 @@ YY_RULE_SETUP
 	YY_BREAK
 case 73:
 YY_RULE_SETUP
-#line 645 "lexer.l"
+#line 648 "lexer.l"
 { yytext_to_buffer; }
 	YY_BREAK
 case 74:
 /* rule 74 can match eol */
 YY_RULE_SETUP
-#line 648 "lexer.l"
+#line 651 "lexer.l"
 {
   syntax_error("unterminated string");
 }
@@ -2162,14 +2165,14 @@ YY_RULE_SETUP
 case 75:
 /* rule 75 can match eol */
 YY_RULE_SETUP
-#line 653 "lexer.l"
+#line 656 "lexer.l"
 {
   syntax_error("illegal escape sequence");
 }
 	YY_BREAK
 case 76:
 YY_RULE_SETUP
-#line 658 "lexer.l"
+#line 661 "lexer.l"
 {
 
   if (yyextra->lex_buf_len > 0)
@@ -2198,7 +2201,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 77:
 YY_RULE_SETUP
-#line 685 "lexer.l"
+#line 688 "lexer.l"
 {
 
   lex_check_space_ok("/", yyextra->lex_buf_len, YR_LEX_BUF_SIZE);
@@ -2208,7 +2211,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 78:
 YY_RULE_SETUP
-#line 693 "lexer.l"
+#line 696 "lexer.l"
 {
 
   lex_check_space_ok("\\.", yyextra->lex_buf_len, YR_LEX_BUF_SIZE);
@@ -2223,20 +2226,20 @@ YY_RULE_SETUP
 	YY_BREAK
 case 79:
 YY_RULE_SETUP
-#line 706 "lexer.l"
+#line 709 "lexer.l"
 { yytext_to_buffer; }
 	YY_BREAK
 case 80:
 /* rule 80 can match eol */
 YY_RULE_SETUP
-#line 709 "lexer.l"
+#line 712 "lexer.l"
 {
   syntax_error("unterminated regular expression");
 }
 	YY_BREAK
 case 81:
 YY_RULE_SETUP
-#line 714 "lexer.l"
+#line 717 "lexer.l"
 {
 
   yylval->sized_string = NULL;
@@ -2247,7 +2250,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 82:
 YY_RULE_SETUP
-#line 723 "lexer.l"
+#line 726 "lexer.l"
 {
 
   yylval->sized_string = NULL;
@@ -2259,7 +2262,7 @@ YY_RULE_SETUP
 case 83:
 /* rule 83 can match eol */
 YY_RULE_SETUP
-#line 732 "lexer.l"
+#line 735 "lexer.l"
 {
   // Match hex-digits with whitespace or comments. The latter are stripped
   // out by hex_lexer.l
@@ -2279,12 +2282,12 @@ YY_RULE_SETUP
 case 84:
 /* rule 84 can match eol */
 YY_RULE_SETUP
-#line 749 "lexer.l"
+#line 752 "lexer.l"
 /* skip whitespace */
 	YY_BREAK
 case 85:
 YY_RULE_SETUP
-#line 751 "lexer.l"
+#line 754 "lexer.l"
 {
 
   if (yytext[0] >= 32 && yytext[0] < 127)
@@ -2299,10 +2302,10 @@ YY_RULE_SETUP
 	YY_BREAK
 case 86:
 YY_RULE_SETUP
-#line 763 "lexer.l"
+#line 766 "lexer.l"
 ECHO;
 	YY_BREAK
-#line 2305 "lexer.c"
+#line 2308 "lexer.c"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -3451,7 +3454,7 @@ void yyfree (void * ptr , yyscan_t yyscanner)
 
 #define YYTABLES_NAME "yytables"
 
-#line 763 "lexer.l"
+#line 766 "lexer.l"
 
 
 
@@ -3717,3 +3720,37 @@ int yr_lex_parse_rules_fd(
   return compiler->errors;
 }
 
+
+int yr_lex_parse_rules_bytes(
+    const void* rules_data,
+    size_t rules_size,
+    int first_line,
+    YR_COMPILER* compiler)
+{
+  yyscan_t yyscanner;
+
+  compiler->errors = 0;
+
+  if (yylex_init(&yyscanner) != 0)
+  {
+    compiler->errors = 1;
+    compiler->last_error = ERROR_INSUFFICIENT_MEMORY;
+    return compiler->errors;
+  }
+
+  if (setjmp(compiler->error_recovery) != 0)
+    return compiler->errors;
+
+  #if YYDEBUG
+  yydebug = 1;
+  #endif
+
+  yyset_extra(compiler, yyscanner);
+  yy_scan_bytes((const char*) rules_data, (int) rules_size, yyscanner);
+  yyset_lineno(first_line, yyscanner);
+  yyparse(yyscanner, compiler);
+  yylex_destroy(yyscanner);
+
+  return compiler->errors;
+}
+
@@ -235,6 +235,7 @@ YR_API int yr_initialize(void)
   uint32_t def_stack_size = DEFAULT_STACK_SIZE;
   uint32_t def_max_strings_per_rule = DEFAULT_MAX_STRINGS_PER_RULE;
   uint32_t def_max_match_data = DEFAULT_MAX_MATCH_DATA;
+  uint32_t def_max_threads = YR_MAX_THREADS;
   uint64_t def_max_process_memory_chunk = DEFAULT_MAX_PROCESS_MEMORY_CHUNK;
 
   init_count++;
@@ -302,6 +303,8 @@ YR_API int yr_initialize(void)
   FAIL_ON_ERROR(
       yr_set_configuration(YR_CONFIG_MAX_MATCH_DATA, &def_max_match_data));
 
+  FAIL_ON_ERROR(yr_set_configuration(YR_CONFIG_MAX_THREADS, &def_max_threads));
+
   YR_DEBUG_FPRINTF(2, stderr, "} // %s()\n", __FUNCTION__);
 
   return ERROR_SUCCESS;
@@ -374,6 +377,7 @@ YR_API int yr_finalize(void)
 //              YR_CONFIG_STACK_SIZE                data type: uint32_t
 //              YR_CONFIG_MAX_STRINGS_PER_RULE      data type: uint32_t
 //              YR_CONFIG_MAX_MATCH_DATA            data type: uint32_t
+//              YR_CONFIG_MAX_THREADS               data type: uint32_t
 //              YR_CONFIG_MAX_PROCESS_MEMORY_CHUNK  data type: uint64_t
 //
 //   src: Pointer to the value being set for the option.
@@ -392,6 +396,7 @@ YR_API int yr_set_configuration(YR_CONFIG_NAME name, void *src)
   case YR_CONFIG_STACK_SIZE:
   case YR_CONFIG_MAX_STRINGS_PER_RULE:
   case YR_CONFIG_MAX_MATCH_DATA:
+  case YR_CONFIG_MAX_THREADS:
     yr_cfgs[name].ui32 = *(uint32_t *) src;
     break;
 
@@ -420,13 +425,20 @@ YR_API int yr_set_configuration(YR_CONFIG_NAME name, void *src)
 //
 YR_API int yr_set_configuration_uint32(YR_CONFIG_NAME name, uint32_t value)
 {
+  struct yr_config_var config;
+
   switch (name)
   {
   // Accept only the configuration options that are of type uint32_t.
   case YR_CONFIG_STACK_SIZE:
   case YR_CONFIG_MAX_STRINGS_PER_RULE:
   case YR_CONFIG_MAX_MATCH_DATA:
-    return yr_set_configuration(name, &value);
+  case YR_CONFIG_MAX_THREADS:
+    // The value is passed in a buffer that can hold any option's value, as
+    // yr_set_configuration reads 8 bytes in its uint64_t branch, even though
+    // that branch is never taken for these names.
+    config.ui32 = value;
+    return yr_set_configuration(name, &config.ui32);
   default:
     return ERROR_INVALID_ARGUMENT;
   }
@@ -464,6 +476,7 @@ YR_API int yr_set_configuration_uint64(YR_CONFIG_NAME name, uint64_t value)
 //              YR_CONFIG_STACK_SIZE                data type: uint32_t
 //              YR_CONFIG_MAX_STRINGS_PER_RULE      data type: uint32_t
 //              YR_CONFIG_MAX_MATCH_DATA            data type: uint32_t
+//              YR_CONFIG_MAX_THREADS               data type: uint32_t
 //              YR_CONFIG_MAX_PROCESS_MEMORY_CHUNK  data type: uint64_t
 //
 //   dest: Pointer to a variable that will receive the value for the option.
@@ -482,6 +495,7 @@ YR_API int yr_get_configuration(YR_CONFIG_NAME name, void *dest)
   case YR_CONFIG_STACK_SIZE:
   case YR_CONFIG_MAX_STRINGS_PER_RULE:
   case YR_CONFIG_MAX_MATCH_DATA:
+  case YR_CONFIG_MAX_THREADS:
     *(uint32_t *) dest = yr_cfgs[name].ui32;
     break;
 
@@ -516,6 +530,7 @@ YR_API int yr_get_configuration_uint32(YR_CONFIG_NAME name, uint32_t *dest)
   case YR_CONFIG_STACK_SIZE:
   case YR_CONFIG_MAX_STRINGS_PER_RULE:
   case YR_CONFIG_MAX_MATCH_DATA:
+  case YR_CONFIG_MAX_THREADS:
     return yr_get_configuration(name, (void *) dest);
   default:
     return ERROR_INVALID_ARGUMENT;
@@ -60,12 +60,26 @@ YR_MODULE yr_modules_table[] = {
 
 #undef MODULE
 
+#define YR_NUM_MODULES (sizeof(yr_modules_table) / sizeof(YR_MODULE))
+
 int yr_modules_initialize()
 {
   int i;
 
-  for (i = 0; i < sizeof(yr_modules_table) / sizeof(YR_MODULE); i++)
+  for (i = 0; i < YR_NUM_MODULES; i++)
   {
+    // The declarations are run only once, each scan gets a copy of the
+    // resulting objects with yr_object_copy_declarations, which is much faster
+    // than running the declarations again.
+    FAIL_ON_ERROR(yr_object_create(
+        OBJECT_TYPE_STRUCTURE,
+        yr_modules_table[i].name,
+        NULL,
+        &yr_modules_table[i].prototype));
+
+    FAIL_ON_ERROR(
+        yr_modules_table[i].declarations(yr_modules_table[i].prototype));
+
     int result = yr_modules_table[i].initialize(&yr_modules_table[i]);
 
     if (result != ERROR_SUCCESS)
@@ -79,12 +93,15 @@ int yr_modules_finalize()
 {
   int i;
 
-  for (i = 0; i < sizeof(yr_modules_table) / sizeof(YR_MODULE); i++)
+  for (i = 0; i < YR_NUM_MODULES; i++)
   {
     int result = yr_modules_table[i].finalize(&yr_modules_table[i]);
 
     if (result != ERROR_SUCCESS)
       return result;
+
+    yr_object_destroy(yr_modules_table[i].prototype);
+    yr_modules_table[i].prototype = NULL;
   }
 
   return ERROR_SUCCESS;
@@ -96,7 +113,7 @@ int yr_modules_do_declarations(
 {
   int i;
 
-  for (i = 0; i < sizeof(yr_modules_table) / sizeof(YR_MODULE); i++)
+  for (i = 0; i < YR_NUM_MODULES; i++)
   {
     if (strcmp(yr_modules_table[i].name, module_name) == 0)
       return yr_modules_table[i].declarations(main_structure);
@@ -122,12 +139,14 @@ int yr_modules_load(const char* module_name, YR_SCAN_CONTEXT* context)
 
   // not loaded yet
 
-  FAIL_ON_ERROR(yr_object_create(
-      OBJECT_TYPE_STRUCTURE, module_name, NULL, &module_structure));
+  for (i = 0; i < YR_NUM_MODULES; i++)
+  {
+    if (strcmp(yr_modules_table[i].name, module_name) == 0)
+      break;
+  }
 
-  // initialize canary for module's top-level structure, every other object
-  // within the module inherits the same canary.
-  yr_object_set_canary(module_structure, context->canary);
+  if (i == YR_NUM_MODULES)
+    return ERROR_UNKNOWN_MODULE;
 
   mi.module_name = module_name;
   mi.module_data = NULL;
@@ -137,31 +156,22 @@ int yr_modules_load(const char* module_name, YR_SCAN_CONTEXT* context)
       context, CALLBACK_MSG_IMPORT_MODULE, &mi, context->user_data);
 
   if (result == CALLBACK_ERROR)
-  {
-    yr_object_destroy(module_structure);
     return ERROR_CALLBACK_ERROR;
-  }
 
-  FAIL_ON_ERROR_WITH_CLEANUP(
-      yr_modules_do_declarations(module_name, module_structure),
-      yr_object_destroy(module_structure));
+  // Every object within the module gets the canary of the scan context.
+  FAIL_ON_ERROR(yr_object_copy_declarations(
+      yr_modules_table[i].prototype, context->canary, &module_structure));
 
   FAIL_ON_ERROR_WITH_CLEANUP(
       yr_hash_table_add(
           context->objects_table, module_name, NULL, module_structure),
       yr_object_destroy(module_structure));
 
-  for (i = 0; i < sizeof(yr_modules_table) / sizeof(YR_MODULE); i++)
-  {
-    if (strcmp(yr_modules_table[i].name, module_name) == 0)
-    {
-      result = yr_modules_table[i].load(
-          context, module_structure, mi.module_data, mi.module_data_size);
+  result = yr_modules_table[i].load(
+      context, module_structure, mi.module_data, mi.module_data_size);
 
-      if (result != ERROR_SUCCESS)
-        return result;
-    }
-  }
+  if (result != ERROR_SUCCESS)
+    return result;
 
   result = context->callback(
       context,
@@ -177,7 +187,7 @@ int yr_modules_load(const char* module_name, YR_SCAN_CONTEXT* context)
 
 int yr_modules_unload_all(YR_SCAN_CONTEXT* context)
 {
-  for (int i = 0; i < sizeof(yr_modules_table) / sizeof(YR_MODULE); i++)
+  for (int i = 0; i < YR_NUM_MODULES; i++)
   {
     YR_OBJECT* module_structure = (YR_OBJECT*) yr_hash_table_remove(
         context->objects_table, yr_modules_table[i].name, NULL);
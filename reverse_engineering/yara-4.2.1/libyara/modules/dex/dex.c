@@ -37,6 +37,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // DEX File layout information:
 // https://source.android.com/devices/tech/dalvik/dex-format
 
+// Paths read for every method and field, both while parsing the file and by
+// the has_method_xxx and has_class_xxx functions. They are compiled once in
+// module_initialize.
+static struct
+{
+  YR_OBJECT_PATH string_value;
+  YR_OBJECT_PATH type_descriptor_idx;
+  YR_OBJECT_PATH proto_shorty_idx;
+  YR_OBJECT_PATH field_name_idx;
+  YR_OBJECT_PATH field_class_idx;
+  YR_OBJECT_PATH field_type_idx;
+  YR_OBJECT_PATH method_name_idx;
+  YR_OBJECT_PATH method_class_idx;
+  YR_OBJECT_PATH method_proto_idx;
+  YR_OBJECT_PATH method_name;
+  YR_OBJECT_PATH method_class_name;
+} dex_paths;
+
 define_function(has_method_string)
 {
   SIZED_STRING* parsed_name;
@@ -49,7 +67,7 @@ define_function(has_method_string)
 
   for (int i = 0; i < number_of_methods; i++)
   {
-    parsed_name = get_string(module, "method[%i].name", i);
+    parsed_name = get_string_by_path(module, &dex_paths.method_name, i);
     if (parsed_name != NULL &&
         strcmp(parsed_name->c_string, method_name->c_string) == 0)
     {
@@ -74,14 +92,14 @@ define_function(has_method_and_class_string)
 
   for (int i = 0; i < number_of_methods; i++)
   {
-    parsed_class = get_string(module, "method[%i].class_name", i);
+    parsed_class = get_string_by_path(module, &dex_paths.method_class_name, i);
     if (parsed_class != NULL &&
         strcmp(parsed_class->c_string, class_name->c_string) != 0)
     {
       continue;
     }
 
-    parsed_name = get_string(module, "method[%i].name", i);
+    parsed_name = get_string_by_path(module, &dex_paths.method_name, i);
     if (parsed_name != NULL &&
         strcmp(parsed_name->c_string, method_name->c_string) == 0)
     {
@@ -104,7 +122,7 @@ define_function(has_method_regexp)
 
   for (int i = 0; i < number_of_methods; i++)
   {
-    parsed_name = get_string(module, "method[%i].name", i);
+    parsed_name = get_string_by_path(module, &dex_paths.method_name, i);
     if (parsed_name != NULL &&
         yr_re_match(scan_context(), regex, parsed_name->c_string) != -1)
     {
@@ -128,14 +146,14 @@ define_function(has_method_and_class_regexp)
 
   for (int i = 0; i < number_of_methods; i++)
   {
-    parsed_class = get_string(module, "method[%i].class_name", i);
+    parsed_class = get_string_by_path(module, &dex_paths.method_class_name, i);
     if (parsed_class != NULL &&
         yr_re_match(scan_context(), class_regex, parsed_class->c_string) == -1)
     {
       continue;
     }
 
-    parsed_name = get_string(module, "method[%i].name", i);
+    parsed_name = get_string_by_path(module, &dex_paths.method_name, i);
     if (parsed_name != NULL &&
         yr_re_match(scan_context(), name_regex, parsed_name->c_string) != -1)
     {
@@ -157,7 +175,7 @@ define_function(has_class_string)
 
   for (int i = 0; i < number_of_methods; i++)
   {
-    parsed_class = get_string(module, "method[%i].class_name", i);
+    parsed_class = get_string_by_path(module, &dex_paths.method_class_name, i);
     if (parsed_class != NULL &&
         strcmp(parsed_class->c_string, class_name->c_string) == 0)
     {
@@ -180,7 +198,7 @@ define_function(has_class_regexp)
 
   for (int i = 0; i < number_of_methods; i++)
   {
-    parsed_class = get_string(module, "method[%i].class_name", i);
+    parsed_class = get_string_by_path(module, &dex_paths.method_class_name, i);
     if (parsed_class != NULL &&
         yr_re_match(scan_context(), regex, parsed_class->c_string) != -1)
     {
@@ -190,6 +208,58 @@ define_function(has_class_regexp)
   return_integer(0);
 }
 
+// Integer constants are part of the declarations, the DEX_FILE_MAGIC_XXX
+// strings are still set by module_load because declarations can't contain
+// string values.
+
+static void dex_set_definitions(YR_OBJECT* module_object)
+{
+  set_integer(0x12345678, module_object, "ENDIAN_CONSTANT");
+  set_integer(0x78563412, module_object, "REVERSE_ENDIAN_CONSTANT");
+
+  set_integer(0xffffffff, module_object, "NO_INDEX");
+  set_integer(0x1, module_object, "ACC_PUBLIC");
+  set_integer(0x2, module_object, "ACC_PRIVATE");
+  set_integer(0x4, module_object, "ACC_PROTECTED");
+  set_integer(0x8, module_object, "ACC_STATIC");
+  set_integer(0x10, module_object, "ACC_FINAL");
+  set_integer(0x20, module_object, "ACC_SYNCHRONIZED");
+  set_integer(0x40, module_object, "ACC_VOLATILE");
+  set_integer(0x40, module_object, "ACC_BRIDGE");
+  set_integer(0x80, module_object, "ACC_TRANSIENT");
+  set_integer(0x80, module_object, "ACC_VARARGS");
+  set_integer(0x100, module_object, "ACC_NATIVE");
+  set_integer(0x200, module_object, "ACC_INTERFACE");
+  set_integer(0x400, module_object, "ACC_ABSTRACT");
+  set_integer(0x800, module_object, "ACC_STRICT");
+  set_integer(0x1000, module_object, "ACC_SYNTHETIC");
+  set_integer(0x2000, module_object, "ACC_ANNOTATION");
+  set_integer(0x4000, module_object, "ACC_ENUM");
+  set_integer(0x10000, module_object, "ACC_CONSTRUCTOR");
+  set_integer(0x20000, module_object, "ACC_DECLARED_SYNCHRONIZED");
+
+  set_integer(0x0000, module_object, "TYPE_HEADER_ITEM");
+  set_integer(0x0001, module_object, "TYPE_STRING_ID_ITEM");
+  set_integer(0x0002, module_object, "TYPE_TYPE_ID_ITEM");
+  set_integer(0x0003, module_object, "TYPE_PROTO_ID_ITEM");
+  set_integer(0x0004, module_object, "TYPE_FIELD_ID_ITEM");
+  set_integer(0x0005, module_object, "TYPE_METHOD_ID_ITEM");
+  set_integer(0x0006, module_object, "TYPE_CLASS_DEF_ITEM");
+  set_integer(0x0007, module_object, "TYPE_CALL_SITE_ID_ITEM");
+  set_integer(0x0008, module_object, "TYPE_METHOD_HANDLE_ITEM");
+  set_integer(0x1000, module_object, "TYPE_MAP_LIST");
+  set_integer(0x1001, module_object, "TYPE_TYPE_LIST");
+  set_integer(0x1002, module_object, "TYPE_ANNOTATION_SET_REF_LIST");
+  set_integer(0x1003, module_object, "TYPE_ANNOTATION_SET_ITEM");
+  set_integer(0x2000, module_object, "TYPE_CLASS_DATA_ITEM");
+  set_integer(0x2001, module_object, "TYPE_CODE_ITEM");
+  set_integer(0x2002, module_object, "TYPE_STRING_DATA_ITEM");
+  set_integer(0x2003, module_object, "TYPE_DEBUG_INFO_ITEM");
+  set_integer(0x2004, module_object, "TYPE_ANNOTATION_ITEM");
+  set_integer(0x2005, module_object, "TYPE_ENCODED_ARRAY_ITEM");
+  set_integer(0x2006, module_object, "TYPE_ANNOTATIONS_DIRECTORY_ITEM");
+}
+
 begin_declarations
   declare_string("DEX_FILE_MAGIC_035");
   declare_string("DEX_FILE_MAGIC_036");
@@ -332,12 +402,12 @@ begin_declarations
     declare_integer("access_flags");
   end_struct_array("field")
 
-  declare_function("has_method", "s", "i", has_method_string);
-  declare_function("has_method", "ss", "i", has_method_and_class_string);
-  declare_function("has_method", "r", "i", has_method_regexp);
-  declare_function("has_method", "rr", "i", has_method_and_class_regexp);
-  declare_function("has_class", "s", "i", has_class_string);
-  declare_function("has_class", "r", "i", has_class_regexp);
+  declare_pure_function("has_method", "s", "i", has_method_string);
+  declare_pure_function("has_method", "ss", "i", has_method_and_class_string);
+  declare_pure_function("has_method", "r", "i", has_method_regexp);
+  declare_pure_function("has_method", "rr", "i", has_method_and_class_regexp);
+  declare_pure_function("has_class", "s", "i", has_class_string);
+  declare_pure_function("has_class", "r", "i", has_class_regexp);
 
   declare_integer("number_of_methods");
   begin_struct_array("method")
@@ -365,6 +435,8 @@ begin_declarations
       end_struct_array("handlers");
     end_struct("code_item")
   end_struct_array("method")
+
+  dex_set_definitions(module);
 end_declarations
 
 // https://android.googlesource.com/platform/dalvik/+/android-4.4.2_r2/libdex/Leb128.cpp
@@ -415,7 +487,7 @@ static int32_t read_uleb128(const uint8_t* pStream, uint32_t* size)
 
 static int64_t dex_get_integer(
     YR_OBJECT* object,
-    const char* pattern,
+    const YR_OBJECT_PATH* path,
     int64_t index)
 {
   if (index == YR_UNDEFINED)
@@ -425,13 +497,13 @@ static int64_t dex_get_integer(
   if (index > 0x80000)
     return YR_UNDEFINED;
 
-  return get_integer(object, pattern, (int) index);
+  return get_integer_by_path(object, path, (int) index);
 }
 
 
 static SIZED_STRING* dex_get_string(
     YR_OBJECT* object,
-    const char* pattern,
+    const YR_OBJECT_PATH* path,
     int64_t index)
 {
   if (index == YR_UNDEFINED)
@@ -441,7 +513,7 @@ static SIZED_STRING* dex_get_string(
   if (index > 0x80000)
     return NULL;
 
-  return get_string(object, pattern, (int) index);
+  return get_string_by_path(object, path, (int) index);
 }
 
 
@@ -607,13 +679,13 @@ uint32_t load_encoded_field(
 #endif
 
   int64_t name_idx = dex_get_integer(
-      dex->object, "field_ids[%i].name_idx", *previous_field_idx);
+      dex->object, &dex_paths.field_name_idx, *previous_field_idx);
 
   if (name_idx == YR_UNDEFINED)
     return 0;
 
   SIZED_STRING* field_name = dex_get_string(
-      dex->object, "string_ids[%i].value", name_idx);
+      dex->object, &dex_paths.string_value, name_idx);
 
   if (field_name != NULL)
   {
@@ -631,13 +703,13 @@ uint32_t load_encoded_field(
   }
 
   int64_t class_idx = dex_get_integer(
-      dex->object, "field_ids[%i].class_idx", *previous_field_idx);
+      dex->object, &dex_paths.field_class_idx, *previous_field_idx);
 
   int64_t descriptor_idx = dex_get_integer(
-      dex->object, "type_ids[%i].descriptor_idx", class_idx);
+      dex->object, &dex_paths.type_descriptor_idx, class_idx);
 
   SIZED_STRING* class_name = dex_get_string(
-      dex->object, "string_ids[%i].value", descriptor_idx);
+      dex->object, &dex_paths.string_value, descriptor_idx);
 
   if (class_name != NULL)
   {
@@ -658,13 +730,13 @@ uint32_t load_encoded_field(
   }
 
   int type_idx = dex_get_integer(
-      dex->object, "field_ids[%i].type_idx", *previous_field_idx);
+      dex->object, &dex_paths.field_type_idx, *previous_field_idx);
 
   int shorty_idx = dex_get_integer(
-      dex->object, "type_ids[%i].descriptor_idx", type_idx);
+      dex->object, &dex_paths.type_descriptor_idx, type_idx);
 
   SIZED_STRING* proto_name = dex_get_string(
-      dex->object, "string_ids[%i].value", shorty_idx);
+      dex->object, &dex_paths.string_value, shorty_idx);
 
   if (proto_name != NULL)
   {
@@ -742,7 +814,7 @@ uint32_t load_encoded_method(
   *previous_method_idx = encoded_method.method_idx_diff + *previous_method_idx;
 
   int64_t name_idx = dex_get_integer(
-      dex->object, "method_ids[%i].name_idx", *previous_method_idx);
+      dex->object, &dex_paths.method_name_idx, *previous_method_idx);
 
   if (name_idx == YR_UNDEFINED)
     return 0;
@@ -762,7 +834,7 @@ uint32_t load_encoded_method(
 #endif
 
   SIZED_STRING* method_name = dex_get_string(
-      dex->object, "string_ids[%i].value", name_idx);
+      dex->object, &dex_paths.string_value, name_idx);
 
   if (method_name != NULL)
   {
@@ -782,13 +854,13 @@ uint32_t load_encoded_method(
   }
 
   int64_t class_idx = dex_get_integer(
-      dex->object, "method_ids[%i].class_idx", *previous_method_idx);
+      dex->object, &dex_paths.method_class_idx, *previous_method_idx);
 
   int64_t descriptor_idx = dex_get_integer(
-      dex->object, "type_ids[%i].descriptor_idx", class_idx);
+      dex->object, &dex_paths.type_descriptor_idx, class_idx);
 
   SIZED_STRING* class_name = dex_get_string(
-      dex->object, "string_ids[%i].value", descriptor_idx);
+      dex->object, &dex_paths.string_value, descriptor_idx);
 
   if (class_name != NULL)
   {
@@ -809,13 +881,13 @@ uint32_t load_encoded_method(
   }
 
   int64_t proto_idx = dex_get_integer(
-      dex->object, "method_ids[%i].proto_idx", *previous_method_idx);
+      dex->object, &dex_paths.method_proto_idx, *previous_method_idx);
 
   int64_t shorty_idx = dex_get_integer(
-      dex->object, "proto_ids[%i].shorty_idx", proto_idx);
+      dex->object, &dex_paths.proto_shorty_idx, proto_idx);
 
   SIZED_STRING* proto_name = dex_get_string(
-      dex->object, "string_ids[%i].value", shorty_idx);
+      dex->object, &dex_paths.string_value, shorty_idx);
 
   if (proto_name != NULL)
   {
@@ -1385,6 +1457,33 @@ void dex_parse(DEX* dex, uint64_t base_address)
 
 int module_initialize(YR_MODULE* module)
 {
+  YR_OBJECT* prototype = module->prototype;
+
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "string_ids[%i].value", &dex_paths.string_value));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype,
+      "type_ids[%i].descriptor_idx",
+      &dex_paths.type_descriptor_idx));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "proto_ids[%i].shorty_idx", &dex_paths.proto_shorty_idx));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "field_ids[%i].name_idx", &dex_paths.field_name_idx));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "field_ids[%i].class_idx", &dex_paths.field_class_idx));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "field_ids[%i].type_idx", &dex_paths.field_type_idx));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "method_ids[%i].name_idx", &dex_paths.method_name_idx));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "method_ids[%i].class_idx", &dex_paths.method_class_idx));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "method_ids[%i].proto_idx", &dex_paths.method_proto_idx));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "method[%i].name", &dex_paths.method_name));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "method[%i].class_name", &dex_paths.method_class_name));
+
   return ERROR_SUCCESS;
 }
 
@@ -1412,51 +1511,6 @@ int module_load(
   set_string(DEX_FILE_MAGIC_038, module_object, "DEX_FILE_MAGIC_038");
   set_string(DEX_FILE_MAGIC_039, module_object, "DEX_FILE_MAGIC_039");
 
-  set_integer(0x12345678, module_object, "ENDIAN_CONSTANT");
-  set_integer(0x78563412, module_object, "REVERSE_ENDIAN_CONSTANT");
-
-  set_integer(0xffffffff, module_object, "NO_INDEX");
-  set_integer(0x1, module_object, "ACC_PUBLIC");
-  set_integer(0x2, module_object, "ACC_PRIVATE");
-  set_integer(0x4, module_object, "ACC_PROTECTED");
-  set_integer(0x8, module_object, "ACC_STATIC");
-  set_integer(0x10, module_object, "ACC_FINAL");
-  set_integer(0x20, module_object, "ACC_SYNCHRONIZED");
-  set_integer(0x40, module_object, "ACC_VOLATILE");
-  set_integer(0x40, module_object, "ACC_BRIDGE");
-  set_integer(0x80, module_object, "ACC_TRANSIENT");
-  set_integer(0x80, module_object, "ACC_VARARGS");
-  set_integer(0x100, module_object, "ACC_NATIVE");
-  set_integer(0x200, module_object, "ACC_INTERFACE");
-  set_integer(0x400, module_object, "ACC_ABSTRACT");
-  set_integer(0x800, module_object, "ACC_STRICT");
-  set_integer(0x1000, module_object, "ACC_SYNTHETIC");
-  set_integer(0x2000, module_object, "ACC_ANNOTATION");
-  set_integer(0x4000, module_object, "ACC_ENUM");
-  set_integer(0x10000, module_object, "ACC_CONSTRUCTOR");
-  set_integer(0x20000, module_object, "ACC_DECLARED_SYNCHRONIZED");
-
-  set_integer(0x0000, module_object, "TYPE_HEADER_ITEM");
-  set_integer(0x0001, module_object, "TYPE_STRING_ID_ITEM");
-  set_integer(0x0002, module_object, "TYPE_TYPE_ID_ITEM");
-  set_integer(0x0003, module_object, "TYPE_PROTO_ID_ITEM");
-  set_integer(0x0004, module_object, "TYPE_FIELD_ID_ITEM");
-  set_integer(0x0005, module_object, "TYPE_METHOD_ID_ITEM");
-  set_integer(0x0006, module_object, "TYPE_CLASS_DEF_ITEM");
-  set_integer(0x0007, module_object, "TYPE_CALL_SITE_ID_ITEM");
-  set_integer(0x0008, module_object, "TYPE_METHOD_HANDLE_ITEM");
-  set_integer(0x1000, module_object, "TYPE_MAP_LIST");
-  set_integer(0x1001, module_object, "TYPE_TYPE_LIST");
-  set_integer(0x1002, module_object, "TYPE_ANNOTATION_SET_REF_LIST");
-  set_integer(0x1003, module_object, "TYPE_ANNOTATION_SET_ITEM");
-  set_integer(0x2000, module_object, "TYPE_CLASS_DATA_ITEM");
-  set_integer(0x2001, module_object, "TYPE_CODE_ITEM");
-  set_integer(0x2002, module_object, "TYPE_STRING_DATA_ITEM");
-  set_integer(0x2003, module_object, "TYPE_DEBUG_INFO_ITEM");
-  set_integer(0x2004, module_object, "TYPE_ANNOTATION_ITEM");
-  set_integer(0x2005, module_object, "TYPE_ENCODED_ARRAY_ITEM");
-  set_integer(0x2006, module_object, "TYPE_ANNOTATIONS_DIRECTORY_ITEM");
-
   foreach_memory_block(iterator, block)
   {
     const uint8_t* block_data = block->fetch_data(block);
@@ -489,6 +489,110 @@ PARSE_ELF_HEADER(32, be);
 PARSE_ELF_HEADER(64, be);
 
 
+// ELF constants, set once when the module is declared instead of on every
+// scan.
+
+static void elf_set_definitions(YR_OBJECT* module_object)
+{
+  set_integer(ELF_ET_NONE, module_object, "ET_NONE");
+  set_integer(ELF_ET_REL, module_object, "ET_REL");
+  set_integer(ELF_ET_EXEC, module_object, "ET_EXEC");
+  set_integer(ELF_ET_DYN, module_object, "ET_DYN");
+  set_integer(ELF_ET_CORE, module_object, "ET_CORE");
+
+  set_integer(ELF_EM_NONE, module_object, "EM_NONE");
+  set_integer(ELF_EM_M32, module_object, "EM_M32");
+  set_integer(ELF_EM_SPARC, module_object, "EM_SPARC");
+  set_integer(ELF_EM_386, module_object, "EM_386");
+  set_integer(ELF_EM_68K, module_object, "EM_68K");
+  set_integer(ELF_EM_88K, module_object, "EM_88K");
+  set_integer(ELF_EM_860, module_object, "EM_860");
+  set_integer(ELF_EM_MIPS, module_object, "EM_MIPS");
+  set_integer(ELF_EM_MIPS_RS3_LE, module_object, "EM_MIPS_RS3_LE");
+  set_integer(ELF_EM_PPC, module_object, "EM_PPC");
+  set_integer(ELF_EM_PPC64, module_object, "EM_PPC64");
+  set_integer(ELF_EM_ARM, module_object, "EM_ARM");
+  set_integer(ELF_EM_X86_64, module_object, "EM_X86_64");
+  set_integer(ELF_EM_AARCH64, module_object, "EM_AARCH64");
+
+  set_integer(ELF_SHT_NULL, module_object, "SHT_NULL");
+  set_integer(ELF_SHT_PROGBITS, module_object, "SHT_PROGBITS");
+  set_integer(ELF_SHT_SYMTAB, module_object, "SHT_SYMTAB");
+  set_integer(ELF_SHT_STRTAB, module_object, "SHT_STRTAB");
+  set_integer(ELF_SHT_RELA, module_object, "SHT_RELA");
+  set_integer(ELF_SHT_HASH, module_object, "SHT_HASH");
+  set_integer(ELF_SHT_DYNAMIC, module_object, "SHT_DYNAMIC");
+  set_integer(ELF_SHT_NOTE, module_object, "SHT_NOTE");
+  set_integer(ELF_SHT_NOBITS, module_object, "SHT_NOBITS");
+  set_integer(ELF_SHT_REL, module_object, "SHT_REL");
+  set_integer(ELF_SHT_SHLIB, module_object, "SHT_SHLIB");
+  set_integer(ELF_SHT_DYNSYM, module_object, "SHT_DYNSYM");
+
+  set_integer(ELF_SHF_WRITE, module_object, "SHF_WRITE");
+  set_integer(ELF_SHF_ALLOC, module_object, "SHF_ALLOC");
+  set_integer(ELF_SHF_EXECINSTR, module_object, "SHF_EXECINSTR");
+
+  set_integer(ELF_PT_NULL, module_object, "PT_NULL");
+  set_integer(ELF_PT_LOAD, module_object, "PT_LOAD");
+  set_integer(ELF_PT_DYNAMIC, module_object, "PT_DYNAMIC");
+  set_integer(ELF_PT_INTERP, module_object, "PT_INTERP");
+  set_integer(ELF_PT_NOTE, module_object, "PT_NOTE");
+  set_integer(ELF_PT_SHLIB, module_object, "PT_SHLIB");
+  set_integer(ELF_PT_PHDR, module_object, "PT_PHDR");
+  set_integer(ELF_PT_TLS, module_object, "PT_TLS");
+  set_integer(ELF_PT_GNU_EH_FRAME, module_object, "PT_GNU_EH_FRAME");
+  set_integer(ELF_PT_GNU_STACK, module_object, "PT_GNU_STACK");
+
+  set_integer(ELF_DT_NULL, module_object, "DT_NULL");
+  set_integer(ELF_DT_NEEDED, module_object, "DT_NEEDED");
+  set_integer(ELF_DT_PLTRELSZ, module_object, "DT_PLTRELSZ");
+  set_integer(ELF_DT_PLTGOT, module_object, "DT_PLTGOT");
+  set_integer(ELF_DT_HASH, module_object, "DT_HASH");
+  set_integer(ELF_DT_STRTAB, module_object, "DT_STRTAB");
+  set_integer(ELF_DT_SYMTAB, module_object, "DT_SYMTAB");
+  set_integer(ELF_DT_RELA, module_object, "DT_RELA");
+  set_integer(ELF_DT_RELASZ, module_object, "DT_RELASZ");
+  set_integer(ELF_DT_RELAENT, module_object, "DT_RELAENT");
+  set_integer(ELF_DT_STRSZ, module_object, "DT_STRSZ");
+  set_integer(ELF_DT_SYMENT, module_object, "DT_SYMENT");
+  set_integer(ELF_DT_INIT, module_object, "DT_INIT");
+  set_integer(ELF_DT_FINI, module_object, "DT_FINI");
+  set_integer(ELF_DT_SONAME, module_object, "DT_SONAME");
+  set_integer(ELF_DT_RPATH, module_object, "DT_RPATH");
+  set_integer(ELF_DT_SYMBOLIC, module_object, "DT_SYMBOLIC");
+  set_integer(ELF_DT_REL, module_object, "DT_REL");
+  set_integer(ELF_DT_RELSZ, module_object, "DT_RELSZ");
+  set_integer(ELF_DT_RELENT, module_object, "DT_RELENT");
+  set_integer(ELF_DT_PLTREL, module_object, "DT_PLTREL");
+  set_integer(ELF_DT_DEBUG, module_object, "DT_DEBUG");
+  set_integer(ELF_DT_TEXTREL, module_object, "DT_TEXTREL");
+  set_integer(ELF_DT_JMPREL, module_object, "DT_JMPREL");
+  set_integer(ELF_DT_BIND_NOW, module_object, "DT_BIND_NOW");
+  set_integer(ELF_DT_INIT_ARRAY, module_object, "DT_INIT_ARRAY");
+  set_integer(ELF_DT_FINI_ARRAY, module_object, "DT_FINI_ARRAY");
+  set_integer(ELF_DT_INIT_ARRAYSZ, module_object, "DT_INIT_ARRAYSZ");
+  set_integer(ELF_DT_FINI_ARRAYSZ, module_object, "DT_FINI_ARRAYSZ");
+  set_integer(ELF_DT_RUNPATH, module_object, "DT_RUNPATH");
+  set_integer(ELF_DT_FLAGS, module_object, "DT_FLAGS");
+  set_integer(ELF_DT_ENCODING, module_object, "DT_ENCODING");
+
+  set_integer(ELF_STT_NOTYPE, module_object, "STT_NOTYPE");
+  set_integer(ELF_STT_OBJECT, module_object, "STT_OBJECT");
+  set_integer(ELF_STT_FUNC, module_object, "STT_FUNC");
+  set_integer(ELF_STT_SECTION, module_object, "STT_SECTION");
+  set_integer(ELF_STT_FILE, module_object, "STT_FILE");
+  set_integer(ELF_STT_COMMON, module_object, "STT_COMMON");
+  set_integer(ELF_STT_TLS, module_object, "STT_TLS");
+
+  set_integer(ELF_STB_LOCAL, module_object, "STB_LOCAL");
+  set_integer(ELF_STB_GLOBAL, module_object, "STB_GLOBAL");
+  set_integer(ELF_STB_WEAK, module_object, "STB_WEAK");
+
+  set_integer(ELF_PF_X, module_object, "PF_X");
+  set_integer(ELF_PF_W, module_object, "PF_W");
+  set_integer(ELF_PF_R, module_object, "PF_R");
+}
+
 begin_declarations
   declare_integer("ET_NONE");
   declare_integer("ET_REL");
@@ -646,6 +750,7 @@ begin_declarations
     declare_integer("shndx");
   end_struct_array("dynsym")
 
+  elf_set_definitions(module);
 end_declarations
 
 
@@ -673,104 +778,6 @@ int module_load(
   elf32_header_t* elf_header32;
   elf64_header_t* elf_header64;
 
-  set_integer(ELF_ET_NONE, module_object, "ET_NONE");
-  set_integer(ELF_ET_REL, module_object, "ET_REL");
-  set_integer(ELF_ET_EXEC, module_object, "ET_EXEC");
-  set_integer(ELF_ET_DYN, module_object, "ET_DYN");
-  set_integer(ELF_ET_CORE, module_object, "ET_CORE");
-
-  set_integer(ELF_EM_NONE, module_object, "EM_NONE");
-  set_integer(ELF_EM_M32, module_object, "EM_M32");
-  set_integer(ELF_EM_SPARC, module_object, "EM_SPARC");
-  set_integer(ELF_EM_386, module_object, "EM_386");
-  set_integer(ELF_EM_68K, module_object, "EM_68K");
-  set_integer(ELF_EM_88K, module_object, "EM_88K");
-  set_integer(ELF_EM_860, module_object, "EM_860");
-  set_integer(ELF_EM_MIPS, module_object, "EM_MIPS");
-  set_integer(ELF_EM_MIPS_RS3_LE, module_object, "EM_MIPS_RS3_LE");
-  set_integer(ELF_EM_PPC, module_object, "EM_PPC");
-  set_integer(ELF_EM_PPC64, module_object, "EM_PPC64");
-  set_integer(ELF_EM_ARM, module_object, "EM_ARM");
-  set_integer(ELF_EM_X86_64, module_object, "EM_X86_64");
-  set_integer(ELF_EM_AARCH64, module_object, "EM_AARCH64");
-
-  set_integer(ELF_SHT_NULL, module_object, "SHT_NULL");
-  set_integer(ELF_SHT_PROGBITS, module_object, "SHT_PROGBITS");
-  set_integer(ELF_SHT_SYMTAB, module_object, "SHT_SYMTAB");
-  set_integer(ELF_SHT_STRTAB, module_object, "SHT_STRTAB");
-  set_integer(ELF_SHT_RELA, module_object, "SHT_RELA");
-  set_integer(ELF_SHT_HASH, module_object, "SHT_HASH");
-  set_integer(ELF_SHT_DYNAMIC, module_object, "SHT_DYNAMIC");
-  set_integer(ELF_SHT_NOTE, module_object, "SHT_NOTE");
-  set_integer(ELF_SHT_NOBITS, module_object, "SHT_NOBITS");
-  set_integer(ELF_SHT_REL, module_object, "SHT_REL");
-  set_integer(ELF_SHT_SHLIB, module_object, "SHT_SHLIB");
-  set_integer(ELF_SHT_DYNSYM, module_object, "SHT_DYNSYM");
-
-  set_integer(ELF_SHF_WRITE, module_object, "SHF_WRITE");
-  set_integer(ELF_SHF_ALLOC, module_object, "SHF_ALLOC");
-  set_integer(ELF_SHF_EXECINSTR, module_object, "SHF_EXECINSTR");
-
-  set_integer(ELF_PT_NULL, module_object, "PT_NULL");
-  set_integer(ELF_PT_LOAD, module_object, "PT_LOAD");
-  set_integer(ELF_PT_DYNAMIC, module_object, "PT_DYNAMIC");
-  set_integer(ELF_PT_INTERP, module_object, "PT_INTERP");
-  set_integer(ELF_PT_NOTE, module_object, "PT_NOTE");
-  set_integer(ELF_PT_SHLIB, module_object, "PT_SHLIB");
-  set_integer(ELF_PT_PHDR, module_object, "PT_PHDR");
-  set_integer(ELF_PT_TLS, module_object, "PT_TLS");
-  set_integer(ELF_PT_GNU_EH_FRAME, module_object, "PT_GNU_EH_FRAME");
-  set_integer(ELF_PT_GNU_STACK, module_object, "PT_GNU_STACK");
-
-  set_integer(ELF_DT_NULL, module_object, "DT_NULL");
-  set_integer(ELF_DT_NEEDED, module_object, "DT_NEEDED");
-  set_integer(ELF_DT_PLTRELSZ, module_object, "DT_PLTRELSZ");
-  set_integer(ELF_DT_PLTGOT, module_object, "DT_PLTGOT");
-  set_integer(ELF_DT_HASH, module_object, "DT_HASH");
-  set_integer(ELF_DT_STRTAB, module_object, "DT_STRTAB");
-  set_integer(ELF_DT_SYMTAB, module_object, "DT_SYMTAB");
-  set_integer(ELF_DT_RELA, module_object, "DT_RELA");
-  set_integer(ELF_DT_RELASZ, module_object, "DT_RELASZ");
-  set_integer(ELF_DT_RELAENT, module_object, "DT_RELAENT");
-  set_integer(ELF_DT_STRSZ, module_object, "DT_STRSZ");
-  set_integer(ELF_DT_SYMENT, module_object, "DT_SYMENT");
-  set_integer(ELF_DT_INIT, module_object, "DT_INIT");
-  set_integer(ELF_DT_FINI, module_object, "DT_FINI");
-  set_integer(ELF_DT_SONAME, module_object, "DT_SONAME");
-  set_integer(ELF_DT_RPATH, module_object, "DT_RPATH");
-  set_integer(ELF_DT_SYMBOLIC, module_object, "DT_SYMBOLIC");
-  set_integer(ELF_DT_REL, module_object, "DT_REL");
-  set_integer(ELF_DT_RELSZ, module_object, "DT_RELSZ");
-  set_integer(ELF_DT_RELENT, module_object, "DT_RELENT");
-  set_integer(ELF_DT_PLTREL, module_object, "DT_PLTREL");
-  set_integer(ELF_DT_DEBUG, module_object, "DT_DEBUG");
-  set_integer(ELF_DT_TEXTREL, module_object, "DT_TEXTREL");
-  set_integer(ELF_DT_JMPREL, module_object, "DT_JMPREL");
-  set_integer(ELF_DT_BIND_NOW, module_object, "DT_BIND_NOW");
-  set_integer(ELF_DT_INIT_ARRAY, module_object, "DT_INIT_ARRAY");
-  set_integer(ELF_DT_FINI_ARRAY, module_object, "DT_FINI_ARRAY");
-  set_integer(ELF_DT_INIT_ARRAYSZ, module_object, "DT_INIT_ARRAYSZ");
-  set_integer(ELF_DT_FINI_ARRAYSZ, module_object, "DT_FINI_ARRAYSZ");
-  set_integer(ELF_DT_RUNPATH, module_object, "DT_RUNPATH");
-  set_integer(ELF_DT_FLAGS, module_object, "DT_FLAGS");
-  set_integer(ELF_DT_ENCODING, module_object, "DT_ENCODING");
-
-  set_integer(ELF_STT_NOTYPE, module_object, "STT_NOTYPE");
-  set_integer(ELF_STT_OBJECT, module_object, "STT_OBJECT");
-  set_integer(ELF_STT_FUNC, module_object, "STT_FUNC");
-  set_integer(ELF_STT_SECTION, module_object, "STT_SECTION");
-  set_integer(ELF_STT_FILE, module_object, "STT_FILE");
-  set_integer(ELF_STT_COMMON, module_object, "STT_COMMON");
-  set_integer(ELF_STT_TLS, module_object, "STT_TLS");
-
-  set_integer(ELF_STB_LOCAL, module_object, "STB_LOCAL");
-  set_integer(ELF_STB_GLOBAL, module_object, "STB_GLOBAL");
-  set_integer(ELF_STB_WEAK, module_object, "STB_WEAK");
-
-  set_integer(ELF_PF_X, module_object, "PF_X");
-  set_integer(ELF_PF_W, module_object, "PF_W");
-  set_integer(ELF_PF_R, module_object, "PF_R");
-
   foreach_memory_block(iterator, block)
   {
     const uint8_t* block_data = block->fetch_data(block);
@@ -27,14 +27,38 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <string.h>
+#include <yara/endian.h>
 #include <yara/globals.h>
 #include <yara/mem.h>
 #include <yara/modules.h>
+#include <yara/rules.h>
 
 #include "../crypto.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_PCLMUL
+#include <immintrin.h>
+#endif
+
 #define MODULE_NAME hash
 
+// Digests that can be computed for a range of the scanned data.
+#define DIGEST_MD5        0x01
+#define DIGEST_SHA1       0x02
+#define DIGEST_SHA256     0x04
+#define DIGEST_CHECKSUM32 0x08
+#define DIGEST_CRC32      0x10
+
+// Maximum number of ranges whose digests are kept in the cache. When this
+// number is reached the cache is emptied, which bounds both the memory used
+// and the length of the hash table's chains in loops over many ranges.
+#define MAX_CACHE_ENTRIES 1024
+
+// The data is passed to the digests in pieces of this size, so that each
+// piece is still in the CPU cache when the last digest reads it.
+#define DIGEST_PIECE_SIZE 16384
+
 
 typedef struct _CACHE_KEY
 {
@@ -44,6 +68,48 @@ typedef struct _CACHE_KEY
 } CACHE_KEY;
 
 
+typedef struct _DIGESTS
+{
+  // Combination of DIGEST_XXX flags for the digests below that have been
+  // computed.
+  int computed;
+
+  char md5[YR_MD5_LEN * 2 + 1];
+  char sha1[YR_SHA1_LEN * 2 + 1];
+  char sha256[YR_SHA256_LEN * 2 + 1];
+
+  uint32_t checksum32;
+  uint32_t crc32;
+
+} DIGESTS;
+
+
+typedef struct _HASH_CACHE
+{
+  // Maps each CACHE_KEY to the DIGESTS computed for that range.
+  YR_HASH_TABLE* hash_table;
+  int entries;
+
+  // Combination of DIGEST_XXX flags for the digests that the rules compute
+  // over ranges of the scanned data. All of them are computed at once the
+  // first time any of them is requested for a range.
+  int called_digests;
+
+} HASH_CACHE;
+
+
+typedef struct _DIGEST_CONTEXT
+{
+  yr_md5_ctx md5;
+  yr_sha1_ctx sha1;
+  yr_sha256_ctx sha256;
+
+  uint32_t checksum32;
+  uint32_t crc32;
+
+} DIGEST_CONTEXT;
+
+
 const uint32_t crc32_tab[] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
     0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
@@ -90,6 +156,158 @@ const uint32_t crc32_tab[] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d};
 
 
+// Tables for computing the CRC32 eight bytes at a time, crc32_slices[0] is
+// the same as crc32_tab and crc32_slices[k][n] is the CRC of byte n followed
+// by k zeroes. They are filled by module_initialize.
+static uint32_t crc32_slices[8][256];
+
+
+static uint32_t crc32_update_portable(
+    uint32_t crc,
+    const uint8_t* data,
+    size_t length)
+{
+  while (length >= 8)
+  {
+    uint32_t lo, hi;
+
+    memcpy(&lo, data, sizeof(lo));
+    memcpy(&hi, data + 4, sizeof(hi));
+
+    lo = yr_le32toh(lo) ^ crc;
+    hi = yr_le32toh(hi);
+
+    crc = crc32_slices[7][lo & 0xFF] ^ crc32_slices[6][(lo >> 8) & 0xFF] ^
+          crc32_slices[5][(lo >> 16) & 0xFF] ^ crc32_slices[4][lo >> 24] ^
+          crc32_slices[3][hi & 0xFF] ^ crc32_slices[2][(hi >> 8) & 0xFF] ^
+          crc32_slices[1][(hi >> 16) & 0xFF] ^ crc32_slices[0][hi >> 24];
+
+    data += 8;
+    length -= 8;
+  }
+
+  while (length-- > 0) crc = crc32_tab[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+  return crc;
+}
+
+
+#if defined(CRC32_PCLMUL)
+
+// Folds 64 bytes at a time with carry-less multiplications, as described in
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+// by Gopal et al. The constants are the ones given in that paper for the
+// bit-reflected CRC32 polynomial. SSE4.2 has a crc32 instruction, but it uses
+// the Castagnoli polynomial instead of the one used by this module.
+__attribute__((target("pclmul,sse4.1"))) static uint32_t crc32_update_pclmul(
+    uint32_t crc,
+    const uint8_t* data,
+    size_t length)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+  if (length < 64)
+    return crc32_update_portable(crc, data, length);
+
+  x1 = _mm_loadu_si128((const __m128i*) (data + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*) (data + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*) (data + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*) (data + 0x30));
+
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+
+  data += 64;
+  length -= 64;
+
+  while (length >= 64)
+  {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+    x1 = _mm_xor_si128(x1, x5);
+    x2 = _mm_xor_si128(x2, x6);
+    x3 = _mm_xor_si128(x3, x7);
+    x4 = _mm_xor_si128(x4, x8);
+
+    x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*) (data + 0x00)));
+    x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i*) (data + 0x10)));
+    x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i*) (data + 0x20)));
+    x4 = _mm_xor_si128(x4, _mm_loadu_si128((const __m128i*) (data + 0x30)));
+
+    data += 64;
+    length -= 64;
+  }
+
+  // Fold the four 128-bits values into one.
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  while (length >= 16)
+  {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(x1, x5);
+    x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*) data));
+
+    data += 16;
+    length -= 16;
+  }
+
+  // Fold the 128-bits value into 64 bits.
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits.
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  crc = (uint32_t) _mm_extract_epi32(x1, 1);
+
+  return crc32_update_portable(crc, data, length);
+}
+
+#endif
+
+
+// Updates a CRC32 that starts as 0xFFFFFFFF and must be inverted at the end.
+// module_initialize replaces the portable implementation with the one using
+// PCLMULQDQ if the CPU supports it.
+static uint32_t (*crc32_update)(
+    uint32_t crc,
+    const uint8_t* data,
+    size_t length) = crc32_update_portable;
+
+
 static void digest_to_ascii(
     unsigned char* digest,
     char* digest_ascii,
@@ -104,20 +322,102 @@ static void digest_to_ascii(
 }
 
 
-static char* get_from_cache(
+static void digests_init(DIGEST_CONTEXT* context, int digests)
+{
+  if (digests & DIGEST_MD5)
+    yr_md5_init(&context->md5);
+
+  if (digests & DIGEST_SHA1)
+    yr_sha1_init(&context->sha1);
+
+  if (digests & DIGEST_SHA256)
+    yr_sha256_init(&context->sha256);
+
+  context->checksum32 = 0;
+  context->crc32 = 0xFFFFFFFF;
+}
+
+
+static void digests_update(
+    DIGEST_CONTEXT* context,
+    int digests,
+    const uint8_t* data,
+    size_t length)
+{
+  while (length > 0)
+  {
+    size_t i;
+    size_t piece_length = yr_min(length, DIGEST_PIECE_SIZE);
+
+    if (digests & DIGEST_MD5)
+      yr_md5_update(&context->md5, data, piece_length);
+
+    if (digests & DIGEST_SHA1)
+      yr_sha1_update(&context->sha1, data, piece_length);
+
+    if (digests & DIGEST_SHA256)
+      yr_sha256_update(&context->sha256, data, piece_length);
+
+    if (digests & DIGEST_CHECKSUM32)
+      for (i = 0; i < piece_length; i++) context->checksum32 += data[i];
+
+    if (digests & DIGEST_CRC32)
+      context->crc32 = crc32_update(context->crc32, data, piece_length);
+
+    data += piece_length;
+    length -= piece_length;
+  }
+}
+
+
+static void digests_final(
+    DIGEST_CONTEXT* context,
+    int digests,
+    DIGESTS* result)
+{
+  unsigned char digest[YR_SHA256_LEN];
+
+  if (digests & DIGEST_MD5)
+  {
+    yr_md5_final(digest, &context->md5);
+    digest_to_ascii(digest, result->md5, YR_MD5_LEN);
+  }
+
+  if (digests & DIGEST_SHA1)
+  {
+    yr_sha1_final(digest, &context->sha1);
+    digest_to_ascii(digest, result->sha1, YR_SHA1_LEN);
+  }
+
+  if (digests & DIGEST_SHA256)
+  {
+    yr_sha256_final(digest, &context->sha256);
+    digest_to_ascii(digest, result->sha256, YR_SHA256_LEN);
+  }
+
+  if (digests & DIGEST_CHECKSUM32)
+    result->checksum32 = context->checksum32;
+
+  if (digests & DIGEST_CRC32)
+    result->crc32 = context->crc32 ^ 0xFFFFFFFF;
+
+  result->computed |= digests;
+}
+
+
+static DIGESTS* get_from_cache(
     YR_OBJECT* module_object,
-    const char* ns,
     int64_t offset,
     int64_t length)
 {
   CACHE_KEY key;
-  YR_HASH_TABLE* hash_table = (YR_HASH_TABLE*) module_object->data;
+  HASH_CACHE* cache = (HASH_CACHE*) module_object->data;
 
   key.offset = offset;
   key.length = length;
 
-  char* result = (char*) yr_hash_table_lookup_raw_key(
-      hash_table, &key, sizeof(key), ns);
+  DIGESTS* result = (DIGESTS*) yr_hash_table_lookup_raw_key(
+      cache->hash_table, &key, sizeof(key), NULL);
 
   YR_DEBUG_FPRINTF(
       2,
@@ -134,39 +434,156 @@ static char* get_from_cache(
 
 static int add_to_cache(
     YR_OBJECT* module_object,
-    const char* ns,
     int64_t offset,
     int64_t length,
-    const char* digest)
+    DIGESTS** digests)
 {
   CACHE_KEY key;
-  YR_HASH_TABLE* hash_table = (YR_HASH_TABLE*) module_object->data;
+  HASH_CACHE* cache = (HASH_CACHE*) module_object->data;
+
+  if (cache->entries == MAX_CACHE_ENTRIES)
+  {
+    yr_hash_table_clean(
+        cache->hash_table, (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_free);
 
-  char* copy = yr_strdup(digest);
+    cache->entries = 0;
+  }
 
-  key.offset = offset;
-  key.length = length;
+  DIGESTS* new_digests = (DIGESTS*) yr_malloc(sizeof(DIGESTS));
 
-  if (copy == NULL)
+  if (new_digests == NULL)
     return ERROR_INSUFFICIENT_MEMORY;
 
+  new_digests->computed = 0;
+
+  key.offset = offset;
+  key.length = length;
+
   int result = yr_hash_table_add_raw_key(
-      hash_table, &key, sizeof(key), ns, (void*) copy);
+      cache->hash_table, &key, sizeof(key), NULL, (void*) new_digests);
+
+  if (result != ERROR_SUCCESS)
+  {
+    yr_free(new_digests);
+    return result;
+  }
+
+  cache->entries++;
+  *digests = new_digests;
 
   YR_DEBUG_FPRINTF(
       2,
       stderr,
-      "- %s(offset=%" PRIi64 " length=%" PRIi64 " digest=%s) {} = %d\n",
+      "- %s(offset=%" PRIi64 " length=%" PRIi64 ") {} = %d\n",
       __FUNCTION__,
       offset,
       length,
-      digest,
       result);
 
   return result;
 }
 
 
+// Returns in *digests the digests for the given range of the scanned data, or
+// NULL if they are undefined. The requested digest is computed if it's not
+// already in the cache, together with every other digest called by the rules
+// that is not in the cache either, all of them in a single pass over the data.
+static int get_digests(
+    YR_SCAN_CONTEXT* context,
+    YR_OBJECT* module_object,
+    int digest,
+    int64_t offset,
+    int64_t length,
+    DIGESTS** digests)
+{
+  HASH_CACHE* cache = (HASH_CACHE*) module_object->data;
+  YR_MEMORY_BLOCK* block = first_memory_block(context);
+  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
+
+  DIGEST_CONTEXT digest_context;
+  DIGESTS* cached_digests;
+
+  int64_t arg_offset = offset;
+  int64_t arg_length = length;
+
+  bool past_first_block = false;
+
+  *digests = NULL;
+
+  if (block == NULL)
+    return ERROR_SUCCESS;
+
+  if (offset < 0 || length < 0 || offset < block->base)
+    return ERROR_SUCCESS;
+
+  cached_digests = get_from_cache(module_object, arg_offset, arg_length);
+
+  if (cached_digests != NULL && (cached_digests->computed & digest))
+  {
+    *digests = cached_digests;
+    return ERROR_SUCCESS;
+  }
+
+  int missing = digest | cache->called_digests;
+
+  if (cached_digests != NULL)
+    missing &= ~cached_digests->computed;
+
+  digests_init(&digest_context, missing);
+
+  foreach_memory_block(iterator, block)
+  {
+    // if desired block within current block
+
+    if (offset >= block->base && offset < block->base + block->size)
+    {
+      const uint8_t* block_data = block->fetch_data(block);
+
+      if (block_data != NULL)
+      {
+        size_t data_offset = (size_t)(offset - block->base);
+        size_t data_len = (size_t) yr_min(
+            length, (size_t)(block->size - data_offset));
+
+        offset += data_len;
+        length -= data_len;
+
+        digests_update(
+            &digest_context, missing, block_data + data_offset, data_len);
+      }
+
+      past_first_block = true;
+    }
+    else if (past_first_block)
+    {
+      // If offset is not within current block and we already
+      // past the first block then the we are trying to compute
+      // the checksum over a range of non contiguous blocks. As
+      // range contains gaps of undefined data the checksum is
+      // undefined.
+
+      return ERROR_SUCCESS;
+    }
+
+    if (block->base + block->size > offset + length)
+      break;
+  }
+
+  if (!past_first_block)
+    return ERROR_SUCCESS;
+
+  if (cached_digests == NULL)
+    FAIL_ON_ERROR(
+        add_to_cache(module_object, arg_offset, arg_length, &cached_digests));
+
+  digests_final(&digest_context, missing, cached_digests);
+
+  *digests = cached_digests;
+
+  return ERROR_SUCCESS;
+}
+
+
 define_function(string_md5)
 {
   unsigned char digest[YR_MD5_LEN];
@@ -268,455 +685,85 @@ define_function(string_checksum32)
 
 define_function(data_md5)
 {
-  yr_md5_ctx md5_context;
+  DIGESTS* digests;
 
-  unsigned char digest[YR_MD5_LEN];
-  char digest_ascii[YR_MD5_LEN * 2 + 1];
-  char* cached_ascii_digest;
+  int64_t offset = integer_argument(1);  // offset where to start
+  int64_t length = integer_argument(2);  // length of bytes we want hash on
 
-  bool past_first_block = false;
+  FAIL_ON_ERROR(get_digests(
+      scan_context(), module(), DIGEST_MD5, offset, length, &digests));
 
-  YR_SCAN_CONTEXT* context = scan_context();
-  YR_MEMORY_BLOCK* block = first_memory_block(context);
-  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
+  if (digests == NULL)
+    return_string(YR_UNDEFINED);
 
-  int64_t arg_offset = integer_argument(1);  // offset where to start
-  int64_t arg_length = integer_argument(2);  // length of bytes we want hash on
+  YR_DEBUG_FPRINTF(2, stderr, "- %s() {} = 0x%s\n", __FUNCTION__, digests->md5);
+  return_string(digests->md5);
+}
 
-  int64_t offset = arg_offset;
-  int64_t length = arg_length;
 
-  YR_DEBUG_FPRINTF(
-      2,
-      stderr,
-      "+ %s(offset=%" PRIi64 " length=%" PRIi64 ") {\n",
-      __FUNCTION__,
-      offset,
-      length);
+define_function(data_sha1)
+{
+  DIGESTS* digests;
 
-  if (block == NULL)
-  {
-    YR_DEBUG_FPRINTF(
-        2, stderr, "} // %s() = YR_UNDEFINED // block == NULL\n", __FUNCTION__);
-    return_string(YR_UNDEFINED);
-  }
+  int64_t offset = integer_argument(1);  // offset where to start
+  int64_t length = integer_argument(2);  // length of bytes we want hash on
 
-  yr_md5_init(&md5_context);
+  FAIL_ON_ERROR(get_digests(
+      scan_context(), module(), DIGEST_SHA1, offset, length, &digests));
 
-  if (offset < 0 || length < 0 || offset < block->base)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = YR_UNDEFINED // bad offset / length\n",
-        __FUNCTION__);
+  if (digests == NULL)
     return_string(YR_UNDEFINED);
-  }
 
-  cached_ascii_digest = get_from_cache(module(), "md5", arg_offset, arg_length);
+  YR_DEBUG_FPRINTF(
+      2, stderr, "- %s() {} = 0x%s\n", __FUNCTION__, digests->sha1);
+  return_string(digests->sha1);
+}
 
-  if (cached_ascii_digest != NULL)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = %s (cached)\n",
-        __FUNCTION__,
-        cached_ascii_digest);
-    return_string(cached_ascii_digest);
-  }
 
-  foreach_memory_block(iterator, block)
-  {
-    // if desired block within current block
+define_function(data_sha256)
+{
+  DIGESTS* digests;
 
-    if (offset >= block->base && offset < block->base + block->size)
-    {
-      const uint8_t* block_data = block->fetch_data(block);
+  int64_t offset = integer_argument(1);  // offset where to start
+  int64_t length = integer_argument(2);  // length of bytes we want hash on
 
-      if (block_data != NULL)
-      {
-        size_t data_offset = (size_t)(offset - block->base);
-        size_t data_len = (size_t) yr_min(
-            length, (size_t)(block->size - data_offset));
+  FAIL_ON_ERROR(get_digests(
+      scan_context(), module(), DIGEST_SHA256, offset, length, &digests));
 
-        offset += data_len;
-        length -= data_len;
+  if (digests == NULL)
+    return_string(YR_UNDEFINED);
 
-        yr_md5_update(&md5_context, block_data + data_offset, data_len);
-      }
+  YR_DEBUG_FPRINTF(
+      2, stderr, "- %s() {} = 0x%s\n", __FUNCTION__, digests->sha256);
+  return_string(digests->sha256);
+}
 
-      past_first_block = true;
-    }
-    else if (past_first_block)
-    {
-      // If offset is not within current block and we already
-      // past the first block then the we are trying to compute
-      // the checksum over a range of non contiguous blocks. As
-      // range contains gaps of undefined data the checksum is
-      // undefined.
 
-      YR_DEBUG_FPRINTF(
-          2,
-          stderr,
-          "} // %s() = YR_UNDEFINED // past_first_block\n",
-          __FUNCTION__);
-      return_string(YR_UNDEFINED);
-    }
+define_function(data_checksum32)
+{
+  DIGESTS* digests;
 
-    if (block->base + block->size > offset + length)
-      break;
-  }
+  int64_t offset = integer_argument(1);  // offset where to start
+  int64_t length = integer_argument(2);  // length of bytes we want hash on
 
-  if (!past_first_block)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = YR_UNDEFINED // !past_first_block\n",
-        __FUNCTION__);
-    return_string(YR_UNDEFINED);
-  }
+  FAIL_ON_ERROR(get_digests(
+      scan_context(), module(), DIGEST_CHECKSUM32, offset, length, &digests));
 
-  yr_md5_final(digest, &md5_context);
-
-  digest_to_ascii(digest, digest_ascii, YR_MD5_LEN);
-
-  FAIL_ON_ERROR(
-      add_to_cache(module(), "md5", arg_offset, arg_length, digest_ascii));
-
-  YR_DEBUG_FPRINTF(2, stderr, "} // %s() = 0x%s\n", __FUNCTION__, digest_ascii);
-  return_string(digest_ascii);
-}
-
-
-define_function(data_sha1)
-{
-  yr_sha1_ctx sha_context;
-
-  unsigned char digest[YR_SHA1_LEN];
-  char digest_ascii[YR_SHA1_LEN * 2 + 1];
-  char* cached_ascii_digest;
-
-  int past_first_block = false;
-
-  int64_t arg_offset = integer_argument(1);  // offset where to start
-  int64_t arg_length = integer_argument(2);  // length of bytes we want hash on
-
-  int64_t offset = arg_offset;
-  int64_t length = arg_length;
-
-  YR_SCAN_CONTEXT* context = scan_context();
-  YR_MEMORY_BLOCK* block = first_memory_block(context);
-  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
-
-  YR_DEBUG_FPRINTF(
-      2,
-      stderr,
-      "+ %s(offset=%" PRIi64 " length=%" PRIi64 ") {\n",
-      __FUNCTION__,
-      offset,
-      length);
-
-  if (block == NULL)
-  {
-    YR_DEBUG_FPRINTF(
-        2, stderr, "} // %s() = YR_UNDEFINED // block == NULL\n", __FUNCTION__);
-    return_string(YR_UNDEFINED);
-  }
-
-  yr_sha1_init(&sha_context);
-
-  if (offset < 0 || length < 0 || offset < block->base)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = YR_UNDEFINED // bad offset / length\n",
-        __FUNCTION__);
-    return_string(YR_UNDEFINED);
-  }
-
-  cached_ascii_digest = get_from_cache(
-      module(), "sha1", arg_offset, arg_length);
-
-  if (cached_ascii_digest != NULL)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = %s (cached)\n",
-        __FUNCTION__,
-        cached_ascii_digest);
-    return_string(cached_ascii_digest);
-  }
-
-  foreach_memory_block(iterator, block)
-  {
-    // if desired block within current block
-    if (offset >= block->base && offset < block->base + block->size)
-    {
-      const uint8_t* block_data = block->fetch_data(block);
-
-      if (block_data != NULL)
-      {
-        size_t data_offset = (size_t)(offset - block->base);
-        size_t data_len = (size_t) yr_min(
-            length, (size_t) block->size - data_offset);
-
-        offset += data_len;
-        length -= data_len;
-
-        yr_sha1_update(&sha_context, block_data + data_offset, data_len);
-      }
-
-      past_first_block = true;
-    }
-    else if (past_first_block)
-    {
-      // If offset is not within current block and we already
-      // past the first block then the we are trying to compute
-      // the checksum over a range of non contiguous blocks. As
-      // range contains gaps of undefined data the checksum is
-      // undefined.
-
-      YR_DEBUG_FPRINTF(
-          2,
-          stderr,
-          "} // %s() = YR_UNDEFINED // past_first_block\n",
-          __FUNCTION__);
-      return_string(YR_UNDEFINED);
-    }
-
-    if (block->base + block->size > offset + length)
-      break;
-  }
-
-  if (!past_first_block)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = YR_UNDEFINED // !past_first_block\n",
-        __FUNCTION__);
-    return_string(YR_UNDEFINED);
-  }
-
-  yr_sha1_final(digest, &sha_context);
-
-  digest_to_ascii(digest, digest_ascii, YR_SHA1_LEN);
-
-  FAIL_ON_ERROR(
-      add_to_cache(module(), "sha1", arg_offset, arg_length, digest_ascii));
-
-  YR_DEBUG_FPRINTF(2, stderr, "} // %s() = 0x%s\n", __FUNCTION__, digest_ascii);
-  return_string(digest_ascii);
-}
-
-
-define_function(data_sha256)
-{
-  yr_sha256_ctx sha256_context;
-
-  unsigned char digest[YR_SHA256_LEN];
-  char digest_ascii[YR_SHA256_LEN * 2 + 1];
-  char* cached_ascii_digest;
-
-  int past_first_block = false;
-
-  int64_t arg_offset = integer_argument(1);  // offset where to start
-  int64_t arg_length = integer_argument(2);  // length of bytes we want hash on
-
-  int64_t offset = arg_offset;
-  int64_t length = arg_length;
-
-  YR_SCAN_CONTEXT* context = scan_context();
-  YR_MEMORY_BLOCK* block = first_memory_block(context);
-  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
-
-  YR_DEBUG_FPRINTF(
-      2,
-      stderr,
-      "+ %s(offset=%" PRIi64 " length=%" PRIi64 ") {\n",
-      __FUNCTION__,
-      offset,
-      length);
-
-  if (block == NULL)
-  {
-    YR_DEBUG_FPRINTF(
-        2, stderr, "} // %s() = YR_UNDEFINED // block == NULL\n", __FUNCTION__);
-    return_string(YR_UNDEFINED);
-  }
-
-  yr_sha256_init(&sha256_context);
-
-  if (offset < 0 || length < 0 || offset < block->base)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = YR_UNDEFINED // bad offset / length\n",
-        __FUNCTION__);
-    return_string(YR_UNDEFINED);
-  }
-
-  cached_ascii_digest = get_from_cache(
-      module(), "sha256", arg_offset, arg_length);
-
-  if (cached_ascii_digest != NULL)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = %s (cached)\n",
-        __FUNCTION__,
-        cached_ascii_digest);
-    return_string(cached_ascii_digest);
-  }
-
-  foreach_memory_block(iterator, block)
-  {
-    // if desired block within current block
-    if (offset >= block->base && offset < block->base + block->size)
-    {
-      const uint8_t* block_data = block->fetch_data(block);
-
-      if (block_data != NULL)
-      {
-        size_t data_offset = (size_t)(offset - block->base);
-        size_t data_len = (size_t) yr_min(length, block->size - data_offset);
-
-        offset += data_len;
-        length -= data_len;
-
-        yr_sha256_update(&sha256_context, block_data + data_offset, data_len);
-      }
-
-      past_first_block = true;
-    }
-    else if (past_first_block)
-    {
-      // If offset is not within current block and we already
-      // past the first block then the we are trying to compute
-      // the checksum over a range of non contiguous blocks. As
-      // range contains gaps of undefined data the checksum is
-      // undefined.
-
-      YR_DEBUG_FPRINTF(
-          2,
-          stderr,
-          "} // %s() = YR_UNDEFINED // past_first_block\n",
-          __FUNCTION__);
-      return_string(YR_UNDEFINED);
-    }
-
-    if (block->base + block->size > offset + length)
-      break;
-  }
-
-  if (!past_first_block)
-  {
-    YR_DEBUG_FPRINTF(
-        2,
-        stderr,
-        "} // %s() = YR_UNDEFINED // !past_first_block\n",
-        __FUNCTION__);
-    return_string(YR_UNDEFINED);
-  }
-
-  yr_sha256_final(digest, &sha256_context);
-
-  digest_to_ascii(digest, digest_ascii, YR_SHA256_LEN);
-
-  FAIL_ON_ERROR(
-      add_to_cache(module(), "sha256", arg_offset, arg_length, digest_ascii));
-
-  YR_DEBUG_FPRINTF(2, stderr, "} // %s() = 0x%s\n", __FUNCTION__, digest_ascii);
-  return_string(digest_ascii);
-}
-
-
-define_function(data_checksum32)
-{
-  int64_t offset = integer_argument(1);  // offset where to start
-  int64_t length = integer_argument(2);  // length of bytes we want hash on
+  if (digests == NULL)
+    return_integer(YR_UNDEFINED);
 
   YR_DEBUG_FPRINTF(
-      2,
-      stderr,
-      "+ %s(offset=%" PRIi64 " length=%" PRIi64 ") {\n",
-      __FUNCTION__,
-      offset,
-      length);
-
-  YR_SCAN_CONTEXT* context = scan_context();
-  YR_MEMORY_BLOCK* block = first_memory_block(context);
-  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
-
-  uint32_t checksum = 0;
-  int past_first_block = false;
-
-  if (block == NULL)
-    return_integer(YR_UNDEFINED);
-
-  if (offset < 0 || length < 0 || offset < block->base)
-    return_integer(YR_UNDEFINED);
-
-  foreach_memory_block(iterator, block)
-  {
-    if (offset >= block->base && offset < block->base + block->size)
-    {
-      const uint8_t* block_data = block->fetch_data(block);
-
-      if (block_data != NULL)
-      {
-        size_t i;
-
-        size_t data_offset = (size_t)(offset - block->base);
-        size_t data_len = (size_t) yr_min(length, block->size - data_offset);
-
-        offset += data_len;
-        length -= data_len;
-
-        for (i = 0; i < data_len; i++)
-          checksum += *(block_data + data_offset + i);
-      }
-
-      past_first_block = true;
-    }
-    else if (past_first_block)
-    {
-      // If offset is not within current block and we already
-      // past the first block then the we are trying to compute
-      // the checksum over a range of non contiguous blocks. As
-      // range contains gaps of undefined data the checksum is
-      // undefined.
-
-      return_integer(YR_UNDEFINED);
-    }
-
-    if (block->base + block->size > offset + length)
-      break;
-  }
-
-  if (!past_first_block)
-    return_integer(YR_UNDEFINED);
-
-  YR_DEBUG_FPRINTF(2, stderr, "} // %s() = 0x%x\n", __FUNCTION__, checksum);
-  return_integer(checksum);
+      2, stderr, "- %s() {} = 0x%x\n", __FUNCTION__, digests->checksum32);
+  return_integer(digests->checksum32);
 }
 
 
 define_function(string_crc32)
 {
-  size_t i;
   SIZED_STRING* s = sized_string_argument(1);
-  uint32_t checksum = 0xFFFFFFFF;
 
-  for (i = 0; i < s->length; i++)
-    checksum = crc32_tab[(checksum ^ (uint8_t) s->c_string[i]) & 0xFF] ^
-               (checksum >> 8);
+  uint32_t checksum = crc32_update(
+      0xFFFFFFFF, (const uint8_t*) s->c_string, s->length);
 
   YR_DEBUG_FPRINTF(
       2,
@@ -732,92 +779,37 @@ define_function(string_crc32)
 
 define_function(data_crc32)
 {
+  DIGESTS* digests;
+
   int64_t offset = integer_argument(1);  // offset where to start
   int64_t length = integer_argument(2);  // length of bytes we want hash on
-  uint32_t checksum = 0xFFFFFFFF;
-
-  YR_SCAN_CONTEXT* context = scan_context();
-  YR_MEMORY_BLOCK* block = first_memory_block(context);
-  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
-
-  YR_DEBUG_FPRINTF(
-      2,
-      stderr,
-      "+ %s(offset=%" PRIi64 " length=%" PRIi64 ") {\n",
-      __FUNCTION__,
-      offset,
-      length);
-
-  int past_first_block = false;
-
-  if (block == NULL)
-    return_integer(YR_UNDEFINED);
-
-  if (offset < 0 || length < 0 || offset < block->base)
-    return_integer(YR_UNDEFINED);
-
-  foreach_memory_block(iterator, block)
-  {
-    if (offset >= block->base && offset < block->base + block->size)
-    {
-      const uint8_t* block_data = block->fetch_data(block);
-
-      if (block_data != NULL)
-      {
-        size_t i;
-
-        size_t data_offset = (size_t)(offset - block->base);
-        size_t data_len = (size_t) yr_min(length, block->size - data_offset);
-
-        offset += data_len;
-        length -= data_len;
-
-        for (i = 0; i < data_len; i++)
-          checksum =
-              crc32_tab[(checksum ^ *(block_data + data_offset + i)) & 0xFF] ^
-              (checksum >> 8);
-      }
 
-      past_first_block = true;
-    }
-    else if (past_first_block)
-    {
-      // If offset is not within current block and we already
-      // past the first block then the we are trying to compute
-      // the checksum over a range of non contiguous blocks. As
-      // range contains gaps of undefined data the checksum is
-      // undefined.
+  FAIL_ON_ERROR(get_digests(
+      scan_context(), module(), DIGEST_CRC32, offset, length, &digests));
 
-      return_integer(YR_UNDEFINED);
-    }
-
-    if (block->base + block->size > offset + length)
-      break;
-  }
-
-  if (!past_first_block)
+  if (digests == NULL)
     return_integer(YR_UNDEFINED);
 
   YR_DEBUG_FPRINTF(
-      2, stderr, "} // %s() = 0x%x\n", __FUNCTION__, checksum ^ 0xFFFFFFFF);
-  return_integer(checksum ^ 0xFFFFFFFF);
+      2, stderr, "- %s() {} = 0x%x\n", __FUNCTION__, digests->crc32);
+  return_integer(digests->crc32);
 }
 
 
 begin_declarations
-  declare_function("md5", "ii", "s", data_md5);
+  declare_pure_function("md5", "ii", "s", data_md5);
   declare_function("md5", "s", "s", string_md5);
 
-  declare_function("sha1", "ii", "s", data_sha1);
+  declare_pure_function("sha1", "ii", "s", data_sha1);
   declare_function("sha1", "s", "s", string_sha1);
 
-  declare_function("sha256", "ii", "s", data_sha256);
+  declare_pure_function("sha256", "ii", "s", data_sha256);
   declare_function("sha256", "s", "s", string_sha256);
 
-  declare_function("checksum32", "ii", "i", data_checksum32);
+  declare_pure_function("checksum32", "ii", "i", data_checksum32);
   declare_function("checksum32", "s", "i", string_checksum32);
 
-  declare_function("crc32", "ii", "i", data_crc32);
+  declare_pure_function("crc32", "ii", "i", data_crc32);
   declare_function("crc32", "s", "i", string_crc32);
 end_declarations
 
@@ -826,6 +818,20 @@ int module_initialize(YR_MODULE* module)
 {
   YR_DEBUG_FPRINTF(2, stderr, "- %s() {}\n", __FUNCTION__);
 
+  for (int n = 0; n < 256; n++) crc32_slices[0][n] = crc32_tab[n];
+
+  for (int k = 1; k < 8; k++)
+    for (int n = 0; n < 256; n++)
+      crc32_slices[k][n] = crc32_tab[crc32_slices[k - 1][n] & 0xFF] ^
+                           (crc32_slices[k - 1][n] >> 8);
+
+#if defined(CRC32_PCLMUL)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+    crc32_update = crc32_update_pclmul;
+#endif
+
   return ERROR_SUCCESS;
 }
 
@@ -846,11 +852,39 @@ int module_load(
 {
   YR_DEBUG_FPRINTF(2, stderr, "- %s() {}\n", __FUNCTION__);
 
-  YR_HASH_TABLE* hash_table;
+  HASH_CACHE* cache = (HASH_CACHE*) yr_malloc(sizeof(HASH_CACHE));
+
+  if (cache == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  int result = yr_hash_table_create(
+      MAX_CACHE_ENTRIES / 2, &cache->hash_table);
+
+  if (result != ERROR_SUCCESS)
+  {
+    yr_free(cache);
+    return result;
+  }
+
+  cache->entries = 0;
+  cache->called_digests = 0;
+
+  if (yr_rules_calls_function(context->rules, "hash.md5", "ii"))
+    cache->called_digests |= DIGEST_MD5;
+
+  if (yr_rules_calls_function(context->rules, "hash.sha1", "ii"))
+    cache->called_digests |= DIGEST_SHA1;
+
+  if (yr_rules_calls_function(context->rules, "hash.sha256", "ii"))
+    cache->called_digests |= DIGEST_SHA256;
 
-  FAIL_ON_ERROR(yr_hash_table_create(17, &hash_table));
+  if (yr_rules_calls_function(context->rules, "hash.checksum32", "ii"))
+    cache->called_digests |= DIGEST_CHECKSUM32;
 
-  module_object->data = hash_table;
+  if (yr_rules_calls_function(context->rules, "hash.crc32", "ii"))
+    cache->called_digests |= DIGEST_CRC32;
+
+  module_object->data = cache;
 
   return ERROR_SUCCESS;
 }
@@ -860,10 +894,15 @@ int module_unload(YR_OBJECT* module_object)
 {
   YR_DEBUG_FPRINTF(2, stderr, "- %s() {}\n", __FUNCTION__);
 
-  YR_HASH_TABLE* hash_table = (YR_HASH_TABLE*) module_object->data;
+  HASH_CACHE* cache = (HASH_CACHE*) module_object->data;
+
+  if (cache != NULL)
+  {
+    yr_hash_table_destroy(
+        cache->hash_table, (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_free);
 
-  if (hash_table != NULL)
-    yr_hash_table_destroy(hash_table, (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_free);
+    yr_free(cache);
+  }
 
   return ERROR_SUCCESS;
 }
@@ -1322,6 +1322,8 @@ begin_declarations
   declare_function("file_index_for_arch", "ii", "i", file_index_subtype);
   declare_function("entry_point_for_arch", "i", "i", ep_for_arch_type);
   declare_function("entry_point_for_arch", "ii", "i", ep_for_arch_subtype);
+
+  macho_set_definitions(module);
 end_declarations
 
 int module_initialize(YR_MODULE* module)
@@ -1365,7 +1367,6 @@ int module_load(
     }
   }
 
-  macho_set_definitions(module_object);
   return ERROR_SUCCESS;
 }
 
@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <math.h>
+#include <string.h>
 #include <yara/mem.h>
 #include <yara/modules.h>
 #include <yara/utils.h>
@@ -45,25 +46,178 @@ static double log2(double n)
 }
 #endif
 
-uint32_t* get_distribution(int64_t offset, int64_t length, YR_SCAN_CONTEXT* context) {
-  bool past_first_block = false;
+// Distributions of at least this number of bytes are computed with partial
+// histograms, see count_bytes.
+#define INTERLEAVED_MIN_LENGTH 1024
 
-  size_t i;
+// Maximum number of distributions and window statistics cached during a scan.
+#define MAX_CACHE_ENTRIES 1024
 
-  uint32_t* data = (uint32_t*) yr_calloc(256, sizeof(uint32_t));
+typedef struct _CACHE_KEY
+{
+  int64_t offset;
+  int64_t length;
+  int64_t window;
+  int64_t step;
 
-  if (data == NULL) {
-    return NULL;
+} CACHE_KEY;
+
+typedef struct _WINDOW_STATS
+{
+  double max_entropy;
+  double min_entropy;
+  int64_t argmax_entropy;
+  double max_mean;
+  double min_mean;
+
+} WINDOW_STATS;
+
+// Cache stored in the module object's data. Values are computed in
+// "distribution" and "window_stats" and then copied to the hash table.
+typedef struct _MATH_CACHE
+{
+  YR_HASH_TABLE* hash_table;
+  int entries;
+
+  uint32_t distribution[256];
+  WINDOW_STATS window_stats;
+
+} MATH_CACHE;
+
+// Adds the number of occurrences of each byte value in "data" to the
+// corresponding entry in "distribution". When the same byte repeats in the
+// data, as it happens in padding or zero-filled areas, each increment must wait
+// for the previous one to be stored before loading the counter again. For
+// avoiding that dependency the bytes are distributed among four partial
+// histograms that are added together at the end.
+static void count_bytes(
+    uint32_t* distribution,
+    const uint8_t* data,
+    size_t length)
+{
+  size_t i = 0;
+
+  if (length >= INTERLEAVED_MIN_LENGTH)
+  {
+    uint32_t partial[4][256];
+
+    memset(partial, 0, sizeof(partial));
+
+    for (; i + 8 <= length; i += 8)
+    {
+      uint64_t v;
+
+      memcpy(&v, data + i, sizeof(v));
+
+      partial[0][(uint8_t) v]++;
+      partial[1][(uint8_t) (v >> 8)]++;
+      partial[2][(uint8_t) (v >> 16)]++;
+      partial[3][(uint8_t) (v >> 24)]++;
+      partial[0][(uint8_t) (v >> 32)]++;
+      partial[1][(uint8_t) (v >> 40)]++;
+      partial[2][(uint8_t) (v >> 48)]++;
+      partial[3][(uint8_t) (v >> 56)]++;
+    }
+
+    for (int j = 0; j < 256; j++)
+      distribution[j] +=
+          partial[0][j] + partial[1][j] + partial[2][j] + partial[3][j];
+  }
+
+  for (; i < length; i++) distribution[data[i]]++;
+}
+
+// Distributions and window statistics are computed once per scan and kept in a
+// hash table, keyed by offset and length, plus window and step in the case of
+// window statistics. The distribution for the whole data is stored in the
+// "global" namespace. The returned values are owned by the cache and must not
+// be freed by the caller.
+static const void* get_from_cache(
+    MATH_CACHE* cache,
+    const char* ns,
+    const CACHE_KEY* key)
+{
+  return yr_hash_table_lookup_raw_key(
+      cache->hash_table, key, sizeof(CACHE_KEY), ns);
+}
+
+// Puts a copy of the "size" bytes at "value" in the cache and returns the
+// copy. When the cache reaches MAX_CACHE_ENTRIES entries it's emptied before
+// adding the new one. This way rules calling a function with a different range
+// on each iteration of a loop don't make the cache grow indefinitely, while the
+// values that are used over and over are computed again only once each time
+// the cache is emptied. If the copy can't be added "value" is returned.
+static const void* add_to_cache(
+    MATH_CACHE* cache,
+    const char* ns,
+    const CACHE_KEY* key,
+    const void* value,
+    size_t size)
+{
+  if (cache->entries >= MAX_CACHE_ENTRIES)
+  {
+    yr_hash_table_clean(
+        cache->hash_table, (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_free);
+
+    cache->entries = 0;
   }
 
+  void* copy = yr_malloc(size);
+
+  if (copy == NULL)
+    return value;
+
+  memcpy(copy, value, size);
+
+  if (yr_hash_table_add_raw_key(
+          cache->hash_table, key, sizeof(CACHE_KEY), ns, copy) !=
+      ERROR_SUCCESS)
+  {
+    yr_free(copy);
+    return value;
+  }
+
+  cache->entries++;
+
+  return copy;
+}
+
+static const uint32_t* get_distribution(
+    YR_OBJECT* module_object,
+    int64_t offset,
+    int64_t length,
+    YR_SCAN_CONTEXT* context)
+{
+  bool past_first_block = false;
+
+  MATH_CACHE* cache = (MATH_CACHE*) module_object->data;
+  CACHE_KEY key = {0};
+
   YR_MEMORY_BLOCK* block = first_memory_block(context);
   YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
 
   if (offset < 0 || length < 0 || offset < block->base)
-  {
-    yr_free(data);
     return NULL;
-  }
+
+  // When the first block contains the whole file, ranges extending past the
+  // end of the file are equivalent to the ones ending at the end of the file,
+  // make them share the same cache entry. This way math.entropy(0, filesize)
+  // and math.count(x) use the same distribution.
+  if (block->base == 0 && block->size == context->file_size &&
+      offset < block->size && length > block->size - offset)
+    length = block->size - offset;
+
+  key.offset = offset;
+  key.length = length;
+
+  const uint32_t* cached = get_from_cache(cache, "range", &key);
+
+  if (cached != NULL)
+    return cached;
+
+  uint32_t* data = cache->distribution;
+
+  memset(data, 0, sizeof(cache->distribution));
 
   foreach_memory_block(iterator, block)
   {
@@ -76,19 +230,12 @@ uint32_t* get_distribution(int64_t offset, int64_t length, YR_SCAN_CONTEXT* cont
       const uint8_t* block_data = block->fetch_data(block);
 
       if (block_data == NULL)
-      {
-        yr_free(data);
         return NULL;
-      }
 
       offset += data_len;
       length -= data_len;
 
-      for (i = 0; i < data_len; i++)
-      {
-        uint8_t c = *(block_data + data_offset + i);
-        data[c]++;
-      }
+      count_bytes(data, block_data + data_offset, data_len);
 
       past_first_block = true;
     }
@@ -99,8 +246,6 @@ uint32_t* get_distribution(int64_t offset, int64_t length, YR_SCAN_CONTEXT* cont
       // the distribution over a range of non contiguous blocks. As
       // range contains gaps of undefined data the distribution is
       // undefined.
-
-      yr_free(data);
       return NULL;
     }
 
@@ -109,27 +254,38 @@ uint32_t* get_distribution(int64_t offset, int64_t length, YR_SCAN_CONTEXT* cont
   }
 
   if (!past_first_block)
-  {
-    yr_free(data);
     return NULL;
-  }
-  return data;
-}
-
-uint32_t* get_distribution_global(YR_SCAN_CONTEXT* context) {
 
-  size_t i;
+  return add_to_cache(cache, "range", &key, data, sizeof(cache->distribution));
+}
 
+static const uint32_t* get_distribution_global(
+    YR_OBJECT* module_object,
+    YR_SCAN_CONTEXT* context)
+{
   int64_t expected_next_offset = 0;
 
-  uint32_t* data = (uint32_t*) yr_calloc(256, sizeof(uint32_t));
-
-  if (data == NULL)
-    return NULL;
+  MATH_CACHE* cache = (MATH_CACHE*) module_object->data;
+  CACHE_KEY key = {0};
 
   YR_MEMORY_BLOCK* block = first_memory_block(context);
   YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
 
+  // If the first block is the whole file the distribution is the same as
+  // the one for the range covering the block.
+  if (block->base == 0 && block->size > 0 &&
+      block->size == context->file_size)
+    return get_distribution(module_object, 0, block->size, context);
+
+  const uint32_t* cached = get_from_cache(cache, "global", &key);
+
+  if (cached != NULL)
+    return cached;
+
+  uint32_t* data = cache->distribution;
+
+  memset(data, 0, sizeof(cache->distribution));
+
   foreach_memory_block(iterator, block)
   {
     if (expected_next_offset != block->base)
@@ -138,25 +294,47 @@ uint32_t* get_distribution_global(YR_SCAN_CONTEXT* context) {
       // we are trying to compute the distribution over a range of non 
       // contiguous blocks. As the range contains gaps of 
       // undefined data the distribution is undefined.
-      yr_free(data);
       return NULL;
     }
     const uint8_t* block_data = block->fetch_data(block);
 
     if (block_data == NULL)
-    {
-      yr_free(data);
       return NULL;
-    }
 
-    for (i = 0; i < block->size; i++)
+    count_bytes(data, block_data, block->size);
+
+    expected_next_offset = block->base + block->size;
+  }
+
+  return add_to_cache(
+      cache, "global", &key, data, sizeof(cache->distribution));
+}
+
+// Returns the entropy for a distribution of "total_len" bytes.
+static double distribution_entropy(const uint32_t* data, size_t total_len)
+{
+  double entropy = 0.0;
+
+  for (size_t i = 0; i < 256; i++)
+  {
+    if (data[i] != 0)
     {
-        uint8_t c = *(block_data + i);
-        data[c] += 1;
+      double x = (double) (data[i]) / total_len;
+      entropy -= x * log2(x);
     }
-    expected_next_offset = block->base + block->size;
   }
-  return data;
+
+  return entropy;
+}
+
+// Returns the mean for a distribution of "total_len" bytes.
+static double distribution_mean(const uint32_t* data, size_t total_len)
+{
+  double sum = 0.0;
+
+  for (size_t i = 0; i < 256; i++) sum += ((double) i) * data[i];
+
+  return sum / total_len;
 }
 
 define_function(string_entropy)
@@ -192,8 +370,6 @@ define_function(string_entropy)
 
 define_function(data_entropy)
 {
-  double entropy = 0.0;
-
   int64_t offset = integer_argument(1);  // offset where to start
   int64_t length = integer_argument(2);  // length of bytes we want entropy on
 
@@ -203,7 +379,7 @@ define_function(data_entropy)
 
   size_t total_len = 0;
 
-  uint32_t* data = get_distribution(offset, length, context);
+  const uint32_t* data = get_distribution(module(), offset, length, context);
   if (data == NULL)
     return_float(YR_UNDEFINED);
 
@@ -212,17 +388,7 @@ define_function(data_entropy)
     total_len += data[i];
   }
 
-  for (i = 0; i < 256; i++)
-  {
-    if (data[i] != 0)
-    {
-      double x = (double) (data[i]) / total_len;
-      entropy -= x * log2(x);
-    }
-  }
-
-  yr_free(data);
-  return_float(entropy);
+  return_float(distribution_entropy(data, total_len));
 }
 
 define_function(string_deviation)
@@ -252,7 +418,7 @@ define_function(data_deviation)
 
   YR_SCAN_CONTEXT* context = scan_context();
 
-  uint32_t* data = get_distribution(offset, length, context);
+  const uint32_t* data = get_distribution(module(), offset, length, context);
   if (data == NULL)
     return_float(YR_UNDEFINED);
 
@@ -262,7 +428,6 @@ define_function(data_deviation)
     sum += fabs(((double) i) - mean) * data[i];
   }
 
-  yr_free(data);
   return_float(sum / total_len);
 }
 
@@ -280,8 +445,6 @@ define_function(string_mean)
 
 define_function(data_mean)
 {
-  double sum = 0.0;
-
   int64_t offset = integer_argument(1);
   int64_t length = integer_argument(2);
 
@@ -290,18 +453,16 @@ define_function(data_mean)
   size_t total_len = 0;
   size_t i;
 
-  uint32_t* data = get_distribution(offset, length, context);
+  const uint32_t* data = get_distribution(module(), offset, length, context);
   if (data == NULL)
     return_float(YR_UNDEFINED);
 
   for (i = 0; i < 256; i++)
   {
     total_len += data[i];
-    sum += ((double) i) * data[i];
   }
 
-  yr_free(data);
-  return_float(sum / total_len);
+  return_float(distribution_mean(data, total_len));
 }
 
 define_function(data_serial_correlation)
@@ -600,13 +761,13 @@ define_function(count_range)
 
   YR_SCAN_CONTEXT* context = scan_context();
 
-  uint32_t* distribution = get_distribution(offset, length, context);
+  const uint32_t* distribution = get_distribution(
+      module(), offset, length, context);
   if (distribution == NULL)
   {
     return_integer(YR_UNDEFINED);
   }
   int64_t count = (int64_t) distribution[byte];
-  yr_free(distribution);
   return_integer(count);
 }
 
@@ -616,13 +777,12 @@ define_function(count_global)
 
   YR_SCAN_CONTEXT* context = scan_context();
 
-  uint32_t* distribution = get_distribution_global(context);
+  const uint32_t* distribution = get_distribution_global(module(), context);
   if (distribution == NULL)
   {
     return_integer(YR_UNDEFINED);
   }
   int64_t count = (int64_t) distribution[byte];
-  yr_free(distribution);
   return_integer(count);
 }
 
@@ -634,7 +794,8 @@ define_function(percentage_range)
 
   YR_SCAN_CONTEXT* context = scan_context();
 
-  uint32_t* distribution = get_distribution(offset, length, context);
+  const uint32_t* distribution = get_distribution(
+      module(), offset, length, context);
   if (distribution == NULL) {
     return_float(YR_UNDEFINED);
   }
@@ -644,7 +805,6 @@ define_function(percentage_range)
   for (i = 0; i < 256; i++) {
     total_count += distribution[i];
   }
-  yr_free(distribution);
   return_float(((float) count) / ((float) total_count));
 }
 
@@ -654,7 +814,7 @@ define_function(percentage_global)
 
   YR_SCAN_CONTEXT* context = scan_context();
 
-  uint32_t* distribution = get_distribution_global(context);
+  const uint32_t* distribution = get_distribution_global(module(), context);
   if (distribution == NULL) {
     return_float(YR_UNDEFINED);
   }
@@ -664,7 +824,6 @@ define_function(percentage_global)
   for (i = 0; i < 256; i++) {
     total_count += distribution[i];
   }
-  yr_free(distribution);
   return_float(((float) count) / ((float) total_count));
 }
 
@@ -675,7 +834,8 @@ define_function(mode_range)
 
   YR_SCAN_CONTEXT* context = scan_context();
 
-  uint32_t* distribution = get_distribution(offset, length, context);
+  const uint32_t* distribution = get_distribution(
+      module(), offset, length, context);
   if (distribution == NULL) {
     return_integer(YR_UNDEFINED);
   }
@@ -689,7 +849,6 @@ define_function(mode_range)
       most_common = (int64_t) i;
     }
   }
-  yr_free(distribution);
   return_integer(most_common);
 }
 
@@ -697,7 +856,7 @@ define_function(mode_global)
 {
   YR_SCAN_CONTEXT* context = scan_context();
 
-  uint32_t* distribution = get_distribution_global(context);
+  const uint32_t* distribution = get_distribution_global(module(), context);
   if (distribution == NULL) {
     return_integer(YR_UNDEFINED);
   }
@@ -711,33 +870,320 @@ define_function(mode_global)
       most_common = (int64_t) i;
     }
   }
-  yr_free(distribution);
   return_integer(most_common);
 }
 
+// Computes the statistics for windows of "window" bytes that start at
+// "offset", "offset + step", "offset + 2 * step" and so on, within the range
+// defined by "offset" and "length". If the last of these windows doesn't reach
+// the end of the range, one more window ending exactly at the end of the range
+// is added, so every byte belongs to some window while all windows have the
+// same size. Ranges shorter than "window" are treated as a single window.
+// When windows overlap the distribution of each window is obtained from the
+// previous one by removing the bytes that are left behind and adding the new
+// ones, so each byte is visited at most twice. Windows don't span multiple
+// memory blocks, the range is truncated at the end of the block containing
+// "offset". All the statistics are computed in the same pass and cached in
+// the "windows" namespace of the module's cache.
+static const WINDOW_STATS* get_window_stats(
+    YR_OBJECT* module_object,
+    YR_SCAN_CONTEXT* context,
+    int64_t offset,
+    int64_t length,
+    int64_t window,
+    int64_t step)
+{
+  MATH_CACHE* cache = (MATH_CACHE*) module_object->data;
+  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
+  YR_MEMORY_BLOCK* block;
+
+  CACHE_KEY key;
+  WINDOW_STATS* stats = &cache->window_stats;
+
+  uint32_t distribution[256];
+
+  size_t prev_start = 0;
+  size_t prev_end = 0;
+  size_t start = 0;
+  size_t end;
+
+  if (offset < 0 || length <= 0 || window <= 0 || step <= 0)
+    return NULL;
+
+  foreach_memory_block(iterator, block)
+  {
+    if (offset >= block->base && offset < block->base + block->size)
+      break;
+  }
+
+  if (block == NULL)
+    return NULL;
+
+  if (length > block->base + block->size - offset)
+    length = block->base + block->size - offset;
+
+  key.offset = offset;
+  key.length = length;
+  key.window = window;
+  key.step = step;
+
+  const WINDOW_STATS* cached = get_from_cache(cache, "windows", &key);
+
+  if (cached != NULL)
+    return cached;
+
+  const uint8_t* block_data = block->fetch_data(block);
+
+  if (block_data == NULL)
+    return NULL;
+
+  const uint8_t* data = block_data + (offset - block->base);
+
+  if (window > length)
+    window = length;
+
+  while (true)
+  {
+    end = start + (size_t) window;
+
+    if (start >= prev_end)
+    {
+      memset(distribution, 0, sizeof(distribution));
+      count_bytes(distribution, data + start, end - start);
+    }
+    else
+    {
+      for (size_t i = prev_start; i < start; i++) distribution[data[i]]--;
+      for (size_t i = prev_end; i < end; i++) distribution[data[i]]++;
+    }
+
+    double entropy = distribution_entropy(distribution, end - start);
+    double mean = distribution_mean(distribution, end - start);
+
+    if (start == 0 || entropy > stats->max_entropy)
+    {
+      stats->max_entropy = entropy;
+      stats->argmax_entropy = offset + start;
+    }
+
+    if (start == 0 || entropy < stats->min_entropy)
+      stats->min_entropy = entropy;
+
+    if (start == 0 || mean > stats->max_mean)
+      stats->max_mean = mean;
+
+    if (start == 0 || mean < stats->min_mean)
+      stats->min_mean = mean;
+
+    if (end == (size_t) length)
+      break;
+
+    prev_start = start;
+    prev_end = end;
+
+    if ((size_t) step > (size_t) length - end)
+      start = (size_t) (length - window);
+    else
+      start += (size_t) step;
+  }
+
+  return add_to_cache(cache, "windows", &key, stats, sizeof(WINDOW_STATS));
+}
+
+define_function(max_entropy)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(3));
+
+  if (stats == NULL)
+    return_float(YR_UNDEFINED);
+
+  return_float(stats->max_entropy);
+}
+
+define_function(max_entropy_step)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(4));
+
+  if (stats == NULL)
+    return_float(YR_UNDEFINED);
+
+  return_float(stats->max_entropy);
+}
+
+define_function(min_entropy)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(3));
+
+  if (stats == NULL)
+    return_float(YR_UNDEFINED);
+
+  return_float(stats->min_entropy);
+}
+
+define_function(min_entropy_step)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(4));
+
+  if (stats == NULL)
+    return_float(YR_UNDEFINED);
+
+  return_float(stats->min_entropy);
+}
+
+define_function(argmax_entropy)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(3));
+
+  if (stats == NULL)
+    return_integer(YR_UNDEFINED);
+
+  return_integer(stats->argmax_entropy);
+}
+
+define_function(argmax_entropy_step)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(4));
+
+  if (stats == NULL)
+    return_integer(YR_UNDEFINED);
+
+  return_integer(stats->argmax_entropy);
+}
+
+define_function(max_mean)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(3));
+
+  if (stats == NULL)
+    return_float(YR_UNDEFINED);
+
+  return_float(stats->max_mean);
+}
+
+define_function(max_mean_step)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(4));
+
+  if (stats == NULL)
+    return_float(YR_UNDEFINED);
+
+  return_float(stats->max_mean);
+}
+
+define_function(min_mean)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(3));
+
+  if (stats == NULL)
+    return_float(YR_UNDEFINED);
+
+  return_float(stats->min_mean);
+}
+
+define_function(min_mean_step)
+{
+  const WINDOW_STATS* stats = get_window_stats(
+      module(),
+      scan_context(),
+      integer_argument(1),
+      integer_argument(2),
+      integer_argument(3),
+      integer_argument(4));
+
+  if (stats == NULL)
+    return_float(YR_UNDEFINED);
+
+  return_float(stats->min_mean);
+}
+
 begin_declarations
   declare_float("MEAN_BYTES");
   declare_function("in_range", "fff", "i", in_range);
-  declare_function("deviation", "iif", "f", data_deviation);
+  declare_pure_function("deviation", "iif", "f", data_deviation);
   declare_function("deviation", "sf", "f", string_deviation);
-  declare_function("mean", "ii", "f", data_mean);
+  declare_pure_function("mean", "ii", "f", data_mean);
   declare_function("mean", "s", "f", string_mean);
-  declare_function("serial_correlation", "ii", "f", data_serial_correlation);
+  declare_pure_function(
+      "serial_correlation", "ii", "f", data_serial_correlation);
   declare_function("serial_correlation", "s", "f", string_serial_correlation);
-  declare_function("monte_carlo_pi", "ii", "f", data_monte_carlo_pi);
+  declare_pure_function("monte_carlo_pi", "ii", "f", data_monte_carlo_pi);
   declare_function("monte_carlo_pi", "s", "f", string_monte_carlo_pi);
-  declare_function("entropy", "ii", "f", data_entropy);
+  declare_pure_function("entropy", "ii", "f", data_entropy);
   declare_function("entropy", "s", "f", string_entropy);
   declare_function("min", "ii", "i", min);
   declare_function("max", "ii", "i", max);
   declare_function("to_number", "b", "i", to_number);
   declare_function("abs", "i", "i", yr_math_abs);
-  declare_function("count", "iii", "i", count_range);
-  declare_function("count", "i", "i", count_global);
-  declare_function("percentage", "iii", "f", percentage_range);
-  declare_function("percentage", "i", "f", percentage_global);
-  declare_function("mode", "ii", "i", mode_range);
-  declare_function("mode", "", "i", mode_global);
+  declare_pure_function("count", "iii", "i", count_range);
+  declare_pure_function("count", "i", "i", count_global);
+  declare_pure_function("percentage", "iii", "f", percentage_range);
+  declare_pure_function("percentage", "i", "f", percentage_global);
+  declare_pure_function("mode", "ii", "i", mode_range);
+  declare_pure_function("mode", "", "i", mode_global);
+  declare_pure_function("max_entropy", "iii", "f", max_entropy);
+  declare_pure_function("max_entropy", "iiii", "f", max_entropy_step);
+  declare_pure_function("min_entropy", "iii", "f", min_entropy);
+  declare_pure_function("min_entropy", "iiii", "f", min_entropy_step);
+  declare_pure_function("argmax_entropy", "iii", "i", argmax_entropy);
+  declare_pure_function("argmax_entropy", "iiii", "i", argmax_entropy_step);
+  declare_pure_function("max_mean", "iii", "f", max_mean);
+  declare_pure_function("max_mean", "iiii", "f", max_mean_step);
+  declare_pure_function("min_mean", "iii", "f", min_mean);
+  declare_pure_function("min_mean", "iiii", "f", min_mean_step);
 end_declarations
 
 int module_initialize(YR_MODULE* module)
@@ -756,11 +1202,32 @@ int module_load(
     void* module_data,
     size_t module_data_size)
 {
+  MATH_CACHE* cache;
+
   set_float(127.5, module_object, "MEAN_BYTES");
-  return ERROR_SUCCESS;
+
+  cache = (MATH_CACHE*) yr_calloc(1, sizeof(MATH_CACHE));
+
+  if (cache == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  module_object->data = cache;
+
+  return yr_hash_table_create(MAX_CACHE_ENTRIES / 2, &cache->hash_table);
 }
 
 int module_unload(YR_OBJECT* module_object)
 {
+  MATH_CACHE* cache = (MATH_CACHE*) module_object->data;
+
+  if (cache == NULL)
+    return ERROR_SUCCESS;
+
+  if (cache->hash_table != NULL)
+    yr_hash_table_destroy(
+        cache->hash_table, (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_free);
+
+  yr_free(cache);
+
   return ERROR_SUCCESS;
 }
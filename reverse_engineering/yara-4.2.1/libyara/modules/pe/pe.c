@@ -51,6 +51,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <yara/dotnet.h>
 #include <yara/endian.h>
+#include <yara/globals.h>
 #include <yara/mem.h>
 #include <yara/modules.h>
 #include <yara/pe.h>
@@ -115,6 +116,23 @@ typedef int (*RESOURCE_CALLBACK_FUNC)(
     const IMAGE_RESOURCE_DIR_STRING_U* lang_string,
     void* cb_data);
 
+//
+// Paths read by the functions that iterate over sections, exports and
+// resources. They are compiled in module_initialize.
+//
+
+static struct
+{
+  YR_OBJECT_PATH section_name;
+  YR_OBJECT_PATH section_virtual_address;
+  YR_OBJECT_PATH section_virtual_size;
+  YR_OBJECT_PATH section_raw_data_offset;
+  YR_OBJECT_PATH section_raw_data_size;
+  YR_OBJECT_PATH export_name;
+  YR_OBJECT_PATH export_ordinal;
+  YR_OBJECT_PATH resource_language;
+} pe_paths;
+
 static size_t available_space(PE* pe, void* pointer)
 {
   if ((uint8_t*) pointer < pe->data)
@@ -1429,6 +1447,7 @@ static void pe_parse_exports(PE* pe)
   DWORD* names = NULL;
   WORD* ordinals = NULL;
   DWORD* function_addrs = NULL;
+  uint32_t* name_indexes = NULL;
 
   // If not a PE file, return YR_UNDEFINED
 
@@ -1548,6 +1567,29 @@ static void pe_parse_exports(PE* pe)
   //
   // If the RVA from the address array is within the export directory it is a
   // forwarder RVA and points to a NULL terminated ASCII string.
+  //
+  // Instead of walking the ordinal array for each export, the position in the
+  // names array for each index in the address array is computed beforehand,
+  // UINT32_MAX means that the export has no name. If an index appears more
+  // than once in the ordinal array the first position is used.
+
+  if (names != NULL && number_of_exports > 0)
+  {
+    name_indexes = (uint32_t*) yr_malloc(number_of_exports * sizeof(uint32_t));
+
+    if (name_indexes == NULL)
+      return;
+
+    memset(name_indexes, 0xFF, number_of_exports * sizeof(uint32_t));
+
+    for (j = 0; j < number_of_names; j++)
+    {
+      WORD index = yr_le16toh(ordinals[j]);
+
+      if (index < number_of_exports && name_indexes[index] == UINT32_MAX)
+        name_indexes[index] = j;
+    }
+  }
 
   for (i = 0; i < number_of_exports; i++)
   {
@@ -1575,33 +1617,28 @@ static void pe_parse_exports(PE* pe)
       set_integer(offset, pe->object, "export_details[%i].offset", exp_sz);
     }
 
-    if (names != NULL)
+    if (name_indexes != NULL && name_indexes[i] != UINT32_MAX)
     {
-      for (j = 0; j < number_of_exports; j++)
+      offset = pe_rva_to_offset(pe, yr_le32toh(names[name_indexes[i]]));
+
+      if (offset > 0)
       {
-        if (yr_le16toh(ordinals[j]) == i && j < number_of_names)
-        {
-          offset = pe_rva_to_offset(pe, yr_le32toh(names[j]));
+        remaining = pe->data_size - (size_t) offset;
+        name_len = strnlen((char*) (pe->data + offset), remaining);
 
-          if (offset > 0)
-          {
-            remaining = pe->data_size - (size_t) offset;
-            name_len = strnlen((char*) (pe->data + offset), remaining);
-
-            set_sized_string(
-                (char*) (pe->data + offset),
-                yr_min(name_len, MAX_EXPORT_NAME_LENGTH),
-                pe->object,
-                "export_details[%i].name",
-                exp_sz);
-          }
-          break;
-        }
+        set_sized_string(
+            (char*) (pe->data + offset),
+            yr_min(name_len, MAX_EXPORT_NAME_LENGTH),
+            pe->object,
+            "export_details[%i].name",
+            exp_sz);
       }
     }
     exp_sz++;
   }
 
+  yr_free(name_indexes);
+
   set_integer(exp_sz, pe->object, "number_of_exports");
 }
 
@@ -2189,12 +2226,6 @@ static void pe_parse_header(PE* pe, uint64_t base_address, int flags)
     data_dir++;
   }
 
-  pe_iterate_resources(
-      pe, (RESOURCE_CALLBACK_FUNC) pe_collect_resources, (void*) pe);
-
-  set_integer(pe->resources, pe->object, "number_of_resources");
-  set_integer(pe->version_infos, pe->object, "number_of_version_infos");
-
   section = IMAGE_FIRST_SECTION(pe->header);
 
   scount = yr_min(
@@ -2370,13 +2401,15 @@ define_function(section_index_addr)
   {
     if (context->flags & SCAN_FLAGS_PROCESS_MEMORY)
     {
-      offset = get_integer(module, "sections[%i].virtual_address", i);
-      size = get_integer(module, "sections[%i].virtual_size", i);
+      offset = get_integer_by_path(
+          module, &pe_paths.section_virtual_address, i);
+      size = get_integer_by_path(module, &pe_paths.section_virtual_size, i);
     }
     else
     {
-      offset = get_integer(module, "sections[%i].raw_data_offset", i);
-      size = get_integer(module, "sections[%i].raw_data_size", i);
+      offset = get_integer_by_path(
+          module, &pe_paths.section_raw_data_offset, i);
+      size = get_integer_by_path(module, &pe_paths.section_raw_data_size, i);
     }
 
     if (addr >= offset && addr < offset + size)
@@ -2399,7 +2432,8 @@ define_function(section_index_name)
 
   for (int i = 0; i < yr_min(n, MAX_PE_SECTIONS); i++)
   {
-    SIZED_STRING* sect = get_string(module, "sections[%i].name", i);
+    SIZED_STRING* sect = get_string_by_path(
+        module, &pe_paths.section_name, i);
 
     if (sect != NULL && strcmp(name, sect->c_string) == 0)
       return_integer(i);
@@ -2408,11 +2442,248 @@ define_function(section_index_name)
   return_integer(YR_UNDEFINED);
 }
 
+//
+// Returns a lowercase copy of name, followed by a zero byte and a lowercase
+// copy of subname if subname is not NULL. These are the keys in the hash tables
+// used by pe.imports and pe.exports, which are case-insensitive. The key is
+// written to the given buffer if it fits, or to newly allocated memory
+// otherwise, in both cases it must be released with pe_index_key_free.
+//
+
+static char* pe_index_key(
+    char* buffer,
+    size_t buffer_size,
+    const char* name,
+    size_t name_length,
+    const char* subname,
+    size_t* key_length)
+{
+  size_t length = name_length;
+  char* key = buffer;
+
+  if (subname != NULL)
+    length += 1 + strlen(subname);
+
+  if (length >= buffer_size)
+    key = (char*) yr_malloc(length + 1);
+
+  if (key == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < name_length; i++)
+    key[i] = yr_lowercase[(uint8_t) name[i]];
+
+  if (subname != NULL)
+  {
+    key[name_length] = '\0';
+
+    for (size_t i = name_length + 1; i < length; i++)
+      key[i] = yr_lowercase[(uint8_t) subname[i - name_length - 1]];
+  }
+
+  *key_length = length;
+
+  return key;
+}
+
+static void pe_index_key_free(char* key, char* buffer)
+{
+  if (key != buffer)
+    yr_free(key);
+}
+
+//
+// Returns the hash table used by pe.exports, creating it the first time it's
+// needed during the scan. Exports are indexed by lowercase name in the "name"
+// namespace and by ordinal in the "ordinal" namespace, both having the position
+// of the first export with that name or ordinal in export_details. Returns NULL
+// if the table couldn't be created.
+//
+
+static YR_HASH_TABLE* pe_exports_index(PE* pe, int number_of_exports)
+{
+  SIZED_STRING* name;
+  int64_t ordinal;
+  size_t key_length;
+  char buffer[256];
+  char* key;
+  int result = ERROR_SUCCESS;
+
+  if (pe->exports_index != NULL)
+    return pe->exports_index;
+
+  if (yr_hash_table_create(
+          yr_max(2 * number_of_exports, 17), &pe->exports_index) !=
+      ERROR_SUCCESS)
+    return NULL;
+
+  for (int i = 0; i < number_of_exports && result == ERROR_SUCCESS; i++)
+  {
+    name = get_string_by_path(pe->object, &pe_paths.export_name, i);
+
+    if (name != NULL)
+    {
+      key = pe_index_key(
+          buffer,
+          sizeof(buffer),
+          name->c_string,
+          name->length,
+          NULL,
+          &key_length);
+
+      if (key == NULL)
+      {
+        result = ERROR_INSUFFICIENT_MEMORY;
+        break;
+      }
+
+      if (yr_hash_table_lookup_uint32_raw_key(
+              pe->exports_index, key, key_length, "name") == UINT32_MAX)
+      {
+        result = yr_hash_table_add_uint32_raw_key(
+            pe->exports_index, key, key_length, "name", i);
+      }
+
+      pe_index_key_free(key, buffer);
+    }
+
+    ordinal = get_integer_by_path(pe->object, &pe_paths.export_ordinal, i);
+
+    if (result == ERROR_SUCCESS &&
+        yr_hash_table_lookup_uint32_raw_key(
+            pe->exports_index, &ordinal, sizeof(ordinal), "ordinal") ==
+            UINT32_MAX)
+    {
+      result = yr_hash_table_add_uint32_raw_key(
+          pe->exports_index, &ordinal, sizeof(ordinal), "ordinal", i);
+    }
+  }
+
+  if (result != ERROR_SUCCESS)
+  {
+    yr_hash_table_destroy(pe->exports_index, NULL);
+    pe->exports_index = NULL;
+  }
+
+  return pe->exports_index;
+}
+
+//
+// Returns the position in export_details of the first export with the given
+// name, or -1 if there's no such export.
+//
+
+static int64_t pe_exports_find_name(
+    PE* pe,
+    int number_of_exports,
+    SIZED_STRING* search_name)
+{
+  YR_HASH_TABLE* index = pe_exports_index(pe, number_of_exports);
+
+  size_t key_length;
+  char buffer[256];
+  char* key;
+  uint32_t result;
+
+  if (index == NULL)
+    return -1;
+
+  key = pe_index_key(
+      buffer,
+      sizeof(buffer),
+      search_name->c_string,
+      search_name->length,
+      NULL,
+      &key_length);
+
+  if (key == NULL)
+    return -1;
+
+  result = yr_hash_table_lookup_uint32_raw_key(index, key, key_length, "name");
+
+  pe_index_key_free(key, buffer);
+
+  return result == UINT32_MAX ? -1 : (int64_t) result;
+}
+
+//
+// Returns the position in export_details of the first export with the given
+// ordinal, or -1 if there's no such export.
+//
+
+static int64_t pe_exports_find_ordinal(
+    PE* pe,
+    int number_of_exports,
+    int64_t ordinal)
+{
+  YR_HASH_TABLE* index = pe_exports_index(pe, number_of_exports);
+
+  uint32_t result;
+
+  if (index == NULL)
+    return -1;
+
+  result = yr_hash_table_lookup_uint32_raw_key(
+      index, &ordinal, sizeof(ordinal), "ordinal");
+
+  return result == UINT32_MAX ? -1 : (int64_t) result;
+}
+
+//
+// Returns the position in export_details of the first export with a name
+// matching the regular expression, or -1 if there's no such export. The result
+// is kept in the "regexp" namespace of the index, as the same regexp is usually
+// used by many rules.
+//
+
+static int64_t pe_exports_find_regexp(
+    YR_SCAN_CONTEXT* context,
+    PE* pe,
+    int number_of_exports,
+    RE* regex)
+{
+  YR_HASH_TABLE* index = pe_exports_index(pe, number_of_exports);
+
+  SIZED_STRING* function_name;
+  uint32_t result;
+
+  if (index == NULL)
+    return -1;
+
+  // The cached value is the position plus one, zero means no match.
+  result = yr_hash_table_lookup_uint32_raw_key(
+      index, &regex, sizeof(regex), "regexp");
+
+  if (result != UINT32_MAX)
+    return (int64_t) result - 1;
+
+  result = 0;
+
+  for (int i = 0; i < number_of_exports; i++)
+  {
+    function_name = get_string_by_path(pe->object, &pe_paths.export_name, i);
+
+    if (function_name == NULL)
+      continue;
+
+    if (yr_re_match(context, regex, function_name->c_string) != -1)
+    {
+      result = i + 1;
+      break;
+    }
+  }
+
+  // If the result can't be cached it will be computed again next time.
+  yr_hash_table_add_uint32_raw_key(
+      index, &regex, sizeof(regex), "regexp", result);
+
+  return (int64_t) result - 1;
+}
+
 define_function(exports)
 {
   SIZED_STRING* search_name = sized_string_argument(1);
 
-  SIZED_STRING* function_name = NULL;
   YR_OBJECT* module = module();
   PE* pe = (PE*) module->data;
 
@@ -2426,25 +2697,13 @@ define_function(exports)
   if (n == 0)
     return_integer(0);
 
-  for (int i = 0; i < n; i++)
-  {
-    function_name = get_string(module, "export_details[%i].name", i);
-
-    if (function_name == NULL)
-      continue;
-
-    if (ss_icompare(function_name, search_name) == 0)
-      return_integer(1);
-  }
-
-  return_integer(0);
+  return_integer(pe_exports_find_name(pe, n, search_name) >= 0);
 }
 
 define_function(exports_regexp)
 {
   RE* regex = regexp_argument(1);
 
-  SIZED_STRING* function_name = NULL;
   YR_OBJECT* module = module();
   PE* pe = (PE*) module->data;
 
@@ -2458,17 +2717,7 @@ define_function(exports_regexp)
   if (n == 0)
     return_integer(0);
 
-  for (int i = 0; i < n; i++)
-  {
-    function_name = get_string(module, "export_details[%i].name", i);
-    if (function_name == NULL)
-      continue;
-
-    if (yr_re_match(scan_context(), regex, function_name->c_string) != -1)
-      return_integer(1);
-  }
-
-  return_integer(0);
+  return_integer(pe_exports_find_regexp(scan_context(), pe, n, regex) >= 0);
 }
 
 define_function(exports_ordinal)
@@ -2491,23 +2740,13 @@ define_function(exports_ordinal)
   if (ordinal == 0 || ordinal > n)
     return_integer(0);
 
-  for (int i = 0; i < n; i++)
-  {
-    int64_t exported_ordinal = yr_object_get_integer(
-        module, "export_details[%i].ordinal", i);
-
-    if (exported_ordinal == ordinal)
-      return_integer(1);
-  }
-
-  return_integer(0);
+  return_integer(pe_exports_find_ordinal(pe, n, ordinal) >= 0);
 }
 
 define_function(exports_index_name)
 {
   SIZED_STRING* search_name = sized_string_argument(1);
 
-  SIZED_STRING* function_name = NULL;
   YR_OBJECT* module = module();
   PE* pe = (PE*) module->data;
 
@@ -2521,18 +2760,12 @@ define_function(exports_index_name)
   if (n == 0)
     return_integer(YR_UNDEFINED);
 
-  for (int i = 0; i < n; i++)
-  {
-    function_name = get_string(module, "export_details[%i].name", i);
-
-    if (function_name == NULL)
-      continue;
+  int64_t i = pe_exports_find_name(pe, n, search_name);
 
-    if (ss_icompare(function_name, search_name) == 0)
-      return_integer(i);
-  }
+  if (i < 0)
+    return_integer(YR_UNDEFINED);
 
-  return_integer(YR_UNDEFINED);
+  return_integer(i);
 }
 
 define_function(exports_index_ordinal)
@@ -2555,23 +2788,18 @@ define_function(exports_index_ordinal)
   if (ordinal == 0 || ordinal > n)
     return_integer(YR_UNDEFINED);
 
-  for (int i = 0; i < n; i++)
-  {
-    int64_t exported_ordinal = yr_object_get_integer(
-        module, "export_details[%i].ordinal", i);
+  int64_t i = pe_exports_find_ordinal(pe, n, ordinal);
 
-    if (exported_ordinal == ordinal)
-      return_integer(i);
-  }
+  if (i < 0)
+    return_integer(YR_UNDEFINED);
 
-  return_integer(YR_UNDEFINED);
+  return_integer(i);
 }
 
 define_function(exports_index_regex)
 {
   RE* regex = regexp_argument(1);
 
-  SIZED_STRING* function_name = NULL;
   YR_OBJECT* module = module();
   PE* pe = (PE*) module->data;
 
@@ -2585,19 +2813,12 @@ define_function(exports_index_regex)
   if (n == 0)
     return_integer(YR_UNDEFINED);
 
-  for (int i = 0; i < n; i++)
-  {
-    function_name = get_string(module, "export_details[%i].name", i);
-    if (function_name == NULL)
-      continue;
+  int64_t i = pe_exports_find_regexp(scan_context(), pe, n, regex);
 
-    if (yr_re_match(scan_context(), regex, function_name->c_string) != -1)
-    {
-      return_integer(i);
-    }
-  }
+  if (i < 0)
+    return_integer(YR_UNDEFINED);
 
-  return_integer(YR_UNDEFINED);
+  return_integer(i);
 }
 
 #if defined(HAVE_LIBCRYPTO) || defined(HAVE_WINCRYPT_H) || \
@@ -2729,95 +2950,291 @@ define_function(imphash)
 
 #endif  // defined(HAVE_LIBCRYPTO) || defined(HAVE_WINCRYPT_H)
 
-int64_t pe_imports_dll(IMPORTED_DLL* dll, char* dll_name)
-{
-  if (dll == NULL)
-    return 0;
+//
+// Adds the DLLs and functions in a list of imports to a hash table. Functions
+// are indexed by DLL and name in the "function" namespace and by DLL and
+// ordinal in the "ordinal" namespace, the "dll" namespace has the number of
+// functions imported from each DLL.
+//
 
-  int64_t result = 0;
+static int pe_index_imports(IMPORTED_DLL* dll, YR_HASH_TABLE* index)
+{
+  char ordinal[8];
+  char buffer[256];
+  char* key;
+  size_t key_length;
+  size_t dll_length;
 
   for (; dll != NULL; dll = dll->next)
   {
-    if (strcasecmp(dll->name, dll_name) == 0)
+    uint32_t count = 0;
+
+    dll_length = strlen(dll->name);
+
+    for (IMPORT_FUNCTION* fun = dll->functions; fun != NULL; fun = fun->next)
     {
-      IMPORT_FUNCTION* fun = dll->functions;
-      for (; fun != NULL; fun = fun->next)
+      count++;
+
+      if (fun->name != NULL)
+      {
+        key = pe_index_key(
+            buffer,
+            sizeof(buffer),
+            dll->name,
+            dll_length,
+            fun->name,
+            &key_length);
+
+        if (key == NULL)
+          return ERROR_INSUFFICIENT_MEMORY;
+
+        if (yr_hash_table_lookup_raw_key(index, key, key_length, "function") ==
+            NULL)
+        {
+          FAIL_ON_ERROR_WITH_CLEANUP(
+              yr_hash_table_add_raw_key(
+                  index, key, key_length, "function", dll),
+              pe_index_key_free(key, buffer));
+        }
+
+        pe_index_key_free(key, buffer);
+      }
+
+      if (fun->has_ordinal)
       {
-        result++;
+        snprintf(ordinal, sizeof(ordinal), "%u", fun->ordinal);
+
+        key = pe_index_key(
+            buffer,
+            sizeof(buffer),
+            dll->name,
+            dll_length,
+            ordinal,
+            &key_length);
+
+        if (key == NULL)
+          return ERROR_INSUFFICIENT_MEMORY;
+
+        if (yr_hash_table_lookup_raw_key(index, key, key_length, "ordinal") ==
+            NULL)
+        {
+          FAIL_ON_ERROR_WITH_CLEANUP(
+              yr_hash_table_add_raw_key(index, key, key_length, "ordinal", dll),
+              pe_index_key_free(key, buffer));
+        }
+
+        pe_index_key_free(key, buffer);
       }
     }
-  }
 
-  return result;
-}
+    key = pe_index_key(
+        buffer, sizeof(buffer), dll->name, dll_length, NULL, &key_length);
 
-int64_t pe_imports(IMPORTED_DLL* dll, char* dll_name, char* fun_name)
-{
-  if (dll == NULL)
-    return 0;
+    if (key == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
 
-  for (; dll != NULL; dll = dll->next)
-  {
-    if (strcasecmp(dll->name, dll_name) == 0)
+    // The same DLL can appear more than once in the imports, in that case the
+    // counts are added up.
+    uint32_t previous = yr_hash_table_lookup_uint32_raw_key(
+        index, key, key_length, "dll");
+
+    if (previous != UINT32_MAX)
     {
-      IMPORT_FUNCTION* fun = dll->functions;
-      for (; fun != NULL; fun = fun->next)
-      {
-        if (strcasecmp(fun->name, fun_name) == 0)
-          return 1;
-      }
+      yr_hash_table_remove_raw_key(index, key, key_length, "dll");
+      count += previous;
     }
+
+    FAIL_ON_ERROR_WITH_CLEANUP(
+        yr_hash_table_add_uint32_raw_key(index, key, key_length, "dll", count),
+        pe_index_key_free(key, buffer));
+
+    pe_index_key_free(key, buffer);
   }
 
-  return 0;
+  return ERROR_SUCCESS;
 }
 
-int64_t pe_imports_regexp(
-    YR_SCAN_CONTEXT* context,
-    IMPORTED_DLL* dll,
-    RE* dll_name,
-    RE* fun_name)
+//
+// Returns the hash table for the standard or delayed imports (depending on
+// whether list is IMPORT_STANDARD or IMPORT_DELAYED), creating it the first
+// time it's needed during the scan. Returns NULL if there are no imports in the
+// list or the table couldn't be created.
+//
+
+static YR_HASH_TABLE* pe_imports_index(PE* pe, int list)
 {
-  if (dll == NULL)
-    return 0;
+  IMPORTED_DLL* dlls;
+  YR_HASH_TABLE** index;
 
-  int64_t result = 0;
+  if (list == IMPORT_DELAYED)
+  {
+    dlls = pe->delay_imported_dlls;
+    index = &pe->delay_imports_index;
+  }
+  else
+  {
+    dlls = pe->imported_dlls;
+    index = &pe->imports_index;
+  }
 
-  for (; dll != NULL; dll = dll->next)
+  if (*index == NULL && dlls != NULL)
   {
-    if (yr_re_match(context, dll_name, dll->name) > 0)
+    int count = 0;
+
+    for (IMPORTED_DLL* dll = dlls; dll != NULL; dll = dll->next)
+      for (IMPORT_FUNCTION* fun = dll->functions; fun != NULL; fun = fun->next)
+        count++;
+
+    if (yr_hash_table_create(yr_max(2 * count, 17), index) != ERROR_SUCCESS)
+      return NULL;
+
+    if (pe_index_imports(dlls, *index) != ERROR_SUCCESS)
     {
-      IMPORT_FUNCTION* fun = dll->functions;
-      for (; fun != NULL; fun = fun->next)
-      {
-        if (yr_re_match(context, fun_name, fun->name) > 0)
-          result++;
-      }
+      yr_hash_table_destroy(*index, NULL);
+      *index = NULL;
     }
   }
 
-  return result;
+  return *index;
 }
 
-int64_t pe_imports_ordinal(IMPORTED_DLL* dll, char* dll_name, uint64_t ordinal)
+int64_t pe_imports_dll(PE* pe, int list, char* dll_name)
 {
-  if (dll == NULL)
-    return 0;
+  YR_HASH_TABLE* index = pe_imports_index(pe, list);
 
-  for (; dll != NULL; dll = dll->next)
+  size_t key_length;
+  char buffer[256];
+  char* key;
+
+  if (index == NULL)
+    return 0;
+
+  key = pe_index_key(
+      buffer, sizeof(buffer), dll_name, strlen(dll_name), NULL, &key_length);
+
+  if (key == NULL)
+    return 0;
+
+  uint32_t result = yr_hash_table_lookup_uint32_raw_key(
+      index, key, key_length, "dll");
+
+  pe_index_key_free(key, buffer);
+
+  return result == UINT32_MAX ? 0 : result;
+}
+
+int64_t pe_imports(PE* pe, int list, char* dll_name, char* fun_name)
+{
+  YR_HASH_TABLE* index = pe_imports_index(pe, list);
+
+  size_t key_length;
+  char buffer[256];
+  char* key;
+  void* result;
+
+  if (index == NULL)
+    return 0;
+
+  key = pe_index_key(
+      buffer,
+      sizeof(buffer),
+      dll_name,
+      strlen(dll_name),
+      fun_name,
+      &key_length);
+
+  if (key == NULL)
+    return 0;
+
+  result = yr_hash_table_lookup_raw_key(index, key, key_length, "function");
+
+  pe_index_key_free(key, buffer);
+
+  return result != NULL;
+}
+
+//
+// The result of pe_imports_regexp for a pair of regular expressions is kept in
+// the "regexp" namespace of the index, as the same pair is usually used by many
+// rules.
+//
+
+int64_t pe_imports_regexp(
+    YR_SCAN_CONTEXT* context,
+    PE* pe,
+    int list,
+    RE* dll_name,
+    RE* fun_name)
+{
+  YR_HASH_TABLE* index = pe_imports_index(pe, list);
+
+  RE* key[2] = {dll_name, fun_name};
+  uint32_t result;
+
+  if (index == NULL)
+    return 0;
+
+  result = yr_hash_table_lookup_uint32_raw_key(
+      index, key, sizeof(key), "regexp");
+
+  if (result != UINT32_MAX)
+    return result;
+
+  IMPORTED_DLL* dll = list == IMPORT_DELAYED ? pe->delay_imported_dlls
+                                             : pe->imported_dlls;
+  result = 0;
+
+  for (; dll != NULL; dll = dll->next)
   {
-    if (strcasecmp(dll->name, dll_name) == 0)
+    if (yr_re_match(context, dll_name, dll->name) > 0)
     {
       IMPORT_FUNCTION* fun = dll->functions;
       for (; fun != NULL; fun = fun->next)
       {
-        if (fun->has_ordinal && fun->ordinal == ordinal)
-          return 1;
+        if (yr_re_match(context, fun_name, fun->name) > 0)
+          result++;
       }
     }
   }
 
-  return 0;
+  // If the result can't be cached it will be computed again next time.
+  yr_hash_table_add_uint32_raw_key(index, key, sizeof(key), "regexp", result);
+
+  return result;
+}
+
+int64_t pe_imports_ordinal(PE* pe, int list, char* dll_name, uint64_t ordinal)
+{
+  YR_HASH_TABLE* index = pe_imports_index(pe, list);
+
+  char ordinal_str[8];
+  size_t key_length;
+  char buffer[256];
+  char* key;
+  void* result;
+
+  // Ordinals of imported functions are 16-bit numbers.
+  if (index == NULL || ordinal > UINT16_MAX)
+    return 0;
+
+  snprintf(ordinal_str, sizeof(ordinal_str), "%u", (uint16_t) ordinal);
+
+  key = pe_index_key(
+      buffer,
+      sizeof(buffer),
+      dll_name,
+      strlen(dll_name),
+      ordinal_str,
+      &key_length);
+
+  if (key == NULL)
+    return 0;
+
+  result = yr_hash_table_lookup_raw_key(index, key, key_length, "ordinal");
+
+  pe_index_key_free(key, buffer);
+
+  return result != NULL;
 }
 
 define_function(imports_standard)
@@ -2831,7 +3248,7 @@ define_function(imports_standard)
   if (!pe)
     return_integer(YR_UNDEFINED);
 
-  return_integer(pe_imports(pe->imported_dlls, dll_name, function_name));
+  return_integer(pe_imports(pe, IMPORT_STANDARD, dll_name, function_name));
 }
 
 define_function(imports)
@@ -2847,13 +3264,13 @@ define_function(imports)
     return_integer(YR_UNDEFINED);
 
   if (flags & IMPORT_STANDARD &&
-      pe_imports(pe->imported_dlls, dll_name, function_name))
+      pe_imports(pe, IMPORT_STANDARD, dll_name, function_name))
   {
     return_integer(1);
   }
 
   if (flags & IMPORT_DELAYED &&
-      pe_imports(pe->delay_imported_dlls, dll_name, function_name))
+      pe_imports(pe, IMPORT_DELAYED, dll_name, function_name))
   {
     return_integer(1);
   }
@@ -2872,7 +3289,7 @@ define_function(imports_standard_ordinal)
   if (!pe)
     return_integer(YR_UNDEFINED);
 
-  return_integer(pe_imports_ordinal(pe->imported_dlls, dll_name, ordinal))
+  return_integer(pe_imports_ordinal(pe, IMPORT_STANDARD, dll_name, ordinal))
 }
 
 define_function(imports_ordinal)
@@ -2888,13 +3305,13 @@ define_function(imports_ordinal)
     return_integer(YR_UNDEFINED);
 
   if (flags & IMPORT_STANDARD &&
-      pe_imports_ordinal(pe->imported_dlls, dll_name, ordinal))
+      pe_imports_ordinal(pe, IMPORT_STANDARD, dll_name, ordinal))
   {
     return_integer(1);
   }
 
   if (flags & IMPORT_DELAYED &&
-      pe_imports_ordinal(pe->delay_imported_dlls, dll_name, ordinal))
+      pe_imports_ordinal(pe, IMPORT_DELAYED, dll_name, ordinal))
   {
     return_integer(1);
   }
@@ -2914,7 +3331,7 @@ define_function(imports_standard_regex)
     return_integer(YR_UNDEFINED);
 
   return_integer(pe_imports_regexp(
-      scan_context(), pe->imported_dlls, dll_name, function_name))
+      scan_context(), pe, IMPORT_STANDARD, dll_name, function_name))
 }
 
 define_function(imports_regex)
@@ -2933,11 +3350,11 @@ define_function(imports_regex)
 
   if (flags & IMPORT_STANDARD)
     result += pe_imports_regexp(
-        scan_context(), pe->imported_dlls, dll_name, function_name);
+        scan_context(), pe, IMPORT_STANDARD, dll_name, function_name);
 
   if (flags & IMPORT_DELAYED)
     result += pe_imports_regexp(
-        scan_context(), pe->delay_imported_dlls, dll_name, function_name);
+        scan_context(), pe, IMPORT_DELAYED, dll_name, function_name);
 
   return_integer(result);
 }
@@ -2952,7 +3369,7 @@ define_function(imports_standard_dll)
   if (!pe)
     return_integer(YR_UNDEFINED);
 
-  return_integer(pe_imports_dll(pe->imported_dlls, dll_name));
+  return_integer(pe_imports_dll(pe, IMPORT_STANDARD, dll_name));
 }
 
 define_function(imports_dll)
@@ -2969,10 +3386,10 @@ define_function(imports_dll)
   int64_t result = 0;
 
   if (flags & IMPORT_STANDARD)
-    result += pe_imports_dll(pe->imported_dlls, dll_name);
+    result += pe_imports_dll(pe, IMPORT_STANDARD, dll_name);
 
   if (flags & IMPORT_DELAYED)
-    result += pe_imports_dll(pe->delay_imported_dlls, dll_name);
+    result += pe_imports_dll(pe, IMPORT_DELAYED, dll_name);
 
   return_integer(result);
 }
@@ -2996,7 +3413,8 @@ define_function(locale)
 
   for (int i = 0; i < n; i++)
   {
-    uint64_t rsrc_language = get_integer(module, "resources[%i].language", i);
+    uint64_t rsrc_language = get_integer_by_path(
+        module, &pe_paths.resource_language, i);
 
     if ((rsrc_language & 0xFFFF) == locale)
       return_integer(1);
@@ -3024,7 +3442,8 @@ define_function(language)
 
   for (int i = 0; i < n; i++)
   {
-    uint64_t rsrc_language = get_integer(module, "resources[%i].language", i);
+    uint64_t rsrc_language = get_integer_by_path(
+        module, &pe_paths.resource_language, i);
 
     if ((rsrc_language & 0xFF) == language)
       return_integer(1);
@@ -3213,420 +3632,78 @@ define_function(rva_to_offset)
   return_integer(offset);
 }
 
-begin_declarations
-  declare_integer("MACHINE_UNKNOWN");
-  declare_integer("MACHINE_AM33");
-  declare_integer("MACHINE_AMD64");
-  declare_integer("MACHINE_ARM");
-  declare_integer("MACHINE_ARMNT");
-  declare_integer("MACHINE_ARM64");
-  declare_integer("MACHINE_EBC");
-  declare_integer("MACHINE_I386");
-  declare_integer("MACHINE_IA64");
-  declare_integer("MACHINE_M32R");
-  declare_integer("MACHINE_MIPS16");
-  declare_integer("MACHINE_MIPSFPU");
-  declare_integer("MACHINE_MIPSFPU16");
-  declare_integer("MACHINE_POWERPC");
-  declare_integer("MACHINE_POWERPCFP");
-  declare_integer("MACHINE_R4000");
-  declare_integer("MACHINE_SH3");
-  declare_integer("MACHINE_SH3DSP");
-  declare_integer("MACHINE_SH4");
-  declare_integer("MACHINE_SH5");
-  declare_integer("MACHINE_THUMB");
-  declare_integer("MACHINE_WCEMIPSV2");
-  declare_integer("MACHINE_TARGET_HOST");
-  declare_integer("MACHINE_R3000");
-  declare_integer("MACHINE_R10000");
-  declare_integer("MACHINE_ALPHA");
-  declare_integer("MACHINE_SH3E");
-  declare_integer("MACHINE_ALPHA64");
-  declare_integer("MACHINE_AXP64");
-  declare_integer("MACHINE_TRICORE");
-  declare_integer("MACHINE_CEF");
-  declare_integer("MACHINE_CEE");
+//
+// Parse stages. Only the headers and sections are parsed in module_load, the
+// rest of the PE is parsed by these functions the first time a rule uses a
+// field or function that depends on it. See begin_stage in modules.h.
+//
 
-  declare_integer("SUBSYSTEM_UNKNOWN");
-  declare_integer("SUBSYSTEM_NATIVE");
-  declare_integer("SUBSYSTEM_WINDOWS_GUI");
-  declare_integer("SUBSYSTEM_WINDOWS_CUI");
-  declare_integer("SUBSYSTEM_OS2_CUI");
-  declare_integer("SUBSYSTEM_POSIX_CUI");
-  declare_integer("SUBSYSTEM_NATIVE_WINDOWS");
-  declare_integer("SUBSYSTEM_WINDOWS_CE_GUI");
-  declare_integer("SUBSYSTEM_EFI_APPLICATION");
-  declare_integer("SUBSYSTEM_EFI_BOOT_SERVICE_DRIVER");
-  declare_integer("SUBSYSTEM_EFI_RUNTIME_DRIVER");
-  declare_integer("SUBSYSTEM_EFI_ROM_IMAGE");
-  declare_integer("SUBSYSTEM_XBOX");
-  declare_integer("SUBSYSTEM_WINDOWS_BOOT_APPLICATION");
+static void pe_load_resources(YR_OBJECT* module_object)
+{
+  PE* pe = (PE*) module_object->data;
 
-  declare_integer("HIGH_ENTROPY_VA");
-  declare_integer("DYNAMIC_BASE");
-  declare_integer("FORCE_INTEGRITY");
-  declare_integer("NX_COMPAT");
-  declare_integer("NO_ISOLATION");
-  declare_integer("NO_SEH");
-  declare_integer("NO_BIND");
-  declare_integer("APPCONTAINER");
-  declare_integer("WDM_DRIVER");
-  declare_integer("GUARD_CF");
-  declare_integer("TERMINAL_SERVER_AWARE");
+  if (pe == NULL)
+    return;
 
-  declare_integer("RELOCS_STRIPPED");
-  declare_integer("EXECUTABLE_IMAGE");
-  declare_integer("LINE_NUMS_STRIPPED");
-  declare_integer("LOCAL_SYMS_STRIPPED");
-  declare_integer("AGGRESIVE_WS_TRIM");
-  declare_integer("LARGE_ADDRESS_AWARE");
-  declare_integer("BYTES_REVERSED_LO");
-  declare_integer("MACHINE_32BIT");
-  declare_integer("DEBUG_STRIPPED");
-  declare_integer("REMOVABLE_RUN_FROM_SWAP");
-  declare_integer("NET_RUN_FROM_SWAP");
-  declare_integer("SYSTEM");
-  declare_integer("DLL");
-  declare_integer("UP_SYSTEM_ONLY");
-  declare_integer("BYTES_REVERSED_HI");
+  pe_iterate_resources(
+      pe, (RESOURCE_CALLBACK_FUNC) pe_collect_resources, (void*) pe);
 
-  declare_integer("IMAGE_DIRECTORY_ENTRY_EXPORT");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_IMPORT");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_RESOURCE");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_EXCEPTION");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_SECURITY");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_BASERELOC");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_DEBUG");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_ARCHITECTURE");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_COPYRIGHT");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_GLOBALPTR");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_TLS");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_IAT");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT");
-  declare_integer("IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR");
+  set_integer(pe->resources, pe->object, "number_of_resources");
+  set_integer(pe->version_infos, pe->object, "number_of_version_infos");
+}
 
-  declare_integer("IMAGE_NT_OPTIONAL_HDR32_MAGIC");
-  declare_integer("IMAGE_NT_OPTIONAL_HDR64_MAGIC");
-  declare_integer("IMAGE_ROM_OPTIONAL_HDR_MAGIC");
+static void pe_load_rich_signature(YR_OBJECT* module_object)
+{
+  PE* pe = (PE*) module_object->data;
 
-  declare_integer("SECTION_NO_PAD");
-  declare_integer("SECTION_CNT_CODE");
-  declare_integer("SECTION_CNT_INITIALIZED_DATA");
-  declare_integer("SECTION_CNT_UNINITIALIZED_DATA");
-  declare_integer("SECTION_LNK_OTHER");
-  declare_integer("SECTION_LNK_INFO");
-  declare_integer("SECTION_LNK_REMOVE");
-  declare_integer("SECTION_LNK_COMDAT");
-  declare_integer("SECTION_NO_DEFER_SPEC_EXC");
-  declare_integer("SECTION_GPREL");
-  declare_integer("SECTION_MEM_FARDATA");
-  declare_integer("SECTION_MEM_PURGEABLE");
-  declare_integer("SECTION_MEM_16BIT");
-  declare_integer("SECTION_MEM_LOCKED");
-  declare_integer("SECTION_MEM_PRELOAD");
-  declare_integer("SECTION_ALIGN_1BYTES");
-  declare_integer("SECTION_ALIGN_2BYTES");
-  declare_integer("SECTION_ALIGN_4BYTES");
-  declare_integer("SECTION_ALIGN_8BYTES");
-  declare_integer("SECTION_ALIGN_16BYTES");
-  declare_integer("SECTION_ALIGN_32BYTES");
-  declare_integer("SECTION_ALIGN_64BYTES");
-  declare_integer("SECTION_ALIGN_128BYTES");
-  declare_integer("SECTION_ALIGN_256BYTES");
-  declare_integer("SECTION_ALIGN_512BYTES");
-  declare_integer("SECTION_ALIGN_1024BYTES");
-  declare_integer("SECTION_ALIGN_2048BYTES");
-  declare_integer("SECTION_ALIGN_4096BYTES");
-  declare_integer("SECTION_ALIGN_8192BYTES");
-  declare_integer("SECTION_ALIGN_MASK");
-  declare_integer("SECTION_LNK_NRELOC_OVFL");
-  declare_integer("SECTION_MEM_DISCARDABLE");
-  declare_integer("SECTION_MEM_NOT_CACHED");
-  declare_integer("SECTION_MEM_NOT_PAGED");
-  declare_integer("SECTION_MEM_SHARED");
-  declare_integer("SECTION_MEM_EXECUTE");
-  declare_integer("SECTION_MEM_READ");
-  declare_integer("SECTION_MEM_WRITE");
-  declare_integer("SECTION_SCALE_INDEX");
+  if (pe != NULL)
+    pe_parse_rich_signature(pe, pe->base_address);
+}
 
-  declare_integer("RESOURCE_TYPE_CURSOR");
-  declare_integer("RESOURCE_TYPE_BITMAP");
-  declare_integer("RESOURCE_TYPE_ICON");
-  declare_integer("RESOURCE_TYPE_MENU");
-  declare_integer("RESOURCE_TYPE_DIALOG");
-  declare_integer("RESOURCE_TYPE_STRING");
-  declare_integer("RESOURCE_TYPE_FONTDIR");
-  declare_integer("RESOURCE_TYPE_FONT");
-  declare_integer("RESOURCE_TYPE_ACCELERATOR");
-  declare_integer("RESOURCE_TYPE_RCDATA");
-  declare_integer("RESOURCE_TYPE_MESSAGETABLE");
-  declare_integer("RESOURCE_TYPE_GROUP_CURSOR");
-  declare_integer("RESOURCE_TYPE_GROUP_ICON");
-  declare_integer("RESOURCE_TYPE_VERSION");
-  declare_integer("RESOURCE_TYPE_DLGINCLUDE");
-  declare_integer("RESOURCE_TYPE_PLUGPLAY");
-  declare_integer("RESOURCE_TYPE_VXD");
-  declare_integer("RESOURCE_TYPE_ANICURSOR");
-  declare_integer("RESOURCE_TYPE_ANIICON");
-  declare_integer("RESOURCE_TYPE_HTML");
-  declare_integer("RESOURCE_TYPE_MANIFEST");
+static void pe_load_debug_directory(YR_OBJECT* module_object)
+{
+  PE* pe = (PE*) module_object->data;
 
-  declare_integer("IMAGE_DEBUG_TYPE_UNKNOWN");
-  declare_integer("IMAGE_DEBUG_TYPE_COFF");
-  declare_integer("IMAGE_DEBUG_TYPE_CODEVIEW");
-  declare_integer("IMAGE_DEBUG_TYPE_FPO");
-  declare_integer("IMAGE_DEBUG_TYPE_MISC");
-  declare_integer("IMAGE_DEBUG_TYPE_EXCEPTION");
-  declare_integer("IMAGE_DEBUG_TYPE_FIXUP");
-  declare_integer("IMAGE_DEBUG_TYPE_OMAP_TO_SRC");
-  declare_integer("IMAGE_DEBUG_TYPE_OMAP_FROM_SRC");
-  declare_integer("IMAGE_DEBUG_TYPE_BORLAND");
-  declare_integer("IMAGE_DEBUG_TYPE_RESERVED10");
-  declare_integer("IMAGE_DEBUG_TYPE_CLSID");
-  declare_integer("IMAGE_DEBUG_TYPE_VC_FEATURE");
-  declare_integer("IMAGE_DEBUG_TYPE_POGO");
-  declare_integer("IMAGE_DEBUG_TYPE_ILTCG");
-  declare_integer("IMAGE_DEBUG_TYPE_MPX");
-  declare_integer("IMAGE_DEBUG_TYPE_REPRO");
+  if (pe != NULL)
+    pe_parse_debug_directory(pe);
+}
 
-  declare_integer("is_pe");
-  declare_integer("machine");
-  declare_integer("number_of_sections");
-  declare_integer("timestamp");
-  declare_integer("pointer_to_symbol_table");
-  declare_integer("number_of_symbols");
-  declare_integer("size_of_optional_header");
-  declare_integer("characteristics");
-
-  declare_integer("entry_point");
-  declare_integer("entry_point_raw");
-  declare_integer("image_base");
-  declare_integer("number_of_rva_and_sizes");
-  declare_integer("number_of_version_infos");
-
-  declare_string_dictionary("version_info");
-
-  begin_struct_array("version_info_list")
-    declare_string("key");
-    declare_string("value");
-  end_struct_array("version_info_list");
-
-  declare_integer("opthdr_magic");
-  declare_integer("size_of_code");
-  declare_integer("size_of_initialized_data");
-  declare_integer("size_of_uninitialized_data");
-  declare_integer("base_of_code");
-  declare_integer("base_of_data");
-  declare_integer("section_alignment");
-  declare_integer("file_alignment");
-
-  begin_struct("linker_version")
-    declare_integer("major");
-    declare_integer("minor");
-  end_struct("linker_version");
-
-  begin_struct("os_version")
-    declare_integer("major");
-    declare_integer("minor");
-  end_struct("os_version");
-
-  begin_struct("image_version")
-    declare_integer("major");
-    declare_integer("minor");
-  end_struct("image_version");
-
-  begin_struct("subsystem_version")
-    declare_integer("major");
-    declare_integer("minor");
-  end_struct("subsystem_version");
-
-  declare_integer("win32_version_value");
-  declare_integer("size_of_image");
-  declare_integer("size_of_headers");
-
-  declare_integer("checksum");
-  declare_function("calculate_checksum", "", "i", calculate_checksum);
-  declare_integer("subsystem");
-
-  declare_integer("dll_characteristics");
-  declare_integer("size_of_stack_reserve");
-  declare_integer("size_of_stack_commit");
-  declare_integer("size_of_heap_reserve");
-  declare_integer("size_of_heap_commit");
-  declare_integer("loader_flags");
-
-  begin_struct_array("data_directories")
-    declare_integer("virtual_address");
-    declare_integer("size");
-  end_struct_array("data_directories");
-
-  begin_struct_array("sections")
-    declare_string("name");
-    declare_string("full_name");
-    declare_integer("characteristics");
-    declare_integer("virtual_address");
-    declare_integer("virtual_size");
-    declare_integer("raw_data_offset");
-    declare_integer("raw_data_size");
-    declare_integer("pointer_to_relocations");
-    declare_integer("pointer_to_line_numbers");
-    declare_integer("number_of_relocations");
-    declare_integer("number_of_line_numbers");
-  end_struct_array("sections");
-
-  begin_struct("overlay")
-    declare_integer("offset");
-    declare_integer("size");
-  end_struct("overlay");
-
-  begin_struct("rich_signature")
-    declare_integer("offset");
-    declare_integer("length");
-    declare_integer("key");
-    declare_string("raw_data");
-    declare_string("clear_data");
-    declare_function("version", "i", "i", rich_version);
-    declare_function("version", "ii", "i", rich_version_toolid);
-    declare_function("toolid", "i", "i", rich_toolid);
-    declare_function("toolid", "ii", "i", rich_toolid_version);
-  end_struct("rich_signature");
+#if defined(HAVE_LIBCRYPTO) && !defined(BORINGSSL)
+static void pe_load_certificates(YR_OBJECT* module_object)
+{
+  PE* pe = (PE*) module_object->data;
 
-#if defined(HAVE_LIBCRYPTO) || defined(HAVE_WINCRYPT_H) || \
-    defined(HAVE_COMMONCRYPTO_COMMONCRYPTO_H)
-  declare_function("imphash", "", "s", imphash);
+  if (pe != NULL)
+    pe_parse_certificates(pe);
+}
 #endif
 
-  declare_integer("IMPORT_DELAYED");
-  declare_integer("IMPORT_STANDARD");
-  declare_integer("IMPORT_ANY");
-
-  declare_function("section_index", "s", "i", section_index_name);
-  declare_function("section_index", "i", "i", section_index_addr);
-  declare_function("exports", "s", "i", exports);
-  declare_function("exports", "r", "i", exports_regexp);
-  declare_function("exports", "i", "i", exports_ordinal);
-  declare_function("exports_index", "s", "i", exports_index_name);
-  declare_function("exports_index", "i", "i", exports_index_ordinal);
-  declare_function("exports_index", "r", "i", exports_index_regex);
-  declare_function("imports", "ss", "i", imports_standard);
-  declare_function("imports", "si", "i", imports_standard_ordinal);
-  declare_function("imports", "s", "i", imports_standard_dll);
-  declare_function("imports", "rr", "i", imports_standard_regex);
-  declare_function("imports", "iss", "i", imports);
-  declare_function("imports", "isi", "i", imports_ordinal);
-  declare_function("imports", "is", "i", imports_dll);
-  declare_function("imports", "irr", "i", imports_regex);
-  declare_function("locale", "i", "i", locale);
-  declare_function("language", "i", "i", language);
-  declare_function("is_dll", "", "i", is_dll);
-  declare_function("is_32bit", "", "i", is_32bit);
-  declare_function("is_64bit", "", "i", is_64bit);
-
-  declare_integer("number_of_imports");
-  declare_integer("number_of_imported_functions");
-  declare_integer("number_of_delayed_imports");
-  declare_integer("number_of_delayed_imported_functions");
-  declare_integer("number_of_exports");
-
-  declare_string("dll_name");
-  declare_integer("export_timestamp");
-  begin_struct_array("export_details")
-    declare_integer("offset");
-    declare_string("name");
-    declare_string("forward_name");
-    declare_integer("ordinal");
-  end_struct_array("export_details")
-
-  begin_struct_array("import_details")
-    declare_string("library_name");
-    declare_integer("number_of_functions");
-    begin_struct_array("functions")
-      declare_string("name");
-      declare_integer("ordinal");
-    end_struct_array("functions");
-  end_struct_array("import_details");
-
-  begin_struct_array("delay_import_details")
-    declare_string("library_name");
-    declare_integer("number_of_function");
-    begin_struct_array("functions")
-      declare_string("name");
-      declare_integer("ordinal");
-    end_struct_array("functions");
-  end_struct_array("delay_import_details");
-
-  declare_integer("resource_timestamp");
-
-  begin_struct("resource_version")
-    declare_integer("major");
-    declare_integer("minor");
-  end_struct("resource_version")
-
-  begin_struct_array("resources")
-    declare_integer("rva");
-    declare_integer("offset");
-    declare_integer("length");
-    declare_integer("type");
-    declare_integer("id");
-    declare_integer("language");
-    declare_string("type_string");
-    declare_string("name_string");
-    declare_string("language_string");
-  end_struct_array("resources")
-
-  declare_integer("number_of_resources");
-  declare_string("pdb_path");
-
-#if defined(HAVE_LIBCRYPTO) && !defined(BORINGSSL)
-  begin_struct_array("signatures")
-    declare_string("thumbprint");
-    declare_string("issuer");
-    declare_string("subject");
-    declare_integer("version");
-    declare_string("algorithm");
-    declare_string("algorithm_oid");
-    declare_string("serial");
-    declare_integer("not_before");
-    declare_integer("not_after");
-    declare_function("valid_on", "i", "i", valid_on);
-  end_struct_array("signatures")
-
-  declare_integer("number_of_signatures");
-#endif
+static void pe_load_imports(YR_OBJECT* module_object)
+{
+  PE* pe = (PE*) module_object->data;
 
-  declare_function("rva_to_offset", "i", "i", rva_to_offset);
-end_declarations
+  if (pe == NULL)
+    return;
 
-int module_initialize(YR_MODULE* module)
-{
-#if defined(HAVE_LIBCRYPTO)
-  // Not checking return value here because if it fails we will not parse the
-  // nested signature silently.
-  OBJ_create(SPC_NESTED_SIGNATURE_OBJID, NULL, NULL);
-#endif
-  return ERROR_SUCCESS;
+  pe->imported_dlls = pe_parse_imports(pe);
+  pe->delay_imported_dlls = pe_parse_delayed_imports(pe);
 }
 
-int module_finalize(YR_MODULE* module)
+static void pe_load_exports(YR_OBJECT* module_object)
 {
-  return ERROR_SUCCESS;
-}
+  PE* pe = (PE*) module_object->data;
 
-int module_load(
-    YR_SCAN_CONTEXT* context,
-    YR_OBJECT* module_object,
-    void* module_data,
-    size_t module_data_size)
-{
-  YR_MEMORY_BLOCK* block;
-  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
+  if (pe != NULL)
+    pe_parse_exports(pe);
+}
 
-  PIMAGE_NT_HEADERS32 pe_header;
-  const uint8_t* block_data = NULL;
-  PE* pe = NULL;
+//
+// Sets the values of the module's constants. This is done in the declarations,
+// so that the values are part of the object tree copied for each scan.
+//
 
+static void pe_set_definitions(YR_OBJECT* module_object)
+{
   set_integer(IMPORT_DELAYED, module_object, "IMPORT_DELAYED");
   set_integer(IMPORT_STANDARD, module_object, "IMPORT_STANDARD");
   set_integer(IMPORT_ANY, module_object, "IMPORT_ANY");
@@ -3939,6 +4016,479 @@ int module_load(
   set_integer(IMAGE_DEBUG_TYPE_ILTCG, module_object, "IMAGE_DEBUG_TYPE_ILTCG");
   set_integer(IMAGE_DEBUG_TYPE_MPX, module_object, "IMAGE_DEBUG_TYPE_MPX");
   set_integer(IMAGE_DEBUG_TYPE_REPRO, module_object, "IMAGE_DEBUG_TYPE_REPRO");
+}
+
+begin_declarations
+  declare_integer("MACHINE_UNKNOWN");
+  declare_integer("MACHINE_AM33");
+  declare_integer("MACHINE_AMD64");
+  declare_integer("MACHINE_ARM");
+  declare_integer("MACHINE_ARMNT");
+  declare_integer("MACHINE_ARM64");
+  declare_integer("MACHINE_EBC");
+  declare_integer("MACHINE_I386");
+  declare_integer("MACHINE_IA64");
+  declare_integer("MACHINE_M32R");
+  declare_integer("MACHINE_MIPS16");
+  declare_integer("MACHINE_MIPSFPU");
+  declare_integer("MACHINE_MIPSFPU16");
+  declare_integer("MACHINE_POWERPC");
+  declare_integer("MACHINE_POWERPCFP");
+  declare_integer("MACHINE_R4000");
+  declare_integer("MACHINE_SH3");
+  declare_integer("MACHINE_SH3DSP");
+  declare_integer("MACHINE_SH4");
+  declare_integer("MACHINE_SH5");
+  declare_integer("MACHINE_THUMB");
+  declare_integer("MACHINE_WCEMIPSV2");
+  declare_integer("MACHINE_TARGET_HOST");
+  declare_integer("MACHINE_R3000");
+  declare_integer("MACHINE_R10000");
+  declare_integer("MACHINE_ALPHA");
+  declare_integer("MACHINE_SH3E");
+  declare_integer("MACHINE_ALPHA64");
+  declare_integer("MACHINE_AXP64");
+  declare_integer("MACHINE_TRICORE");
+  declare_integer("MACHINE_CEF");
+  declare_integer("MACHINE_CEE");
+
+  declare_integer("SUBSYSTEM_UNKNOWN");
+  declare_integer("SUBSYSTEM_NATIVE");
+  declare_integer("SUBSYSTEM_WINDOWS_GUI");
+  declare_integer("SUBSYSTEM_WINDOWS_CUI");
+  declare_integer("SUBSYSTEM_OS2_CUI");
+  declare_integer("SUBSYSTEM_POSIX_CUI");
+  declare_integer("SUBSYSTEM_NATIVE_WINDOWS");
+  declare_integer("SUBSYSTEM_WINDOWS_CE_GUI");
+  declare_integer("SUBSYSTEM_EFI_APPLICATION");
+  declare_integer("SUBSYSTEM_EFI_BOOT_SERVICE_DRIVER");
+  declare_integer("SUBSYSTEM_EFI_RUNTIME_DRIVER");
+  declare_integer("SUBSYSTEM_EFI_ROM_IMAGE");
+  declare_integer("SUBSYSTEM_XBOX");
+  declare_integer("SUBSYSTEM_WINDOWS_BOOT_APPLICATION");
+
+  declare_integer("HIGH_ENTROPY_VA");
+  declare_integer("DYNAMIC_BASE");
+  declare_integer("FORCE_INTEGRITY");
+  declare_integer("NX_COMPAT");
+  declare_integer("NO_ISOLATION");
+  declare_integer("NO_SEH");
+  declare_integer("NO_BIND");
+  declare_integer("APPCONTAINER");
+  declare_integer("WDM_DRIVER");
+  declare_integer("GUARD_CF");
+  declare_integer("TERMINAL_SERVER_AWARE");
+
+  declare_integer("RELOCS_STRIPPED");
+  declare_integer("EXECUTABLE_IMAGE");
+  declare_integer("LINE_NUMS_STRIPPED");
+  declare_integer("LOCAL_SYMS_STRIPPED");
+  declare_integer("AGGRESIVE_WS_TRIM");
+  declare_integer("LARGE_ADDRESS_AWARE");
+  declare_integer("BYTES_REVERSED_LO");
+  declare_integer("MACHINE_32BIT");
+  declare_integer("DEBUG_STRIPPED");
+  declare_integer("REMOVABLE_RUN_FROM_SWAP");
+  declare_integer("NET_RUN_FROM_SWAP");
+  declare_integer("SYSTEM");
+  declare_integer("DLL");
+  declare_integer("UP_SYSTEM_ONLY");
+  declare_integer("BYTES_REVERSED_HI");
+
+  declare_integer("IMAGE_DIRECTORY_ENTRY_EXPORT");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_IMPORT");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_RESOURCE");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_EXCEPTION");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_SECURITY");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_BASERELOC");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_DEBUG");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_ARCHITECTURE");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_COPYRIGHT");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_GLOBALPTR");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_TLS");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_IAT");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT");
+  declare_integer("IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR");
+
+  declare_integer("IMAGE_NT_OPTIONAL_HDR32_MAGIC");
+  declare_integer("IMAGE_NT_OPTIONAL_HDR64_MAGIC");
+  declare_integer("IMAGE_ROM_OPTIONAL_HDR_MAGIC");
+
+  declare_integer("SECTION_NO_PAD");
+  declare_integer("SECTION_CNT_CODE");
+  declare_integer("SECTION_CNT_INITIALIZED_DATA");
+  declare_integer("SECTION_CNT_UNINITIALIZED_DATA");
+  declare_integer("SECTION_LNK_OTHER");
+  declare_integer("SECTION_LNK_INFO");
+  declare_integer("SECTION_LNK_REMOVE");
+  declare_integer("SECTION_LNK_COMDAT");
+  declare_integer("SECTION_NO_DEFER_SPEC_EXC");
+  declare_integer("SECTION_GPREL");
+  declare_integer("SECTION_MEM_FARDATA");
+  declare_integer("SECTION_MEM_PURGEABLE");
+  declare_integer("SECTION_MEM_16BIT");
+  declare_integer("SECTION_MEM_LOCKED");
+  declare_integer("SECTION_MEM_PRELOAD");
+  declare_integer("SECTION_ALIGN_1BYTES");
+  declare_integer("SECTION_ALIGN_2BYTES");
+  declare_integer("SECTION_ALIGN_4BYTES");
+  declare_integer("SECTION_ALIGN_8BYTES");
+  declare_integer("SECTION_ALIGN_16BYTES");
+  declare_integer("SECTION_ALIGN_32BYTES");
+  declare_integer("SECTION_ALIGN_64BYTES");
+  declare_integer("SECTION_ALIGN_128BYTES");
+  declare_integer("SECTION_ALIGN_256BYTES");
+  declare_integer("SECTION_ALIGN_512BYTES");
+  declare_integer("SECTION_ALIGN_1024BYTES");
+  declare_integer("SECTION_ALIGN_2048BYTES");
+  declare_integer("SECTION_ALIGN_4096BYTES");
+  declare_integer("SECTION_ALIGN_8192BYTES");
+  declare_integer("SECTION_ALIGN_MASK");
+  declare_integer("SECTION_LNK_NRELOC_OVFL");
+  declare_integer("SECTION_MEM_DISCARDABLE");
+  declare_integer("SECTION_MEM_NOT_CACHED");
+  declare_integer("SECTION_MEM_NOT_PAGED");
+  declare_integer("SECTION_MEM_SHARED");
+  declare_integer("SECTION_MEM_EXECUTE");
+  declare_integer("SECTION_MEM_READ");
+  declare_integer("SECTION_MEM_WRITE");
+  declare_integer("SECTION_SCALE_INDEX");
+
+  declare_integer("RESOURCE_TYPE_CURSOR");
+  declare_integer("RESOURCE_TYPE_BITMAP");
+  declare_integer("RESOURCE_TYPE_ICON");
+  declare_integer("RESOURCE_TYPE_MENU");
+  declare_integer("RESOURCE_TYPE_DIALOG");
+  declare_integer("RESOURCE_TYPE_STRING");
+  declare_integer("RESOURCE_TYPE_FONTDIR");
+  declare_integer("RESOURCE_TYPE_FONT");
+  declare_integer("RESOURCE_TYPE_ACCELERATOR");
+  declare_integer("RESOURCE_TYPE_RCDATA");
+  declare_integer("RESOURCE_TYPE_MESSAGETABLE");
+  declare_integer("RESOURCE_TYPE_GROUP_CURSOR");
+  declare_integer("RESOURCE_TYPE_GROUP_ICON");
+  declare_integer("RESOURCE_TYPE_VERSION");
+  declare_integer("RESOURCE_TYPE_DLGINCLUDE");
+  declare_integer("RESOURCE_TYPE_PLUGPLAY");
+  declare_integer("RESOURCE_TYPE_VXD");
+  declare_integer("RESOURCE_TYPE_ANICURSOR");
+  declare_integer("RESOURCE_TYPE_ANIICON");
+  declare_integer("RESOURCE_TYPE_HTML");
+  declare_integer("RESOURCE_TYPE_MANIFEST");
+
+  declare_integer("IMAGE_DEBUG_TYPE_UNKNOWN");
+  declare_integer("IMAGE_DEBUG_TYPE_COFF");
+  declare_integer("IMAGE_DEBUG_TYPE_CODEVIEW");
+  declare_integer("IMAGE_DEBUG_TYPE_FPO");
+  declare_integer("IMAGE_DEBUG_TYPE_MISC");
+  declare_integer("IMAGE_DEBUG_TYPE_EXCEPTION");
+  declare_integer("IMAGE_DEBUG_TYPE_FIXUP");
+  declare_integer("IMAGE_DEBUG_TYPE_OMAP_TO_SRC");
+  declare_integer("IMAGE_DEBUG_TYPE_OMAP_FROM_SRC");
+  declare_integer("IMAGE_DEBUG_TYPE_BORLAND");
+  declare_integer("IMAGE_DEBUG_TYPE_RESERVED10");
+  declare_integer("IMAGE_DEBUG_TYPE_CLSID");
+  declare_integer("IMAGE_DEBUG_TYPE_VC_FEATURE");
+  declare_integer("IMAGE_DEBUG_TYPE_POGO");
+  declare_integer("IMAGE_DEBUG_TYPE_ILTCG");
+  declare_integer("IMAGE_DEBUG_TYPE_MPX");
+  declare_integer("IMAGE_DEBUG_TYPE_REPRO");
+
+  declare_integer("is_pe");
+  declare_integer("machine");
+  declare_integer("number_of_sections");
+  declare_integer("timestamp");
+  declare_integer("pointer_to_symbol_table");
+  declare_integer("number_of_symbols");
+  declare_integer("size_of_optional_header");
+  declare_integer("characteristics");
+
+  declare_integer("entry_point");
+  declare_integer("entry_point_raw");
+  declare_integer("image_base");
+  declare_integer("number_of_rva_and_sizes");
+
+  begin_stage(pe_load_resources)
+    declare_integer("number_of_version_infos");
+
+    declare_string_dictionary("version_info");
+
+    begin_struct_array("version_info_list")
+      declare_string("key");
+      declare_string("value");
+    end_struct_array("version_info_list");
+  end_stage(pe_load_resources)
+
+  declare_integer("opthdr_magic");
+  declare_integer("size_of_code");
+  declare_integer("size_of_initialized_data");
+  declare_integer("size_of_uninitialized_data");
+  declare_integer("base_of_code");
+  declare_integer("base_of_data");
+  declare_integer("section_alignment");
+  declare_integer("file_alignment");
+
+  begin_struct("linker_version")
+    declare_integer("major");
+    declare_integer("minor");
+  end_struct("linker_version");
+
+  begin_struct("os_version")
+    declare_integer("major");
+    declare_integer("minor");
+  end_struct("os_version");
+
+  begin_struct("image_version")
+    declare_integer("major");
+    declare_integer("minor");
+  end_struct("image_version");
+
+  begin_struct("subsystem_version")
+    declare_integer("major");
+    declare_integer("minor");
+  end_struct("subsystem_version");
+
+  declare_integer("win32_version_value");
+  declare_integer("size_of_image");
+  declare_integer("size_of_headers");
+
+  declare_integer("checksum");
+  declare_pure_function("calculate_checksum", "", "i", calculate_checksum);
+  declare_integer("subsystem");
+
+  declare_integer("dll_characteristics");
+  declare_integer("size_of_stack_reserve");
+  declare_integer("size_of_stack_commit");
+  declare_integer("size_of_heap_reserve");
+  declare_integer("size_of_heap_commit");
+  declare_integer("loader_flags");
+
+  begin_struct_array("data_directories")
+    declare_integer("virtual_address");
+    declare_integer("size");
+  end_struct_array("data_directories");
+
+  begin_struct_array("sections")
+    declare_string("name");
+    declare_string("full_name");
+    declare_integer("characteristics");
+    declare_integer("virtual_address");
+    declare_integer("virtual_size");
+    declare_integer("raw_data_offset");
+    declare_integer("raw_data_size");
+    declare_integer("pointer_to_relocations");
+    declare_integer("pointer_to_line_numbers");
+    declare_integer("number_of_relocations");
+    declare_integer("number_of_line_numbers");
+  end_struct_array("sections");
+
+  begin_struct("overlay")
+    declare_integer("offset");
+    declare_integer("size");
+  end_struct("overlay");
+
+  begin_stage(pe_load_rich_signature)
+    begin_struct("rich_signature")
+      declare_integer("offset");
+      declare_integer("length");
+      declare_integer("key");
+      declare_string("raw_data");
+      declare_string("clear_data");
+      declare_pure_function("version", "i", "i", rich_version);
+      declare_pure_function("version", "ii", "i", rich_version_toolid);
+      declare_pure_function("toolid", "i", "i", rich_toolid);
+      declare_pure_function("toolid", "ii", "i", rich_toolid_version);
+    end_struct("rich_signature");
+  end_stage(pe_load_rich_signature)
+
+#if defined(HAVE_LIBCRYPTO) || defined(HAVE_WINCRYPT_H) || \
+    defined(HAVE_COMMONCRYPTO_COMMONCRYPTO_H)
+  begin_stage(pe_load_imports)
+    declare_pure_function("imphash", "", "s", imphash);
+  end_stage(pe_load_imports)
+#endif
+
+  declare_integer("IMPORT_DELAYED");
+  declare_integer("IMPORT_STANDARD");
+  declare_integer("IMPORT_ANY");
+
+  declare_function("section_index", "s", "i", section_index_name);
+  declare_function("section_index", "i", "i", section_index_addr);
+
+  begin_stage(pe_load_exports)
+    declare_function("exports", "s", "i", exports);
+    declare_function("exports", "r", "i", exports_regexp);
+    declare_function("exports", "i", "i", exports_ordinal);
+    declare_function("exports_index", "s", "i", exports_index_name);
+    declare_function("exports_index", "i", "i", exports_index_ordinal);
+    declare_function("exports_index", "r", "i", exports_index_regex);
+  end_stage(pe_load_exports)
+
+  begin_stage(pe_load_imports)
+    declare_function("imports", "ss", "i", imports_standard);
+    declare_function("imports", "si", "i", imports_standard_ordinal);
+    declare_function("imports", "s", "i", imports_standard_dll);
+    declare_function("imports", "rr", "i", imports_standard_regex);
+    declare_function("imports", "iss", "i", imports);
+    declare_function("imports", "isi", "i", imports_ordinal);
+    declare_function("imports", "is", "i", imports_dll);
+    declare_function("imports", "irr", "i", imports_regex);
+  end_stage(pe_load_imports)
+
+  begin_stage(pe_load_resources)
+    declare_function("locale", "i", "i", locale);
+    declare_function("language", "i", "i", language);
+  end_stage(pe_load_resources)
+
+  declare_function("is_dll", "", "i", is_dll);
+  declare_function("is_32bit", "", "i", is_32bit);
+  declare_function("is_64bit", "", "i", is_64bit);
+
+  begin_stage(pe_load_imports)
+    declare_integer("number_of_imports");
+    declare_integer("number_of_imported_functions");
+    declare_integer("number_of_delayed_imports");
+    declare_integer("number_of_delayed_imported_functions");
+  end_stage(pe_load_imports)
+
+  begin_stage(pe_load_exports)
+    declare_integer("number_of_exports");
+
+    declare_string("dll_name");
+    declare_integer("export_timestamp");
+    begin_struct_array("export_details")
+      declare_integer("offset");
+      declare_string("name");
+      declare_string("forward_name");
+      declare_integer("ordinal");
+    end_struct_array("export_details")
+  end_stage(pe_load_exports)
+
+  begin_stage(pe_load_imports)
+    begin_struct_array("import_details")
+      declare_string("library_name");
+      declare_integer("number_of_functions");
+      begin_struct_array("functions")
+        declare_string("name");
+        declare_integer("ordinal");
+      end_struct_array("functions");
+    end_struct_array("import_details");
+
+    begin_struct_array("delay_import_details")
+      declare_string("library_name");
+      declare_integer("number_of_function");
+      begin_struct_array("functions")
+        declare_string("name");
+        declare_integer("ordinal");
+      end_struct_array("functions");
+    end_struct_array("delay_import_details");
+  end_stage(pe_load_imports)
+
+  begin_stage(pe_load_resources)
+    declare_integer("resource_timestamp");
+
+    begin_struct("resource_version")
+      declare_integer("major");
+      declare_integer("minor");
+    end_struct("resource_version")
+
+    begin_struct_array("resources")
+      declare_integer("rva");
+      declare_integer("offset");
+      declare_integer("length");
+      declare_integer("type");
+      declare_integer("id");
+      declare_integer("language");
+      declare_string("type_string");
+      declare_string("name_string");
+      declare_string("language_string");
+    end_struct_array("resources")
+
+    declare_integer("number_of_resources");
+  end_stage(pe_load_resources)
+
+  begin_stage(pe_load_debug_directory)
+    declare_string("pdb_path");
+  end_stage(pe_load_debug_directory)
+
+#if defined(HAVE_LIBCRYPTO) && !defined(BORINGSSL)
+  begin_stage(pe_load_certificates)
+    begin_struct_array("signatures")
+      declare_string("thumbprint");
+      declare_string("issuer");
+      declare_string("subject");
+      declare_integer("version");
+      declare_string("algorithm");
+      declare_string("algorithm_oid");
+      declare_string("serial");
+      declare_integer("not_before");
+      declare_integer("not_after");
+      declare_function("valid_on", "i", "i", valid_on);
+    end_struct_array("signatures")
+
+    declare_integer("number_of_signatures");
+  end_stage(pe_load_certificates)
+#endif
+
+  declare_function("rva_to_offset", "i", "i", rva_to_offset);
+
+  pe_set_definitions(module);
+end_declarations
+
+int module_initialize(YR_MODULE* module)
+{
+  YR_OBJECT* prototype = module->prototype;
+
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "sections[%i].name", &pe_paths.section_name));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype,
+      "sections[%i].virtual_address",
+      &pe_paths.section_virtual_address));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "sections[%i].virtual_size", &pe_paths.section_virtual_size));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype,
+      "sections[%i].raw_data_offset",
+      &pe_paths.section_raw_data_offset));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype,
+      "sections[%i].raw_data_size",
+      &pe_paths.section_raw_data_size));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "export_details[%i].name", &pe_paths.export_name));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "export_details[%i].ordinal", &pe_paths.export_ordinal));
+  FAIL_ON_ERROR(yr_object_path_compile(
+      prototype, "resources[%i].language", &pe_paths.resource_language));
+
+#if defined(HAVE_LIBCRYPTO)
+  // Not checking return value here because if it fails we will not parse the
+  // nested signature silently.
+  OBJ_create(SPC_NESTED_SIGNATURE_OBJID, NULL, NULL);
+#endif
+  return ERROR_SUCCESS;
+}
+
+int module_finalize(YR_MODULE* module)
+{
+  return ERROR_SUCCESS;
+}
+
+int module_load(
+    YR_SCAN_CONTEXT* context,
+    YR_OBJECT* module_object,
+    void* module_data,
+    size_t module_data_size)
+{
+  YR_MEMORY_BLOCK* block;
+  YR_MEMORY_BLOCK_ITERATOR* iterator = context->iterator;
+
+  PIMAGE_NT_HEADERS32 pe_header;
+  const uint8_t* block_data = NULL;
+  PE* pe = NULL;
 
   set_integer(0, module_object, "is_pe");
 
@@ -3968,24 +4518,22 @@ int module_load(
 
         pe->data = block_data;
         pe->data_size = block->size;
+        pe->base_address = block->base;
         pe->header = pe_header;
         pe->object = module_object;
         pe->resources = 0;
         pe->version_infos = 0;
+        pe->imported_dlls = NULL;
+        pe->delay_imported_dlls = NULL;
+        pe->imports_index = NULL;
+        pe->delay_imports_index = NULL;
+        pe->exports_index = NULL;
 
         module_object->data = pe;
 
+        // Resources, imports, exports, certificates and so on are parsed by
+        // the pe_load_* functions when a rule needs them.
         pe_parse_header(pe, block->base, context->flags);
-        pe_parse_rich_signature(pe, block->base);
-        pe_parse_debug_directory(pe);
-
-#if defined(HAVE_LIBCRYPTO) && !defined(BORINGSSL)
-        pe_parse_certificates(pe);
-#endif
-
-        pe->imported_dlls = pe_parse_imports(pe);
-        pe->delay_imported_dlls = pe_parse_delayed_imports(pe);
-        pe_parse_exports(pe);
 
         break;
       }
@@ -4035,6 +4583,15 @@ int module_unload(YR_OBJECT* module_object)
     yr_hash_table_destroy(
         pe->hash_table, (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_free);
 
+  if (pe->imports_index != NULL)
+    yr_hash_table_destroy(pe->imports_index, NULL);
+
+  if (pe->delay_imports_index != NULL)
+    yr_hash_table_destroy(pe->delay_imports_index, NULL);
+
+  if (pe->exports_index != NULL)
+    yr_hash_table_destroy(pe->exports_index, NULL);
+
   free_dlls(pe->imported_dlls);
   free_dlls(pe->delay_imported_dlls);
 
@@ -37,60 +37,69 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/error.h>
 #include <yara/exec.h>
 #include <yara/globals.h>
+#include <yara/hash.h>
 #include <yara/mem.h>
 #include <yara/object.h>
 #include <yara/utils.h>
 
+// Rounds up the size of each piece allocated by yr_object_copy_declarations
+// within its memory block, keeping all of them properly aligned.
+#define _YR_OBJECT_BLOCK_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+
+// Structures with at least this number of members have a hash table for
+// finding members by identifier, smaller ones are searched sequentially.
+#define _YR_OBJECT_MIN_HASHED_MEMBERS 16
+
 ////////////////////////////////////////////////////////////////////////////////
-// Creates a new object with the given type and identifier. If a parent is
-// specified the new object is owned by the parent and it will be destroyed when
-// the parent is destroyed. You must not call yr_object_destroy on an objected
-// that has a parent, you should destroy the parent instead.
+// Returns the size of the structure used for objects of the given type.
 //
-int yr_object_create(
-    int8_t type,
-    const char* identifier,
-    YR_OBJECT* parent,
-    YR_OBJECT** object)
+static size_t _yr_object_size(int8_t type)
 {
-  YR_OBJECT* obj;
-  size_t object_size = 0;
-
-  assert(parent != NULL || object != NULL);
-
   switch (type)
   {
   case OBJECT_TYPE_STRUCTURE:
-    object_size = sizeof(YR_OBJECT_STRUCTURE);
-    break;
+    return sizeof(YR_OBJECT_STRUCTURE);
   case OBJECT_TYPE_ARRAY:
-    object_size = sizeof(YR_OBJECT_ARRAY);
-    break;
+    return sizeof(YR_OBJECT_ARRAY);
   case OBJECT_TYPE_DICTIONARY:
-    object_size = sizeof(YR_OBJECT_DICTIONARY);
-    break;
+    return sizeof(YR_OBJECT_DICTIONARY);
   case OBJECT_TYPE_INTEGER:
-    object_size = sizeof(YR_OBJECT);
-    break;
   case OBJECT_TYPE_FLOAT:
-    object_size = sizeof(YR_OBJECT);
-    break;
   case OBJECT_TYPE_STRING:
-    object_size = sizeof(YR_OBJECT);
-    break;
+    return sizeof(YR_OBJECT);
   case OBJECT_TYPE_FUNCTION:
-    object_size = sizeof(YR_OBJECT_FUNCTION);
-    break;
+    return sizeof(YR_OBJECT_FUNCTION);
   default:
     assert(false);
   }
 
-  obj = (YR_OBJECT*) yr_malloc(object_size);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates a new object with the given type and identifier. If a parent is
+// specified the new object is owned by the parent and it will be destroyed when
+// the parent is destroyed. You must not call yr_object_destroy on an objected
+// that has a parent, you should destroy the parent instead.
+//
+int yr_object_create(
+    int8_t type,
+    const char* identifier,
+    YR_OBJECT* parent,
+    YR_OBJECT** object)
+{
+  YR_OBJECT* obj;
+
+  assert(parent != NULL || object != NULL);
+
+  obj = (YR_OBJECT*) yr_malloc(_yr_object_size(type));
 
   if (obj == NULL)
     return ERROR_INSUFFICIENT_MEMORY;
 
   obj->type = type;
+  obj->stage = 0;
+  obj->flags = 0;
   obj->identifier = yr_strdup(identifier);
   obj->parent = parent;
   obj->data = NULL;
@@ -108,6 +117,11 @@ int yr_object_create(
     break;
   case OBJECT_TYPE_STRUCTURE:
     object_as_structure(obj)->members = NULL;
+    object_as_structure(obj)->num_members = 0;
+    object_as_structure(obj)->members_capacity = 0;
+    object_as_structure(obj)->members_index = NULL;
+    object_as_structure(obj)->members_index_size = 0;
+    object_as_structure(obj)->stages = NULL;
     break;
   case OBJECT_TYPE_ARRAY:
     object_as_array(obj)->items = NULL;
@@ -123,6 +137,7 @@ int yr_object_create(
     {
       object_as_function(obj)->prototypes[i].arguments_fmt = NULL;
       object_as_function(obj)->prototypes[i].code = NULL;
+      object_as_function(obj)->prototypes[i].flags = 0;
     }
     break;
   }
@@ -183,6 +198,7 @@ int yr_object_function_create(
     const char* arguments_fmt,
     const char* return_fmt,
     YR_MODULE_FUNC code,
+    int flags,
     YR_OBJECT* parent,
     YR_OBJECT** function)
 {
@@ -237,6 +253,7 @@ int yr_object_function_create(
     {
       f->prototypes[i].arguments_fmt = arguments_fmt;
       f->prototypes[i].code = code;
+      f->prototypes[i].flags = flags;
 
       break;
     }
@@ -315,28 +332,36 @@ int yr_object_from_external_variable(
 // Destroy an objects, and any other object that is a child of it. For example,
 // destroying a struct will destroy all its members.
 //
+////////////////////////////////////////////////////////////////////////////////
+// Destroys an object and all its descendants. Objects in a tree created by
+// yr_object_copy_declarations are destroyed by destroying the tree's root,
+// which releases the memory block shared by all of them.
+//
 void yr_object_destroy(YR_OBJECT* object)
 {
-  YR_STRUCTURE_MEMBER* member;
-  YR_STRUCTURE_MEMBER* next_member;
   YR_ARRAY_ITEMS* array_items;
   YR_DICTIONARY_ITEMS* dict_items;
 
+  bool in_block;
+
   if (object == NULL)
     return;
 
+  in_block = (object->flags & OBJECT_FLAG_IN_BLOCK) != 0;
+
   switch (object->type)
   {
   case OBJECT_TYPE_STRUCTURE:
-    member = object_as_structure(object)->members;
+    for (int i = 0; i < object_as_structure(object)->num_members; i++)
+      yr_object_destroy(object_as_structure(object)->members[i]);
 
-    while (member != NULL)
+    if (!in_block)
     {
-      next_member = member->next;
-      yr_object_destroy(member->object);
-      yr_free(member);
-      member = next_member;
+      yr_free(object_as_structure(object)->members);
+      yr_free(object_as_structure(object)->members_index);
+      yr_free(object_as_structure(object)->stages);
     }
+
     break;
 
   case OBJECT_TYPE_STRING:
@@ -376,6 +401,8 @@ void yr_object_destroy(YR_OBJECT* object)
         if (dict_items->objects[i].obj != NULL)
           yr_object_destroy(dict_items->objects[i].obj);
       }
+
+      yr_free(dict_items->index);
     }
 
     yr_free(dict_items);
@@ -386,28 +413,128 @@ void yr_object_destroy(YR_OBJECT* object)
     break;
   }
 
-  yr_free((void*) object->identifier);
-  yr_free(object);
+  // Objects in a block share their identifiers with the objects they were
+  // copied from, and are freed all at once when the root is destroyed, the
+  // root being the only one without a parent and the first in the block.
+  if (!in_block)
+  {
+    yr_free((void*) object->identifier);
+    yr_free(object);
+  }
+  else if (object->parent == NULL)
+  {
+    yr_free(object);
+  }
 }
 
-YR_OBJECT* yr_object_lookup_field(YR_OBJECT* object, const char* field_name)
+////////////////////////////////////////////////////////////////////////////////
+// The hash tables used for finding structure members and dictionary items have
+// a power of two size and use linear probing. This returns the first slot to
+// probe for a given key in a table with the given size.
+//
+static uint32_t _yr_object_hash_slot(const char* key, int size)
+{
+  return yr_hash(0, key, strlen(key)) & (size - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds a member that will be put at the given position in the "members" array
+// of a structure to the structure's hash table, creating or growing the table
+// when needed. Does nothing if the structure is too small for having a table.
+//
+static int _yr_object_structure_index_member(
+    YR_OBJECT_STRUCTURE* structure,
+    YR_OBJECT* member,
+    int position)
 {
-  YR_STRUCTURE_MEMBER* member;
+  int size = structure->members_index_size;
+  uint32_t slot;
+
+  if (position + 1 < _YR_OBJECT_MIN_HASHED_MEMBERS)
+    return ERROR_SUCCESS;
+
+  // The table is kept at most half full, when it grows the existing members
+  // are put in a new table.
+  if (structure->members_index == NULL || 2 * (position + 1) > size)
+  {
+    int* index;
+
+    size = yr_max(size * 2, 4 * _YR_OBJECT_MIN_HASHED_MEMBERS);
+    index = (int*) yr_calloc(size, sizeof(int));
+
+    if (index == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    yr_free(structure->members_index);
+
+    structure->members_index = index;
+    structure->members_index_size = size;
+
+    for (int i = 0; i < position; i++)
+    {
+      slot = _yr_object_hash_slot(structure->members[i]->identifier, size);
+
+      while (index[slot] != 0) slot = (slot + 1) & (size - 1);
+
+      index[slot] = i + 1;
+    }
+  }
+
+  slot = _yr_object_hash_slot(member->identifier, size);
+
+  while (structure->members_index[slot] != 0) slot = (slot + 1) & (size - 1);
+
+  structure->members_index[slot] = position + 1;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the position of the member with the given identifier in the
+// "members" array of a structure, or -1 if the structure doesn't have it.
+//
+static int _yr_object_member_index(YR_OBJECT* object, const char* field_name)
+{
+  YR_OBJECT_STRUCTURE* structure = object_as_structure(object);
 
   assert(object != NULL);
   assert(object->type == OBJECT_TYPE_STRUCTURE);
 
-  member = object_as_structure(object)->members;
-
-  while (member != NULL)
+  if (structure->members_index != NULL)
   {
-    if (strcmp(member->object->identifier, field_name) == 0)
-      return member->object;
+    int size = structure->members_index_size;
+    uint32_t slot = _yr_object_hash_slot(field_name, size);
 
-    member = member->next;
+    while (structure->members_index[slot] != 0)
+    {
+      int i = structure->members_index[slot] - 1;
+
+      if (strcmp(structure->members[i]->identifier, field_name) == 0)
+        return i;
+
+      slot = (slot + 1) & (size - 1);
+    }
+
+    return -1;
   }
 
-  return NULL;
+  for (int i = structure->num_members - 1; i >= 0; i--)
+  {
+    if (strcmp(structure->members[i]->identifier, field_name) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+YR_OBJECT* yr_object_lookup_field(YR_OBJECT* object, const char* field_name)
+{
+  int i = _yr_object_member_index(object, field_name);
+
+  if (i < 0)
+    return NULL;
+
+  return object_as_structure(object)->members[i];
 }
 
 static YR_OBJECT* _yr_object_lookup(
@@ -445,6 +572,11 @@ static YR_OBJECT* _yr_object_lookup(
     if (obj == NULL)
       return NULL;
 
+    // Members in a parse stage must be loaded before reading them, but not
+    // before writing them, writes come from the module's loaders.
+    if (obj->stage != 0 && !(flags & OBJECT_CREATE))
+      yr_object_load_stage(obj);
+
     if (*p == '[')
     {
       p++;
@@ -531,12 +663,151 @@ YR_OBJECT* yr_object_lookup(
   return result;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Compiles a pattern like "sections[%i].name" into a YR_OBJECT_PATH, resolving
+// each identifier to the position of the member within its structure. The
+// pattern has the same syntax than in yr_object_lookup, except that indexes
+// and keys must be "%i" and "%s", their values are passed to
+// yr_object_path_lookup instead.
+//
+// Members have the same positions in every copy of a structure, so the path
+// can be compiled once with the module's declarations (see YR_MODULE) and then
+// used with the module's object in every scan.
+//
+int yr_object_path_compile(
+    YR_OBJECT* object,
+    const char* pattern,
+    YR_OBJECT_PATH* path)
+{
+  const char* p = pattern;
+
+  char str[256];
+
+  path->length = 0;
+
+  while (true)
+  {
+    int i = 0;
+    int member;
+
+    while (*p != '\0' && *p != '.' && *p != '[' && i < sizeof(str) - 1)
+    {
+      str[i++] = *p++;
+    }
+
+    str[i] = '\0';
+
+    if (object == NULL || object->type != OBJECT_TYPE_STRUCTURE)
+      return ERROR_INVALID_FIELD_NAME;
+
+    if (path->length == YR_MAX_OBJECT_PATH_LENGTH)
+      return ERROR_INVALID_FIELD_NAME;
+
+    member = _yr_object_member_index(object, str);
+
+    if (member < 0)
+      return ERROR_INVALID_FIELD_NAME;
+
+    object = object_as_structure(object)->members[member];
+
+    path->steps[path->length].member = member;
+    path->steps[path->length].subscript = 0;
+
+    if (*p == '[')
+    {
+      if (strncmp(p, "[%i]", 4) == 0 && object->type == OBJECT_TYPE_ARRAY)
+      {
+        path->steps[path->length].subscript = OBJECT_TYPE_ARRAY;
+        object = object_as_array(object)->prototype_item;
+      }
+      else if (
+          strncmp(p, "[%s]", 4) == 0 && object->type == OBJECT_TYPE_DICTIONARY)
+      {
+        path->steps[path->length].subscript = OBJECT_TYPE_DICTIONARY;
+        object = object_as_dictionary(object)->prototype_item;
+      }
+      else
+      {
+        return ERROR_INVALID_FORMAT;
+      }
+
+      p += 4;
+    }
+
+    path->length++;
+
+    if (*p == '\0')
+      break;
+
+    if (*p != '.')
+      return ERROR_INVALID_FORMAT;
+
+    p++;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+static YR_OBJECT* _yr_object_path_lookup(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    va_list args)
+{
+  for (int i = 0; i < path->length && object != NULL; i++)
+  {
+    assert(object->type == OBJECT_TYPE_STRUCTURE);
+    assert(path->steps[i].member < object_as_structure(object)->num_members);
+
+    object = object_as_structure(object)->members[path->steps[i].member];
+
+    if (object->stage != 0)
+      yr_object_load_stage(object);
+
+    switch (path->steps[i].subscript)
+    {
+    case OBJECT_TYPE_ARRAY:
+      object = yr_object_array_get_item(object, 0, va_arg(args, int));
+      break;
+
+    case OBJECT_TYPE_DICTIONARY:
+      object = yr_object_dict_get_item(object, 0, va_arg(args, const char*));
+      break;
+    }
+  }
+
+  return object;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the object reached by following a path compiled with
+// yr_object_path_compile, starting at the given object. Indexes and keys for
+// the "[%i]" and "[%s]" subscripts in the path are passed as additional
+// arguments. Returns NULL if some array item or dictionary key doesn't exist.
+//
+YR_OBJECT* yr_object_path_lookup(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    ...)
+{
+  YR_OBJECT* result;
+
+  va_list args;
+  va_start(args, path);
+
+  result = _yr_object_path_lookup(object, path, args);
+
+  va_end(args);
+
+  return result;
+}
+
 int yr_object_copy(YR_OBJECT* object, YR_OBJECT** object_copy)
 {
   YR_OBJECT* copy;
   YR_OBJECT* o;
 
-  YR_STRUCTURE_MEMBER* structure_member;
+  YR_OBJECT_STRUCTURE* structure;
+  YR_OBJECT_STRUCTURE* structure_copy;
 
   *object_copy = NULL;
 
@@ -581,20 +852,53 @@ int yr_object_copy(YR_OBJECT* object, YR_OBJECT** object_copy)
 
   case OBJECT_TYPE_STRUCTURE:
 
-    structure_member = object_as_structure(object)->members;
+    structure = object_as_structure(object);
+    structure_copy = object_as_structure(copy);
+
+    if (structure->num_members == 0)
+      break;
+
+    structure_copy->members = (YR_OBJECT**) yr_malloc(
+        structure->num_members * sizeof(YR_OBJECT*));
 
-    while (structure_member != NULL)
+    if (structure_copy->members == NULL)
+    {
+      yr_object_destroy(copy);
+      return ERROR_INSUFFICIENT_MEMORY;
+    }
+
+    structure_copy->members_capacity = structure->num_members;
+
+    // Members are copied to the same positions they have in the original
+    // structure, which yr_object_path_lookup relies on. The identifiers are
+    // known to be unique, there's no need for yr_object_structure_set_member.
+    for (int i = 0; i < structure->num_members; i++)
     {
       FAIL_ON_ERROR_WITH_CLEANUP(
-          yr_object_copy(structure_member->object, &o),
-          yr_object_destroy(copy));
+          yr_object_copy(structure->members[i], &o), yr_object_destroy(copy));
+
+      o->parent = copy;
+      structure_copy->members[structure_copy->num_members++] = o;
+    }
 
-      FAIL_ON_ERROR_WITH_CLEANUP(yr_object_structure_set_member(copy, o),
-                                 // cleanup
-                                 yr_free(o);
-                                 yr_object_destroy(copy));
+    // As positions are the same, the hash table is the same too.
+    if (structure->members_index != NULL)
+    {
+      structure_copy->members_index = (int*) yr_malloc(
+          structure->members_index_size * sizeof(int));
 
-      structure_member = structure_member->next;
+      if (structure_copy->members_index == NULL)
+      {
+        yr_object_destroy(copy);
+        return ERROR_INSUFFICIENT_MEMORY;
+      }
+
+      memcpy(
+          structure_copy->members_index,
+          structure->members_index,
+          structure->members_index_size * sizeof(int));
+
+      structure_copy->members_index_size = structure->members_index_size;
     }
 
     break;
@@ -630,29 +934,297 @@ int yr_object_copy(YR_OBJECT* object, YR_OBJECT** object_copy)
 
 int yr_object_structure_set_member(YR_OBJECT* object, YR_OBJECT* member)
 {
-  YR_STRUCTURE_MEMBER* sm;
+  YR_OBJECT_STRUCTURE* structure = object_as_structure(object);
 
   assert(object->type == OBJECT_TYPE_STRUCTURE);
+  assert(!(object->flags & OBJECT_FLAG_IN_BLOCK));
 
   // Check if the object already have a member with the same identifier
 
   if (yr_object_lookup_field(object, member->identifier) != NULL)
     return ERROR_DUPLICATED_STRUCTURE_MEMBER;
 
-  sm = (YR_STRUCTURE_MEMBER*) yr_malloc(sizeof(YR_STRUCTURE_MEMBER));
+  if (structure->num_members == structure->members_capacity)
+  {
+    int capacity = yr_max(8, structure->members_capacity * 2);
 
-  if (sm == NULL)
-    return ERROR_INSUFFICIENT_MEMORY;
+    YR_OBJECT** members = (YR_OBJECT**) yr_realloc(
+        structure->members, capacity * sizeof(YR_OBJECT*));
+
+    if (members == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    structure->members = members;
+    structure->members_capacity = capacity;
+  }
+
+  FAIL_ON_ERROR(_yr_object_structure_index_member(
+      structure, member, structure->num_members));
 
   member->parent = object;
-  sm->object = member;
-  sm->next = object_as_structure(object)->members;
+  structure->members[structure->num_members++] = member;
 
-  object_as_structure(object)->members = sm;
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the number of bytes needed by yr_object_copy_declarations for
+// copying the given object and its descendants.
+//
+static size_t _yr_object_declarations_size(YR_OBJECT* object)
+{
+  YR_OBJECT_STRUCTURE* structure;
+  YR_STRUCTURE_STAGE* stages;
+
+  size_t size = _YR_OBJECT_BLOCK_ALIGN(_yr_object_size(object->type));
+
+  switch (object->type)
+  {
+  case OBJECT_TYPE_STRUCTURE:
+    structure = object_as_structure(object);
+
+    size += _YR_OBJECT_BLOCK_ALIGN(structure->num_members * sizeof(YR_OBJECT*));
+
+    for (int i = 0; i < structure->num_members; i++)
+      size += _yr_object_declarations_size(structure->members[i]);
+
+    stages = structure->stages;
+
+    if (stages != NULL)
+    {
+      int num_stages = 0;
+
+      while (stages[num_stages].load != NULL) num_stages++;
+
+      size += _YR_OBJECT_BLOCK_ALIGN(
+          (num_stages + 1) * sizeof(YR_STRUCTURE_STAGE));
+    }
+    break;
+
+  case OBJECT_TYPE_ARRAY:
+    size += _yr_object_declarations_size(
+        object_as_array(object)->prototype_item);
+    break;
+
+  case OBJECT_TYPE_DICTIONARY:
+    size += _yr_object_declarations_size(
+        object_as_dictionary(object)->prototype_item);
+    break;
+
+  case OBJECT_TYPE_FUNCTION:
+    size += _yr_object_declarations_size(
+        object_as_function(object)->return_obj);
+    break;
+  }
+
+  return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Copies an object and its descendants into the memory pointed to by *block,
+// advancing *block past the used memory. See yr_object_copy_declarations.
+//
+static YR_OBJECT* _yr_object_copy_declarations(
+    YR_OBJECT* object,
+    YR_OBJECT* parent,
+    int canary,
+    uint8_t** block)
+{
+  YR_OBJECT* copy = (YR_OBJECT*) *block;
+  YR_OBJECT_STRUCTURE* structure;
+  YR_OBJECT_STRUCTURE* structure_copy;
+  YR_STRUCTURE_STAGE* stages;
+
+  size_t object_size = _yr_object_size(object->type);
+
+  *block += _YR_OBJECT_BLOCK_ALIGN(object_size);
+
+  // This copies the type, stage and identifier, as well as the function
+  // prototypes and the values of integers and floats. Declarations can set
+  // the values of constants, but strings must be undefined.
+  memcpy(copy, object, object_size);
+
+  copy->canary = canary;
+  copy->flags = OBJECT_FLAG_IN_BLOCK;
+  copy->parent = parent;
+  copy->data = NULL;
+
+  switch (object->type)
+  {
+  case OBJECT_TYPE_STRING:
+    assert(object->value.ss == NULL);
+    break;
+
+  case OBJECT_TYPE_STRUCTURE:
+    structure = object_as_structure(object);
+    structure_copy = object_as_structure(copy);
+
+    // Members keep their positions, see yr_object_path_lookup. This also
+    // means that the copy can share the hash table of the original structure,
+    // if any, which memcpy already copied.
+    structure_copy->members = NULL;
+    structure_copy->members_capacity = structure->num_members;
+
+    if (structure->num_members > 0)
+    {
+      structure_copy->members = (YR_OBJECT**) *block;
+      *block += _YR_OBJECT_BLOCK_ALIGN(
+          structure->num_members * sizeof(YR_OBJECT*));
+    }
+
+    for (int i = 0; i < structure->num_members; i++)
+    {
+      structure_copy->members[i] = _yr_object_copy_declarations(
+          structure->members[i], copy, canary, block);
+    }
+
+    stages = structure->stages;
+
+    if (stages != NULL)
+    {
+      int num_stages = 0;
+
+      while (stages[num_stages].load != NULL) num_stages++;
+
+      object_as_structure(copy)->stages = (YR_STRUCTURE_STAGE*) *block;
+
+      // Copy the stages, including the terminating one, none of them has been
+      // loaded in the copy.
+      for (int i = 0; i <= num_stages; i++)
+      {
+        object_as_structure(copy)->stages[i].load = stages[i].load;
+        object_as_structure(copy)->stages[i].loaded = false;
+      }
+
+      *block += _YR_OBJECT_BLOCK_ALIGN(
+          (num_stages + 1) * sizeof(YR_STRUCTURE_STAGE));
+    }
+    break;
+
+  case OBJECT_TYPE_ARRAY:
+    assert(object_as_array(object)->items == NULL);
+    object_as_array(copy)->prototype_item = _yr_object_copy_declarations(
+        object_as_array(object)->prototype_item, copy, canary, block);
+    break;
+
+  case OBJECT_TYPE_DICTIONARY:
+    assert(object_as_dictionary(object)->items == NULL);
+    object_as_dictionary(copy)->prototype_item = _yr_object_copy_declarations(
+        object_as_dictionary(object)->prototype_item, copy, canary, block);
+    break;
+
+  case OBJECT_TYPE_FUNCTION:
+    object_as_function(copy)->return_obj = _yr_object_copy_declarations(
+        object_as_function(object)->return_obj, copy, canary, block);
+    break;
+  }
+
+  return copy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates a copy of an object tree built by a module's declarations, before
+// any value is assigned to it. Unlike yr_object_copy, which allocates each
+// object separately, all the objects in the copy are allocated in a single
+// memory block, and they share their identifiers with the original objects,
+// so the original tree must outlive the copy. Integer and float values set by
+// the declarations are copied too. All objects in the copy get the given
+// canary. The copy is destroyed with yr_object_destroy as usual, items
+// added later to arrays and dictionaries in the copy are allocated and freed
+// separately. Structures in the copy don't accept new members.
+//
+int yr_object_copy_declarations(
+    YR_OBJECT* object,
+    int canary,
+    YR_OBJECT** object_copy)
+{
+  uint8_t* block;
+
+  assert(object->parent == NULL);
+
+  block = (uint8_t*) yr_malloc(_yr_object_declarations_size(object));
+
+  if (block == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  *object_copy = _yr_object_copy_declarations(object, NULL, canary, &block);
 
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Puts the members of a structure starting at position "first_member" in a
+// parse stage.
+// The values of those members are not filled in by the module's load function,
+// instead "load" is called the first time one of them is read with
+// yr_object_lookup (or get_integer, get_string, etc) or by a rule's condition.
+// Members put in a stage in different calls with the same "load" function
+// belong to the same stage, this allows a stage to include members that are
+// not declared together.
+//
+int yr_object_structure_add_stage(
+    YR_OBJECT* object,
+    int first_member,
+    YR_STAGE_FUNC load)
+{
+  YR_OBJECT_STRUCTURE* structure = object_as_structure(object);
+  YR_STRUCTURE_STAGE* stages = structure->stages;
+
+  int i = 0;
+
+  assert(object->type == OBJECT_TYPE_STRUCTURE);
+
+  while (stages != NULL && stages[i].load != NULL && stages[i].load != load)
+    i++;
+
+  if (stages == NULL || stages[i].load == NULL)
+  {
+    // The index of the stage is stored in an uint8_t, plus one.
+    if (i >= UINT8_MAX)
+      return ERROR_INTERNAL_FATAL_ERROR;
+
+    stages = (YR_STRUCTURE_STAGE*) yr_realloc(
+        stages, (i + 2) * sizeof(YR_STRUCTURE_STAGE));
+
+    if (stages == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    stages[i].load = load;
+    stages[i].loaded = false;
+    stages[i + 1].load = NULL;
+
+    structure->stages = stages;
+  }
+
+  for (int j = first_member; j < structure->num_members; j++)
+    structure->members[j]->stage = (uint8_t) (i + 1);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Calls the load function for the parse stage that a structure member belongs
+// to, if it wasn't called before. Does nothing for members that are not in a
+// stage.
+//
+void yr_object_load_stage(YR_OBJECT* object)
+{
+  YR_STRUCTURE_STAGE* stage;
+
+  if (object->stage == 0)
+    return;
+
+  stage = &object_as_structure(object->parent)->stages[object->stage - 1];
+
+  if (!stage->loaded)
+  {
+    // Flag the stage as loaded before calling the load function, so that it
+    // can read members of its own stage without being called again.
+    stage->loaded = true;
+    stage->load(yr_object_get_root(object));
+  }
+}
+
 int yr_object_array_length(YR_OBJECT* object)
 {
   YR_OBJECT_ARRAY* array;
@@ -747,6 +1319,25 @@ int yr_object_array_set_item(YR_OBJECT* object, YR_OBJECT* item, int index)
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Returns the slot in the hash table of a dictionary that points to the last
+// item with the given key, or the empty slot where it would be if the
+// dictionary doesn't have the key.
+//
+static int* _yr_object_dict_slot(YR_DICTIONARY_ITEMS* items, const char* key)
+{
+  int size = 2 * (items->used + items->free);
+  uint32_t slot = _yr_object_hash_slot(key, size);
+
+  while (items->index[slot] != 0 &&
+         strcmp(items->objects[items->index[slot] - 1].key->c_string, key) != 0)
+  {
+    slot = (slot + 1) & (size - 1);
+  }
+
+  return &items->index[slot];
+}
+
 YR_OBJECT* yr_object_dict_get_item(
     YR_OBJECT* object,
     int flags,
@@ -761,11 +1352,10 @@ YR_OBJECT* yr_object_dict_get_item(
 
   if (dict->items != NULL)
   {
-    for (int i = 0; i < dict->items->used; i++)
-    {
-      if (strcmp(dict->items->objects[i].key->c_string, key) == 0)
-        result = dict->items->objects[i].obj;
-    }
+    int position = *_yr_object_dict_slot(dict->items, key);
+
+    if (position != 0)
+      result = dict->items->objects[position - 1].obj;
   }
 
   if (result == NULL && flags & OBJECT_CREATE)
@@ -784,6 +1374,7 @@ int yr_object_dict_set_item(YR_OBJECT* object, YR_OBJECT* item, const char* key)
   YR_OBJECT_DICTIONARY* dict;
 
   int count;
+  int* index;
 
   assert(object->type == OBJECT_TYPE_DICTIONARY);
 
@@ -799,6 +1390,15 @@ int yr_object_dict_set_item(YR_OBJECT* object, YR_OBJECT* item, const char* key)
     if (dict->items == NULL)
       return ERROR_INSUFFICIENT_MEMORY;
 
+    dict->items->index = (int*) yr_calloc(2 * count, sizeof(int));
+
+    if (dict->items->index == NULL)
+    {
+      yr_free(dict->items);
+      dict->items = NULL;
+      return ERROR_INSUFFICIENT_MEMORY;
+    }
+
     memset(dict->items->objects, 0, count * sizeof(dict->items->objects[0]));
 
     dict->items->free = count;
@@ -806,13 +1406,25 @@ int yr_object_dict_set_item(YR_OBJECT* object, YR_OBJECT* item, const char* key)
   }
   else if (dict->items->free == 0)
   {
+    YR_DICTIONARY_ITEMS* items;
+
     count = dict->items->used * 2;
-    dict->items = (YR_DICTIONARY_ITEMS*) yr_realloc(
+    index = (int*) yr_calloc(2 * count, sizeof(int));
+
+    if (index == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    items = (YR_DICTIONARY_ITEMS*) yr_realloc(
         dict->items,
         sizeof(YR_DICTIONARY_ITEMS) + count * sizeof(dict->items->objects[0]));
 
-    if (dict->items == NULL)
+    if (items == NULL)
+    {
+      yr_free(index);
       return ERROR_INSUFFICIENT_MEMORY;
+    }
+
+    dict->items = items;
 
     for (int i = dict->items->used; i < count; i++)
     {
@@ -820,7 +1432,16 @@ int yr_object_dict_set_item(YR_OBJECT* object, YR_OBJECT* item, const char* key)
       dict->items->objects[i].obj = NULL;
     }
 
+    yr_free(dict->items->index);
+
+    dict->items->index = index;
     dict->items->free = dict->items->used;
+
+    // Existing items are inserted in order, so that duplicate keys end up
+    // pointing to the last item, like in the table being replaced.
+    for (int i = 0; i < dict->items->used; i++)
+      *_yr_object_dict_slot(dict->items, dict->items->objects[i].key->c_string) =
+          i + 1;
   }
 
   item->parent = object;
@@ -828,6 +1449,8 @@ int yr_object_dict_set_item(YR_OBJECT* object, YR_OBJECT* item, const char* key)
   dict->items->objects[dict->items->used].key = ss_new(key);
   dict->items->objects[dict->items->used].obj = item;
 
+  *_yr_object_dict_slot(dict->items, key) = dict->items->used + 1;
+
   dict->items->used++;
   dict->items->free--;
 
@@ -939,6 +1562,72 @@ SIZED_STRING* yr_object_get_string(YR_OBJECT* object, const char* field, ...)
   return string_obj->value.ss;
 }
 
+int64_t yr_object_path_get_integer(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    ...)
+{
+  YR_OBJECT* integer_obj;
+
+  va_list args;
+  va_start(args, path);
+
+  integer_obj = _yr_object_path_lookup(object, path, args);
+
+  va_end(args);
+
+  if (integer_obj == NULL)
+    return YR_UNDEFINED;
+
+  assert(integer_obj->type == OBJECT_TYPE_INTEGER);
+
+  return integer_obj->value.i;
+}
+
+double yr_object_path_get_float(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    ...)
+{
+  YR_OBJECT* double_obj;
+
+  va_list args;
+  va_start(args, path);
+
+  double_obj = _yr_object_path_lookup(object, path, args);
+
+  va_end(args);
+
+  if (double_obj == NULL)
+    return NAN;
+
+  assert(double_obj->type == OBJECT_TYPE_FLOAT);
+
+  return double_obj->value.d;
+}
+
+SIZED_STRING* yr_object_path_get_string(
+    YR_OBJECT* object,
+    const YR_OBJECT_PATH* path,
+    ...)
+{
+  YR_OBJECT* string_obj;
+
+  va_list args;
+  va_start(args, path);
+
+  string_obj = _yr_object_path_lookup(object, path, args);
+
+  va_end(args);
+
+  if (string_obj == NULL)
+    return NULL;
+
+  assert(string_obj->type == OBJECT_TYPE_STRING);
+
+  return string_obj->value.ss;
+}
+
 int yr_object_set_integer(
     int64_t value,
     YR_OBJECT* object,
@@ -1070,7 +1759,7 @@ YR_API void yr_object_print_data(
     int print_identifier)
 {
   YR_DICTIONARY_ITEMS* dict_items;
-  YR_STRUCTURE_MEMBER* member;
+  YR_OBJECT* member;
 
   char indent_spaces[32];
 
@@ -1128,16 +1817,16 @@ YR_API void yr_object_print_data(
 
   case OBJECT_TYPE_STRUCTURE:
 
-    member = object_as_structure(object)->members;
-
-    while (member != NULL)
+    for (int i = 0; i < object_as_structure(object)->num_members; i++)
     {
-      if (member->object->type != OBJECT_TYPE_FUNCTION)
+      member = object_as_structure(object)->members[i];
+
+      if (member->type != OBJECT_TYPE_FUNCTION)
       {
+        yr_object_load_stage(member);
         printf("\n");
-        yr_object_print_data(member->object, indent + 1, 1);
+        yr_object_print_data(member, indent + 1, 1);
       }
-      member = member->next;
     }
 
     break;
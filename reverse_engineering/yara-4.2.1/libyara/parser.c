@@ -48,11 +48,70 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   ((x) >= 'A' && (x) <= 'F') ? ((uint8_t) (x - 'A' + 10)) \
                              : ((uint8_t) (x - '0'))
 
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if the result of the given instruction depends only on its
+// operands, the scanned data and the data's size. Conditions made only of
+// such instructions can be evaluated before scanning the data, see
+// yr_parser_reduce_rule_declaration_phase_2. Loops are not included, which
+// guarantees that the guards are evaluated in linear time.
+//
+static bool _yr_parser_is_guard_instruction(uint8_t instruction)
+{
+  switch (instruction)
+  {
+  case OP_NOP:
+  case OP_AND:
+  case OP_OR:
+  case OP_NOT:
+  case OP_DEFINED:
+  case OP_BITWISE_NOT:
+  case OP_BITWISE_AND:
+  case OP_BITWISE_OR:
+  case OP_BITWISE_XOR:
+  case OP_SHL:
+  case OP_SHR:
+  case OP_MOD:
+  case OP_INT_TO_DBL:
+  case OP_PUSH:
+  case OP_PUSH_8:
+  case OP_PUSH_16:
+  case OP_PUSH_32:
+  case OP_PUSH_U:
+  case OP_JFALSE:
+  case OP_JTRUE:
+  case OP_FILESIZE:
+    return true;
+  }
+
+  return IS_INT_OP(instruction) || IS_DBL_OP(instruction) ||
+         (instruction >= OP_INT8 && instruction <= OP_UINT32BE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Must be called before emitting each instruction of a rule's condition. If
+// the instruction can't be part of a guard and it's the first one of its kind
+// in the condition, its offset is recorded in scan_dependent_offset.
+//
+static void _yr_parser_track_instruction(
+    YR_COMPILER* compiler,
+    bool guard_instruction)
+{
+  if (!guard_instruction && compiler->current_rule_idx != UINT32_MAX &&
+      compiler->scan_dependent_offset == UINT32_MAX)
+  {
+    compiler->scan_dependent_offset = yr_arena_get_current_offset(
+        compiler->arena, YR_CODE_SECTION);
+  }
+}
+
 int yr_parser_emit(
     yyscan_t yyscanner,
     uint8_t instruction,
     YR_ARENA_REF* instruction_ref)
 {
+  _yr_parser_track_instruction(
+      yyget_extra(yyscanner), _yr_parser_is_guard_instruction(instruction));
+
   return yr_arena_write_data(
       yyget_extra(yyscanner)->arena,
       YR_CODE_SECTION,
@@ -68,6 +127,9 @@ int yr_parser_emit_with_arg_double(
     YR_ARENA_REF* instruction_ref,
     YR_ARENA_REF* argument_ref)
 {
+  _yr_parser_track_instruction(
+      yyget_extra(yyscanner), _yr_parser_is_guard_instruction(instruction));
+
   int result = yr_arena_write_data(
       yyget_extra(yyscanner)->arena,
       YR_CODE_SECTION,
@@ -93,6 +155,9 @@ int yr_parser_emit_with_arg_int32(
     YR_ARENA_REF* instruction_ref,
     YR_ARENA_REF* argument_ref)
 {
+  _yr_parser_track_instruction(
+      yyget_extra(yyscanner), _yr_parser_is_guard_instruction(instruction));
+
   int result = yr_arena_write_data(
       yyget_extra(yyscanner)->arena,
       YR_CODE_SECTION,
@@ -118,6 +183,11 @@ int yr_parser_emit_with_arg(
     YR_ARENA_REF* instruction_ref,
     YR_ARENA_REF* argument_ref)
 {
+  YR_ARENA_REF ref = YR_ARENA_NULL_REF;
+
+  _yr_parser_track_instruction(
+      yyget_extra(yyscanner), _yr_parser_is_guard_instruction(instruction));
+
   int result = yr_arena_write_data(
       yyget_extra(yyscanner)->arena,
       YR_CODE_SECTION,
@@ -131,7 +201,15 @@ int yr_parser_emit_with_arg(
         YR_CODE_SECTION,
         &argument,
         sizeof(int64_t),
-        argument_ref);
+        &ref);
+
+  if (result == ERROR_SUCCESS &&
+      (instruction == OP_PUSH_RULE || instruction == OP_MATCH_RULE))
+    result = _yr_compiler_add_rule_idx_location(
+        yyget_extra(yyscanner), &ref, sizeof(int64_t));
+
+  if (argument_ref != NULL)
+    *argument_ref = ref;
 
   return result;
 }
@@ -150,6 +228,10 @@ int yr_parser_emit_with_arg_reloc(
   memset(&arg, 0, sizeof(arg));
   arg.ptr = argument;
 
+  // Guards are copied to YR_GUARD_CODE_SECTION without their relocations,
+  // so instructions with pointers can't be part of them.
+  _yr_parser_track_instruction(yyget_extra(yyscanner), false);
+
   int result = yr_arena_write_data(
       yyget_extra(yyscanner)->arena,
       YR_CODE_SECTION,
@@ -324,10 +406,134 @@ int yr_parser_emit_push_const(yyscan_t yyscanner, uint64_t argument)
       yyget_extra(yyscanner)->arena, YR_CODE_SECTION, buf, bufsz, NULL);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Writes the full identifier of an object, like "pe.rich_signature.toolid",
+// into buffer. Objects without identifier, like array items, are skipped.
+//
+static void _yr_parser_object_full_identifier(
+    YR_OBJECT* object,
+    char* buffer,
+    size_t buffer_size)
+{
+  if (object->parent != NULL)
+  {
+    _yr_parser_object_full_identifier(object->parent, buffer, buffer_size);
+
+    if (buffer[0] != '\0' && object->identifier != NULL)
+      strlcat(buffer, ".", buffer_size);
+  }
+  else
+  {
+    buffer[0] = '\0';
+  }
+
+  if (object->identifier != NULL)
+    strlcat(buffer, object->identifier, buffer_size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds the function's prototype to the list of module functions called by the
+// rules if it isn't already there. See YR_SUMMARY.
+//
+static int _yr_parser_add_called_function(
+    YR_COMPILER* compiler,
+    YR_OBJECT_FUNCTION* function,
+    int32_t prototype_idx)
+{
+  char identifier[256];
+
+  _yr_parser_object_full_identifier(
+      (YR_OBJECT*) function, identifier, sizeof(identifier));
+
+  strlcat(identifier, "(", sizeof(identifier));
+  strlcat(
+      identifier,
+      function->prototypes[prototype_idx].arguments_fmt,
+      sizeof(identifier));
+  strlcat(identifier, ")", sizeof(identifier));
+
+  return _yr_compiler_add_called_function(compiler, identifier);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Emits an OP_CALL instruction. The instruction is followed by two int32_t
+// arguments: the number of arguments passed to the function and the index
+// of the prototype that must be called, as returned by yr_parser_check_types.
+// With the overload resolved at compile time, the executor doesn't need to
+// compare argument formats while scanning. The function is also added to the
+// list of functions called by the rules.
+//
+int yr_parser_emit_call(
+    yyscan_t yyscanner,
+    YR_OBJECT_FUNCTION* function,
+    const char* args_fmt,
+    int32_t prototype_idx)
+{
+  YR_COMPILER* compiler = yyget_extra(yyscanner);
+
+  uint8_t buf[1 + 2 * sizeof(int32_t)];
+  int32_t num_args = (int32_t) strlen(args_fmt);
+
+  FAIL_ON_ERROR(
+      _yr_parser_add_called_function(compiler, function, prototype_idx));
+
+  _yr_parser_track_instruction(compiler, false);
+
+  buf[0] = OP_CALL;
+  memcpy(buf + 1, &num_args, sizeof(num_args));
+  memcpy(buf + 1 + sizeof(num_args), &prototype_idx, sizeof(prototype_idx));
+
+  return yr_arena_write_data(
+      compiler->arena, YR_CODE_SECTION, buf, sizeof(buf), NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Emits the OP_AND instruction for an "and" operator whose left operand is
+// followed by the OP_JFALSE instruction whose argument is "jfalse_arg_ref".
+// Both instructions are recorded in compiler->condition_ands, which is used
+// for finding the rule's guard in yr_parser_reduce_rule_declaration_phase_2.
+//
+int yr_parser_emit_and(yyscan_t yyscanner, YR_ARENA_REF* jfalse_arg_ref)
+{
+  YR_COMPILER* compiler = yyget_extra(yyscanner);
+
+  if (compiler->num_condition_ands == compiler->max_condition_ands)
+  {
+    uint32_t max = compiler->max_condition_ands == 0
+                       ? 64
+                       : compiler->max_condition_ands * 2;
+
+    YR_CONDITION_AND* condition_ands = (YR_CONDITION_AND*) yr_realloc(
+        compiler->condition_ands, max * sizeof(YR_CONDITION_AND));
+
+    if (condition_ands == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    compiler->condition_ands = condition_ands;
+    compiler->max_condition_ands = max;
+  }
+
+  YR_CONDITION_AND* condition_and =
+      &compiler->condition_ands[compiler->num_condition_ands++];
+
+  // The opcode is right before the jump's argument.
+  condition_and->jfalse_offset = jfalse_arg_ref->offset - 1;
+  condition_and->and_offset = yr_arena_get_current_offset(
+      compiler->arena, YR_CODE_SECTION);
+
+  return yr_parser_emit(yyscanner, OP_AND, NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Checks that the arguments described by actual_args_fmt match one of the
+// prototypes of the given function. If that's the case, the index of the
+// matching prototype is stored in *prototype_idx.
+//
 int yr_parser_check_types(
     YR_COMPILER* compiler,
     YR_OBJECT_FUNCTION* function,
-    const char* actual_args_fmt)
+    const char* actual_args_fmt,
+    int32_t* prototype_idx)
 {
   int i;
 
@@ -337,7 +543,10 @@ int yr_parser_check_types(
       break;
 
     if (strcmp(function->prototypes[i].arguments_fmt, actual_args_fmt) == 0)
+    {
+      *prototype_idx = i;
       return ERROR_SUCCESS;
+    }
   }
 
   yr_compiler_set_error_extra_info(compiler, function->identifier)
@@ -536,13 +745,18 @@ static int _yr_parser_write_string(
 
   if (result == ERROR_SUCCESS)
   {
-    // Add the string to Aho-Corasick automaton.
-    result = yr_ac_add_string(
-        compiler->automaton,
-        string,
-        compiler->current_string_idx,
-        atom_list,
-        compiler->arena);
+    // Add the string to Aho-Corasick automaton. With a cache the automaton
+    // is built by the cache when the rules are compiled.
+    if (compiler->cache != NULL)
+      result = _yr_compiler_cache_add_string(
+          compiler, compiler->current_string_idx, atom_list);
+    else
+      result = yr_ac_add_string(
+          compiler->automaton,
+          string,
+          compiler->current_string_idx,
+          atom_list,
+          compiler->arena);
   }
 
   if (modifier.flags & STRING_FLAGS_LITERAL)
@@ -1003,12 +1217,17 @@ int yr_parser_reduce_rule_declaration_phase_1(
   FAIL_ON_ERROR(yr_parser_emit_with_arg_int32(
       yyscanner, OP_INIT_RULE, 0, NULL, &jmp_offset_ref));
 
+  YR_ARENA_REF rule_idx_ref;
+
   FAIL_ON_ERROR(yr_arena_write_data(
       compiler->arena,
       YR_CODE_SECTION,
       &compiler->current_rule_idx,
       sizeof(compiler->current_rule_idx),
-      NULL));
+      &rule_idx_ref));
+
+  FAIL_ON_ERROR(_yr_compiler_add_rule_idx_location(
+      compiler, &rule_idx_ref, sizeof(compiler->current_rule_idx)));
 
   // Create a fixup entry for the jump and push it in the stack
   fixup = (YR_FIXUP*) yr_malloc(sizeof(YR_FIXUP));
@@ -1020,7 +1239,14 @@ int yr_parser_reduce_rule_declaration_phase_1(
   fixup->next = compiler->fixup_stack_head;
   compiler->fixup_stack_head = fixup;
 
-  // Clean strings_table as we are starting to parse a new rule.
+  // The rule's condition starts here.
+  compiler->condition_offset = yr_arena_get_current_offset(
+      compiler->arena, YR_CODE_SECTION);
+  compiler->scan_dependent_offset = UINT32_MAX;
+  compiler->num_condition_ands = 0;
+
+  // Clean strings_table as we are starting to parse a new rule. It's usually
+  // empty already, see yr_parser_reduce_rule_declaration_phase_2.
   yr_hash_table_clean(compiler->strings_table, NULL);
 
   FAIL_ON_ERROR(yr_hash_table_add_uint32(
@@ -1029,6 +1255,89 @@ int yr_parser_reduce_rule_declaration_phase_1(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Finds the guard for the rule being parsed, if any, and writes it into the
+// YR_GUARD_CODE_SECTION. The guard is the longest part of the condition that
+// can be evaluated before scanning the data, and such that the whole condition
+// is false if the guard is false. If the condition is "A and B and C" and
+// both A and B use only guard instructions, the guard is "A and B".
+//
+// With left associativity the condition is parsed as ((A and B) and C), so
+// the topmost "and" operators form a chain where each one is the left operand
+// of the next. The chain is followed from the last instruction of the
+// condition towards its start, looking for the first "and" whose left operand
+// doesn't contain any instruction that depends on the scan. This operand
+// always starts at the beginning of the condition, and ends right before the
+// corresponding OP_JFALSE.
+//
+// In the guard code the guard is followed by an OP_GUARD_RULE instruction
+// that disables the rule's strings if the guard is not true. The rule's
+// condition is not modified, and still produces the same result.
+//
+static int _yr_parser_emit_guard(YR_COMPILER* compiler, YR_RULE* rule)
+{
+  yr_arena_off_t guard_end = compiler->condition_offset;
+  yr_arena_off_t and_offset = yr_arena_get_current_offset(
+                                  compiler->arena, YR_CODE_SECTION) -
+                              1;
+
+  // Guards are useful only for rules with strings.
+  if (rule->strings == NULL)
+    return ERROR_SUCCESS;
+
+  for (uint32_t i = compiler->num_condition_ands; i > 0; i--)
+  {
+    YR_CONDITION_AND* condition_and = &compiler->condition_ands[i - 1];
+
+    // Entries are ordered by and_offset, those that are not in the chain
+    // are simply skipped.
+    if (condition_and->and_offset != and_offset)
+      continue;
+
+    if (condition_and->jfalse_offset <= compiler->scan_dependent_offset)
+    {
+      guard_end = condition_and->jfalse_offset;
+      break;
+    }
+
+    // The left operand of this "and" could be another "and".
+    and_offset = condition_and->jfalse_offset - 1;
+  }
+
+  if (guard_end == compiler->condition_offset)
+    return ERROR_SUCCESS;
+
+  const uint8_t* guard = (const uint8_t*) yr_arena_get_ptr(
+      compiler->arena, YR_CODE_SECTION, compiler->condition_offset);
+
+  uint8_t guard_rule[1 + sizeof(uint64_t)];
+  uint64_t rule_idx = compiler->current_rule_idx;
+
+  guard_rule[0] = OP_GUARD_RULE;
+  memcpy(guard_rule + 1, &rule_idx, sizeof(rule_idx));
+
+  FAIL_ON_ERROR(yr_arena_write_data(
+      compiler->arena,
+      YR_GUARD_CODE_SECTION,
+      guard,
+      guard_end - compiler->condition_offset,
+      NULL));
+
+  YR_ARENA_REF ref;
+
+  FAIL_ON_ERROR(yr_arena_write_data(
+      compiler->arena,
+      YR_GUARD_CODE_SECTION,
+      guard_rule,
+      sizeof(guard_rule),
+      &ref));
+
+  // The rule index follows the opcode.
+  ref.offset += 1;
+
+  return _yr_compiler_add_rule_idx_location(compiler, &ref, sizeof(rule_idx));
+}
+
 int yr_parser_reduce_rule_declaration_phase_2(
     yyscan_t yyscanner,
     YR_ARENA_REF* rule_ref)
@@ -1067,6 +1376,10 @@ int yr_parser_reduce_rule_declaration_phase_2(
           compiler, string->identifier) return ERROR_UNREFERENCED_STRING;
     }
 
+    // The string's identifier is not needed in strings_table anymore. Removing
+    // it here is cheaper than cleaning the whole table in the next rule.
+    yr_hash_table_remove(compiler->strings_table, string->identifier, NULL);
+
     strings_in_rule++;
 
     if (strings_in_rule > max_strings_per_rule)
@@ -1076,6 +1389,8 @@ int yr_parser_reduce_rule_declaration_phase_2(
     }
   }
 
+  FAIL_ON_ERROR(_yr_parser_emit_guard(compiler, rule));
+
   FAIL_ON_ERROR(yr_parser_emit_with_arg(
       yyscanner, OP_MATCH_RULE, compiler->current_rule_idx, NULL, NULL));
 
@@ -29,11 +29,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <yara/ahocorasick.h>
 #include <yara/compiler.h>
 #include <yara/error.h>
 #include <yara/filemap.h>
 #include <yara/globals.h>
+#include <yara/libyara.h>
 #include <yara/mem.h>
 #include <yara/proc.h>
 #include <yara/rules.h>
@@ -180,7 +195,7 @@ YR_API int yr_rules_scan_mem_blocks(
   YR_SCANNER* scanner;
   int result;
 
-  FAIL_ON_ERROR(yr_scanner_create(rules, &scanner));
+  FAIL_ON_ERROR(yr_scanner_pool_acquire(rules->scanner_pool, &scanner));
 
   yr_scanner_set_callback(scanner, callback, user_data);
   yr_scanner_set_timeout(scanner, timeout);
@@ -188,7 +203,7 @@ YR_API int yr_rules_scan_mem_blocks(
 
   result = yr_scanner_scan_mem_blocks(scanner, iterator);
 
-  yr_scanner_destroy(scanner);
+  yr_scanner_pool_release(rules->scanner_pool, scanner);
 
   return result;
 }
@@ -214,7 +229,7 @@ YR_API int yr_rules_scan_mem(
   YR_SCANNER* scanner;
   int result = ERROR_INTERNAL_FATAL_ERROR;
 
-  GOTO_EXIT_ON_ERROR(yr_scanner_create(rules, &scanner));
+  GOTO_EXIT_ON_ERROR(yr_scanner_pool_acquire(rules->scanner_pool, &scanner));
 
   yr_scanner_set_callback(scanner, callback, user_data);
   yr_scanner_set_timeout(scanner, timeout);
@@ -222,7 +237,7 @@ YR_API int yr_rules_scan_mem(
 
   result = yr_scanner_scan_mem(scanner, buffer, buffer_size);
 
-  yr_scanner_destroy(scanner);
+  yr_scanner_pool_release(rules->scanner_pool, scanner);
 
 _exit:
 
@@ -325,6 +340,8 @@ YR_API int yr_rules_scan_proc(
 
 int yr_rules_from_arena(YR_ARENA* arena, YR_RULES** rules)
 {
+  uint32_t max_threads;
+
   YR_RULES* new_rules = (YR_RULES*) yr_malloc(sizeof(YR_RULES));
 
   if (new_rules == NULL)
@@ -342,6 +359,7 @@ int yr_rules_from_arena(YR_ARENA* arena, YR_RULES** rules)
   new_rules->num_rules = summary->num_rules;
   new_rules->num_strings = summary->num_strings;
   new_rules->num_namespaces = summary->num_namespaces;
+  new_rules->called_functions = summary->called_functions;
 
   new_rules->rules_table = yr_arena_get_ptr(arena, YR_RULES_TABLE, 0);
 
@@ -361,6 +379,37 @@ int yr_rules_from_arena(YR_ARENA* arena, YR_RULES** rules)
 
   new_rules->code_start = yr_arena_get_ptr(arena, YR_CODE_SECTION, 0);
 
+  new_rules->guard_code_start = yr_arena_get_ptr(
+      arena, YR_GUARD_CODE_SECTION, 0);
+
+  int result = yr_ac_prefilter_create(
+      new_rules->ac_transition_table,
+      new_rules->ac_match_table,
+      &new_rules->ac_prefilter);
+
+  if (result != ERROR_SUCCESS)
+  {
+    yr_arena_release(arena);
+    yr_free(new_rules);
+    return result;
+  }
+
+  result = yr_get_configuration_uint32(YR_CONFIG_MAX_THREADS, &max_threads);
+
+  if (result == ERROR_SUCCESS)
+    result = yr_scanner_pool_create(
+        new_rules, max_threads, &new_rules->scanner_pool);
+
+  if (result != ERROR_SUCCESS)
+  {
+    if (new_rules->ac_prefilter != NULL)
+      yr_ac_prefilter_destroy(new_rules->ac_prefilter);
+
+    yr_arena_release(arena);
+    yr_free(new_rules);
+    return result;
+  }
+
   *rules = new_rules;
 
   return ERROR_SUCCESS;
@@ -386,7 +435,21 @@ YR_API int yr_rules_load_stream(YR_STREAM* stream, YR_RULES** rules)
 
 YR_API int yr_rules_load(const char* filename, YR_RULES** rules)
 {
-  int result;
+  YR_ARENA* arena;
+
+  // Map the file in memory if possible, this avoids reading the whole file
+  // and most of it remains shared with other processes using the same rules.
+  int result = yr_arena_load_file(filename, &arena);
+
+  if (result == ERROR_SUCCESS)
+  {
+    result = yr_rules_from_arena(arena, rules);
+    yr_arena_release(arena);
+    return result;
+  }
+
+  if (result != ERROR_COULD_NOT_MAP_FILE)
+    return result;
 
   YR_STREAM stream;
   FILE* fh = fopen(filename, "rb");
@@ -408,25 +471,168 @@ YR_API int yr_rules_save_stream(YR_RULES* rules, YR_STREAM* stream)
   return yr_arena_save_stream(rules->arena, stream);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Saves the rules into a file.
+//
+// The rules are written into a temporary file in the same directory, which is
+// then renamed to the final name. yr_rules_load maps the files in memory, so
+// truncating and rewriting a file that is loaded by some process would crash
+// that process. Replacing the file is safe, the process keeps using the old
+// one.
+//
 YR_API int yr_rules_save(YR_RULES* rules, const char* filename)
 {
+  char temp_filename[MAX_PATH];
+  FILE* fh = NULL;
   int result;
 
-  YR_STREAM stream;
-  FILE* fh = fopen(filename, "wb");
+  // Try a few names, in case that temporary files with the same name were left
+  // by a process that crashed, or are in use by another one.
+  for (int i = 0; i < 100 && fh == NULL; i++)
+  {
+    if (snprintf(temp_filename, sizeof(temp_filename), "%s.%d.tmp", filename, i)
+        >= (int) sizeof(temp_filename))
+      return ERROR_COULD_NOT_OPEN_FILE;
+
+    fh = fopen(temp_filename, "wbx");
+
+    if (fh == NULL && errno != EEXIST)
+      return ERROR_COULD_NOT_OPEN_FILE;
+  }
 
   if (fh == NULL)
     return ERROR_COULD_NOT_OPEN_FILE;
 
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+  struct stat st;
+
+  // The file that is replaced keeps its permissions, as it did when it was
+  // overwritten.
+  if (stat(filename, &st) == 0)
+    fchmod(fileno(fh), st.st_mode & 07777);
+#endif
+
+  YR_STREAM stream;
+
   stream.user_data = fh;
   stream.write = (YR_STREAM_WRITE_FUNC) fwrite;
 
   result = yr_rules_save_stream(rules, &stream);
 
-  fclose(fh);
+  if (fclose(fh) != 0 && result == ERROR_SUCCESS)
+    result = ERROR_WRITING_FILE;
+
+#if defined(_WIN32)
+  if (result == ERROR_SUCCESS &&
+      !MoveFileExA(temp_filename, filename, MOVEFILE_REPLACE_EXISTING))
+    result = ERROR_COULD_NOT_OPEN_FILE;
+#else
+  if (result == ERROR_SUCCESS && rename(temp_filename, filename) != 0)
+    result = ERROR_COULD_NOT_OPEN_FILE;
+#endif
+
+  if (result != ERROR_SUCCESS)
+    remove(temp_filename);
+
+  return result;
+}
+
+YR_API int yr_rules_publish_fd(
+    YR_RULES* rules,
+    YR_FILE_DESCRIPTOR fd,
+    const char* tag)
+{
+  return yr_arena_publish_fd(rules->arena, fd, tag);
+}
+
+YR_API int yr_rules_attach_fd(YR_FILE_DESCRIPTOR fd, YR_RULES** rules)
+{
+  YR_ARENA* arena;
+
+  FAIL_ON_ERROR(yr_arena_attach_fd(fd, &arena));
+
+  int result = yr_rules_from_arena(arena, rules);
+  yr_arena_release(arena);
+
+  return result;
+}
+
+YR_API const char* yr_rules_get_tag(YR_RULES* rules)
+{
+  return rules->arena->tag;
+}
+
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+
+YR_API int yr_rules_publish(
+    YR_RULES* rules,
+    const char* name,
+    const char* tag)
+{
+  // Processes attached to a previous object with the same name keep using it
+  // until they destroy their rules, the object is never modified once it has
+  // been published.
+  shm_unlink(name);
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+  if (fd == -1)
+    return ERROR_COULD_NOT_OPEN_FILE;
+
+  int result = yr_rules_publish_fd(rules, fd, tag);
+
+  close(fd);
+
+  if (result != ERROR_SUCCESS)
+    shm_unlink(name);
+
+  return result;
+}
+
+YR_API int yr_rules_attach(const char* name, YR_RULES** rules)
+{
+  int fd = shm_open(name, O_RDONLY, 0);
+
+  if (fd == -1)
+    return ERROR_COULD_NOT_OPEN_FILE;
+
+  int result = yr_rules_attach_fd(fd, rules);
+
+  close(fd);
+
   return result;
 }
 
+YR_API int yr_rules_unpublish(const char* name)
+{
+  if (shm_unlink(name) != 0)
+    return ERROR_COULD_NOT_OPEN_FILE;
+
+  return ERROR_SUCCESS;
+}
+
+#else
+
+YR_API int yr_rules_publish(
+    YR_RULES* rules,
+    const char* name,
+    const char* tag)
+{
+  return ERROR_COULD_NOT_MAP_FILE;
+}
+
+YR_API int yr_rules_attach(const char* name, YR_RULES** rules)
+{
+  return ERROR_COULD_NOT_MAP_FILE;
+}
+
+YR_API int yr_rules_unpublish(const char* name)
+{
+  return ERROR_COULD_NOT_MAP_FILE;
+}
+
+#endif
+
 static int _uint32_cmp(const void* a, const void* b)
 {
   return (*(uint32_t*) a - *(uint32_t*) b);
@@ -513,6 +719,10 @@ YR_API int yr_rules_destroy(YR_RULES* rules)
 {
   YR_EXTERNAL_VARIABLE* external = rules->ext_vars_table;
 
+  // The idle scanners in the pool reference the rules, they must be destroyed
+  // first.
+  yr_scanner_pool_destroy(rules->scanner_pool);
+
   while (!EXTERNAL_VARIABLE_IS_NULL(external))
   {
     if (external->type == EXTERNAL_VARIABLE_TYPE_MALLOC_STRING)
@@ -521,12 +731,53 @@ YR_API int yr_rules_destroy(YR_RULES* rules)
     external++;
   }
 
+  if (rules->ac_prefilter != NULL)
+    yr_ac_prefilter_destroy(rules->ac_prefilter);
+
   yr_arena_release(rules->arena);
   yr_free(rules);
 
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if some rule calls the module function with the given full
+// identifier, like "hash.md5". If arguments_fmt is not NULL only calls to the
+// prototype with those arguments are taken into account, for instance "ii" for
+// hash.md5(offset, size). Modules can use this for computing in advance only
+// the results that the rules will use.
+//
+YR_API bool yr_rules_calls_function(
+    YR_RULES* rules,
+    const char* identifier,
+    const char* arguments_fmt)
+{
+  const char* called_function = rules->called_functions;
+  size_t identifier_length = strlen(identifier);
+
+  while (*called_function != '\0')
+  {
+    size_t length = strlen(called_function);
+
+    // Entries look like "hash.md5(ii)", compare the identifier up to the
+    // opening parenthesis and then the arguments if required.
+    if (strncmp(called_function, identifier, identifier_length) == 0 &&
+        called_function[identifier_length] == '(')
+    {
+      const char* fmt = called_function + identifier_length + 1;
+
+      if (arguments_fmt == NULL ||
+          (strncmp(fmt, arguments_fmt, strlen(arguments_fmt)) == 0 &&
+           fmt[strlen(arguments_fmt)] == ')'))
+        return true;
+    }
+
+    called_function += length + 1;
+  }
+
+  return false;
+}
+
 YR_API void yr_rule_disable(YR_RULE* rule)
 {
   YR_STRING* string;
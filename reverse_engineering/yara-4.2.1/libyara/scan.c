@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/globals.h>
 #include <yara/libyara.h>
 #include <yara/limits.h>
+#include <yara/mem.h>
 #include <yara/re.h>
 #include <yara/rules.h>
 #include <yara/scan.h>
@@ -258,14 +259,17 @@ static void _yr_scan_update_match_chain_length(
   if (string->chained_to == NULL)
     return;
 
+  uint64_t position = match_to_update->base + match_to_update->offset;
+
   match = context->unconfirmed_matches[string->chained_to->idx].head;
 
   while (match != NULL)
   {
-    int64_t ending_offset = match->offset + match->match_length;
+    uint64_t ending_offset = match->base + match->offset + match->match_length;
 
-    if (ending_offset + string->chain_gap_max >= match_to_update->offset &&
-        ending_offset + string->chain_gap_min <= match_to_update->offset)
+    if (match->base + match->offset >= context->contiguous_base &&
+        ending_offset + string->chain_gap_max >= position &&
+        ending_offset + string->chain_gap_min <= position)
     {
       _yr_scan_update_match_chain_length(
           context, string->chained_to, match, chain_length + 1);
@@ -275,6 +279,31 @@ static void _yr_scan_update_match_chain_length(
   }
 }
 
+//
+// _yr_scan_mark_string_dirty
+//
+// Records that the entries for the given string in "matches",
+// "unconfirmed_matches" or "strings_temp_disabled" are being modified, so
+// that they are reset once the scan finishes. See _yr_scanner_clean_matches.
+//
+
+static void _yr_scan_mark_string_dirty(
+    YR_SCAN_CONTEXT* context,
+    YR_STRING* string)
+{
+  if (yr_bitmask_is_set(context->strings_dirty, string->idx))
+    return;
+
+  yr_bitmask_set(context->strings_dirty, string->idx);
+
+  // Once the list is full the remaining strings are only counted, the
+  // scanner will reset everything instead of walking the list.
+  if (context->num_dirty_strings < context->max_dirty_strings)
+    context->dirty_strings[context->num_dirty_strings] = string->idx;
+
+  context->num_dirty_strings++;
+}
+
 static int _yr_scan_add_match_to_list(
     YR_MATCH* match,
     YR_MATCHES* matches_list,
@@ -330,6 +359,7 @@ static int _yr_scan_add_match_to_list(
   }
 
   matches_list->count++;
+  matches_list->index = 0;
 
   if (match->next != NULL)
     match->next->prev = match;
@@ -372,6 +402,7 @@ static void _yr_scan_remove_match_from_list(
     matches_list->tail = match->prev;
 
   matches_list->count--;
+  matches_list->index = 0;
   match->next = NULL;
   match->prev = NULL;
 }
@@ -390,11 +421,18 @@ static void _yr_scan_remove_match_from_list(
 // Notice that this function operates in a non-greedy fashion. Matches found
 // for S will be the shortest possible ones.
 //
+// The parts of a chain can be found in different blocks when the data is
+// scanned with SCAN_FLAGS_CONTIGUOUS_BLOCKS, or with yr_scanner_scan_feed,
+// so the distances between them are computed with their absolute positions
+// (base + offset). "data_size" is the size of the buffer where match_data
+// is, starting at match_base.
+//
 
 static int _yr_scan_verify_chained_string_match(
     YR_STRING* matching_string,
     YR_SCAN_CONTEXT* context,
     const uint8_t* match_data,
+    size_t data_size,
     uint64_t match_base,
     uint64_t match_offset,
     int32_t match_length)
@@ -402,10 +440,11 @@ static int _yr_scan_verify_chained_string_match(
   YR_DEBUG_FPRINTF(
       2,
       stderr,
-      "- %s (match_data=%p match_base=%" PRIx64 " match_offset=0x%" PRIx64
-      " match_length=%'d) {} \n",
+      "- %s (match_data=%p data_size=%zu match_base=%" PRIx64
+      " match_offset=0x%" PRIx64 " match_length=%'d) {} \n",
       __FUNCTION__,
       match_data,
+      data_size,
       match_base,
       match_offset,
       match_length);
@@ -415,6 +454,11 @@ static int _yr_scan_verify_chained_string_match(
   YR_MATCH* next_match;
   YR_MATCH* new_match;
 
+  // The block where the match was found starts at block_data, and its
+  // absolute position is match_base.
+  const uint8_t* block_data = match_data - match_offset;
+
+  uint64_t match_position = match_base + match_offset;
   uint64_t lowest_offset;
   uint64_t ending_offset;
   int32_t full_chain_length;
@@ -439,9 +483,9 @@ static int _yr_scan_verify_chained_string_match(
     match = context->unconfirmed_matches[matching_string->idx].head;
 
     if (match != NULL)
-      lowest_offset = match->offset;
+      lowest_offset = match->base + match->offset;
     else
-      lowest_offset = match_offset;
+      lowest_offset = match_position;
 
     // Iterate over the list of unconfirmed matches for the string that
     // precedes the currently matching string. If we have a string chain like:
@@ -456,23 +500,24 @@ static int _yr_scan_verify_chained_string_match(
       // set to NULL, that's why we store its current value before that happens.
       next_match = match->next;
 
-      // The unconfirmed match starts at match->offset and finishes at
-      // ending_offset.
-      ending_offset = match->offset + match->match_length;
+      // The unconfirmed match starts at match->base + match->offset and
+      // finishes at ending_offset.
+      ending_offset = match->base + match->offset + match->match_length;
 
-      if (ending_offset + matching_string->chain_gap_max < lowest_offset)
+      if (ending_offset + matching_string->chain_gap_max < lowest_offset ||
+          match->base + match->offset < context->contiguous_base)
       {
         // If the current match is too far away from the unconfirmed match,
-        // remove the unconfirmed match from the list because it has been
-        // negatively confirmed (i.e: we can be sure that this unconfirmed
-        // match can't be an actual match)
+        // or the data between them wasn't scanned, remove the unconfirmed
+        // match from the list because it has been negatively confirmed (i.e:
+        // we can be sure that this unconfirmed match can't be an actual match)
         _yr_scan_remove_match_from_list(
             match,
             &context->unconfirmed_matches[matching_string->chained_to->idx]);
       }
       else if (
-          ending_offset + matching_string->chain_gap_max >= match_offset &&
-          ending_offset + matching_string->chain_gap_min <= match_offset)
+          ending_offset + matching_string->chain_gap_max >= match_position &&
+          ending_offset + matching_string->chain_gap_min <= match_position)
       {
         // If the distance between the end of the unconfirmed match and the
         // start of the current match is within the range specified in the
@@ -508,10 +553,11 @@ static int _yr_scan_verify_chained_string_match(
 
       while (match != NULL)
       {
-        ending_offset = match->offset + match->match_length;
+        ending_offset = match->base + match->offset + match->match_length;
 
-        if (ending_offset + matching_string->chain_gap_max >= match_offset &&
-            ending_offset + matching_string->chain_gap_min <= match_offset)
+        if (match->base + match->offset >= context->contiguous_base &&
+            ending_offset + matching_string->chain_gap_max >= match_position &&
+            ending_offset + matching_string->chain_gap_min <= match_position)
         {
           _yr_scan_update_match_chain_length(
               context, matching_string->chained_to, match, 1);
@@ -542,11 +588,15 @@ static int _yr_scan_verify_chained_string_match(
 
         if (match->chain_length == full_chain_length)
         {
+          uint64_t head_position = match->base + match->offset;
+          const uint8_t* head_data = match->data;
+          int32_t head_data_length = match->data_length;
+
           _yr_scan_remove_match_from_list(
               match, &context->unconfirmed_matches[string->idx]);
 
           match->match_length =
-              (int32_t) (match_offset - match->offset + match_length);
+              (int32_t) (match_position - head_position + match_length);
 
           match->data_length = yr_min(
               match->match_length, (int32_t) max_match_data);
@@ -557,10 +607,38 @@ static int _yr_scan_verify_chained_string_match(
           if (match->data == NULL)
             return ERROR_INSUFFICIENT_MEMORY;
 
-          memcpy(
-              (void*) match->data,
-              match_data - match_offset + match->offset,
-              match->data_length);
+          if (head_position >= match_base)
+          {
+            memcpy(
+                (void*) match->data,
+                block_data + (head_position - match_base),
+                match->data_length);
+          }
+          else
+          {
+            // The head of the chain was found in a previous block, which is
+            // not available anymore. The data saved with the head goes first,
+            // and the rest is taken from the current block. If there's data
+            // missing between them the match data is truncated, this can
+            // happen only if YR_CONFIG_MAX_MATCH_DATA is larger than
+            // YR_BLOCK_OVERLAP_SIZE.
+            int32_t length = yr_min(head_data_length, match->data_length);
+
+            memcpy((void*) match->data, head_data, length);
+
+            if (length < match->data_length)
+            {
+              if (head_position + length >= match_base)
+                memcpy(
+                    (void*) (match->data + length),
+                    block_data + (head_position + length - match_base),
+                    match->data_length - length);
+              else
+                match->data_length = length;
+            }
+          }
+
+          _yr_scan_mark_string_dirty(context, string);
 
           FAIL_ON_ERROR(_yr_scan_add_match_to_list(
               match, &context->matches[string->idx], false));
@@ -589,6 +667,18 @@ static int _yr_scan_verify_chained_string_match(
       // amount of data copies is limited by YR_CONFIG_MAX_MATCH_DATA.
       new_match->data_length = yr_min(match_length, (int32_t) max_match_data);
 
+      // If the data is scanned in adjacent blocks, the chain can be confirmed
+      // in a later block, when the data at its head is not available anymore.
+      // For that case the head of the chain keeps all the data that the whole
+      // match could need, up to the end of the current block.
+      if (matching_string->chained_to == NULL &&
+          (context->flags & SCAN_FLAGS_CONTIGUOUS_BLOCKS ||
+           context->stream_active))
+      {
+        new_match->data_length = (int32_t) yr_min(
+            data_size - match_offset, (size_t) max_match_data);
+      }
+
       if (new_match->data_length > 0)
       {
         new_match->data = yr_notebook_alloc(
@@ -607,6 +697,8 @@ static int _yr_scan_verify_chained_string_match(
       // Add the match to the list of unconfirmed matches because the string
       // is part of a chain but not its tail, so we can't be sure the this is
       // an actual match until finding the remaining parts of the chain.
+      _yr_scan_mark_string_dirty(context, matching_string);
+
       FAIL_ON_ERROR(_yr_scan_add_match_to_list(
           new_match,
           &context->unconfirmed_matches[matching_string->idx],
@@ -617,6 +709,47 @@ static int _yr_scan_verify_chained_string_match(
   return ERROR_SUCCESS;
 }
 
+//
+// _yr_scan_defer_chained_match
+//
+// Records a match for a part of a string chain found by a scanner that has
+// "defer_chained_matches" set. The match is verified later by
+// yr_scan_merge_segment, see YR_DEFERRED_MATCH.
+//
+
+static int _yr_scan_defer_chained_match(
+    YR_SCAN_CONTEXT* context,
+    YR_STRING* string,
+    uint64_t match_offset,
+    int32_t match_length)
+{
+  YR_DEFERRED_MATCH* deferred;
+
+  if (context->num_deferred_matches == context->max_deferred_matches)
+  {
+    uint32_t max = context->max_deferred_matches == 0
+                       ? 1024
+                       : context->max_deferred_matches * 2;
+
+    deferred = (YR_DEFERRED_MATCH*) yr_realloc(
+        context->deferred_matches, max * sizeof(YR_DEFERRED_MATCH));
+
+    if (deferred == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    context->deferred_matches = deferred;
+    context->max_deferred_matches = max;
+  }
+
+  deferred = &context->deferred_matches[context->num_deferred_matches++];
+  deferred->string = string;
+  deferred->offset = match_offset;
+  deferred->match_length = match_length;
+  deferred->verification = context->num_verifications;
+
+  return ERROR_SUCCESS;
+}
+
 static int _yr_scan_match_callback(
     const uint8_t* match_data,
     int32_t match_length,
@@ -679,12 +812,19 @@ static int _yr_scan_match_callback(
     }
   }
 
-  if (STRING_IS_CHAIN_PART(string))
+  if (STRING_IS_CHAIN_PART(string) &&
+      callback_args->context->defer_chained_matches)
+  {
+    result = _yr_scan_defer_chained_match(
+        callback_args->context, string, match_offset, match_length);
+  }
+  else if (STRING_IS_CHAIN_PART(string))
   {
     result = _yr_scan_verify_chained_string_match(
         string,
         callback_args->context,
         match_data,
+        callback_args->data_size,
         callback_args->data_base,
         match_offset,
         match_length);
@@ -734,6 +874,8 @@ static int _yr_scan_match_callback(
       new_match->next = NULL;
       new_match->is_private = STRING_IS_PRIVATE(string);
 
+      _yr_scan_mark_string_dirty(callback_args->context, string);
+
       FAIL_ON_ERROR(_yr_scan_add_match_to_list(
           new_match,
           &callback_args->context->matches[string->idx],
@@ -961,6 +1103,45 @@ static int _yr_scan_verify_literal_match(
   return ERROR_SUCCESS;
 }
 
+//
+// _yr_scan_handle_too_many_matches
+//
+// Called when a string reaches YR_MAX_STRING_MATCHES. The callback decides
+// whether the scan continues without looking for more matches of the string,
+// or it's aborted with ERROR_TOO_MANY_MATCHES.
+//
+
+static int _yr_scan_handle_too_many_matches(
+    YR_SCAN_CONTEXT* context,
+    YR_STRING* string)
+{
+  int result = context->callback(
+      context,
+      CALLBACK_MSG_TOO_MANY_MATCHES,
+      (void*) string,
+      context->user_data);
+
+  if (result != CALLBACK_CONTINUE)
+    return ERROR_TOO_MANY_MATCHES;
+
+  yr_scan_disable_string(context, string);
+
+  return ERROR_SUCCESS;
+}
+
+//
+// yr_scan_disable_string
+//
+// Stops looking for matches of the given string during the current scan. The
+// matches found so far are kept.
+//
+
+void yr_scan_disable_string(YR_SCAN_CONTEXT* context, YR_STRING* string)
+{
+  _yr_scan_mark_string_dirty(context, string);
+  yr_bitmask_set(context->strings_temp_disabled, string->idx);
+}
+
 int yr_scan_verify_match(
     YR_SCAN_CONTEXT* context,
     YR_AC_MATCH* ac_match,
@@ -980,7 +1161,6 @@ int yr_scan_verify_match(
       offset);
 
   YR_STRING* string = ac_match->string;
-  YR_CALLBACK_FUNC callback = context->callback;
 
   int result;
 
@@ -998,6 +1178,9 @@ int yr_scan_verify_match(
       string->fixed_offset != data_base + offset)
     return ERROR_SUCCESS;
 
+  if (STRING_IS_CHAIN_PART(string) && context->defer_chained_matches)
+    context->num_verifications++;
+
 #ifdef YR_PROFILING_ENABLED
   uint64_t start_time;
   bool sample = context->profiling_info[string->rule_idx].atom_matches %
@@ -1024,25 +1207,7 @@ int yr_scan_verify_match(
   // in order to ask what to do. If the callback returns CALLBACK_CONTINUE
   // this error is ignored, if not, the error is propagated to the caller.
   if (result == ERROR_TOO_MANY_MATCHES)
-  {
-    result = callback(
-        context,
-        CALLBACK_MSG_TOO_MANY_MATCHES,
-        (void*) string,
-        context->user_data);
-
-    switch (result)
-    {
-    case CALLBACK_CONTINUE:
-      yr_bitmask_set(context->strings_temp_disabled, string->idx);
-      result = ERROR_SUCCESS;
-      break;
-
-    default:
-      result = ERROR_TOO_MANY_MATCHES;
-      break;
-    }
-  }
+    result = _yr_scan_handle_too_many_matches(context, string);
 
 #ifdef YR_PROFILING_ENABLED
   if (sample)
@@ -1059,3 +1224,235 @@ int yr_scan_verify_match(
 
   return result;
 }
+
+//
+// _yr_scan_merge_string_matches
+//
+// Adds copies of the matches found for a string by the scanner of a segment
+// to the matches of the same string in "context", as if they were found by
+// "context" itself.
+//
+
+static int _yr_scan_merge_string_matches(
+    YR_SCAN_CONTEXT* context,
+    YR_SCAN_CONTEXT* segment_context,
+    YR_STRING* string)
+{
+  YR_MATCH* match = segment_context->matches[string->idx].head;
+  YR_MATCH* new_match;
+
+  if (match == NULL)
+    return ERROR_SUCCESS;
+
+  if (yr_bitmask_is_set(context->strings_temp_disabled, string->idx))
+    return ERROR_SUCCESS;
+
+  // In fast mode the segment scanner has stopped at the first match, which
+  // is the first one found in the whole block only if no preceding segment
+  // has found any.
+  if (context->flags & SCAN_FLAGS_FAST_MODE && STRING_IS_SINGLE_MATCH(string) &&
+      context->matches[string->idx].head != NULL)
+    return ERROR_SUCCESS;
+
+  _yr_scan_mark_string_dirty(context, string);
+
+  while (match != NULL)
+  {
+    int result;
+
+    new_match = yr_notebook_alloc(context->matches_notebook, sizeof(YR_MATCH));
+
+    if (new_match == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    *new_match = *match;
+    new_match->prev = NULL;
+    new_match->next = NULL;
+
+    if (match->data_length > 0)
+    {
+      new_match->data = yr_notebook_alloc(
+          context->matches_notebook, match->data_length);
+
+      if (new_match->data == NULL)
+        return ERROR_INSUFFICIENT_MEMORY;
+
+      memcpy((void*) new_match->data, match->data, match->data_length);
+    }
+
+    result = _yr_scan_add_match_to_list(
+        new_match,
+        &context->matches[string->idx],
+        STRING_IS_GREEDY_REGEXP(string));
+
+    if (result == ERROR_TOO_MANY_MATCHES)
+    {
+      result = _yr_scan_handle_too_many_matches(context, string);
+
+      // If the scan continues the string is disabled from now on.
+      if (result == ERROR_SUCCESS)
+        break;
+    }
+
+    if (result != ERROR_SUCCESS)
+    {
+      context->last_error_string = string;
+      return result;
+    }
+
+    match = match->next;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+//
+// _yr_scan_replay_deferred_matches
+//
+// Verifies the matches for parts of string chains that were deferred by the
+// scanner of a segment, in the same order in which they were found. "data",
+// "data_size" and "data_base" must be the data, size and base address of the
+// scanned block.
+//
+
+static int _yr_scan_replay_deferred_matches(
+    YR_SCAN_CONTEXT* context,
+    YR_SCAN_CONTEXT* segment_context,
+    const uint8_t* data,
+    size_t data_size,
+    uint64_t data_base)
+{
+  YR_DEFERRED_MATCH* deferred = segment_context->deferred_matches;
+  YR_DEFERRED_MATCH* end = deferred + segment_context->num_deferred_matches;
+
+  while (deferred < end)
+  {
+    YR_STRING* string = deferred->string;
+    uint32_t verification = deferred->verification;
+
+    int result = ERROR_SUCCESS;
+
+    // These are the same checks done by yr_scan_verify_match before the
+    // verification, which depend on the matches found so far.
+    bool skip =
+        yr_bitmask_is_set(context->strings_temp_disabled, string->idx) ||
+        (context->flags & SCAN_FLAGS_FAST_MODE &&
+         STRING_IS_SINGLE_MATCH(string) &&
+         context->matches[string->idx].head != NULL);
+
+    for (; deferred < end && deferred->verification == verification;
+         deferred++)
+    {
+      if (!skip && result == ERROR_SUCCESS)
+      {
+        result = _yr_scan_verify_chained_string_match(
+            string,
+            context,
+            data + deferred->offset,
+            data_size,
+            data_base,
+            deferred->offset,
+            deferred->match_length);
+      }
+    }
+
+    if (result == ERROR_TOO_MANY_MATCHES)
+      result = _yr_scan_handle_too_many_matches(context, string);
+
+    if (result != ERROR_SUCCESS)
+    {
+      context->last_error_string = string;
+      return result;
+    }
+  }
+
+  return ERROR_SUCCESS;
+}
+
+//
+// yr_scan_merge_segment
+//
+// Merges the matches found by the scanner of a segment into "context". The
+// segments of a block must be merged in order, after all of them have been
+// scanned, and the result is the same as if the whole block was scanned by
+// "context". "data", "data_size" and "data_base" are the data, size and base
+// address of the block.
+//
+
+int yr_scan_merge_segment(
+    YR_SCAN_CONTEXT* context,
+    YR_SCAN_CONTEXT* segment_context,
+    const uint8_t* data,
+    size_t data_size,
+    uint64_t data_base)
+{
+  YR_STRING* strings_table = context->rules->strings_table;
+  uint32_t num_strings = context->rules->num_strings;
+
+  if (segment_context->num_dirty_strings > segment_context->max_dirty_strings)
+  {
+    for (uint32_t i = 0; i < num_strings; i++)
+      FAIL_ON_ERROR(_yr_scan_merge_string_matches(
+          context, segment_context, &strings_table[i]));
+  }
+  else
+  {
+    for (uint32_t i = 0; i < segment_context->num_dirty_strings; i++)
+      FAIL_ON_ERROR(_yr_scan_merge_string_matches(
+          context,
+          segment_context,
+          &strings_table[segment_context->dirty_strings[i]]));
+  }
+
+  return _yr_scan_replay_deferred_matches(
+      context, segment_context, data, data_size, data_base);
+}
+
+//
+// yr_scan_get_match_index
+//
+// Returns in "index" an array with pointers to the matches of the given
+// string, sorted by offset. The array is built the first time it's requested
+// and remains valid until the list of matches changes or some other list is
+// indexed. The number of items in the array is the number of matches.
+//
+
+int yr_scan_get_match_index(
+    YR_SCAN_CONTEXT* context,
+    YR_STRING* string,
+    YR_MATCH*** index)
+{
+  YR_MATCHES* matches = &context->matches[string->idx];
+  YR_MATCH* match;
+
+  if (matches->index == 0)
+  {
+    size_t required = context->match_index_length + matches->count;
+
+    if (required > context->match_index_capacity)
+    {
+      size_t capacity = yr_max(context->match_index_capacity * 2, 1024);
+      YR_MATCH** match_index;
+
+      while (capacity < required) capacity *= 2;
+
+      match_index = (YR_MATCH**) yr_realloc(
+          context->match_index, capacity * sizeof(YR_MATCH*));
+
+      if (match_index == NULL)
+        return ERROR_INSUFFICIENT_MEMORY;
+
+      context->match_index = match_index;
+      context->match_index_capacity = capacity;
+    }
+
+    matches->index = context->match_index_length + 1;
+
+    for (match = matches->head; match != NULL; match = match->next)
+      context->match_index[context->match_index_length++] = match;
+  }
+
+  *index = context->match_index + matches->index - 1;
+
+  return ERROR_SUCCESS;
+}
@@ -37,38 +37,60 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/object.h>
 #include <yara/proc.h>
 #include <yara/scanner.h>
+#include <yara/threading.h>
 #include <yara/types.h>
 
 #include "exception.h"
 
+////////////////////////////////////////////////////////////////////////////////
+// Scans a memory block with the Aho-Corasick automaton and verifies the atoms
+// found. Only the atoms ending at offsets within [verify_start, verify_end)
+// are verified, the data outside that range is available to the verification
+// functions but the automaton doesn't go further than necessary. Use 0 and
+// SIZE_MAX for verifying the whole block.
+//
 static int _yr_scanner_scan_mem_block(
     YR_SCANNER* scanner,
     const uint8_t* block_data,
-    YR_MEMORY_BLOCK* block)
+    YR_MEMORY_BLOCK* block,
+    size_t verify_start,
+    size_t verify_end)
 {
   YR_DEBUG_FPRINTF(
       2,
       stderr,
-      "+ %s(block_data=%p block->base=0x%" PRIx64 " block->size=%zu) {\n",
+      "+ %s(block_data=%p block->base=0x%" PRIx64
+      " block->size=%zu verify_start=%zu verify_end=%zu) {\n",
       __FUNCTION__,
       block_data,
       block->base,
-      block->size);
+      block->size,
+      verify_start,
+      verify_end);
 
   int result = ERROR_SUCCESS;
 
   YR_RULES* rules = scanner->rules;
   YR_AC_TRANSITION* transition_table = rules->ac_transition_table;
+  YR_AC_PREFILTER* prefilter = rules->ac_prefilter;
   uint32_t* match_table = rules->ac_match_table;
 
   YR_AC_MATCH* match;
   YR_AC_TRANSITION transition;
 
-  size_t i = 0;
+  // No atom is longer than YR_MAX_ATOM_LENGTH, so the automaton reaches the
+  // same state at verify_start when it starts at the root state that number
+  // of bytes before, there's no need to scan from the start of the block.
+  size_t i = verify_start > YR_MAX_ATOM_LENGTH
+                 ? verify_start - YR_MAX_ATOM_LENGTH
+                 : 0;
+
+  size_t scan_end = yr_min(block->size, verify_end);
+
   uint32_t state = YR_AC_ROOT_STATE;
   uint16_t index;
 
-  while (i < block->size)
+  while (i < scan_end)
   {
     if (i % 4096 == 0 && scanner->timeout > 0)
     {
@@ -79,6 +101,19 @@ static int _yr_scanner_scan_mem_block(
       }
     }
 
+    if (state == YR_AC_ROOT_STATE && prefilter != NULL)
+    {
+      // While in the root state the automaton can skip over positions where
+      // no atom starts. The skipped region never goes beyond the next multiple
+      // of 4096, so that the timeout is still checked at those positions.
+      size_t limit = yr_min(scan_end, (i & ~(size_t) 4095) + 4096);
+
+      i = prefilter->find(prefilter, block_data, block->size, i, limit);
+
+      if (i == limit)
+        continue;
+    }
+
 #if 2 == YR_DEBUG_VERBOSITY
     if (0 != state)
       YR_DEBUG_FPRINTF(
@@ -94,7 +129,7 @@ static int _yr_scanner_scan_mem_block(
           __FUNCTION__);
 #endif
 
-    if (match_table[state] != 0)
+    if (match_table[state] != 0 && i >= verify_start)
     {
       // If the entry corresponding to state N in the match table is zero, it
       // means that there's no match associated to the state. If it's non-zero,
@@ -140,7 +175,7 @@ static int _yr_scanner_scan_mem_block(
     state = YR_AC_NEXT_STATE(transition);
   }
 
-  if (match_table[state] != 0)
+  if (match_table[state] != 0 && i >= verify_start && i < verify_end)
   {
     match = &rules->ac_match_pool[match_table[state] - 1];
 
@@ -174,6 +209,145 @@ _exit:
   return result;
 }
 
+static int _yr_scanner_scan_segments(
+    YR_SCANNER* scanner,
+    const uint8_t* block_data,
+    YR_MEMORY_BLOCK* block,
+    size_t verify_start,
+    size_t verify_end);
+
+////////////////////////////////////////////////////////////////////////////////
+// Verifies the atoms that were left pending at the end of the last block
+// scanned with SCAN_FLAGS_CONTIGUOUS_BLOCKS. This is called when it's known
+// that the next block is not adjacent to the previous one, or that there are
+// no more blocks, and therefore the data in the overlap buffer is all the
+// data available for verifying them.
+//
+static int _yr_scanner_flush_overlap(YR_SCANNER* scanner)
+{
+  YR_MEMORY_BLOCK tail;
+
+  if (scanner->overlap_length == 0)
+    return ERROR_SUCCESS;
+
+  tail.base = scanner->overlap_end - scanner->overlap_length;
+  tail.size = scanner->overlap_length;
+
+  scanner->overlap_length = 0;
+
+  return _yr_scanner_scan_mem_block(
+      scanner,
+      scanner->overlap_buffer,
+      &tail,
+      scanner->overlap_verify_from - tail.base,
+      SIZE_MAX);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scans a memory block when SCAN_FLAGS_CONTIGUOUS_BLOCKS is set. If the block
+// starts where the previous one ended both are treated as a single stream of
+// data, and strings crossing the boundary between them are found as if the
+// data was scanned in a single block.
+//
+// Let H be YR_BLOCK_OVERLAP_SIZE. Atoms ending within the last H bytes of a
+// block are left pending, as the data following them is not available yet.
+// When the next block arrives, the last 2*H bytes of the previous data plus
+// the first 2*H bytes of the new block are copied to the overlap buffer, and
+// the pending atoms, together with the ones ending within the first H bytes of
+// the new block, are verified there. The remaining atoms are verified in the
+// block itself. This way every atom is verified once, with at least H bytes
+// of data before and after it.
+//
+static int _yr_scanner_scan_contiguous_block(
+    YR_SCANNER* scanner,
+    const uint8_t* data,
+    YR_MEMORY_BLOCK* block)
+{
+  const size_t h = YR_BLOCK_OVERLAP_SIZE;
+
+  YR_MEMORY_BLOCK joint;
+
+  if (block->size == 0)
+    return ERROR_SUCCESS;
+
+  if (scanner->overlap_buffer == NULL)
+  {
+    scanner->overlap_buffer = (uint8_t*) yr_malloc(4 * h);
+
+    if (scanner->overlap_buffer == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+  }
+
+  if (scanner->overlap_length > 0 && scanner->overlap_end != block->base)
+    FAIL_ON_ERROR(_yr_scanner_flush_overlap(scanner));
+
+  if (scanner->overlap_length == 0)
+  {
+    scanner->overlap_verify_from = block->base;
+    scanner->contiguous_base = block->base;
+  }
+
+  uint64_t block_end = block->base + block->size;
+  uint64_t verify_limit = block_end > h ? block_end - h : 0;
+  size_t head_length = yr_min(block->size, 2 * h);
+
+  memcpy(scanner->overlap_buffer + scanner->overlap_length, data, head_length);
+
+  joint.base = block->base - scanner->overlap_length;
+  joint.size = scanner->overlap_length + head_length;
+
+  uint64_t verify_from = scanner->overlap_verify_from;
+  uint64_t verify_to = yr_min(block->base + h, verify_limit);
+
+  if (verify_to > verify_from)
+  {
+    FAIL_ON_ERROR(_yr_scanner_scan_mem_block(
+        scanner,
+        scanner->overlap_buffer,
+        &joint,
+        verify_from - joint.base,
+        verify_to - joint.base));
+  }
+
+  verify_from = yr_max(verify_from, block->base + h);
+
+  if (verify_limit > verify_from)
+  {
+    FAIL_ON_ERROR(_yr_scanner_scan_segments(
+        scanner,
+        data,
+        block,
+        verify_from - block->base,
+        verify_limit - block->base));
+  }
+
+  scanner->overlap_verify_from = yr_max(
+      scanner->overlap_verify_from, verify_limit);
+
+  // Keep the last 2*H bytes of data for the next block. If the block is
+  // shorter than that, they are already at the end of the joint buffer.
+  if (block->size >= 2 * h)
+  {
+    memcpy(scanner->overlap_buffer, data + block->size - 2 * h, 2 * h);
+    scanner->overlap_length = 2 * h;
+  }
+  else
+  {
+    size_t keep = yr_min(joint.size, 2 * h);
+
+    memmove(
+        scanner->overlap_buffer,
+        scanner->overlap_buffer + joint.size - keep,
+        keep);
+
+    scanner->overlap_length = keep;
+  }
+
+  scanner->overlap_end = block_end;
+
+  return ERROR_SUCCESS;
+}
+
 static void _yr_scanner_clean_matches(YR_SCANNER* scanner)
 {
   YR_DEBUG_FPRINTF(2, stderr, "- %s() {} \n", __FUNCTION__);
@@ -188,17 +362,413 @@ static void _yr_scanner_clean_matches(YR_SCANNER* scanner)
       0,
       sizeof(YR_BITMASK) * YR_BITMASK_SIZE(scanner->rules->num_namespaces));
 
-  memset(
-      scanner->strings_temp_disabled,
-      0,
-      sizeof(YR_BITMASK) * YR_BITMASK_SIZE(scanner->rules->num_strings));
+  // Only the strings that were touched during the scan need to be reset. If
+  // the list of dirty strings overflowed it's cheaper to reset all of them.
+  if (scanner->num_dirty_strings > scanner->max_dirty_strings)
+  {
+    memset(
+        scanner->strings_temp_disabled,
+        0,
+        sizeof(YR_BITMASK) * YR_BITMASK_SIZE(scanner->rules->num_strings));
+
+    memset(
+        scanner->strings_dirty,
+        0,
+        sizeof(YR_BITMASK) * YR_BITMASK_SIZE(scanner->rules->num_strings));
+
+    memset(
+        scanner->matches, 0, sizeof(YR_MATCHES) * scanner->rules->num_strings);
+
+    memset(
+        scanner->unconfirmed_matches,
+        0,
+        sizeof(YR_MATCHES) * scanner->rules->num_strings);
+  }
+  else
+  {
+    for (uint32_t i = 0; i < scanner->num_dirty_strings; i++)
+    {
+      uint32_t idx = scanner->dirty_strings[i];
 
-  memset(scanner->matches, 0, sizeof(YR_MATCHES) * scanner->rules->num_strings);
+      yr_bitmask_clear(scanner->strings_temp_disabled, idx);
+      yr_bitmask_clear(scanner->strings_dirty, idx);
 
-  memset(
-      scanner->unconfirmed_matches,
-      0,
-      sizeof(YR_MATCHES) * scanner->rules->num_strings);
+      memset(&scanner->matches[idx], 0, sizeof(YR_MATCHES));
+      memset(&scanner->unconfirmed_matches[idx], 0, sizeof(YR_MATCHES));
+    }
+  }
+
+  scanner->num_dirty_strings = 0;
+  scanner->num_deferred_matches = 0;
+  scanner->num_verifications = 0;
+  scanner->match_index_length = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Prepares the scanner for a new scan.
+//
+static int _yr_scanner_start(YR_SCANNER* scanner)
+{
+  // Create the notebook that will hold the YR_MATCH structures representing
+  // each match found. This notebook will also contain snippets of the
+  // matching data (the "data" field in YR_MATCH points to the snippet
+  // corresponding to the match). Each notebook's page can store up to 1024
+  // matches.
+  uint32_t max_match_data;
+
+  FAIL_ON_ERROR(
+      yr_get_configuration_uint32(YR_CONFIG_MAX_MATCH_DATA, &max_match_data));
+
+  FAIL_ON_ERROR(yr_notebook_create(
+      1024 * (sizeof(YR_MATCH) + max_match_data), &scanner->matches_notebook));
+
+  yr_stopwatch_start(&scanner->stopwatch);
+
+  scanner->overlap_length = 0;
+  scanner->overlap_end = 0;
+  scanner->contiguous_base = 0;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Evaluates the rules' guards before scanning the data, which disables the
+// strings of the rules that can't match anyway, see yr_execute_guards. This
+// is done only if the data can be read before scanning it, as with files and
+// memory buffers, and if the callback doesn't receive the non-matching rules,
+// as the matches of their strings would be missing.
+//
+static int _yr_scanner_evaluate_guards(
+    YR_SCANNER* scanner,
+    YR_MEMORY_BLOCK_ITERATOR* iterator)
+{
+  int result;
+  int last_error = iterator->last_error;
+
+  if (*scanner->rules->guard_code_start == OP_HALT ||
+      scanner->flags & SCAN_FLAGS_REPORT_RULES_NOT_MATCHING ||
+      iterator->file_size == NULL)
+    return ERROR_SUCCESS;
+
+  scanner->file_size = iterator->file_size(iterator);
+
+  YR_TRYCATCH(
+      !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
+      { result = yr_execute_guards(scanner); },
+      { result = ERROR_COULD_NOT_MAP_FILE; });
+
+  // If the iterator failed while the guards were reading the data their
+  // results can't be trusted. In that case they are simply discarded, the
+  // scan goes on as if there were no guards.
+  if (result == ERROR_SUCCESS && iterator->last_error != last_error)
+  {
+    _yr_scanner_clean_matches(scanner);
+    iterator->last_error = last_error;
+  }
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Evaluates the rules' conditions once all the data has been scanned, and
+// invokes the callback for the matching and non-matching rules.
+//
+static int _yr_scanner_evaluate_rules(YR_SCANNER* scanner)
+{
+  YR_RULE* rule;
+
+  int i, result;
+
+  YR_TRYCATCH(
+      !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
+      { result = yr_execute_code(scanner); },
+      { result = ERROR_COULD_NOT_MAP_FILE; });
+
+  if (result != ERROR_SUCCESS)
+    return result;
+
+  for (i = 0, rule = scanner->rules->rules_table; !RULE_IS_NULL(rule);
+       i++, rule++)
+  {
+    int message = 0;
+
+    if (yr_bitmask_is_set(scanner->rule_matches_flags, i) &&
+        yr_bitmask_is_not_set(scanner->ns_unsatisfied_flags, rule->ns->idx))
+    {
+      if (scanner->flags & SCAN_FLAGS_REPORT_RULES_MATCHING)
+        message = CALLBACK_MSG_RULE_MATCHING;
+    }
+    else
+    {
+      if (scanner->flags & SCAN_FLAGS_REPORT_RULES_NOT_MATCHING)
+        message = CALLBACK_MSG_RULE_NOT_MATCHING;
+    }
+
+    if (message != 0 && !RULE_IS_PRIVATE(rule))
+    {
+      switch (scanner->callback(scanner, message, rule, scanner->user_data))
+      {
+      case CALLBACK_ABORT:
+        return ERROR_SUCCESS;
+
+      case CALLBACK_ERROR:
+        return ERROR_CALLBACK_ERROR;
+      }
+    }
+  }
+
+  scanner->callback(
+      scanner, CALLBACK_MSG_SCAN_FINISHED, NULL, scanner->user_data);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Releases the resources used during a scan, leaving the scanner ready for
+// the next one.
+//
+static void _yr_scanner_finish(YR_SCANNER* scanner)
+{
+  _yr_scanner_clean_matches(scanner);
+
+  if (scanner->matches_notebook != NULL)
+  {
+    yr_notebook_destroy(scanner->matches_notebook);
+    scanner->matches_notebook = NULL;
+  }
+}
+
+typedef struct _SCAN_SEGMENT
+{
+  YR_SCANNER* scanner;
+  YR_THREAD thread;
+  bool thread_created;
+
+  const uint8_t* block_data;
+  YR_MEMORY_BLOCK* block;
+  size_t verify_start;
+  size_t verify_end;
+
+  int result;
+
+} SCAN_SEGMENT;
+
+////////////////////////////////////////////////////////////////////////////////
+// Callback used by the scanners of segments. The only message they can send
+// is CALLBACK_MSG_TOO_MANY_MATCHES, the scanner that merges the segments asks
+// its own callback when it's the one reaching the limit.
+//
+static int _yr_scanner_segment_callback(
+    YR_SCAN_CONTEXT* context,
+    int message,
+    void* message_data,
+    void* user_data)
+{
+  return CALLBACK_CONTINUE;
+}
+
+static int _yr_scanner_scan_segment(SCAN_SEGMENT* segment)
+{
+  return _yr_scanner_scan_mem_block(
+      segment->scanner,
+      segment->block_data,
+      segment->block,
+      segment->verify_start,
+      segment->verify_end);
+}
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+static DWORD WINAPI _yr_scanner_segment_thread(LPVOID param)
+#else
+static void* _yr_scanner_segment_thread(void* param)
+#endif
+{
+  SCAN_SEGMENT* segment = (SCAN_SEGMENT*) param;
+
+  int result;
+
+  YR_TRYCATCH(
+      !(segment->scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
+      { result = _yr_scanner_scan_segment(segment); },
+      { result = ERROR_COULD_NOT_MAP_FILE; });
+
+  segment->result = result;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Prepares a scanner taken from the pool for scanning a segment on behalf of
+// "scanner".
+//
+static int _yr_scanner_start_segment(
+    YR_SCANNER* scanner,
+    SCAN_SEGMENT* segment)
+{
+  YR_SCANNER* segment_scanner;
+
+  FAIL_ON_ERROR(yr_scanner_pool_acquire(
+      scanner->rules->scanner_pool, &segment->scanner));
+
+  segment_scanner = segment->scanner;
+  segment_scanner->flags = scanner->flags;
+  segment_scanner->timeout = scanner->timeout;
+  segment_scanner->callback = _yr_scanner_segment_callback;
+  segment_scanner->defer_chained_matches = true;
+
+  FAIL_ON_ERROR(_yr_scanner_start(segment_scanner));
+
+  // The timeout is measured from the start of the whole scan.
+  segment_scanner->stopwatch = scanner->stopwatch;
+
+  // Strings disabled in "scanner", for instance by the guards, are disabled
+  // in the segment too. If no string was touched none is disabled.
+  if (scanner->num_dirty_strings > 0)
+  {
+    for (uint32_t i = 0; i < scanner->rules->num_strings; i++)
+    {
+      if (yr_bitmask_is_set(scanner->strings_temp_disabled, i))
+        yr_scan_disable_string(
+            segment_scanner, &scanner->rules->strings_table[i]);
+    }
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the scanner of a segment to the pool.
+//
+static void _yr_scanner_finish_segment(
+    YR_SCANNER* scanner,
+    SCAN_SEGMENT* segment)
+{
+  YR_SCANNER* segment_scanner = segment->scanner;
+
+  if (segment_scanner == NULL)
+    return;
+
+#ifdef YR_PROFILING_ENABLED
+  for (uint32_t i = 0; i < scanner->rules->num_rules; i++)
+  {
+    scanner->profiling_info[i].atom_matches +=
+        segment_scanner->profiling_info[i].atom_matches;
+    scanner->profiling_info[i].match_time +=
+        segment_scanner->profiling_info[i].match_time;
+  }
+#endif
+
+  _yr_scanner_finish(segment_scanner);
+
+  segment_scanner->defer_chained_matches = false;
+
+  yr_scanner_pool_release(scanner->rules->scanner_pool, segment_scanner);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Like _yr_scanner_scan_mem_block, but if the scanner is allowed to use more
+// than one thread the range [verify_start, verify_end) is split in segments
+// that are scanned in parallel by scanners taken from the pool. Once all the
+// segments are scanned their matches are merged into "scanner" in offset
+// order, and the result is the same as if the whole range was scanned by
+// "scanner" alone.
+//
+// Each segment is scanned over the whole block, so the verification of the
+// atoms found in a segment can use the data beyond it. The parts of string
+// chains can't be verified without knowing the matches found by preceding
+// segments, so they are only recorded by the segments and verified here
+// while merging, in the scan order.
+//
+static int _yr_scanner_scan_segments(
+    YR_SCANNER* scanner,
+    const uint8_t* block_data,
+    YR_MEMORY_BLOCK* block,
+    size_t verify_start,
+    size_t verify_end)
+{
+  SCAN_SEGMENT* segments;
+
+  // Atoms ending at block->size are verified too, so the last position that
+  // can be verified is block->size itself.
+  size_t range_end = yr_min(verify_end, block->size + 1);
+  size_t range = range_end > verify_start ? range_end - verify_start : 0;
+  size_t num_segments = range / YR_MIN_SCAN_SEGMENT_SIZE;
+  size_t segment_size;
+
+  int result = ERROR_SUCCESS;
+
+  if (scanner->num_threads < (int) num_segments)
+    num_segments = scanner->num_threads;
+
+  if (num_segments < 2)
+    return _yr_scanner_scan_mem_block(
+        scanner, block_data, block, verify_start, verify_end);
+
+  segments = (SCAN_SEGMENT*) yr_calloc(num_segments, sizeof(SCAN_SEGMENT));
+
+  if (segments == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  segment_size = range / num_segments;
+
+  for (size_t i = 0; i < num_segments; i++)
+  {
+    segments[i].block_data = block_data;
+    segments[i].block = block;
+    segments[i].verify_start = verify_start + i * segment_size;
+    segments[i].verify_end = i == num_segments - 1
+                                 ? verify_end
+                                 : verify_start + (i + 1) * segment_size;
+
+    GOTO_EXIT_ON_ERROR(_yr_scanner_start_segment(scanner, &segments[i]));
+  }
+
+  // The first segment is scanned by the current thread. If some thread can't
+  // be created its segment is scanned by the current thread too. The caller
+  // is responsible for handling exceptions in the current thread.
+  for (size_t i = 1; i < num_segments; i++)
+  {
+    segments[i].thread_created = yr_thread_create(
+                                     &segments[i].thread,
+                                     _yr_scanner_segment_thread,
+                                     &segments[i]) == ERROR_SUCCESS;
+  }
+
+  segments[0].result = _yr_scanner_scan_segment(&segments[0]);
+
+  for (size_t i = 1; i < num_segments; i++)
+  {
+    if (segments[i].thread_created)
+      yr_thread_join(&segments[i].thread);
+    else
+      segments[i].result = _yr_scanner_scan_segment(&segments[i]);
+  }
+
+  for (size_t i = 0; i < num_segments; i++)
+  {
+    result = segments[i].result;
+
+    if (result != ERROR_SUCCESS)
+    {
+      scanner->last_error_string = segments[i].scanner->last_error_string;
+      break;
+    }
+
+    result = yr_scan_merge_segment(
+        scanner, segments[i].scanner, block_data, block->size, block->base);
+
+    if (result != ERROR_SUCCESS)
+      break;
+  }
+
+_exit:
+
+  for (size_t i = 0; i < num_segments; i++)
+    _yr_scanner_finish_segment(scanner, &segments[i]);
+
+  yr_free(segments);
+
+  return result;
 }
 
 YR_API int yr_scanner_create(YR_RULES* rules, YR_SCANNER** scanner)
@@ -218,6 +788,7 @@ YR_API int yr_scanner_create(YR_RULES* rules, YR_SCANNER** scanner)
       yr_free(new_scanner));
 
   new_scanner->rules = rules;
+  new_scanner->num_threads = 1;
   new_scanner->entry_point = YR_UNDEFINED;
   new_scanner->file_size = YR_UNDEFINED;
   new_scanner->canary = rand();
@@ -241,6 +812,16 @@ YR_API int yr_scanner_create(YR_RULES* rules, YR_SCANNER** scanner)
   new_scanner->unconfirmed_matches = (YR_MATCHES*) yr_calloc(
       rules->num_strings, sizeof(YR_MATCHES));
 
+  new_scanner->strings_dirty = (YR_BITMASK*) yr_calloc(
+      sizeof(YR_BITMASK), YR_BITMASK_SIZE(rules->num_strings));
+
+  // Resetting a single string is more expensive than resetting it as part of
+  // a memset covering the whole array, so the list of dirty strings is only
+  // worth keeping while it's small compared with the number of strings.
+  new_scanner->max_dirty_strings = rules->num_strings / 8;
+  new_scanner->dirty_strings = (uint32_t*) yr_calloc(
+      new_scanner->max_dirty_strings + 1, sizeof(uint32_t));
+
 #ifdef YR_PROFILING_ENABLED
   new_scanner->profiling_info = yr_calloc(
       rules->num_rules, sizeof(YR_PROFILING_INFO));
@@ -321,6 +902,12 @@ YR_API void yr_scanner_destroy(YR_SCANNER* scanner)
   yr_free(scanner->strings_temp_disabled);
   yr_free(scanner->matches);
   yr_free(scanner->unconfirmed_matches);
+  yr_free(scanner->strings_dirty);
+  yr_free(scanner->dirty_strings);
+  yr_free(scanner->overlap_buffer);
+  yr_free(scanner->stream_head);
+  yr_free(scanner->deferred_matches);
+  yr_free(scanner->match_index);
   yr_free(scanner);
 }
 
@@ -339,6 +926,18 @@ YR_API void yr_scanner_set_timeout(YR_SCANNER* scanner, int timeout)
   scanner->timeout = timeout * 1000000000ULL;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Sets the number of threads used for scanning each memory block. Blocks of
+// at least twice YR_MIN_SCAN_SEGMENT_SIZE bytes are split in up to that number
+// of segments that are scanned in parallel, the matches found are the same
+// as with a single thread. The additional threads use scanners taken from the
+// scanner pool of the rules.
+//
+YR_API void yr_scanner_set_threads(YR_SCANNER* scanner, int threads)
+{
+  scanner->num_threads = threads > 0 ? threads : 1;
+}
+
 YR_API void yr_scanner_set_flags(YR_SCANNER* scanner, int flags)
 {
   // For backward compatibility, if neither SCAN_FLAGS_REPORT_RULES_MATCHING
@@ -419,11 +1018,9 @@ YR_API int yr_scanner_scan_mem_blocks(
 {
   YR_DEBUG_FPRINTF(2, stderr, "+ %s() {\n", __FUNCTION__);
 
-  YR_RULES* rules;
-  YR_RULE* rule;
   YR_MEMORY_BLOCK* block;
 
-  int i, result = ERROR_SUCCESS;
+  int result = ERROR_SUCCESS;
 
   if (scanner->callback == NULL)
   {
@@ -432,7 +1029,6 @@ YR_API int yr_scanner_scan_mem_blocks(
   }
 
   scanner->iterator = iterator;
-  rules = scanner->rules;
 
   if (iterator->last_error == ERROR_BLOCK_NOT_READY)
   {
@@ -442,24 +1038,14 @@ YR_API int yr_scanner_scan_mem_blocks(
   }
   else
   {
-    // Create the notebook that will hold the YR_MATCH structures representing
-    // each match found. This notebook will also contain snippets of the
-    // matching data (the "data" field in YR_MATCH points to the snippet
-    // corresponding to the match). Each notebook's page can store up to 1024
-    // matches.
-    uint32_t max_match_data;
-
-    FAIL_ON_ERROR(
-        yr_get_configuration_uint32(YR_CONFIG_MAX_MATCH_DATA, &max_match_data));
+    result = _yr_scanner_start(scanner);
 
-    result = yr_notebook_create(
-        1024 * (sizeof(YR_MATCH) + max_match_data), &scanner->matches_notebook);
+    if (result == ERROR_SUCCESS)
+      result = _yr_scanner_evaluate_guards(scanner, iterator);
 
     if (result != ERROR_SUCCESS)
       goto _exit;
 
-    yr_stopwatch_start(&scanner->stopwatch);
-
     block = iterator->first(iterator);
   }
 
@@ -489,10 +1075,24 @@ YR_API int yr_scanner_scan_mem_blocks(
           {});
     }
 
-    YR_TRYCATCH(
-        !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
-        { result = _yr_scanner_scan_mem_block(scanner, data, block); },
-        { result = ERROR_COULD_NOT_MAP_FILE; });
+    if (scanner->flags & SCAN_FLAGS_CONTIGUOUS_BLOCKS)
+    {
+      YR_TRYCATCH(
+          !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
+          { result = _yr_scanner_scan_contiguous_block(scanner, data, block); },
+          { result = ERROR_COULD_NOT_MAP_FILE; });
+    }
+    else
+    {
+      YR_TRYCATCH(
+          !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
+          {
+            scanner->contiguous_base = block->base;
+            result = _yr_scanner_scan_segments(
+                scanner, data, block, 0, SIZE_MAX);
+          },
+          { result = ERROR_COULD_NOT_MAP_FILE; });
+    }
 
     if (result != ERROR_SUCCESS)
       goto _exit;
@@ -502,6 +1102,14 @@ YR_API int yr_scanner_scan_mem_blocks(
 
   result = iterator->last_error;
 
+  if (result != ERROR_SUCCESS)
+    goto _exit;
+
+  // Verify the atoms that are still pending at the end of the last block.
+  // This scans the copy in the overlap buffer, the block's data could be
+  // gone by now.
+  result = _yr_scanner_flush_overlap(scanner);
+
   if (result != ERROR_SUCCESS)
     goto _exit;
 
@@ -512,47 +1120,7 @@ YR_API int yr_scanner_scan_mem_blocks(
   else
     scanner->file_size = YR_UNDEFINED;
 
-  YR_TRYCATCH(
-      !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
-      { result = yr_execute_code(scanner); },
-      { result = ERROR_COULD_NOT_MAP_FILE; });
-
-  if (result != ERROR_SUCCESS)
-    goto _exit;
-
-  for (i = 0, rule = rules->rules_table; !RULE_IS_NULL(rule); i++, rule++)
-  {
-    int message = 0;
-
-    if (yr_bitmask_is_set(scanner->rule_matches_flags, i) &&
-        yr_bitmask_is_not_set(scanner->ns_unsatisfied_flags, rule->ns->idx))
-    {
-      if (scanner->flags & SCAN_FLAGS_REPORT_RULES_MATCHING)
-        message = CALLBACK_MSG_RULE_MATCHING;
-    }
-    else
-    {
-      if (scanner->flags & SCAN_FLAGS_REPORT_RULES_NOT_MATCHING)
-        message = CALLBACK_MSG_RULE_NOT_MATCHING;
-    }
-
-    if (message != 0 && !RULE_IS_PRIVATE(rule))
-    {
-      switch (scanner->callback(scanner, message, rule, scanner->user_data))
-      {
-      case CALLBACK_ABORT:
-        result = ERROR_SUCCESS;
-        goto _exit;
-
-      case CALLBACK_ERROR:
-        result = ERROR_CALLBACK_ERROR;
-        goto _exit;
-      }
-    }
-  }
-
-  scanner->callback(
-      scanner, CALLBACK_MSG_SCAN_FINISHED, NULL, scanner->user_data);
+  result = _yr_scanner_evaluate_rules(scanner);
 
 _exit:
 
@@ -560,15 +1128,7 @@ _exit:
   // destroy the notebook yet. ERROR_BLOCK_NOT_READY is not a permament error,
   // the caller can still call this function again for a retry.
   if (result != ERROR_BLOCK_NOT_READY)
-  {
-    _yr_scanner_clean_matches(scanner);
-
-    if (scanner->matches_notebook != NULL)
-    {
-      yr_notebook_destroy(scanner->matches_notebook);
-      scanner->matches_notebook = NULL;
-    }
-  }
+    _yr_scanner_finish(scanner);
 
   YR_DEBUG_FPRINTF(
       2,
@@ -717,6 +1277,353 @@ YR_API int yr_scanner_scan_proc(YR_SCANNER* scanner, int pid)
   return result;
 }
 
+static YR_MEMORY_BLOCK* _yr_get_next_stream_block(
+    YR_MEMORY_BLOCK_ITERATOR* iterator)
+{
+  YR_SCANNER* scanner = (YR_SCANNER*) iterator->context;
+
+  if (scanner->stream_next_block >= scanner->stream_num_blocks)
+    return NULL;
+
+  return &scanner->stream_blocks[scanner->stream_next_block++];
+}
+
+static YR_MEMORY_BLOCK* _yr_get_first_stream_block(
+    YR_MEMORY_BLOCK_ITERATOR* iterator)
+{
+  YR_SCANNER* scanner = (YR_SCANNER*) iterator->context;
+
+  scanner->stream_next_block = 0;
+
+  return _yr_get_next_stream_block(iterator);
+}
+
+static uint64_t _yr_get_stream_size(YR_MEMORY_BLOCK_ITERATOR* iterator)
+{
+  return ((YR_SCANNER*) iterator->context)->stream_size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Starts scanning a stream of data that is passed to the scanner in chunks
+// with yr_scanner_scan_feed. The rules are evaluated when yr_scanner_scan_end
+// is called, and the callback is invoked from there. The stream is scanned as
+// with SCAN_FLAGS_CONTIGUOUS_BLOCKS, so matches crossing the boundary between
+// two chunks are found.
+//
+// Only a bounded amount of data is kept by the scanner: the first
+// YR_SCAN_STREAM_HEAD_SIZE bytes of the stream, and the last bytes that were
+// fed. Conditions and modules accessing data outside those ranges (like
+// uint32(offset) with a large offset) behave as if the data was not
+// available.
+//
+YR_API int yr_scanner_scan_begin(YR_SCANNER* scanner)
+{
+  if (scanner->callback == NULL)
+    return ERROR_CALLBACK_REQUIRED;
+
+  if (scanner->stream_head == NULL)
+  {
+    scanner->stream_head = (uint8_t*) yr_malloc(YR_SCAN_STREAM_HEAD_SIZE);
+
+    if (scanner->stream_head == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+  }
+
+  if (scanner->stream_active)
+    _yr_scanner_finish(scanner);
+
+  FAIL_ON_ERROR(_yr_scanner_start(scanner));
+
+  scanner->stream_active = true;
+  scanner->stream_size = 0;
+  scanner->stream_head_length = 0;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scans the next chunk of a stream started with yr_scanner_scan_begin. The
+// buffer is not used after this function returns. If the function fails the
+// scan is aborted, and there's no need to call yr_scanner_scan_end.
+//
+YR_API int yr_scanner_scan_feed(
+    YR_SCANNER* scanner,
+    const uint8_t* buffer,
+    size_t buffer_size)
+{
+  YR_MEMORY_BLOCK block;
+
+  int result;
+
+  if (!scanner->stream_active)
+    return ERROR_INVALID_ARGUMENT;
+
+  if (scanner->stream_head_length < YR_SCAN_STREAM_HEAD_SIZE)
+  {
+    size_t length = yr_min(
+        buffer_size, YR_SCAN_STREAM_HEAD_SIZE - scanner->stream_head_length);
+
+    memcpy(scanner->stream_head + scanner->stream_head_length, buffer, length);
+
+    scanner->stream_head_length += length;
+  }
+
+  block.base = scanner->stream_size;
+  block.size = buffer_size;
+
+  YR_TRYCATCH(
+      !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
+      { result = _yr_scanner_scan_contiguous_block(scanner, buffer, &block); },
+      { result = ERROR_COULD_NOT_MAP_FILE; });
+
+  scanner->stream_size += buffer_size;
+
+  if (result != ERROR_SUCCESS)
+  {
+    scanner->stream_active = false;
+    _yr_scanner_finish(scanner);
+  }
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Finishes the scan of a stream started with yr_scanner_scan_begin. The
+// rules are evaluated and the callback is invoked for them, exactly as
+// yr_scanner_scan_mem does. filesize is the total size of the data fed.
+//
+YR_API int yr_scanner_scan_end(YR_SCANNER* scanner)
+{
+  int result;
+
+  if (!scanner->stream_active)
+    return ERROR_INVALID_ARGUMENT;
+
+  scanner->stream_active = false;
+
+  size_t tail_length = scanner->overlap_length;
+  uint64_t tail_base = scanner->overlap_end - tail_length;
+
+  result = _yr_scanner_flush_overlap(scanner);
+
+  if (result != ERROR_SUCCESS)
+    goto _exit;
+
+  // The data kept by the scanner is exposed to conditions and modules as at
+  // most two blocks, the head of the stream and the part of the tail that
+  // doesn't overlap with it.
+  scanner->stream_blocks[0].base = 0;
+  scanner->stream_blocks[0].size = scanner->stream_head_length;
+  scanner->stream_blocks[0].context = scanner->stream_head;
+  scanner->stream_blocks[0].fetch_data = _yr_fetch_block_data;
+  scanner->stream_num_blocks = 1;
+
+  if (tail_length > 0 &&
+      tail_base + tail_length > scanner->stream_head_length)
+  {
+    size_t skip = 0;
+
+    if (tail_base < scanner->stream_head_length)
+      skip = (size_t) (scanner->stream_head_length - tail_base);
+
+    scanner->stream_blocks[1].base = tail_base + skip;
+    scanner->stream_blocks[1].size = tail_length - skip;
+    scanner->stream_blocks[1].context = scanner->overlap_buffer + skip;
+    scanner->stream_blocks[1].fetch_data = _yr_fetch_block_data;
+    scanner->stream_num_blocks = 2;
+  }
+
+  scanner->stream_iterator.context = scanner;
+  scanner->stream_iterator.first = _yr_get_first_stream_block;
+  scanner->stream_iterator.next = _yr_get_next_stream_block;
+  scanner->stream_iterator.file_size = _yr_get_stream_size;
+  scanner->stream_iterator.last_error = ERROR_SUCCESS;
+
+  scanner->iterator = &scanner->stream_iterator;
+  scanner->file_size = scanner->stream_size;
+  scanner->entry_point = yr_get_entry_point_offset(
+      scanner->stream_head, scanner->stream_head_length);
+
+  result = _yr_scanner_evaluate_rules(scanner);
+
+_exit:
+
+  _yr_scanner_finish(scanner);
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Puts a scanner that was used before in the same state as a newly created
+// one. External variables get the values currently defined in the rules,
+// which may have changed with yr_rules_define_xxx_variable since the scanner
+// was created.
+//
+static int _yr_scanner_reset(YR_SCANNER* scanner)
+{
+  YR_EXTERNAL_VARIABLE* external = scanner->rules->ext_vars_table;
+
+  if (scanner->stream_active || scanner->matches_notebook != NULL)
+  {
+    scanner->stream_active = false;
+    _yr_scanner_finish(scanner);
+  }
+
+  scanner->callback = NULL;
+  scanner->user_data = NULL;
+  scanner->timeout = 0;
+  scanner->num_threads = 1;
+  scanner->entry_point = YR_UNDEFINED;
+  scanner->file_size = YR_UNDEFINED;
+  scanner->last_error_string = NULL;
+  scanner->flags = SCAN_FLAGS_REPORT_RULES_MATCHING |
+                   SCAN_FLAGS_REPORT_RULES_NOT_MATCHING;
+
+#ifdef YR_PROFILING_ENABLED
+  yr_scanner_reset_profiling_info(scanner);
+#endif
+
+  while (!EXTERNAL_VARIABLE_IS_NULL(external))
+  {
+    YR_OBJECT* obj = (YR_OBJECT*) yr_hash_table_lookup(
+        scanner->objects_table, external->identifier, NULL);
+
+    switch (external->type)
+    {
+    case EXTERNAL_VARIABLE_TYPE_INTEGER:
+    case EXTERNAL_VARIABLE_TYPE_BOOLEAN:
+      FAIL_ON_ERROR(yr_object_set_integer(external->value.i, obj, NULL));
+      break;
+
+    case EXTERNAL_VARIABLE_TYPE_FLOAT:
+      FAIL_ON_ERROR(yr_object_set_float(external->value.f, obj, NULL));
+      break;
+
+    case EXTERNAL_VARIABLE_TYPE_STRING:
+    case EXTERNAL_VARIABLE_TYPE_MALLOC_STRING:
+      FAIL_ON_ERROR(yr_object_set_string(
+          external->value.s, strlen(external->value.s), obj, NULL));
+      break;
+    }
+
+    external++;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates a pool that keeps up to "capacity" idle scanners for the given
+// rules. Scanning many small inputs with scanners taken from the pool avoids
+// allocating and initializing a new scanner for each of them.
+//
+// Args:
+//   rules: Rules used by the scanners in the pool.
+//   capacity: Maximum number of idle scanners kept by the pool. More scanners
+//     can be acquired at the same time, but the ones that don't fit in the
+//     pool are destroyed when released.
+//   pool: Address of a pointer that receives the new pool.
+//
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_INSUFFICIENT_MEMORY
+//   ERROR_INTERNAL_FATAL_ERROR
+//
+YR_API int yr_scanner_pool_create(
+    YR_RULES* rules,
+    uint32_t capacity,
+    YR_SCANNER_POOL** pool)
+{
+  YR_SCANNER_POOL* new_pool = (YR_SCANNER_POOL*) yr_calloc(
+      1, sizeof(YR_SCANNER_POOL));
+
+  if (new_pool == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  new_pool->scanners = (YR_SCANNER**) yr_calloc(
+      capacity > 0 ? capacity : 1, sizeof(YR_SCANNER*));
+
+  if (new_pool->scanners == NULL)
+  {
+    yr_free(new_pool);
+    return ERROR_INSUFFICIENT_MEMORY;
+  }
+
+  FAIL_ON_ERROR_WITH_CLEANUP(
+      yr_mutex_create(&new_pool->mutex),
+      // cleanup
+      yr_free(new_pool->scanners);
+      yr_free(new_pool));
+
+  new_pool->rules = rules;
+  new_pool->capacity = capacity;
+
+  *pool = new_pool;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Destroys a pool and the idle scanners in it. Scanners that were acquired
+// and not released yet must be destroyed with yr_scanner_destroy.
+//
+YR_API void yr_scanner_pool_destroy(YR_SCANNER_POOL* pool)
+{
+  for (uint32_t i = 0; i < pool->count; i++)
+    yr_scanner_destroy(pool->scanners[i]);
+
+  yr_mutex_destroy(&pool->mutex);
+  yr_free(pool->scanners);
+  yr_free(pool);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Takes an idle scanner from the pool, or creates a new one if the pool is
+// empty. The scanner is in the same state as one created with
+// yr_scanner_create, and it should be returned with yr_scanner_pool_release.
+//
+YR_API int yr_scanner_pool_acquire(YR_SCANNER_POOL* pool, YR_SCANNER** scanner)
+{
+  YR_SCANNER* idle_scanner = NULL;
+
+  yr_mutex_lock(&pool->mutex);
+
+  if (pool->count > 0)
+    idle_scanner = pool->scanners[--pool->count];
+
+  yr_mutex_unlock(&pool->mutex);
+
+  if (idle_scanner == NULL)
+    return yr_scanner_create(pool->rules, scanner);
+
+  FAIL_ON_ERROR_WITH_CLEANUP(
+      _yr_scanner_reset(idle_scanner), yr_scanner_destroy(idle_scanner));
+
+  *scanner = idle_scanner;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns to the pool a scanner obtained with yr_scanner_pool_acquire. If the
+// pool is full the scanner is destroyed.
+//
+YR_API void yr_scanner_pool_release(YR_SCANNER_POOL* pool, YR_SCANNER* scanner)
+{
+  yr_mutex_lock(&pool->mutex);
+
+  if (pool->count < pool->capacity)
+  {
+    pool->scanners[pool->count++] = scanner;
+    scanner = NULL;
+  }
+
+  yr_mutex_unlock(&pool->mutex);
+
+  if (scanner != NULL)
+    yr_scanner_destroy(scanner);
+}
+
 YR_API YR_STRING* yr_scanner_last_error_string(YR_SCANNER* scanner)
 {
   return scanner->last_error_string;
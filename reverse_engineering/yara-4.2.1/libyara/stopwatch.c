@@ -31,14 +31,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #if defined(_WIN32)
 
-void yr_stopwatch_start(YR_STOPWATCH* sw)
+YR_API void yr_stopwatch_start(YR_STOPWATCH* sw)
 {
   QueryPerformanceFrequency(&sw->frequency);
   QueryPerformanceCounter(&sw->start);
 }
 
 
-uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* sw)
+YR_API uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* sw)
 {
   LARGE_INTEGER li;
 
@@ -51,14 +51,14 @@ uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* sw)
 
 #elif defined(__APPLE__) && defined(__MACH__)
 
-void yr_stopwatch_start(YR_STOPWATCH* sw)
+YR_API void yr_stopwatch_start(YR_STOPWATCH* sw)
 {
   mach_timebase_info(&sw->timebase);
   sw->start = mach_absolute_time();
 }
 
 
-uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* sw)
+YR_API uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* sw)
 {
   uint64_t now = mach_absolute_time();
   return ((now - sw->start) * sw->timebase.numer) / sw->timebase.denom;
@@ -80,13 +80,13 @@ uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* sw)
   } while (0)
 
 
-void yr_stopwatch_start(YR_STOPWATCH* stopwatch)
+YR_API void yr_stopwatch_start(YR_STOPWATCH* stopwatch)
 {
   clock_gettime(CLOCK_MONOTONIC, &stopwatch->ts_start);
 }
 
 
-uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* stopwatch)
+YR_API uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* stopwatch)
 {
   struct timespec ts_stop;
   struct timespec ts_elapsed;
@@ -114,13 +114,13 @@ uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* stopwatch)
   } while (0)
 
 
-void yr_stopwatch_start(YR_STOPWATCH* stopwatch)
+YR_API void yr_stopwatch_start(YR_STOPWATCH* stopwatch)
 {
   gettimeofday(&stopwatch->tv_start, NULL);
 }
 
 
-uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* stopwatch)
+YR_API uint64_t yr_stopwatch_elapsed_ns(YR_STOPWATCH* stopwatch)
 {
   struct timeval tv_stop;
   struct timeval tv_elapsed;
@@ -111,6 +111,32 @@ void* yr_thread_storage_get_value(YR_THREAD_STORAGE_KEY* storage)
 }
 
 
+int yr_thread_create(
+    YR_THREAD* thread,
+    YR_THREAD_START_ROUTINE start_routine,
+    void* param)
+{
+  *thread = CreateThread(NULL, 0, start_routine, param, 0, NULL);
+
+  if (*thread == NULL)
+    return ERROR_INTERNAL_FATAL_ERROR;
+
+  return ERROR_SUCCESS;
+}
+
+
+int yr_thread_join(YR_THREAD* thread)
+{
+  if (WaitForSingleObject(*thread, INFINITE) == WAIT_FAILED)
+    return ERROR_INTERNAL_FATAL_ERROR;
+
+  if (CloseHandle(*thread) == FALSE)
+    return ERROR_INTERNAL_FATAL_ERROR;
+
+  return ERROR_SUCCESS;
+}
+
+
 #else  // POSIX implementation
 
 
@@ -188,4 +214,25 @@ void* yr_thread_storage_get_value(YR_THREAD_STORAGE_KEY* storage)
   return pthread_getspecific(*storage);
 }
 
+
+int yr_thread_create(
+    YR_THREAD* thread,
+    YR_THREAD_START_ROUTINE start_routine,
+    void* param)
+{
+  if (pthread_create(thread, NULL, start_routine, param) != 0)
+    return ERROR_INTERNAL_FATAL_ERROR;
+
+  return ERROR_SUCCESS;
+}
+
+
+int yr_thread_join(YR_THREAD* thread)
+{
+  if (pthread_join(*thread, NULL) != 0)
+    return ERROR_INTERNAL_FATAL_ERROR;
+
+  return ERROR_SUCCESS;
+}
+
 #endif
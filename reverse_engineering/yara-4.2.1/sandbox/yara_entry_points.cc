@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <memory>
@@ -107,6 +108,26 @@ static auto* g_results GUARDED_BY(g_results_mutex) =
 ABSL_CONST_INIT static absl::Mutex g_rules_mutex(absl::kConstInit);
 static YR_RULES* g_rules GUARDED_BY(g_rules_mutex) = nullptr;
 
+// Replaces the global YARA rules set, waiting for all the scans using the
+// current one to finish. Returns the number of rules in the new set.
+static int ReplaceRules(YR_RULES* rules)
+{
+  int num_rules = 0;
+  YR_RULE* rule;
+  yr_rules_foreach(rules, rule) { ++num_rules; }
+
+  absl::MutexLock lock(&g_rules_mutex);
+
+  if (g_rules)
+  {
+    yr_rules_destroy(g_rules);
+  }
+
+  g_rules = rules;
+
+  return num_rules;
+}
+
 void ScanWorker()
 {
   while (true)
@@ -154,8 +175,13 @@ void ScanWorker()
 extern "C" void YaraInitWorkers(int num_workers)
 {
   const int num_threads = std::min(
-      static_cast<unsigned int>(std::min(num_workers, YR_MAX_THREADS)),
-      std::thread::hardware_concurrency());
+      static_cast<unsigned int>(std::max(num_workers, 1)),
+      std::max(std::thread::hardware_concurrency(), 1u));
+
+  // Let the scanner pool of the rules loaded from now on keep an idle scanner
+  // for each worker.
+  yr_set_configuration_uint32(
+      YR_CONFIG_MAX_THREADS, static_cast<uint32_t>(num_threads));
 
   static auto* workers = new std::vector<std::thread>();
   workers->reserve(num_threads);
@@ -211,20 +237,33 @@ extern "C" int YaraLoadRules(const char* rule_string, YaraStatus* error_status)
     return 0;
   }
 
-  int num_rules = 0;
-  YR_RULE* rule;
-  yr_rules_foreach(rules, rule) { ++num_rules; }
+  return ReplaceRules(rules);
+}
 
-  absl::MutexLock lock(&g_rules_mutex);
+// Initializes the global YARA rules set from a shared memory object where the
+// host code published compiled rules with yr_rules_publish_fd(). The rules are
+// not copied, all the sandboxees attached to the same object share them.
+// Takes ownership of rules_fd. Returns the number of rules attached. Extended
+// error information can be found in status if it is not nullptr.
+extern "C" int YaraAttachRules(int rules_fd, YaraStatus* error_status)
+{
+  YR_RULES* rules = nullptr;
+  int error = yr_rules_attach_fd(rules_fd, &rules);
 
-  if (g_rules)
+  close(rules_fd);
+
+  if (error != ERROR_SUCCESS)
   {
-    yr_rules_destroy(g_rules);
+    if (error_status)
+    {
+      error_status->set_code(error);
+      error_status->set_message(
+          absl::StrCat("yr_rules_attach_fd() failed with code: ", error));
+    }
+    return 0;
   }
 
-  g_rules = rules;
-
-  return num_rules;
+  return ReplaceRules(rules);
 }
 
 // Schedules a new asynchronous YARA scan task on the data in the specified file
@@ -80,6 +80,34 @@ absl::Mutex YaraTransaction::mutex_(absl::kConstInit);
   return num_rules;
 }
 
+::sapi::StatusOr<int> YaraTransaction::AttachRules(int rules_fd)
+{
+  absl::MutexLock lock(&mutex_);
+  sandbox::YaraApi api(sandbox());
+
+  ::sapi::v::Fd rules_fd_sapi(rules_fd);
+  SAPI_RETURN_IF_ERROR(sandbox()->TransferToSandboxee(&rules_fd_sapi));
+  rules_fd_sapi.OwnLocalFd(false);   // To be closed by caller
+  rules_fd_sapi.OwnRemoteFd(false);  // Sandboxee will close
+
+  YaraStatus error_status;
+  ::sapi::v::Proto<YaraStatus> error_status_sapi(error_status);
+  SAPI_ASSIGN_OR_RETURN(
+      int num_rules,
+      api.YaraAttachRules(
+          rules_fd_sapi.GetRemoteFd(), error_status_sapi.PtrBoth()));
+  if (num_rules <= 0)
+  {
+    auto error_status_copy = error_status_sapi.GetProtoCopy();
+    if (!error_status_copy)
+    {
+      return absl::UnknownError("Deserialization of response failed");
+    }
+    return absl::InvalidArgumentError(error_status_copy->message());
+  }
+  return num_rules;
+}
+
 ::sapi::StatusOr<YaraMatches> YaraTransaction::ScanFd(int fd)
 {
   int local_event_fd = eventfd(0 /* initval */, 0 /* flags */);
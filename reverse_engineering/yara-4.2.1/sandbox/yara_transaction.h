@@ -62,6 +62,7 @@ class YaraSandbox : public sandbox::YaraSandbox {
             __NR_mprotect,
             __NR_munlock,
             __NR_poll,
+            __NR_pread64,
             __NR_sched_getparam,
             __NR_sched_getscheduler,
             __NR_sched_yield,
@@ -110,6 +111,13 @@ class YaraTransaction : public ::sapi::Transaction {
   ::sapi::StatusOr<int> LoadRules(const std::string& rule_string)
       LOCKS_EXCLUDED(mutex_);
 
+  // Like LoadRules(), but uses compiled rules that were published with
+  // yr_rules_publish_fd() into the shared memory object referred by rules_fd,
+  // like a memfd. The rules are not copied into the sandboxee, so the same
+  // object can be used by many transactions without increasing their memory
+  // usage. The file descriptor is not closed.
+  ::sapi::StatusOr<int> AttachRules(int rules_fd) LOCKS_EXCLUDED(mutex_);
+
   // Scans the contents of the specified file descriptor.
   // Returns DeadlineExceededError if the scan timed out.
   ::sapi::StatusOr<YaraMatches> ScanFd(int fd) LOCKS_EXCLUDED(mutex_);
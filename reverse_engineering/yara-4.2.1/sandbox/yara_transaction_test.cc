@@ -40,6 +40,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "absl/strings/str_cat.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "libyara/include/yara.h"
 #include "sandbox/yara_matches.pb.h"
 #include "sandboxed_api/util/status_matchers.h"
 #include "sandboxed_api/util/statusor.h"
@@ -163,6 +164,53 @@ TEST_F(TransactionTest, BasicFunctionality)
   EXPECT_THAT(matches.match(1).id().rule_name(), StrEq("Keyboard"));
 }
 
+TEST_F(TransactionTest, AttachRules)
+{
+  // Compile the rules in the host and publish them into an empty memfd.
+  ASSERT_THAT(yr_initialize(), Eq(ERROR_SUCCESS));
+
+  YR_COMPILER* compiler;
+  ASSERT_THAT(yr_compiler_create(&compiler), Eq(ERROR_SUCCESS));
+  ASSERT_THAT(
+      yr_compiler_add_string(
+          compiler,
+          R"(
+    rule Number {
+      strings:   $ = "123"
+      condition: all of them
+    }
+    rule Color {
+      strings:   $ = "green"
+      condition: all of them
+    })",
+          nullptr),
+      Eq(0));
+
+  YR_RULES* rules;
+  ASSERT_THAT(yr_compiler_get_rules(compiler, &rules), Eq(ERROR_SUCCESS));
+  yr_compiler_destroy(compiler);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(MemoryFD rules_fd, MemoryFD::CreateWithContent(""));
+  ASSERT_THAT(
+      yr_rules_publish_fd(rules, rules_fd.fd(), nullptr), Eq(ERROR_SUCCESS));
+  yr_rules_destroy(rules);
+  yr_finalize();
+
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      int num_rules, transaction_->AttachRules(rules_fd.fd()));
+  EXPECT_THAT(num_rules, Eq(2));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(YaraMatches matches, ScanString("green 123"));
+  EXPECT_THAT(matches.match_size(), Eq(2));
+  EXPECT_THAT(matches.match(0).id().rule_name(), StrEq("Number"));
+  EXPECT_THAT(matches.match(1).id().rule_name(), StrEq("Color"));
+
+  // Anything that wasn't published with yr_rules_publish_fd() is rejected.
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      MemoryFD invalid_fd, MemoryFD::CreateWithContent("not rules"));
+  EXPECT_FALSE(transaction_->AttachRules(invalid_fd.fd()).ok());
+}
+
 TEST_F(TransactionTest, ConcurrentScanStressTest)
 {
   ASSERT_THAT(
@@ -0,0 +1,195 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+//
+// Measures how long it takes to compile a set of rules after changing some of
+// them, with and without a compiler cache (see yr_compiler_set_cache).
+//
+// By default it generates a set of 20000 rules, and compiles it after changing
+// 0, 1, 10, 100 and 1000 rules. Run it with -h for the options.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <yara.h>
+
+#include "bench.h"
+#include "util.h"
+
+// Rules that are changed get a different "version" in their condition.
+static void generate_rules(
+    BENCH_TEXT* text,
+    int num_rules,
+    int num_changed,
+    int version)
+{
+  uint32_t seed = 0x1234;
+
+  for (int i = 0; i < num_rules; i++)
+  {
+    uint8_t string[16];
+    int length = 8 + bench_random(&seed) % 9;
+
+    bench_random_fill(&seed, string, length, 1);
+
+    bench_text_printf(
+        text,
+        "rule r%d {\n"
+        "  meta:\n"
+        "    id = %d\n"
+        "  strings:\n"
+        "    $a = \"%.*s\"\n"
+        "    $b = { %02X %02X [0-2] %02X %02X }\n"
+        "    $c = /%.*s[0-9]{1,4}/\n"
+        "  condition:\n"
+        "    any of them and filesize > %d\n"
+        "}\n",
+        i,
+        i,
+        length,
+        string,
+        string[0],
+        string[1],
+        string[2],
+        string[3],
+        length / 2,
+        string,
+        i < num_changed ? version : 0);
+  }
+}
+
+static double compile(
+    YR_COMPILER_CACHE* cache,
+    int num_rules,
+    int num_changed,
+    int version)
+{
+  BENCH_TEXT source = {0};
+  YR_COMPILER* compiler;
+  YR_RULES* rules;
+
+  generate_rules(&source, num_rules, num_changed, version);
+
+  double start = bench_now();
+
+  if (yr_compiler_create(&compiler) != ERROR_SUCCESS)
+    exit(EXIT_FAILURE);
+
+  if (cache != NULL && yr_compiler_set_cache(compiler, cache) != ERROR_SUCCESS)
+    exit(EXIT_FAILURE);
+
+  if (yr_compiler_add_string(compiler, source.data, NULL) != 0 ||
+      yr_compiler_get_rules(compiler, &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "failed to compile rules\n");
+    exit(EXIT_FAILURE);
+  }
+
+  yr_compiler_destroy(compiler);
+
+  double elapsed = bench_now() - start;
+
+  yr_rules_destroy(rules);
+  bench_text_destroy(&source);
+
+  return elapsed;
+}
+
+static void usage(void)
+{
+  printf(
+      "usage: bench-compile [options]\n"
+      "  -n <number>   number of rules (default 20000)\n"
+      "  -c <number>   number of changed rules, the default is measuring\n"
+      "                0, 1, 10, 100 and 1000 changed rules\n");
+}
+
+int main(int argc, char** argv)
+{
+  int num_rules = 20000;
+  int num_changed = -1;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:c:h")) != -1)
+  {
+    switch (c)
+    {
+    case 'n':
+      num_rules = atoi(optarg);
+      break;
+    case 'c':
+      num_changed = atoi(optarg);
+      break;
+    default:
+      usage();
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (yr_initialize() != ERROR_SUCCESS)
+    return EXIT_FAILURE;
+
+  YR_COMPILER_CACHE* cache;
+
+  if (yr_compiler_cache_create(&cache) != ERROR_SUCCESS)
+    return EXIT_FAILURE;
+
+  int default_changed[] = {0, 1, 10, 100, 1000};
+  int n = num_changed >= 0 ? 1 : 5;
+
+  if (num_changed >= 0)
+    default_changed[0] = num_changed;
+
+  printf("%d rules\n\n", num_rules);
+  printf("%-16s %12s %12s\n", "changed rules", "no cache", "cache");
+
+  // The first compilation fills the cache.
+  compile(cache, num_rules, 0, 0);
+
+  for (int i = 0; i < n; i++)
+  {
+    // Each compilation uses a different version of the changed rules, so
+    // that they are never found in the cache.
+    double without_cache = compile(NULL, num_rules, default_changed[i], i + 1);
+    double with_cache = compile(cache, num_rules, default_changed[i], i + 1);
+
+    printf(
+        "%-16d %10.3f s %10.3f s\n",
+        default_changed[i],
+        without_cache,
+        with_cache);
+  }
+
+  yr_compiler_cache_destroy(cache);
+  yr_finalize();
+
+  return EXIT_SUCCESS;
+}
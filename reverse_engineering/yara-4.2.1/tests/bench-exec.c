@@ -0,0 +1,542 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+//
+// Measures the time spent by yr_execute_code in conditions that don't depend
+// on strings, like those with loops, arithmetic, uintN() reads and calls to
+// module functions.
+//
+// By default it generates two sets of 1000 rules, one with loops, arithmetic
+// and uintN() reads, and another one mixing calls to functions in the "tests"
+// module with arithmetic. No rule matches, so every condition is evaluated
+// completely. A small buffer is scanned many times and the time per scan is
+// reported. Run it with -h for the options.
+//
+// It also measures conditions that look up the matches of a string with
+// many matches, like "@a[i]", "!a[i]", "$a at", "$a in" and "#a in", which
+// use the match index built by yr_scan_get_match_index. Before measuring
+// them it checks that they produce the same results that are obtained by
+// walking the list of matches.
+//
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <yara.h>
+
+#include "bench.h"
+#include "util.h"
+
+static const char* read_functions[] = {
+    "uint8",
+    "uint16",
+    "uint32",
+    "uint16be",
+    "uint32be",
+    "int8",
+    "int16",
+    "int32",
+};
+
+static const char* operators[] = {
+    "+", "-", "*", "\\", "%", "&", "|", "^", "<<", ">>"};
+
+#define NUM_READ_FUNCTIONS (sizeof(read_functions) / sizeof(read_functions[0]))
+#define NUM_OPERATORS      (sizeof(operators) / sizeof(operators[0]))
+
+// Appends an arithmetic expression that combines a read at an offset that
+// depends on the loop variable with a couple of constants.
+static void generate_expression(BENCH_TEXT* text, uint32_t* seed)
+{
+  const char* op1 = operators[bench_random(seed) % NUM_OPERATORS];
+  const char* op2 = operators[bench_random(seed) % NUM_OPERATORS];
+
+  // Divisions and shifts use a constant that is never zero and never too
+  // large, other operators can use any small constant.
+  bench_text_printf(
+      text,
+      "((%s(i * %d) %s %d) %s (i + %d))",
+      read_functions[bench_random(seed) % NUM_READ_FUNCTIONS],
+      1 + bench_random(seed) % 8,
+      op1,
+      1 + bench_random(seed) % 31,
+      op2,
+      1 + bench_random(seed) % 7);
+}
+
+static void generate_arithmetic_rules(
+    BENCH_TEXT* text,
+    int num_rules,
+    uint32_t seed)
+{
+  for (int i = 0; i < num_rules; i++)
+  {
+    // The loops compare values with constants that the expressions can't
+    // produce with this input, so they never finish early and the rule never
+    // matches.
+    bench_text_printf(
+        text,
+        "rule r%d { condition: for any i in (0..%d) : (",
+        i,
+        16 + bench_random(&seed) % 48);
+
+    generate_expression(text, &seed);
+    bench_text_printf(
+        text, " == 0x7fff%08x or ", bench_random(&seed) % 0x7fffffff);
+    generate_expression(text, &seed);
+    bench_text_printf(
+        text, " + filesize == 0x7fff%08x", bench_random(&seed) % 0x7fffffff);
+
+    bench_text_printf(text, ") }\n");
+  }
+}
+
+static void generate_call_rules(BENCH_TEXT* text, int num_rules, uint32_t seed)
+{
+  bench_text_printf(text, "import \"tests\"\n");
+
+  for (int i = 0; i < num_rules; i++)
+  {
+    int n = 8 + bench_random(&seed) % 24;
+
+    switch (bench_random(&seed) % 4)
+    {
+    case 0:
+      bench_text_printf(
+          text,
+          "rule r%d { condition: for any i in (0..%d) : "
+          "(tests.isum(i, uint8(i)) == -%d) }\n",
+          i,
+          n,
+          1 + bench_random(&seed) % 1000);
+      break;
+    case 1:
+      bench_text_printf(
+          text,
+          "rule r%d { condition: for any i in (0..%d) : "
+          "(tests.isum(i, uint16(i * 2), %d) == -1) }\n",
+          i,
+          n,
+          bench_random(&seed) % 1000);
+      break;
+    case 2:
+      bench_text_printf(
+          text,
+          "rule r%d { condition: for any i in (0..%d) : "
+          "(tests.fsum(%d.5, 2.0) + i < 0.0 or "
+          "tests.fsum(1.0, 2.0, %d.0) - i < -100.0) }\n",
+          i,
+          n,
+          bench_random(&seed) % 100,
+          bench_random(&seed) % 100);
+      break;
+    case 3:
+      bench_text_printf(
+          text,
+          "rule r%d { condition: for any i in (0..%d) : "
+          "(tests.length(\"%08x\") + i == -%d) }\n",
+          i,
+          n,
+          bench_random(&seed),
+          1 + bench_random(&seed) % 1000);
+      break;
+    }
+  }
+}
+
+// String with many matches in the data generated by fill_matches, one every
+// 16 bytes, with lengths from 3 to 6 bytes.
+#define MATCHING_STRING "$a = /xy[0-9]{0,3}z/"
+
+static void fill_matches(uint8_t* buffer, size_t size, uint32_t seed)
+{
+  bench_random_fill(&seed, buffer, size, 1);
+
+  for (size_t i = 0; i + 16 <= size; i += 16)
+  {
+    size_t digits = (i / 16) % 4;
+
+    memcpy(buffer + i, "xy", 2);
+    memset(buffer + i + 2, '0' + (i / 16) % 10, digits);
+    buffer[i + 2 + digits] = 'z';
+  }
+}
+
+// Offsets and lengths of the matches for $a, in the order in which they
+// appear in the list of matches.
+typedef struct LINEAR_MATCHES
+{
+  int64_t* offsets;
+  int32_t* lengths;
+  int count;
+
+} LINEAR_MATCHES;
+
+static int collect_matches(
+    YR_SCAN_CONTEXT* context,
+    int message,
+    void* message_data,
+    void* user_data)
+{
+  LINEAR_MATCHES* matches = (LINEAR_MATCHES*) user_data;
+  YR_RULE* rule = (YR_RULE*) message_data;
+  YR_STRING* string;
+  YR_MATCH* match;
+
+  if (message != CALLBACK_MSG_RULE_MATCHING)
+    return CALLBACK_CONTINUE;
+
+  yr_rule_strings_foreach(rule, string)
+  {
+    yr_string_matches_foreach(context, string, match)
+    {
+      matches->offsets = realloc(
+          matches->offsets, (matches->count + 1) * sizeof(int64_t));
+      matches->lengths = realloc(
+          matches->lengths, (matches->count + 1) * sizeof(int32_t));
+
+      if (matches->offsets == NULL || matches->lengths == NULL)
+      {
+        fprintf(stderr, "not enough memory\n");
+        exit(EXIT_FAILURE);
+      }
+
+      matches->offsets[matches->count] = match->base + match->offset;
+      matches->lengths[matches->count] = match->match_length;
+      matches->count++;
+    }
+  }
+
+  return CALLBACK_CONTINUE;
+}
+
+static int count_in_range(LINEAR_MATCHES* matches, int64_t from, int64_t to)
+{
+  int count = 0;
+
+  for (int i = 0; i < matches->count; i++)
+    if (matches->offsets[i] >= from && matches->offsets[i] <= to)
+      count++;
+
+  return count;
+}
+
+// Checks that conditions using the match index agree with the matches
+// obtained by walking the list of matches. One rule is generated for each
+// sampled match, with conditions that must be true if the index works, and
+// all the rules must match.
+static void check_match_index(const uint8_t* buffer, size_t size)
+{
+  LINEAR_MATCHES matches = {0};
+  BENCH_TEXT source = {0};
+  YR_RULES* rules;
+
+  bench_compile(
+      "rule collect { strings: " MATCHING_STRING " condition: $a }", &rules);
+
+  if (yr_rules_scan_mem(rules, buffer, size, 0, collect_matches, &matches, 0) !=
+          ERROR_SUCCESS ||
+      matches.count == 0)
+  {
+    fprintf(stderr, "can't collect the matches for the index check\n");
+    exit(EXIT_FAILURE);
+  }
+
+  yr_rules_destroy(rules);
+
+  int step = matches.count > 64 ? matches.count / 64 : 1;
+  int num_rules = 0;
+
+  for (int i = 0; i < matches.count; i += step)
+  {
+    int64_t offset = matches.offsets[i];
+    int64_t gap_end = i + 1 < matches.count ? matches.offsets[i + 1] - 1
+                                            : (int64_t) size;
+
+    bench_text_printf(
+        &source,
+        "rule check%d { strings: " MATCHING_STRING " condition: "
+        "@a[%d] == %" PRId64 " and !a[%d] == %d and $a at %" PRId64 " and "
+        "#a in (%" PRId64 "..%" PRId64 ") == %d and "
+        "$a in (%" PRId64 "..%" PRId64 ")",
+        num_rules++,
+        i + 1,
+        offset,
+        i + 1,
+        matches.lengths[i],
+        offset,
+        offset - 40,
+        offset + 40,
+        count_in_range(&matches, offset - 40, offset + 40),
+        offset,
+        offset + 40);
+
+    // The data between this match and the next one has no matches.
+    if (gap_end > offset)
+      bench_text_printf(
+          &source,
+          " and not $a at %" PRId64 " and not $a in (%" PRId64 "..%" PRId64
+          ")",
+          offset + 1,
+          offset + 1,
+          gap_end);
+
+    bench_text_printf(&source, " }\n");
+  }
+
+  int rules_matching;
+
+  bench_compile(source.data, &rules);
+  bench_scan_mem(rules, buffer, size, 1, &rules_matching);
+
+  if (rules_matching != num_rules)
+  {
+    fprintf(
+        stderr,
+        "match index check failed: %d of %d rules match\n",
+        rules_matching,
+        num_rules);
+    exit(EXIT_FAILURE);
+  }
+
+  printf("match index check passed for %d matches\n\n", matches.count);
+
+  yr_rules_destroy(rules);
+  bench_text_destroy(&source);
+  free(matches.offsets);
+  free(matches.lengths);
+}
+
+// Conditions that look up the matches of $a once per match. Walking the
+// list of matches for each lookup would make them quadratic. Every condition
+// is true for the data generated by fill_matches.
+static const char* match_conditions[][2] = {
+    {"@a[i]", "for all i in (2..#a) : (@a[i] > @a[i - 1])"},
+    {"!a[i]", "for all i in (1..#a) : (!a[i] >= 3)"},
+    {"$a at", "for all i in (1..#a) : ($a at @a[i])"},
+    {"$a in", "for all i in (1..#a) : ($a in (@a[i]..@a[i] + 2))"},
+    {"#a in", "for all i in (1..#a) : (#a in (0..@a[i]) == i)"},
+};
+
+#define NUM_MATCH_CONDITIONS \
+  (sizeof(match_conditions) / sizeof(match_conditions[0]))
+
+static void run(
+    const char* name,
+    YR_RULES* rules,
+    const uint8_t* buffer,
+    size_t size,
+    int scans)
+{
+  int matches;
+  double best = bench_scan_mem(rules, buffer, size, scans, &matches);
+
+  printf("%-24s %10.1f us/scan %8d\n", name, best * 1e6, matches);
+}
+
+static void usage(void)
+{
+  printf(
+      "usage: bench-exec [options]\n"
+      "  -n <number>   number of rules in each generated rule set "
+      "(default 1000)\n"
+      "  -r <file>     use the rules in this source file\n"
+      "  -f <file>     scan this file instead of random data\n"
+      "  -s <size>     size of the random data in KB (default 4)\n"
+      "  -p <number>   number of scans, the fastest is reported "
+      "(default 200)\n"
+      "  -m <number>   number of matches for the match lookups "
+      "(default 4096)\n");
+}
+
+int main(int argc, char** argv)
+{
+  const char* rules_file = NULL;
+  const char* input_file = NULL;
+
+  int num_rules = 1000;
+  int num_matches = 4096;
+  int scans = 200;
+  size_t size = 4;
+
+  int c;
+
+  while ((c = getopt(argc, argv, "n:r:f:s:p:m:h")) != -1)
+  {
+    switch (c)
+    {
+    case 'n':
+      num_rules = atoi(optarg);
+      break;
+    case 'r':
+      rules_file = optarg;
+      break;
+    case 'f':
+      input_file = optarg;
+      break;
+    case 's':
+      size = strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      scans = atoi(optarg);
+      break;
+    case 'm':
+      num_matches = atoi(optarg);
+      break;
+    default:
+      usage();
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (scans < 1)
+    scans = 1;
+
+  if (num_rules < 1)
+    num_rules = 1;
+
+  if (num_matches < 1)
+    num_matches = 1;
+
+  uint8_t* buffer;
+
+  if (input_file != NULL)
+  {
+    int rc = read_file((char*) input_file, (char**) &buffer);
+
+    if (rc < 0)
+    {
+      fprintf(stderr, "can't read %s\n", input_file);
+      return EXIT_FAILURE;
+    }
+
+    size = rc;
+  }
+  else
+  {
+    uint32_t seed = 0x5eed;
+
+    size *= 1024;
+    buffer = malloc(size);
+
+    if (buffer == NULL)
+    {
+      fprintf(stderr, "not enough memory\n");
+      return EXIT_FAILURE;
+    }
+
+    bench_random_fill(&seed, buffer, size, 0);
+  }
+
+  if (yr_initialize() != ERROR_SUCCESS)
+    return EXIT_FAILURE;
+
+  printf("input: %zu bytes, %d scans\n\n", size, scans);
+  printf("%-24s %18s %8s\n", "rules", "time", "matches");
+
+  YR_RULES* rules;
+
+  if (rules_file != NULL)
+  {
+    char* source;
+    int rc = read_file((char*) rules_file, &source);
+
+    if (rc < 0 || (source = realloc(source, rc + 1)) == NULL)
+    {
+      fprintf(stderr, "can't read %s\n", rules_file);
+      return EXIT_FAILURE;
+    }
+
+    source[rc] = '\0';
+    bench_compile(source, &rules);
+    free(source);
+
+    run(rules_file, rules, buffer, size, scans);
+
+    yr_rules_destroy(rules);
+  }
+  else
+  {
+    BENCH_TEXT source = {0};
+    char name[64];
+
+    generate_arithmetic_rules(&source, num_rules, 0x1234);
+    bench_compile(source.data, &rules);
+    bench_text_destroy(&source);
+
+    snprintf(name, sizeof(name), "%d arithmetic", num_rules);
+    run(name, rules, buffer, size, scans);
+    yr_rules_destroy(rules);
+
+    generate_call_rules(&source, num_rules, 0x4321);
+    bench_compile(source.data, &rules);
+    bench_text_destroy(&source);
+
+    snprintf(name, sizeof(name), "%d module calls", num_rules);
+    run(name, rules, buffer, size, scans);
+    yr_rules_destroy(rules);
+
+    size_t matches_size = (size_t) num_matches * 16;
+    uint8_t* matches_buffer = malloc(matches_size);
+
+    if (matches_buffer == NULL)
+    {
+      fprintf(stderr, "not enough memory\n");
+      return EXIT_FAILURE;
+    }
+
+    fill_matches(matches_buffer, matches_size, 0x3a3a);
+
+    printf("\ninput: %zu bytes, %d matches\n", matches_size, num_matches);
+    check_match_index(matches_buffer, matches_size);
+
+    for (size_t i = 0; i < NUM_MATCH_CONDITIONS; i++)
+    {
+      bench_text_printf(
+          &source,
+          "rule r { strings: " MATCHING_STRING " condition: %s }",
+          match_conditions[i][1]);
+
+      bench_compile(source.data, &rules);
+      bench_text_destroy(&source);
+
+      run(match_conditions[i][0], rules, matches_buffer, matches_size, scans);
+      yr_rules_destroy(rules);
+    }
+
+    free(matches_buffer);
+  }
+
+  free(buffer);
+  yr_finalize();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,289 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+//
+// Measures the cost of looking up structure members and dictionary items in
+// module objects, using the "pe" module.
+//
+// Three rule sets are scanned against each input file:
+//
+//   - 2000 rules comparing pe.version_info["..."] items with strings.
+//   - 2000 rules comparing fields of the PE headers with integers.
+//   - A single rule, which measures the time the module takes for filling
+//     its objects (exports, imports, resources, etc).
+//
+// No rule matches, so every condition is evaluated completely. The input
+// files are given as arguments, by default a couple of DLLs from tests/data
+// are used. Run it with -h for the options.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <yara.h>
+
+#include "bench.h"
+#include "util.h"
+
+static const char* version_info_keys[] = {
+    "CompanyName",
+    "FileDescription",
+    "FileVersion",
+    "InternalName",
+    "LegalCopyright",
+    "OriginalFilename",
+    "ProductName",
+    "ProductVersion",
+    // These are usually missing and the lookups return undefined.
+    "Comments",
+    "PrivateBuild",
+    "SpecialBuild",
+};
+
+static const char* header_fields[] = {
+    "machine",
+    "number_of_sections",
+    "timestamp",
+    "characteristics",
+    "entry_point",
+    "image_base",
+    "number_of_rva_and_sizes",
+    "size_of_code",
+    "size_of_image",
+    "size_of_headers",
+    "checksum",
+    "subsystem",
+    "dll_characteristics",
+    "base_of_code",
+    "section_alignment",
+    "file_alignment",
+    "linker_version.major",
+    "os_version.major",
+    "subsystem_version.minor",
+    "number_of_imported_functions",
+    "number_of_exports",
+    "number_of_resources",
+};
+
+#define NUM_VERSION_INFO_KEYS \
+  (sizeof(version_info_keys) / sizeof(version_info_keys[0]))
+
+#define NUM_HEADER_FIELDS (sizeof(header_fields) / sizeof(header_fields[0]))
+
+typedef struct INPUT_FILE
+{
+  const char* name;
+  uint8_t* data;
+  size_t size;
+
+} INPUT_FILE;
+
+static void generate_version_info_rules(
+    BENCH_TEXT* text,
+    int num_rules,
+    uint32_t seed)
+{
+  bench_text_printf(text, "import \"pe\"\n");
+
+  for (int i = 0; i < num_rules; i++)
+  {
+    bench_text_printf(text, "rule r%d { condition: ", i);
+
+    for (int j = 0; j < 3; j++)
+      bench_text_printf(
+          text,
+          "%spe.version_info[\"%s\"] == \"%08x\"",
+          j > 0 ? " or " : "",
+          version_info_keys[bench_random(&seed) % NUM_VERSION_INFO_KEYS],
+          bench_random(&seed));
+
+    bench_text_printf(text, " }\n");
+  }
+}
+
+static void generate_header_rules(BENCH_TEXT* text, int num_rules, uint32_t seed)
+{
+  bench_text_printf(text, "import \"pe\"\n");
+
+  for (int i = 0; i < num_rules; i++)
+  {
+    bench_text_printf(text, "rule r%d { condition: ", i);
+
+    // Values are larger than 32 bits, no field is equal to them.
+    for (int j = 0; j < 3; j++)
+      bench_text_printf(
+          text,
+          "%spe.%s == 0x1%08x",
+          j > 0 ? " or " : "",
+          header_fields[bench_random(&seed) % NUM_HEADER_FIELDS],
+          bench_random(&seed));
+
+    bench_text_printf(text, " }\n");
+  }
+}
+
+static void run(
+    const char* name,
+    const char* source,
+    INPUT_FILE* files,
+    int num_files,
+    int passes)
+{
+  YR_RULES* rules;
+  double total = 0;
+  int total_matches = 0;
+
+  bench_compile(source, &rules);
+
+  for (int i = 0; i < num_files; i++)
+  {
+    int matches;
+
+    total += bench_scan_mem(
+        rules, files[i].data, files[i].size, passes, &matches);
+
+    total_matches += matches;
+  }
+
+  printf("%-24s %10.3f ms/pass %8d\n", name, total * 1e3, total_matches);
+
+  yr_rules_destroy(rules);
+}
+
+static void usage(void)
+{
+  printf(
+      "usage: bench-object [options] [file...]\n"
+      "  -n <number>   number of rules in the generated rule sets "
+      "(default 2000)\n"
+      "  -p <number>   number of passes, the fastest is reported "
+      "(default 20)\n");
+}
+
+int main(int argc, char** argv)
+{
+  static char* default_files[] = {
+      "tests/data/mtxex.dll",
+      "tests/data/"
+      "ca21e1c32065352d352be6cde97f89c141d7737ea92434831f998080783d5386",
+  };
+
+  int num_rules = 2000;
+  int passes = 20;
+
+  int c;
+
+  while ((c = getopt(argc, argv, "n:p:h")) != -1)
+  {
+    switch (c)
+    {
+    case 'n':
+      num_rules = atoi(optarg);
+      break;
+    case 'p':
+      passes = atoi(optarg);
+      break;
+    default:
+      usage();
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (passes < 1)
+    passes = 1;
+
+  if (num_rules < 1)
+    num_rules = 1;
+
+  int num_files = argc - optind;
+
+  if (num_files == 0)
+  {
+    init_top_srcdir();
+    num_files = sizeof(default_files) / sizeof(default_files[0]);
+  }
+
+  INPUT_FILE* files = calloc(num_files, sizeof(INPUT_FILE));
+
+  if (files == NULL)
+  {
+    fprintf(stderr, "not enough memory\n");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; i < num_files; i++)
+  {
+    char* name = optind < argc ? argv[optind + i]
+                               : prefix_top_srcdir(default_files[i]);
+
+    int rc = read_file(name, (char**) &files[i].data);
+
+    if (rc < 0)
+    {
+      fprintf(stderr, "can't read %s\n", name);
+      return EXIT_FAILURE;
+    }
+
+    files[i].name = name;
+    files[i].size = rc;
+  }
+
+  if (yr_initialize() != ERROR_SUCCESS)
+    return EXIT_FAILURE;
+
+  printf("input: %d files, %d passes\n\n", num_files, passes);
+  printf("%-24s %18s %8s\n", "rules", "time", "matches");
+
+  BENCH_TEXT source = {0};
+  char name[64];
+
+  generate_version_info_rules(&source, num_rules, 0x1234);
+  snprintf(name, sizeof(name), "%d version_info", num_rules);
+  run(name, source.data, files, num_files, passes);
+  bench_text_destroy(&source);
+
+  generate_header_rules(&source, num_rules, 0x4321);
+  snprintf(name, sizeof(name), "%d header fields", num_rules);
+  run(name, source.data, files, num_files, passes);
+  bench_text_destroy(&source);
+
+  run("module only",
+      "import \"pe\" rule r { condition: not pe.is_pe }",
+      files,
+      num_files,
+      passes);
+
+  for (int i = 0; i < num_files; i++) free(files[i].data);
+
+  free(files);
+  yr_finalize();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,292 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+//
+// Measures the scanning throughput with and without the Aho-Corasick
+// prefilter (see yr_ac_prefilter_create).
+//
+// By default it generates rule sets of 5000, 10000 and 20000 rules with one
+// text string each, and scans 64 MB of random bytes with each of them. Run it
+// with -h for the options that change the rules and the input.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <yara.h>
+
+#include "bench.h"
+#include "util.h"
+
+static void generate_rules(
+    BENCH_TEXT* text,
+    int num_rules,
+    int hex_percent,
+    uint32_t seed)
+{
+  for (int i = 0; i < num_rules; i++)
+  {
+    uint8_t string[16];
+    int length = 8 + bench_random(&seed) % 9;
+
+    bench_text_printf(text, "rule r%d { strings: $a = ", i);
+
+    if ((int) (bench_random(&seed) % 100) < hex_percent)
+    {
+      bench_random_fill(&seed, string, length, 0);
+      bench_text_printf(text, "{ ");
+
+      for (int j = 0; j < length; j++)
+      {
+        // Make one byte in the middle a wildcard, as in typical hex strings.
+        if (j == length / 2)
+          bench_text_printf(text, "?? ");
+        else
+          bench_text_printf(text, "%02X ", string[j]);
+      }
+
+      bench_text_printf(text, "}");
+    }
+    else
+    {
+      bench_random_fill(&seed, string, length, 1);
+      bench_text_printf(text, "\"%.*s\"", length, string);
+    }
+
+    bench_text_printf(text, " condition: $a }\n");
+  }
+}
+
+static void run(
+    const char* name,
+    YR_RULES* rules,
+    const uint8_t* buffer,
+    size_t size,
+    int passes)
+{
+  int matches;
+
+  double with_prefilter = bench_scan_mem(
+      rules, buffer, size, passes, &matches);
+
+  // Temporarily remove the prefilter for measuring the scan with the plain
+  // transition table loop.
+  YR_AC_PREFILTER* prefilter = rules->ac_prefilter;
+  rules->ac_prefilter = NULL;
+
+  double without_prefilter = bench_scan_mem(rules, buffer, size, passes, NULL);
+
+  rules->ac_prefilter = prefilter;
+
+  printf(
+      "%-24s %8.3f GB/s %8.3f GB/s %8s %8d\n",
+      name,
+      size / without_prefilter / 1e9,
+      size / with_prefilter / 1e9,
+      prefilter != NULL ? "yes" : "no",
+      matches);
+}
+
+static void usage(void)
+{
+  printf(
+      "usage: bench-prefilter [options]\n"
+      "  -n <number>   generate a rule set with this number of rules\n"
+      "  -x <percent>  percentage of generated rules using hex strings\n"
+      "  -r <file>     use the rules in this source file\n"
+      "  -C <file>     use the rules in this compiled file\n"
+      "  -f <file>     scan this file instead of random data\n"
+      "  -s <size>     size of the random data in MB (default 64)\n"
+      "  -t            generate random text instead of random bytes\n"
+      "  -p <number>   number of passes, the fastest is reported "
+      "(default 3)\n");
+}
+
+int main(int argc, char** argv)
+{
+  const char* rules_file = NULL;
+  const char* compiled_rules_file = NULL;
+  const char* input_file = NULL;
+
+  int num_rules = 0;
+  int hex_percent = 0;
+  int passes = 3;
+  int text_input = 0;
+  size_t size = 64;
+
+  int c;
+
+  while ((c = getopt(argc, argv, "n:x:r:C:f:s:tp:h")) != -1)
+  {
+    switch (c)
+    {
+    case 'n':
+      num_rules = atoi(optarg);
+      break;
+    case 'x':
+      hex_percent = atoi(optarg);
+      break;
+    case 'r':
+      rules_file = optarg;
+      break;
+    case 'C':
+      compiled_rules_file = optarg;
+      break;
+    case 'f':
+      input_file = optarg;
+      break;
+    case 's':
+      size = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      text_input = 1;
+      break;
+    case 'p':
+      passes = atoi(optarg);
+      break;
+    default:
+      usage();
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (passes < 1)
+    passes = 1;
+
+  uint8_t* buffer;
+
+  if (input_file != NULL)
+  {
+    int rc = read_file((char*) input_file, (char**) &buffer);
+
+    if (rc < 0)
+    {
+      fprintf(stderr, "can't read %s\n", input_file);
+      return EXIT_FAILURE;
+    }
+
+    size = rc;
+  }
+  else
+  {
+    uint32_t seed = 0x5eed;
+
+    size *= 1024 * 1024;
+    buffer = malloc(size);
+
+    if (buffer == NULL)
+    {
+      fprintf(stderr, "not enough memory\n");
+      return EXIT_FAILURE;
+    }
+
+    bench_random_fill(&seed, buffer, size, text_input);
+  }
+
+  if (yr_initialize() != ERROR_SUCCESS)
+    return EXIT_FAILURE;
+
+  printf("input: %zu bytes, %d passes\n\n", size, passes);
+  printf(
+      "%-24s %13s %13s %8s %8s\n",
+      "rules",
+      "no prefilter",
+      "prefilter",
+      "enabled",
+      "matches");
+
+  YR_RULES* rules;
+
+  if (rules_file != NULL || compiled_rules_file != NULL)
+  {
+    if (rules_file != NULL)
+    {
+      char* source;
+      int rc = read_file((char*) rules_file, &source);
+
+      if (rc < 0 || (source = realloc(source, rc + 1)) == NULL)
+      {
+        fprintf(stderr, "can't read %s\n", rules_file);
+        return EXIT_FAILURE;
+      }
+
+      source[rc] = '\0';
+      bench_compile(source, &rules);
+      free(source);
+    }
+    else if (yr_rules_load(compiled_rules_file, &rules) != ERROR_SUCCESS)
+    {
+      fprintf(stderr, "can't load %s\n", compiled_rules_file);
+      return EXIT_FAILURE;
+    }
+
+    run(rules_file != NULL ? rules_file : compiled_rules_file,
+        rules,
+        buffer,
+        size,
+        passes);
+
+    yr_rules_destroy(rules);
+  }
+  else
+  {
+    int default_num_rules[] = {5000, 10000, 20000};
+    int n = num_rules > 0 ? 1 : 3;
+
+    for (int i = 0; i < n; i++)
+    {
+      BENCH_TEXT source = {0};
+      char name[64];
+
+      if (num_rules > 0)
+        default_num_rules[i] = num_rules;
+
+      generate_rules(&source, default_num_rules[i], hex_percent, 0x1234 + i);
+      bench_compile(source.data, &rules);
+      bench_text_destroy(&source);
+
+      snprintf(
+          name,
+          sizeof(name),
+          "%d (%d%% hex)",
+          default_num_rules[i],
+          hex_percent);
+
+      run(name, rules, buffer, size, passes);
+
+      yr_rules_destroy(rules);
+    }
+  }
+
+  free(buffer);
+  yr_finalize();
+
+  return EXIT_SUCCESS;
+}
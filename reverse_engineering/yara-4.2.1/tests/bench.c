@@ -0,0 +1,174 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bench.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util.h"
+
+void bench_text_printf(BENCH_TEXT* text, const char* fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  int length = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+
+  if (text->length + length + 1 > text->capacity)
+  {
+    size_t capacity = text->capacity == 0 ? 65536 : text->capacity;
+
+    while (text->length + length + 1 > capacity) capacity *= 2;
+
+    char* data = realloc(text->data, capacity);
+
+    if (data == NULL)
+    {
+      fprintf(stderr, "not enough memory\n");
+      exit(EXIT_FAILURE);
+    }
+
+    text->data = data;
+    text->capacity = capacity;
+  }
+
+  va_start(args, fmt);
+  vsnprintf(text->data + text->length, length + 1, fmt, args);
+  va_end(args);
+
+  text->length += length;
+}
+
+void bench_text_destroy(BENCH_TEXT* text)
+{
+  free(text->data);
+
+  text->data = NULL;
+  text->length = 0;
+  text->capacity = 0;
+}
+
+uint32_t bench_random(uint32_t* seed)
+{
+  // xorshift32
+  uint32_t x = *seed;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  *seed = x;
+
+  return x;
+}
+
+void bench_random_fill(uint32_t* seed, uint8_t* buffer, size_t size, int text)
+{
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+  for (size_t i = 0; i < size; i++)
+  {
+    uint32_t r = bench_random(seed);
+
+    if (text)
+      buffer[i] = alphabet[r % (sizeof(alphabet) - 1)];
+    else
+      buffer[i] = (uint8_t) (r >> 24);
+  }
+}
+
+void bench_compile(const char* source, YR_RULES** rules)
+{
+  if (compile_rule((char*) source, rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "failed to compile rules: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+}
+
+double bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _bench_count_matches(
+    YR_SCAN_CONTEXT* context,
+    int message,
+    void* message_data,
+    void* user_data)
+{
+  if (message == CALLBACK_MSG_RULE_MATCHING)
+    (*(int*) user_data)++;
+
+  return CALLBACK_CONTINUE;
+}
+
+double bench_scan_mem(
+    YR_RULES* rules,
+    const uint8_t* buffer,
+    size_t size,
+    int passes,
+    int* matches)
+{
+  double best = 0;
+
+  for (int i = 0; i < passes; i++)
+  {
+    int count = 0;
+    double start = bench_now();
+
+    int result = yr_rules_scan_mem(
+        rules, buffer, size, 0, _bench_count_matches, &count, 0);
+
+    double elapsed = bench_now() - start;
+
+    if (result != ERROR_SUCCESS)
+    {
+      fprintf(stderr, "scan failed with error %d\n", result);
+      exit(EXIT_FAILURE);
+    }
+
+    if (i == 0 || elapsed < best)
+      best = elapsed;
+
+    if (matches != NULL)
+      *matches = count;
+  }
+
+  return best;
+}
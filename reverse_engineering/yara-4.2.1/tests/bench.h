@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <yara.h>
+
+//
+// Helpers shared by the benchmark programs (bench-*.c). Benchmarks are not
+// run by "make check", they are built on demand with "make bench".
+//
+
+typedef struct BENCH_TEXT BENCH_TEXT;
+
+// Growing buffer where benchmarks generate the source code of their rules.
+struct BENCH_TEXT
+{
+  char* data;
+  size_t length;
+  size_t capacity;
+};
+
+// Appends formatted text to the buffer. Exits if there's not enough memory.
+void bench_text_printf(BENCH_TEXT* text, const char* fmt, ...);
+
+void bench_text_destroy(BENCH_TEXT* text);
+
+// Returns a pseudo-random number and updates the seed. Benchmarks use a fixed
+// seed so that every run generates the same rules and input data.
+uint32_t bench_random(uint32_t* seed);
+
+// Fills the buffer with random lowercase letters and digits, or with random
+// bytes if text is false.
+void bench_random_fill(uint32_t* seed, uint8_t* buffer, size_t size, int text);
+
+// Returns the value of a monotonic clock in seconds.
+double bench_now(void);
+
+// Compiles the given source code. Exits with an error message if the source
+// can't be compiled.
+void bench_compile(const char* source, YR_RULES** rules);
+
+// Scans the buffer "passes" times with yr_rules_scan_mem and returns the time
+// in seconds taken by the fastest pass. If matches is not NULL, it receives
+// the number of matching rules.
+double bench_scan_mem(
+    YR_RULES* rules,
+    const uint8_t* buffer,
+    size_t size,
+    int passes,
+    int* matches);
+
+#endif
@@ -0,0 +1,691 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+//
+// Compares the matches found by the different ways of scanning the same data
+// with the ones found by yr_scanner_scan_mem on the whole buffer. Every match
+// is compared, including its offset, length and data.
+//
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yara.h>
+#include <yara/ahocorasick.h>
+
+#include "util.h"
+
+// Number of threads used by the scanners created by create_scanner, see
+// yr_scanner_set_threads.
+static int num_threads = 1;
+
+// Text describing the matches found by a scan, one line per match.
+typedef struct MATCH_LOG
+{
+  char* text;
+  size_t length;
+  size_t capacity;
+  int num_matches;
+
+} MATCH_LOG;
+
+static void log_append(MATCH_LOG* log, const char* line)
+{
+  size_t line_length = strlen(line);
+
+  if (log->length + line_length + 1 > log->capacity)
+  {
+    log->capacity = (log->capacity + line_length + 1) * 2;
+    log->text = realloc(log->text, log->capacity);
+
+    if (log->text == NULL)
+    {
+      fprintf(stderr, "not enough memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  memcpy(log->text + log->length, line, line_length + 1);
+  log->length += line_length;
+}
+
+static uint32_t hash_data(const uint8_t* data, int32_t length)
+{
+  uint32_t hash = 2166136261u;
+
+  for (int32_t i = 0; i < length; i++)
+    hash = (hash ^ data[i]) * 16777619u;
+
+  return hash;
+}
+
+static int log_matches(
+    YR_SCAN_CONTEXT* context,
+    int message,
+    void* message_data,
+    void* user_data)
+{
+  MATCH_LOG* log = (MATCH_LOG*) user_data;
+  YR_RULE* rule = (YR_RULE*) message_data;
+  YR_STRING* string;
+  YR_MATCH* match;
+
+  char line[256];
+
+  if (message != CALLBACK_MSG_RULE_MATCHING)
+    return CALLBACK_CONTINUE;
+
+  yr_rule_strings_foreach(rule, string)
+  {
+    yr_string_matches_foreach(context, string, match)
+    {
+      snprintf(
+          line,
+          sizeof(line),
+          "%s %s @%" PRIu64 " +%d data=%d:%08x\n",
+          rule->identifier,
+          string->identifier,
+          match->base + match->offset,
+          match->match_length,
+          match->data_length,
+          hash_data(match->data, match->data_length));
+
+      log_append(log, line);
+      log->num_matches++;
+    }
+  }
+
+  snprintf(line, sizeof(line), "%s\n", rule->identifier);
+  log_append(log, line);
+
+  return CALLBACK_CONTINUE;
+}
+
+static YR_SCANNER* create_scanner(YR_RULES* rules, MATCH_LOG* log)
+{
+  YR_SCANNER* scanner;
+
+  memset(log, 0, sizeof(MATCH_LOG));
+
+  if (yr_scanner_create(rules, &scanner) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "yr_scanner_create failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  yr_scanner_set_callback(scanner, log_matches, log);
+  yr_scanner_set_threads(scanner, num_threads);
+
+  return scanner;
+}
+
+static void scan_whole(
+    YR_RULES* rules,
+    const uint8_t* data,
+    size_t size,
+    MATCH_LOG* log)
+{
+  YR_SCANNER* scanner = create_scanner(rules, log);
+
+  if (yr_scanner_scan_mem(scanner, data, size) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "yr_scanner_scan_mem failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  yr_scanner_destroy(scanner);
+}
+
+// Scans the data as adjacent blocks of block_size bytes with
+// SCAN_FLAGS_CONTIGUOUS_BLOCKS.
+static void scan_blocks(
+    YR_RULES* rules,
+    const uint8_t* data,
+    size_t size,
+    size_t block_size,
+    MATCH_LOG* log)
+{
+  YR_SCANNER* scanner = create_scanner(rules, log);
+  YR_MEMORY_BLOCK_ITERATOR iterator;
+  YR_TEST_ITERATOR_CTX iterator_ctx;
+
+  yr_test_mem_block_size = block_size;
+  yr_test_mem_block_size_overlap = 0;
+
+  init_test_iterator(&iterator, &iterator_ctx, data, size);
+
+  yr_scanner_set_flags(scanner, SCAN_FLAGS_CONTIGUOUS_BLOCKS);
+
+  if (yr_scanner_scan_mem_blocks(scanner, &iterator) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "yr_scanner_scan_mem_blocks failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  yr_test_mem_block_size = 0;
+  yr_scanner_destroy(scanner);
+}
+
+// Feeds the data to yr_scanner_scan_feed in chunks of chunk_size bytes.
+static void scan_stream(
+    YR_RULES* rules,
+    const uint8_t* data,
+    size_t size,
+    size_t chunk_size,
+    MATCH_LOG* log)
+{
+  YR_SCANNER* scanner = create_scanner(rules, log);
+
+  int result = yr_scanner_scan_begin(scanner);
+
+  for (size_t i = 0; i < size && result == ERROR_SUCCESS; i += chunk_size)
+    result = yr_scanner_scan_feed(
+        scanner, data + i, chunk_size < size - i ? chunk_size : size - i);
+
+  if (result == ERROR_SUCCESS)
+    result = yr_scanner_scan_end(scanner);
+
+  if (result != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "stream scan failed: %d\n", result);
+    exit(EXIT_FAILURE);
+  }
+
+  yr_scanner_destroy(scanner);
+}
+
+static void assert_same_matches(
+    const char* name,
+    size_t chunk_size,
+    MATCH_LOG* expected,
+    MATCH_LOG* actual)
+{
+  if (expected->length != actual->length ||
+      memcmp(expected->text, actual->text, expected->length) != 0)
+  {
+    fprintf(
+        stderr,
+        "%s with chunks of %zu bytes: matches differ\n"
+        "expected:\n%s\nactual:\n%s\n",
+        name,
+        chunk_size,
+        expected->text,
+        actual->text);
+
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Fills the buffer with random letters from a small alphabet, so that the
+// strings in the rules below match many times at random offsets.
+static void random_fill(uint8_t* buffer, size_t size, uint32_t seed)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    buffer[i] = "abceg"[(seed >> 16) % 5];
+  }
+}
+
+// Fills the buffer with random bytes, and copies the given strings at random
+// offsets, including the very end of the buffer.
+static void random_fill_bytes(
+    uint8_t* buffer,
+    size_t size,
+    uint32_t seed,
+    const char** strings,
+    int num_strings)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    buffer[i] = (uint8_t) (seed >> 16);
+  }
+
+  for (size_t i = 0; i < size / 64; i++)
+  {
+    const char* string = strings[i % num_strings];
+    size_t length = strlen(string);
+
+    seed = seed * 1103515245 + 12345;
+
+    size_t offset = i == 0 ? size - length : (seed >> 4) % (size - length);
+
+    memcpy(buffer + offset, string, length);
+  }
+}
+
+// Rules with strings that are split in chains (hex strings and regexps with
+// large jumps), whose parts can be found in different blocks, and some other
+// strings for comparison.
+static char* chained_rules =
+    "rule chained_hex { strings: $a = { 67 61 63 [26-755] 62 65 65 } "
+    "condition: $a }"
+    "rule chained_hex_3 { strings: $a = { 61 62 [300-500] 63 65 [250-1000] "
+    "67 67 } condition: $a }"
+    "rule chained_re { strings: $a = /bee.{210,600}cab/s condition: $a }"
+    "rule chained_long { strings: $a = { 67 67 67 67 [10000-30000] 61 61 61 "
+    "61 } condition: $a }"
+    "rule literals { strings: $a = \"gabe\" $b = \"CECA\" nocase "
+    "condition: any of them }"
+    "rule hex { strings: $a = { 62 ?? 63 [2-30] 61 61 } condition: $a }"
+    "rule re { strings: $a = /ab[c-e]{2,8}ga/ condition: $a }";
+
+static size_t chunk_sizes[] = {70000, 16384, 8320, 4097, 1000, 100};
+
+#define NUM_CHUNK_SIZES (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))
+
+static void test_contiguous_blocks()
+{
+  YR_RULES* rules;
+  MATCH_LOG expected;
+  MATCH_LOG actual;
+
+  size_t size = 150000;
+  uint8_t* data = (uint8_t*) malloc(size);
+
+  random_fill(data, size, 1);
+
+  if (compile_rule(chained_rules, &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "compile_rule: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+
+  scan_whole(rules, data, size, &expected);
+
+  assert_true_expr(expected.num_matches > 0);
+
+  for (size_t i = 0; i < NUM_CHUNK_SIZES; i++)
+  {
+    scan_blocks(rules, data, size, chunk_sizes[i], &actual);
+    assert_same_matches("blocks", chunk_sizes[i], &expected, &actual);
+    free(actual.text);
+  }
+
+  free(expected.text);
+  yr_rules_destroy(rules);
+
+  // The "gac" at offset 66543 of the first block and the "bee" at the same
+  // offset plus 225 in the second block are too far away from each other,
+  // but they were reported as a match when the offsets of the parts of the
+  // chain were compared without taking the block into account.
+  memset(data, '.', size);
+  memcpy(data + 66543, "gac", 3);
+  memcpy(data + 70000 + 66543 + 225, "bee", 3);
+
+  if (compile_rule(
+          "rule test { strings: $a = { 67 61 63 [26-755] 62 65 65 } "
+          "condition: $a }",
+          &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "compile_rule: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+
+  scan_blocks(rules, data, size, 70000, &actual);
+  assert_true_expr(actual.num_matches == 0);
+  free(actual.text);
+
+  yr_rules_destroy(rules);
+  free(data);
+}
+
+static void test_stream()
+{
+  YR_RULES* rules;
+  MATCH_LOG expected;
+  MATCH_LOG actual;
+
+  size_t size = 150000;
+  uint8_t* data = (uint8_t*) malloc(size);
+
+  random_fill(data, size, 2);
+
+  if (compile_rule(chained_rules, &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "compile_rule: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+
+  scan_whole(rules, data, size, &expected);
+
+  assert_true_expr(expected.num_matches > 0);
+
+  for (size_t i = 0; i < NUM_CHUNK_SIZES; i++)
+  {
+    scan_stream(rules, data, size, chunk_sizes[i], &actual);
+    assert_same_matches("stream", chunk_sizes[i], &expected, &actual);
+    free(actual.text);
+  }
+
+  free(expected.text);
+  yr_rules_destroy(rules);
+
+  // Same as in test_contiguous_blocks, but feeding the data in chunks.
+  memset(data, '.', size);
+  memcpy(data + 66543, "gac", 3);
+  memcpy(data + 70000 + 66543 + 225, "bee", 3);
+
+  if (compile_rule(
+          "rule test { strings: $a = { 67 61 63 [26-755] 62 65 65 } "
+          "condition: $a }",
+          &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "compile_rule: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+
+  scan_stream(rules, data, size, 70000, &actual);
+  assert_true_expr(actual.num_matches == 0);
+  free(actual.text);
+
+  yr_rules_destroy(rules);
+  free(data);
+}
+
+// Rules whose atoms start with few different pairs of bytes, so that the
+// Aho-Corasick prefilter is used with them.
+static char* prefilter_rules =
+    "rule mz { strings: $a = { 4D 5A 90 00 } $b = { E8 ?? ?? ?? ?? 5D C3 } "
+    "condition: any of them }"
+    "rule text { strings: $a = \"http://\" nocase $b = \"kernel32\" wide "
+    "$c = \"Zz\" condition: any of them }"
+    "rule regexp { strings: $a = /GetProc[A-Z][a-z]+/ $b = /\\x01\\x02.\\x04/ "
+    "condition: any of them }"
+    "rule xored { strings: $a = \"secret\" xor(1-3) condition: $a }";
+
+static const char* prefilter_strings[] = {
+    "MZ\x90\x00",
+    "\xe8\x01\x02\x03\x04\x5d\xc3",
+    "HTTP://",
+    "k\0e\0r\0n\0e\0l\0003\0002\0",
+    "Zz",
+    "GetProcAddress",
+    "\x01\x02\xff\x04",
+    "rdbsdu",
+};
+
+// Compares the matches found with each implementation of the prefilter, and
+// without it, for several sizes and alignments of the data.
+static void test_prefilter()
+{
+  YR_RULES* rules;
+  MATCH_LOG expected;
+  MATCH_LOG actual;
+
+  int implementations[] = {
+      YR_AC_PREFILTER_SCALAR, YR_AC_PREFILTER_SSE42, YR_AC_PREFILTER_AVX2};
+
+  size_t size = 20000;
+  uint8_t* data = (uint8_t*) malloc(size);
+
+  random_fill_bytes(
+      data,
+      size,
+      3,
+      prefilter_strings,
+      sizeof(prefilter_strings) / sizeof(prefilter_strings[0]));
+
+  if (compile_rule(prefilter_rules, &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "compile_rule: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+
+  YR_AC_PREFILTER* prefilter = rules->ac_prefilter;
+
+  assert_true_expr(prefilter != NULL);
+
+  for (size_t start = 0; start < 64; start += 7)
+  {
+    for (size_t end = size - 64; end <= size; end += 9)
+    {
+      rules->ac_prefilter = NULL;
+      scan_whole(rules, data + start, end - start, &expected);
+      rules->ac_prefilter = prefilter;
+
+      assert_true_expr(expected.num_matches > 0);
+
+      for (int i = 0; i < 3; i++)
+      {
+        if (yr_ac_prefilter_set_find(prefilter, implementations[i]) !=
+            ERROR_SUCCESS)
+          continue;
+
+        scan_whole(rules, data + start, end - start, &actual);
+        assert_same_matches("prefilter", end - start, &expected, &actual);
+        free(actual.text);
+      }
+
+      free(expected.text);
+    }
+  }
+
+  yr_rules_destroy(rules);
+  free(data);
+}
+
+// Compares the matches found when large blocks are split in segments that
+// are scanned in parallel with the ones found by a single thread.
+static void test_segments()
+{
+  YR_RULES* rules;
+  MATCH_LOG expected;
+  MATCH_LOG actual;
+
+  size_t size = 4 * YR_MIN_SCAN_SEGMENT_SIZE + 12345;
+  uint8_t* data = (uint8_t*) malloc(size);
+
+  random_fill(data, size, 4);
+
+  if (compile_rule(chained_rules, &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "compile_rule: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+
+  num_threads = 1;
+  scan_whole(rules, data, size, &expected);
+
+  assert_true_expr(expected.num_matches > 0);
+
+  num_threads = 4;
+  scan_whole(rules, data, size, &actual);
+  assert_same_matches("segments", size, &expected, &actual);
+  free(actual.text);
+
+  // Adjacent blocks large enough for being split in segments too.
+  scan_blocks(rules, data, size, 2 * YR_MIN_SCAN_SEGMENT_SIZE + 1, &actual);
+  assert_same_matches(
+      "segments in blocks",
+      2 * YR_MIN_SCAN_SEGMENT_SIZE + 1,
+      &expected,
+      &actual);
+  free(actual.text);
+
+  num_threads = 1;
+
+  free(expected.text);
+  yr_rules_destroy(rules);
+  free(data);
+}
+
+// Offsets and lengths of the matches of a string, as found in the list of
+// matches.
+typedef struct MATCH_LIST
+{
+  int64_t offsets[4096];
+  int32_t lengths[4096];
+  int count;
+
+} MATCH_LIST;
+
+static int collect_matches(
+    YR_SCAN_CONTEXT* context,
+    int message,
+    void* message_data,
+    void* user_data)
+{
+  MATCH_LIST* list = (MATCH_LIST*) user_data;
+  YR_RULE* rule = (YR_RULE*) message_data;
+  YR_STRING* string;
+  YR_MATCH* match;
+
+  if (message != CALLBACK_MSG_RULE_MATCHING)
+    return CALLBACK_CONTINUE;
+
+  yr_rule_strings_foreach(rule, string)
+  {
+    yr_string_matches_foreach(context, string, match)
+    {
+      assert_true_expr(list->count < 4096);
+
+      list->offsets[list->count] = match->base + match->offset;
+      list->lengths[list->count] = match->match_length;
+      list->count++;
+    }
+  }
+
+  return CALLBACK_CONTINUE;
+}
+
+// Checks that "@a[i]", "!a[i]", "$a at", "$a in" and "#a in", which use the
+// match index, agree with the list of matches. A rule is generated for each
+// match with conditions that are true according to the list, and every rule
+// must match.
+static void test_match_index()
+{
+  YR_RULES* rules;
+  MATCH_LIST* list = (MATCH_LIST*) calloc(1, sizeof(MATCH_LIST));
+
+  size_t size = 30000;
+  uint8_t* data = (uint8_t*) malloc(size);
+
+  random_fill(data, size, 5);
+
+  if (compile_rule(
+          "rule collect { strings: $a = /ga[bc]{1,3}e/ condition: $a }",
+          &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "compile_rule: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+
+  assert_true_expr(
+      yr_rules_scan_mem(rules, data, size, 0, collect_matches, list, 0) ==
+      ERROR_SUCCESS);
+
+  yr_rules_destroy(rules);
+
+  assert_true_expr(list->count > 100);
+
+  size_t source_size = list->count * 512;
+  char* source = (char*) malloc(source_size);
+  size_t length = 0;
+
+  for (int i = 0; i < list->count; i++)
+  {
+    int64_t offset = list->offsets[i];
+    int64_t next = i + 1 < list->count ? list->offsets[i + 1] : (int64_t) size;
+    int in_range = 0;
+
+    for (int j = 0; j < list->count; j++)
+      if (list->offsets[j] >= offset - 50 && list->offsets[j] <= offset + 50)
+        in_range++;
+
+    length += snprintf(
+        source + length,
+        source_size - length,
+        "rule r%d { strings: $a = /ga[bc]{1,3}e/ condition: "
+        "@a[%d] == %" PRId64 " and !a[%d] == %d and $a at %" PRId64
+        " and $a in (%" PRId64 "..%" PRId64 ") and "
+        "#a in (%" PRId64 "..%" PRId64 ") == %d and "
+        "not $a in (%" PRId64 "..%" PRId64 ") }\n",
+        i,
+        i + 1,
+        offset,
+        i + 1,
+        list->lengths[i],
+        offset,
+        offset - 3,
+        offset + 3,
+        offset - 50,
+        offset + 50,
+        in_range,
+        offset + 1,
+        next - 1);
+  }
+
+  if (compile_rule(source, &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "compile_rule: %s\n", compile_error);
+    exit(EXIT_FAILURE);
+  }
+
+  struct COUNTERS counters = {0};
+
+  assert_true_expr(
+      yr_rules_scan_mem(rules, data, size, 0, count, &counters, 0) ==
+      ERROR_SUCCESS);
+
+  assert_true_expr(counters.rules_matching == list->count);
+  assert_true_expr(counters.rules_not_matching == 0);
+
+  yr_rules_destroy(rules);
+  free(source);
+  free(list);
+  free(data);
+}
+
+int main(int argc, char** argv)
+{
+  int result = 0;
+
+  YR_DEBUG_INITIALIZE();
+  YR_DEBUG_FPRINTF(1, stderr, "+ %s() { // in %s\n", __FUNCTION__, argv[0]);
+
+  init_top_srcdir();
+
+  yr_initialize();
+
+  test_prefilter();
+  test_contiguous_blocks();
+  test_stream();
+  test_segments();
+  test_match_index();
+
+  yr_finalize();
+
+  YR_DEBUG_FPRINTF(
+      1, stderr, "} = %d // %s() in %s\n", result, __FUNCTION__, argv[0]);
+
+  return result;
+}